@@ -56,10 +56,163 @@ export interface Reader {
     index: number;
     name: string;
     atr: string;
+    prefetched: string[] | undefined;
+    prefetchIncomplete: boolean | undefined;
     connected: boolean | undefined;
-    connect(shared?: boolean): Promise<string>;
+    connect(shared?: boolean, priority?: number, restore?: string[], elideSelect?: boolean): Promise<string>;
     disconnect(): Promise<void>;
-    transceive(apdu: string): Promise<string>;
+    transceive(apdu: string, timeout?: number): Promise<string>;
+    setDebounce(window: number): Promise<DebounceInfo[]>;
+}
+
+export interface DebounceInfo {
+    w: number;
+    s: number;
+}
+
+export interface CacheOptions {
+    budget?: number;
+    instructions?: string;
+}
+
+export interface CacheStats {
+    p: number;
+    b: number;
+    n: number;
+    h: number;
+    m: number;
+    e: number;
+    s?: number;
+}
+
+export interface CardCacheOptions {
+    size?: number;
+    serialApdu?: string;
+    lifetime?: number;
+}
+
+export interface CardCacheStats extends CacheStats {
+    x: number;
+}
+
+export interface EventFilters {
+    e?: number[];
+    r?: number[];
+    a?: string;
+    m?: string;
+}
+
+export interface PrefetchScript {
+    k?: string;
+    r?: number[];
+    a?: string;
+    m?: string;
+    d: string[];
+}
+
+export interface HistogramSummary {
+    n: number;
+    min: number;
+    mean: number;
+    p50: number;
+    p90: number;
+    p99: number;
+    p999: number;
+    max: number;
+}
+
+export interface WebCardStats {
+    t: number;
+    c: {
+        c: number;
+        f: number;
+        read: HistogramSummary;
+        parse: HistogramSummary;
+        run: HistogramSummary;
+        serialize: HistogramSummary;
+        write: HistogramSummary;
+        total: HistogramSummary;
+    }[];
+    r: { n: string; x: HistogramSummary; w: HistogramSummary }[];
+    o?: OutputStats;
+}
+
+export interface OutputStats {
+    n: number;
+    b: number;
+    p: number;
+    m: number;
+    c: number;
+    w: number;
+    l: number;
+}
+
+export interface TraceStats {
+    p: number;
+    b: number;
+    n: number;
+    x: number;
+}
+
+export interface LogState {
+    p: number;
+    x: number;
+}
+
+export interface LingerState {
+    p: number;
+    n: number;
+    h: number;
+    m: number;
+    x: number;
+}
+
+export interface FanOutResult {
+    r?: number;
+    d: string[];
+    incomplete?: boolean;
+}
+
+export interface FanOutOptions {
+    readers?: number[];
+    atr?: string;
+    mask?: string;
+    onResult?: (result: FanOutResult) => void;
+}
+
+export interface JobOptions {
+    script?: string[];
+    readers?: number[];
+    atr?: string;
+    mask?: string;
+    queue?: string[][];
+    clear?: boolean;
+    reset?: boolean;
+}
+
+export interface JobReaderState {
+    n: string;
+    j: number;
+    f: number;
+    t: number;
+    u: number;
+}
+
+export interface JobQueueState {
+    p: number;
+    b: number;
+    n: number;
+    f: number;
+    h: number;
+    k?: number;
+    r: JobReaderState[];
+}
+
+export interface JobResult {
+    j: number;
+    d: string[];
+    t: number;
+    incomplete?: boolean;
 }
 
 export interface WebCardVersions {
@@ -73,14 +226,28 @@ export interface WebCard {
     installerUrl: string;
     pendingRequests: Map<string, unknown>;
     readers(): Promise<Reader[]>;
+    setDebounce(window: number): Promise<DebounceInfo[]>;
+    subscribe(filters?: EventFilters): Promise<void>;
+    unsubscribe(): Promise<void>;
+    configureCache(options?: CacheOptions): Promise<CacheStats>;
+    configureCardCache(options?: CardCacheOptions): Promise<CardCacheStats>;
+    setPrefetch(script: PrefetchScript): Promise<void>;
+    getStats(reset?: boolean): Promise<WebCardStats>;
+    trace(size?: number): Promise<TraceStats>;
+    setLogLevel(level?: number): Promise<LogState>;
+    cancel(uid: string): Promise<number>;
+    setLinger(time?: number): Promise<LingerState>;
+    fanOut(apdus: string[], options?: FanOutOptions): Promise<FanOutResult[]>;
+    jobs(options?: JobOptions): Promise<JobQueueState>;
     getVersions(): Promise<WebCardVersions>;
-    send(cmdIdx: number, otherParams?: object): Promise<unknown>;
+    send(cmdIdx: number, otherParams?: object, onUpdate?: (update: unknown) => void): Promise<unknown>;
     sendEx(cmdIdx: number, otherParams?: object): { promise: Promise<unknown>; uid: string | undefined };
     responseCallback(msg: object): void;
     cardInserted?: (reader: Reader) => void;
     cardRemoved?: (reader: Reader) => void;
     readersConnected?: (count: number) => void;
     readersDisconnected?: (count: number) => void;
+    jobDone?: (result: JobResult, reader?: Reader) => void;
 }
 
 export class Reader {
@@ -8,6 +8,28 @@ let nativePort;
 // All the tabs that use "WebCard" extension.
 let contentPorts = new Map();
 
+// Reader Event subscriptions of the tabs:
+// (senderId) => (last [subscribe] request, without the message id).
+// Tabs that never subscribed receive every event.
+let subscriptions = new Map();
+
+// Tabs that explicitly unsubscribed from all Reader Events.
+let unsubscribedTabs = new Set();
+
+// Tabs that connected to any reader (released when the tab is closed).
+let connectedTabs = new Set();
+
+// Native commands: [Connect], [Disconnect], [Transceive],
+// [Subscribe], [Unsubscribe], [Cancel] and [Fan-out].
+const CMD_CONNECT = 2;
+const CMD_DISCONNECT = 3;
+const CMD_TRANSCEIVE = 4;
+const CMD_SUBSCRIBE = 12;
+const CMD_UNSUBSCRIBE = 13;
+const CMD_CANCEL = 20;
+const CMD_FAN_OUT = 22;
+const CMD_JOBS = 23;
+
 /******************************************************************************/
 // Combined WebCard UID:
 // (senderId, requestId) => (jsonResponseId)
@@ -43,11 +65,40 @@ function nativePortCallback(msg)
     else if (msg.e)
     {
         // Message originating from the [Native App].
-        // Broadcast to all content ports.
-        contentPorts.forEach((port, senderId) =>
+        if (Array.isArray(msg.k))
         {
-            port.postMessage(msg);
-        });
+            // Route only to the subscribed content ports.
+            let keys = msg.k;
+            delete msg.k;
+
+            keys.forEach((senderId) =>
+            {
+                contentPorts.get(senderId)?.postMessage(msg);
+            });
+        }
+        else
+        {
+            // No subscriptions on the [Native App] side.
+            // Broadcast to all content ports that still listen.
+            contentPorts.forEach((port, senderId) =>
+            {
+                if (!unsubscribedTabs.has(senderId))
+                {
+                    port.postMessage(msg);
+                }
+            });
+        }
+    }
+}
+
+/******************************************************************************/
+// Sends a request that is not tied to any tab's JavaScript Promise
+// (an empty message identifier is ignored when the response arrives).
+function postInternalRequest(msg)
+{
+    if (nativePort)
+    {
+        nativePort.postMessage({ i: '', ...msg });
     }
 }
 
@@ -74,6 +125,9 @@ function connectWithNativeApp()
     });
 
     nativePort.onMessage.addListener(nativePortCallback);
+
+    // A fresh [Native App] process knows nothing about the tabs.
+    subscriptions.forEach((request) => postInternalRequest(request));
 }
 
 /******************************************************************************/
@@ -94,11 +148,44 @@ chrome.runtime.onConnect.addListener((contentPort) =>
     {
         if (msg && (typeof msg.i === 'string'))
         {
-            if (!contentPorts.has(senderId))
+            let isNewTab = !contentPorts.has(senderId);
+
+            if (isNewTab)
             {
                 contentPorts.set(senderId, contentPort);
             }
 
+            if ((msg.c === CMD_SUBSCRIBE) || (msg.c === CMD_UNSUBSCRIBE))
+            {
+                // Subscriptions are owned by tabs, not by pages' requests.
+                msg.k = senderId;
+            }
+            else if ((msg.c === CMD_CONNECT) || (msg.c === CMD_DISCONNECT) ||
+                (msg.c === CMD_TRANSCEIVE) || (msg.c === CMD_FAN_OUT))
+            {
+                // Readers are owned by tabs: other tabs wait
+                // until the connected tab disconnects
+                // (or fan-out skips the readers of other tabs).
+                msg.k = senderId;
+
+                if (msg.c === CMD_CONNECT)
+                {
+                    connectedTabs.add(senderId);
+                }
+            }
+            else if (msg.c === CMD_JOBS)
+            {
+                // Job reports go to the tab that runs the production line,
+                // and its waiting jobs are dropped when it is closed.
+                msg.k = senderId;
+                connectedTabs.add(senderId);
+            }
+            else if ((msg.c === CMD_CANCEL) && (typeof msg.k === 'string'))
+            {
+                // The [Native App] knows only the combined UIDs.
+                msg.k = packMessageId(senderId, msg.k);
+            }
+
             let requestId = msg.i;
             msg.i = packMessageId(senderId, requestId);
             console.log(`>> ${JSON.stringify(msg)}`);
@@ -110,6 +197,26 @@ chrome.runtime.onConnect.addListener((contentPort) =>
                 connectWithNativeApp();
             }
 
+            if (msg.c === CMD_SUBSCRIBE)
+            {
+                let { i, ...request } = msg;
+                subscriptions.set(senderId, request);
+                unsubscribedTabs.delete(senderId);
+            }
+            else if (msg.c === CMD_UNSUBSCRIBE)
+            {
+                subscriptions.delete(senderId);
+                unsubscribedTabs.add(senderId);
+            }
+            else if (isNewTab && !subscriptions.has(senderId))
+            {
+                // Until it subscribes, a tab receives every event
+                // (even when other tabs have filtered subscriptions).
+                let request = { c: CMD_SUBSCRIBE, k: senderId };
+                subscriptions.set(senderId, request);
+                postInternalRequest(request);
+            }
+
             nativePort.postMessage(msg);
         }
     });
@@ -119,6 +226,19 @@ chrome.runtime.onConnect.addListener((contentPort) =>
     {
         console.log(`Tab ${senderId} disconnected.`);
         contentPorts.delete(senderId);
+        unsubscribedTabs.delete(senderId);
+
+        if (subscriptions.delete(senderId))
+        {
+            postInternalRequest({ c: CMD_UNSUBSCRIBE, k: senderId });
+        }
+
+        if (connectedTabs.delete(senderId))
+        {
+            // Readers of this tab can be granted to the waiting tabs
+            // (and its production-line jobs are dropped).
+            postInternalRequest({ c: CMD_DISCONNECT, k: senderId });
+        }
     });
 });
 
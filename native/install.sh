@@ -46,7 +46,8 @@ cp "$DIR/$HOST_NAME.json" "$CHROME_TARGET_DIR"
 cp "$DIR/$HOST_NAME.json" "$EDGE_TARGET_DIR"
 
 # Update host path in the manifest.
-HOST_PATH=$DIR/out/webcard
+# HOST_BINARY=webcard_shim shares one native app between browsers.
+HOST_PATH=$DIR/out/${HOST_BINARY:-webcard}
 ESCAPED_HOST_PATH=${HOST_PATH////\\/}
 sed -i -e "s/HOST_PATH/$ESCAPED_HOST_PATH/" "$CHROME_TARGET_DIR/$HOST_NAME.json"
 sed -i -e "s/HOST_PATH/$ESCAPED_HOST_PATH/" "$EDGE_TARGET_DIR/$HOST_NAME.json"
@@ -20,7 +20,7 @@ extern "C" {
 /**************************************************************/
 
 /**
- * Possible return values for `JsonByteStream_loadFromStandardInput` function.
+ * Possible return values for `JsonByteStream_loadFromStream` function.
  */
 
   /** Bytes successfully loaded from STDIN stream. */
@@ -32,6 +32,9 @@ extern "C" {
   /** No more bytes, loading error, memory alocation error. */
   #define JSON_STREAM_STATUS__NO_MORE  2
 
+/** Longest accepted message, in bytes (without the length prefix). */
+#define JSON_STREAM_MAX_LENGTH  (64 * 1024 * 1024)
+
 /**
  * `JsonByteStream` type definition.
  */
@@ -69,6 +72,35 @@ int
 JsonByteStream_loadFromStandardInput(
   _Out_ JsonByteStream *stream);
 
+/**
+ * @brief Prepares a `JsonByteStream` object to parse a stringified JSON
+ * read from any stream with the framing of Standard Input
+ * (e.g. a local socket).
+ *
+ * @param[out] stream Reference to an UNINITIALIZED `JsonByteStream` object.
+ * @param[in] input OS-specific stream descriptor, open for reading.
+ * @return `JSON_STREAM_STATUS__VALID` if the stream is allocated and ready,
+ * otherwise the object is left uninitialized.
+ */
+int
+JsonByteStream_loadFromStream(
+  _Out_ JsonByteStream *stream,
+  _In_ const os_specific_stream_t input);
+
+/**
+ * @brief Prepares a `JsonByteStream` object to parse
+ * a stringified JSON stored in a file (e.g. a configuration file).
+ *
+ * @param[out] stream Reference to an UNINITIALIZED `JsonByteStream` object.
+ * @param[in] fileName Path to the file.
+ * @return `TRUE` if the stream is allocated and ready,
+ * `FALSE` if the file could not be read (the stream is left empty).
+ */
+extern BOOL
+JsonByteStream_loadFromFile(
+  _Out_ JsonByteStream *stream,
+  _In_ LPCSTR fileName);
+
 /**
  * @brief `JsonByteStream` destructor.
  *
@@ -114,10 +114,9 @@ JsonArray_parse(
 
   if (!JsonByteStream_read(stream, &(test_byte), 1) || ('[' != test_byte))
   {
-    #if defined(_DEBUG)
-    OSSpecific_writeDebugMessage(
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
       "JSON array, parsing failed: expected an opening square bracket");
-    #endif
 
     return FALSE;
   }
@@ -139,10 +138,9 @@ JsonArray_parse(
     {
       if (0 == result[0]->count)
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON array, parsing failed: unexpected comma");
-        #endif
 
         return FALSE;
       }
@@ -153,10 +151,9 @@ JsonArray_parse(
     {
       if (0 != result[0]->count)
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON value, parsing failed: expected a comma");
-        #endif
 
         return FALSE;
       }
@@ -11,10 +11,7 @@ int
 JsonByteStream_loadFromStandardInput(
   _Out_ JsonByteStream *stream)
 {
-  BOOL test_bool;
   os_specific_stream_t stdin_stream;
-  uint32_t pipe_length;
-  uint32_t json_length;
 
   /* Get Standard Input stream identifier */
 
@@ -33,11 +30,25 @@ JsonByteStream_loadFromStandardInput(
   }
   #endif
 
+  return JsonByteStream_loadFromStream(stream, stdin_stream);
+}
+
+/**************************************************************/
+
+int
+JsonByteStream_loadFromStream(
+  _Out_ JsonByteStream *stream,
+  _In_ const os_specific_stream_t input)
+{
+  BOOL test_bool;
+  uint32_t pipe_length;
+  uint32_t json_length;
+
   /* Check if the pipe is not broken */
   /* and if any message is pending to be read */
 
   test_bool = OSSpecific_peekStream(
-    stdin_stream,
+    input,
     &(pipe_length));
 
   if (!test_bool)
@@ -58,7 +69,7 @@ JsonByteStream_loadFromStandardInput(
   /* ("native byte order", no need to check for endianness) */
 
   test_bool = OSSpecific_readBytesFromStream(
-    stdin_stream,
+    input,
     &(json_length),
     sizeof(uint32_t));
 
@@ -67,54 +78,23 @@ JsonByteStream_loadFromStandardInput(
     return JSON_STREAM_STATUS__NO_MORE;
   }
 
-  #if defined(_DEBUG)
-    OSSpecific_writeDebugMessage(
-      "{JsonByteStream} 0x%04X/0x%04X bytes on STDIN",
-      json_length,
-      pipe_length);
-  #endif
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__DEBUG,
+    "{JsonByteStream} 0x%04X/0x%04X bytes pending",
+    json_length,
+    pipe_length);
 
   /* Validate given text length */
+  /* (the rest of a long message might still be on its way, */
+  /* e.g. when relayed through a socket: it is waited for below) */
 
-  test_bool = (json_length <= (pipe_length - sizeof(uint32_t)));
-
-  if ((0 == json_length) || (UINT32_MAX == json_length) || (!test_bool))
+  if ((0 == json_length) || (json_length > JSON_STREAM_MAX_LENGTH))
   {
-    if (sizeof(uint32_t) == pipe_length)
-    {
-      /* In rare cases, only 4 bytes (JSON size info) were streamed first */
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{JsonByteStream::loadFromStream} invalid stream length!");
 
-      do
-      {
-        test_bool = OSSpecific_peekStream(
-          stdin_stream,
-          &(pipe_length));
-
-        if (!test_bool)
-        {
-          return JSON_STREAM_STATUS__NO_MORE;
-        }
-      }
-      while (0 == pipe_length);
-
-      #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
-          "{JsonByteStream} 0x%04X bytes on STDIN",
-          pipe_length);
-      #endif
-
-      test_bool = (json_length <= pipe_length);
-    }
-
-    if (!test_bool)
-    {
-      #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
-          "{JsonByteStream::loadFromStandardInput} invalid stream length!");
-      #endif
-
-      return JSON_STREAM_STATUS__NO_MORE;
-    }
+    return JSON_STREAM_STATUS__NO_MORE;
   }
 
   /* Initialize "JsonByteStream" object */
@@ -122,20 +102,19 @@ JsonByteStream_loadFromStandardInput(
   stream->head = malloc(sizeof(BYTE) * json_length);
   if (NULL == (stream->head))
   {
-    #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
-        "{JsonByteStream::loadFromStandardInput} memory allocation failed!");
-    #endif
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{JsonByteStream::loadFromStandardInput} memory allocation failed!");
 
     return JSON_STREAM_STATUS__NO_MORE;
   }
 
   stream->head_length = json_length;
 
-  /* Read the rest of the STDIN stream (UTF-8 text) */
+  /* Read the rest of the message (UTF-8 text) */
 
   test_bool = OSSpecific_readBytesFromStream(
-    stdin_stream,
+    input,
     &(stream->head[0]),
     json_length);
 
@@ -145,13 +124,16 @@ JsonByteStream_loadFromStandardInput(
     return JSON_STREAM_STATUS__NO_MORE;
   }
 
-  #if defined(_DEBUG)
-    UTF8String hexdump;
-    UTF8String_init(&(hexdump));
-    UTF8String_pushBytesAsHex(&(hexdump), json_length, stream->head);
-    OSSpecific_writeDebugMessage("{JsonByteStream} hex-dump: %s", (LPCSTR) hexdump.text);
-    UTF8String_destroy(&(hexdump));
-  #endif
+  OSSpecific_writeLogBytes(
+    OS_SPECIFIC_LOG__TRACE,
+    "{JsonByteStream} hex-dump",
+    stream->head,
+    json_length);
+
+  OSSpecific_probe2(
+    stdin__frame,
+    json_length,
+    pipe_length);
 
   /* "JsonByteStream" object is now ready to be parsed */
 
@@ -163,6 +145,72 @@ JsonByteStream_loadFromStandardInput(
 
 /**************************************************************/
 
+BOOL
+JsonByteStream_loadFromFile(
+  _Out_ JsonByteStream *stream,
+  _In_ LPCSTR fileName)
+{
+  FILE *file;
+  long file_length;
+  BOOL test_bool;
+
+  stream->head = NULL;
+  stream->head_length = 0;
+  stream->tail = NULL;
+  stream->tail_length = 0;
+
+  file = fopen(fileName, "rb");
+  if (NULL == file) { return FALSE; }
+
+  /* Get the file size */
+
+  test_bool = (0 == fseek(file, 0, SEEK_END));
+
+  if (test_bool)
+  {
+    file_length = ftell(file);
+    test_bool = (file_length > 0) && (0 == fseek(file, 0, SEEK_SET));
+  }
+
+  if (test_bool)
+  {
+    stream->head = malloc(sizeof(BYTE) * file_length);
+    test_bool = (NULL != stream->head);
+  }
+
+  if (test_bool)
+  {
+    test_bool = (((size_t) file_length) == fread(
+      stream->head,
+      sizeof(BYTE),
+      file_length,
+      file));
+  }
+
+  fclose(file);
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{JsonByteStream::loadFromFile} failed to read \"%s\"",
+      fileName);
+
+    JsonByteStream_destroy(stream);
+    return FALSE;
+  }
+
+  /* "JsonByteStream" object is now ready to be parsed */
+
+  stream->head_length = file_length;
+  stream->tail = stream->head;
+  stream->tail_length = file_length;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
 VOID
 JsonByteStream_destroy(
   _Inout_ JsonByteStream *stream)
@@ -187,10 +235,9 @@ JsonByteStream_peek(
     return TRUE;
   }
 
-  #if defined(_DEBUG)
-  OSSpecific_writeDebugMessage(
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__WARNING,
     "{JsonByteStream} peek failed: no more bytes");
-  #endif
 
   return FALSE;
 }
@@ -216,10 +263,9 @@ JsonByteStream_read(
 {
   if (stream->tail_length < count)
   {
-    #if defined(_DEBUG)
-    OSSpecific_writeDebugMessage(
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
       "{JsonByteStream} read failed: no more bytes");
-    #endif
 
     return FALSE;
   }
@@ -135,10 +135,9 @@ JsonObject_parse(
 
   if (!JsonByteStream_read(stream, &(test_byte), 1) || ('{' != test_byte))
   {
-    #if defined(_DEBUG)
-    OSSpecific_writeDebugMessage(
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
       "JSON object, parsing failed: expected an opening curly bracket");
-    #endif
 
     return FALSE;
   }
@@ -160,10 +159,9 @@ JsonObject_parse(
     {
       if (0 == result[0]->count)
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON object, parsing failed: unexpected comma");
-        #endif
 
         return FALSE;
       }
@@ -174,10 +172,9 @@ JsonObject_parse(
     {
       if (0 != result[0]->count)
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON object, parsing failed: expected a comma");
-        #endif
 
         return FALSE;
       }
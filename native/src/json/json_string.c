@@ -27,10 +27,9 @@ JsonString_parse(
 
   if (!JsonByteStream_read(stream, &(test_byte), 1) || ('"' != test_byte))
   {
-    #if defined(_DEBUG)
-    OSSpecific_writeDebugMessage(
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
       "JSON string, parsing failed: expected an opening quote");
-    #endif
 
     return FALSE;
   }
@@ -39,11 +38,10 @@ JsonString_parse(
   {
     if (test_byte < ' ')
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
         "JSON string, parsing failed: unexpected character 0x%02X",
         test_byte);
-      #endif
 
       return FALSE;
     }
@@ -60,10 +58,9 @@ JsonString_parse(
 
       if (!test_bool)
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JsonString::parse(): not a valid UTF-8 representation!");
-        #endif
 
         return FALSE;
       }
@@ -113,11 +110,10 @@ JsonString_parse(
             test_byte = '\t';
             break;
           default:
-            #if defined(_DEBUG)
-            OSSpecific_writeDebugMessage(
+            OSSpecific_writeLogMessage(
+              OS_SPECIFIC_LOG__WARNING,
               "JSON stream, parsing failed: unknown escape sequence 0x%02X",
               test_byte);
-            #endif
             return FALSE;
         }
       }
@@ -218,10 +214,9 @@ JsonString_toString(
 
       if (!test_bool)
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JsonString::toString(): not a valid UTF-8 representation!");
-        #endif
 
         return FALSE;
       }
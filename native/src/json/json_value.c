@@ -177,10 +177,9 @@ JsonValue_parseNumber(
     {
       if (!Misc_pushToLocalBuffer(buf, &(buf_end), sizeof(buf), test_byte))
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON number parsing failed: buffer overflow");
-        #endif
 
         return FALSE;
       }
@@ -419,11 +418,10 @@ JsonValue_parseNumber(
 
   if ('J' != parser_state)
   {
-    #if defined(_DEBUG)
-    OSSpecific_writeDebugMessage(
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
       "JSON number parsing failed: unexpected character 0x%02X",
       test_byte);
-    #endif
 
     return FALSE;
   }
@@ -436,11 +434,10 @@ JsonValue_parseNumber(
   number = strtof(buf, &(buf_end_dummy));
   if ((0 != errno) || (buf_end_dummy != buf_end))
   {
-    #if defined(_DEBUG)
-    OSSpecific_writeDebugMessage(
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
       "{strtof} failed: errno=0x%08X",
       errno);
-    #endif
 
     return FALSE;
   }
@@ -550,10 +547,9 @@ JsonValue_parse(
 
       if (0 != memcmp(test_bytes[0], test_bytes[1], 3))
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON value, parsing failed: expected literal 'true'");
-        #endif
 
         return FALSE;
       }
@@ -577,10 +573,9 @@ JsonValue_parse(
 
       if (0 != memcmp(test_bytes[0], test_bytes[1], 4))
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON value, parsing failed: expected literal 'false'");
-        #endif
 
         return FALSE;
       }
@@ -603,10 +598,9 @@ JsonValue_parse(
 
       if (0 != memcmp(test_bytes[0], test_bytes[1], 3))
       {
-        #if defined(_DEBUG)
-        OSSpecific_writeDebugMessage(
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
           "JSON value, parsing failed: expected literal 'null'");
-        #endif
 
         return FALSE;
       }
@@ -638,11 +632,10 @@ JsonValue_parse(
     }
     default:
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
         "JSON value, parsing failed: unexpected character 0x%02X",
         test_bytes[0][0]);
-      #endif
 
       return FALSE;
     }
@@ -71,4 +71,45 @@ Misc_pushToLocalBuffer(
 }
 
 
+/**************************************************************/
+
+uint32_t
+Misc_crc32(
+  _In_ uint32_t crc,
+  _In_ const BYTE *bytes,
+  _In_ const size_t length)
+{
+  static uint32_t table[256];
+  static BOOL table_ready = FALSE;
+  uint32_t test_uint;
+
+  if (!table_ready)
+  {
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      test_uint = i;
+
+      for (int j = 0; j < 8; j++)
+      {
+        test_uint = (test_uint & 1) ?
+          (0xEDB88320U ^ (test_uint >> 1)) :
+          (test_uint >> 1);
+      }
+
+      table[i] = test_uint;
+    }
+
+    table_ready = TRUE;
+  }
+
+  crc = ~crc;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+
+  return ~crc;
+}
+
 /**************************************************************/
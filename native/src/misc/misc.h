@@ -63,6 +63,21 @@ Misc_pushToLocalBuffer(
   _In_ const size_t size,
   _In_ const char character);
 
+/**
+ * @brief Computes (or continues computing) a CRC-32 checksum
+ * (ISO-HDLC polynomial, as used by ZIP and PNG).
+ *
+ * @param[in] crc Result of the previous call, or `0` for the first block.
+ * @param[in] bytes Data block.
+ * @param[in] length The length of `bytes` buffer, in bytes.
+ * @return Updated checksum.
+ */
+extern uint32_t
+Misc_crc32(
+  _In_ uint32_t crc,
+  _In_ const BYTE *bytes,
+  _In_ const size_t length);
+
 
 /**************************************************************/
 
@@ -0,0 +1,1127 @@
+/**
+ * @file "native/src/os_specific/os_log.c"
+ * Asynchronous logging: messages are queued without formatting
+ * and written to `STDERR` by a background (flusher) thread.
+ */
+
+#include "os_specific/os_specific.h"
+
+#include <stddef.h>  /* ptrdiff_t */
+
+/**************************************************************/
+
+/**
+ * Possible kinds of a queued message.
+ */
+
+  #define OS_SPECIFIC_LOG_KIND__MESSAGE  0
+  #define OS_SPECIFIC_LOG_KIND__BYTES    1
+
+/**
+ * Possible (normalized) length modifiers of a format specifier.
+ */
+
+  #define OS_SPECIFIC_LOG_LENGTH__NONE         0
+  #define OS_SPECIFIC_LOG_LENGTH__CHAR         1
+  #define OS_SPECIFIC_LOG_LENGTH__SHORT        2
+  #define OS_SPECIFIC_LOG_LENGTH__LONG         3
+  #define OS_SPECIFIC_LOG_LENGTH__LONG_LONG    4
+  #define OS_SPECIFIC_LOG_LENGTH__SIZE         5
+  #define OS_SPECIFIC_LOG_LENGTH__MAX          6
+  #define OS_SPECIFIC_LOG_LENGTH__PTRDIFF      7
+  #define OS_SPECIFIC_LOG_LENGTH__LONG_DOUBLE  8
+
+/** Copied strings that did not fit in the slot. */
+#define OS_SPECIFIC_LOG_NO_STRING  UINT64_MAX
+
+/**
+ * One argument of a queued message.
+ * Strings are copied into the slot, `u` is then their offset.
+ */
+typedef union
+{
+  int64_t i;
+  uint64_t u;
+  double f;
+  const void *p;
+}
+OSSpecificLogArgument;
+
+/**
+ * Header of a queued message (followed by copied strings or bytes).
+ */
+typedef struct
+{
+  /** Turn of this slot in the queue (see `OSSpecific_claimLogSlot`) */
+  os_specific_atomic_t sequence;
+
+  /** `OSSpecific_getPreciseTime()` when the message was queued */
+  uint64_t time;
+
+  /** String literal: format of a message or label of a hex-dump */
+  LPCSTR format;
+
+  uint8_t kind;
+  uint8_t level;
+  uint8_t argumentCount;
+  uint16_t dataLength;
+
+  OSSpecificLogArgument arguments[OS_SPECIFIC_LOG_MAX_ARGUMENTS];
+}
+OSSpecificLogHeader;
+
+#define OS_SPECIFIC_LOG_DATA_SIZE \
+  (OS_SPECIFIC_LOG_SLOT_SIZE - sizeof(OSSpecificLogHeader))
+
+typedef struct
+{
+  OSSpecificLogHeader header;
+  BYTE data[OS_SPECIFIC_LOG_DATA_SIZE];
+}
+OSSpecificLogSlot;
+
+/**
+ * Parsed format specifier (`%[flags][width][.precision][length]conversion`).
+ */
+typedef struct
+{
+  LPCSTR flags;
+  size_t flagsLength;
+  LPCSTR width;
+  size_t widthLength;
+  BOOL widthArgument;
+  BOOL hasPrecision;
+  LPCSTR precision;
+  size_t precisionLength;
+  BOOL precisionArgument;
+  int length;
+  CHAR conversion;
+}
+OSSpecificLogSpecifier;
+
+/**
+ * Bounded multi-producer queue, consumed by the flusher thread.
+ */
+typedef struct
+{
+  os_specific_atomic_t level;
+  os_specific_atomic_t stopping;
+  os_specific_atomic_t enqueuePosition;
+  os_specific_atomic_t dropped;
+
+  size_t dequeuePosition;
+  uint64_t reportedDropped;
+  uint64_t startTime;
+
+  BOOL threadStarted;
+  os_specific_thread_t thread;
+
+  OSSpecificLogSlot *slots;
+}
+OSSpecificLogger;
+
+static OSSpecificLogger OSSpecific_logger;
+
+static const LPCSTR OSSpecific_logLevelNames[] =
+{
+  "off", "error", "warning", "info", "debug", "trace"
+};
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Reads one format specifier (right after its `%` character).
+ *
+ * @param[in] format Text after the `%` character.
+ * @param[out] specifier Parsed specifier.
+ * @return Text after the specifier.
+ */
+LPCSTR
+OSSpecific_parseLogSpecifier(
+  _In_z_ LPCSTR format,
+  _Out_ OSSpecificLogSpecifier *specifier)
+{
+  memset(specifier, 0x00, sizeof(OSSpecificLogSpecifier));
+
+  specifier->flags = format;
+  while (('\0' != format[0]) && (NULL != strchr("-+ #0", format[0])))
+  {
+    format++;
+  }
+  specifier->flagsLength = (size_t) (format - specifier->flags);
+
+  specifier->width = format;
+  if ('*' == format[0])
+  {
+    specifier->widthArgument = TRUE;
+    format++;
+  }
+  else
+  {
+    while (('0' <= format[0]) && ('9' >= format[0])) { format++; }
+  }
+  specifier->widthLength = (size_t) (format - specifier->width);
+
+  if ('.' == format[0])
+  {
+    format++;
+    specifier->hasPrecision = TRUE;
+    specifier->precision = format;
+
+    if ('*' == format[0])
+    {
+      specifier->precisionArgument = TRUE;
+      format++;
+    }
+    else
+    {
+      while (('0' <= format[0]) && ('9' >= format[0])) { format++; }
+    }
+
+    specifier->precisionLength = (size_t) (format - specifier->precision);
+  }
+
+  switch (format[0])
+  {
+    case 'h':
+    {
+      format++;
+      specifier->length = OS_SPECIFIC_LOG_LENGTH__SHORT;
+
+      if ('h' == format[0])
+      {
+        format++;
+        specifier->length = OS_SPECIFIC_LOG_LENGTH__CHAR;
+      }
+
+      break;
+    }
+    case 'l':
+    {
+      format++;
+      specifier->length = OS_SPECIFIC_LOG_LENGTH__LONG;
+
+      if ('l' == format[0])
+      {
+        format++;
+        specifier->length = OS_SPECIFIC_LOG_LENGTH__LONG_LONG;
+      }
+
+      break;
+    }
+    case 'z':
+    {
+      format++;
+      specifier->length = OS_SPECIFIC_LOG_LENGTH__SIZE;
+      break;
+    }
+    case 'j':
+    {
+      format++;
+      specifier->length = OS_SPECIFIC_LOG_LENGTH__MAX;
+      break;
+    }
+    case 't':
+    {
+      format++;
+      specifier->length = OS_SPECIFIC_LOG_LENGTH__PTRDIFF;
+      break;
+    }
+    case 'L':
+    {
+      format++;
+      specifier->length = OS_SPECIFIC_LOG_LENGTH__LONG_DOUBLE;
+      break;
+    }
+  }
+
+  specifier->conversion = format[0];
+
+  if ('\0' != format[0])
+  {
+    format++;
+  }
+
+  return format;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Copies the arguments of a message into its slot.
+ * Stops at the first conversion that is not supported.
+ */
+VOID
+OSSpecific_captureLogArguments(
+  _Inout_ OSSpecificLogSlot *slot,
+  _In_z_ LPCSTR format,
+  va_list args)
+{
+  OSSpecificLogSpecifier specifier;
+  OSSpecificLogArgument *argument;
+  BOOL supported = TRUE;
+  LPCSTR text;
+  size_t text_length;
+  size_t count = 0;
+  size_t used = 0;
+
+  while ('\0' != format[0])
+  {
+    if ('%' != format[0])
+    {
+      format++;
+      continue;
+    }
+
+    if ('%' == format[1])
+    {
+      format += 2;
+      continue;
+    }
+
+    format = OSSpecific_parseLogSpecifier(&(format[1]), &(specifier));
+
+    /* Arguments of width and precision come first */
+
+    if (specifier.widthArgument && (count < OS_SPECIFIC_LOG_MAX_ARGUMENTS))
+    {
+      slot->header.arguments[count++].i = va_arg(args, int);
+    }
+
+    if (specifier.precisionArgument && (count < OS_SPECIFIC_LOG_MAX_ARGUMENTS))
+    {
+      slot->header.arguments[count++].i = va_arg(args, int);
+    }
+
+    if (count >= OS_SPECIFIC_LOG_MAX_ARGUMENTS)
+    {
+      break;
+    }
+
+    argument = &(slot->header.arguments[count]);
+
+    switch (specifier.conversion)
+    {
+      case 'd':
+      case 'i':
+      {
+        switch (specifier.length)
+        {
+          case OS_SPECIFIC_LOG_LENGTH__LONG:
+            argument->i = va_arg(args, long);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__LONG_LONG:
+            argument->i = va_arg(args, long long);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__SIZE:
+            argument->i = (int64_t) va_arg(args, size_t);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__MAX:
+            argument->i = va_arg(args, intmax_t);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__PTRDIFF:
+            argument->i = va_arg(args, ptrdiff_t);
+            break;
+          default:
+            argument->i = va_arg(args, int);
+        }
+
+        break;
+      }
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+      {
+        switch (specifier.length)
+        {
+          case OS_SPECIFIC_LOG_LENGTH__LONG:
+            argument->u = va_arg(args, unsigned long);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__LONG_LONG:
+            argument->u = va_arg(args, unsigned long long);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__SIZE:
+            argument->u = va_arg(args, size_t);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__MAX:
+            argument->u = va_arg(args, uintmax_t);
+            break;
+          case OS_SPECIFIC_LOG_LENGTH__PTRDIFF:
+            argument->u = (uint64_t) va_arg(args, ptrdiff_t);
+            break;
+          default:
+            argument->u = va_arg(args, unsigned int);
+        }
+
+        break;
+      }
+      case 'c':
+      {
+        argument->i = va_arg(args, int);
+        break;
+      }
+      case 'e':
+      case 'E':
+      case 'f':
+      case 'F':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+      {
+        argument->f = (OS_SPECIFIC_LOG_LENGTH__LONG_DOUBLE == specifier.length) ?
+          (double) va_arg(args, long double) :
+          va_arg(args, double);
+
+        break;
+      }
+      case 'p':
+      {
+        argument->p = va_arg(args, void *);
+        break;
+      }
+      case 's':
+      {
+        if (OS_SPECIFIC_LOG_LENGTH__NONE != specifier.length)
+        {
+          supported = FALSE;
+          break;
+        }
+
+        /* The string may be gone when the message is formatted */
+
+        text = va_arg(args, LPCSTR);
+        if (NULL == text) { text = "(null)"; }
+
+        text_length = strlen(text);
+
+        if (used < OS_SPECIFIC_LOG_DATA_SIZE)
+        {
+          if (text_length > (OS_SPECIFIC_LOG_DATA_SIZE - used - 1))
+          {
+            text_length = OS_SPECIFIC_LOG_DATA_SIZE - used - 1;
+          }
+
+          memcpy(&(slot->data[used]), text, text_length);
+          slot->data[used + text_length] = '\0';
+
+          argument->u = used;
+          used += text_length + 1;
+        }
+        else
+        {
+          argument->u = OS_SPECIFIC_LOG_NO_STRING;
+        }
+
+        break;
+      }
+      default:
+      {
+        /* Unknown conversion: the type of the argument is unknown too */
+
+        supported = FALSE;
+      }
+    }
+
+    if (!supported)
+    {
+      break;
+    }
+
+    count++;
+  }
+
+  slot->header.argumentCount = (uint8_t) count;
+  slot->header.dataLength = (uint16_t) used;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Claims a free slot of the queue (lock-free, for any thread).
+ *
+ * @return Reference to the claimed slot, or `NULL` when the queue is full.
+ */
+OSSpecificLogSlot *
+OSSpecific_claimLogSlot(void)
+{
+  OSSpecificLogger *logger = &(OSSpecific_logger);
+  OSSpecificLogSlot *slot;
+  size_t position;
+  size_t sequence;
+
+  if (NULL == logger->slots)
+  {
+    return NULL;
+  }
+
+  position = (size_t) OSSpecific_atomicLoad(&(logger->enqueuePosition));
+
+  while (TRUE)
+  {
+    slot = &(logger->slots[position & (OS_SPECIFIC_LOG_SLOTS - 1)]);
+
+    sequence = (size_t) OSSpecific_atomicLoad(&(slot->header.sequence));
+
+    if (sequence == position)
+    {
+      /* Slot is free in this turn, try to take it */
+
+      if (OSSpecific_atomicCompareExchange(
+        &(logger->enqueuePosition),
+        position,
+        position + 1))
+      {
+        return slot;
+      }
+    }
+    else if (sequence < position)
+    {
+      /* Flusher thread has not emptied this slot yet */
+
+      OSSpecific_atomicAdd(&(logger->dropped), 1);
+      return NULL;
+    }
+
+    /* Another producer took this position first */
+
+    position = (size_t) OSSpecific_atomicLoad(&(logger->enqueuePosition));
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Hands a filled slot over to the flusher thread.
+ */
+VOID
+OSSpecific_publishLogSlot(
+  _Inout_ OSSpecificLogSlot *slot)
+{
+  size_t sequence = (size_t) OSSpecific_atomicLoad(&(slot->header.sequence));
+
+  OSSpecific_atomicStore(&(slot->header.sequence), sequence + 1);
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_pushLogMessage(
+  _In_ const int level,
+  _In_z_ LPCSTR format,
+  ...)
+{
+  va_list args;
+  OSSpecificLogSlot *slot = OSSpecific_claimLogSlot();
+
+  if (NULL == slot)
+  {
+    return;
+  }
+
+  slot->header.time = OSSpecific_getPreciseTime();
+  slot->header.format = format;
+  slot->header.kind = OS_SPECIFIC_LOG_KIND__MESSAGE;
+  slot->header.level = (uint8_t) level;
+
+  va_start(args, format);
+  OSSpecific_captureLogArguments(slot, format, args);
+  va_end(args);
+
+  OSSpecific_publishLogSlot(slot);
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_pushLogBytes(
+  _In_ const int level,
+  _In_z_ LPCSTR label,
+  _In_ const BYTE *bytes,
+  _In_ const size_t length)
+{
+  OSSpecificLogSlot *slot = OSSpecific_claimLogSlot();
+  size_t copied = length;
+
+  if (NULL == slot)
+  {
+    return;
+  }
+
+  if (copied > OS_SPECIFIC_LOG_DATA_SIZE)
+  {
+    copied = OS_SPECIFIC_LOG_DATA_SIZE;
+  }
+
+  slot->header.time = OSSpecific_getPreciseTime();
+  slot->header.format = label;
+  slot->header.kind = OS_SPECIFIC_LOG_KIND__BYTES;
+  slot->header.level = (uint8_t) level;
+  slot->header.argumentCount = 1;
+  slot->header.arguments[0].u = length;
+  slot->header.dataLength = (uint16_t) copied;
+
+  memcpy(slot->data, bytes, copied);
+
+  OSSpecific_publishLogSlot(slot);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Appends formatted text to the output buffer (truncating it when full).
+ */
+VOID
+OSSpecific_appendLogText(
+  _Inout_ LPSTR output,
+  _Inout_ size_t *outputLength,
+  _In_ const size_t outputSize,
+  _In_z_ LPCSTR format,
+  ...)
+{
+  va_list args;
+  int written;
+
+  if ((outputLength[0] + 1) >= outputSize)
+  {
+    return;
+  }
+
+  va_start(args, format);
+  written = vsnprintf(
+    &(output[outputLength[0]]),
+    outputSize - outputLength[0],
+    format,
+    args);
+  va_end(args);
+
+  if (written > 0)
+  {
+    outputLength[0] += (size_t) written;
+
+    if (outputLength[0] >= outputSize)
+    {
+      outputLength[0] = outputSize - 1;
+    }
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Formats a queued message into a single line of text.
+ *
+ * @return Length of the line.
+ */
+size_t
+OSSpecific_formatLogSlot(
+  _In_ const OSSpecificLogSlot *slot,
+  _Out_ LPSTR output,
+  _In_ const size_t outputSize)
+{
+  OSSpecificLogSpecifier specifier;
+  const OSSpecificLogArgument *arguments = slot->header.arguments;
+  LPCSTR format = slot->header.format;
+  LPCSTR start;
+  CHAR spec[64];
+  size_t spec_length;
+  size_t length = 0;
+  size_t next = 0;
+  uint64_t elapsed = slot->header.time - OSSpecific_logger.startTime;
+
+  OSSpecific_appendLogText(
+    output, &(length), outputSize,
+    DEBUG_MESSAGE_START "%5llu.%06llu %-7s ",
+    (unsigned long long) (elapsed / 1000000000),
+    (unsigned long long) ((elapsed % 1000000000) / 1000),
+    OSSpecific_logLevelNames[slot->header.level]);
+
+  if (OS_SPECIFIC_LOG_KIND__BYTES == slot->header.kind)
+  {
+    OSSpecific_appendLogText(
+      output, &(length), outputSize,
+      "%s (%llu bytes): ",
+      format,
+      (unsigned long long) arguments[0].u);
+
+    for (size_t i = 0; i < slot->header.dataLength; i++)
+    {
+      OSSpecific_appendLogText(output, &(length), outputSize, "%02X", slot->data[i]);
+    }
+
+    if (slot->header.dataLength < arguments[0].u)
+    {
+      OSSpecific_appendLogText(output, &(length), outputSize, "...");
+    }
+
+    OSSpecific_appendLogText(output, &(length), outputSize, DEBUG_MESSAGE_END);
+    return length;
+  }
+
+  while ('\0' != format[0])
+  {
+    /* Literal text up to the next specifier */
+
+    start = format;
+    while (('\0' != format[0]) && ('%' != format[0])) { format++; }
+
+    if (format > start)
+    {
+      OSSpecific_appendLogText(
+        output, &(length), outputSize,
+        "%.*s", (int) (format - start), start);
+    }
+
+    if ('\0' == format[0])
+    {
+      break;
+    }
+
+    if ('%' == format[1])
+    {
+      OSSpecific_appendLogText(output, &(length), outputSize, "%%");
+      format += 2;
+      continue;
+    }
+
+    start = format;
+    format = OSSpecific_parseLogSpecifier(&(format[1]), &(specifier));
+
+    /* Arguments past the captured ones: print the rest as it is */
+
+    if ((next + (specifier.widthArgument ? 1 : 0) +
+      (specifier.precisionArgument ? 1 : 0)) >= slot->header.argumentCount)
+    {
+      OSSpecific_appendLogText(output, &(length), outputSize, "%s", start);
+      break;
+    }
+
+    /* Rebuild the specifier: explicit width and precision, widest types */
+
+    spec_length = (size_t) snprintf(spec, sizeof(spec), "%%%.*s",
+      (int) specifier.flagsLength, specifier.flags);
+
+    if (specifier.widthArgument)
+    {
+      spec_length += (size_t) snprintf(&(spec[spec_length]), sizeof(spec) - spec_length,
+        "%d", (int) arguments[next++].i);
+    }
+    else
+    {
+      spec_length += (size_t) snprintf(&(spec[spec_length]), sizeof(spec) - spec_length,
+        "%.*s", (int) specifier.widthLength, specifier.width);
+    }
+
+    if (specifier.precisionArgument)
+    {
+      spec_length += (size_t) snprintf(&(spec[spec_length]), sizeof(spec) - spec_length,
+        ".%d", (int) arguments[next++].i);
+    }
+    else if (specifier.hasPrecision)
+    {
+      spec_length += (size_t) snprintf(&(spec[spec_length]), sizeof(spec) - spec_length,
+        ".%.*s", (int) specifier.precisionLength, specifier.precision);
+    }
+
+    if (spec_length >= (sizeof(spec) - 4))
+    {
+      break;
+    }
+
+    switch (specifier.conversion)
+    {
+      case 'd':
+      case 'i':
+      {
+        snprintf(&(spec[spec_length]), sizeof(spec) - spec_length,
+          "ll%c", specifier.conversion);
+
+        OSSpecific_appendLogText(output, &(length), outputSize,
+          spec, (long long) arguments[next].i);
+
+        break;
+      }
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+      {
+        /* Unsigned values wider than their type are cut back */
+
+        uint64_t value = arguments[next].u;
+
+        if (OS_SPECIFIC_LOG_LENGTH__CHAR == specifier.length)
+        {
+          value = (unsigned char) value;
+        }
+        else if (OS_SPECIFIC_LOG_LENGTH__SHORT == specifier.length)
+        {
+          value = (unsigned short) value;
+        }
+
+        snprintf(&(spec[spec_length]), sizeof(spec) - spec_length,
+          "ll%c", specifier.conversion);
+
+        OSSpecific_appendLogText(output, &(length), outputSize,
+          spec, (unsigned long long) value);
+
+        break;
+      }
+      case 'c':
+      {
+        snprintf(&(spec[spec_length]), sizeof(spec) - spec_length, "c");
+
+        OSSpecific_appendLogText(output, &(length), outputSize,
+          spec, (int) arguments[next].i);
+
+        break;
+      }
+      case 'p':
+      {
+        snprintf(&(spec[spec_length]), sizeof(spec) - spec_length, "p");
+
+        OSSpecific_appendLogText(output, &(length), outputSize,
+          spec, arguments[next].p);
+
+        break;
+      }
+      case 's':
+      {
+        snprintf(&(spec[spec_length]), sizeof(spec) - spec_length, "s");
+
+        OSSpecific_appendLogText(output, &(length), outputSize,
+          spec,
+          (OS_SPECIFIC_LOG_NO_STRING == arguments[next].u) ?
+            "..." :
+            (LPCSTR) &(slot->data[arguments[next].u]));
+
+        break;
+      }
+      default:
+      {
+        snprintf(&(spec[spec_length]), sizeof(spec) - spec_length,
+          "%c", specifier.conversion);
+
+        OSSpecific_appendLogText(output, &(length), outputSize,
+          spec, arguments[next].f);
+      }
+    }
+
+    next++;
+  }
+
+  OSSpecific_appendLogText(output, &(length), outputSize, DEBUG_MESSAGE_END);
+  return length;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Writes a chunk of formatted lines to `STDERR`
+ * (directly, so that failures are never logged again).
+ */
+VOID
+OSSpecific_writeLogOutput(
+  _In_ LPCSTR output,
+  _In_ size_t length)
+{
+  #if defined(_WIN32)
+  {
+    DWORD written;
+    HANDLE stderr_stream = GetStdHandle(STD_ERROR_HANDLE);
+
+    if ((INVALID_HANDLE_VALUE != stderr_stream) && (NULL != stderr_stream))
+    {
+      WriteFile(stderr_stream, output, (DWORD) length, &(written), NULL);
+    }
+
+    OutputDebugStringA(output);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    ssize_t written;
+
+    while (length > 0)
+    {
+      written = write(STDERR_FILENO, output, length);
+
+      if (written <= 0)
+      {
+        if ((written < 0) && (EINTR == errno)) { continue; }
+        return;
+      }
+
+      output += written;
+      length -= (size_t) written;
+    }
+  }
+  #endif
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Formats and writes every queued message (flusher thread only).
+ *
+ * @return `TRUE` if anything was written.
+ */
+BOOL
+OSSpecific_drainLog(void)
+{
+  OSSpecificLogger *logger = &(OSSpecific_logger);
+  OSSpecificLogSlot *slot;
+  CHAR output[8192];
+  size_t length = 0;
+  size_t sequence;
+  uint64_t dropped;
+  BOOL drained = FALSE;
+
+  while (TRUE)
+  {
+    slot = &(logger->slots[logger->dequeuePosition & (OS_SPECIFIC_LOG_SLOTS - 1)]);
+
+    sequence = (size_t) OSSpecific_atomicLoad(&(slot->header.sequence));
+
+    if (sequence != (logger->dequeuePosition + 1))
+    {
+      break;
+    }
+
+    /* Flush before a line could be cut */
+
+    if ((sizeof(output) - length) < 2048)
+    {
+      OSSpecific_writeLogOutput(output, length);
+      length = 0;
+    }
+
+    length += OSSpecific_formatLogSlot(
+      slot,
+      &(output[length]),
+      sizeof(output) - length);
+
+    /* The slot becomes free for the next turn */
+
+    OSSpecific_atomicStore(
+      &(slot->header.sequence),
+      logger->dequeuePosition + OS_SPECIFIC_LOG_SLOTS);
+
+    logger->dequeuePosition += 1;
+    drained = TRUE;
+  }
+
+  dropped = (uint64_t) OSSpecific_atomicLoad(&(logger->dropped));
+
+  if (dropped != logger->reportedDropped)
+  {
+    OSSpecific_appendLogText(
+      output, &(length), sizeof(output),
+      DEBUG_MESSAGE_START "%llu log messages dropped (queue full)" DEBUG_MESSAGE_END,
+      (unsigned long long) (dropped - logger->reportedDropped));
+
+    logger->reportedDropped = dropped;
+  }
+
+  if (length > 0)
+  {
+    OSSpecific_writeLogOutput(output, length);
+  }
+
+  return drained;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Body of the flusher thread.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(OSSpecific_runLogFlusher)
+{
+  OSSpecificLogger *logger = &(OSSpecific_logger);
+
+  while (!OSSpecific_atomicLoad(&(logger->stopping)))
+  {
+    if (!OSSpecific_drainLog())
+    {
+      OSSpecific_sleep(OS_SPECIFIC_LOG_FLUSH_INTERVAL);
+    }
+  }
+
+  /* Messages queued right before stopping */
+
+  OSSpecific_drainLog();
+
+  return 0;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `OSSpecificLogger` object.
+ * Allocates the queue and starts the flusher thread (once).
+ */
+BOOL
+OSSpecific_startLogger(void)
+{
+  OSSpecificLogger *logger = &(OSSpecific_logger);
+
+  if (logger->threadStarted)
+  {
+    return TRUE;
+  }
+
+  logger->slots = malloc(sizeof(OSSpecificLogSlot) * OS_SPECIFIC_LOG_SLOTS);
+
+  if (NULL == logger->slots)
+  {
+    return FALSE;
+  }
+
+  for (size_t i = 0; i < OS_SPECIFIC_LOG_SLOTS; i++)
+  {
+    OSSpecific_atomicStore(&(logger->slots[i].header.sequence), i);
+  }
+
+  logger->threadStarted = OSSpecific_startThread(
+    &(logger->thread),
+    OSSpecific_runLogFlusher,
+    NULL);
+
+  if (!logger->threadStarted)
+  {
+    free(logger->slots);
+    logger->slots = NULL;
+  }
+
+  return logger->threadStarted;
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_initLogger(void)
+{
+  OSSpecificLogger *logger = &(OSSpecific_logger);
+  LPCSTR variable = getenv(OS_SPECIFIC_LOG_VARIABLE);
+  int level = OS_SPECIFIC_LOG_DEFAULT;
+
+  OSSpecific_atomicStore(&(logger->level), OS_SPECIFIC_LOG__OFF);
+  OSSpecific_atomicStore(&(logger->stopping), 0);
+  OSSpecific_atomicStore(&(logger->enqueuePosition), 0);
+  OSSpecific_atomicStore(&(logger->dropped), 0);
+
+  logger->dequeuePosition = 0;
+  logger->reportedDropped = 0;
+  logger->startTime = OSSpecific_getPreciseTime();
+  logger->threadStarted = FALSE;
+  logger->slots = NULL;
+
+  if ((NULL != variable) && ('\0' != variable[0]))
+  {
+    if (('0' <= variable[0]) && ('9' >= variable[0]))
+    {
+      level = atoi(variable);
+    }
+    else
+    {
+      for (int i = 0; i <= OS_SPECIFIC_LOG__TRACE; i++)
+      {
+        if (0 == strcmp(variable, OSSpecific_logLevelNames[i]))
+        {
+          level = i;
+        }
+      }
+    }
+  }
+
+  if (level > OS_SPECIFIC_LOG__TRACE)
+  {
+    level = OS_SPECIFIC_LOG__TRACE;
+  }
+
+  OSSpecific_setLogLevel(level);
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_destroyLogger(void)
+{
+  OSSpecificLogger *logger = &(OSSpecific_logger);
+
+  OSSpecific_atomicStore(&(logger->level), OS_SPECIFIC_LOG__OFF);
+
+  if (!logger->threadStarted)
+  {
+    return;
+  }
+
+  OSSpecific_atomicStore(&(logger->stopping), 1);
+
+  OSSpecific_joinThread(logger->thread);
+
+  /* Producers check the level first, but one could still be */
+  /* between the check and the claim: the queue is leaked on purpose */
+
+  logger->threadStarted = FALSE;
+}
+
+/**************************************************************/
+
+BOOL
+OSSpecific_isLogEnabled(
+  _In_ const int level)
+{
+  /* Full barrier: the queue allocated by `OSSpecific_setLogLevel` */
+  /* (on another thread) is visible once its level is */
+
+  return (level <= OSSpecific_atomicLoad(&(OSSpecific_logger.level)));
+}
+
+/**************************************************************/
+
+BOOL
+OSSpecific_setLogLevel(
+  _In_ const int level)
+{
+  if ((level < OS_SPECIFIC_LOG__OFF) || (level > OS_SPECIFIC_LOG__TRACE))
+  {
+    return FALSE;
+  }
+
+  /* The queue exists before any message can be pushed */
+
+  if ((OS_SPECIFIC_LOG__OFF != level) && !OSSpecific_startLogger())
+  {
+    return FALSE;
+  }
+
+  OSSpecific_atomicStore(&(OSSpecific_logger.level), level);
+  return TRUE;
+}
+
+/**************************************************************/
+
+int
+OSSpecific_getLogLevel(
+  _Out_opt_ uint64_t *droppedRef)
+{
+  if (NULL != droppedRef)
+  {
+    droppedRef[0] = (uint64_t) OSSpecific_atomicLoad(&(OSSpecific_logger.dropped));
+  }
+
+  return (int) OSSpecific_atomicLoad(&(OSSpecific_logger.level));
+}
+
+/**************************************************************/
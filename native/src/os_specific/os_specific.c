@@ -3,6 +3,11 @@
  * Operating-System-specific functions
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+  /** Needed for `struct ucred` (peer credentials of local sockets) */
+  #define _GNU_SOURCE
+#endif
+
 #include "os_specific/os_specific.h"
 
 /**************************************************************/
@@ -35,20 +40,18 @@ OSSpecific_validateTypesOfStreams(
   {
     if (FILE_TYPE_PIPE != GetFileType(inputStream))
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "Expected {Standard Input} type to be a pipe");
-      #endif
 
       return FALSE;
     }
 
     if (FILE_TYPE_PIPE != GetFileType(outputStream))
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "Expected {Standard Output} type to be a pipe");
-      #endif
 
       return FALSE;
     }
@@ -61,42 +64,38 @@ OSSpecific_validateTypesOfStreams(
 
     if (0 != fstat(inputStream, &(file_status)))
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "{fstat} failed: errno=0x%08X",
         errno);
-      #endif
 
       return FALSE;
     }
 
     if (!S_ISFIFO(file_status.st_mode))
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "Expected {Standard Input} type to be a pipe");
-      #endif
 
       return FALSE;
     }
 
     if (0 != fstat(outputStream, &(file_status)))
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "{fstat} failed: errno=0x%08X",
         errno);
-      #endif
 
       return FALSE;
     }
 
     if (!S_ISFIFO(file_status.st_mode))
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "Expected {Standard Output} type to be a pipe");
-      #endif
 
       return FALSE;
     }
@@ -139,14 +138,13 @@ OSSpecific_peekStream(
     {
       streamSizeRef[0] = pipe_length;
     }
-    #if defined(_DEBUG)
     else
     {
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "{PeekNamedPipe} failed: 0x%08X",
         GetLastError());
     }
-    #endif
 
     return test_bool;
   }
@@ -164,11 +162,10 @@ OSSpecific_peekStream(
 
     if ((-1) == result)
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
         "{poll} failed: errno=0x%08X",
         errno);
-      #endif
 
       return FALSE;
     }
@@ -181,12 +178,11 @@ OSSpecific_peekStream(
     }
     else
     {
-      #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__DEBUG,
         "{poll} POLLIN=%d POLLHUP=%d",
         !!(POLLIN & fds.revents),
         !!(POLLHUP & fds.revents));
-      #endif
 
       if (POLLHUP & fds.revents)
       {
@@ -204,11 +200,18 @@ OSSpecific_peekStream(
 
         if ((-1) == ioctl(stream, FIONREAD, &(result)))
         {
-          #if defined(_DEBUG)
-          OSSpecific_writeDebugMessage(
+          OSSpecific_writeLogMessage(
+            OS_SPECIFIC_LOG__ERROR,
             "{ioctl} failed: errno=0x%08X",
             errno);
-          #endif
+
+          return FALSE;
+        }
+
+        if (0 == result)
+        {
+          /* Readable, but nothing to read: the end of the stream */
+          /* (a socket closed by its peer might not report `POLLHUP`) */
 
           return FALSE;
         }
@@ -230,58 +233,131 @@ OSSpecific_peekStream(
 
 /**************************************************************/
 
+BOOL
+OSSpecific_waitForStream(
+  _In_ const os_specific_stream_t stream)
+{
+  #if defined(_WIN32)
+  {
+    BYTE dummy;
+    DWORD test_dword;
+
+    /* Zero-byte read blocks until the pipe has data (or is broken) */
+
+    if (ReadFile(stream, &(dummy), 0, &(test_dword), NULL))
+    {
+      return TRUE;
+    }
+
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{ReadFile} failed: 0x%08X",
+      GetLastError());
+
+    return FALSE;
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    struct pollfd fds =
+    {
+      .fd = stream,
+      .events = POLLIN
+    };
+
+    /* Readable or closed: `OSSpecific_peekStream` tells which one */
+
+    while ((-1) == poll(&(fds), 1, (-1)))
+    {
+      if (EINTR != errno)
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{poll} failed: errno=0x%08X",
+          errno);
+
+        return FALSE;
+      }
+    }
+
+    return TRUE;
+  }
+  #else
+  {
+    return FALSE;
+  }
+  #endif
+}
+
+/**************************************************************/
+
 BOOL
 OSSpecific_readBytesFromStream(
   _In_ const os_specific_stream_t stream,
   _Out_ void *output,
   _In_ const size_t size)
 {
+  /* A pipe can return less than requested (message not fully written yet) */
+
+  size_t offset = 0;
+
   #if defined(_WIN32)
   {
     BOOL test_bool;
     DWORD test_dword;
 
-    test_bool = ReadFile(
-      stream,
-      output,
-      size,
-      &(test_dword),
-      NULL);
-
-    #if defined(_DEBUG)
+    while (offset < size)
     {
-      if (test_bool && (size == test_dword)) { return TRUE; }
+      test_bool = ReadFile(
+        stream,
+        &(((LPBYTE) output)[offset]),
+        (DWORD) (size - offset),
+        &(test_dword),
+        NULL);
+
+      if (!test_bool || (0 == test_dword))
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{ReadFile} failed: 0x%08X",
+          GetLastError());
 
-      OSSpecific_writeDebugMessage(
-        "{ReadFile} failed: 0x%08X",
-        GetLastError());
+        return FALSE;
+      }
 
-      return FALSE;
-    }
-    #else
-    {
-      return (test_bool && (size == test_dword));
+      offset += test_dword;
     }
-    #endif
+
+    return TRUE;
   }
   #elif defined(__linux__) || defined(__APPLE__)
   {
-    #if defined(_DEBUG)
+    ssize_t result;
+
+    while (offset < size)
     {
-      ssize_t result = read(stream, output, size);
-      if (size == result) { return TRUE; }
+      result = read(stream, &(((LPBYTE) output)[offset]), size - offset);
 
-      OSSpecific_writeDebugMessage(
-        "{read} failed: errno=0x%08X",
-        errno);
+      if ((-1) == result)
+      {
+        if (EINTR == errno) { continue; }
 
-      return FALSE;
-    }
-    #else
-    {
-      return (size == read(stream, output, size));
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{read} failed: errno=0x%08X",
+          errno);
+
+        return FALSE;
+      }
+      else if (0 == result)
+      {
+        /* End of the stream in the middle of a message */
+        return FALSE;
+      }
+
+      offset += (size_t) result;
     }
-    #endif
+
+    return TRUE;
   }
   #else
   {
@@ -312,60 +388,37 @@ OSSpecific_writeBytesToStream(
 
     if (test_bool && (size == test_dword))
     {
-      #if defined(_DEBUG)
-      {
-        test_bool = FlushFileBuffers(stream);
-
-        if (!test_bool)
-        {
-          test_dword = GetLastError();
+      test_bool = FlushFileBuffers(stream);
 
-          if (ERROR_INVALID_HANDLE == test_dword)
-          {
-            return TRUE;
-          }
-
-          OSSpecific_writeDebugMessage(
-            "{FlushFileBuffers} failed: 0x%08X",
-            GetLastError());
-        }
-
-        return test_bool;
-      }
-      #else
+      if (!test_bool)
       {
-        return FlushFileBuffers(stream);
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{FlushFileBuffers} failed: 0x%08X",
+          GetLastError());
       }
-      #endif
-    }
 
-    #if defined(_DEBUG)
-    {
-      OSSpecific_writeDebugMessage(
-        "{WriteFile} failed: 0x%08X",
-        GetLastError());
+      return test_bool;
     }
-    #endif
+
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{WriteFile} failed: 0x%08X",
+      GetLastError());
 
     return FALSE;
   }
   #elif defined(__linux__) || defined(__APPLE__)
   {
-    #if defined(_DEBUG)
-    {
-      ssize_t result = write(stream, input, size);
-      if (size == result) { return TRUE; }
+    ssize_t result = write(stream, input, size);
+    if (size == result) { return TRUE; }
 
-      OSSpecific_writeDebugMessage(
-        "{write} failed");
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{write} failed: errno=0x%08X",
+      errno);
 
-      return FALSE;
-    }
-    #else
-    {
-      return (size == write(stream, input, size));
-    }
-    #endif
+    return FALSE;
   }
   #else
   {
@@ -376,58 +429,1181 @@ OSSpecific_writeBytesToStream(
 
 /**************************************************************/
 
-#if defined(_DEBUG)
+uint64_t
+OSSpecific_getMonotonicTime(void)
+{
+  #if defined(_WIN32)
+  {
+    return (uint64_t) GetTickCount64();
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    struct timespec now;
+
+    if (0 != clock_gettime(CLOCK_MONOTONIC, &(now)))
+    {
+      return 0;
+    }
 
-  VOID
-  OSSpecific_writeDebugMessage(
-    _In_z_ LPCSTR message,
-    ...)
+    return ((uint64_t) now.tv_sec * 1000) + ((uint64_t) now.tv_nsec / 1000000);
+  }
+  #else
   {
-    CHAR buffer[512];
-    va_list args;
-    os_specific_stream_t stderr_stream;
+    return 0;
+  }
+  #endif
+}
 
-    va_start(args, message);
-    vsnprintf(buffer, sizeof(buffer), message, args);
-    va_end(args);
+/**************************************************************/
 
-    #if defined(_WIN32)
-    {
-      stderr_stream = GetStdHandle(STD_ERROR_HANDLE);
+uint64_t
+OSSpecific_getPreciseTime(void)
+{
+  #if defined(_WIN32)
+  {
+    static LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER counter;
 
-      if (INVALID_HANDLE_VALUE == stderr_stream)
-      {
-        return;
-      }
-    }
-    #elif defined(__linux__) || defined(__APPLE__)
+    if (0 == frequency.QuadPart)
     {
-      stderr_stream = STDERR_FILENO;
+      QueryPerformanceFrequency(&(frequency));
     }
-    #endif
 
-    OSSpecific_writeBytesToStream(
-      stderr_stream,
-      DEBUG_MESSAGE_START,
-      sizeof(CHAR) * strlen(DEBUG_MESSAGE_START));
+    QueryPerformanceCounter(&(counter));
 
-    OSSpecific_writeBytesToStream(
-      stderr_stream,
-      buffer,
-      sizeof(CHAR) * strlen(buffer));
+    /* Split to avoid overflowing 64 bits */
 
-    OSSpecific_writeBytesToStream(
-      stderr_stream,
-      DEBUG_MESSAGE_END,
-      sizeof(CHAR) * strlen(DEBUG_MESSAGE_END));
+    return
+      ((uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000000) +
+      ((uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000000 /
+        (uint64_t) frequency.QuadPart);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    struct timespec now;
 
-    #if defined(_WIN32)
+    if (0 != clock_gettime(CLOCK_MONOTONIC, &(now)))
     {
-      OutputDebugStringA(buffer);
+      return 0;
     }
-    #endif
+
+    return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+  }
+  #else
+  {
+    return 0;
   }
+  #endif
+}
 
-#endif
+/**************************************************************/
+
+VOID
+OSSpecific_sleep(
+  _In_ const uint32_t microseconds)
+{
+  #if defined(_WIN32)
+  {
+    Sleep((microseconds + 999) / 1000);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    struct timespec duration;
+    duration.tv_sec = microseconds / 1000000;
+    duration.tv_nsec = (long) (microseconds % 1000000) * 1000;
+
+    /* Resume after signal interruptions */
+    while ((0 != nanosleep(&(duration), &(duration))) && (EINTR == errno));
+  }
+  #endif
+}
+
+/**************************************************************/
+
+BOOL
+OSSpecific_startThread(
+  _Out_ os_specific_thread_t *threadRef,
+  _In_ os_specific_thread_routine_t routine,
+  _In_opt_ void *parameter)
+{
+  #if defined(_WIN32)
+  {
+    threadRef[0] = CreateThread(
+      NULL,
+      0,
+      routine,
+      parameter,
+      0,
+      NULL);
+
+    return (NULL != threadRef[0]);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    return (0 == pthread_create(threadRef, NULL, routine, parameter));
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_joinThread(
+  _In_ os_specific_thread_t thread)
+{
+  #if defined(_WIN32)
+  {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_join(thread, NULL);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_initMutex(
+  _Out_ os_specific_mutex_t *mutex)
+{
+  #if defined(_WIN32)
+  {
+    InitializeSRWLock(mutex);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_mutex_init(mutex, NULL);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_destroyMutex(
+  _Inout_ os_specific_mutex_t *mutex)
+{
+  #if defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_mutex_destroy(mutex);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_lockMutex(
+  _Inout_ os_specific_mutex_t *mutex)
+{
+  #if defined(_WIN32)
+  {
+    AcquireSRWLockExclusive(mutex);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_mutex_lock(mutex);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_unlockMutex(
+  _Inout_ os_specific_mutex_t *mutex)
+{
+  #if defined(_WIN32)
+  {
+    ReleaseSRWLockExclusive(mutex);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_mutex_unlock(mutex);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_initCondition(
+  _Out_ os_specific_condition_t *condition)
+{
+  #if defined(_WIN32)
+  {
+    InitializeConditionVariable(condition);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_cond_init(condition, NULL);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_destroyCondition(
+  _Inout_ os_specific_condition_t *condition)
+{
+  #if defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_cond_destroy(condition);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_broadcastCondition(
+  _Inout_ os_specific_condition_t *condition)
+{
+  #if defined(_WIN32)
+  {
+    WakeAllConditionVariable(condition);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    pthread_cond_broadcast(condition);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_waitCondition(
+  _Inout_ os_specific_condition_t *condition,
+  _Inout_ os_specific_mutex_t *mutex,
+  _In_ const uint64_t timeout)
+{
+  #if defined(_WIN32)
+  {
+    /* Rounded up to whole milliseconds (`INFINITE` is reserved) */
+
+    DWORD milliseconds = INFINITE;
+
+    if (UINT64_MAX != timeout)
+    {
+      milliseconds = ((timeout / 1000000) < (INFINITE - 1)) ?
+        (DWORD) (timeout / 1000000 + 1) :
+        (INFINITE - 1);
+    }
+
+    SleepConditionVariableSRW(
+      condition,
+      mutex,
+      milliseconds,
+      0);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    struct timespec deadline;
+
+    if (UINT64_MAX == timeout)
+    {
+      pthread_cond_wait(condition, mutex);
+      return;
+    }
+
+    /* Absolute time of the default (realtime) clock */
+
+    clock_gettime(CLOCK_REALTIME, &(deadline));
+
+    deadline.tv_sec += (time_t) (timeout / 1000000000);
+    deadline.tv_nsec += (long) (timeout % 1000000000);
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_cond_timedwait(condition, mutex, &(deadline));
+  }
+  #endif
+}
+
+/**************************************************************/
+
+/** Maximal length of a cache file path (in characters). */
+#define WEBCARD_CACHE_PATH_SIZE  1024
+
+#if defined(_WIN32)
+
+  /**
+   * @brief A private OS-specific function.
+   * Builds the path of a file in the per-user cache directory of WebCard,
+   * creating the directory if needed.
+   *
+   * @param[out] output Buffer of `WEBCARD_CACHE_PATH_SIZE` characters.
+   * @param[in] fileName ASCII name of the file (without directories).
+   * @return `TRUE` on success, `FALSE` if the path cannot be determined.
+   */
+  BOOL
+  OSSpecific_getCacheFilePath(
+    _Out_ WCHAR *output,
+    _In_z_ LPCSTR fileName)
+  {
+    DWORD test_dword;
+    size_t length;
+
+    test_dword = GetEnvironmentVariableW(
+      L"LOCALAPPDATA",
+      output,
+      WEBCARD_CACHE_PATH_SIZE);
+
+    if ((0 == test_dword) || (test_dword >= WEBCARD_CACHE_PATH_SIZE))
+    {
+      return FALSE;
+    }
+
+    length = test_dword;
+
+    if ((length + 10 + strlen(fileName)) >= WEBCARD_CACHE_PATH_SIZE)
+    {
+      return FALSE;
+    }
+
+    wcscpy(&(output[length]), L"\\WebCard");
+    length += 8;
+
+    if (!CreateDirectoryW(output, NULL) &&
+      (ERROR_ALREADY_EXISTS != GetLastError()))
+    {
+      return FALSE;
+    }
+
+    output[length] = L'\\';
+    length += 1;
+
+    /* ASCII name: simple widening */
+
+    for (size_t i = 0; '\0' != fileName[i]; i++)
+    {
+      output[length] = (WCHAR) fileName[i];
+      length += 1;
+    }
+
+    output[length] = L'\0';
+    return TRUE;
+  }
+
+#elif defined(__linux__) || defined(__APPLE__)
+
+  /**
+   * @brief A private OS-specific function.
+   * Builds the path of a file in the per-user cache directory of WebCard,
+   * creating the directory if needed.
+   *
+   * @param[out] output Buffer of `WEBCARD_CACHE_PATH_SIZE` characters.
+   * @param[in] fileName ASCII name of the file (without directories).
+   * @return `TRUE` on success, `FALSE` if the path cannot be determined.
+   */
+  BOOL
+  OSSpecific_getCacheFilePath(
+    _Out_ char *output,
+    _In_z_ LPCSTR fileName)
+  {
+    int length;
+    const char *base_directory;
+    const char *sub_directory;
+
+    #if defined(__APPLE__)
+      base_directory = NULL;
+    #else
+      base_directory = getenv("XDG_CACHE_HOME");
+    #endif
+
+    if ((NULL != base_directory) && ('\0' != base_directory[0]))
+    {
+      sub_directory = "";
+    }
+    else
+    {
+      base_directory = getenv("HOME");
+      if (NULL == base_directory) { return FALSE; }
+
+      #if defined(__APPLE__)
+        sub_directory = "/Library/Caches";
+      #else
+        sub_directory = "/.cache";
+      #endif
+    }
+
+    /* Parent directory (e.g. "~/.cache") should already exist */
+
+    length = snprintf(
+      output,
+      WEBCARD_CACHE_PATH_SIZE,
+      "%s%s",
+      base_directory,
+      sub_directory);
+
+    if ((length <= 0) || (length >= WEBCARD_CACHE_PATH_SIZE))
+    {
+      return FALSE;
+    }
+
+    mkdir(output, 0700);
+
+    length = snprintf(
+      output,
+      WEBCARD_CACHE_PATH_SIZE,
+      "%s%s/webcard",
+      base_directory,
+      sub_directory);
+
+    if ((length <= 0) || (length >= WEBCARD_CACHE_PATH_SIZE))
+    {
+      return FALSE;
+    }
+
+    if ((0 != mkdir(output, 0700)) && (EEXIST != errno))
+    {
+      return FALSE;
+    }
+
+    length = snprintf(
+      output,
+      WEBCARD_CACHE_PATH_SIZE,
+      "%s%s/webcard/%s",
+      base_directory,
+      sub_directory,
+      fileName);
+
+    return ((length > 0) && (length < WEBCARD_CACHE_PATH_SIZE));
+  }
+
+#endif
+
+/**************************************************************/
+
+VOID
+OSSpecific_initMappedFile(
+  _Out_ OSSpecificMappedFile *file)
+{
+  #if defined(_WIN32)
+  {
+    file->fileHandle = INVALID_HANDLE_VALUE;
+    file->mappingHandle = NULL;
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    file->fileDescriptor = (-1);
+  }
+  #endif
+
+  file->data = NULL;
+  file->size = 0;
+}
+
+/**************************************************************/
+
+BOOL
+OSSpecific_openMappedFile(
+  _Inout_ OSSpecificMappedFile *file,
+  _In_z_ LPCSTR fileName,
+  _In_ const size_t size)
+{
+  #if defined(_WIN32)
+  {
+    WCHAR path[WEBCARD_CACHE_PATH_SIZE];
+    LARGE_INTEGER file_size;
+
+    if (!OSSpecific_getCacheFilePath(path, fileName))
+    {
+      return FALSE;
+    }
+
+    /* No sharing: another WebCard process cannot open the same file */
+
+    file->fileHandle = CreateFileW(
+      path,
+      (GENERIC_READ | GENERIC_WRITE),
+      0,
+      NULL,
+      (0 == size) ? OPEN_EXISTING : OPEN_ALWAYS,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+
+    if (INVALID_HANDLE_VALUE == file->fileHandle)
+    {
+      return FALSE;
+    }
+
+    if (0 != size)
+    {
+      file_size.QuadPart = (LONGLONG) size;
+
+      if (!SetFilePointerEx(file->fileHandle, file_size, NULL, FILE_BEGIN) ||
+        !SetEndOfFile(file->fileHandle))
+      {
+        return FALSE;
+      }
+    }
+
+    if (!GetFileSizeEx(file->fileHandle, &(file_size)) ||
+      (0 == file_size.QuadPart))
+    {
+      return FALSE;
+    }
+
+    file->mappingHandle = CreateFileMappingW(
+      file->fileHandle,
+      NULL,
+      PAGE_READWRITE,
+      0,
+      0,
+      NULL);
+
+    if (NULL == file->mappingHandle)
+    {
+      return FALSE;
+    }
+
+    file->data = MapViewOfFile(
+      file->mappingHandle,
+      FILE_MAP_ALL_ACCESS,
+      0,
+      0,
+      0);
+
+    if (NULL == file->data)
+    {
+      return FALSE;
+    }
+
+    file->size = (size_t) file_size.QuadPart;
+    return TRUE;
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    char path[WEBCARD_CACHE_PATH_SIZE];
+    struct stat file_stat;
+    void *mapping;
+
+    if (!OSSpecific_getCacheFilePath(path, fileName))
+    {
+      return FALSE;
+    }
+
+    file->fileDescriptor = open(
+      path,
+      (0 == size) ? O_RDWR : (O_RDWR | O_CREAT),
+      0600);
+
+    if (file->fileDescriptor < 0)
+    {
+      return FALSE;
+    }
+
+    /* Another WebCard process (e.g. other browser profile) owns the file */
+
+    if (0 != flock(file->fileDescriptor, (LOCK_EX | LOCK_NB)))
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{flock} failed: cache file \"%s\" is in use",
+        fileName);
+
+      return FALSE;
+    }
+
+    if ((0 != size) && (0 != ftruncate(file->fileDescriptor, (off_t) size)))
+    {
+      return FALSE;
+    }
+
+    if ((0 != fstat(file->fileDescriptor, &(file_stat))) ||
+      (0 == file_stat.st_size))
+    {
+      return FALSE;
+    }
+
+    mapping = mmap(
+      NULL,
+      (size_t) file_stat.st_size,
+      (PROT_READ | PROT_WRITE),
+      MAP_SHARED,
+      file->fileDescriptor,
+      0);
+
+    if (MAP_FAILED == mapping)
+    {
+      return FALSE;
+    }
+
+    file->data = mapping;
+    file->size = (size_t) file_stat.st_size;
+    return TRUE;
+  }
+  #else
+  {
+    return FALSE;
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_flushMappedFile(
+  _In_ const OSSpecificMappedFile *file)
+{
+  if (NULL == file->data)
+  {
+    return;
+  }
+
+  #if defined(_WIN32)
+  {
+    FlushViewOfFile(file->data, 0);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    msync(file->data, file->size, MS_ASYNC);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_closeMappedFile(
+  _Inout_ OSSpecificMappedFile *file)
+{
+  #if defined(_WIN32)
+  {
+    if (NULL != file->data)
+    {
+      FlushViewOfFile(file->data, 0);
+      UnmapViewOfFile(file->data);
+    }
+
+    if (NULL != file->mappingHandle)
+    {
+      CloseHandle(file->mappingHandle);
+    }
+
+    if (INVALID_HANDLE_VALUE != file->fileHandle)
+    {
+      CloseHandle(file->fileHandle);
+    }
+
+    file->fileHandle = INVALID_HANDLE_VALUE;
+    file->mappingHandle = NULL;
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    if (NULL != file->data)
+    {
+      msync(file->data, file->size, MS_SYNC);
+      munmap(file->data, file->size);
+    }
+
+    if (file->fileDescriptor >= 0)
+    {
+      /* Closing the descriptor also releases the `flock` */
+      close(file->fileDescriptor);
+    }
+
+    file->fileDescriptor = (-1);
+  }
+  #endif
+
+  file->data = NULL;
+  file->size = 0;
+}
+
+/**************************************************************/
+
+BOOL
+OSSpecific_deleteCacheFile(
+  _In_z_ LPCSTR fileName)
+{
+  #if defined(_WIN32)
+  {
+    WCHAR path[WEBCARD_CACHE_PATH_SIZE];
+
+    if (!OSSpecific_getCacheFilePath(path, fileName))
+    {
+      return FALSE;
+    }
+
+    return (DeleteFileW(path) || (ERROR_FILE_NOT_FOUND == GetLastError()));
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    char path[WEBCARD_CACHE_PATH_SIZE];
+
+    if (!OSSpecific_getCacheFilePath(path, fileName))
+    {
+      return FALSE;
+    }
+
+    return ((0 == unlink(path)) || (ENOENT == errno));
+  }
+  #else
+  {
+    return FALSE;
+  }
+  #endif
+}
+
+/**************************************************************/
+
+#if defined(__linux__) || defined(__APPLE__)
+
+  /**
+   * @brief A private OS-specific function.
+   * Fills the address of the local socket of the shared Native App.
+   *
+   * @param[out] address Receives the socket path.
+   * @return `TRUE` on success, `FALSE` if the path cannot be determined
+   * (or does not fit a socket address).
+   */
+  BOOL
+  OSSpecific_getLocalSocketAddress(
+    _Out_ struct sockaddr_un *address)
+  {
+    int length;
+    char path[WEBCARD_CACHE_PATH_SIZE];
+    const char *variable = getenv(OS_SPECIFIC_SOCKET_VARIABLE);
+
+    if ((NULL != variable) && ('\0' != variable[0]))
+    {
+      length = snprintf(path, WEBCARD_CACHE_PATH_SIZE, "%s", variable);
+    }
+    else
+    {
+      #if defined(__APPLE__)
+        variable = NULL;
+      #else
+        variable = getenv("XDG_RUNTIME_DIR");
+      #endif
+
+      if ((NULL != variable) && ('\0' != variable[0]))
+      {
+        length = snprintf(path, WEBCARD_CACHE_PATH_SIZE, "%s/webcard.sock", variable);
+      }
+      else if (OSSpecific_getCacheFilePath(path, "daemon.sock"))
+      {
+        length = (int) strlen(path);
+      }
+      else
+      {
+        return FALSE;
+      }
+    }
+
+    if ((length <= 0) || ((size_t) length >= sizeof(address->sun_path)))
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
+        "{OSSpecific::getLocalSocketAddress} invalid path: \"%s\"",
+        path);
+
+      return FALSE;
+    }
+
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, path, (size_t) length + 1);
+
+    return TRUE;
+  }
+
+  /**
+   * @brief A private OS-specific function.
+   * Opens a local stream socket, not inherited by child processes.
+   *
+   * @return Socket descriptor, or `OS_SPECIFIC_INVALID_STREAM`.
+   */
+  int
+  OSSpecific_openLocalSocket(void)
+  {
+    int result = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if ((-1) == result)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
+        "{socket} failed: errno=0x%08X",
+        errno);
+
+      return OS_SPECIFIC_INVALID_STREAM;
+    }
+
+    fcntl(result, F_SETFD, FD_CLOEXEC);
+
+    return result;
+  }
+
+  /**
+   * @brief A private OS-specific function.
+   * Binds a local socket, so that the socket file is never
+   * (not even briefly) accessible to other users.
+   *
+   * @param[in] listener Socket from `OSSpecific_openLocalSocket`.
+   * @param[in] address Socket path.
+   * @return `0` on success, `-1` on error (with `errno` set).
+   */
+  int
+  OSSpecific_bindLocalSocket(
+    _In_ const int listener,
+    _In_ const struct sockaddr_un *address)
+  {
+    int result;
+    int saved_errno;
+    mode_t mask = umask(077);
+
+    result = bind(listener, (const struct sockaddr *) address, sizeof(struct sockaddr_un));
+    saved_errno = errno;
+
+    umask(mask);
+    errno = saved_errno;
+
+    return result;
+  }
+
+  /**
+   * @brief A private OS-specific function.
+   * Checks that a local socket client runs as the current user.
+   *
+   * @param[in] stream Accepted socket.
+   * @return `TRUE` if the peer has the effective user ID of this
+   * process, `FALSE` otherwise (or if it cannot be determined).
+   */
+  BOOL
+  OSSpecific_isLocalPeerTrusted(
+    _In_ const int stream)
+  {
+    uid_t peer_uid;
+
+    #if defined(__APPLE__)
+    {
+      gid_t peer_gid;
+
+      if ((-1) == getpeereid(stream, &(peer_uid), &(peer_gid)))
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{getpeereid} failed: errno=0x%08X",
+          errno);
+
+        return FALSE;
+      }
+    }
+    #else
+    {
+      struct ucred credentials;
+      socklen_t length = sizeof(credentials);
+
+      if ((-1) == getsockopt(stream, SOL_SOCKET, SO_PEERCRED, &(credentials), &(length)))
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{getsockopt} failed: errno=0x%08X",
+          errno);
+
+        return FALSE;
+      }
+
+      peer_uid = credentials.uid;
+    }
+    #endif
+
+    if (geteuid() != peer_uid)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{OSSpecific::isLocalPeerTrusted} rejected a client of user %u",
+        (unsigned int) peer_uid);
+
+      return FALSE;
+    }
+
+    return TRUE;
+  }
+
+#endif
+
+/**************************************************************/
+
+BOOL
+OSSpecific_listenLocalSocket(
+  _Out_ os_specific_stream_t *listenerRef)
+{
+  listenerRef[0] = OS_SPECIFIC_INVALID_STREAM;
+
+  #if defined(_WIN32)
+  {
+    /* Shared Native App is not available on Windows */
+
+    return FALSE;
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    int listener;
+    int connected;
+    struct sockaddr_un address;
+
+    if (!OSSpecific_getLocalSocketAddress(&(address)))
+    {
+      return FALSE;
+    }
+
+    /* Clients that went away must not stop the whole process */
+
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = OSSpecific_openLocalSocket();
+    if ((-1) == listener) { return FALSE; }
+
+    if ((-1) == OSSpecific_bindLocalSocket(listener, &(address)))
+    {
+      if (EADDRINUSE != errno)
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{bind} failed: errno=0x%08X",
+          errno);
+
+        close(listener);
+        return FALSE;
+      }
+
+      /* Socket file exists: is anybody still listening? */
+
+      if (OSSpecific_connectLocalSocket(&(connected)))
+      {
+        close(connected);
+        close(listener);
+
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__WARNING,
+          "{OSSpecific::listenLocalSocket} \"%s\" is already in use",
+          address.sun_path);
+
+        return FALSE;
+      }
+
+      unlink(address.sun_path);
+
+      if ((-1) == OSSpecific_bindLocalSocket(listener, &(address)))
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{bind} failed: errno=0x%08X",
+          errno);
+
+        close(listener);
+        return FALSE;
+      }
+    }
+
+    /* Only the current user (the directory should be private too) */
+
+    if ((-1) == chmod(address.sun_path, 0600))
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
+        "{chmod} failed: errno=0x%08X",
+        errno);
+
+      unlink(address.sun_path);
+      close(listener);
+      return FALSE;
+    }
+
+    if ((-1) == listen(listener, SOMAXCONN))
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
+        "{listen} failed: errno=0x%08X",
+        errno);
+
+      close(listener);
+      return FALSE;
+    }
+
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__INFO,
+      "{OSSpecific::listenLocalSocket} listening on \"%s\"",
+      address.sun_path);
+
+    listenerRef[0] = listener;
+    return TRUE;
+  }
+  #else
+  {
+    return FALSE;
+  }
+  #endif
+}
+
+/**************************************************************/
+
+BOOL
+OSSpecific_acceptLocalSocket(
+  _In_ const os_specific_stream_t listener,
+  _In_ const uint32_t waitTime,
+  _In_ const uint32_t sendTimeout,
+  _Out_ os_specific_stream_t *streamRef)
+{
+  streamRef[0] = OS_SPECIFIC_INVALID_STREAM;
+
+  #if defined(_WIN32)
+  {
+    return FALSE;
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    int result;
+    struct timeval timeout;
+
+    struct pollfd fds =
+    {
+      .fd = listener,
+      .events = POLLIN
+    };
+
+    result = poll(&(fds), 1, (int) waitTime);
+
+    if (result <= 0)
+    {
+      if (((-1) == result) && (EINTR != errno))
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__ERROR,
+          "{poll} failed: errno=0x%08X",
+          errno);
+      }
+
+      return FALSE;
+    }
+
+    result = accept(listener, NULL, NULL);
+
+    if ((-1) == result)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
+        "{accept} failed: errno=0x%08X",
+        errno);
+
+      return FALSE;
+    }
+
+    fcntl(result, F_SETFD, FD_CLOEXEC);
+
+    /* Socket permissions are not enough on every system */
+
+    if (!OSSpecific_isLocalPeerTrusted(result))
+    {
+      close(result);
+      return FALSE;
+    }
+
+    /* A client that stops reading can't block the other ones forever */
+
+    timeout.tv_sec = sendTimeout / 1000;
+    timeout.tv_usec = (sendTimeout % 1000) * 1000;
+
+    setsockopt(result, SOL_SOCKET, SO_SNDTIMEO, &(timeout), sizeof(timeout));
+
+    streamRef[0] = result;
+    return TRUE;
+  }
+  #else
+  {
+    return FALSE;
+  }
+  #endif
+}
+
+/**************************************************************/
+
+BOOL
+OSSpecific_connectLocalSocket(
+  _Out_ os_specific_stream_t *streamRef)
+{
+  streamRef[0] = OS_SPECIFIC_INVALID_STREAM;
+
+  #if defined(_WIN32)
+  {
+    return FALSE;
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    int result;
+    struct sockaddr_un address;
+
+    if (!OSSpecific_getLocalSocketAddress(&(address)))
+    {
+      return FALSE;
+    }
+
+    result = OSSpecific_openLocalSocket();
+    if ((-1) == result) { return FALSE; }
+
+    if ((-1) == connect(result, (struct sockaddr *) &(address), sizeof(address)))
+    {
+      /* Usually `ENOENT` or `ECONNREFUSED`: nobody listens */
+
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__DEBUG,
+        "{connect} failed: errno=0x%08X",
+        errno);
+
+      close(result);
+      return FALSE;
+    }
+
+    streamRef[0] = result;
+    return TRUE;
+  }
+  #else
+  {
+    return FALSE;
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_shutdownLocalSocket(
+  _In_ const os_specific_stream_t stream)
+{
+  #if defined(__linux__) || defined(__APPLE__)
+  {
+    shutdown(stream, SHUT_RDWR);
+  }
+  #endif
+}
+
+/**************************************************************/
+
+VOID
+OSSpecific_closeStream(
+  _In_ const os_specific_stream_t stream)
+{
+  #if defined(_WIN32)
+  {
+    CloseHandle(stream);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    close(stream);
+  }
+  #endif
+}
 
 /**************************************************************/
@@ -41,6 +41,15 @@
   #include <poll.h>
   #include <unistd.h>
 
+  /** Memory-mapped files and advisory file locks */
+  #include <sys/mman.h>
+  #include <sys/file.h>
+
+  /** Local (Unix domain) sockets */
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <signal.h>
+
   /**
    * C library for strings, includes:
    *  `strlen()`, `memcpy()`.
@@ -75,12 +84,8 @@
  */
 #include <stdio.h>
 
-#if defined(_DEBUG)
-
-  /** Accessing variable-argument lists. */
-  #include <stdarg.h>
-
-#endif
+/** Accessing variable-argument lists. */
+#include <stdarg.h>
 
 /** Checking error codes when standard functions fail. */
 #include <errno.h>
@@ -91,9 +96,13 @@
 #if defined(_WIN32)
   typedef HANDLE os_specific_stream_t;
 
+  #define OS_SPECIFIC_INVALID_STREAM  INVALID_HANDLE_VALUE
+
 #elif defined(__linux__) || defined(__APPLE__)
   typedef int os_specific_stream_t;
 
+  #define OS_SPECIFIC_INVALID_STREAM  (-1)
+
 #endif
 
 
@@ -144,12 +153,25 @@ OSSpecific_peekStream(
   _Out_ uint32_t *streamSizeRef);
 
 /**
- * @brief Reads bytes from a stream.
+ * @brief Blocks until a given stream has some data to read
+ * (or until the other end of the pipe is closed).
+ *
+ * @param[in] stream OS-specific stream descriptor, open for reading.
+ * @return `TRUE` when the stream should be peeked again,
+ * `FALSE` on pipe-access errors.
+ */
+extern BOOL
+OSSpecific_waitForStream(
+  _In_ const os_specific_stream_t stream);
+
+/**
+ * @brief Reads bytes from a stream, waiting for all of them.
  *
  * @param[in] stream OS-specific stream descriptor, open for reading.
  * @param[out] output Memory location where `size` of bytes will be stored.
  * @param[in] size Constant number of bytes to read from the stream.
- * @return `TRUE` on success, `FALSE` on any stream error.
+ * @return `TRUE` on success, `FALSE` on any stream error
+ * (including the end of the stream).
  */
 extern BOOL
 OSSpecific_readBytesFromStream(
@@ -173,27 +195,583 @@ OSSpecific_writeBytesToStream(
 
 
 /**************************************************************/
-/* DEBUG DEFINITIONS AND DECLARATIONS                         */
+/* LOCAL SOCKETS                                              */
+/**************************************************************/
+
+/**
+ * Environment variable with the path of the local socket of the
+ * shared Native App (daemon mode). By default the socket is
+ * "$XDG_RUNTIME_DIR/webcard.sock" on Linux, or "daemon.sock"
+ * in the per-user cache directory of WebCard.
+ */
+#define OS_SPECIFIC_SOCKET_VARIABLE  "WEBCARD_SOCKET"
+
+/**
+ * @brief Starts listening on the local socket (Linux and macOS only).
+ *
+ * The socket file is created accessible to the current user only.
+ * A socket file left behind by a process that no longer runs
+ * is replaced. Writes to sockets closed by their peers fail
+ * instead of raising `SIGPIPE`.
+ * @param[out] listenerRef Receives the listening socket.
+ * @return `TRUE` on success, `FALSE` on any socket error
+ * OR if another process is already listening.
+ */
+extern BOOL
+OSSpecific_listenLocalSocket(
+  _Out_ os_specific_stream_t *listenerRef);
+
+/**
+ * @brief Waits for a client of the local socket.
+ *
+ * Clients running as another user are disconnected right away.
+ *
+ * @param[in] listener Socket from `OSSpecific_listenLocalSocket`.
+ * @param[in] waitTime Longest wait, in milliseconds.
+ * @param[in] sendTimeout Writes to the accepted socket fail after
+ * being blocked for this long (in milliseconds).
+ * @param[out] streamRef Receives the connected socket.
+ * @return `TRUE` when a client has connected, `FALSE` on timeout
+ * or on any socket error.
+ */
+extern BOOL
+OSSpecific_acceptLocalSocket(
+  _In_ const os_specific_stream_t listener,
+  _In_ const uint32_t waitTime,
+  _In_ const uint32_t sendTimeout,
+  _Out_ os_specific_stream_t *streamRef);
+
+/**
+ * @brief Connects to the local socket.
+ *
+ * @param[out] streamRef Receives the connected socket.
+ * @return `TRUE` on success, `FALSE` if nobody listens on the socket.
+ */
+extern BOOL
+OSSpecific_connectLocalSocket(
+  _Out_ os_specific_stream_t *streamRef);
+
+/**
+ * @brief Ends both directions of a connected socket, so that
+ * other threads blocked on it see the end of the stream.
+ *
+ * @param[in] stream Connected socket (still to be closed).
+ */
+extern VOID
+OSSpecific_shutdownLocalSocket(
+  _In_ const os_specific_stream_t stream);
+
+/**
+ * @brief Closes a socket (or any other stream).
+ *
+ * @param[in] stream OS-specific stream descriptor.
+ */
+extern VOID
+OSSpecific_closeStream(
+  _In_ const os_specific_stream_t stream);
+
+
+/**************************************************************/
+/* TIMING                                                     */
+/**************************************************************/
+
+/**
+ * @brief Reads a monotonic clock (unaffected by system time changes).
+ *
+ * The starting point is unspecified, so the result is only meaningful
+ * when compared with another result of this function.
+ * @return Current time in milliseconds.
+ */
+extern uint64_t
+OSSpecific_getMonotonicTime(void);
+
+/**
+ * @brief Reads a high-resolution monotonic clock, for measuring
+ * short durations.
+ *
+ * The starting point is unspecified (and differs from
+ * `OSSpecific_getMonotonicTime`).
+ * @return Current time in nanoseconds.
+ */
+extern uint64_t
+OSSpecific_getPreciseTime(void);
+
+/**
+ * @brief Suspends the calling thread.
+ *
+ * @param[in] microseconds Minimal time to wait. Windows rounds it up
+ * to whole milliseconds.
+ */
+extern VOID
+OSSpecific_sleep(
+  _In_ const uint32_t microseconds);
+
+
+/**************************************************************/
+/* THREADS                                                    */
 /**************************************************************/
 
+#if defined(_WIN32)
+  typedef HANDLE os_specific_thread_t;
+  typedef SRWLOCK os_specific_mutex_t;
+  typedef CONDITION_VARIABLE os_specific_condition_t;
+
+  /** Static initialization of a mutex (no `initMutex` call needed). */
+  #define OS_SPECIFIC_MUTEX_INITIALIZER  SRWLOCK_INIT
+
+  /** Signature of a thread body, `parameter` is passed to `startThread`. */
+  #define OS_SPECIFIC_THREAD_ROUTINE(name) \
+    DWORD WINAPI name(_In_ LPVOID parameter)
+
+  typedef DWORD (WINAPI *os_specific_thread_routine_t)(LPVOID);
+
+#elif defined(__linux__) || defined(__APPLE__)
+  #include <pthread.h>
+
+  typedef pthread_t os_specific_thread_t;
+  typedef pthread_mutex_t os_specific_mutex_t;
+  typedef pthread_cond_t os_specific_condition_t;
+
+  /** Static initialization of a mutex (no `initMutex` call needed). */
+  #define OS_SPECIFIC_MUTEX_INITIALIZER  PTHREAD_MUTEX_INITIALIZER
+
+  /** Signature of a thread body, `parameter` is passed to `startThread`. */
+  #define OS_SPECIFIC_THREAD_ROUTINE(name) \
+    void * name(_In_ void *parameter)
+
+  typedef void * (*os_specific_thread_routine_t)(void *);
+
+#endif
+
+/**
+ * @brief Starts a new thread.
+ *
+ * @param[out] threadRef Receives the thread identifier.
+ * @param[in] routine Function declared with `OS_SPECIFIC_THREAD_ROUTINE`
+ * (returning `0`).
+ * @param[in] parameter Argument for the `routine`.
+ * @return `TRUE` on success, otherwise `FALSE`.
+ */
+extern BOOL
+OSSpecific_startThread(
+  _Out_ os_specific_thread_t *threadRef,
+  _In_ os_specific_thread_routine_t routine,
+  _In_opt_ void *parameter);
+
+/**
+ * @brief Waits for a thread to finish and releases it.
+ *
+ * @param[in] thread Identifier from `OSSpecific_startThread`.
+ */
+extern VOID
+OSSpecific_joinThread(
+  _In_ os_specific_thread_t thread);
+
+/**
+ * @brief Mutex constructor.
+ *
+ * @param[out] mutex Reference to an UNINITIALIZED mutex.
+ */
+extern VOID
+OSSpecific_initMutex(
+  _Out_ os_specific_mutex_t *mutex);
+
+/**
+ * @brief Mutex destructor (the mutex must not be locked).
+ */
+extern VOID
+OSSpecific_destroyMutex(
+  _Inout_ os_specific_mutex_t *mutex);
+
+/**
+ * @brief Locks a (non-recursive) mutex.
+ */
+extern VOID
+OSSpecific_lockMutex(
+  _Inout_ os_specific_mutex_t *mutex);
+
+/**
+ * @brief Unlocks a mutex locked by the calling thread.
+ */
+extern VOID
+OSSpecific_unlockMutex(
+  _Inout_ os_specific_mutex_t *mutex);
+
+/**
+ * @brief Condition variable constructor.
+ *
+ * @param[out] condition Reference to an UNINITIALIZED condition variable.
+ */
+extern VOID
+OSSpecific_initCondition(
+  _Out_ os_specific_condition_t *condition);
+
+/**
+ * @brief Condition variable destructor (no thread may be waiting).
+ */
+extern VOID
+OSSpecific_destroyCondition(
+  _Inout_ os_specific_condition_t *condition);
+
+/**
+ * @brief Wakes all the threads waiting for a condition variable.
+ */
+extern VOID
+OSSpecific_broadcastCondition(
+  _Inout_ os_specific_condition_t *condition);
+
+/**
+ * @brief Atomically unlocks a mutex and waits for a condition variable,
+ * then locks the mutex again. Spurious wake-ups are possible.
+ *
+ * @param[in,out] condition Condition variable.
+ * @param[in,out] mutex Mutex locked by the calling thread.
+ * @param[in] timeout Longest wait in nanoseconds
+ * (`UINT64_MAX` waits without a time limit).
+ */
+extern VOID
+OSSpecific_waitCondition(
+  _Inout_ os_specific_condition_t *condition,
+  _Inout_ os_specific_mutex_t *mutex,
+  _In_ const uint64_t timeout);
+
+
+/**************************************************************/
+/* ATOMIC VALUES                                              */
+/**************************************************************/
+
+/**
+ * Integers shared by threads without a mutex. Every access goes
+ * through the `OSSpecific_atomic*` macros (each one a full memory
+ * barrier). MSVC has `<stdatomic.h>` only behind the compiler flag
+ * "/experimental:c11atomics", so Windows uses `Interlocked*` instead.
+ *
+ * `OSSpecific_atomicAdd` returns the previous value.
+ * `OSSpecific_atomicCompareExchange` stores `desired` only if the value
+ * is `expected` (evaluated twice on Windows) and tells if it did.
+ */
+#if defined(_WIN32)
+  typedef volatile LONG64 os_specific_atomic_t;
+
+  #define OSSpecific_atomicLoad(atomic) \
+    InterlockedCompareExchange64((atomic), 0, 0)
+
+  #define OSSpecific_atomicStore(atomic, value) \
+    ((void) InterlockedExchange64((atomic), (LONG64) (value)))
+
+  #define OSSpecific_atomicAdd(atomic, value) \
+    InterlockedExchangeAdd64((atomic), (LONG64) (value))
+
+  #define OSSpecific_atomicCompareExchange(atomic, expected, desired) \
+    ((LONG64) (expected) == InterlockedCompareExchange64( \
+      (atomic), (LONG64) (desired), (LONG64) (expected)))
+
+#elif defined(__linux__) || defined(__APPLE__)
+  typedef int64_t os_specific_atomic_t;
+
+  #define OSSpecific_atomicLoad(atomic) \
+    __atomic_load_n((atomic), __ATOMIC_SEQ_CST)
+
+  #define OSSpecific_atomicStore(atomic, value) \
+    __atomic_store_n((atomic), (int64_t) (value), __ATOMIC_SEQ_CST)
+
+  #define OSSpecific_atomicAdd(atomic, value) \
+    __atomic_fetch_add((atomic), (int64_t) (value), __ATOMIC_SEQ_CST)
+
+  #define OSSpecific_atomicCompareExchange(atomic, expected, desired) \
+    __sync_bool_compare_and_swap((atomic), (int64_t) (expected), (int64_t) (desired))
+
+#endif
+
+
+/**************************************************************/
+/* MEMORY-MAPPED FILES                                        */
+/**************************************************************/
+
+/**
+ * `OSSpecificMappedFile` type definition.
+ */
+typedef struct OSSpecificMappedFile OSSpecificMappedFile;
+
+/**
+ * A file from the per-user cache directory, mapped into memory
+ * and locked for exclusive use by this process.
+ */
+struct OSSpecificMappedFile
+{
+  #if defined(_WIN32)
+    /** File handle (opened without sharing, which also acts as a lock). */
+    HANDLE fileHandle;
+
+    /** File-mapping object handle. */
+    HANDLE mappingHandle;
+
+  #elif defined(__linux__) || defined(__APPLE__)
+    /** File descriptor (holding an exclusive `flock`). */
+    int fileDescriptor;
+
+  #endif
+
+  /** Mapped view of the whole file (`NULL` when closed). */
+  LPBYTE data;
+
+  /** Size of the file and of the mapped view, in bytes. */
+  size_t size;
+};
+
+/**
+ * @brief `OSSpecificMappedFile` constructor (closed file).
+ *
+ * @param[out] file Reference to an UNINITIALIZED `OSSpecificMappedFile` object.
+ */
+extern VOID
+OSSpecific_initMappedFile(
+  _Out_ OSSpecificMappedFile *file);
+
+/**
+ * @brief Opens (or creates) a file in the per-user cache directory
+ * of WebCard and maps it into memory.
+ *
+ * Linux: "$XDG_CACHE_HOME/webcard" (or "~/.cache/webcard"),
+ * macOS: "~/Library/Caches/webcard", Windows: "%LOCALAPPDATA%\WebCard".
+ * @param[in,out] file Reference to a VALID (closed) `OSSpecificMappedFile`.
+ * @param[in] fileName ASCII name of the file (without directories).
+ * @param[in] size Required size of the file (it will be created, extended
+ * or truncated), or `0` to open an existing file with its current size.
+ * @return `TRUE` on success, `FALSE` on any file-system error
+ * OR if another process is already using the file.
+ *
+ * @note If the function failed, `file` should still be passed
+ * to `OSSpecific_closeMappedFile`.
+ */
+extern BOOL
+OSSpecific_openMappedFile(
+  _Inout_ OSSpecificMappedFile *file,
+  _In_z_ LPCSTR fileName,
+  _In_ const size_t size);
+
+/**
+ * @brief Schedules writing of modified pages back to the disk.
+ *
+ * @param[in] file Reference to a VALID and CONSTANT `OSSpecificMappedFile`.
+ */
+extern VOID
+OSSpecific_flushMappedFile(
+  _In_ const OSSpecificMappedFile *file);
+
+/**
+ * @brief Unmaps and closes the file (releasing the lock).
+ *
+ * @param[in,out] file Reference to a VALID `OSSpecificMappedFile` object.
+ */
+extern VOID
+OSSpecific_closeMappedFile(
+  _Inout_ OSSpecificMappedFile *file);
+
+/**
+ * @brief Deletes a file from the per-user cache directory of WebCard.
+ *
+ * @param[in] fileName ASCII name of the file (without directories).
+ * @return `TRUE` on success (or if the file did not exist), otherwise `FALSE`.
+ */
+extern BOOL
+OSSpecific_deleteCacheFile(
+  _In_z_ LPCSTR fileName);
+
+
+/**************************************************************/
+/* LOGGING                                                    */
+/**************************************************************/
+
+#define DEBUG_MESSAGE_START "-- "
+#define DEBUG_MESSAGE_END " --\n"
+
+/**
+ * Log levels. Messages above the current level are skipped
+ * before any of their arguments are evaluated.
+ */
+
+  #define OS_SPECIFIC_LOG__OFF      0
+  #define OS_SPECIFIC_LOG__ERROR    1
+  #define OS_SPECIFIC_LOG__WARNING  2
+  #define OS_SPECIFIC_LOG__INFO     3
+  #define OS_SPECIFIC_LOG__DEBUG    4
+  #define OS_SPECIFIC_LOG__TRACE    5
+
+/**
+ * Environment variable with the initial log level,
+ * as a name ("error", "warning", "info", "debug", "trace") or a number.
+ */
+#define OS_SPECIFIC_LOG_VARIABLE  "WEBCARD_LOG"
+
+/** Debug builds log everything unless told otherwise. */
 #if defined(_DEBUG)
+  #define OS_SPECIFIC_LOG_DEFAULT  OS_SPECIFIC_LOG__TRACE
+#else
+  #define OS_SPECIFIC_LOG_DEFAULT  OS_SPECIFIC_LOG__OFF
+#endif
 
-  #define DEBUG_MESSAGE_START "-- "
-  #define DEBUG_MESSAGE_END " --\n"
+/** Number of messages waiting for the flusher thread (power of two). */
+#define OS_SPECIFIC_LOG_SLOTS  1024
 
-  /**
-   * @brief Outputs a debug message (info or error).
-   *
-   * On all operating systems, the message is passed to `STDERR` stream.
-   * On Windows, the message is also passed to `OutputDebugStringA` function.
-   * @param[in] message A NULL-terminated UTF-8 string
-   * that acts as a message format.
-   * @param[in] ... variable arguments for message formatting.
-   */
-  extern VOID
-  OSSpecific_writeDebugMessage(
-    _In_z_ LPCSTR message,
-    ...);
+/** Size of one queued message, including copied strings and bytes. */
+#define OS_SPECIFIC_LOG_SLOT_SIZE  512
+
+/** Up to this many arguments of a message are kept. */
+#define OS_SPECIFIC_LOG_MAX_ARGUMENTS  8
+
+/** How often the flusher thread writes queued messages (microseconds). */
+#define OS_SPECIFIC_LOG_FLUSH_INTERVAL  10000
+
+/**
+ * @brief Queues a log message, when `level` is enabled.
+ *
+ * Formatting is deferred to the flusher thread: only the format and
+ * the arguments are copied (strings included), so the message must use
+ * a string literal as the format. Supported conversions are those of
+ * `printf()` except `%n` and wide strings.
+ * @param[in] level One of `OS_SPECIFIC_LOG__ERROR` ... `OS_SPECIFIC_LOG__TRACE`.
+ * @param[in] ... format, then the variable arguments for message formatting.
+ */
+#define OSSpecific_writeLogMessage(level, ...) \
+  do \
+  { \
+    if (OSSpecific_isLogEnabled(level)) \
+    { \
+      OSSpecific_pushLogMessage((level), __VA_ARGS__); \
+    } \
+  } \
+  while (0)
+
+/**
+ * @brief Queues a hex-dump of some bytes, when `level` is enabled.
+ * Long dumps are truncated to fit a single queued message.
+ */
+#define OSSpecific_writeLogBytes(level, label, bytes, length) \
+  do \
+  { \
+    if (OSSpecific_isLogEnabled(level)) \
+    { \
+      OSSpecific_pushLogBytes((level), (label), (bytes), (length)); \
+    } \
+  } \
+  while (0)
+
+/**
+ * @brief Sets the initial log level (from `OS_SPECIFIC_LOG_VARIABLE`
+ * or the default one) and starts the flusher thread when needed.
+ */
+extern VOID
+OSSpecific_initLogger(void);
+
+/**
+ * @brief Writes all queued messages and stops the flusher thread.
+ */
+extern VOID
+OSSpecific_destroyLogger(void);
+
+/**
+ * @brief Checks whether messages of given level are written.
+ *
+ * @param[in] level Log level of a message.
+ * @return `TRUE` if the message would be written, otherwise `FALSE`.
+ */
+extern BOOL
+OSSpecific_isLogEnabled(
+  _In_ const int level);
+
+/**
+ * @brief Changes the log level (starting the flusher thread if needed).
+ *
+ * @param[in] level New log level, from `OS_SPECIFIC_LOG__OFF`
+ * to `OS_SPECIFIC_LOG__TRACE`.
+ * @return `TRUE` on success, `FALSE` for an invalid level or when
+ * the flusher thread could not be started.
+ */
+extern BOOL
+OSSpecific_setLogLevel(
+  _In_ const int level);
+
+/**
+ * @brief Reads the current log level.
+ *
+ * @param[out] droppedRef Number of messages dropped because the
+ * queue was full (the flusher thread could not keep up).
+ * @return Current log level.
+ */
+extern int
+OSSpecific_getLogLevel(
+  _Out_opt_ uint64_t *droppedRef);
+
+/**
+ * @brief Use `OSSpecific_writeLogMessage` instead
+ * (which checks the level first).
+ */
+extern VOID
+OSSpecific_pushLogMessage(
+  _In_ const int level,
+  _In_z_ LPCSTR format,
+  ...);
+
+/**
+ * @brief Use `OSSpecific_writeLogBytes` instead
+ * (which checks the level first).
+ */
+extern VOID
+OSSpecific_pushLogBytes(
+  _In_ const int level,
+  _In_z_ LPCSTR label,
+  _In_ const BYTE *bytes,
+  _In_ const size_t length);
+
+
+/**************************************************************/
+/* STATIC PROBES                                              */
+/**************************************************************/
+
+/**
+ * Static tracepoints of the "webcard" provider, for `perf probe`,
+ * `bpftrace` or SystemTap attached to a running Native App.
+ *
+ * Compiled in with `make PROBES=1` (Linux, requires `<sys/sdt.h>` from
+ * "systemtap-sdt-dev"): every probe is then a single `nop` instruction,
+ * with its arguments described in the ".note.stapsdt" ELF section.
+ * Otherwise probes expand to nothing (arguments are never evaluated).
+ *
+ * Probe names use `__` in place of `-` (for example `request__start`
+ * is listed as `sdt_webcard:request__start` by `perf list`).
+ */
+#if defined(WEBCARD_PROBES) && defined(__linux__)
+
+  #include <sys/sdt.h>
+
+  #define OSSpecific_probe1(name, a) \
+    DTRACE_PROBE1(webcard, name, (a))
+
+  #define OSSpecific_probe2(name, a, b) \
+    DTRACE_PROBE2(webcard, name, (a), (b))
+
+  #define OSSpecific_probe3(name, a, b, c) \
+    DTRACE_PROBE3(webcard, name, (a), (b), (c))
+
+  #define OSSpecific_probe4(name, a, b, c, d) \
+    DTRACE_PROBE4(webcard, name, (a), (b), (c), (d))
+
+#else
+
+  /* Arguments stay "used" (no warnings), the dead branch is removed */
+
+  #define OSSpecific_probe1(name, a) \
+    do { if (0) { (void) (a); } } while (0)
+
+  #define OSSpecific_probe2(name, a, b) \
+    do { if (0) { (void) (a); (void) (b); } } while (0)
+
+  #define OSSpecific_probe3(name, a, b, c) \
+    do { if (0) { (void) (a); (void) (b); (void) (c); } } while (0)
+
+  #define OSSpecific_probe4(name, a, b, c, d) \
+    do { if (0) { (void) (a); (void) (b); (void) (c); (void) (d); } } while (0)
 
 #endif
 
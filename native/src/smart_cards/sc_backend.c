@@ -0,0 +1,285 @@
+/**
+ * @file "native/src/smart_cards/sc_backend.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscEstablishContext(
+  _Out_ LPSCARDCONTEXT context)
+{
+  return SCardEstablishContext(
+    SCARD_SCOPE_USER,
+    NULL,
+    NULL,
+    context);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscReleaseContext(
+  _In_ SCARDCONTEXT context)
+{
+  return SCardReleaseContext(context);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscListReaders(
+  _In_ SCARDCONTEXT context,
+  _Out_opt_ LPTSTR readerNames,
+  _Inout_ PCSC_DWORD *readerNamesLength)
+{
+  return SCardListReaders(
+    context,
+    NULL,
+    readerNames,
+    readerNamesLength);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscGetStatusChange(
+  _In_ SCARDCONTEXT context,
+  _In_ PCSC_DWORD timeout,
+  _Inout_ SCARD_READERSTATE *readerStates,
+  _In_ PCSC_DWORD readerCount)
+{
+  return SCardGetStatusChange(
+    context,
+    timeout,
+    readerStates,
+    readerCount);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscConnect(
+  _In_ SCARDCONTEXT context,
+  _In_ LPCTSTR readerName,
+  _In_ PCSC_DWORD shareMode,
+  _In_ PCSC_DWORD preferredProtocols,
+  _Out_ LPSCARDHANDLE card,
+  _Out_ PCSC_DWORD *activeProtocol)
+{
+  return SCardConnect(
+    context,
+    readerName,
+    shareMode,
+    preferredProtocols,
+    card,
+    activeProtocol);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscDisconnect(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD disposition)
+{
+  return SCardDisconnect(card, disposition);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscReconnect(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD shareMode,
+  _In_ PCSC_DWORD preferredProtocols,
+  _In_ PCSC_DWORD initialization,
+  _Out_ PCSC_DWORD *activeProtocol)
+{
+  return SCardReconnect(
+    card,
+    shareMode,
+    preferredProtocols,
+    initialization,
+    activeProtocol);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscTransmit(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD activeProtocol,
+  _In_ const BYTE *input,
+  _In_ PCSC_DWORD inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLength)
+{
+  return SCardTransmit(
+    card,
+    (SCARD_PROTOCOL_T0 == activeProtocol) ?
+      SCARD_PCI_T0 :
+      SCARD_PCI_T1,
+    input,
+    inputLength,
+    NULL,
+    output,
+    outputLength);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Forwards the call to the "WinSCard" / "PCSC Lite" library.
+ */
+PCSC_LONG
+SCardBackend_pcscCancel(
+  _In_ SCARDCONTEXT context)
+{
+  return SCardCancel(context);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Checks if the "Smart Card" service / "pcscd" daemon is running.
+ */
+BOOL
+SCardBackend_pcscIsServiceAvailable(void)
+{
+  #if defined(_WIN32)
+  {
+    BOOL available = TRUE;
+    HANDLE started_event = SCardAccessStartedEvent();
+
+    if (NULL != started_event)
+    {
+      available = (WAIT_OBJECT_0 == WaitForSingleObject(started_event, 0));
+      SCardReleaseStartedEvent();
+    }
+
+    return available;
+  }
+  #elif defined(__linux__)
+  {
+    LPCSTR socket_path = getenv("PCSCLITE_CSOCK_NAME");
+
+    if ((NULL == socket_path) || ('\0' == socket_path[0]))
+    {
+      socket_path = WEBCARD_PCSCLITE_SOCKET;
+    }
+
+    /* Created by "pcscd" when it starts (or by "systemd", */
+    /* which starts "pcscd" on the first connection) */
+
+    return (0 == access(socket_path, F_OK));
+  }
+  #else
+  {
+    /* Can't be told (macOS: "CryptoTokenKit") */
+    return TRUE;
+  }
+  #endif
+}
+
+/**************************************************************/
+
+const SCardBackend SCardBackend_pcsc =
+{
+  "pcsc",
+  SCardBackend_pcscEstablishContext,
+  SCardBackend_pcscReleaseContext,
+  SCardBackend_pcscListReaders,
+  SCardBackend_pcscGetStatusChange,
+  SCardBackend_pcscConnect,
+  SCardBackend_pcscDisconnect,
+  SCardBackend_pcscReconnect,
+  SCardBackend_pcscTransmit,
+  SCardBackend_pcscCancel,
+  SCardBackend_pcscIsServiceAvailable
+};
+
+const SCardBackend *SCardBackend_current = &(SCardBackend_pcsc);
+
+/**************************************************************/
+
+BOOL
+SCardBackend_select(void)
+{
+  LPCSTR file_name = getenv(WEBCARD_SIMULATOR_VARIABLE);
+
+  if ((NULL == file_name) || ('\0' == file_name[0]))
+  {
+    SCardBackend_current = &(SCardBackend_pcsc);
+    return TRUE;
+  }
+
+  if (!SCardSimulator_load(file_name))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{SCardBackend::select} invalid reader farm \"%s\"",
+      file_name);
+
+    return FALSE;
+  }
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{SCardBackend::select} simulated reader farm \"%s\"",
+    file_name);
+
+  SCardBackend_current = &(SCardBackend_simulated);
+  return TRUE;
+}
+
+/**************************************************************/
+
+VOID
+SCardBackend_release(void)
+{
+  if (&(SCardBackend_simulated) == SCardBackend_current)
+  {
+    SCardSimulator_destroy();
+  }
+
+  SCardBackend_current = &(SCardBackend_pcsc);
+}
+
+/**************************************************************/
@@ -0,0 +1,855 @@
+/**
+ * @file "native/src/smart_cards/sc_cache.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+/** Number of hash buckets allocated on first use. */
+#define SCARD_APDU_CACHE__INITIAL_BUCKETS  64
+
+/** Instruction bytes ("INS") referenced by the APDU cache. */
+#define SCARD_INS__SELECT         0xA4
+#define SCARD_INS__READ_BINARY    0xB0
+#define SCARD_INS__GET_DATA       0xCA
+
+/** Selections ("P1" of SELECT) that don't depend on the current DF. */
+#define SCARD_SELECT_P1__DF_NAME       0x04
+#define SCARD_SELECT_P1__PATH_FROM_MF  0x08
+
+/**
+ * Instructions that modify card contents (ISO/IEC 7816-4
+ * and GlobalPlatform) and therefore invalidate cached responses.
+ */
+static const BYTE SCardApduCache_modifyingInstructions[] =
+{
+  0x0E, /* ERASE BINARY */
+  0x0F, /* ERASE BINARY */
+  0x44, /* ACTIVATE FILE */
+  0xD0, /* WRITE BINARY */
+  0xD1, /* WRITE BINARY */
+  0xD2, /* WRITE RECORD */
+  0xD6, /* UPDATE BINARY */
+  0xD7, /* UPDATE BINARY */
+  0xDA, /* PUT DATA */
+  0xDB, /* PUT DATA */
+  0xDC, /* UPDATE RECORD */
+  0xDD, /* UPDATE RECORD */
+  0xE0, /* CREATE FILE */
+  0xE2, /* APPEND RECORD */
+  0xE4, /* DELETE FILE */
+  0xE6, /* TERMINATE DF / INSTALL */
+  0xE8, /* TERMINATE EF / LOAD */
+  0xFE  /* TERMINATE CARD USAGE */
+};
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Computes a FNV-1a hash of a reader index and a cache key.
+ */
+uint32_t
+SCardApduCache_hash(
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength)
+{
+  uint32_t hash = 2166136261U;
+
+  hash = (hash ^ ((uint32_t) readerIndex)) * 16777619U;
+
+  for (size_t i = 0; i < keyLength; i++)
+  {
+    hash = (hash ^ key[i]) * 16777619U;
+  }
+
+  return hash;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Number of bytes accounted against the byte budget for one entry.
+ */
+size_t
+SCardApduCache_entrySize(
+  _In_ const size_t keyLength,
+  _In_ const size_t responseLength)
+{
+  return sizeof(SCardCacheEntry) + keyLength + responseLength;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Unlinks an entry from the "Least Recently Used" list.
+ */
+VOID
+SCardApduCache_unlinkRecent(
+  _Inout_ SCardApduCache *cache,
+  _Inout_ SCardCacheEntry *entry)
+{
+  if (NULL != entry->newer)
+  {
+    entry->newer->older = entry->older;
+  }
+  else
+  {
+    cache->newest = entry->older;
+  }
+
+  if (NULL != entry->older)
+  {
+    entry->older->newer = entry->newer;
+  }
+  else
+  {
+    cache->oldest = entry->newer;
+  }
+
+  entry->newer = NULL;
+  entry->older = NULL;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Places an (unlinked) entry at the front of the "Least Recently Used" list.
+ */
+VOID
+SCardApduCache_linkNewest(
+  _Inout_ SCardApduCache *cache,
+  _Inout_ SCardCacheEntry *entry)
+{
+  entry->newer = NULL;
+  entry->older = cache->newest;
+
+  if (NULL != cache->newest)
+  {
+    cache->newest->newer = entry;
+  }
+  else
+  {
+    cache->oldest = entry;
+  }
+
+  cache->newest = entry;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Removes one entry from the hash table and the LRU list, then releases it.
+ */
+VOID
+SCardApduCache_removeEntry(
+  _Inout_ SCardApduCache *cache,
+  _Inout_ SCardCacheEntry *entry)
+{
+  SCardCacheEntry **link;
+
+  link = &(cache->buckets[entry->hash & (cache->bucketCount - 1)]);
+
+  while (entry != link[0])
+  {
+    link = &(link[0]->bucketNext);
+  }
+
+  link[0] = entry->bucketNext;
+
+  SCardApduCache_unlinkRecent(cache, entry);
+
+  cache->byteCount -= SCardApduCache_entrySize(
+    entry->keyLength,
+    entry->response.length);
+
+  cache->entryCount -= 1;
+
+  UTF8String_destroy(&(entry->response));
+  free(entry->key);
+  free(entry);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Evicts least recently used entries until `extraBytes` fit in the budget.
+ */
+VOID
+SCardApduCache_evict(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t extraBytes)
+{
+  while ((NULL != cache->oldest) &&
+    ((cache->byteCount + extraBytes) > cache->byteBudget))
+  {
+    SCardApduCache_removeEntry(cache, cache->oldest);
+    cache->evictions += 1;
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Doubles the number of hash buckets (or allocates the initial ones).
+ * A failed allocation is not an error: chains just get longer.
+ */
+VOID
+SCardApduCache_growBuckets(
+  _Inout_ SCardApduCache *cache)
+{
+  SCardCacheEntry **test_buckets;
+  SCardCacheEntry *entry;
+  size_t new_count;
+
+  new_count = (0 == cache->bucketCount) ?
+    SCARD_APDU_CACHE__INITIAL_BUCKETS :
+    (2 * cache->bucketCount);
+
+  test_buckets = calloc(new_count, sizeof(SCardCacheEntry *));
+  if (NULL == test_buckets) { return; }
+
+  /* Re-hash using the LRU list (it links every entry) */
+
+  for (entry = cache->oldest; NULL != entry; entry = entry->newer)
+  {
+    entry->bucketNext = test_buckets[entry->hash & (new_count - 1)];
+    test_buckets[entry->hash & (new_count - 1)] = entry;
+  }
+
+  if (NULL != cache->buckets)
+  {
+    free(cache->buckets);
+  }
+
+  cache->buckets = test_buckets;
+  cache->bucketCount = new_count;
+}
+
+/**************************************************************/
+
+VOID
+SCardApduCache_init(
+  _Out_ SCardApduCache *cache)
+{
+  const BYTE default_instructions[] =
+  {
+    SCARD_INS__READ_BINARY,
+    SCARD_INS__GET_DATA
+  };
+
+  cache->byteBudget  = 0;
+  cache->byteCount   = 0;
+  cache->entryCount  = 0;
+  cache->bucketCount = 0;
+  cache->buckets     = NULL;
+  cache->newest      = NULL;
+  cache->oldest      = NULL;
+  cache->hits        = 0;
+  cache->misses      = 0;
+  cache->evictions   = 0;
+
+  cache->elidedSelects = 0;
+
+  SCardCacheFile_init(&(cache->persistent));
+
+  SCardApduCache_setAllowedInstructions(
+    cache,
+    default_instructions,
+    sizeof(default_instructions));
+}
+
+/**************************************************************/
+
+VOID
+SCardApduCache_destroy(
+  _Inout_ SCardApduCache *cache)
+{
+  SCardApduCache_clear(cache);
+
+  if (NULL != cache->buckets)
+  {
+    free(cache->buckets);
+  }
+
+  cache->buckets = NULL;
+  cache->bucketCount = 0;
+
+  SCardCacheFile_destroy(&(cache->persistent));
+}
+
+/**************************************************************/
+
+VOID
+SCardApduCache_clear(
+  _Inout_ SCardApduCache *cache)
+{
+  while (NULL != cache->oldest)
+  {
+    SCardApduCache_removeEntry(cache, cache->oldest);
+  }
+}
+
+/**************************************************************/
+
+VOID
+SCardApduCache_invalidateReader(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex)
+{
+  SCardCacheEntry *entry;
+  SCardCacheEntry *next_entry;
+
+  for (entry = cache->oldest; NULL != entry; entry = next_entry)
+  {
+    next_entry = entry->newer;
+
+    if (readerIndex == entry->readerIndex)
+    {
+      SCardApduCache_removeEntry(cache, entry);
+    }
+  }
+}
+
+/**************************************************************/
+
+VOID
+SCardApduCache_setBudget(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t byteBudget)
+{
+  cache->byteBudget = byteBudget;
+
+  SCardApduCache_evict(cache, 0);
+}
+
+/**************************************************************/
+
+VOID
+SCardApduCache_setAllowedInstructions(
+  _Inout_ SCardApduCache *cache,
+  _In_ const BYTE *instructions,
+  _In_ const size_t count)
+{
+  memset(cache->allowedInstructions, 0x00, sizeof(cache->allowedInstructions));
+
+  for (size_t i = 0; i < count; i++)
+  {
+    cache->allowedInstructions[instructions[i] >> 3] |=
+      (BYTE) (1 << (instructions[i] & 0x07));
+  }
+
+  /* Responses of removed instructions must not be served anymore */
+
+  SCardApduCache_clear(cache);
+}
+
+/**************************************************************/
+
+BOOL
+SCardApduCache_isCacheable(
+  _In_ const SCardApduCache *cache,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength)
+{
+  if (apduLength < 4)
+  {
+    return FALSE;
+  }
+
+  if ((0 == cache->byteBudget) &&
+    !SCardCacheFile_isOpen(&(cache->persistent)))
+  {
+    return FALSE;
+  }
+
+  /* Basic logical channel only ("SELECT" context is not tracked */
+  /* for other channels), no secure messaging (responses differ every time) */
+
+  if ((0xFF == apdu[0]) || (0 != (apdu[0] & 0x4F)))
+  {
+    return FALSE;
+  }
+
+  return (0 != (cache->allowedInstructions[apdu[1] >> 3] &
+    (1 << (apdu[1] & 0x07))));
+}
+
+/**************************************************************/
+
+BOOL
+SCardApduCache_makeKey(
+  _In_ const SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _Outptr_result_maybenull_ LPBYTE *keyRef,
+  _Out_ size_t *keyLengthRef)
+{
+  LPBYTE key;
+  size_t offset;
+  const SCardSelection *selection = &(connection->selections[0]);
+
+  keyRef[0] = NULL;
+  keyLengthRef[0] = 0;
+
+  /* Never cache anything if the card identity or the selected file */
+  /* is unknown (a plain "GET DATA" is fine without a "SELECT") */
+
+  if (0 == connection->cardAtrLength)
+  {
+    return FALSE;
+  }
+
+  if ((0 == selection->commandLength) &&
+    (SCARD_INS__GET_DATA != apdu[1]))
+  {
+    return FALSE;
+  }
+
+  /* A SELECT relative to the current DF (P1 = 00 to 03, 09) */
+  /* names different files depending on what was selected before, */
+  /* so only selections by DF name or by path from the MF are used */
+  /* (first or only occurrence) */
+
+  if ((0 != selection->commandLength) &&
+    (((SCARD_SELECT_P1__DF_NAME != selection->command[2]) &&
+      (SCARD_SELECT_P1__PATH_FROM_MF != selection->command[2])) ||
+    (0 != (selection->command[3] & 0x03))))
+  {
+    return FALSE;
+  }
+
+  /* Layout: [ATR length] [ATR] [serial length] [serial] */
+  /* [SELECT length] [SELECT] [APDU] */
+
+  keyLengthRef[0] = 3 +
+    connection->cardAtrLength +
+    connection->cardSerialLength +
+    selection->commandLength +
+    apduLength;
+
+  key = malloc(sizeof(BYTE) * keyLengthRef[0]);
+  if (NULL == key) { return FALSE; }
+
+  offset = 0;
+
+  key[offset] = (BYTE) connection->cardAtrLength;
+  offset += 1;
+  memcpy(&(key[offset]), connection->cardAtr, connection->cardAtrLength);
+  offset += connection->cardAtrLength;
+
+  key[offset] = (BYTE) connection->cardSerialLength;
+  offset += 1;
+  memcpy(&(key[offset]), connection->cardSerial, connection->cardSerialLength);
+  offset += connection->cardSerialLength;
+
+  key[offset] = (BYTE) selection->commandLength;
+  offset += 1;
+  memcpy(&(key[offset]), selection->command, selection->commandLength);
+  offset += selection->commandLength;
+
+  memcpy(&(key[offset]), apdu, apduLength);
+
+  keyRef[0] = key;
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Is the card serial number a part of this key?
+ * (only such keys are used with the persistent cache)
+ */
+BOOL
+SCardApduCache_isIdentified(
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength)
+{
+  const size_t serial_offset = 1 + (size_t) key[0];
+
+  return ((serial_offset < keyLength) && (0 != key[serial_offset]));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Looks up a response in the in-memory tier.
+ */
+BOOL
+SCardApduCache_lookupMemory(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _Inout_ UTF8String *hexStringResult)
+{
+  uint32_t hash;
+  SCardCacheEntry *entry;
+
+  if (0 == cache->bucketCount)
+  {
+    cache->misses += 1;
+    return FALSE;
+  }
+
+  hash = SCardApduCache_hash(readerIndex, key, keyLength);
+
+  entry = cache->buckets[hash & (cache->bucketCount - 1)];
+
+  while (NULL != entry)
+  {
+    if ((hash == entry->hash) &&
+      (readerIndex == entry->readerIndex) &&
+      (keyLength == entry->keyLength) &&
+      (0 == memcmp(key, entry->key, keyLength)))
+    {
+      if (!UTF8String_pushText(
+        hexStringResult,
+        (LPCSTR) entry->response.text,
+        entry->response.length))
+      {
+        return FALSE;
+      }
+
+      SCardApduCache_unlinkRecent(cache, entry);
+      SCardApduCache_linkNewest(cache, entry);
+
+      cache->hits += 1;
+      return TRUE;
+    }
+
+    entry = entry->bucketNext;
+  }
+
+  cache->misses += 1;
+  return FALSE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardApduCache` object.
+ * Stores a response in the in-memory tier.
+ */
+BOOL
+SCardApduCache_storeMemory(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _In_ const UTF8String *hexStringResponse)
+{
+  BOOL test_bool;
+  size_t entry_size;
+  SCardCacheEntry *entry;
+  SCardCacheEntry **bucket;
+
+  entry_size = SCardApduCache_entrySize(keyLength, hexStringResponse->length);
+
+  if (entry_size > cache->byteBudget)
+  {
+    return FALSE;
+  }
+
+  SCardApduCache_evict(cache, entry_size);
+
+  if (cache->entryCount >= cache->bucketCount)
+  {
+    SCardApduCache_growBuckets(cache);
+    if (0 == cache->bucketCount) { return FALSE; }
+  }
+
+  entry = malloc(sizeof(SCardCacheEntry));
+  if (NULL == entry) { return FALSE; }
+
+  entry->key = malloc(sizeof(BYTE) * keyLength);
+  if (NULL == entry->key)
+  {
+    free(entry);
+    return FALSE;
+  }
+
+  test_bool = UTF8String_copy(&(entry->response), hexStringResponse);
+
+  if (!test_bool)
+  {
+    UTF8String_destroy(&(entry->response));
+    free(entry->key);
+    free(entry);
+    return FALSE;
+  }
+
+  memcpy(entry->key, key, keyLength);
+  entry->keyLength = keyLength;
+  entry->readerIndex = readerIndex;
+  entry->hash = SCardApduCache_hash(readerIndex, key, keyLength);
+
+  bucket = &(cache->buckets[entry->hash & (cache->bucketCount - 1)]);
+  entry->bucketNext = bucket[0];
+  bucket[0] = entry;
+
+  SCardApduCache_linkNewest(cache, entry);
+
+  cache->byteCount += entry_size;
+  cache->entryCount += 1;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardApduCache_lookup(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _Inout_ UTF8String *hexStringResult)
+{
+  BOOL test_bool;
+
+  if (0 != cache->byteBudget)
+  {
+    test_bool = SCardApduCache_lookupMemory(
+      cache,
+      readerIndex,
+      key,
+      keyLength,
+      hexStringResult);
+
+    if (test_bool) { return TRUE; }
+  }
+
+  if (!SCardApduCache_isIdentified(key, keyLength))
+  {
+    return FALSE;
+  }
+
+  test_bool = SCardCacheFile_lookup(
+    &(cache->persistent),
+    key,
+    keyLength,
+    hexStringResult);
+
+  if (test_bool && (0 != cache->byteBudget))
+  {
+    /* Promote to the in-memory tier */
+
+    SCardApduCache_storeMemory(
+      cache,
+      readerIndex,
+      key,
+      keyLength,
+      hexStringResult);
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+SCardApduCache_store(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _In_ const UTF8String *hexStringResponse)
+{
+  BOOL stored = FALSE;
+
+  /* Only successful responses ("9000") are worth remembering */
+
+  if ((hexStringResponse->length < 4) ||
+    (0 != memcmp(
+      &(hexStringResponse->text[hexStringResponse->length - 4]),
+      "9000",
+      4)))
+  {
+    return FALSE;
+  }
+
+  if (0 != cache->byteBudget)
+  {
+    stored = SCardApduCache_storeMemory(
+      cache,
+      readerIndex,
+      key,
+      keyLength,
+      hexStringResponse);
+  }
+
+  if (SCardApduCache_isIdentified(key, keyLength))
+  {
+    stored |= SCardCacheFile_store(
+      &(cache->persistent),
+      key,
+      keyLength,
+      hexStringResponse);
+  }
+
+  return stored;
+}
+
+/**************************************************************/
+
+BOOL
+SCardApduCache_identifyCard(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _Inout_ SCardConnection *connection,
+  _Out_ BYTE *outputBuffer,
+  _In_ const size_t outputBufferLength)
+{
+  BOOL test_bool;
+  UTF8String utf8_hex_response;
+  LPBYTE serial_bytes = NULL;
+  size_t serial_length = 0;
+  const SCardCacheFile *persistent = &(cache->persistent);
+
+  if (connection->cardSerialKnown)
+  {
+    return (0 != connection->cardSerialLength);
+  }
+
+  if (!SCardCacheFile_isOpen(persistent) ||
+    (0 == persistent->serialApduLength))
+  {
+    return FALSE;
+  }
+
+  /* Ask only once per card: a failure means "not identifiable" */
+
+  connection->cardSerialKnown = TRUE;
+  connection->cardSerialLength = 0;
+
+  UTF8String_init(&(utf8_hex_response));
+
+  test_bool = SCardConnection_transceiveMultiple(
+    connection,
+    &(utf8_hex_response),
+    persistent->serialApdu,
+    persistent->serialApduLength,
+    outputBuffer,
+    outputBufferLength);
+
+  SCardApduCache_observeCommand(
+    cache,
+    readerIndex,
+    connection,
+    persistent->serialApdu,
+    persistent->serialApduLength,
+    test_bool ? &(utf8_hex_response) : NULL);
+
+  if (test_bool)
+  {
+    test_bool = UTF8String_hexToByteArray(
+      &(utf8_hex_response),
+      &(serial_length),
+      &(serial_bytes));
+  }
+
+  /* Serial number + "9000" (status word is not a part of the serial) */
+
+  if (test_bool &&
+    (serial_length > 2) &&
+    ((serial_length - 2) <= WEBCARD_CARD_SERIAL_MAX_SIZE) &&
+    (0x90 == serial_bytes[serial_length - 2]) &&
+    (0x00 == serial_bytes[serial_length - 1]))
+  {
+    memcpy(connection->cardSerial, serial_bytes, serial_length - 2);
+    connection->cardSerialLength = serial_length - 2;
+  }
+
+  if (NULL != serial_bytes)
+  {
+    free(serial_bytes);
+  }
+
+  UTF8String_destroy(&(utf8_hex_response));
+
+  return (0 != connection->cardSerialLength);
+}
+
+/**************************************************************/
+
+VOID
+SCardApduCache_observeCommand(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _Inout_ SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _In_opt_ const UTF8String *hexStringResponse)
+{
+  size_t length;
+  BYTE key_prefix[2 + WEBCARD_ATR_MAX_SIZE + WEBCARD_CARD_SERIAL_MAX_SIZE];
+
+  /* The selected files are part of the cache keys */
+
+  SCardConnection_observeSelection(
+    connection,
+    apdu,
+    apduLength,
+    hexStringResponse);
+
+  /* Transmission failures usually mean a card reset (or removal): */
+  /* the card might be different */
+
+  if (NULL == hexStringResponse)
+  {
+    SCardApduCache_invalidateReader(cache, readerIndex);
+    return;
+  }
+
+  if ((apduLength < 4) || (SCARD_INS__SELECT == apdu[1]))
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < sizeof(SCardApduCache_modifyingInstructions); i++)
+  {
+    if (SCardApduCache_modifyingInstructions[i] == apdu[1])
+    {
+      SCardApduCache_invalidateReader(cache, readerIndex);
+
+      /* Persistent records of this card: [ATR length] [ATR] [serial...] */
+      /* (all cards with the same ATR, if this card is not identified) */
+
+      key_prefix[0] = (BYTE) connection->cardAtrLength;
+      memcpy(&(key_prefix[1]), connection->cardAtr, connection->cardAtrLength);
+      length = 1 + connection->cardAtrLength;
+
+      if (connection->cardSerialLength > 0)
+      {
+        key_prefix[length] = (BYTE) connection->cardSerialLength;
+        memcpy(
+          &(key_prefix[length + 1]),
+          connection->cardSerial,
+          connection->cardSerialLength);
+
+        length += 1 + connection->cardSerialLength;
+      }
+
+      SCardCacheFile_invalidatePrefix(
+        &(cache->persistent),
+        key_prefix,
+        length);
+
+      return;
+    }
+  }
+}
+
+/**************************************************************/
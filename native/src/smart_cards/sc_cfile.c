@@ -0,0 +1,793 @@
+/**
+ * @file "native/src/smart_cards/sc_cfile.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+/** Identification of the cache file format. */
+#define SCARD_CACHE_FILE__MAGIC    "WCcf"
+#define SCARD_CACHE_FILE__VERSION  1
+
+/** Space reserved for the file header (records start after it). */
+#define SCARD_CACHE_FILE__HEADER_SIZE  128
+
+/** Records are aligned to 8 bytes. */
+#define SCARD_CACHE_FILE__ALIGN(x)  (((x) + 7) & (~((size_t) 7)))
+
+/**
+ * Header of the cache file (host byte order: the file never leaves
+ * the computer on which it was written).
+ */
+typedef struct SCardCacheFileHeader
+{
+  BYTE magic[4];
+  uint32_t version;
+
+  /** CRC-32 of the header, computed with this field set to `0`. */
+  uint32_t checksum;
+
+  /** Number of bytes used by records (after the header). */
+  uint32_t usedBytes;
+
+  /** Settings of the persistent cache. */
+  uint32_t timeToLive;
+  uint32_t serialApduLength;
+  BYTE serialApdu[WEBCARD_SERIAL_APDU_MAX_SIZE];
+}
+SCardCacheFileHeader;
+
+/**
+ * Header of a record. Followed by the key bytes and by the response
+ * (hex-string, without a NULL-terminator).
+ */
+typedef struct SCardCacheFileRecord
+{
+  /** Total (aligned) length of the record, including this header. */
+  uint32_t length;
+
+  /** CRC-32 of everything that follows this field (up to the padding). */
+  uint32_t checksum;
+
+  /** Expiration time (seconds since the Epoch), `0` for dropped records. */
+  uint64_t expiresAt;
+
+  uint32_t keyLength;
+  uint32_t responseLength;
+}
+SCardCacheFileRecord;
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Computes the checksum of a record (header already filled in).
+ */
+uint32_t
+SCardCacheFile_recordChecksum(
+  _In_ const SCardCacheFileRecord *record)
+{
+  const BYTE *bytes = (const BYTE *) record;
+  const size_t skipped = 2 * sizeof(uint32_t);
+
+  return Misc_crc32(
+    0,
+    &(bytes[skipped]),
+    sizeof(SCardCacheFileRecord) - skipped +
+      record->keyLength +
+      record->responseLength);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Computes a FNV-1a hash of a record key.
+ */
+uint32_t
+SCardCacheFile_hash(
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength)
+{
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < keyLength; i++)
+  {
+    hash = (hash ^ key[i]) * 16777619U;
+  }
+
+  return hash;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Reference to the record header at given offset.
+ */
+SCardCacheFileRecord *
+SCardCacheFile_recordAt(
+  _In_ const SCardCacheFile *cacheFile,
+  _In_ const size_t offset)
+{
+  return (SCardCacheFileRecord *) &(cacheFile->file.data[offset]);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Reference to the file header.
+ */
+SCardCacheFileHeader *
+SCardCacheFile_header(
+  _In_ const SCardCacheFile *cacheFile)
+{
+  return (SCardCacheFileHeader *) cacheFile->file.data;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Updates the header checksum after the header was modified.
+ */
+VOID
+SCardCacheFile_sealHeader(
+  _Inout_ SCardCacheFile *cacheFile)
+{
+  SCardCacheFileHeader *header = SCardCacheFile_header(cacheFile);
+
+  header->checksum = 0;
+  header->checksum = Misc_crc32(
+    0,
+    (const BYTE *) header,
+    sizeof(SCardCacheFileHeader));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Adds a record to the in-memory index.
+ */
+BOOL
+SCardCacheFile_addSlot(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const uint32_t hash,
+  _In_ const size_t offset)
+{
+  size_t new_capacity;
+  SCardCacheFileSlot *test_slots;
+
+  if (cacheFile->slotCount >= cacheFile->slotCapacity)
+  {
+    new_capacity = Misc_nextPowerOfTwo(cacheFile->slotCapacity);
+
+    test_slots = realloc(
+      cacheFile->slots,
+      sizeof(SCardCacheFileSlot) * new_capacity);
+
+    if (NULL == test_slots) { return FALSE; }
+
+    cacheFile->slots = test_slots;
+    cacheFile->slotCapacity = new_capacity;
+  }
+
+  cacheFile->slots[cacheFile->slotCount].hash = hash;
+  cacheFile->slots[cacheFile->slotCount].offset = (uint32_t) offset;
+  cacheFile->slotCount += 1;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Marks a record as dropped and removes it from the in-memory index.
+ */
+VOID
+SCardCacheFile_dropSlot(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const size_t slotIndex)
+{
+  SCardCacheFileRecord *record = SCardCacheFile_recordAt(
+    cacheFile,
+    cacheFile->slots[slotIndex].offset);
+
+  record->expiresAt = 0;
+  record->checksum = SCardCacheFile_recordChecksum(record);
+
+  /* Keep the index contiguous (order doesn't matter) */
+
+  cacheFile->slotCount -= 1;
+  cacheFile->slots[slotIndex] = cacheFile->slots[cacheFile->slotCount];
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Validates every record and rebuilds the in-memory index.
+ * The used area is truncated at the first damaged record
+ * (the lengths of the following records can't be trusted).
+ */
+VOID
+SCardCacheFile_loadIndex(
+  _Inout_ SCardCacheFile *cacheFile)
+{
+  SCardCacheFileHeader *header = SCardCacheFile_header(cacheFile);
+  SCardCacheFileRecord *record;
+  const uint64_t now = (uint64_t) time(NULL);
+  size_t offset = SCARD_CACHE_FILE__HEADER_SIZE;
+  const size_t end = SCARD_CACHE_FILE__HEADER_SIZE + header->usedBytes;
+
+  cacheFile->slotCount = 0;
+
+  while (offset < end)
+  {
+    record = SCardCacheFile_recordAt(cacheFile, offset);
+
+    if ((end - offset) < sizeof(SCardCacheFileRecord) ||
+      (record->length < sizeof(SCardCacheFileRecord)) ||
+      (record->length > (end - offset)) ||
+      (0 != (record->length & 7)) ||
+      ((sizeof(SCardCacheFileRecord) +
+        (size_t) record->keyLength +
+        (size_t) record->responseLength) > record->length) ||
+      (SCardCacheFile_recordChecksum(record) != record->checksum))
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{SCardCacheFile::loadIndex} damaged record at offset %u",
+        (uint32_t) offset);
+
+      cacheFile->corrupted += 1;
+
+      header->usedBytes = (uint32_t) (offset - SCARD_CACHE_FILE__HEADER_SIZE);
+      SCardCacheFile_sealHeader(cacheFile);
+      return;
+    }
+
+    if (record->expiresAt > now)
+    {
+      if (!SCardCacheFile_addSlot(
+        cacheFile,
+        SCardCacheFile_hash(
+          (const BYTE *) &(record[1]),
+          record->keyLength),
+        offset))
+      {
+        /* Not indexed: the record will be dropped on compaction */
+        record->expiresAt = 0;
+        record->checksum = SCardCacheFile_recordChecksum(record);
+      }
+    }
+
+    offset += record->length;
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Moves live records to the beginning of the used area, dropping expired
+ * records and then the oldest records, until `neededBytes` more bytes
+ * fit in `capacity` bytes (the size of the area after the header).
+ */
+VOID
+SCardCacheFile_compact(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const size_t neededBytes,
+  _In_ const size_t capacity)
+{
+  SCardCacheFileHeader *header = SCardCacheFile_header(cacheFile);
+  SCardCacheFileRecord *record;
+  const uint64_t now = (uint64_t) time(NULL);
+  size_t offset = SCARD_CACHE_FILE__HEADER_SIZE;
+  size_t write_offset = SCARD_CACHE_FILE__HEADER_SIZE;
+  const size_t end = SCARD_CACHE_FILE__HEADER_SIZE + header->usedBytes;
+  size_t live_bytes = 0;
+
+  /* Bytes of records that are not expired (nor dropped) */
+
+  while (offset < end)
+  {
+    record = SCardCacheFile_recordAt(cacheFile, offset);
+
+    if (record->expiresAt > now)
+    {
+      live_bytes += record->length;
+    }
+
+    offset += record->length;
+  }
+
+  offset = SCARD_CACHE_FILE__HEADER_SIZE;
+
+  while (offset < end)
+  {
+    record = SCardCacheFile_recordAt(cacheFile, offset);
+    const size_t length = record->length;
+
+    if (record->expiresAt > now)
+    {
+      if ((live_bytes + neededBytes) > capacity)
+      {
+        /* Still too much: evict this (oldest) record */
+
+        live_bytes -= length;
+        cacheFile->evictions += 1;
+      }
+      else
+      {
+        if (write_offset != offset)
+        {
+          memmove(
+            &(cacheFile->file.data[write_offset]),
+            record,
+            length);
+        }
+
+        write_offset += length;
+      }
+    }
+
+    offset += length;
+  }
+
+  header->usedBytes = (uint32_t) (write_offset - SCARD_CACHE_FILE__HEADER_SIZE);
+  SCardCacheFile_sealHeader(cacheFile);
+
+  SCardCacheFile_loadIndex(cacheFile);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Maps the cache file and checks its header. A file with an invalid header
+ * is reset, keeping the current settings of `cacheFile`.
+ *
+ * @param[in] fileSize Required file size, or `0` for an existing file
+ * (with the settings taken from its header).
+ */
+BOOL
+SCardCacheFile_open(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const size_t fileSize)
+{
+  SCardCacheFileHeader *header;
+  uint32_t checksum;
+  BOOL test_bool;
+
+  test_bool = OSSpecific_openMappedFile(
+    &(cacheFile->file),
+    WEBCARD_CACHE_FILE_NAME,
+    fileSize);
+
+  if (test_bool && (cacheFile->file.size <= SCARD_CACHE_FILE__HEADER_SIZE))
+  {
+    test_bool = FALSE;
+  }
+
+  if (test_bool && (cacheFile->file.size > UINT32_MAX))
+  {
+    test_bool = FALSE;
+  }
+
+  if (!test_bool)
+  {
+    OSSpecific_closeMappedFile(&(cacheFile->file));
+    return FALSE;
+  }
+
+  header = SCardCacheFile_header(cacheFile);
+
+  checksum = header->checksum;
+  header->checksum = 0;
+
+  test_bool = (
+    (0 == memcmp(header->magic, SCARD_CACHE_FILE__MAGIC, 4)) &&
+    (SCARD_CACHE_FILE__VERSION == header->version) &&
+    (checksum == Misc_crc32(
+      0,
+      (const BYTE *) header,
+      sizeof(SCardCacheFileHeader))) &&
+    (header->serialApduLength <= WEBCARD_SERIAL_APDU_MAX_SIZE) &&
+    (header->usedBytes <=
+      (cacheFile->file.size - SCARD_CACHE_FILE__HEADER_SIZE)));
+
+  header->checksum = checksum;
+
+  if (test_bool)
+  {
+    if (0 == fileSize)
+    {
+      /* Resuming a previous session */
+
+      cacheFile->timeToLive = header->timeToLive;
+      cacheFile->serialApduLength = header->serialApduLength;
+
+      memcpy(
+        cacheFile->serialApdu,
+        header->serialApdu,
+        header->serialApduLength);
+    }
+  }
+  else
+  {
+    if (0 == fileSize)
+    {
+      /* Nothing to resume */
+      OSSpecific_closeMappedFile(&(cacheFile->file));
+      return FALSE;
+    }
+
+    if (0 != memcmp(header->magic, "\0\0\0\0", 4))
+    {
+      cacheFile->corrupted += 1;
+    }
+
+    memcpy(header->magic, SCARD_CACHE_FILE__MAGIC, 4);
+    header->version = SCARD_CACHE_FILE__VERSION;
+    header->usedBytes = 0;
+  }
+
+  SCardCacheFile_saveSettings(cacheFile);
+  SCardCacheFile_loadIndex(cacheFile);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+VOID
+SCardCacheFile_init(
+  _Out_ SCardCacheFile *cacheFile)
+{
+  OSSpecific_initMappedFile(&(cacheFile->file));
+
+  cacheFile->timeToLive       = WEBCARD_CACHE_FILE_DEFAULT_TTL;
+  cacheFile->serialApduLength = 0;
+  cacheFile->slotCount        = 0;
+  cacheFile->slotCapacity     = 0;
+  cacheFile->slots            = NULL;
+  cacheFile->hits             = 0;
+  cacheFile->misses           = 0;
+  cacheFile->evictions        = 0;
+  cacheFile->corrupted        = 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardCacheFile_destroy(
+  _Inout_ SCardCacheFile *cacheFile)
+{
+  OSSpecific_closeMappedFile(&(cacheFile->file));
+
+  if (NULL != cacheFile->slots)
+  {
+    free(cacheFile->slots);
+  }
+
+  cacheFile->slots = NULL;
+  cacheFile->slotCount = 0;
+  cacheFile->slotCapacity = 0;
+}
+
+/**************************************************************/
+
+BOOL
+SCardCacheFile_isOpen(
+  _In_ const SCardCacheFile *cacheFile)
+{
+  return (NULL != cacheFile->file.data);
+}
+
+/**************************************************************/
+
+BOOL
+SCardCacheFile_resume(
+  _Inout_ SCardCacheFile *cacheFile)
+{
+  if (SCardCacheFile_isOpen(cacheFile))
+  {
+    return TRUE;
+  }
+
+  return SCardCacheFile_open(cacheFile, 0);
+}
+
+/**************************************************************/
+
+BOOL
+SCardCacheFile_configure(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const size_t fileSize)
+{
+  if (0 == fileSize)
+  {
+    OSSpecific_closeMappedFile(&(cacheFile->file));
+    cacheFile->slotCount = 0;
+
+    return OSSpecific_deleteCacheFile(WEBCARD_CACHE_FILE_NAME);
+  }
+
+  if ((fileSize <= SCARD_CACHE_FILE__HEADER_SIZE) || (fileSize > UINT32_MAX))
+  {
+    return FALSE;
+  }
+
+  if (SCardCacheFile_isOpen(cacheFile))
+  {
+    if (fileSize == cacheFile->file.size)
+    {
+      return TRUE;
+    }
+
+    /* Make the records fit before the file gets truncated */
+
+    SCardCacheFile_compact(
+      cacheFile,
+      0,
+      fileSize - SCARD_CACHE_FILE__HEADER_SIZE);
+
+    OSSpecific_closeMappedFile(&(cacheFile->file));
+    cacheFile->slotCount = 0;
+  }
+
+  return SCardCacheFile_open(cacheFile, fileSize);
+}
+
+/**************************************************************/
+
+VOID
+SCardCacheFile_saveSettings(
+  _Inout_ SCardCacheFile *cacheFile)
+{
+  SCardCacheFileHeader *header;
+
+  if (!SCardCacheFile_isOpen(cacheFile))
+  {
+    return;
+  }
+
+  header = SCardCacheFile_header(cacheFile);
+
+  header->timeToLive = cacheFile->timeToLive;
+  header->serialApduLength = (uint32_t) cacheFile->serialApduLength;
+
+  memset(header->serialApdu, 0x00, WEBCARD_SERIAL_APDU_MAX_SIZE);
+  memcpy(header->serialApdu, cacheFile->serialApdu, cacheFile->serialApduLength);
+
+  SCardCacheFile_sealHeader(cacheFile);
+  OSSpecific_flushMappedFile(&(cacheFile->file));
+}
+
+/**************************************************************/
+
+size_t
+SCardCacheFile_usedBytes(
+  _In_ const SCardCacheFile *cacheFile)
+{
+  if (!SCardCacheFile_isOpen(cacheFile))
+  {
+    return 0;
+  }
+
+  return SCardCacheFile_header(cacheFile)->usedBytes;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardCacheFile` object.
+ * Finds the index slot of a record with given key.
+ * @return Slot index, or `slotCount` if not found.
+ */
+size_t
+SCardCacheFile_find(
+  _In_ const SCardCacheFile *cacheFile,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength)
+{
+  const uint32_t hash = SCardCacheFile_hash(key, keyLength);
+  const SCardCacheFileRecord *record;
+  size_t i;
+
+  for (i = 0; i < cacheFile->slotCount; i++)
+  {
+    if (hash == cacheFile->slots[i].hash)
+    {
+      record = SCardCacheFile_recordAt(cacheFile, cacheFile->slots[i].offset);
+
+      if ((keyLength == record->keyLength) &&
+        (0 == memcmp(&(record[1]), key, keyLength)))
+      {
+        break;
+      }
+    }
+  }
+
+  return i;
+}
+
+/**************************************************************/
+
+BOOL
+SCardCacheFile_lookup(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _Inout_ UTF8String *hexStringResult)
+{
+  size_t slot_index;
+  const SCardCacheFileRecord *record;
+
+  if (!SCardCacheFile_isOpen(cacheFile))
+  {
+    return FALSE;
+  }
+
+  slot_index = SCardCacheFile_find(cacheFile, key, keyLength);
+
+  if (slot_index >= cacheFile->slotCount)
+  {
+    cacheFile->misses += 1;
+    return FALSE;
+  }
+
+  record = SCardCacheFile_recordAt(
+    cacheFile,
+    cacheFile->slots[slot_index].offset);
+
+  if (record->expiresAt <= (uint64_t) time(NULL))
+  {
+    SCardCacheFile_dropSlot(cacheFile, slot_index);
+
+    cacheFile->misses += 1;
+    return FALSE;
+  }
+
+  if (!UTF8String_pushText(
+    hexStringResult,
+    (LPCSTR) &(((const BYTE *) &(record[1]))[record->keyLength]),
+    record->responseLength))
+  {
+    return FALSE;
+  }
+
+  cacheFile->hits += 1;
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardCacheFile_store(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _In_ const UTF8String *hexStringResponse)
+{
+  SCardCacheFileHeader *header;
+  SCardCacheFileRecord *record;
+  size_t slot_index;
+  size_t length;
+  size_t offset;
+  size_t capacity;
+
+  if (!SCardCacheFile_isOpen(cacheFile) || (0 == hexStringResponse->length))
+  {
+    return FALSE;
+  }
+
+  capacity = cacheFile->file.size - SCARD_CACHE_FILE__HEADER_SIZE;
+
+  length = SCARD_CACHE_FILE__ALIGN(
+    sizeof(SCardCacheFileRecord) + keyLength + hexStringResponse->length);
+
+  if (length > capacity)
+  {
+    return FALSE;
+  }
+
+  /* Replace a previous record with the same key */
+
+  slot_index = SCardCacheFile_find(cacheFile, key, keyLength);
+
+  if (slot_index < cacheFile->slotCount)
+  {
+    SCardCacheFile_dropSlot(cacheFile, slot_index);
+  }
+
+  header = SCardCacheFile_header(cacheFile);
+
+  if ((header->usedBytes + length) > capacity)
+  {
+    SCardCacheFile_compact(cacheFile, length, capacity);
+  }
+
+  offset = SCARD_CACHE_FILE__HEADER_SIZE + header->usedBytes;
+
+  if (!SCardCacheFile_addSlot(
+    cacheFile,
+    SCardCacheFile_hash(key, keyLength),
+    offset))
+  {
+    return FALSE;
+  }
+
+  record = SCardCacheFile_recordAt(cacheFile, offset);
+
+  memset(record, 0x00, length);
+
+  record->length = (uint32_t) length;
+  record->expiresAt = ((uint64_t) time(NULL)) + cacheFile->timeToLive;
+  record->keyLength = (uint32_t) keyLength;
+  record->responseLength = (uint32_t) hexStringResponse->length;
+
+  memcpy(&(record[1]), key, keyLength);
+
+  memcpy(
+    &(((BYTE *) &(record[1]))[keyLength]),
+    hexStringResponse->text,
+    hexStringResponse->length);
+
+  record->checksum = SCardCacheFile_recordChecksum(record);
+
+  header->usedBytes += (uint32_t) length;
+  SCardCacheFile_sealHeader(cacheFile);
+
+  OSSpecific_flushMappedFile(&(cacheFile->file));
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+VOID
+SCardCacheFile_invalidatePrefix(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const BYTE *prefix,
+  _In_ const size_t prefixLength)
+{
+  const SCardCacheFileRecord *record;
+  size_t i = 0;
+  BOOL modified = FALSE;
+
+  if (!SCardCacheFile_isOpen(cacheFile))
+  {
+    return;
+  }
+
+  while (i < cacheFile->slotCount)
+  {
+    record = SCardCacheFile_recordAt(cacheFile, cacheFile->slots[i].offset);
+
+    if ((record->keyLength >= prefixLength) &&
+      (0 == memcmp(&(record[1]), prefix, prefixLength)))
+    {
+      /* Last slot is moved into `i`, so don't advance */
+      SCardCacheFile_dropSlot(cacheFile, i);
+      modified = TRUE;
+    }
+    else
+    {
+      i += 1;
+    }
+  }
+
+  if (modified)
+  {
+    OSSpecific_flushMappedFile(&(cacheFile->file));
+  }
+}
+
+/**************************************************************/
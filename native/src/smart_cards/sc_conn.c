@@ -7,13 +7,68 @@
 
 /**************************************************************/
 
+/** Instruction bytes ("INS") referenced by the selection tracking. */
+#define SCARD_INS__SELECT          0xA4
+#define SCARD_INS__MANAGE_CHANNEL  0x70
+
+/**
+ * Instructions (ISO/IEC 7816-4) that never change what is selected.
+ * Any other instruction makes the selection of its channel unknown.
+ */
+static const BYTE SCardConnection_selectionKeepingInstructions[] =
+{
+  0x20, /* VERIFY */
+  0x22, /* MANAGE SECURITY ENVIRONMENT */
+  0x24, /* CHANGE REFERENCE DATA */
+  0x2A, /* PERFORM SECURITY OPERATION */
+  0x2C, /* RESET RETRY COUNTER */
+  0x82, /* EXTERNAL AUTHENTICATE */
+  0x84, /* GET CHALLENGE */
+  0x88, /* INTERNAL AUTHENTICATE */
+  0xC0, /* GET RESPONSE */
+  0xCA, /* GET DATA */
+  0xCB  /* GET DATA */
+};
+
+/**************************************************************/
+
 VOID
 SCardConnection_init(
   _Out_ SCardConnection *connection)
 {
   connection->handle         = 0;
   connection->activeProtocol = 0;
+  connection->shareMode      = 0;
+  connection->lingerDeadline = 0;
   connection->ignoreCounter  = 0;
+
+  connection->restoreScript       = NULL;
+  connection->restoreScriptLength = 0;
+  connection->reconnectCount      = 0;
+
+  connection->debounceWindow    = WEBCARD_DEBOUNCE__INHERIT;
+  connection->settledEvent      = WEBCARD_READER_EVENT__NONE;
+  connection->pendingEvent      = WEBCARD_READER_EVENT__NONE;
+  connection->pendingDeadline   = 0;
+  connection->pendingRemoval    = FALSE;
+  connection->pendingSuppressed = 0;
+  connection->suppressedTotal   = 0;
+
+  connection->cardAtrLength    = 0;
+  connection->cardSerialKnown  = FALSE;
+  connection->cardSerialLength = 0;
+  connection->elideSelect      = FALSE;
+  connection->awaitingJob      = FALSE;
+
+  SCardConnection_forgetSelections(connection);
+
+  connection->transmitLatency = NULL;
+  connection->trace = NULL;
+  connection->traceReader = WEBCARD_TRACE_NO_READER;
+
+  connection->requests = NULL;
+  connection->owner = NULL;
+  connection->ownerSession = WEBCARD_SESSION__STANDARD_IO;
 }
 
 /**************************************************************/
@@ -30,7 +85,7 @@ SCardConnection_open(
     return TRUE;
   }
 
-  PCSC_LONG pcscResult = SCardConnect(
+  PCSC_LONG pcscResult = SCardBackend_current->connect(
     context,
     readerName,
     shareMode,
@@ -42,33 +97,356 @@ SCardConnection_open(
 
   if (SCARD_S_SUCCESS != pcscResult)
   {
-    #if defined(_DEBUG)
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{SCardConnect} failed: 0x%08X (%s)",
+      (uint32_t) pcscResult,
+      WebCard_errorLookup(pcscResult));
+
+    return FALSE;
+  }
+
+  connection->shareMode = shareMode;
+
+  /* Another application might have reset the card in the meantime */
+
+  SCardConnection_forgetSelections(connection);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardConnection_setRestoreScript(
+  _Inout_ SCardConnection *connection,
+  _In_opt_ const JsonArray *jsonApdus)
+{
+  BOOL test_bool = TRUE;
+  LPBYTE script = NULL;
+  size_t script_length = 0;
+  LPBYTE apdu;
+  size_t apdu_length;
+  const UTF8String *hex_apdu;
+
+  if (NULL != connection->restoreScript)
+  {
+    free(connection->restoreScript);
+    connection->restoreScript = NULL;
+  }
+
+  connection->restoreScriptLength = 0;
+
+  if ((NULL == jsonApdus) || (0 == jsonApdus->count))
+  {
+    return TRUE;
+  }
+
+  if (jsonApdus->count > WEBCARD_RESTORE_MAX_APDUS)
+  {
+    return FALSE;
+  }
+
+  /* Hex-strings are never shorter than the bytes they encode */
+
+  for (size_t i = 0; i < jsonApdus->count; i++)
+  {
+    if (JSON_VALUE_TYPE__STRING != jsonApdus->values[i].type)
     {
-      OSSpecific_writeDebugMessage(
-        "{SCardConnect} failed: 0x%08X (%s)",
-        (uint32_t) pcscResult,
-        WebCard_errorLookup(pcscResult));
+      return FALSE;
+    }
+
+    script_length += 2 + ((const UTF8String *) jsonApdus->values[i].value)->length;
+  }
+
+  script = malloc(script_length);
+  if (NULL == script) { return FALSE; }
+
+  script_length = 0;
+
+  for (size_t i = 0; test_bool && (i < jsonApdus->count); i++)
+  {
+    hex_apdu = jsonApdus->values[i].value;
+    apdu = NULL;
+
+    test_bool = UTF8String_hexToByteArray(
+      hex_apdu,
+      &(apdu_length),
+      &(apdu));
+
+    if (test_bool && (apdu_length >= 4) && (apdu_length <= MAX_APDU_SIZE))
+    {
+      script[script_length] = (BYTE) (apdu_length >> 8);
+      script[script_length + 1] = (BYTE) apdu_length;
+      memcpy(&(script[script_length + 2]), apdu, apdu_length);
+
+      script_length += 2 + apdu_length;
+    }
+    else
+    {
+      test_bool = FALSE;
     }
-    #endif
 
+    if (NULL != apdu)
+    {
+      free(apdu);
+    }
+  }
+
+  if (!test_bool)
+  {
+    free(script);
     return FALSE;
   }
 
+  connection->restoreScript = script;
+  connection->restoreScriptLength = script_length;
+
   return TRUE;
 }
 
 /**************************************************************/
 
+VOID
+SCardConnection_forgetSelections(
+  _Inout_ SCardConnection *connection)
+{
+  for (size_t i = 0; i < WEBCARD_LOGICAL_CHANNELS; i++)
+  {
+    connection->selections[i].commandLength = 0;
+    connection->selections[i].responseLength = 0;
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardConnection` object.
+ * Logical channel of a command, from its class byte ("CLA").
+ *
+ * @return Channel number, or `WEBCARD_LOGICAL_CHANNELS` for the channels
+ * that are not tracked (further interindustry class) and for the
+ * commands of the reader itself (class "FF").
+ */
+size_t
+SCardConnection_getChannel(
+  _In_ const BYTE cla)
+{
+  if ((0xFF == cla) || (0 != (cla & 0x40)))
+  {
+    return WEBCARD_LOGICAL_CHANNELS;
+  }
+
+  return (size_t) (cla & 0x03);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardConnection` object.
+ * Does the command leave the selection of its channel as it was?
+ */
+BOOL
+SCardConnection_keepsSelection(
+  _In_ const BYTE *apdu)
+{
+  switch (apdu[1])
+  {
+    /* READ / UPDATE BINARY: short EF identifier in "P1" selects that EF */
+    case 0xB0:
+    case 0xD6:
+    {
+      return (0 == (apdu[2] & 0x80));
+    }
+
+    /* READ / UPDATE RECORD: short EF identifier in "P2" selects that EF */
+    case 0xB2:
+    case 0xDC:
+    {
+      return (0 == (apdu[3] & 0xF8));
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(SCardConnection_selectionKeepingInstructions); i++)
+  {
+    if (SCardConnection_selectionKeepingInstructions[i] == apdu[1])
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**************************************************************/
+
+VOID
+SCardConnection_observeSelection(
+  _Inout_ SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _In_opt_ const UTF8String *hexStringResponse)
+{
+  size_t length;
+  size_t channel;
+  LPCSTR sw1;
+  SCardSelection *selection;
+
+  /* Transmission failures usually mean a card reset (or removal) */
+
+  if (NULL == hexStringResponse)
+  {
+    SCardConnection_forgetSelections(connection);
+    return;
+  }
+
+  if (apduLength < 4)
+  {
+    return;
+  }
+
+  channel = SCardConnection_getChannel(apdu[0]);
+
+  if (channel >= WEBCARD_LOGICAL_CHANNELS)
+  {
+    return;
+  }
+
+  /* Channels opened or closed start with nothing selected */
+
+  if (SCARD_INS__MANAGE_CHANNEL == apdu[1])
+  {
+    SCardConnection_forgetSelections(connection);
+    return;
+  }
+
+  selection = &(connection->selections[channel]);
+
+  if (SCARD_INS__SELECT != apdu[1])
+  {
+    if (!SCardConnection_keepsSelection(apdu))
+    {
+      selection->commandLength = 0;
+      selection->responseLength = 0;
+    }
+
+    return;
+  }
+
+  /* Remember a successful "SELECT" (without secure messaging) */
+
+  selection->commandLength = 0;
+  selection->responseLength = 0;
+
+  length = hexStringResponse->length;
+
+  if ((length < 4) || (0 != (apdu[0] & 0x0C)) ||
+    (apduLength > WEBCARD_SELECT_CONTEXT_SIZE))
+  {
+    return;
+  }
+
+  sw1 = (LPCSTR) &(hexStringResponse->text[length - 4]);
+
+  if ((0 != memcmp(sw1, "9000", 4)) && (0 != memcmp(sw1, "61", 2)))
+  {
+    return;
+  }
+
+  memcpy(selection->command, apdu, apduLength);
+  selection->commandLength = apduLength;
+
+  /* Only the selections that don't depend on what was selected before */
+  /* (EF of the current DF, DF name, path from the MF; first or only */
+  /* occurrence) can be answered again without the card */
+
+  if (((0x02 == apdu[2]) || (0x04 == apdu[2]) || (0x08 == apdu[2])) &&
+    (0 == (apdu[3] & 0x03)) &&
+    (0 == memcmp(sw1, "9000", 4)) &&
+    (length <= sizeof(selection->response)))
+  {
+    memcpy(selection->response, hexStringResponse->text, length);
+    selection->responseLength = length;
+  }
+}
+
+/**************************************************************/
+
+BOOL
+SCardConnection_repeatSelection(
+  _In_ const SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _Inout_ UTF8String *hexStringResult)
+{
+  size_t channel;
+  const SCardSelection *selection;
+
+  /* Another application sharing the card might have selected */
+  /* something else, unseen: repeat only on exclusive connections */
+
+  if ((!connection->elideSelect) ||
+    (SCARD_SHARE_EXCLUSIVE != connection->shareMode) ||
+    (apduLength < 4) ||
+    (SCARD_INS__SELECT != apdu[1]))
+  {
+    return FALSE;
+  }
+
+  channel = SCardConnection_getChannel(apdu[0]);
+
+  if (channel >= WEBCARD_LOGICAL_CHANNELS)
+  {
+    return FALSE;
+  }
+
+  selection = &(connection->selections[channel]);
+
+  if ((0 == selection->responseLength) ||
+    (apduLength != selection->commandLength) ||
+    (0 != memcmp(apdu, selection->command, apduLength)))
+  {
+    return FALSE;
+  }
+
+  return UTF8String_pushText(
+    hexStringResult,
+    selection->response,
+    selection->responseLength);
+}
+
+/**************************************************************/
+
 BOOL
 SCardConnection_close(
   _Inout_ SCardConnection *connection)
 {
+  PCSC_LONG pcscResult;
+
+  /* Next waiting client can connect */
+
+  if (NULL != connection->owner)
+  {
+    free(connection->owner);
+    connection->owner = NULL;
+  }
+
+  if (NULL != connection->restoreScript)
+  {
+    free(connection->restoreScript);
+    connection->restoreScript = NULL;
+    connection->restoreScriptLength = 0;
+  }
+
+  connection->elideSelect = FALSE;
+  connection->lingerDeadline = 0;
+
   if (0 == connection->handle)
   {
     return TRUE;
   }
 
-  PCSC_LONG pcscResult = SCardDisconnect(
+  pcscResult = SCardBackend_current->disconnect(
     connection->handle,
     SCARD_LEAVE_CARD);
 
@@ -79,35 +457,319 @@ SCardConnection_close(
 
 /**************************************************************/
 
+VOID
+SCardConnection_linger(
+  _Inout_ SCardConnection *connection,
+  _In_ const uint64_t deadline)
+{
+  if (NULL != connection->owner)
+  {
+    free(connection->owner);
+    connection->owner = NULL;
+  }
+
+  /* Zero would mean "not lingering" */
+
+  connection->lingerDeadline = (0 != deadline) ? deadline : 1;
+}
+
+/**************************************************************/
+
 BOOL
-SCardConnection_transceiveSingle(
+SCardConnection_reuse(
+  _Inout_ SCardConnection *connection,
+  _In_ const PCSC_DWORD shareMode)
+{
+  if ((0 == connection->handle) || (0 == connection->lingerDeadline))
+  {
+    return FALSE;
+  }
+
+  if (shareMode != connection->shareMode)
+  {
+    SCardConnection_close(connection);
+    return FALSE;
+  }
+
+  connection->lingerDeadline = 0;
+
+  /* Other applications might have used a shared card in the meantime */
+
+  if (SCARD_SHARE_EXCLUSIVE != shareMode)
+  {
+    SCardConnection_forgetSelections(connection);
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardConnection_setOwner(
+  _Inout_ SCardConnection *connection,
+  _In_ const uint32_t session,
+  _In_z_ LPCSTR client)
+{
+  size_t length = strlen(client);
+  LPSTR owner = malloc(sizeof(char) * (length + 1));
+
+  if (NULL == owner) { return FALSE; }
+
+  memcpy(owner, client, length + 1);
+
+  if (NULL != connection->owner)
+  {
+    free(connection->owner);
+  }
+
+  connection->owner = owner;
+  connection->ownerSession = session;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardConnection_isAvailableTo(
+  _In_ const SCardConnection *connection,
+  _In_ const uint32_t session,
+  _In_z_ LPCSTR client)
+{
+  return (NULL == connection->owner) ||
+    ((session == connection->ownerSession) &&
+    (0 == strcmp(connection->owner, client)));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardConnection` object.
+ * One timed and traced `SCardTransmit` call.
+ *
+ * @return PC/SC result code.
+ */
+PCSC_LONG
+SCardConnection_transmit(
   _In_ const SCardConnection *connection,
   _In_ const BYTE *input,
   _In_ const PCSC_DWORD inputLength,
   _Out_ BYTE *output,
   _Inout_ PCSC_DWORD *outputLengthRef)
 {
-  PCSC_LONG pcscResult = SCardTransmit(
+  uint64_t end_time;
+  uint64_t start_time;
+  PCSC_LONG pcscResult;
+
+  OSSpecific_probe2(
+    transmit__start,
+    connection->traceReader,
+    inputLength);
+
+  start_time = OSSpecific_getPreciseTime();
+
+  pcscResult = SCardBackend_current->transmit(
     connection->handle,
-    (SCARD_PROTOCOL_T0 == connection->activeProtocol) ?
-      SCARD_PCI_T0 :
-      SCARD_PCI_T1,
+    connection->activeProtocol,
     input,
     inputLength,
-    NULL,
     output,
     outputLengthRef);
 
+  end_time = OSSpecific_getPreciseTime();
+
+  OSSpecific_probe3(
+    transmit__done,
+    connection->traceReader,
+    pcscResult,
+    (SCARD_S_SUCCESS == pcscResult) ? outputLengthRef[0] : 0);
+
+  if (NULL != connection->transmitLatency)
+  {
+    SCardLatencyHistogram_record(
+      connection->transmitLatency,
+      end_time - start_time);
+  }
+
+  if (NULL != connection->trace)
+  {
+    /* Status Word on success, PC/SC error code otherwise */
+
+    const BOOL succeeded =
+      (SCARD_S_SUCCESS == pcscResult) && (outputLengthRef[0] >= 2);
+
+    SCardTrace_record(
+      connection->trace,
+      WEBCARD_TRACE_RECORD__APDU,
+      succeeded ? 0 : WEBCARD_TRACE_FLAG__FAILED,
+      connection->traceReader,
+      succeeded ?
+        (((uint32_t) output[outputLengthRef[0] - 2] << 8) |
+          output[outputLengthRef[0] - 1]) :
+        (uint32_t) pcscResult,
+      start_time,
+      end_time,
+      input,
+      inputLength,
+      output,
+      (SCARD_S_SUCCESS == pcscResult) ? outputLengthRef[0] : 0);
+  }
+
+  return pcscResult;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardConnection` object.
+ * Reconnects to a card that was reset (or powered down) by another
+ * application, keeping the protocol, and replays the restore script.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] reason `SCARD_W_RESET_CARD` or `SCARD_W_UNPOWERED_CARD`.
+ * @param[out] output Buffer for the responses of the restore script.
+ * @param[in] outputLength The length of `output` buffer, in bytes.
+ * @return `TRUE` if the failed APDU can be sent again.
+ */
+BOOL
+SCardConnection_recover(
+  _Inout_ SCardConnection *connection,
+  _In_ const PCSC_LONG reason,
+  _Out_ BYTE *output,
+  _In_ const PCSC_DWORD outputLength)
+{
+  PCSC_LONG pcscResult;
+  PCSC_DWORD active_protocol;
+  PCSC_DWORD bytes_received;
+  size_t apdu_length;
+  size_t offset = 0;
+  BOOL restored;
+
+  /* A reset card is already powered, an unpowered one needs a reset */
+
+  pcscResult = SCardBackend_current->reconnect(
+    connection->handle,
+    connection->shareMode,
+    connection->activeProtocol,
+    (SCARD_W_UNPOWERED_CARD == reason) ? SCARD_RESET_CARD : SCARD_LEAVE_CARD,
+    &(active_protocol));
+
   if (SCARD_S_SUCCESS != pcscResult)
   {
-    #if defined(_DEBUG)
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{SCardReconnect} failed: 0x%08X (%s)",
+      (uint32_t) pcscResult,
+      WebCard_errorLookup(pcscResult));
+
+    return FALSE;
+  }
+
+  connection->activeProtocol = active_protocol;
+  connection->reconnectCount += 1;
+
+  /* Nothing is selected after a reset */
+
+  SCardConnection_forgetSelections(connection);
+
+  while (offset < connection->restoreScriptLength)
+  {
+    apdu_length =
+      ((size_t) connection->restoreScript[offset] << 8) |
+      connection->restoreScript[offset + 1];
+
+    bytes_received = outputLength;
+
+    pcscResult = SCardConnection_transmit(
+      connection,
+      &(connection->restoreScript[offset + 2]),
+      (PCSC_DWORD) apdu_length,
+      output,
+      &(bytes_received));
+
+    /* Only "9000" (or "61XX", response bytes available) restores */
+
+    restored = (SCARD_S_SUCCESS == pcscResult) && (bytes_received >= 2) &&
+      ((0x61 == output[bytes_received - 2]) ||
+      ((0x90 == output[bytes_received - 2]) && (0x00 == output[bytes_received - 1])));
+
+    if (!restored)
     {
-      OSSpecific_writeDebugMessage(
-        "{SCardTransmit} failed: 0x%08X (%s)",
-        (uint32_t) pcscResult,
-        WebCard_errorLookup(pcscResult));
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{SCardConnection} card session not restored after %s",
+        WebCard_errorLookup(reason));
+
+      return FALSE;
     }
-    #endif
+
+    offset += 2 + apdu_length;
+  }
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{SCardConnection} reconnected after %s (%u restore bytes replayed)",
+    WebCard_errorLookup(reason),
+    (uint32_t) connection->restoreScriptLength);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardConnection_transceiveSingle(
+  _Inout_ SCardConnection *connection,
+  _In_ const BYTE *input,
+  _In_ const PCSC_DWORD inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLengthRef)
+{
+  PCSC_LONG pcscResult;
+  const PCSC_DWORD output_length = outputLengthRef[0];
+
+  /* No more exchanges once the request expired or was cancelled */
+
+  if ((NULL != connection->requests) &&
+    SCardRequestQueue_isAborted(connection->requests))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__INFO,
+      "{SCardTransmit} skipped: request aborted");
+
+    return FALSE;
+  }
+
+  pcscResult = SCardConnection_transmit(
+    connection,
+    input,
+    inputLength,
+    output,
+    outputLengthRef);
+
+  /* Card reset by another application: retried once */
+
+  if (((SCARD_W_RESET_CARD == pcscResult) || (SCARD_W_UNPOWERED_CARD == pcscResult)) &&
+    SCardConnection_recover(connection, pcscResult, output, output_length))
+  {
+    outputLengthRef[0] = output_length;
+
+    pcscResult = SCardConnection_transmit(
+      connection,
+      input,
+      inputLength,
+      output,
+      outputLengthRef);
+  }
+
+  if (SCARD_S_SUCCESS != pcscResult)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{SCardTransmit} failed: 0x%08X (%s)",
+      (uint32_t) pcscResult,
+      WebCard_errorLookup(pcscResult));
 
     return FALSE;
   }
@@ -119,7 +781,7 @@ SCardConnection_transceiveSingle(
 
 BOOL
 SCardConnection_transceiveMultiple(
-  _In_ const SCardConnection *connection,
+  _Inout_ SCardConnection *connection,
   _Inout_ UTF8String *hexStringResult,
   _In_ const BYTE *input,
   _In_ const PCSC_DWORD inputLength,
@@ -0,0 +1,462 @@
+/**
+ * @file "native/src/smart_cards/sc_daemon.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+SCardDaemon *SCardDaemon_current = NULL;
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardDaemon` object.
+ * Body of a session thread: queues the requests of one client
+ * until its socket is closed.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(SCardDaemon_runSession)
+{
+  SCardDaemonSession *session = (SCardDaemonSession *) parameter;
+  SCardDaemon *daemon = session->daemon;
+  int byte_stream_status;
+
+  while (TRUE)
+  {
+    byte_stream_status = SCardRequestQueue_receive(
+      daemon->queue,
+      session->id,
+      session->stream);
+
+    if (JSON_STREAM_STATUS__NO_MORE == byte_stream_status)
+    {
+      break;
+    }
+    else if (JSON_STREAM_STATUS__VALID != byte_stream_status)
+    {
+      OSSpecific_sleep(WEBCARD_QUEUE_IDLE_INTERVAL);
+    }
+  }
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{SCardDaemon} session %u ended",
+    session->id);
+
+  /* The main thread releases the readers of this client */
+
+  OSSpecific_lockMutex(&(daemon->mutex));
+  session->ended = TRUE;
+  OSSpecific_unlockMutex(&(daemon->mutex));
+
+  return 0;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardDaemon` object.
+ * Takes a free slot for a new client (mutex locked).
+ *
+ * @return `TRUE` on success, `FALSE` when there are too many clients
+ * or the session thread could not be started.
+ */
+BOOL
+SCardDaemon_addSession(
+  _Inout_ SCardDaemon *daemon,
+  _In_ const os_specific_stream_t stream)
+{
+  SCardDaemonSession *session = NULL;
+
+  for (size_t i = 0; i < WEBCARD_DAEMON__MAX_SESSIONS; i++)
+  {
+    if (0 == daemon->sessions[i].id)
+    {
+      session = &(daemon->sessions[i]);
+      break;
+    }
+  }
+
+  if (NULL == session)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{SCardDaemon} too many clients, connection refused");
+
+    return FALSE;
+  }
+
+  session->id = daemon->nextSession;
+  session->stream = stream;
+  session->ended = FALSE;
+
+  if (!OSSpecific_startThread(&(session->thread), SCardDaemon_runSession, session))
+  {
+    session->id = 0;
+    return FALSE;
+  }
+
+  /* Zero is Standard Input/Output */
+
+  daemon->nextSession += 1;
+  if (WEBCARD_SESSION__STANDARD_IO == daemon->nextSession)
+  {
+    daemon->nextSession += 1;
+  }
+
+  daemon->sessionCount += 1;
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{SCardDaemon} session %u started (%u clients)",
+    session->id,
+    (uint32_t) daemon->sessionCount);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardDaemon` object.
+ * Body of the listening thread: accepts new clients.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(SCardDaemon_runAccept)
+{
+  SCardDaemon *daemon = (SCardDaemon *) parameter;
+  os_specific_stream_t stream;
+  BOOL stopping = FALSE;
+  BOOL test_bool;
+
+  while (!stopping)
+  {
+    test_bool = OSSpecific_acceptLocalSocket(
+      daemon->listener,
+      WEBCARD_DAEMON__ACCEPT_INTERVAL,
+      WEBCARD_DAEMON__SEND_TIMEOUT,
+      &(stream));
+
+    OSSpecific_lockMutex(&(daemon->mutex));
+
+    stopping = daemon->stopping;
+
+    if (test_bool)
+    {
+      if (stopping || !SCardDaemon_addSession(daemon, stream))
+      {
+        OSSpecific_closeStream(stream);
+      }
+    }
+
+    OSSpecific_unlockMutex(&(daemon->mutex));
+  }
+
+  return 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardDaemon_init(
+  _Out_ SCardDaemon *daemon)
+{
+  OSSpecific_initMutex(&(daemon->mutex));
+
+  daemon->listener = OS_SPECIFIC_INVALID_STREAM;
+  daemon->queue = NULL;
+
+  for (size_t i = 0; i < WEBCARD_DAEMON__MAX_SESSIONS; i++)
+  {
+    daemon->sessions[i].id = 0;
+    daemon->sessions[i].stream = OS_SPECIFIC_INVALID_STREAM;
+    daemon->sessions[i].ended = FALSE;
+    daemon->sessions[i].daemon = daemon;
+
+    OSSpecific_initMutex(&(daemon->sessions[i].outputMutex));
+  }
+
+  daemon->sessionCount = 0;
+  daemon->nextSession = 1;
+  daemon->idleSince = OSSpecific_getMonotonicTime();
+  daemon->stopping = FALSE;
+  daemon->acceptStarted = FALSE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardDaemon_start(
+  _Inout_ SCardDaemon *daemon,
+  _Inout_ SCardRequestQueue *queue)
+{
+  if (!OSSpecific_listenLocalSocket(&(daemon->listener)))
+  {
+    return FALSE;
+  }
+
+  daemon->queue = queue;
+  daemon->idleSince = OSSpecific_getMonotonicTime();
+
+  SCardDaemon_current = daemon;
+
+  daemon->acceptStarted = OSSpecific_startThread(
+    &(daemon->acceptThread),
+    SCardDaemon_runAccept,
+    daemon);
+
+  return daemon->acceptStarted;
+}
+
+/**************************************************************/
+
+VOID
+SCardDaemon_destroy(
+  _Inout_ SCardDaemon *daemon)
+{
+  SCardDaemonSession *session;
+
+  OSSpecific_lockMutex(&(daemon->mutex));
+  daemon->stopping = TRUE;
+  OSSpecific_unlockMutex(&(daemon->mutex));
+
+  if (daemon->acceptStarted)
+  {
+    OSSpecific_joinThread(daemon->acceptThread);
+    daemon->acceptStarted = FALSE;
+  }
+
+  /* Session threads see the end of their streams */
+
+  for (size_t i = 0; i < WEBCARD_DAEMON__MAX_SESSIONS; i++)
+  {
+    session = &(daemon->sessions[i]);
+
+    if (0 != session->id)
+    {
+      OSSpecific_shutdownLocalSocket(session->stream);
+      OSSpecific_joinThread(session->thread);
+
+      OSSpecific_lockMutex(&(session->outputMutex));
+      OSSpecific_closeStream(session->stream);
+      session->stream = OS_SPECIFIC_INVALID_STREAM;
+      session->id = 0;
+      OSSpecific_unlockMutex(&(session->outputMutex));
+    }
+
+    OSSpecific_destroyMutex(&(session->outputMutex));
+  }
+
+  daemon->sessionCount = 0;
+
+  if (SCardDaemon_current == daemon)
+  {
+    SCardDaemon_current = NULL;
+  }
+
+  /* The socket file is left behind: the next daemon replaces it */
+
+  if (OS_SPECIFIC_INVALID_STREAM != daemon->listener)
+  {
+    OSSpecific_closeStream(daemon->listener);
+    daemon->listener = OS_SPECIFIC_INVALID_STREAM;
+  }
+
+  OSSpecific_destroyMutex(&(daemon->mutex));
+}
+
+/**************************************************************/
+
+BOOL
+SCardDaemon_send(
+  _In_ const uint32_t session,
+  _In_ const UTF8String *message)
+{
+  BOOL test_bool = FALSE;
+  SCardDaemon *daemon = SCardDaemon_current;
+  SCardDaemonSession *target = NULL;
+
+  if (WEBCARD_SESSION__STANDARD_IO == session)
+  {
+    /* Browser that does not read must not block the caller */
+
+    if (NULL != SCardOutputQueue_current)
+    {
+      return SCardOutputQueue_push(
+        SCardOutputQueue_current,
+        message,
+        session,
+        WEBCARD_QUEUE_NO_READER,
+        NULL);
+    }
+
+    return UTF8String_writeToStandardOutput(message);
+  }
+
+  if (NULL == daemon)
+  {
+    return FALSE;
+  }
+
+  /* Slot can't be freed while its output mutex is held */
+
+  OSSpecific_lockMutex(&(daemon->mutex));
+
+  for (size_t i = 0; i < WEBCARD_DAEMON__MAX_SESSIONS; i++)
+  {
+    if (session == daemon->sessions[i].id)
+    {
+      target = &(daemon->sessions[i]);
+      OSSpecific_lockMutex(&(target->outputMutex));
+      break;
+    }
+  }
+
+  OSSpecific_unlockMutex(&(daemon->mutex));
+
+  if (NULL == target)
+  {
+    /* Client has gone away meanwhile */
+    return FALSE;
+  }
+
+  test_bool = UTF8String_writeToStream(message, target->stream);
+
+  if (!test_bool)
+  {
+    /* Part of a message might have been written: */
+    /* the stream can't be used any more */
+
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{SCardDaemon} session %u not responding, disconnecting",
+      session);
+
+    OSSpecific_shutdownLocalSocket(target->stream);
+  }
+
+  OSSpecific_unlockMutex(&(target->outputMutex));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+SCardDaemon_sendCardEvent(
+  _In_ const uint32_t session,
+  _In_ const UTF8String *message,
+  _In_ const size_t readerIndex,
+  _In_ const UTF8String *clientKeys)
+{
+  if ((WEBCARD_SESSION__STANDARD_IO == session) &&
+    (NULL != SCardOutputQueue_current))
+  {
+    return SCardOutputQueue_push(
+      SCardOutputQueue_current,
+      message,
+      session,
+      readerIndex,
+      clientKeys);
+  }
+
+  return SCardDaemon_send(session, message);
+}
+
+/**************************************************************/
+
+size_t
+SCardDaemon_listSessions(
+  _Out_ uint32_t *sessions)
+{
+  size_t count = 0;
+  SCardDaemon *daemon = SCardDaemon_current;
+
+  if (NULL == daemon)
+  {
+    sessions[0] = WEBCARD_SESSION__STANDARD_IO;
+    return 1;
+  }
+
+  OSSpecific_lockMutex(&(daemon->mutex));
+
+  for (size_t i = 0; i < WEBCARD_DAEMON__MAX_SESSIONS; i++)
+  {
+    if ((0 != daemon->sessions[i].id) && (!daemon->sessions[i].ended))
+    {
+      sessions[count] = daemon->sessions[i].id;
+      count += 1;
+    }
+  }
+
+  OSSpecific_unlockMutex(&(daemon->mutex));
+
+  return count;
+}
+
+/**************************************************************/
+
+BOOL
+SCardDaemon_popEndedSession(
+  _Inout_ SCardDaemon *daemon,
+  _Out_ uint32_t *sessionRef)
+{
+  SCardDaemonSession *session;
+  BOOL found = FALSE;
+
+  sessionRef[0] = WEBCARD_SESSION__STANDARD_IO;
+
+  OSSpecific_lockMutex(&(daemon->mutex));
+
+  for (size_t i = 0; (!found) && (i < WEBCARD_DAEMON__MAX_SESSIONS); i++)
+  {
+    session = &(daemon->sessions[i]);
+
+    if ((0 != session->id) && session->ended)
+    {
+      found = TRUE;
+      sessionRef[0] = session->id;
+
+      /* Its thread has nothing more to do */
+
+      OSSpecific_joinThread(session->thread);
+
+      OSSpecific_lockMutex(&(session->outputMutex));
+      OSSpecific_closeStream(session->stream);
+      session->stream = OS_SPECIFIC_INVALID_STREAM;
+      session->id = 0;
+      OSSpecific_unlockMutex(&(session->outputMutex));
+
+      daemon->sessionCount -= 1;
+
+      if (0 == daemon->sessionCount)
+      {
+        daemon->idleSince = OSSpecific_getMonotonicTime();
+      }
+    }
+  }
+
+  OSSpecific_unlockMutex(&(daemon->mutex));
+
+  return found;
+}
+
+/**************************************************************/
+
+BOOL
+SCardDaemon_isIdle(
+  _Inout_ SCardDaemon *daemon)
+{
+  BOOL idle;
+
+  OSSpecific_lockMutex(&(daemon->mutex));
+
+  idle = (0 == daemon->sessionCount) &&
+    ((OSSpecific_getMonotonicTime() - daemon->idleSince) >= WEBCARD_DAEMON__IDLE_TIME);
+
+  OSSpecific_unlockMutex(&(daemon->mutex));
+
+  return idle;
+}
+
+/**************************************************************/
@@ -14,6 +14,179 @@ SCardReaderDB_init(
   database->count = 0;
   database->states = NULL;
   database->connections = NULL;
+
+  database->debounceWindow = 0;
+
+  database->subscriptionCount = 0;
+  database->subscriptions = NULL;
+
+  SCardApduCache_init(&(database->apduCache));
+
+  database->prefetchCount = 0;
+  database->prefetchScripts = NULL;
+
+  SCardStats_init(&(database->stats));
+  SCardTrace_init(&(database->trace));
+
+  database->requests = NULL;
+  database->session = WEBCARD_SESSION__STANDARD_IO;
+
+  database->lingerTime = 0;
+  database->lingerHits = 0;
+  database->lingerMisses = 0;
+  database->lingerReleases = 0;
+
+  SCardRecovery_init(&(database->recovery));
+
+  database->jobs = NULL;
+  database->fanOuts = NULL;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardReaderDB` object.
+ * Points the reader filter of a subscription (or of a script)
+ * at the same readers in the new list, matched by name.
+ * Readers that are gone are replaced with `SIZE_MAX`, which never
+ * matches, so that the filter won't pick whichever reader took
+ * their index. Indices beyond the previous list are kept.
+ */
+VOID
+SCardReaderDB_remapFilter(
+  _In_ const SCardReaderDB *destination,
+  _In_ const SCardReaderDB *source,
+  _Inout_ SCardSubscription *filter)
+{
+  size_t index;
+
+  for (size_t i = 0; i < filter->readerCount; i++)
+  {
+    index = filter->readerIndices[i];
+
+    if (index < (size_t) source->count)
+    {
+      filter->readerIndices[i] = SCardReaderDB_findReaderNamed(
+        destination,
+        source->states[index].szReader);
+    }
+  }
+}
+
+/**************************************************************/
+
+VOID
+SCardReaderDB_moveSettings(
+  _Inout_ SCardReaderDB *destination,
+  _Inout_ SCardReaderDB *source)
+{
+  size_t j;
+  const SCardConnection *previous;
+  SCardConnection *connection;
+
+  destination->debounceWindow = source->debounceWindow;
+
+  /* Readers still listed keep their debounce state (by name, */
+  /* as indices shift): an event that has not settled yet is */
+  /* sent later as usual. Events of unplugged readers are dropped. */
+
+  for (size_t i = 0; i < destination->count; i++)
+  {
+    j = SCardReaderDB_findReaderNamed(source, destination->states[i].szReader);
+
+    if (SIZE_MAX == j)
+    {
+      continue;
+    }
+
+    previous = &(source->connections[j]);
+    connection = &(destination->connections[i]);
+
+    connection->debounceWindow = previous->debounceWindow;
+    connection->settledEvent = previous->settledEvent;
+    connection->pendingEvent = previous->pendingEvent;
+    connection->pendingDeadline = previous->pendingDeadline;
+    connection->pendingRemoval = previous->pendingRemoval;
+    connection->pendingSuppressed = previous->pendingSuppressed;
+    connection->suppressedTotal = previous->suppressedTotal;
+  }
+
+  destination->subscriptionCount = source->subscriptionCount;
+  destination->subscriptions = source->subscriptions;
+  source->subscriptionCount = 0;
+  source->subscriptions = NULL;
+
+  /* Cached responses are keyed by reader index, */
+  /* which is meaningless in the new list of readers */
+
+  SCardApduCache_destroy(&(destination->apduCache));
+  destination->apduCache = source->apduCache;
+  SCardApduCache_clear(&(destination->apduCache));
+  SCardApduCache_init(&(source->apduCache));
+
+  destination->prefetchCount = source->prefetchCount;
+  destination->prefetchScripts = source->prefetchScripts;
+  source->prefetchCount = 0;
+  source->prefetchScripts = NULL;
+
+  /* Reader filters were given as indices in the previous list */
+
+  for (size_t i = 0; i < destination->subscriptionCount; i++)
+  {
+    SCardReaderDB_remapFilter(
+      destination,
+      source,
+      &(destination->subscriptions[i]));
+  }
+
+  for (size_t i = 0; i < destination->prefetchCount; i++)
+  {
+    SCardReaderDB_remapFilter(
+      destination,
+      source,
+      &(destination->prefetchScripts[i].filter));
+  }
+
+  /* Reader statistics are keyed by name, so they are still valid */
+
+  SCardStats_destroy(&(destination->stats));
+  destination->stats = source->stats;
+  SCardStats_init(&(source->stats));
+
+  /* Trace records refer to readers by index, */
+  /* so the new list of readers is traced again */
+
+  SCardTrace_destroy(&(destination->trace));
+  destination->trace = source->trace;
+  SCardTrace_init(&(source->trace));
+
+  destination->requests = source->requests;
+  destination->session = source->session;
+
+  destination->lingerTime = source->lingerTime;
+  destination->lingerHits = source->lingerHits;
+  destination->lingerMisses = source->lingerMisses;
+  destination->lingerReleases = source->lingerReleases;
+
+  destination->recovery = source->recovery;
+
+  /* Workers have connections of their own, by reader name */
+
+  destination->jobs = source->jobs;
+  source->jobs = NULL;
+
+  if (NULL != destination->jobs)
+  {
+    SCardReaderDB_remapFilter(
+      destination,
+      source,
+      &(destination->jobs->filter));
+  }
+
+  /* Fan-out workers too */
+
+  destination->fanOuts = source->fanOuts;
+  source->fanOuts = NULL;
 }
 
 /**************************************************************/
@@ -23,6 +196,7 @@ SCardReaderDB_destroy(
   _Inout_ SCardReaderDB *database)
 {
   int i;
+  SCardFanOut *fan_out;
 
   if (NULL != database->states)
   {
@@ -46,6 +220,47 @@ SCardReaderDB_destroy(
 
     free(database->connections);
   }
+
+  if (NULL != database->subscriptions)
+  {
+    for (size_t j = 0; j < database->subscriptionCount; j++)
+    {
+      SCardSubscription_destroy(&(database->subscriptions[j]));
+    }
+
+    free(database->subscriptions);
+  }
+
+  SCardApduCache_destroy(&(database->apduCache));
+
+  if (NULL != database->prefetchScripts)
+  {
+    for (size_t j = 0; j < database->prefetchCount; j++)
+    {
+      SCardPrefetchScript_destroy(&(database->prefetchScripts[j]));
+    }
+
+    free(database->prefetchScripts);
+  }
+
+  SCardStats_destroy(&(database->stats));
+  SCardTrace_destroy(&(database->trace));
+
+  if (NULL != database->jobs)
+  {
+    SCardJobQueue_destroy(database->jobs);
+    free(database->jobs);
+    database->jobs = NULL;
+  }
+
+  while (NULL != database->fanOuts)
+  {
+    fan_out = database->fanOuts;
+    database->fanOuts = fan_out->next;
+
+    SCardFanOut_destroy(fan_out);
+    free(fan_out);
+  }
 }
 
 /**************************************************************/
@@ -146,6 +361,24 @@ SCardReaderDB_hasReaderNamed(
 
 /**************************************************************/
 
+size_t
+SCardReaderDB_findReaderNamed(
+  _In_ const SCardReaderDB *database,
+  _In_ LPCTSTR readerName)
+{
+  for (size_t i = 0; i < database->count; i++)
+  {
+    if (0 == _tcscmp(database->states[i].szReader, readerName))
+    {
+      return i;
+    }
+  }
+
+  return SIZE_MAX;
+}
+
+/**************************************************************/
+
 int
 SCardReaderDB_fetch(
   _Inout_ SCardReaderDB *database,
@@ -172,17 +405,16 @@ SCardReaderDB_fetch(
 
   testLength = 0;
 
-  pcscResult = SCardListReaders(
+  pcscResult = SCardBackend_current->listReaders(
     context,
     NULL,
-    NULL,
     &(testLength));
 
   if (SCARD_S_SUCCESS != pcscResult)
   {
-    if (SCARD_E_SERVICE_STOPPED == pcscResult)
+    if (SCardRecovery_isContextLost(pcscResult))
     {
-      /* Last reader unplugged */
+      /* Last reader unplugged (Windows), or service restarted */
       return WEBCARD_FETCH_READERS__SERVICE_STOPPED;
     }
     else if (SCARD_E_NO_READERS_AVAILABLE == pcscResult)
@@ -193,14 +425,11 @@ SCardReaderDB_fetch(
     }
     else
     {
-      #if defined(_DEBUG)
-      {
-        OSSpecific_writeDebugMessage(
-          "{SCardListReaders} failed: 0x%08X (%s)",
-          (uint32_t) pcscResult,
-          WebCard_errorLookup(pcscResult));
-      }
-      #endif
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
+        "{SCardListReaders} failed: 0x%08X (%s)",
+        (uint32_t) pcscResult,
+        WebCard_errorLookup(pcscResult));
 
       return WEBCARD_FETCH_READERS__FAIL;
     }
@@ -228,8 +457,17 @@ SCardReaderDB_fetch(
             jsonReaderNames);
         }
       }
+      OSSpecific_probe3(
+        readers__rebuild,
+        database->count,
+        0,
+        WEBCARD_FETCH_READERS__LESS_READERS);
+
+      SCardReaderDB_init(&(testDatabase));
+      SCardReaderDB_moveSettings(&(testDatabase), database);
+
       SCardReaderDB_destroy(database);
-      SCardReaderDB_init(database);
+      database[0] = testDatabase;
 
       return WEBCARD_FETCH_READERS__LESS_READERS;
     }
@@ -246,9 +484,8 @@ SCardReaderDB_fetch(
 
   /* Get Smart Card Reader names */
 
-  pcscResult = SCardListReaders(
+  pcscResult = SCardBackend_current->listReaders(
     context,
-    NULL,
     readerNames,
     &(testLength));
 
@@ -345,7 +582,15 @@ SCardReaderDB_fetch(
     }
   }
 
-  /* Destroy previous Smart Card Readers array */
+  OSSpecific_probe3(
+    readers__rebuild,
+    database->count,
+    testDatabase.count,
+    fetchResult);
+
+  /* Keep the settings, destroy previous Smart Card Readers array */
+
+  SCardReaderDB_moveSettings(&(testDatabase), database);
 
   SCardReaderDB_destroy(database);
 
@@ -0,0 +1,350 @@
+/**
+ * @file "native/src/smart_cards/sc_fanout.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardFanOut` object.
+ * Connects to one reader through a Smart Card Context of its own
+ * and sends the command APDUs of the script, stopping at the first
+ * failed transmission (or when stopped).
+ */
+VOID
+SCardFanOut_runJob(
+  _Inout_ SCardFanOutJob *job)
+{
+  BOOL test_bool;
+  PCSC_LONG pcscResult;
+  SCARDCONTEXT context = 0;
+  LPBYTE output_bytes = NULL;
+  SCardFanOut *fan_out = job->fanOut;
+  const SCardPrefetchScript *script = &(fan_out->script);
+
+  /* PCSC Lite runs the calls made through one context one at a time: */
+  /* with the context of the main thread, the readers would take turns */
+
+  pcscResult = SCardBackend_current->establishContext(&(context));
+
+  test_bool = (SCARD_S_SUCCESS == pcscResult);
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{SCardFanOut} no context for reader %u: 0x%08X (%s)",
+      (uint32_t) job->readerIndex,
+      (uint32_t) pcscResult,
+      WebCard_errorLookup(pcscResult));
+  }
+
+  test_bool = test_bool && SCardConnection_open(
+    &(job->connection),
+    context,
+    job->readerName,
+    SCARD_SHARE_SHARED);
+
+  if (test_bool)
+  {
+    output_bytes = malloc(sizeof(BYTE) * MAX_APDU_SIZE);
+
+    test_bool = (NULL != output_bytes);
+  }
+
+  for (size_t i = 0; test_bool && (i < script->apduCount); i++)
+  {
+    OSSpecific_lockMutex(&(fan_out->mutex));
+    test_bool = !(fan_out->stopping);
+    OSSpecific_unlockMutex(&(fan_out->mutex));
+
+    test_bool = test_bool && SCardConnection_transceiveMultiple(
+      &(job->connection),
+      &(job->responses[i]),
+      script->apdus[i],
+      script->apduLengths[i],
+      output_bytes,
+      MAX_APDU_SIZE);
+
+    if (test_bool)
+    {
+      job->responseCount += 1;
+    }
+  }
+
+  if (NULL != output_bytes)
+  {
+    free(output_bytes);
+  }
+
+  SCardConnection_close(&(job->connection));
+
+  if (0 != context)
+  {
+    SCardBackend_current->releaseContext(context);
+  }
+
+  OSSpecific_lockMutex(&(fan_out->mutex));
+  job->finished = TRUE;
+  OSSpecific_unlockMutex(&(fan_out->mutex));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardFanOut` object.
+ * Body of a worker thread.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(SCardFanOut_runWorker)
+{
+  SCardFanOut_runJob((SCardFanOutJob *) parameter);
+
+  return 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardFanOut_init(
+  _Out_ SCardFanOut *fanOut)
+{
+  OSSpecific_initMutex(&(fanOut->mutex));
+
+  SCardPrefetchScript_init(&(fanOut->script));
+
+  fanOut->id = NULL;
+  fanOut->session = WEBCARD_SESSION__STANDARD_IO;
+  fanOut->streamed = FALSE;
+  fanOut->deadline = 0;
+  fanOut->stopping = FALSE;
+  fanOut->answered = FALSE;
+  fanOut->prefetch = FALSE;
+  fanOut->suppressedCount = 0;
+  fanOut->jobCount = 0;
+  fanOut->next = NULL;
+}
+
+/**************************************************************/
+
+VOID
+SCardFanOut_destroy(
+  _Inout_ SCardFanOut *fanOut)
+{
+  SCardFanOutJob *job;
+
+  /* Scripts in progress are finished (a card must not be left half-done) */
+
+  SCardFanOut_wait(fanOut);
+
+  for (size_t i = 0; i < fanOut->jobCount; i++)
+  {
+    job = &(fanOut->jobs[i]);
+
+    for (size_t j = 0; j < WEBCARD_PREFETCH_MAX_APDUS; j++)
+    {
+      UTF8String_destroy(&(job->responses[j]));
+    }
+
+    free(job->readerName);
+    job->readerName = NULL;
+  }
+
+  fanOut->jobCount = 0;
+
+  if (NULL != fanOut->id)
+  {
+    free(fanOut->id);
+    fanOut->id = NULL;
+  }
+
+  SCardPrefetchScript_destroy(&(fanOut->script));
+
+  OSSpecific_destroyMutex(&(fanOut->mutex));
+}
+
+/**************************************************************/
+
+BOOL
+SCardFanOut_addReader(
+  _Inout_ SCardFanOut *fanOut,
+  _In_ LPCTSTR readerName,
+  _In_ const size_t readerIndex,
+  _In_ const SCardConnection *card)
+{
+  size_t name_length;
+  SCardFanOutJob *job;
+
+  if (fanOut->jobCount >= WEBCARD_FANOUT_MAX_READERS)
+  {
+    return FALSE;
+  }
+
+  job = &(fanOut->jobs[fanOut->jobCount]);
+
+  name_length = 1 + _tcslen(readerName);
+
+  job->readerName = malloc(sizeof(TCHAR) * name_length);
+  if (NULL == job->readerName) { return FALSE; }
+
+  memcpy(job->readerName, readerName, sizeof(TCHAR) * name_length);
+
+  /* Connection of its own (opened by the worker thread): */
+  /* the worker never touches the clients' one */
+
+  SCardConnection_init(&(job->connection));
+
+  /* Card identity, for the persistent cache records of this card */
+
+  job->connection.cardAtrLength = card->cardAtrLength;
+  memcpy(job->connection.cardAtr, card->cardAtr, card->cardAtrLength);
+
+  job->connection.cardSerialKnown = card->cardSerialKnown;
+  job->connection.cardSerialLength = card->cardSerialLength;
+  memcpy(job->connection.cardSerial, card->cardSerial, card->cardSerialLength);
+
+  job->readerIndex = readerIndex;
+  job->responseCount = 0;
+  job->started = FALSE;
+  job->finished = FALSE;
+  job->reported = FALSE;
+  job->fanOut = fanOut;
+
+  for (size_t i = 0; i < WEBCARD_PREFETCH_MAX_APDUS; i++)
+  {
+    UTF8String_init(&(job->responses[i]));
+  }
+
+  fanOut->jobCount += 1;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+VOID
+SCardFanOut_start(
+  _Inout_ SCardFanOut *fanOut)
+{
+  SCardFanOutJob *job;
+
+  for (size_t i = 0; i < fanOut->jobCount; i++)
+  {
+    job = &(fanOut->jobs[i]);
+
+    job->started = OSSpecific_startThread(
+      &(job->thread),
+      SCardFanOut_runWorker,
+      job);
+
+    if (!(job->started))
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{SCardFanOut} no thread for reader %u, served in turn",
+        (uint32_t) job->readerIndex);
+
+      SCardFanOut_runJob(job);
+    }
+  }
+}
+
+/**************************************************************/
+
+VOID
+SCardFanOut_stop(
+  _Inout_ SCardFanOut *fanOut)
+{
+  OSSpecific_lockMutex(&(fanOut->mutex));
+  fanOut->stopping = TRUE;
+  OSSpecific_unlockMutex(&(fanOut->mutex));
+}
+
+/**************************************************************/
+
+VOID
+SCardFanOut_wait(
+  _Inout_ SCardFanOut *fanOut)
+{
+  for (size_t i = 0; i < fanOut->jobCount; i++)
+  {
+    if (fanOut->jobs[i].started)
+    {
+      OSSpecific_joinThread(fanOut->jobs[i].thread);
+      fanOut->jobs[i].started = FALSE;
+    }
+  }
+}
+
+/**************************************************************/
+
+SCardFanOutJob *
+SCardFanOut_collect(
+  _Inout_ SCardFanOut *fanOut)
+{
+  SCardFanOutJob *job = NULL;
+
+  OSSpecific_lockMutex(&(fanOut->mutex));
+
+  for (size_t i = 0; (NULL == job) && (i < fanOut->jobCount); i++)
+  {
+    if (!(fanOut->jobs[i].reported) && fanOut->jobs[i].finished)
+    {
+      job = &(fanOut->jobs[i]);
+    }
+  }
+
+  OSSpecific_unlockMutex(&(fanOut->mutex));
+
+  if (NULL != job)
+  {
+    if (job->started)
+    {
+      OSSpecific_joinThread(job->thread);
+      job->started = FALSE;
+    }
+
+    job->reported = TRUE;
+  }
+
+  return job;
+}
+
+/**************************************************************/
+
+BOOL
+SCardFanOut_isDone(
+  _In_ const SCardFanOut *fanOut)
+{
+  for (size_t i = 0; i < fanOut->jobCount; i++)
+  {
+    if (!(fanOut->jobs[i].reported))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardFanOut_usesReader(
+  _In_ const SCardFanOut *fanOut,
+  _In_ LPCTSTR readerName)
+{
+  for (size_t i = 0; i < fanOut->jobCount; i++)
+  {
+    if (!(fanOut->jobs[i].reported) &&
+      (0 == _tcscmp(fanOut->jobs[i].readerName, readerName)))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**************************************************************/
@@ -0,0 +1,849 @@
+/**
+ * @file "native/src/smart_cards/sc_jobs.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardJobQueue` object.
+ * Releases the parameters of one job.
+ */
+VOID
+SCardJobQueue_freeJob(
+  _Inout_ SCardJob *job)
+{
+  for (size_t i = 0; i < job->parameterCount; i++)
+  {
+    free(job->parameters[i]);
+  }
+
+  job->parameterCount = 0;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardJobQueue` object.
+ * Makes a NULL-terminated copy of a JSON string.
+ */
+LPSTR
+SCardJobQueue_copyText(
+  _In_ const UTF8String *text)
+{
+  LPSTR copy = malloc(sizeof(char) * (text->length + 1));
+
+  if (NULL != copy)
+  {
+    memcpy(copy, text->text, text->length);
+    copy[text->length] = '\0';
+  }
+
+  return copy;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardJobQueue` object.
+ * Checks a job parameter (hex digits, even length)
+ * or a job script command (hex digits and `{n}` parameters).
+ */
+BOOL
+SCardJobQueue_isValidText(
+  _In_ const UTF8String *text,
+  _In_ const BOOL isTemplate)
+{
+  size_t digits = 0;
+  const char *c;
+
+  for (size_t i = 0; i < text->length; i++)
+  {
+    c = (const char *) &(text->text[i]);
+
+    if (((c[0] >= '0') && (c[0] <= '9')) ||
+      ((c[0] >= 'A') && (c[0] <= 'F')) ||
+      ((c[0] >= 'a') && (c[0] <= 'f')))
+    {
+      digits += 1;
+    }
+    else if (isTemplate && ('{' == c[0]) && ((i + 2) < text->length) &&
+      (c[1] >= '0') && (c[1] < ('0' + WEBCARD_JOBS_MAX_PARAMETERS)) &&
+      ('}' == c[2]))
+    {
+      i += 2;
+    }
+    else
+    {
+      return FALSE;
+    }
+  }
+
+  /* Parameters are whole bytes, so the rest must be too */
+
+  return (0 == (digits % 2)) && (!isTemplate || (text->length > 0));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardJobQueue` object.
+ * Builds one command APDU of the job script for given job.
+ *
+ * @return `TRUE` on success, `FALSE` when a parameter is missing,
+ * the command APDU is too short, OR on memory allocation failure.
+ */
+BOOL
+SCardJobQueue_expand(
+  _In_z_ LPCSTR apduTemplate,
+  _In_ const SCardJob *job,
+  _Out_ LPBYTE *apduRef,
+  _Out_ size_t *apduLengthRef)
+{
+  BOOL test_bool = TRUE;
+  size_t parameter;
+  UTF8String utf8_apdu;
+
+  apduRef[0] = NULL;
+  apduLengthRef[0] = 0;
+
+  UTF8String_init(&(utf8_apdu));
+
+  for (size_t i = 0; test_bool && ('\0' != apduTemplate[i]); i++)
+  {
+    if ('{' == apduTemplate[i])
+    {
+      parameter = (size_t) (apduTemplate[i + 1] - '0');
+      i += 2;
+
+      test_bool = (parameter < job->parameterCount) &&
+        UTF8String_pushText(
+          &(utf8_apdu),
+          job->parameters[parameter],
+          strlen(job->parameters[parameter]));
+    }
+    else
+    {
+      test_bool = UTF8String_pushByte(&(utf8_apdu), (BYTE) apduTemplate[i]);
+    }
+  }
+
+  if (test_bool)
+  {
+    test_bool = UTF8String_hexToByteArray(
+      &(utf8_apdu),
+      apduLengthRef,
+      apduRef) && (apduLengthRef[0] >= 4);
+  }
+
+  UTF8String_destroy(&(utf8_apdu));
+
+  if (!test_bool && (NULL != apduRef[0]))
+  {
+    free(apduRef[0]);
+    apduRef[0] = NULL;
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardJobQueue` object.
+ * Connects to the card through a Smart Card Context of its own
+ * and sends the command APDUs of the job, stopping at the first
+ * failed transmission.
+ */
+VOID
+SCardJobQueue_runJob(
+  _Inout_ SCardJobWorker *worker)
+{
+  BOOL test_bool;
+  PCSC_LONG pcscResult;
+  SCARDCONTEXT context = 0;
+  LPBYTE output_bytes = NULL;
+
+  /* PCSC Lite runs the calls made through one context one at a time: */
+  /* with the context of the main thread, the readers would take turns */
+  /* (and the main loop would wait for them) */
+
+  pcscResult = SCardBackend_current->establishContext(&(context));
+
+  test_bool = (SCARD_S_SUCCESS == pcscResult);
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{SCardJobQueue} job %u: no context: 0x%08X (%s)",
+      worker->job.id,
+      (uint32_t) pcscResult,
+      WebCard_errorLookup(pcscResult));
+  }
+
+  test_bool = test_bool && SCardConnection_open(
+    &(worker->connection),
+    context,
+    worker->readerName,
+    SCARD_SHARE_SHARED);
+
+  if (test_bool)
+  {
+    output_bytes = malloc(sizeof(BYTE) * MAX_APDU_SIZE);
+
+    test_bool = (NULL != output_bytes);
+  }
+
+  for (size_t i = 0; test_bool && (i < worker->apduCount); i++)
+  {
+    test_bool = SCardConnection_transceiveMultiple(
+      &(worker->connection),
+      &(worker->responses[i]),
+      worker->apdus[i],
+      worker->apduLengths[i],
+      output_bytes,
+      MAX_APDU_SIZE);
+
+    if (test_bool)
+    {
+      worker->responseCount += 1;
+    }
+  }
+
+  if (NULL != output_bytes)
+  {
+    free(output_bytes);
+  }
+
+  SCardConnection_close(&(worker->connection));
+
+  if (0 != context)
+  {
+    SCardBackend_current->releaseContext(context);
+  }
+
+  worker->failed = (worker->responseCount < worker->apduCount);
+  worker->endTime = OSSpecific_getMonotonicTime();
+
+  OSSpecific_lockMutex(&(worker->queue->mutex));
+  worker->finished = TRUE;
+  OSSpecific_unlockMutex(&(worker->queue->mutex));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardJobQueue` object.
+ * Body of a worker thread.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(SCardJobQueue_runWorker)
+{
+  SCardJobQueue_runJob((SCardJobWorker *) parameter);
+
+  return 0;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardJobQueue` object.
+ * Finds (or creates) the throughput of given reader.
+ */
+SCardJobReaderStats *
+SCardJobQueue_findReader(
+  _Inout_ SCardJobQueue *queue,
+  _In_ LPCTSTR readerName)
+{
+  SCardJobReaderStats *new_readers;
+  SCardJobReaderStats *reader_stats;
+  size_t name_length;
+
+  for (size_t i = 0; i < queue->readerCount; i++)
+  {
+    if (0 == _tcscmp(queue->readers[i].readerName, readerName))
+    {
+      return &(queue->readers[i]);
+    }
+  }
+
+  new_readers = realloc(
+    queue->readers,
+    sizeof(SCardJobReaderStats) * (queue->readerCount + 1));
+
+  if (NULL == new_readers) { return NULL; }
+
+  queue->readers = new_readers;
+  reader_stats = &(new_readers[queue->readerCount]);
+
+  name_length = 1 + _tcslen(readerName);
+
+  reader_stats->readerName = malloc(sizeof(TCHAR) * name_length);
+  if (NULL == reader_stats->readerName) { return NULL; }
+
+  memcpy(reader_stats->readerName, readerName, sizeof(TCHAR) * name_length);
+  reader_stats->jobs = 0;
+  reader_stats->failures = 0;
+  reader_stats->busyTime = 0;
+
+  queue->readerCount += 1;
+
+  return reader_stats;
+}
+
+/**************************************************************/
+
+VOID
+SCardJobQueue_init(
+  _Out_ SCardJobQueue *queue)
+{
+  OSSpecific_initMutex(&(queue->mutex));
+
+  queue->session = WEBCARD_SESSION__STANDARD_IO;
+  SCardSubscription_init(&(queue->filter));
+
+  queue->templateCount = 0;
+
+  queue->pending = NULL;
+  queue->pendingCapacity = 0;
+  queue->pendingFirst = 0;
+  queue->pendingCount = 0;
+  queue->nextId = 1;
+
+  for (size_t i = 0; i < WEBCARD_JOBS_MAX_WORKERS; i++)
+  {
+    queue->workers[i].busy = FALSE;
+    queue->workers[i].queue = queue;
+
+    SCardConnection_init(&(queue->workers[i].connection));
+  }
+
+  queue->firstDispatch = 0;
+  queue->doneCount = 0;
+  queue->failedCount = 0;
+
+  queue->readerCount = 0;
+  queue->readers = NULL;
+}
+
+/**************************************************************/
+
+VOID
+SCardJobQueue_destroy(
+  _Inout_ SCardJobQueue *queue)
+{
+  /* Jobs in progress are finished (a card must not be left half-done) */
+
+  for (size_t i = 0; i < WEBCARD_JOBS_MAX_WORKERS; i++)
+  {
+    if (queue->workers[i].busy)
+    {
+      SCardJobQueue_release(queue, &(queue->workers[i]));
+    }
+  }
+
+  SCardJobQueue_clear(queue);
+
+  if (NULL != queue->pending)
+  {
+    free(queue->pending);
+    queue->pending = NULL;
+  }
+
+  queue->pendingCapacity = 0;
+
+  for (size_t i = 0; i < queue->templateCount; i++)
+  {
+    free(queue->templates[i]);
+  }
+
+  queue->templateCount = 0;
+
+  SCardSubscription_destroy(&(queue->filter));
+
+  for (size_t i = 0; i < queue->readerCount; i++)
+  {
+    free(queue->readers[i].readerName);
+  }
+
+  if (NULL != queue->readers)
+  {
+    free(queue->readers);
+    queue->readers = NULL;
+  }
+
+  queue->readerCount = 0;
+
+  OSSpecific_destroyMutex(&(queue->mutex));
+}
+
+/**************************************************************/
+
+VOID
+SCardJobQueue_clear(
+  _Inout_ SCardJobQueue *queue)
+{
+  for (size_t i = 0; i < queue->pendingCount; i++)
+  {
+    SCardJobQueue_freeJob(&(queue->pending[queue->pendingFirst + i]));
+  }
+
+  queue->pendingFirst = 0;
+  queue->pendingCount = 0;
+}
+
+/**************************************************************/
+
+BOOL
+SCardJobQueue_configure(
+  _Inout_ SCardJobQueue *queue,
+  _In_ const JsonObject *jsonRequest,
+  _In_ const uint32_t session,
+  _Out_ uint32_t *firstIdRef)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  const JsonArray *json_templates = NULL;
+  const JsonArray *json_jobs = NULL;
+  const JsonArray *json_parameters;
+  SCardSubscription filter;
+  SCardJob *new_pending;
+  SCardJob *job;
+  size_t new_capacity;
+  size_t template_count;
+
+  firstIdRef[0] = 0;
+
+  /* Key "d" (job script), checked before anything changes */
+
+  if (JsonObject_getValue(jsonRequest, &(json_value), "d"))
+  {
+    if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+    json_templates = json_value.value;
+
+    if ((0 == json_templates->count) ||
+      (json_templates->count > WEBCARD_PREFETCH_MAX_APDUS))
+    {
+      return FALSE;
+    }
+
+    for (size_t i = 0; i < json_templates->count; i++)
+    {
+      if ((JSON_VALUE_TYPE__STRING != json_templates->values[i].type) ||
+        !SCardJobQueue_isValidText(json_templates->values[i].value, TRUE))
+      {
+        return FALSE;
+      }
+    }
+  }
+
+  /* Key "j" (jobs to queue) */
+
+  if (JsonObject_getValue(jsonRequest, &(json_value), "j"))
+  {
+    if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+    json_jobs = json_value.value;
+
+    if ((NULL == json_templates) && (0 == queue->templateCount))
+    {
+      return FALSE;
+    }
+
+    if ((queue->pendingCount + json_jobs->count) > WEBCARD_JOBS_MAX_PENDING)
+    {
+      return FALSE;
+    }
+
+    for (size_t i = 0; i < json_jobs->count; i++)
+    {
+      if (JSON_VALUE_TYPE__ARRAY != json_jobs->values[i].type)
+      {
+        return FALSE;
+      }
+
+      json_parameters = json_jobs->values[i].value;
+
+      if (json_parameters->count > WEBCARD_JOBS_MAX_PARAMETERS)
+      {
+        return FALSE;
+      }
+
+      for (size_t j = 0; j < json_parameters->count; j++)
+      {
+        if ((JSON_VALUE_TYPE__STRING != json_parameters->values[j].type) ||
+          !SCardJobQueue_isValidText(json_parameters->values[j].value, FALSE))
+        {
+          return FALSE;
+        }
+      }
+    }
+  }
+
+  /* Keys "r", "a" and "m" (readers and cards), "k" (who gets the reports) */
+
+  if (NULL != json_templates)
+  {
+    test_bool = SCardSubscription_load(&(filter), jsonRequest);
+
+    if (!test_bool)
+    {
+      SCardSubscription_destroy(&(filter));
+      return FALSE;
+    }
+
+    SCardSubscription_destroy(&(queue->filter));
+    queue->filter = filter;
+    queue->session = session;
+
+    template_count = queue->templateCount;
+    queue->templateCount = 0;
+
+    for (size_t i = 0; i < template_count; i++)
+    {
+      free(queue->templates[i]);
+    }
+
+    for (size_t i = 0; i < json_templates->count; i++)
+    {
+      queue->templates[i] = SCardJobQueue_copyText(json_templates->values[i].value);
+
+      if (NULL == queue->templates[i]) { return FALSE; }
+
+      queue->templateCount += 1;
+    }
+  }
+
+  /* Key "x" (drop the waiting jobs) */
+
+  if (JsonObject_getValue(jsonRequest, &(json_value), "x") &&
+    (JSON_VALUE_TYPE__NUMBER == json_value.type) &&
+    (0 != ((FLOAT *) json_value.value)[0]))
+  {
+    SCardJobQueue_clear(queue);
+  }
+
+  if ((NULL == json_jobs) || (0 == json_jobs->count))
+  {
+    return TRUE;
+  }
+
+  /* Waiting jobs are moved to the front, then the list grows */
+
+  if ((queue->pendingFirst > 0) &&
+    ((queue->pendingFirst + queue->pendingCount + json_jobs->count) > queue->pendingCapacity))
+  {
+    memmove(
+      queue->pending,
+      &(queue->pending[queue->pendingFirst]),
+      sizeof(SCardJob) * queue->pendingCount);
+
+    queue->pendingFirst = 0;
+  }
+
+  if ((queue->pendingCount + json_jobs->count) > queue->pendingCapacity)
+  {
+    new_capacity = Misc_nextPowerOfTwo(queue->pendingCount + json_jobs->count);
+
+    new_pending = realloc(queue->pending, sizeof(SCardJob) * new_capacity);
+    if (NULL == new_pending) { return FALSE; }
+
+    queue->pending = new_pending;
+    queue->pendingCapacity = new_capacity;
+  }
+
+  firstIdRef[0] = queue->nextId;
+
+  for (size_t i = 0; i < json_jobs->count; i++)
+  {
+    json_parameters = json_jobs->values[i].value;
+
+    job = &(queue->pending[queue->pendingFirst + queue->pendingCount]);
+    job->id = queue->nextId;
+    job->parameterCount = 0;
+
+    for (size_t j = 0; j < json_parameters->count; j++)
+    {
+      job->parameters[j] = SCardJobQueue_copyText(json_parameters->values[j].value);
+
+      if (NULL == job->parameters[j])
+      {
+        SCardJobQueue_freeJob(job);
+        return FALSE;
+      }
+
+      job->parameterCount += 1;
+    }
+
+    queue->nextId += 1;
+    queue->pendingCount += 1;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardJobQueue_matches(
+  _In_ const SCardJobQueue *queue,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *atr,
+  _In_ const size_t atrLength)
+{
+  if (0 == queue->templateCount)
+  {
+    return FALSE;
+  }
+
+  return SCardSubscription_matches(
+    &(queue->filter),
+    readerIndex,
+    WEBCARD_READER_EVENT__CARD_INSERTION,
+    atr,
+    atrLength);
+}
+
+/**************************************************************/
+
+BOOL
+SCardJobQueue_dispatch(
+  _Inout_ SCardJobQueue *queue,
+  _In_ LPCTSTR readerName)
+{
+  BOOL test_bool;
+  size_t name_length;
+  SCardJobWorker *worker = NULL;
+
+  if ((0 == queue->templateCount) || (0 == queue->pendingCount))
+  {
+    return FALSE;
+  }
+
+  for (size_t i = 0; i < WEBCARD_JOBS_MAX_WORKERS; i++)
+  {
+    if (!(queue->workers[i].busy))
+    {
+      if (NULL == worker)
+      {
+        worker = &(queue->workers[i]);
+      }
+    }
+    else if (0 == _tcscmp(queue->workers[i].readerName, readerName))
+    {
+      /* Still working on the previous card */
+      return FALSE;
+    }
+  }
+
+  if (NULL == worker)
+  {
+    return FALSE;
+  }
+
+  /* Connection of its own (opened by the worker thread): */
+  /* the worker never touches the clients' one */
+
+  name_length = 1 + _tcslen(readerName);
+
+  worker->readerName = malloc(sizeof(TCHAR) * name_length);
+  if (NULL == worker->readerName) { return FALSE; }
+
+  memcpy(worker->readerName, readerName, sizeof(TCHAR) * name_length);
+
+  /* Oldest waiting job */
+
+  worker->job = queue->pending[queue->pendingFirst];
+  queue->pendingFirst += 1;
+  queue->pendingCount -= 1;
+
+  if (0 == queue->pendingCount)
+  {
+    queue->pendingFirst = 0;
+  }
+
+  worker->busy = TRUE;
+  worker->started = FALSE;
+  worker->finished = FALSE;
+  worker->failed = FALSE;
+  worker->apduCount = 0;
+  worker->responseCount = 0;
+  worker->startTime = OSSpecific_getMonotonicTime();
+  worker->endTime = worker->startTime;
+
+  if (0 == queue->firstDispatch)
+  {
+    queue->firstDispatch = worker->startTime;
+  }
+
+  for (size_t i = 0; i < WEBCARD_PREFETCH_MAX_APDUS; i++)
+  {
+    UTF8String_init(&(worker->responses[i]));
+  }
+
+  for (size_t i = 0; i < queue->templateCount; i++)
+  {
+    test_bool = SCardJobQueue_expand(
+      queue->templates[i],
+      &(worker->job),
+      &(worker->apdus[i]),
+      &(worker->apduLengths[i]));
+
+    if (!test_bool)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{SCardJobQueue} job %u: command %u could not be built",
+        worker->job.id,
+        (uint32_t) i);
+
+      worker->failed = TRUE;
+      break;
+    }
+
+    worker->apduCount += 1;
+  }
+
+  if (worker->failed)
+  {
+    /* Reported as failed without touching the card */
+    worker->finished = TRUE;
+    return TRUE;
+  }
+
+  worker->started = OSSpecific_startThread(
+    &(worker->thread),
+    SCardJobQueue_runWorker,
+    worker);
+
+  if (!(worker->started))
+  {
+    SCardJobQueue_runJob(worker);
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+SCardJobWorker *
+SCardJobQueue_collect(
+  _Inout_ SCardJobQueue *queue)
+{
+  SCardJobWorker *worker = NULL;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  for (size_t i = 0; (NULL == worker) && (i < WEBCARD_JOBS_MAX_WORKERS); i++)
+  {
+    if (queue->workers[i].busy && queue->workers[i].finished)
+    {
+      worker = &(queue->workers[i]);
+    }
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return worker;
+}
+
+/**************************************************************/
+
+VOID
+SCardJobQueue_release(
+  _Inout_ SCardJobQueue *queue,
+  _Inout_ SCardJobWorker *worker)
+{
+  SCardJobReaderStats *reader_stats;
+
+  if (worker->started)
+  {
+    OSSpecific_joinThread(worker->thread);
+    worker->started = FALSE;
+  }
+
+  if (worker->failed)
+  {
+    queue->failedCount += 1;
+  }
+  else
+  {
+    queue->doneCount += 1;
+  }
+
+  if (0 == queue->firstDispatch)
+  {
+    queue->firstDispatch = worker->startTime;
+  }
+
+  reader_stats = SCardJobQueue_findReader(queue, worker->readerName);
+
+  if (NULL != reader_stats)
+  {
+    reader_stats->jobs += 1;
+    reader_stats->busyTime += worker->endTime - worker->startTime;
+
+    if (worker->failed)
+    {
+      reader_stats->failures += 1;
+    }
+  }
+
+  for (size_t i = 0; i < worker->apduCount; i++)
+  {
+    free(worker->apdus[i]);
+  }
+
+  for (size_t i = 0; i < WEBCARD_PREFETCH_MAX_APDUS; i++)
+  {
+    UTF8String_destroy(&(worker->responses[i]));
+  }
+
+  SCardJobQueue_freeJob(&(worker->job));
+
+  free(worker->readerName);
+  worker->readerName = NULL;
+
+  worker->apduCount = 0;
+  worker->responseCount = 0;
+  worker->busy = FALSE;
+}
+
+/**************************************************************/
+
+VOID
+SCardJobQueue_wait(
+  _Inout_ SCardJobQueue *queue)
+{
+  for (size_t i = 0; i < WEBCARD_JOBS_MAX_WORKERS; i++)
+  {
+    if (queue->workers[i].busy && queue->workers[i].started)
+    {
+      OSSpecific_joinThread(queue->workers[i].thread);
+      queue->workers[i].started = FALSE;
+    }
+  }
+}
+
+/**************************************************************/
+
+VOID
+SCardJobQueue_resetCounters(
+  _Inout_ SCardJobQueue *queue)
+{
+  queue->firstDispatch = 0;
+  queue->doneCount = 0;
+  queue->failedCount = 0;
+
+  for (size_t i = 0; i < queue->readerCount; i++)
+  {
+    queue->readers[i].jobs = 0;
+    queue->readers[i].failures = 0;
+    queue->readers[i].busyTime = 0;
+  }
+}
+
+/**************************************************************/
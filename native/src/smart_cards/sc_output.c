@@ -0,0 +1,428 @@
+/**
+ * @file "native/src/smart_cards/sc_output.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+SCardOutputQueue *SCardOutputQueue_current = NULL;
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardOutputQueue` object.
+ * Releases every message that has not been written yet (mutex locked).
+ */
+VOID
+SCardOutputQueue_dropAll(
+  _Inout_ SCardOutputQueue *queue)
+{
+  SCardOutgoingMessage *message;
+
+  while (NULL != queue->first)
+  {
+    message = queue->first;
+    queue->first = message->next;
+
+    queue->count -= 1;
+    queue->bytes -= message->text.length;
+
+    UTF8String_destroy(&(message->text));
+    UTF8String_destroy(&(message->clientKeys));
+    free(message);
+  }
+
+  queue->last = NULL;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardOutputQueue` object.
+ * Updates the congestion counters after the queued bytes
+ * have changed (mutex locked).
+ */
+VOID
+SCardOutputQueue_checkBudget(
+  _Inout_ SCardOutputQueue *queue)
+{
+  const BOOL congested = (queue->bytes > WEBCARD_OUTPUT_BUDGET);
+  const uint64_t now = OSSpecific_getMonotonicTime();
+
+  if (queue->bytes > queue->stats.peakBytes)
+  {
+    queue->stats.peakBytes = queue->bytes;
+  }
+
+  if (congested && !(queue->congested))
+  {
+    queue->congested = TRUE;
+    queue->congestedSince = now;
+    queue->stats.congestions += 1;
+  }
+  else if ((!congested) && queue->congested)
+  {
+    queue->congested = FALSE;
+    queue->stats.congestedTime += (now - queue->congestedSince);
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardOutputQueue` object.
+ * Body of the writer thread: writes the messages in their order
+ * until the queue is stopped and empty.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(SCardOutputQueue_runWriter)
+{
+  SCardOutputQueue *queue = (SCardOutputQueue *) parameter;
+  SCardOutgoingMessage *message;
+  BOOL test_bool;
+  uint64_t waited;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  while (TRUE)
+  {
+    while ((NULL == queue->first) && !(queue->stopping))
+    {
+      OSSpecific_waitCondition(&(queue->condition), &(queue->mutex), UINT64_MAX);
+    }
+
+    if (NULL == queue->first)
+    {
+      break;
+    }
+
+    /* Detached message can't be merged any more, */
+    /* but it is still counted until it is written */
+
+    message = queue->first;
+    queue->first = message->next;
+
+    if (NULL == queue->first)
+    {
+      queue->last = NULL;
+    }
+
+    OSSpecific_unlockMutex(&(queue->mutex));
+
+    test_bool = UTF8String_writeToStandardOutput(&(message->text));
+
+    OSSpecific_lockMutex(&(queue->mutex));
+
+    waited = OSSpecific_getMonotonicTime() - message->queuedTime;
+
+    if (waited > queue->stats.longestWait)
+    {
+      queue->stats.longestWait = waited;
+    }
+
+    queue->count -= 1;
+    queue->bytes -= message->text.length;
+
+    UTF8String_destroy(&(message->text));
+    UTF8String_destroy(&(message->clientKeys));
+    free(message);
+
+    if ((!test_bool) && !(queue->broken))
+    {
+      /* Nobody reads Standard Output any more */
+
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{SCardOutputQueue} Standard Output closed, %u message(s) dropped",
+        (uint32_t) queue->count);
+
+      queue->broken = TRUE;
+      SCardOutputQueue_dropAll(queue);
+    }
+
+    SCardOutputQueue_checkBudget(queue);
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardOutputQueue_init(
+  _Out_ SCardOutputQueue *queue)
+{
+  OSSpecific_initMutex(&(queue->mutex));
+  OSSpecific_initCondition(&(queue->condition));
+
+  queue->first = NULL;
+  queue->last = NULL;
+  queue->count = 0;
+  queue->bytes = 0;
+
+  queue->congested = FALSE;
+  queue->congestedSince = 0;
+  queue->broken = FALSE;
+  queue->stopping = FALSE;
+  queue->writerStarted = FALSE;
+
+  SCardOutputQueue_resetStats(queue);
+}
+
+/**************************************************************/
+
+BOOL
+SCardOutputQueue_start(
+  _Inout_ SCardOutputQueue *queue)
+{
+  queue->writerStarted = OSSpecific_startThread(
+    &(queue->writerThread),
+    SCardOutputQueue_runWriter,
+    queue);
+
+  if (queue->writerStarted)
+  {
+    SCardOutputQueue_current = queue;
+  }
+
+  return queue->writerStarted;
+}
+
+/**************************************************************/
+
+VOID
+SCardOutputQueue_destroy(
+  _Inout_ SCardOutputQueue *queue)
+{
+  if (SCardOutputQueue_current == queue)
+  {
+    SCardOutputQueue_current = NULL;
+  }
+
+  /* Writer thread empties the queue before it returns */
+
+  OSSpecific_lockMutex(&(queue->mutex));
+  queue->stopping = TRUE;
+  OSSpecific_broadcastCondition(&(queue->condition));
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  if (queue->writerStarted)
+  {
+    OSSpecific_joinThread(queue->writerThread);
+    queue->writerStarted = FALSE;
+  }
+
+  SCardOutputQueue_dropAll(queue);
+
+  OSSpecific_destroyCondition(&(queue->condition));
+  OSSpecific_destroyMutex(&(queue->mutex));
+}
+
+/**************************************************************/
+
+BOOL
+SCardOutputQueue_push(
+  _Inout_ SCardOutputQueue *queue,
+  _In_ const UTF8String *message,
+  _In_ const uint32_t session,
+  _In_ const size_t readerIndex,
+  _In_opt_ const UTF8String *clientKeys)
+{
+  SCardOutgoingMessage *entry;
+  SCardOutgoingMessage *previous = NULL;
+  SCardOutgoingMessage *merged = NULL;
+
+  entry = malloc(sizeof(SCardOutgoingMessage));
+
+  if (NULL == entry)
+  {
+    return FALSE;
+  }
+
+  if (!UTF8String_copy(&(entry->text), message))
+  {
+    free(entry);
+    return FALSE;
+  }
+
+  UTF8String_init(&(entry->clientKeys));
+
+  if ((NULL != clientKeys) && !UTF8String_copy(&(entry->clientKeys), clientKeys))
+  {
+    UTF8String_destroy(&(entry->text));
+    free(entry);
+    return FALSE;
+  }
+
+  entry->next = NULL;
+  entry->readerIndex = readerIndex;
+  entry->session = session;
+  entry->queuedTime = OSSpecific_getMonotonicTime();
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  if (queue->broken)
+  {
+    OSSpecific_unlockMutex(&(queue->mutex));
+
+    UTF8String_destroy(&(entry->text));
+    UTF8String_destroy(&(entry->clientKeys));
+    free(entry);
+
+    return FALSE;
+  }
+
+  /* A Card Event still waiting for the same reader is superseded: */
+  /* only the latest state of that reader is written (unless it */
+  /* goes to other clients, who would miss an event) */
+
+  if (WEBCARD_QUEUE_NO_READER != readerIndex)
+  {
+    for (merged = queue->first; NULL != merged; merged = merged->next)
+    {
+      if ((readerIndex == merged->readerIndex) &&
+        (session == merged->session) &&
+        (entry->clientKeys.length == merged->clientKeys.length) &&
+        ((0 == entry->clientKeys.length) ||
+        (0 == memcmp(entry->clientKeys.text, merged->clientKeys.text, entry->clientKeys.length))))
+      {
+        break;
+      }
+
+      previous = merged;
+    }
+  }
+
+  if (NULL != merged)
+  {
+    if (NULL == previous)
+    {
+      queue->first = merged->next;
+    }
+    else
+    {
+      previous->next = merged->next;
+    }
+
+    if (queue->last == merged)
+    {
+      queue->last = previous;
+    }
+
+    queue->count -= 1;
+    queue->bytes -= merged->text.length;
+    queue->stats.mergedEvents += 1;
+
+    UTF8String_destroy(&(merged->text));
+    UTF8String_destroy(&(merged->clientKeys));
+    free(merged);
+  }
+
+  /* The new message goes last, after the responses */
+  /* that were built before it */
+
+  if (NULL == queue->last)
+  {
+    queue->first = entry;
+  }
+  else
+  {
+    queue->last->next = entry;
+  }
+
+  queue->last = entry;
+  queue->count += 1;
+  queue->bytes += entry->text.length;
+
+  SCardOutputQueue_checkBudget(queue);
+
+  OSSpecific_broadcastCondition(&(queue->condition));
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+VOID
+SCardOutputQueue_forgetReaders(
+  _Inout_ SCardOutputQueue *queue)
+{
+  SCardOutgoingMessage *message;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  for (message = queue->first; NULL != message; message = message->next)
+  {
+    message->readerIndex = WEBCARD_QUEUE_NO_READER;
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+}
+
+/**************************************************************/
+
+BOOL
+SCardOutputQueue_isCongested(
+  _Inout_ SCardOutputQueue *queue)
+{
+  BOOL congested;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+  congested = queue->congested;
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return congested;
+}
+
+/**************************************************************/
+
+VOID
+SCardOutputQueue_getStats(
+  _Inout_ SCardOutputQueue *queue,
+  _Out_ SCardOutputStats *stats)
+{
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  stats[0] = queue->stats;
+  stats->queuedMessages = queue->count;
+  stats->queuedBytes = queue->bytes;
+
+  /* Ongoing congestion is counted up to now */
+
+  if (queue->congested)
+  {
+    stats->congestedTime += (OSSpecific_getMonotonicTime() - queue->congestedSince);
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+}
+
+/**************************************************************/
+
+VOID
+SCardOutputQueue_resetStats(
+  _Inout_ SCardOutputQueue *queue)
+{
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  queue->stats.queuedMessages = 0;
+  queue->stats.queuedBytes = 0;
+  queue->stats.peakBytes = queue->bytes;
+  queue->stats.mergedEvents = 0;
+  queue->stats.congestions = queue->congested ? 1 : 0;
+  queue->stats.congestedTime = 0;
+  queue->stats.longestWait = 0;
+
+  if (queue->congested)
+  {
+    queue->congestedSince = OSSpecific_getMonotonicTime();
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+}
+
+/**************************************************************/
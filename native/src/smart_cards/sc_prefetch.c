@@ -0,0 +1,229 @@
+/**
+ * @file "native/src/smart_cards/sc_prefetch.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+VOID
+SCardPrefetchScript_init(
+  _Out_ SCardPrefetchScript *script)
+{
+  SCardSubscription_init(&(script->filter));
+
+  script->apduCount = 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardPrefetchScript_destroy(
+  _Inout_ SCardPrefetchScript *script)
+{
+  SCardSubscription_destroy(&(script->filter));
+
+  for (size_t i = 0; i < script->apduCount; i++)
+  {
+    free(script->apdus[i]);
+  }
+
+  script->apduCount = 0;
+}
+
+/**************************************************************/
+
+BOOL
+SCardPrefetchScript_load(
+  _Out_ SCardPrefetchScript *script,
+  _In_ const JsonObject *jsonRequest)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  const JsonArray *json_array;
+  LPBYTE apdu;
+  size_t apdu_length;
+
+  script->apduCount = 0;
+
+  /* Keys "k", "r", "a" and "m" (same meaning as for subscriptions) */
+
+  test_bool = SCardSubscription_load(
+    &(script->filter),
+    jsonRequest);
+
+  if (!test_bool) { return FALSE; }
+
+  /* Key "d" (list of command APDUs) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "d");
+
+  if (!test_bool) { return TRUE; }
+
+  if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+  json_array = json_value.value;
+
+  if (json_array->count > WEBCARD_PREFETCH_MAX_APDUS) { return FALSE; }
+
+  for (size_t i = 0; i < json_array->count; i++)
+  {
+    if (JSON_VALUE_TYPE__STRING != json_array->values[i].type)
+    {
+      return FALSE;
+    }
+
+    if (0 == ((const UTF8String *) json_array->values[i].value)->length)
+    {
+      return FALSE;
+    }
+
+    test_bool = UTF8String_hexToByteArray(
+      json_array->values[i].value,
+      &(apdu_length),
+      &(apdu));
+
+    if (!test_bool || (apdu_length < 4))
+    {
+      if (NULL != apdu)
+      {
+        free(apdu);
+      }
+
+      return FALSE;
+    }
+
+    script->apdus[i] = apdu;
+    script->apduLengths[i] = apdu_length;
+    script->apduCount += 1;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardPrefetchScript_copy(
+  _Out_ SCardPrefetchScript *destination,
+  _In_ const SCardPrefetchScript *source)
+{
+  LPBYTE apdu;
+
+  SCardPrefetchScript_init(destination);
+
+  for (size_t i = 0; i < source->apduCount; i++)
+  {
+    apdu = malloc(sizeof(BYTE) * source->apduLengths[i]);
+    if (NULL == apdu) { return FALSE; }
+
+    memcpy(apdu, source->apdus[i], source->apduLengths[i]);
+
+    destination->apdus[i] = apdu;
+    destination->apduLengths[i] = source->apduLengths[i];
+    destination->apduCount += 1;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardReaderDB_installPrefetchScript(
+  _Inout_ SCardReaderDB *database,
+  _Inout_ SCardPrefetchScript *script)
+{
+  size_t byteSize;
+  SCardPrefetchScript *test_scripts;
+  const UTF8String *name = &(script->filter.clientKey);
+
+  /* Replace (or remove) existing script with the same name */
+
+  for (size_t i = 0; i < database->prefetchCount; i++)
+  {
+    if (UTF8String_matches(
+      &(database->prefetchScripts[i].filter.clientKey),
+      (NULL != name->text) ? (LPCSTR) name->text : ""))
+    {
+      SCardPrefetchScript_destroy(&(database->prefetchScripts[i]));
+
+      if (0 == script->apduCount)
+      {
+        /* Keep the order: earlier scripts take precedence */
+
+        database->prefetchCount -= 1;
+
+        memmove(
+          &(database->prefetchScripts[i]),
+          &(database->prefetchScripts[i + 1]),
+          sizeof(SCardPrefetchScript) * (database->prefetchCount - i));
+
+        SCardPrefetchScript_destroy(script);
+      }
+      else
+      {
+        database->prefetchScripts[i] = script[0];
+      }
+
+      return TRUE;
+    }
+  }
+
+  if (0 == script->apduCount)
+  {
+    /* Nothing to remove */
+    SCardPrefetchScript_destroy(script);
+    return TRUE;
+  }
+
+  /* Expand the script list */
+
+  byteSize = sizeof(SCardPrefetchScript) * (1 + database->prefetchCount);
+  test_scripts = realloc(database->prefetchScripts, byteSize);
+  if (NULL == test_scripts) { return FALSE; }
+
+  database->prefetchScripts = test_scripts;
+  database->prefetchScripts[database->prefetchCount] = script[0];
+  database->prefetchCount += 1;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+const SCardPrefetchScript *
+SCardReaderDB_findPrefetchScript(
+  _In_ const SCardReaderDB *database,
+  _In_ const size_t readerIndex)
+{
+  const SCardConnection *connection;
+
+  if (readerIndex >= (size_t) database->count)
+  {
+    return NULL;
+  }
+
+  connection = &(database->connections[readerIndex]);
+
+  for (size_t i = 0; i < database->prefetchCount; i++)
+  {
+    if (SCardSubscription_matches(
+      &(database->prefetchScripts[i].filter),
+      readerIndex,
+      WEBCARD_READER_EVENT__CARD_INSERTION,
+      connection->cardAtr,
+      connection->cardAtrLength))
+    {
+      return &(database->prefetchScripts[i]);
+    }
+  }
+
+  return NULL;
+}
+
+/**************************************************************/
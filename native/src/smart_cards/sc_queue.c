@@ -0,0 +1,938 @@
+/**
+ * @file "native/src/smart_cards/sc_queue.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+VOID
+SCardQueuedRequest_destroy(
+  _Inout_ SCardQueuedRequest *request)
+{
+  JsonObject_destroy(&(request->object));
+  JsonByteStream_destroy(&(request->stream));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Writes a response to a request that the main thread won't answer.
+ *
+ * @param[in] session Session of the request.
+ * @param[in] id Value of the "i" key of the request.
+ * @param[in] key Either "x" (with "incomplete") or "d".
+ * @param[in] value Number stored under the `key`.
+ */
+VOID
+SCardRequestQueue_answer(
+  _In_ const uint32_t session,
+  _In_z_ LPCSTR id,
+  _In_z_ LPCSTR key,
+  _In_ const int value)
+{
+  BOOL test_bool;
+  FLOAT test_float = (FLOAT) value;
+  JsonObject json_response;
+  JsonValue json_value;
+  UTF8String utf8_string;
+
+  JsonObject_init(&(json_response));
+
+  UTF8String_makeTemporary(&(utf8_string), id);
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+  json_value.value = &(utf8_string);
+
+  test_bool = JsonObject_appendKeyValue(
+    &(json_response),
+    "i",
+    &(json_value));
+
+  if (test_bool && ('x' == key[0]))
+  {
+    json_value.type = JSON_VALUE_TYPE__TRUE;
+    json_value.value = NULL;
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_response),
+      "incomplete",
+      &(json_value));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__NUMBER;
+    json_value.value = &(test_float);
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_response),
+      key,
+      &(json_value));
+  }
+
+  if (test_bool)
+  {
+    UTF8String_init(&(utf8_string));
+
+    if (JsonObject_toString(&(json_response), &(utf8_string)))
+    {
+      SCardDaemon_send(session, &(utf8_string));
+    }
+
+    UTF8String_destroy(&(utf8_string));
+  }
+
+  JsonObject_destroy(&(json_response));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Ends the running request (mutex locked): answers it right away
+ * and interrupts its blocking PC/SC call.
+ */
+VOID
+SCardRequestQueue_abortActive(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const int state)
+{
+  PCSC_LONG pcscResult;
+
+  queue->activeState = state;
+  queue->activeAnswered = TRUE;
+  queue->activeAbortTime = OSSpecific_getPreciseTime();
+
+  SCardRequestQueue_answer(queue->activeSession, queue->activeId, "x", state);
+
+  pcscResult = SCardBackend_current->cancel(queue->activeContext);
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{SCardRequestQueue} request \"%s\" %s, SCardCancel: 0x%08X",
+    queue->activeId,
+    (WEBCARD_REQUEST_STATE__TIMED_OUT == state) ? "timed out" : "cancelled",
+    (uint32_t) pcscResult);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Ends a request waiting in the queue (mutex locked).
+ */
+VOID
+SCardRequestQueue_abortQueued(
+  _Inout_ SCardRequestQueue *queue,
+  _Inout_ SCardQueuedRequest *request,
+  _In_ const int state)
+{
+  request->state = state;
+  request->answered = TRUE;
+
+  SCardRequestQueue_answer(request->session, request->id, "x", state);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Cancels the pending request with given identifier (mutex locked).
+ * Only the requests of the same session can be cancelled.
+ *
+ * @return One of `WEBCARD_CANCEL__*` values.
+ */
+int
+SCardRequestQueue_cancel(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const uint32_t session,
+  _In_z_ LPCSTR id)
+{
+  SCardQueuedRequest *request;
+
+  if (queue->busy &&
+    (WEBCARD_REQUEST_STATE__PENDING == queue->activeState) &&
+    (session == queue->activeSession) &&
+    (0 == strcmp(queue->activeId, id)))
+  {
+    SCardRequestQueue_abortActive(queue, WEBCARD_REQUEST_STATE__CANCELLED);
+
+    return WEBCARD_CANCEL__RUNNING;
+  }
+
+  for (size_t i = 0; i < queue->count; i++)
+  {
+    request = &(queue->entries[(queue->first + i) % queue->capacity]);
+
+    if ((WEBCARD_REQUEST_STATE__PENDING == request->state) &&
+      (session == request->session) &&
+      (NULL != request->id) &&
+      (0 == strcmp(request->id, id)))
+    {
+      SCardRequestQueue_abortQueued(queue, request, WEBCARD_REQUEST_STATE__CANCELLED);
+
+      return WEBCARD_CANCEL__QUEUED;
+    }
+  }
+
+  return WEBCARD_CANCEL__NOT_FOUND;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Appends a request at the end of the queue (mutex locked).
+ *
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ */
+BOOL
+SCardRequestQueue_push(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const SCardQueuedRequest *request)
+{
+  SCardQueuedRequest *entries;
+  size_t capacity;
+
+  if (queue->count == queue->capacity)
+  {
+    capacity = (0 == queue->capacity) ?
+      WEBCARD_QUEUE_INITIAL_CAPACITY :
+      (2 * queue->capacity);
+
+    entries = malloc(sizeof(SCardQueuedRequest) * capacity);
+    if (NULL == entries) { return FALSE; }
+
+    /* Unwrap the ring */
+
+    for (size_t i = 0; i < queue->count; i++)
+    {
+      entries[i] = queue->entries[(queue->first + i) % queue->capacity];
+    }
+
+    free(queue->entries);
+
+    queue->entries = entries;
+    queue->capacity = capacity;
+    queue->first = 0;
+  }
+
+  queue->entries[(queue->first + queue->count) % queue->capacity] = request[0];
+  queue->count += 1;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Removes the request at given position (mutex locked),
+ * moving the younger requests one place forward.
+ */
+VOID
+SCardRequestQueue_removeAt(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const size_t position)
+{
+  for (size_t i = position + 1; i < queue->count; i++)
+  {
+    queue->entries[(queue->first + i - 1) % queue->capacity] =
+      queue->entries[(queue->first + i) % queue->capacity];
+  }
+
+  queue->count -= 1;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Checks if the request at given position must keep waiting (mutex locked):
+ * when `filter` rejects it, or when an older request of the same client
+ * for the same reader is rejected (so that the requests keep their order).
+ */
+BOOL
+SCardRequestQueue_isHeldBack(
+  _In_ const SCardRequestQueue *queue,
+  _In_ const size_t position,
+  _In_opt_ SCardRequestFilter filter,
+  _In_opt_ const void *filterParameter)
+{
+  const SCardQueuedRequest *request;
+  const SCardQueuedRequest *older;
+
+  if (NULL == filter)
+  {
+    return FALSE;
+  }
+
+  request = &(queue->entries[(queue->first + position) % queue->capacity]);
+
+  if (!filter(request, filterParameter))
+  {
+    return TRUE;
+  }
+
+  if (WEBCARD_QUEUE_NO_READER == request->reader)
+  {
+    return FALSE;
+  }
+
+  for (size_t i = 0; i < position; i++)
+  {
+    older = &(queue->entries[(queue->first + i) % queue->capacity]);
+
+    if ((!older->answered) &&
+      (older->reader == request->reader) &&
+      (older->session == request->session) &&
+      (0 == strcmp(older->client, request->client)) &&
+      (!filter(older, filterParameter)))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Reads and parses one message from a stream (reader thread).
+ *
+ * @param[out] request Receives the request when `JSON_STREAM_STATUS__VALID`
+ * is returned.
+ * @param[in] session Session of the request.
+ * @param[in] input Standard Input, or the socket of a daemon client.
+ * @return One of `JSON_STREAM_STATUS__*` values.
+ */
+int
+SCardRequestQueue_readRequest(
+  _Out_ SCardQueuedRequest *request,
+  _In_ const uint32_t session,
+  _In_ const os_specific_stream_t input)
+{
+  BOOL test_bool;
+  int byte_stream_status;
+  JsonObject *json_object_ref;
+  JsonValue json_value;
+
+  if (!OSSpecific_waitForStream(input))
+  {
+    return JSON_STREAM_STATUS__NO_MORE;
+  }
+
+  request->arrivalTime = OSSpecific_getPreciseTime();
+
+  byte_stream_status = JsonByteStream_loadFromStream(&(request->stream), input);
+
+  if (JSON_STREAM_STATUS__VALID != byte_stream_status)
+  {
+    return byte_stream_status;
+  }
+
+  request->readTime = OSSpecific_getPreciseTime();
+  request->session = session;
+  request->id = NULL;
+  request->command = WEBCARD_COMMAND__NONE;
+  request->reader = WEBCARD_QUEUE_NO_READER;
+  request->client = "";
+  request->priority = 0;
+  request->deadline = 0;
+  request->state = WEBCARD_REQUEST_STATE__PENDING;
+  request->answered = FALSE;
+  request->blockedTime = 0;
+
+  json_object_ref = &(request->object);
+
+  test_bool = JsonObject_parse(
+    &(json_object_ref),
+    FALSE,
+    &(request->stream));
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{JSON Request} parsing error!");
+
+    SCardQueuedRequest_destroy(request);
+
+    return JSON_STREAM_STATUS__EMPTY;
+  }
+
+  /* Identifier "i" (for cancellation and early answers) */
+
+  test_bool = JsonObject_getValue(
+    &(request->object),
+    &(json_value),
+    "i");
+
+  if (test_bool && (JSON_VALUE_TYPE__STRING == json_value.type))
+  {
+    request->id = (LPCSTR) ((UTF8String *) json_value.value)->text;
+  }
+
+  /* Command "c", reader index "r", client key "k" and priority "q" */
+  /* (the order in which requests are handled depends on them) */
+
+  test_bool = JsonObject_getValue(
+    &(request->object),
+    &(json_value),
+    "c");
+
+  if (test_bool && (JSON_VALUE_TYPE__NUMBER == json_value.type))
+  {
+    request->command = (size_t) (((FLOAT *) json_value.value)[0]);
+  }
+
+  test_bool = JsonObject_getValue(
+    &(request->object),
+    &(json_value),
+    "r");
+
+  if (test_bool && (JSON_VALUE_TYPE__NUMBER == json_value.type))
+  {
+    request->reader = (size_t) (((FLOAT *) json_value.value)[0]);
+  }
+
+  test_bool = JsonObject_getValue(
+    &(request->object),
+    &(json_value),
+    "k");
+
+  if (test_bool && (JSON_VALUE_TYPE__STRING == json_value.type))
+  {
+    request->client = (LPCSTR) ((UTF8String *) json_value.value)->text;
+  }
+
+  test_bool = JsonObject_getValue(
+    &(request->object),
+    &(json_value),
+    "q");
+
+  if (test_bool && (JSON_VALUE_TYPE__NUMBER == json_value.type))
+  {
+    request->priority = (int) (((FLOAT *) json_value.value)[0]);
+  }
+
+  /* Optional deadline "t", in milliseconds since the message arrived */
+  /* (only requests that can be answered) */
+
+  test_bool = JsonObject_getValue(
+    &(request->object),
+    &(json_value),
+    "t");
+
+  if (test_bool &&
+    (NULL != request->id) &&
+    (JSON_VALUE_TYPE__NUMBER == json_value.type) &&
+    (((FLOAT *) json_value.value)[0] > 0))
+  {
+    request->deadline = request->arrivalTime +
+      (uint64_t) (((FLOAT *) json_value.value)[0] * 1000000);
+  }
+
+  return JSON_STREAM_STATUS__VALID;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Checks if a request is the Cancel command, returning its target.
+ *
+ * @return Identifier of the request to cancel, or `NULL`.
+ */
+LPCSTR
+SCardRequestQueue_getCancelTarget(
+  _In_ const SCardQueuedRequest *request)
+{
+  if ((NULL == request->id) ||
+    (WEBCARD_COMMAND__CANCEL != request->command))
+  {
+    return NULL;
+  }
+
+  return request->client;
+}
+
+/**************************************************************/
+
+int
+SCardRequestQueue_receive(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const uint32_t session,
+  _In_ const os_specific_stream_t input)
+{
+  SCardQueuedRequest request;
+  LPCSTR cancel_target;
+  int byte_stream_status;
+  int cancel_result;
+  BOOL test_bool;
+
+  byte_stream_status = SCardRequestQueue_readRequest(&(request), session, input);
+
+  if (JSON_STREAM_STATUS__VALID != byte_stream_status)
+  {
+    return byte_stream_status;
+  }
+
+  cancel_target = SCardRequestQueue_getCancelTarget(&(request));
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  if (NULL != cancel_target)
+  {
+    cancel_result = SCardRequestQueue_cancel(queue, session, cancel_target);
+    test_bool = TRUE;
+  }
+  else
+  {
+    test_bool = SCardRequestQueue_push(queue, &(request));
+
+    /* The watchdog might need to wake up earlier */
+
+    if (test_bool && (0 != request.deadline))
+    {
+      OSSpecific_broadcastCondition(&(queue->changed));
+    }
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  if (NULL != cancel_target)
+  {
+    SCardRequestQueue_answer(session, request.id, "d", cancel_result);
+    SCardQueuedRequest_destroy(&(request));
+  }
+  else if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{SCardRequestQueue::push} memory allocation failed!");
+
+    SCardQueuedRequest_destroy(&(request));
+  }
+
+  return JSON_STREAM_STATUS__VALID;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Body of the reader thread: reads requests until STDIN is closed.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(SCardRequestQueue_runReader)
+{
+  SCardRequestQueue *queue = (SCardRequestQueue *) parameter;
+  os_specific_stream_t stdin_stream;
+  int byte_stream_status;
+
+  #if defined(_WIN32)
+  {
+    stdin_stream = GetStdHandle(STD_INPUT_HANDLE);
+  }
+  #elif defined(__linux__) || defined(__APPLE__)
+  {
+    stdin_stream = STDIN_FILENO;
+  }
+  #endif
+
+  while (TRUE)
+  {
+    byte_stream_status = SCardRequestQueue_receive(
+      queue,
+      WEBCARD_SESSION__STANDARD_IO,
+      stdin_stream);
+
+    if (JSON_STREAM_STATUS__NO_MORE == byte_stream_status)
+    {
+      break;
+    }
+    else if (JSON_STREAM_STATUS__VALID != byte_stream_status)
+    {
+      /* Invalid JSON, or nothing to read after all */
+      /* (avoids spinning if the wait returned at once) */
+      OSSpecific_sleep(WEBCARD_QUEUE_IDLE_INTERVAL);
+    }
+  }
+
+  OSSpecific_lockMutex(&(queue->mutex));
+  queue->closed = TRUE;
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return 0;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardRequestQueue` object.
+ * Body of the watchdog thread: answers the expired requests as soon
+ * as their deadlines pass, even when the main thread is blocked.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(SCardRequestQueue_runWatchdog)
+{
+  SCardRequestQueue *queue = (SCardRequestQueue *) parameter;
+  SCardQueuedRequest *request;
+  uint64_t now;
+  uint64_t next_deadline;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  while (!queue->stopping)
+  {
+    now = OSSpecific_getPreciseTime();
+    next_deadline = UINT64_MAX;
+
+    if (queue->busy &&
+      (WEBCARD_REQUEST_STATE__PENDING == queue->activeState) &&
+      (0 != queue->activeDeadline))
+    {
+      if (now >= queue->activeDeadline)
+      {
+        SCardRequestQueue_abortActive(queue, WEBCARD_REQUEST_STATE__TIMED_OUT);
+      }
+      else
+      {
+        next_deadline = queue->activeDeadline;
+      }
+    }
+
+    for (size_t i = 0; i < queue->count; i++)
+    {
+      request = &(queue->entries[(queue->first + i) % queue->capacity]);
+
+      if ((WEBCARD_REQUEST_STATE__PENDING != request->state) ||
+        (0 == request->deadline))
+      {
+        continue;
+      }
+
+      if (now >= request->deadline)
+      {
+        SCardRequestQueue_abortQueued(queue, request, WEBCARD_REQUEST_STATE__TIMED_OUT);
+      }
+      else if (request->deadline < next_deadline)
+      {
+        next_deadline = request->deadline;
+      }
+    }
+
+    OSSpecific_waitCondition(
+      &(queue->changed),
+      &(queue->mutex),
+      (UINT64_MAX == next_deadline) ? UINT64_MAX : (next_deadline - now));
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardRequestQueue_init(
+  _Out_ SCardRequestQueue *queue)
+{
+  OSSpecific_initMutex(&(queue->mutex));
+  OSSpecific_initCondition(&(queue->changed));
+
+  queue->entries = NULL;
+  queue->capacity = 0;
+  queue->first = 0;
+  queue->count = 0;
+
+  queue->busy = FALSE;
+  queue->activeSession = WEBCARD_SESSION__STANDARD_IO;
+  queue->activeId = NULL;
+  queue->activeDeadline = 0;
+  queue->activeState = WEBCARD_REQUEST_STATE__PENDING;
+  queue->activeAnswered = FALSE;
+  queue->activeContext = 0;
+  queue->activeAbortTime = 0;
+
+  queue->closed = FALSE;
+  queue->stopping = FALSE;
+
+  queue->readerStarted = FALSE;
+  queue->watchdogStarted = FALSE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardRequestQueue_start(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const BOOL readStandardInput)
+{
+  queue->watchdogStarted = OSSpecific_startThread(
+    &(queue->watchdogThread),
+    SCardRequestQueue_runWatchdog,
+    queue);
+
+  if ((!queue->watchdogStarted) || (!readStandardInput))
+  {
+    return queue->watchdogStarted;
+  }
+
+  queue->readerStarted = OSSpecific_startThread(
+    &(queue->readerThread),
+    SCardRequestQueue_runReader,
+    queue);
+
+  return queue->readerStarted;
+}
+
+/**************************************************************/
+
+VOID
+SCardRequestQueue_destroy(
+  _Inout_ SCardRequestQueue *queue)
+{
+  BOOL closed;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+  queue->stopping = TRUE;
+  closed = queue->closed;
+  OSSpecific_broadcastCondition(&(queue->changed));
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  if (queue->watchdogStarted)
+  {
+    OSSpecific_joinThread(queue->watchdogThread);
+    queue->watchdogStarted = FALSE;
+  }
+
+  if (queue->readerStarted)
+  {
+    if (!closed)
+    {
+      /* Blocked on STDIN: the queue is leaked on purpose */
+      return;
+    }
+
+    OSSpecific_joinThread(queue->readerThread);
+    queue->readerStarted = FALSE;
+  }
+
+  for (size_t i = 0; i < queue->count; i++)
+  {
+    SCardQueuedRequest_destroy(
+      &(queue->entries[(queue->first + i) % queue->capacity]));
+  }
+
+  free(queue->entries);
+
+  queue->entries = NULL;
+  queue->capacity = 0;
+  queue->count = 0;
+
+  OSSpecific_destroyCondition(&(queue->changed));
+  OSSpecific_destroyMutex(&(queue->mutex));
+}
+
+/**************************************************************/
+
+int
+SCardRequestQueue_pop(
+  _Inout_ SCardRequestQueue *queue,
+  _In_opt_ SCardRequestFilter filter,
+  _In_opt_ const void *filterParameter,
+  _Out_ SCardQueuedRequest *request)
+{
+  int result = JSON_STREAM_STATUS__EMPTY;
+  size_t i = 0;
+  size_t best = SIZE_MAX;
+  SCardQueuedRequest *entry;
+  const uint64_t now = OSSpecific_getPreciseTime();
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  while (i < queue->count)
+  {
+    entry = &(queue->entries[(queue->first + i) % queue->capacity]);
+
+    if (entry->answered)
+    {
+      /* Expired or cancelled while waiting (already answered) */
+
+      SCardQueuedRequest_destroy(entry);
+      SCardRequestQueue_removeAt(queue, i);
+      continue;
+    }
+
+    if (SCardRequestQueue_isHeldBack(queue, i, filter, filterParameter))
+    {
+      if (0 == entry->blockedTime)
+      {
+        entry->blockedTime = now;
+      }
+    }
+    else if ((SIZE_MAX == best) || (entry->priority >
+      queue->entries[(queue->first + best) % queue->capacity].priority))
+    {
+      best = i;
+    }
+
+    i += 1;
+  }
+
+  if (SIZE_MAX != best)
+  {
+    request[0] = queue->entries[(queue->first + best) % queue->capacity];
+    SCardRequestQueue_removeAt(queue, best);
+
+    result = JSON_STREAM_STATUS__VALID;
+  }
+  else if (queue->closed)
+  {
+    /* Requests still held back would never be released */
+
+    result = JSON_STREAM_STATUS__NO_MORE;
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return result;
+}
+
+/**************************************************************/
+
+size_t
+SCardRequestQueue_cancelClient(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const uint32_t session,
+  _In_opt_ LPCSTR client)
+{
+  size_t cancelled = 0;
+  SCardQueuedRequest *request;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  for (size_t i = 0; i < queue->count; i++)
+  {
+    request = &(queue->entries[(queue->first + i) % queue->capacity]);
+
+    if ((WEBCARD_REQUEST_STATE__PENDING == request->state) &&
+      (session == request->session) &&
+      ((NULL == client) || ((WEBCARD_QUEUE_NO_READER != request->reader) &&
+      (0 == strcmp(request->client, client)))))
+    {
+      SCardRequestQueue_abortQueued(queue, request, WEBCARD_REQUEST_STATE__CANCELLED);
+      cancelled += 1;
+    }
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return cancelled;
+}
+
+/**************************************************************/
+
+BOOL
+SCardRequestQueue_begin(
+  _Inout_ SCardRequestQueue *queue,
+  _Inout_ SCardQueuedRequest *request,
+  _In_ const SCARDCONTEXT context)
+{
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  if ((WEBCARD_REQUEST_STATE__PENDING == request->state) &&
+    (0 != request->deadline) &&
+    (OSSpecific_getPreciseTime() >= request->deadline))
+  {
+    /* Expired before the watchdog noticed (answered by the caller) */
+
+    request->state = WEBCARD_REQUEST_STATE__TIMED_OUT;
+  }
+
+  if (WEBCARD_REQUEST_STATE__PENDING == request->state)
+  {
+    queue->busy = TRUE;
+    queue->activeSession = request->session;
+    queue->activeId = request->id;
+    queue->activeDeadline = request->deadline;
+    queue->activeState = WEBCARD_REQUEST_STATE__PENDING;
+    queue->activeAnswered = FALSE;
+    queue->activeContext = context;
+    queue->activeAbortTime = 0;
+
+    if (0 != queue->activeDeadline)
+    {
+      OSSpecific_broadcastCondition(&(queue->changed));
+    }
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return (WEBCARD_REQUEST_STATE__PENDING == request->state);
+}
+
+/**************************************************************/
+
+BOOL
+SCardRequestQueue_isAborted(
+  _Inout_ SCardRequestQueue *queue)
+{
+  BOOL aborted;
+
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  aborted = queue->busy &&
+    (WEBCARD_REQUEST_STATE__PENDING != queue->activeState);
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return aborted;
+}
+
+/**************************************************************/
+
+BOOL
+SCardRequestQueue_finish(
+  _Inout_ SCardRequestQueue *queue,
+  _Inout_ SCardQueuedRequest *request)
+{
+  OSSpecific_lockMutex(&(queue->mutex));
+
+  if (queue->busy)
+  {
+    request->state = queue->activeState;
+    request->answered = queue->activeAnswered;
+
+    /* The client got its answer, but the reader (and every other */
+    /* request) had to wait for the card all the same */
+
+    if (0 != queue->activeAbortTime)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{SCardRequestQueue} request \"%s\" kept the main loop " \
+        "blocked for %u ms after it was answered",
+        queue->activeId,
+        (uint32_t) ((OSSpecific_getPreciseTime() - queue->activeAbortTime) / 1000000));
+
+      queue->activeAbortTime = 0;
+    }
+
+    queue->busy = FALSE;
+    queue->activeId = NULL;
+    queue->activeDeadline = 0;
+  }
+
+  OSSpecific_unlockMutex(&(queue->mutex));
+
+  return !(request->answered);
+}
+
+/**************************************************************/
@@ -0,0 +1,198 @@
+/**
+ * @file "native/src/smart_cards/sc_recovery.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+VOID
+SCardRecovery_init(
+  _Out_ SCardRecovery *recovery)
+{
+  memset(recovery, 0x00, sizeof(SCardRecovery));
+
+  recovery->state = WEBCARD_RECOVERY__READY;
+  recovery->serviceAvailable = TRUE;
+
+  /* Processes started together should not retry in lockstep */
+
+  recovery->jitter = (uint32_t) OSSpecific_getPreciseTime() | 1;
+}
+
+/**************************************************************/
+
+BOOL
+SCardRecovery_isContextLost(
+  _In_ const PCSC_LONG pcscResult)
+{
+  switch (pcscResult)
+  {
+    /* Windows: last reader unplugged, or service stopped */
+    case SCARD_E_SERVICE_STOPPED:
+
+    /* PCSC Lite: "pcscd" not running */
+    case SCARD_E_NO_SERVICE:
+
+    /* PCSC Lite: "pcscd" restarted, old context is unknown to it */
+    case SCARD_E_INVALID_HANDLE:
+    {
+      return TRUE;
+    }
+
+    default:
+    {
+      return FALSE;
+    }
+  }
+}
+
+/**************************************************************/
+
+VOID
+SCardRecovery_lose(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now)
+{
+  recovery->state = WEBCARD_RECOVERY__LOST;
+  recovery->lostSince = now;
+  recovery->nextAttempt = now;
+  recovery->lastProbe = now;
+  recovery->attempts = 0;
+  recovery->serviceAvailable = SCardBackend_current->isServiceAvailable();
+
+  recovery->outages += 1;
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__WARNING,
+    "{SCardRecovery} Smart Card Context lost (service %s)",
+    recovery->serviceAvailable ? "running" : "stopped");
+}
+
+/**************************************************************/
+
+BOOL
+SCardRecovery_isAttemptDue(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now)
+{
+  BOOL available;
+
+  if (WEBCARD_RECOVERY__LOST != recovery->state)
+  {
+    return FALSE;
+  }
+
+  if (now >= recovery->nextAttempt)
+  {
+    return TRUE;
+  }
+
+  if ((now - recovery->lastProbe) < WEBCARD_RECOVERY_PROBE_INTERVAL)
+  {
+    return FALSE;
+  }
+
+  recovery->lastProbe = now;
+
+  /* Fast path: no need to wait once the service is back */
+
+  available = SCardBackend_current->isServiceAvailable();
+
+  if (available && !(recovery->serviceAvailable))
+  {
+    recovery->serviceAvailable = TRUE;
+    recovery->fastAttempts += 1;
+
+    return TRUE;
+  }
+
+  recovery->serviceAvailable = available;
+
+  return FALSE;
+}
+
+/**************************************************************/
+
+VOID
+SCardRecovery_fail(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now)
+{
+  uint32_t delay = WEBCARD_RECOVERY_MAX_DELAY;
+  uint32_t x = recovery->jitter;
+
+  if (recovery->attempts < 16)
+  {
+    delay = ((uint32_t) WEBCARD_RECOVERY_FIRST_DELAY) << recovery->attempts;
+
+    if (delay > WEBCARD_RECOVERY_MAX_DELAY)
+    {
+      delay = WEBCARD_RECOVERY_MAX_DELAY;
+    }
+  }
+
+  recovery->attempts += 1;
+  recovery->failedAttempts += 1;
+
+  /* "Equal jitter": half of the delay, plus a random part of the other half */
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  recovery->jitter = x;
+
+  recovery->nextAttempt = now + (delay / 2) + (x % ((delay / 2) + 1));
+
+  /* Service probes tell when to try earlier */
+
+  recovery->lastProbe = now;
+  recovery->serviceAvailable = SCardBackend_current->isServiceAvailable();
+}
+
+/**************************************************************/
+
+VOID
+SCardRecovery_succeed(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now)
+{
+  const uint64_t elapsed = now - recovery->lostSince;
+
+  if (WEBCARD_RECOVERY__LOST != recovery->state)
+  {
+    return;
+  }
+
+  recovery->state = WEBCARD_RECOVERY__READY;
+  recovery->serviceAvailable = TRUE;
+
+  recovery->lastRecoveryTime = elapsed;
+
+  if (elapsed > recovery->longestRecoveryTime)
+  {
+    recovery->longestRecoveryTime = elapsed;
+  }
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{SCardRecovery} Smart Card Context re-established after %u ms (%u failed attempts)",
+    (uint32_t) elapsed,
+    recovery->attempts);
+}
+
+/**************************************************************/
+
+VOID
+SCardRecovery_resetCounters(
+  _Inout_ SCardRecovery *recovery)
+{
+  recovery->outages = 0;
+  recovery->failedAttempts = 0;
+  recovery->fastAttempts = 0;
+  recovery->lastRecoveryTime = 0;
+  recovery->longestRecoveryTime = 0;
+}
+
+/**************************************************************/
@@ -0,0 +1,2194 @@
+/**
+ * @file "native/src/smart_cards/sc_simulator.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+/**
+ * The reader farm of the simulated backend
+ * (PC/SC functions don't carry any user data).
+ */
+static SCardSimulator SCardSimulator_farm;
+
+/** Marker for missing optional latencies. */
+#define WEBCARD_SIM_LATENCY__CARD  UINT32_MAX
+
+/** Poll interval of a blocking `getStatusChange` call, in microseconds. */
+#define WEBCARD_SIM_POLL_INTERVAL  10000
+
+/** Most readers of one `getStatusChange` call ("PCSCLITE_MAX_READERS_CONTEXTS"). */
+#define WEBCARD_SIM_MAX_READER_STATES  16
+
+/**
+ * Incremented by every `cancel` call (from any thread): blocking calls
+ * that started before it return `SCARD_E_CANCELLED`.
+ */
+static os_specific_atomic_t SCardSimulator_cancelCount;
+
+/**
+ * Protects the state of the simulated readers and cards: worker threads
+ * (production-line jobs, fan-out) use the backend together with the main
+ * thread. Card processing time is simulated without holding it.
+ */
+static os_specific_mutex_t SCardSimulator_mutex = OS_SPECIFIC_MUTEX_INITIALIZER;
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Reads an optional non-negative number.
+ *
+ * @param[in] object Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[in] key Key of the number.
+ * @param[in,out] valueRef Receives the number. Left unchanged
+ * if the key is missing (default value).
+ * @return `FALSE` if the value is not a non-negative number, otherwise `TRUE`.
+ */
+BOOL
+SCardSimulator_loadNumber(
+  _In_ const JsonObject *object,
+  _In_ LPCSTR key,
+  _Inout_ uint64_t *valueRef)
+{
+  JsonValue json_value;
+  FLOAT test_float;
+
+  if (!JsonObject_getValue(object, &(json_value), key))
+  {
+    return TRUE;
+  }
+
+  if (JSON_VALUE_TYPE__NUMBER != json_value.type) { return FALSE; }
+
+  test_float = ((FLOAT *) json_value.value)[0];
+  if (test_float < 0) { return FALSE; }
+
+  valueRef[0] = (uint64_t) test_float;
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Decodes an optional hex-string.
+ *
+ * @param[in] object Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[in] key Key of the hex-string.
+ * @param[out] bytesRef Receives a dynamically allocated byte array
+ * (`NULL` if the key is missing or the string is empty).
+ * @param[out] lengthRef Receives the number of decoded bytes.
+ * @return `FALSE` on invalid hex-string OR on memory allocation failure.
+ */
+BOOL
+SCardSimulator_loadHex(
+  _In_ const JsonObject *object,
+  _In_ LPCSTR key,
+  _Out_ LPBYTE *bytesRef,
+  _Out_ size_t *lengthRef)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  const UTF8String *hex_string;
+
+  bytesRef[0] = NULL;
+  lengthRef[0] = 0;
+
+  if (!JsonObject_getValue(object, &(json_value), key))
+  {
+    return TRUE;
+  }
+
+  if (JSON_VALUE_TYPE__STRING != json_value.type) { return FALSE; }
+
+  hex_string = json_value.value;
+
+  if (0 == hex_string->length) { return TRUE; }
+  if (0 != (hex_string->length % 2)) { return FALSE; }
+
+  test_bool = UTF8String_hexToByteArray(
+    hex_string,
+    lengthRef,
+    bytesRef);
+
+  if (!test_bool)
+  {
+    if (NULL != bytesRef[0])
+    {
+      free(bytesRef[0]);
+      bytesRef[0] = NULL;
+    }
+
+    lengthRef[0] = 0;
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Decodes an optional hex-string into a fixed-size buffer.
+ *
+ * @param[in] object Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[in] key Key of the hex-string.
+ * @param[out] output Buffer of `capacity` bytes.
+ * @param[in] capacity Size of the `output` buffer.
+ * @param[out] lengthRef Receives the number of decoded bytes.
+ * @return `FALSE` on invalid or too long hex-string
+ * OR on memory allocation failure.
+ */
+BOOL
+SCardSimulator_loadHexBuffer(
+  _In_ const JsonObject *object,
+  _In_ LPCSTR key,
+  _Out_ BYTE *output,
+  _In_ const size_t capacity,
+  _Out_ size_t *lengthRef)
+{
+  LPBYTE bytes;
+  size_t length;
+
+  lengthRef[0] = 0;
+
+  if (!SCardSimulator_loadHex(object, key, &(bytes), &(length)))
+  {
+    return FALSE;
+  }
+
+  if (NULL == bytes) { return TRUE; }
+
+  if (length <= capacity)
+  {
+    memcpy(output, bytes, length);
+    lengthRef[0] = length;
+  }
+
+  free(bytes);
+
+  return (0 != lengthRef[0]);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Finds a card definition by name.
+ *
+ * @param[in] name Reference to a VALID and CONSTANT `UTF8String` object.
+ * @return Index of the card definition, or `SIZE_MAX` if not found.
+ */
+size_t
+SCardSimulator_findCard(
+  _In_ const UTF8String *name)
+{
+  for (size_t i = 0; i < SCardSimulator_farm.cardCount; i++)
+  {
+    if (UTF8String_matches(
+      &(SCardSimulator_farm.cards[i].name),
+      (NULL != name->text) ? (LPCSTR) name->text : ""))
+    {
+      return i;
+    }
+  }
+
+  return SIZE_MAX;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Reads the "card" key of a reader or of a timeline step.
+ *
+ * @param[in] object Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[out] cardIndexRef Receives the card index, `SIZE_MAX` for
+ * an empty string (card removed) or for a missing key.
+ * @return `FALSE` if the card is not defined, otherwise `TRUE`.
+ */
+BOOL
+SCardSimulator_loadCardName(
+  _In_ const JsonObject *object,
+  _Out_ size_t *cardIndexRef)
+{
+  JsonValue json_value;
+
+  cardIndexRef[0] = SIZE_MAX;
+
+  if (!JsonObject_getValue(object, &(json_value), "card"))
+  {
+    return TRUE;
+  }
+
+  if (JSON_VALUE_TYPE__STRING != json_value.type) { return FALSE; }
+
+  if (0 == ((const UTF8String *) json_value.value)->length)
+  {
+    return TRUE;
+  }
+
+  cardIndexRef[0] = SCardSimulator_findCard(json_value.value);
+
+  return (SIZE_MAX != cardIndexRef[0]);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimCard` object.
+ * Releases the card definition.
+ */
+VOID
+SCardSimCard_destroy(
+  _Inout_ SCardSimCard *card)
+{
+  UTF8String_destroy(&(card->name));
+
+  for (size_t i = 0; i < card->responseCount; i++)
+  {
+    free(card->responses[i].command);
+    free(card->responses[i].response);
+  }
+
+  if (NULL != card->responses)
+  {
+    free(card->responses);
+  }
+
+  for (size_t i = 0; i < card->fileCount; i++)
+  {
+    if (NULL != card->files[i].data)
+    {
+      free(card->files[i].data);
+    }
+  }
+
+  if (NULL != card->files)
+  {
+    free(card->files);
+  }
+
+  if (NULL != card->memory.data)
+  {
+    free(card->memory.data);
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimCard` object.
+ * Loads the fixed responses ("responses" array).
+ */
+BOOL
+SCardSimCard_loadResponses(
+  _Inout_ SCardSimCard *card,
+  _In_ const JsonArray *jsonResponses)
+{
+  BOOL test_bool;
+  uint64_t latency;
+  const JsonObject *json_object;
+  SCardSimResponse *response;
+
+  if (0 == jsonResponses->count) { return TRUE; }
+
+  card->responses = calloc(jsonResponses->count, sizeof(SCardSimResponse));
+  if (NULL == card->responses) { return FALSE; }
+
+  for (size_t i = 0; i < jsonResponses->count; i++)
+  {
+    if (JSON_VALUE_TYPE__OBJECT != jsonResponses->values[i].type)
+    {
+      return FALSE;
+    }
+
+    json_object = jsonResponses->values[i].value;
+    response = &(card->responses[i]);
+    card->responseCount += 1;
+
+    test_bool = SCardSimulator_loadHex(
+      json_object,
+      "command",
+      &(response->command),
+      &(response->commandLength));
+
+    if (!test_bool || (response->commandLength < 4)) { return FALSE; }
+
+    test_bool = SCardSimulator_loadHex(
+      json_object,
+      "response",
+      &(response->response),
+      &(response->responseLength));
+
+    if (!test_bool || (response->responseLength < 2)) { return FALSE; }
+
+    latency = WEBCARD_SIM_LATENCY__CARD;
+
+    if (!SCardSimulator_loadNumber(json_object, "latency", &(latency)))
+    {
+      return FALSE;
+    }
+
+    response->latency = (latency < UINT32_MAX) ?
+      (uint32_t) latency :
+      WEBCARD_SIM_LATENCY__CARD;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimCard` object.
+ * Loads the transparent files of an ISO 7816-4 card ("files" array).
+ */
+BOOL
+SCardSimCard_loadFiles(
+  _Inout_ SCardSimCard *card,
+  _In_ const JsonArray *jsonFiles)
+{
+  BOOL test_bool;
+  const JsonObject *json_object;
+  SCardSimFile *file;
+
+  if (0 == jsonFiles->count) { return TRUE; }
+
+  card->files = calloc(jsonFiles->count, sizeof(SCardSimFile));
+  if (NULL == card->files) { return FALSE; }
+
+  for (size_t i = 0; i < jsonFiles->count; i++)
+  {
+    if (JSON_VALUE_TYPE__OBJECT != jsonFiles->values[i].type)
+    {
+      return FALSE;
+    }
+
+    json_object = jsonFiles->values[i].value;
+    file = &(card->files[i]);
+    card->fileCount += 1;
+
+    /* File ID (2 bytes) or AID (up to 16 bytes) */
+
+    test_bool = SCardSimulator_loadHexBuffer(
+      json_object,
+      "id",
+      file->id,
+      sizeof(file->id),
+      &(file->idLength));
+
+    if (!test_bool || (file->idLength < 2)) { return FALSE; }
+
+    test_bool = SCardSimulator_loadHex(
+      json_object,
+      "data",
+      &(file->data),
+      &(file->length));
+
+    if (!test_bool) { return FALSE; }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimCard` object.
+ * Loads a card definition.
+ *
+ * @param[out] card Reference to an UNINITIALIZED `SCardSimCard` object.
+ * @param[in] jsonCard Reference to a VALID and CONSTANT `JsonObject` object.
+ * @return `TRUE` on success, `FALSE` on invalid description
+ * OR on memory allocation failure.
+ *
+ * @note After this call, `card` will hold a VALID (at least
+ * initialized) object, which shall be destroyed.
+ */
+BOOL
+SCardSimCard_load(
+  _Out_ SCardSimCard *card,
+  _In_ const JsonObject *jsonCard)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  uint64_t number;
+
+  memset(card, 0x00, sizeof(SCardSimCard));
+  UTF8String_init(&(card->name));
+
+  card->model = WEBCARD_SIM_MODEL__STATIC;
+  card->protocol = SCARD_PROTOCOL_T1;
+  card->blockSize = 4;
+
+  /* Name and Answer To Reset are required */
+
+  test_bool = JsonObject_getValue(jsonCard, &(json_value), "name");
+
+  if (!test_bool || (JSON_VALUE_TYPE__STRING != json_value.type))
+  {
+    return FALSE;
+  }
+
+  if (!UTF8String_copy(&(card->name), json_value.value)) { return FALSE; }
+
+  test_bool = SCardSimulator_loadHexBuffer(
+    jsonCard,
+    "atr",
+    card->atr,
+    WEBCARD_ATR_MAX_SIZE,
+    &(card->atrLength));
+
+  if (!test_bool || (0 == card->atrLength)) { return FALSE; }
+
+  /* Protocol (0 for T=0, 1 for T=1) and timing */
+
+  number = 1;
+
+  if (!SCardSimulator_loadNumber(jsonCard, "protocol", &(number)))
+  {
+    return FALSE;
+  }
+
+  if (number > 1) { return FALSE; }
+
+  card->protocol = (0 == number) ? SCARD_PROTOCOL_T0 : SCARD_PROTOCOL_T1;
+
+  number = 0;
+
+  if (!SCardSimulator_loadNumber(jsonCard, "latency", &(number)) ||
+    (number >= UINT32_MAX))
+  {
+    return FALSE;
+  }
+
+  card->latency = (uint32_t) number;
+
+  /* Unique identifier ("FF CA 00 00" pseudo-APDU) */
+
+  test_bool = SCardSimulator_loadHexBuffer(
+    jsonCard,
+    "uid",
+    card->uid,
+    WEBCARD_CARD_SERIAL_MAX_SIZE,
+    &(card->uidLength));
+
+  if (!test_bool) { return FALSE; }
+
+  /* Fixed responses */
+
+  if (JsonObject_getValue(jsonCard, &(json_value), "responses"))
+  {
+    if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+    if (!SCardSimCard_loadResponses(card, json_value.value)) { return FALSE; }
+  }
+
+  /* Card model: ISO 7816-4 files or memory blocks */
+
+  if (JsonObject_getValue(jsonCard, &(json_value), "files"))
+  {
+    if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+    if (!SCardSimCard_loadFiles(card, json_value.value)) { return FALSE; }
+
+    card->model = WEBCARD_SIM_MODEL__ISO7816;
+  }
+
+  test_bool = SCardSimulator_loadHex(
+    jsonCard,
+    "memory",
+    &(card->memory.data),
+    &(card->memory.length));
+
+  if (!test_bool) { return FALSE; }
+
+  if (NULL != card->memory.data)
+  {
+    if (WEBCARD_SIM_MODEL__STATIC != card->model) { return FALSE; }
+
+    card->model = WEBCARD_SIM_MODEL__MEMORY;
+
+    number = card->blockSize;
+
+    if (!SCardSimulator_loadNumber(jsonCard, "block", &(number)) ||
+      (0 == number) || (number > 256))
+    {
+      return FALSE;
+    }
+
+    card->blockSize = (size_t) number;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimReader` object.
+ * Loads one (possibly replicated) reader.
+ *
+ * @param[out] reader Reference to an UNINITIALIZED `SCardSimReader` object.
+ * @param[in] jsonReader Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[in] name Reader name (already with the replica number).
+ * @param[in] replica Zero-based replica number (for the "stagger" delay).
+ * @return `TRUE` on success, `FALSE` on invalid description
+ * OR on memory allocation failure.
+ *
+ * @note After this call, `reader` will hold a VALID (at least
+ * initialized) object, which shall be destroyed.
+ */
+BOOL
+SCardSimReader_load(
+  _Out_ SCardSimReader *reader,
+  _In_ const JsonObject *jsonReader,
+  _In_ const UTF8String *name,
+  _In_ const size_t replica)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  const JsonArray *json_timeline;
+  const JsonObject *json_step;
+  uint64_t stagger = 0;
+
+  memset(reader, 0x00, sizeof(SCardSimReader));
+
+  reader->initialCard = SIZE_MAX;
+  reader->cardIndex = SIZE_MAX;
+  reader->selectedFile = SIZE_MAX;
+
+  /* Reader name as a generic-text (ASCII names only) */
+
+  reader->name = malloc(sizeof(TCHAR) * (1 + name->length));
+  if (NULL == reader->name) { return FALSE; }
+
+  for (size_t i = 0; i < name->length; i++)
+  {
+    if (0x80 & name->text[i]) { return FALSE; }
+
+    reader->name[i] = (TCHAR) name->text[i];
+  }
+
+  reader->name[name->length] = 0;
+
+  /* Card in the reader before the timeline starts */
+
+  if (!SCardSimulator_loadCardName(jsonReader, &(reader->initialCard)))
+  {
+    return FALSE;
+  }
+
+  test_bool =
+    SCardSimulator_loadNumber(jsonReader, "period", &(reader->period)) &&
+    SCardSimulator_loadNumber(jsonReader, "stagger", &(stagger)) &&
+    SCardSimulator_loadNumber(jsonReader, "resets", &(reader->resetPeriod));
+
+  if (!test_bool) { return FALSE; }
+
+  reader->offset = stagger * replica;
+
+  /* Timeline of card insertions and removals */
+
+  if (!JsonObject_getValue(jsonReader, &(json_value), "timeline"))
+  {
+    return TRUE;
+  }
+
+  if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+  json_timeline = json_value.value;
+
+  if (0 == json_timeline->count) { return TRUE; }
+
+  reader->events = malloc(sizeof(SCardSimEvent) * json_timeline->count);
+  if (NULL == reader->events) { return FALSE; }
+
+  for (size_t i = 0; i < json_timeline->count; i++)
+  {
+    if (JSON_VALUE_TYPE__OBJECT != json_timeline->values[i].type)
+    {
+      return FALSE;
+    }
+
+    json_step = json_timeline->values[i].value;
+
+    reader->events[i].at = 0;
+
+    test_bool =
+      SCardSimulator_loadNumber(json_step, "at", &(reader->events[i].at)) &&
+      SCardSimulator_loadCardName(json_step, &(reader->events[i].cardIndex));
+
+    if (!test_bool) { return FALSE; }
+
+    /* Steps must be sorted (and fit in the period) */
+
+    if ((i > 0) && (reader->events[i].at < reader->events[i - 1].at))
+    {
+      return FALSE;
+    }
+
+    if ((reader->period > 0) && (reader->events[i].at >= reader->period))
+    {
+      return FALSE;
+    }
+
+    reader->eventCount += 1;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimReader` object.
+ * Releases the reader.
+ */
+VOID
+SCardSimReader_destroy(
+  _Inout_ SCardSimReader *reader)
+{
+  if (NULL != reader->name)
+  {
+    free(reader->name);
+  }
+
+  if (NULL != reader->events)
+  {
+    free(reader->events);
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimReader` object.
+ * Plays the timeline up to the current time.
+ *
+ * @param[in,out] reader Reference to a VALID `SCardSimReader` object.
+ * @param[in] now Current monotonic time (in milliseconds).
+ */
+VOID
+SCardSimReader_update(
+  _Inout_ SCardSimReader *reader,
+  _In_ const uint64_t now)
+{
+  uint64_t elapsed;
+  uint64_t position;
+  uint64_t resets;
+  size_t card_index = reader->initialCard;
+
+  /* Another application resetting the card now and then */
+
+  if ((reader->resetPeriod > 0) && (now >= SCardSimulator_farm.startTime))
+  {
+    resets = (now - SCardSimulator_farm.startTime) / reader->resetPeriod;
+
+    if (resets != reader->resetCounter)
+    {
+      reader->resetCounter = resets;
+      reader->selectedFile = SIZE_MAX;
+    }
+  }
+
+  if ((reader->eventCount > 0) &&
+    (now >= SCardSimulator_farm.startTime + reader->offset))
+  {
+    elapsed = now - SCardSimulator_farm.startTime - reader->offset;
+    position = (reader->period > 0) ? (elapsed % reader->period) : elapsed;
+
+    if (elapsed != position)
+    {
+      /* Periodic timeline: start where the previous period ended */
+      card_index = reader->events[reader->eventCount - 1].cardIndex;
+    }
+
+    for (size_t i = 0;
+      (i < reader->eventCount) && (reader->events[i].at <= position);
+      i++)
+    {
+      card_index = reader->events[i].cardIndex;
+    }
+  }
+
+  if (card_index == reader->cardIndex)
+  {
+    return;
+  }
+
+  /* Another card counts as a removal followed by an insertion */
+
+  reader->eventCounter += (
+    (SIZE_MAX != reader->cardIndex) &&
+    (SIZE_MAX != card_index)) ? 2 : 1;
+
+  reader->cardIndex = card_index;
+  reader->selectedFile = SIZE_MAX;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Finds a reader by name.
+ *
+ * @return Index of the reader, or `SIZE_MAX` if not found.
+ */
+size_t
+SCardSimulator_findReader(
+  _In_ LPCTSTR readerName)
+{
+  for (size_t i = 0; i < SCardSimulator_farm.readerCount; i++)
+  {
+    if (0 == _tcscmp(SCardSimulator_farm.readers[i].name, readerName))
+    {
+      return i;
+    }
+  }
+
+  return SIZE_MAX;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Contexts are numbered by service restarts (lower 16 bits) and carry
+ * the index of their lock (upper bits), so do the card handles.
+ *
+ * @param[in] number Bits that hold the lock index plus one.
+ * @return Index in `contextLocks`, or `SIZE_MAX` if there is none.
+ */
+size_t
+SCardSimulator_getContextSlot(
+  _In_ const uint32_t number)
+{
+  const size_t slot = (size_t) (number & 0xFF);
+
+  if ((0 == slot) || (slot > WEBCARD_SIM_MAX_CONTEXTS))
+  {
+    return SIZE_MAX;
+  }
+
+  return slot - 1;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Waits for the calls in progress through the same context.
+ */
+VOID
+SCardSimulator_lockContext(
+  _In_ const size_t slot)
+{
+  if (SIZE_MAX != slot)
+  {
+    OSSpecific_lockMutex(&(SCardSimulator_farm.contextLocks[slot]));
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Lets the next call through the same context run.
+ */
+VOID
+SCardSimulator_unlockContext(
+  _In_ const size_t slot)
+{
+  if (SIZE_MAX != slot)
+  {
+    OSSpecific_unlockMutex(&(SCardSimulator_farm.contextLocks[slot]));
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Card handles encode the reader index, the context that connected
+ * them and the card session (handles of a removed card become invalid).
+ */
+SCARDHANDLE
+SCardSimulator_makeHandle(
+  _In_ const size_t readerIndex,
+  _In_ const size_t contextSlot)
+{
+  const SCardSimReader *reader = &(SCardSimulator_farm.readers[readerIndex]);
+
+  return (SCARDHANDLE) (
+    (((uint32_t) reader->eventCounter & 0x7FF) << 20) |
+    (((uint32_t) (contextSlot + 1) & 0xFF) << 12) |
+    (uint32_t) (readerIndex + 1));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Decodes a card handle.
+ *
+ * @param[in] card Card handle.
+ * @param[out] readerIndexRef Receives the reader index.
+ * @return `SCARD_E_INVALID_HANDLE`, `SCARD_W_REMOVED_CARD`
+ * or `SCARD_S_SUCCESS`.
+ */
+PCSC_LONG
+SCardSimulator_checkHandle(
+  _In_ const SCARDHANDLE card,
+  _Out_ size_t *readerIndexRef)
+{
+  SCardSimReader *reader;
+  PCSC_LONG result = SCARD_S_SUCCESS;
+  size_t reader_index = (size_t) (((uint32_t) card) & WEBCARD_SIM_MAX_READERS);
+  const size_t context_slot =
+    SCardSimulator_getContextSlot(((uint32_t) card) >> 12);
+
+  if ((0 == reader_index) || (reader_index > SCardSimulator_farm.readerCount))
+  {
+    return SCARD_E_INVALID_HANDLE;
+  }
+
+  reader_index -= 1;
+  readerIndexRef[0] = reader_index;
+
+  reader = &(SCardSimulator_farm.readers[reader_index]);
+
+  OSSpecific_lockMutex(&(SCardSimulator_mutex));
+
+  SCardSimReader_update(reader, OSSpecific_getMonotonicTime());
+
+  if ((SIZE_MAX == reader->cardIndex) ||
+    (card != SCardSimulator_makeHandle(reader_index, context_slot)))
+  {
+    result = SCARD_W_REMOVED_CARD;
+  }
+
+  OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Builds a response APDU: data followed by the status word.
+ */
+PCSC_LONG
+SCardSimulator_reply(
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLength,
+  _In_opt_ const BYTE *data,
+  _In_ const size_t dataLength,
+  _In_ const uint16_t statusWord)
+{
+  if (outputLength[0] < (dataLength + 2))
+  {
+    return SCARD_E_INSUFFICIENT_BUFFER;
+  }
+
+  if (dataLength > 0)
+  {
+    memcpy(output, data, dataLength);
+  }
+
+  output[dataLength] = (BYTE) (statusWord >> 8);
+  output[dataLength + 1] = (BYTE) statusWord;
+  outputLength[0] = (PCSC_DWORD) (dataLength + 2);
+
+  return SCARD_S_SUCCESS;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimCard` object.
+ * ISO 7816-4 model: SELECT, READ BINARY and UPDATE BINARY
+ * on transparent files (offsets in P1-P2, no short EF identifiers).
+ */
+PCSC_LONG
+SCardSimCard_respondIso7816(
+  _Inout_ SCardSimCard *card,
+  _Inout_ SCardSimReader *reader,
+  _In_ const BYTE *input,
+  _In_ const size_t inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLength)
+{
+  size_t offset;
+  size_t length;
+  size_t expected;
+  SCardSimFile *file;
+  const size_t body_length = (inputLength > 5) ? input[4] : 0;
+
+  if ((inputLength > 5) && (inputLength < (5 + body_length)))
+  {
+    return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6700);
+  }
+
+  switch (input[1])
+  {
+    case 0xA4:
+    {
+      /* SELECT by File ID (P1 = 00) or by AID (P1 = 04, partial allowed) */
+
+      if ((0x00 != input[2]) && (0x04 != input[2]))
+      {
+        return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6A86);
+      }
+
+      for (size_t i = 0; i < card->fileCount; i++)
+      {
+        file = &(card->files[i]);
+
+        if ((body_length > 0) &&
+          ((0x00 == input[2]) ?
+            (body_length == file->idLength) :
+            (body_length <= file->idLength)) &&
+          (0 == memcmp(&(input[5]), file->id, body_length)))
+        {
+          reader->selectedFile = i;
+          return SCardSimulator_reply(output, outputLength, NULL, 0, 0x9000);
+        }
+      }
+
+      return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6A82);
+    }
+
+    case 0xB0:
+    case 0xD6:
+    {
+      if (SIZE_MAX == reader->selectedFile)
+      {
+        return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6986);
+      }
+
+      if (0x80 & input[2])
+      {
+        return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6A81);
+      }
+
+      file = &(card->files[reader->selectedFile]);
+      offset = (((size_t) input[2]) << 8) | input[3];
+
+      if (offset > file->length)
+      {
+        return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6B00);
+      }
+
+      if (0xB0 == input[1])
+      {
+        /* READ BINARY: "Le = 00" means 256 bytes */
+
+        if (inputLength > 5)
+        {
+          return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6700);
+        }
+
+        expected = ((5 == inputLength) && (0 != input[4])) ? input[4] : 256;
+        length = file->length - offset;
+
+        if (length >= expected)
+        {
+          return SCardSimulator_reply(
+            output, outputLength, &(file->data[offset]), expected, 0x9000);
+        }
+
+        return SCardSimulator_reply(
+          output, outputLength, &(file->data[offset]), length,
+          (5 == inputLength) ? 0x6282 : 0x9000);
+      }
+
+      /* UPDATE BINARY */
+
+      if ((0 == body_length) || (offset + body_length > file->length))
+      {
+        return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6700);
+      }
+
+      memcpy(&(file->data[offset]), &(input[5]), body_length);
+
+      return SCardSimulator_reply(output, outputLength, NULL, 0, 0x9000);
+    }
+  }
+
+  return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6D00);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimCard` object.
+ * Memory model: PC/SC storage card pseudo-APDUs
+ * ("FF B0" READ BINARY, "FF D6" UPDATE BINARY, block number in P1-P2).
+ */
+PCSC_LONG
+SCardSimCard_respondMemory(
+  _Inout_ SCardSimCard *card,
+  _In_ const BYTE *input,
+  _In_ const size_t inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLength)
+{
+  size_t offset;
+  size_t length;
+
+  if (0xFF != input[0])
+  {
+    return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6E00);
+  }
+
+  if ((0xB0 != input[1]) && (0xD6 != input[1]))
+  {
+    return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6D00);
+  }
+
+  if (inputLength < 5)
+  {
+    return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6700);
+  }
+
+  offset = ((((size_t) input[2]) << 8) | input[3]) * card->blockSize;
+  length = (0 == input[4]) ? 256 : input[4];
+
+  /* UPDATE BINARY: "Lc" is the length of the data ("Lc = 00" is */
+  /* no data at all, not 256 bytes) */
+
+  if ((0xD6 == input[1]) &&
+    ((0 == input[4]) || (inputLength != (5 + (size_t) input[4]))))
+  {
+    return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6700);
+  }
+
+  if ((offset > card->memory.length) ||
+    (length > (card->memory.length - offset)))
+  {
+    return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6B00);
+  }
+
+  if (0xB0 == input[1])
+  {
+    return SCardSimulator_reply(
+      output, outputLength, &(card->memory.data[offset]), length, 0x9000);
+  }
+
+  memcpy(&(card->memory.data[offset]), &(input[5]), length);
+
+  return SCardSimulator_reply(output, outputLength, NULL, 0, 0x9000);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimCard` object.
+ * Answers a command APDU (fixed responses first, then the card model).
+ *
+ * @param[out] latencyRef Receives the processing time in microseconds.
+ */
+PCSC_LONG
+SCardSimCard_respond(
+  _Inout_ SCardSimCard *card,
+  _Inout_ SCardSimReader *reader,
+  _In_ const BYTE *input,
+  _In_ const size_t inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLength,
+  _Out_ uint32_t *latencyRef)
+{
+  const SCardSimResponse *response;
+
+  latencyRef[0] = card->latency;
+
+  for (size_t i = 0; i < card->responseCount; i++)
+  {
+    response = &(card->responses[i]);
+
+    if ((inputLength == response->commandLength) &&
+      (0 == memcmp(input, response->command, inputLength)))
+    {
+      if (WEBCARD_SIM_LATENCY__CARD != response->latency)
+      {
+        latencyRef[0] = response->latency;
+      }
+
+      return SCardSimulator_reply(
+        output,
+        outputLength,
+        response->response,
+        response->responseLength - 2,
+        (uint16_t) (
+          (response->response[response->responseLength - 2] << 8) |
+          response->response[response->responseLength - 1]));
+    }
+  }
+
+  /* PC/SC "Get UID" pseudo-APDU works with every model */
+
+  if ((0xFF == input[0]) && (0xCA == input[1]) &&
+    (0x00 == input[2]) && (0x00 == input[3]))
+  {
+    return (card->uidLength > 0) ?
+      SCardSimulator_reply(
+        output, outputLength, card->uid, card->uidLength, 0x9000) :
+      SCardSimulator_reply(output, outputLength, NULL, 0, 0x6A81);
+  }
+
+  switch (card->model)
+  {
+    case WEBCARD_SIM_MODEL__ISO7816:
+    {
+      return SCardSimCard_respondIso7816(
+        card, reader, input, inputLength, output, outputLength);
+    }
+
+    case WEBCARD_SIM_MODEL__MEMORY:
+    {
+      return SCardSimCard_respondMemory(
+        card, input, inputLength, output, outputLength);
+    }
+  }
+
+  return SCardSimulator_reply(output, outputLength, NULL, 0, 0x6D00);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Tells where the simulated service is in its outages.
+ *
+ * @param[out] downRef Receives `TRUE` during an outage.
+ * @return Number of outages that have started so far
+ * (contexts established before the last one are invalid).
+ */
+uint64_t
+SCardSimulator_getServiceState(
+  _Out_ BOOL *downRef)
+{
+  uint64_t elapsed;
+  uint64_t outages = 0;
+  const SCardSimulator *farm = &(SCardSimulator_farm);
+
+  downRef[0] = FALSE;
+
+  elapsed = OSSpecific_getMonotonicTime() - farm->startTime;
+
+  if ((0 == farm->outageLength) || (elapsed < farm->outageStart))
+  {
+    return 0;
+  }
+
+  elapsed -= farm->outageStart;
+
+  if (farm->outagePeriod > farm->outageLength)
+  {
+    outages = elapsed / farm->outagePeriod;
+    elapsed %= farm->outagePeriod;
+  }
+
+  downRef[0] = (elapsed < farm->outageLength);
+
+  return outages + 1;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Checks a Smart Card Context against the simulated service.
+ *
+ * @return `SCARD_E_NO_SERVICE` during an outage, `SCARD_E_SERVICE_STOPPED`
+ * if the service was restarted since `context` was established,
+ * otherwise `SCARD_S_SUCCESS`.
+ */
+PCSC_LONG
+SCardSimulator_checkContext(
+  _In_ const SCARDCONTEXT context)
+{
+  BOOL down;
+  const uint64_t outages = SCardSimulator_getServiceState(&(down));
+
+  if (down)
+  {
+    return SCARD_E_NO_SERVICE;
+  }
+
+  if (((outages + 1) & 0xFFFF) != (((uint32_t) context) & 0xFFFF))
+  {
+    return SCARD_E_SERVICE_STOPPED;
+  }
+
+  return SCARD_S_SUCCESS;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardEstablishContext()`.
+ */
+PCSC_LONG
+SCardSimulator_establishContext(
+  _Out_ LPSCARDCONTEXT context)
+{
+  BOOL down;
+  uint64_t outages;
+  size_t slot = SIZE_MAX;
+
+  /* Resource manager (service) being started */
+
+  if (0 != SCardSimulator_farm.startupLatency)
+  {
+    OSSpecific_sleep((uint32_t) SCardSimulator_farm.startupLatency);
+  }
+
+  outages = SCardSimulator_getServiceState(&(down));
+
+  if (down)
+  {
+    return SCARD_E_NO_SERVICE;
+  }
+
+  OSSpecific_lockMutex(&(SCardSimulator_mutex));
+
+  for (size_t i = 0; (SIZE_MAX == slot) && (i < WEBCARD_SIM_MAX_CONTEXTS); i++)
+  {
+    if (!(SCardSimulator_farm.contextUsed[i]))
+    {
+      SCardSimulator_farm.contextUsed[i] = TRUE;
+      slot = i;
+    }
+  }
+
+  OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+
+  if (SIZE_MAX == slot)
+  {
+    return SCARD_E_NO_MEMORY;
+  }
+
+  /* Contexts are numbered by service restarts */
+
+  context[0] = (SCARDCONTEXT) (
+    ((uint32_t) (slot + 1) << 16) |
+    (uint32_t) ((outages + 1) & 0xFFFF));
+
+  return SCARD_S_SUCCESS;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardReleaseContext()`.
+ */
+PCSC_LONG
+SCardSimulator_releaseContext(
+  _In_ SCARDCONTEXT context)
+{
+  const size_t slot =
+    SCardSimulator_getContextSlot(((uint32_t) context) >> 16);
+
+  if (SIZE_MAX == slot)
+  {
+    return SCARD_E_INVALID_HANDLE;
+  }
+
+  /* After the calls in progress */
+
+  SCardSimulator_lockContext(slot);
+
+  OSSpecific_lockMutex(&(SCardSimulator_mutex));
+  SCardSimulator_farm.contextUsed[slot] = FALSE;
+  OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+
+  SCardSimulator_unlockContext(slot);
+
+  return SCARD_S_SUCCESS;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardListReaders()`.
+ */
+PCSC_LONG
+SCardSimulator_listReaders(
+  _In_ SCARDCONTEXT context,
+  _Out_opt_ LPTSTR readerNames,
+  _Inout_ PCSC_DWORD *readerNamesLength)
+{
+  size_t name_length;
+  size_t total_length = 1;
+  const SCardSimReader *reader;
+  PCSC_LONG result = SCardSimulator_checkContext(context);
+
+  if (SCARD_S_SUCCESS != result)
+  {
+    return result;
+  }
+
+  if (0 == SCardSimulator_farm.readerCount)
+  {
+    return SCARD_E_NO_READERS_AVAILABLE;
+  }
+
+  for (size_t i = 0; i < SCardSimulator_farm.readerCount; i++)
+  {
+    total_length += 1 + _tcslen(SCardSimulator_farm.readers[i].name);
+  }
+
+  if (NULL == readerNames)
+  {
+    readerNamesLength[0] = (PCSC_DWORD) total_length;
+    return SCARD_S_SUCCESS;
+  }
+
+  if (readerNamesLength[0] < total_length)
+  {
+    readerNamesLength[0] = (PCSC_DWORD) total_length;
+    return SCARD_E_INSUFFICIENT_BUFFER;
+  }
+
+  /* Multi-string list: NULL-terminated names, then an empty name */
+
+  for (size_t i = 0; i < SCardSimulator_farm.readerCount; i++)
+  {
+    reader = &(SCardSimulator_farm.readers[i]);
+    name_length = 1 + _tcslen(reader->name);
+
+    memcpy(readerNames, reader->name, sizeof(TCHAR) * name_length);
+    readerNames = &(readerNames[name_length]);
+  }
+
+  readerNames[0] = 0;
+  readerNamesLength[0] = (PCSC_DWORD) total_length;
+
+  return SCARD_S_SUCCESS;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardGetStatusChange()`.
+ */
+PCSC_LONG
+SCardSimulator_getStatusChange(
+  _In_ SCARDCONTEXT context,
+  _In_ PCSC_DWORD timeout,
+  _Inout_ SCARD_READERSTATE *readerStates,
+  _In_ PCSC_DWORD readerCount)
+{
+  BOOL changed;
+  uint64_t now = OSSpecific_getMonotonicTime();
+  const uint64_t deadline = now + timeout;
+  const int64_t cancel_count = OSSpecific_atomicLoad(&(SCardSimulator_cancelCount));
+  size_t reader_index;
+  PCSC_DWORD event_state;
+  SCARD_READERSTATE *state;
+  SCardSimReader *reader;
+  const SCardSimCard *card;
+  PCSC_LONG result;
+
+  /* Same limit as PCSC Lite */
+
+  if (readerCount > WEBCARD_SIM_MAX_READER_STATES)
+  {
+    return SCARD_E_INVALID_VALUE;
+  }
+
+  while (TRUE)
+  {
+    result = SCardSimulator_checkContext(context);
+
+    if (SCARD_S_SUCCESS != result)
+    {
+      return result;
+    }
+
+    changed = FALSE;
+
+    OSSpecific_lockMutex(&(SCardSimulator_mutex));
+
+    for (PCSC_DWORD i = 0; i < readerCount; i++)
+    {
+      state = &(readerStates[i]);
+      reader_index = SCardSimulator_findReader(state->szReader);
+
+      if (SIZE_MAX == reader_index)
+      {
+        state->dwEventState = SCARD_STATE_UNKNOWN | SCARD_STATE_CHANGED;
+        changed = TRUE;
+        continue;
+      }
+
+      reader = &(SCardSimulator_farm.readers[reader_index]);
+      SCardSimReader_update(reader, now);
+
+      /* Upper 16 bits count the card events (as in PC/SC), */
+      /* resets by other applications included */
+
+      event_state = ((PCSC_DWORD) ((reader->eventCounter + reader->resetCounter) & 0xFFFF)) << 16;
+
+      if (SIZE_MAX == reader->cardIndex)
+      {
+        event_state |= SCARD_STATE_EMPTY;
+        state->cbAtr = 0;
+      }
+      else
+      {
+        card = &(SCardSimulator_farm.cards[reader->cardIndex]);
+        event_state |= SCARD_STATE_PRESENT;
+
+        state->cbAtr = (card->atrLength < sizeof(state->rgbAtr)) ?
+          (PCSC_DWORD) card->atrLength :
+          (PCSC_DWORD) sizeof(state->rgbAtr);
+
+        memcpy(state->rgbAtr, card->atr, state->cbAtr);
+      }
+
+      if (event_state != (state->dwCurrentState & (~SCARD_STATE_CHANGED)))
+      {
+        event_state |= SCARD_STATE_CHANGED;
+        changed = TRUE;
+      }
+
+      state->dwEventState = event_state;
+    }
+
+    OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+
+    if (changed)
+    {
+      return SCARD_S_SUCCESS;
+    }
+
+    if ((INFINITE != timeout) && (now >= deadline))
+    {
+      return SCARD_E_TIMEOUT;
+    }
+
+    if (cancel_count != OSSpecific_atomicLoad(&(SCardSimulator_cancelCount)))
+    {
+      return SCARD_E_CANCELLED;
+    }
+
+    OSSpecific_sleep(WEBCARD_SIM_POLL_INTERVAL);
+    now = OSSpecific_getMonotonicTime();
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardConnect()`.
+ */
+PCSC_LONG
+SCardSimulator_connect(
+  _In_ SCARDCONTEXT context,
+  _In_ LPCTSTR readerName,
+  _In_ PCSC_DWORD shareMode,
+  _In_ PCSC_DWORD preferredProtocols,
+  _Out_ LPSCARDHANDLE card,
+  _Out_ PCSC_DWORD *activeProtocol)
+{
+  SCardSimReader *reader;
+  PCSC_DWORD protocol;
+  const size_t reader_index = SCardSimulator_findReader(readerName);
+  PCSC_LONG result = SCardSimulator_checkContext(context);
+
+  if (SCARD_S_SUCCESS != result)
+  {
+    return result;
+  }
+
+  if (SIZE_MAX == reader_index)
+  {
+    return SCARD_E_UNKNOWN_READER;
+  }
+
+  reader = &(SCardSimulator_farm.readers[reader_index]);
+
+  OSSpecific_lockMutex(&(SCardSimulator_mutex));
+
+  SCardSimReader_update(reader, OSSpecific_getMonotonicTime());
+
+  if (SCARD_SHARE_DIRECT == shareMode)
+  {
+    /* Direct connection to the reader itself */
+    card[0] = SCardSimulator_makeHandle(
+      reader_index,
+      SCardSimulator_getContextSlot(((uint32_t) context) >> 16));
+    activeProtocol[0] = 0;
+  }
+  else if (SIZE_MAX == reader->cardIndex)
+  {
+    result = SCARD_E_NO_SMARTCARD;
+  }
+  else
+  {
+    protocol = SCardSimulator_farm.cards[reader->cardIndex].protocol;
+
+    if (0 == (protocol & preferredProtocols))
+    {
+      result = SCARD_E_PROTO_MISMATCH;
+    }
+    else
+    {
+      card[0] = SCardSimulator_makeHandle(
+        reader_index,
+        SCardSimulator_getContextSlot(((uint32_t) context) >> 16));
+
+      activeProtocol[0] = protocol;
+
+      reader->resetSeen = reader->resetCounter;
+    }
+  }
+
+  OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardDisconnect()`.
+ */
+PCSC_LONG
+SCardSimulator_disconnect(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD disposition)
+{
+  size_t reader_index;
+  PCSC_LONG result = SCardSimulator_checkHandle(card, &(reader_index));
+
+  if (SCARD_E_INVALID_HANDLE == result)
+  {
+    return result;
+  }
+
+  if ((SCARD_S_SUCCESS == result) && (SCARD_LEAVE_CARD != disposition))
+  {
+    /* Reset card: application selection is lost */
+    OSSpecific_lockMutex(&(SCardSimulator_mutex));
+    SCardSimulator_farm.readers[reader_index].selectedFile = SIZE_MAX;
+    OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+  }
+
+  return SCARD_S_SUCCESS;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardReconnect()`: acknowledges the resets done
+ * by other applications.
+ */
+PCSC_LONG
+SCardSimulator_reconnect(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD shareMode,
+  _In_ PCSC_DWORD preferredProtocols,
+  _In_ PCSC_DWORD initialization,
+  _Out_ PCSC_DWORD *activeProtocol)
+{
+  size_t reader_index;
+  SCardSimReader *reader;
+  PCSC_DWORD protocol;
+  PCSC_LONG result = SCardSimulator_checkHandle(card, &(reader_index));
+
+  if (SCARD_S_SUCCESS != result)
+  {
+    return result;
+  }
+
+  reader = &(SCardSimulator_farm.readers[reader_index]);
+
+  if (SCARD_SHARE_DIRECT == shareMode)
+  {
+    activeProtocol[0] = 0;
+    return SCARD_S_SUCCESS;
+  }
+
+  OSSpecific_lockMutex(&(SCardSimulator_mutex));
+
+  protocol = SCardSimulator_farm.cards[reader->cardIndex].protocol;
+
+  if (0 == (protocol & preferredProtocols))
+  {
+    result = SCARD_E_PROTO_MISMATCH;
+  }
+  else
+  {
+    if (SCARD_LEAVE_CARD != initialization)
+    {
+      reader->selectedFile = SIZE_MAX;
+    }
+
+    reader->resetSeen = reader->resetCounter;
+    activeProtocol[0] = protocol;
+  }
+
+  OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardTransmit()`, sleeping for the card processing time
+ * (which `SCardCancel()` does not interrupt, as with real readers).
+ */
+PCSC_LONG
+SCardSimulator_transmit(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD activeProtocol,
+  _In_ const BYTE *input,
+  _In_ PCSC_DWORD inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLength)
+{
+  size_t reader_index;
+  uint32_t latency = 0;
+  SCardSimReader *reader;
+  PCSC_LONG result = SCardSimulator_checkHandle(card, &(reader_index));
+
+  if (SCARD_S_SUCCESS != result)
+  {
+    return result;
+  }
+
+  if (inputLength < 4)
+  {
+    return SCARD_E_INVALID_PARAMETER;
+  }
+
+  reader = &(SCardSimulator_farm.readers[reader_index]);
+
+  OSSpecific_lockMutex(&(SCardSimulator_mutex));
+
+  if (reader->resetSeen != reader->resetCounter)
+  {
+    result = SCARD_W_RESET_CARD;
+  }
+  else
+  {
+    result = SCardSimCard_respond(
+      &(SCardSimulator_farm.cards[reader->cardIndex]),
+      reader,
+      input,
+      inputLength,
+      output,
+      outputLength,
+      &(latency));
+  }
+
+  OSSpecific_unlockMutex(&(SCardSimulator_mutex));
+
+  /* Card processing time */
+
+  if (latency > 0)
+  {
+    OSSpecific_sleep(latency);
+  }
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardCancel()` (thread-safe).
+ */
+PCSC_LONG
+SCardSimulator_cancel(
+  _In_ SCARDCONTEXT context)
+{
+  OSSpecific_atomicAdd(&(SCardSimulator_cancelCount), 1);
+
+  return SCARD_S_SUCCESS;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * The simulated service is not available during its outages.
+ */
+BOOL
+SCardSimulator_isServiceAvailable(void)
+{
+  BOOL down;
+
+  SCardSimulator_getServiceState(&(down));
+
+  return !down;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardListReaders()`, holding the lock of the context.
+ */
+PCSC_LONG
+SCardSimulator_listReadersLocked(
+  _In_ SCARDCONTEXT context,
+  _Out_opt_ LPTSTR readerNames,
+  _Inout_ PCSC_DWORD *readerNamesLength)
+{
+  PCSC_LONG result;
+  const size_t slot =
+    SCardSimulator_getContextSlot(((uint32_t) context) >> 16);
+
+  SCardSimulator_lockContext(slot);
+  result = SCardSimulator_listReaders(context, readerNames, readerNamesLength);
+  SCardSimulator_unlockContext(slot);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardGetStatusChange()`, holding the lock of the context
+ * for as long as it waits.
+ */
+PCSC_LONG
+SCardSimulator_getStatusChangeLocked(
+  _In_ SCARDCONTEXT context,
+  _In_ PCSC_DWORD timeout,
+  _Inout_ SCARD_READERSTATE *readerStates,
+  _In_ PCSC_DWORD readerCount)
+{
+  PCSC_LONG result;
+  const size_t slot =
+    SCardSimulator_getContextSlot(((uint32_t) context) >> 16);
+
+  SCardSimulator_lockContext(slot);
+  result = SCardSimulator_getStatusChange(context, timeout, readerStates, readerCount);
+  SCardSimulator_unlockContext(slot);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardConnect()`, holding the lock of the context.
+ */
+PCSC_LONG
+SCardSimulator_connectLocked(
+  _In_ SCARDCONTEXT context,
+  _In_ LPCTSTR readerName,
+  _In_ PCSC_DWORD shareMode,
+  _In_ PCSC_DWORD preferredProtocols,
+  _Out_ LPSCARDHANDLE card,
+  _Out_ PCSC_DWORD *activeProtocol)
+{
+  PCSC_LONG result;
+  const size_t slot =
+    SCardSimulator_getContextSlot(((uint32_t) context) >> 16);
+
+  SCardSimulator_lockContext(slot);
+
+  result = SCardSimulator_connect(
+    context,
+    readerName,
+    shareMode,
+    preferredProtocols,
+    card,
+    activeProtocol);
+
+  SCardSimulator_unlockContext(slot);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardDisconnect()`, holding the lock of the context
+ * that connected the card.
+ */
+PCSC_LONG
+SCardSimulator_disconnectLocked(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD disposition)
+{
+  PCSC_LONG result;
+  const size_t slot =
+    SCardSimulator_getContextSlot(((uint32_t) card) >> 12);
+
+  SCardSimulator_lockContext(slot);
+  result = SCardSimulator_disconnect(card, disposition);
+  SCardSimulator_unlockContext(slot);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardReconnect()`, holding the lock of the context
+ * that connected the card.
+ */
+PCSC_LONG
+SCardSimulator_reconnectLocked(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD shareMode,
+  _In_ PCSC_DWORD preferredProtocols,
+  _In_ PCSC_DWORD initialization,
+  _Out_ PCSC_DWORD *activeProtocol)
+{
+  PCSC_LONG result;
+  const size_t slot =
+    SCardSimulator_getContextSlot(((uint32_t) card) >> 12);
+
+  SCardSimulator_lockContext(slot);
+
+  result = SCardSimulator_reconnect(
+    card,
+    shareMode,
+    preferredProtocols,
+    initialization,
+    activeProtocol);
+
+  SCardSimulator_unlockContext(slot);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardBackend` object.
+ * Simulated `SCardTransmit()`, holding the lock of the context
+ * that connected the card (card processing time included).
+ */
+PCSC_LONG
+SCardSimulator_transmitLocked(
+  _In_ SCARDHANDLE card,
+  _In_ PCSC_DWORD activeProtocol,
+  _In_ const BYTE *input,
+  _In_ PCSC_DWORD inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLength)
+{
+  PCSC_LONG result;
+  const size_t slot =
+    SCardSimulator_getContextSlot(((uint32_t) card) >> 12);
+
+  SCardSimulator_lockContext(slot);
+
+  result = SCardSimulator_transmit(
+    card,
+    activeProtocol,
+    input,
+    inputLength,
+    output,
+    outputLength);
+
+  SCardSimulator_unlockContext(slot);
+
+  return result;
+}
+
+/**************************************************************/
+
+const SCardBackend SCardBackend_simulated =
+{
+  "simulated",
+  SCardSimulator_establishContext,
+  SCardSimulator_releaseContext,
+  SCardSimulator_listReadersLocked,
+  SCardSimulator_getStatusChangeLocked,
+  SCardSimulator_connectLocked,
+  SCardSimulator_disconnectLocked,
+  SCardSimulator_reconnectLocked,
+  SCardSimulator_transmitLocked,
+  SCardSimulator_cancel,
+  SCardSimulator_isServiceAvailable
+};
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Loads every card definition ("cards" array).
+ */
+BOOL
+SCardSimulator_loadCards(
+  _In_ const JsonArray *jsonCards)
+{
+  if (0 == jsonCards->count) { return TRUE; }
+
+  SCardSimulator_farm.cards = malloc(sizeof(SCardSimCard) * jsonCards->count);
+  if (NULL == SCardSimulator_farm.cards) { return FALSE; }
+
+  for (size_t i = 0; i < jsonCards->count; i++)
+  {
+    if (JSON_VALUE_TYPE__OBJECT != jsonCards->values[i].type)
+    {
+      return FALSE;
+    }
+
+    SCardSimulator_farm.cardCount += 1;
+
+    if (!SCardSimCard_load(
+      &(SCardSimulator_farm.cards[i]),
+      jsonCards->values[i].value))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSimulator` object.
+ * Loads every reader ("readers" array), expanding the replicated readers
+ * (with the "count" key) into separate readers named "<name> <number>".
+ */
+BOOL
+SCardSimulator_loadReaders(
+  _In_ const JsonArray *jsonReaders)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  const JsonObject *json_reader;
+  const UTF8String *base_name;
+  UTF8String name;
+  uint64_t count;
+  size_t total_count = 0;
+  char number[24];
+
+  /* Count the readers first (replicas included) */
+
+  for (size_t i = 0; i < jsonReaders->count; i++)
+  {
+    if (JSON_VALUE_TYPE__OBJECT != jsonReaders->values[i].type)
+    {
+      return FALSE;
+    }
+
+    count = 1;
+
+    test_bool = SCardSimulator_loadNumber(
+      jsonReaders->values[i].value,
+      "count",
+      &(count));
+
+    if (!test_bool || (0 == count) || (count > WEBCARD_SIM_MAX_READERS)) { return FALSE; }
+
+    total_count += (size_t) count;
+  }
+
+  if (total_count > WEBCARD_SIM_MAX_READERS) { return FALSE; }
+  if (0 == total_count) { return TRUE; }
+
+  SCardSimulator_farm.readers = malloc(sizeof(SCardSimReader) * total_count);
+  if (NULL == SCardSimulator_farm.readers) { return FALSE; }
+
+  for (size_t i = 0; i < jsonReaders->count; i++)
+  {
+    json_reader = jsonReaders->values[i].value;
+
+    test_bool = JsonObject_getValue(json_reader, &(json_value), "name");
+
+    if (!test_bool ||
+      (JSON_VALUE_TYPE__STRING != json_value.type) ||
+      (0 == ((const UTF8String *) json_value.value)->length))
+    {
+      return FALSE;
+    }
+
+    base_name = json_value.value;
+
+    count = 1;
+    SCardSimulator_loadNumber(json_reader, "count", &(count));
+
+    for (size_t j = 0; j < count; j++)
+    {
+      UTF8String_init(&(name));
+
+      test_bool = UTF8String_copy(&(name), base_name);
+
+      if (test_bool && (count > 1))
+      {
+        snprintf(number, sizeof(number), " %u", (unsigned int) j);
+        test_bool = UTF8String_pushText(&(name), number, 0);
+      }
+
+      if (test_bool)
+      {
+        SCardSimulator_farm.readerCount += 1;
+
+        test_bool = SCardSimReader_load(
+          &(SCardSimulator_farm.readers[SCardSimulator_farm.readerCount - 1]),
+          json_reader,
+          &(name),
+          j);
+      }
+
+      UTF8String_destroy(&(name));
+
+      if (!test_bool) { return FALSE; }
+    }
+  }
+
+  /* Reader names must be unique */
+
+  for (size_t i = 1; i < SCardSimulator_farm.readerCount; i++)
+  {
+    if (i != SCardSimulator_findReader(SCardSimulator_farm.readers[i].name))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardSimulator_load(
+  _In_ LPCSTR fileName)
+{
+  BOOL test_bool;
+  JsonByteStream json_stream;
+  JsonObject json_farm;
+  JsonObject *json_farm_ptr = &(json_farm);
+  JsonValue json_value;
+
+  SCardSimulator_destroy();
+
+  if (!JsonByteStream_loadFromFile(&(json_stream), fileName))
+  {
+    return FALSE;
+  }
+
+  JsonObject_init(&(json_farm));
+
+  test_bool = JsonByteStream_skipWhitespace(&(json_stream)) &&
+    JsonObject_parse(&(json_farm_ptr), FALSE, &(json_stream));
+
+  JsonByteStream_destroy(&(json_stream));
+
+  test_bool = test_bool && SCardSimulator_loadNumber(
+    &(json_farm),
+    "startup",
+    &(SCardSimulator_farm.startupLatency));
+
+  /* Optional service outages */
+
+  if (test_bool && JsonObject_getValue(&(json_farm), &(json_value), "outage"))
+  {
+    test_bool = (JSON_VALUE_TYPE__OBJECT == json_value.type) &&
+      SCardSimulator_loadNumber(
+        json_value.value,
+        "at",
+        &(SCardSimulator_farm.outageStart)) &&
+      SCardSimulator_loadNumber(
+        json_value.value,
+        "duration",
+        &(SCardSimulator_farm.outageLength)) &&
+      SCardSimulator_loadNumber(
+        json_value.value,
+        "period",
+        &(SCardSimulator_farm.outagePeriod));
+  }
+
+  /* Cards first (readers refer to them by name) */
+
+  if (test_bool && JsonObject_getValue(&(json_farm), &(json_value), "cards"))
+  {
+    test_bool = (JSON_VALUE_TYPE__ARRAY == json_value.type) &&
+      SCardSimulator_loadCards(json_value.value);
+  }
+
+  if (test_bool && JsonObject_getValue(&(json_farm), &(json_value), "readers"))
+  {
+    test_bool = (JSON_VALUE_TYPE__ARRAY == json_value.type) &&
+      SCardSimulator_loadReaders(json_value.value);
+  }
+
+  JsonObject_destroy(&(json_farm));
+
+  if (!test_bool)
+  {
+    SCardSimulator_destroy();
+    return FALSE;
+  }
+
+  for (size_t i = 0; i < WEBCARD_SIM_MAX_CONTEXTS; i++)
+  {
+    OSSpecific_initMutex(&(SCardSimulator_farm.contextLocks[i]));
+  }
+
+  SCardSimulator_farm.locksReady = TRUE;
+  SCardSimulator_farm.startTime = OSSpecific_getMonotonicTime();
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+VOID
+SCardSimulator_destroy(void)
+{
+  for (size_t i = 0; i < SCardSimulator_farm.cardCount; i++)
+  {
+    SCardSimCard_destroy(&(SCardSimulator_farm.cards[i]));
+  }
+
+  if (NULL != SCardSimulator_farm.cards)
+  {
+    free(SCardSimulator_farm.cards);
+  }
+
+  for (size_t i = 0; i < SCardSimulator_farm.readerCount; i++)
+  {
+    SCardSimReader_destroy(&(SCardSimulator_farm.readers[i]));
+  }
+
+  if (NULL != SCardSimulator_farm.readers)
+  {
+    free(SCardSimulator_farm.readers);
+  }
+
+  for (size_t i = 0; SCardSimulator_farm.locksReady && (i < WEBCARD_SIM_MAX_CONTEXTS); i++)
+  {
+    OSSpecific_destroyMutex(&(SCardSimulator_farm.contextLocks[i]));
+  }
+
+  memset(&(SCardSimulator_farm), 0x00, sizeof(SCardSimulator));
+}
+
+/**************************************************************/
@@ -0,0 +1,371 @@
+/**
+ * @file "native/src/smart_cards/sc_stats.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+VOID
+SCardLatencyHistogram_init(
+  _Out_ SCardLatencyHistogram *histogram)
+{
+  memset(histogram, 0x00, sizeof(SCardLatencyHistogram));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardLatencyHistogram` object.
+ * Finds the log-linear bucket of given duration.
+ *
+ * @param[in] duration Duration, in nanoseconds.
+ * @return Index of the bucket, from `0` to `WEBCARD_STATS_BUCKETS - 1`.
+ */
+size_t
+SCardLatencyHistogram_bucketIndex(
+  _In_ const uint64_t duration)
+{
+  int exponent;
+
+  if (duration < WEBCARD_STATS_SUB_BUCKETS)
+  {
+    return (size_t) duration;
+  }
+
+  /* Position of the most significant bit */
+
+  #if defined(__GNUC__)
+  {
+    exponent = 63 - __builtin_clzll(duration);
+  }
+  #else
+  {
+    exponent = 0;
+    while ((duration >> exponent) > 1) { exponent++; }
+  }
+  #endif
+
+  if (exponent >= WEBCARD_STATS_MAX_EXPONENT)
+  {
+    return (WEBCARD_STATS_BUCKETS - 1);
+  }
+
+  /* Power of two selects the row, the next bits select the column */
+
+  return
+    ((size_t) (exponent - WEBCARD_STATS_SUB_BUCKETS_LOG2 + 1) <<
+      WEBCARD_STATS_SUB_BUCKETS_LOG2) +
+    (size_t) ((duration >> (exponent - WEBCARD_STATS_SUB_BUCKETS_LOG2)) &
+      (WEBCARD_STATS_SUB_BUCKETS - 1));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardLatencyHistogram` object.
+ * Finds the middle of a log-linear bucket.
+ *
+ * @param[in] index Index of the bucket.
+ * @return Representative duration of the bucket, in nanoseconds.
+ */
+uint64_t
+SCardLatencyHistogram_bucketMiddle(
+  _In_ const size_t index)
+{
+  size_t shift;
+  uint64_t column;
+
+  if (index < WEBCARD_STATS_SUB_BUCKETS)
+  {
+    return (uint64_t) index;
+  }
+
+  shift = (index >> WEBCARD_STATS_SUB_BUCKETS_LOG2) - 1;
+  column = (uint64_t) (index & (WEBCARD_STATS_SUB_BUCKETS - 1));
+
+  return
+    ((WEBCARD_STATS_SUB_BUCKETS + column) << shift) +
+    (((uint64_t) 1 << shift) >> 1);
+}
+
+/**************************************************************/
+
+VOID
+SCardLatencyHistogram_record(
+  _Inout_ SCardLatencyHistogram *histogram,
+  _In_ const uint64_t duration)
+{
+  if ((0 == histogram->count) || (duration < histogram->min))
+  {
+    histogram->min = duration;
+  }
+
+  if (duration > histogram->max)
+  {
+    histogram->max = duration;
+  }
+
+  histogram->count += 1;
+  histogram->sum += duration;
+  histogram->buckets[SCardLatencyHistogram_bucketIndex(duration)] += 1;
+}
+
+/**************************************************************/
+
+uint64_t
+SCardLatencyHistogram_percentile(
+  _In_ const SCardLatencyHistogram *histogram,
+  _In_ const double fraction)
+{
+  uint64_t rank;
+  uint64_t seen = 0;
+  uint64_t result;
+
+  if (0 == histogram->count)
+  {
+    return 0;
+  }
+
+  /* Nearest-rank method */
+
+  rank = (uint64_t) (fraction * (double) histogram->count);
+  if ((double) rank < (fraction * (double) histogram->count)) { rank++; }
+  if (rank < 1) { rank = 1; }
+
+  for (size_t i = 0; i < WEBCARD_STATS_BUCKETS; i++)
+  {
+    seen += histogram->buckets[i];
+
+    if (seen >= rank)
+    {
+      result = SCardLatencyHistogram_bucketMiddle(i);
+
+      /* Never report more than the known extremes */
+
+      if (result < histogram->min) { return histogram->min; }
+      if (result > histogram->max) { return histogram->max; }
+
+      return result;
+    }
+  }
+
+  return histogram->max;
+}
+
+/**************************************************************/
+
+BOOL
+SCardLatencyHistogram_toJsonObject(
+  _In_ const SCardLatencyHistogram *histogram,
+  _Out_ JsonObject *jsonObject)
+{
+  BOOL test_bool = TRUE;
+  FLOAT test_float;
+  JsonValue json_number;
+
+  const struct
+  {
+    LPCSTR key;
+    uint64_t value;
+  }
+  summary[] =
+  {
+    {"n", histogram->count},
+    {"min", histogram->min},
+    {"mean", (0 != histogram->count) ? (histogram->sum / histogram->count) : 0},
+    {"p50", SCardLatencyHistogram_percentile(histogram, 0.50)},
+    {"p90", SCardLatencyHistogram_percentile(histogram, 0.90)},
+    {"p99", SCardLatencyHistogram_percentile(histogram, 0.99)},
+    {"p999", SCardLatencyHistogram_percentile(histogram, 0.999)},
+    {"max", histogram->max}
+  };
+
+  JsonObject_init(jsonObject);
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  for (size_t i = 0; test_bool && (i < (sizeof(summary) / sizeof(summary[0]))); i++)
+  {
+    test_float = (FLOAT) summary[i].value;
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonObject,
+      summary[i].key,
+      &(json_number));
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+VOID
+SCardStats_init(
+  _Out_ SCardStats *stats)
+{
+  stats->resetTime = OSSpecific_getMonotonicTime();
+
+  for (size_t i = 0; i < WEBCARD_STATS_COMMANDS; i++)
+  {
+    stats->commands[i] = NULL;
+  }
+
+  stats->readerCount = 0;
+  stats->readers = NULL;
+}
+
+/**************************************************************/
+
+VOID
+SCardStats_destroy(
+  _Inout_ SCardStats *stats)
+{
+  for (size_t i = 0; i < WEBCARD_STATS_COMMANDS; i++)
+  {
+    if (NULL != stats->commands[i])
+    {
+      free(stats->commands[i]);
+    }
+  }
+
+  if (NULL != stats->readers)
+  {
+    for (size_t i = 0; i < stats->readerCount; i++)
+    {
+      free(stats->readers[i]->readerName);
+      free(stats->readers[i]);
+    }
+
+    free(stats->readers);
+  }
+}
+
+/**************************************************************/
+
+BOOL
+SCardStats_recordRequest(
+  _Inout_ SCardStats *stats,
+  _In_ size_t command,
+  _In_ const BOOL failed,
+  _In_ const uint64_t *timestamps)
+{
+  SCardCommandStats *command_stats;
+
+  if (command >= WEBCARD_STATS_COMMANDS)
+  {
+    command = WEBCARD_COMMAND__NONE;
+  }
+
+  command_stats = stats->commands[command];
+
+  if (NULL == command_stats)
+  {
+    command_stats = malloc(sizeof(SCardCommandStats));
+    if (NULL == command_stats) { return FALSE; }
+
+    command_stats->failures = 0;
+
+    for (size_t i = 0; i < WEBCARD_STAGE_COUNT; i++)
+    {
+      SCardLatencyHistogram_init(&(command_stats->stages[i]));
+    }
+
+    stats->commands[command] = command_stats;
+  }
+
+  if (failed)
+  {
+    command_stats->failures += 1;
+  }
+
+  /* Every stage ends where the next one begins */
+
+  for (size_t i = 0; i < WEBCARD_STAGE__TOTAL; i++)
+  {
+    SCardLatencyHistogram_record(
+      &(command_stats->stages[i]),
+      timestamps[i + 1] - timestamps[i]);
+  }
+
+  SCardLatencyHistogram_record(
+    &(command_stats->stages[WEBCARD_STAGE__TOTAL]),
+    timestamps[WEBCARD_STAGE__TOTAL] - timestamps[0]);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+SCardLatencyHistogram *
+SCardStats_findReaderHistogram(
+  _Inout_ SCardStats *stats,
+  _In_ LPCTSTR readerName)
+{
+  SCardReaderStats *reader_stats = SCardStats_findReader(
+    stats,
+    readerName);
+
+  return (NULL != reader_stats) ?
+    &(reader_stats->transmit) :
+    NULL;
+}
+
+/**************************************************************/
+
+SCardReaderStats *
+SCardStats_findReader(
+  _Inout_ SCardStats *stats,
+  _In_ LPCTSTR readerName)
+{
+  SCardReaderStats *reader_stats;
+  SCardReaderStats **new_readers;
+  size_t name_length;
+
+  for (size_t i = 0; i < stats->readerCount; i++)
+  {
+    if (0 == _tcscmp(stats->readers[i]->readerName, readerName))
+    {
+      return stats->readers[i];
+    }
+  }
+
+  /* First use of this reader */
+
+  reader_stats = malloc(sizeof(SCardReaderStats));
+  if (NULL == reader_stats) { return NULL; }
+
+  name_length = 1 + _tcslen(readerName);
+
+  reader_stats->readerName = malloc(sizeof(TCHAR) * name_length);
+  if (NULL == reader_stats->readerName)
+  {
+    free(reader_stats);
+    return NULL;
+  }
+
+  memcpy(reader_stats->readerName, readerName, sizeof(TCHAR) * name_length);
+  SCardLatencyHistogram_init(&(reader_stats->transmit));
+  SCardLatencyHistogram_init(&(reader_stats->wait));
+
+  new_readers = realloc(
+    stats->readers,
+    sizeof(SCardReaderStats *) * (stats->readerCount + 1));
+
+  if (NULL == new_readers)
+  {
+    free(reader_stats->readerName);
+    free(reader_stats);
+    return NULL;
+  }
+
+  new_readers[stats->readerCount] = reader_stats;
+  stats->readers = new_readers;
+  stats->readerCount += 1;
+
+  return reader_stats;
+}
+
+/**************************************************************/
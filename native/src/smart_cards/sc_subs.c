@@ -0,0 +1,444 @@
+/**
+ * @file "native/src/smart_cards/sc_subs.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+VOID
+SCardSubscription_init(
+  _Out_ SCardSubscription *subscription)
+{
+  UTF8String_init(&(subscription->clientKey));
+
+  subscription->session       = WEBCARD_SESSION__STANDARD_IO;
+  subscription->eventMask     = UINT32_MAX;
+  subscription->readerCount   = 0;
+  subscription->readerIndices = NULL;
+  subscription->atrLength     = 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardSubscription_destroy(
+  _Inout_ SCardSubscription *subscription)
+{
+  UTF8String_destroy(&(subscription->clientKey));
+
+  if (NULL != subscription->readerIndices)
+  {
+    free(subscription->readerIndices);
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardSubscription` object.
+ * Decodes an optional hex-string (ATR pattern or ATR mask).
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[in] key Key under which the hex-string is stored.
+ * @param[out] output Buffer of `WEBCARD_ATR_MAX_SIZE` bytes.
+ * @param[out] outputLengthRef Receives the number of decoded bytes
+ * (`0` if the key is missing).
+ * @return `TRUE` on success (or if the key is missing),
+ * `FALSE` on invalid hex-string OR on memory allocation failure.
+ */
+BOOL
+SCardSubscription_loadAtrBytes(
+  _In_ const JsonObject *jsonRequest,
+  _In_ LPCSTR key,
+  _Out_ BYTE *output,
+  _Out_ size_t *outputLengthRef)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  LPBYTE bytes;
+  size_t length;
+
+  outputLengthRef[0] = 0;
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    key);
+
+  if (!test_bool) { return TRUE; }
+
+  if (JSON_VALUE_TYPE__STRING != json_value.type) { return FALSE; }
+
+  if (0 == ((const UTF8String *) json_value.value)->length) { return TRUE; }
+
+  test_bool = UTF8String_hexToByteArray(
+    json_value.value,
+    &(length),
+    &(bytes));
+
+  if (test_bool && (length <= WEBCARD_ATR_MAX_SIZE))
+  {
+    memcpy(output, bytes, length);
+    outputLengthRef[0] = length;
+  }
+  else
+  {
+    test_bool = FALSE;
+  }
+
+  if (NULL != bytes)
+  {
+    free(bytes);
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+SCardSubscription_load(
+  _Out_ SCardSubscription *subscription,
+  _In_ const JsonObject *jsonRequest)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  const JsonArray *json_array;
+  FLOAT test_float;
+  size_t mask_length;
+
+  SCardSubscription_init(subscription);
+
+  /* Key "k" (client key) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "k");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__STRING != json_value.type) { return FALSE; }
+
+    test_bool = UTF8String_copy(
+      &(subscription->clientKey),
+      json_value.value);
+
+    if (!test_bool) { return FALSE; }
+  }
+
+  /* Key "e" (list of Reader Events) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "e");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+    json_array = json_value.value;
+    subscription->eventMask = 0;
+
+    for (size_t i = 0; i < json_array->count; i++)
+    {
+      if (JSON_VALUE_TYPE__NUMBER != json_array->values[i].type)
+      {
+        return FALSE;
+      }
+
+      test_float = ((FLOAT *) json_array->values[i].value)[0];
+
+      if ((test_float < 0) || (test_float >= 32))
+      {
+        return FALSE;
+      }
+
+      subscription->eventMask |= (((uint32_t) 1) << ((uint32_t) test_float));
+    }
+  }
+
+  /* Key "r" (list of reader indices) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "r");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__ARRAY != json_value.type) { return FALSE; }
+
+    json_array = json_value.value;
+
+    if (json_array->count > 0)
+    {
+      subscription->readerIndices = malloc(sizeof(size_t) * json_array->count);
+      if (NULL == subscription->readerIndices) { return FALSE; }
+
+      for (size_t i = 0; i < json_array->count; i++)
+      {
+        if (JSON_VALUE_TYPE__NUMBER != json_array->values[i].type)
+        {
+          return FALSE;
+        }
+
+        test_float = ((FLOAT *) json_array->values[i].value)[0];
+
+        if (test_float < 0) { return FALSE; }
+
+        subscription->readerIndices[i] = (size_t) test_float;
+        subscription->readerCount += 1;
+      }
+    }
+  }
+
+  /* Keys "a" (ATR pattern) and "m" (ATR mask) */
+
+  test_bool = SCardSubscription_loadAtrBytes(
+    jsonRequest,
+    "a",
+    subscription->atrPattern,
+    &(subscription->atrLength));
+
+  if (!test_bool) { return FALSE; }
+
+  test_bool = SCardSubscription_loadAtrBytes(
+    jsonRequest,
+    "m",
+    subscription->atrMask,
+    &(mask_length));
+
+  if (!test_bool) { return FALSE; }
+
+  if (0 == mask_length)
+  {
+    /* Missing mask: compare every bit of the pattern */
+
+    mask_length = subscription->atrLength;
+    memset(subscription->atrMask, 0xFF, mask_length);
+  }
+
+  if (mask_length != subscription->atrLength) { return FALSE; }
+
+  for (size_t i = 0; i < subscription->atrLength; i++)
+  {
+    subscription->atrPattern[i] &= subscription->atrMask[i];
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardSubscription_matches(
+  _In_ const SCardSubscription *subscription,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _In_ const BYTE *atr,
+  _In_ const size_t atrLength)
+{
+  BOOL test_bool;
+
+  if ((readerEvent < 0) || (readerEvent >= 32))
+  {
+    return FALSE;
+  }
+
+  if (0 == (subscription->eventMask & (((uint32_t) 1) << readerEvent)))
+  {
+    return FALSE;
+  }
+
+  /* Reader filters have no meaning for "More Readers" and "Less Readers" */
+  /* (indices of all readers shift, so every subscriber should know) */
+
+  if ((WEBCARD_READER_EVENT__CARD_INSERTION != readerEvent) &&
+    (WEBCARD_READER_EVENT__CARD_REMOVAL != readerEvent))
+  {
+    return TRUE;
+  }
+
+  if (subscription->readerCount > 0)
+  {
+    test_bool = FALSE;
+
+    for (size_t i = 0; (!test_bool) && (i < subscription->readerCount); i++)
+    {
+      test_bool = (readerIndex == subscription->readerIndices[i]);
+    }
+
+    if (!test_bool) { return FALSE; }
+  }
+
+  if (subscription->atrLength > atrLength)
+  {
+    return FALSE;
+  }
+
+  for (size_t i = 0; i < subscription->atrLength; i++)
+  {
+    if ((atr[i] & subscription->atrMask[i]) != subscription->atrPattern[i])
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardReaderDB_subscribe(
+  _Inout_ SCardReaderDB *database,
+  _Inout_ SCardSubscription *subscription)
+{
+  size_t byteSize;
+  SCardSubscription *test_subscriptions;
+  const UTF8String *clientKey = &(subscription->clientKey);
+
+  /* Replace existing subscription of the same client */
+
+  for (size_t i = 0; i < database->subscriptionCount; i++)
+  {
+    if ((subscription->session == database->subscriptions[i].session) &&
+      UTF8String_matches(
+      &(database->subscriptions[i].clientKey),
+      (NULL != clientKey->text) ? (LPCSTR) clientKey->text : ""))
+    {
+      SCardSubscription_destroy(&(database->subscriptions[i]));
+      database->subscriptions[i] = subscription[0];
+      return TRUE;
+    }
+  }
+
+  /* Expand the subscription list */
+
+  byteSize = sizeof(SCardSubscription) * (1 + database->subscriptionCount);
+  test_subscriptions = realloc(database->subscriptions, byteSize);
+  if (NULL == test_subscriptions) { return FALSE; }
+
+  database->subscriptions = test_subscriptions;
+  database->subscriptions[database->subscriptionCount] = subscription[0];
+  database->subscriptionCount += 1;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+SCardReaderDB_unsubscribe(
+  _Inout_ SCardReaderDB *database,
+  _In_ const uint32_t session,
+  _In_opt_ const UTF8String *clientKey)
+{
+  BOOL removed = FALSE;
+  size_t i = 0;
+
+  while (i < database->subscriptionCount)
+  {
+    if ((session == database->subscriptions[i].session) &&
+      ((NULL == clientKey) || UTF8String_matches(
+        &(database->subscriptions[i].clientKey),
+        (NULL != clientKey->text) ? (LPCSTR) clientKey->text : "")))
+    {
+      SCardSubscription_destroy(&(database->subscriptions[i]));
+
+      /* Keep the list contiguous (order doesn't matter) */
+
+      database->subscriptionCount -= 1;
+      database->subscriptions[i] =
+        database->subscriptions[database->subscriptionCount];
+
+      removed = TRUE;
+
+      /* Client keys are unique within a session */
+
+      if (NULL != clientKey) { break; }
+    }
+    else
+    {
+      i += 1;
+    }
+  }
+
+  return removed;
+}
+
+/**************************************************************/
+
+BOOL
+SCardReaderDB_findSubscribers(
+  _In_ const SCardReaderDB *database,
+  _In_ const uint32_t session,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _Out_ JsonArray *jsonClientKeys)
+{
+  BOOL test_bool;
+  BOOL found = FALSE;
+  BOOL subscribed = FALSE;
+  JsonValue json_value;
+  const BYTE *atr = NULL;
+  size_t atr_length = 0;
+
+  JsonArray_init(jsonClientKeys);
+
+  /* Clients that never subscribed receive everything */
+
+  for (size_t i = 0; i < database->subscriptionCount; i++)
+  {
+    if (session == database->subscriptions[i].session)
+    {
+      subscribed = TRUE;
+      break;
+    }
+  }
+
+  if (!subscribed)
+  {
+    return TRUE;
+  }
+
+  if (readerIndex < database->count)
+  {
+    atr = database->connections[readerIndex].cardAtr;
+    atr_length = database->connections[readerIndex].cardAtrLength;
+  }
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+
+  for (size_t i = 0; i < database->subscriptionCount; i++)
+  {
+    if (session != database->subscriptions[i].session)
+    {
+      continue;
+    }
+
+    test_bool = SCardSubscription_matches(
+      &(database->subscriptions[i]),
+      readerIndex,
+      readerEvent,
+      atr,
+      atr_length);
+
+    if (test_bool)
+    {
+      found = TRUE;
+
+      json_value.value = (void *) &(database->subscriptions[i].clientKey);
+
+      JsonArray_append(jsonClientKeys, &(json_value));
+    }
+  }
+
+  return found;
+}
+
+/**************************************************************/
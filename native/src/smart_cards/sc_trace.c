@@ -0,0 +1,281 @@
+/**
+ * @file "native/src/smart_cards/sc_trace.c"
+ * Communication with Smart Card Readers (physical or virtual peripherals).
+ */
+
+#include "smart_cards/smart_cards.h"
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardTrace` object.
+ * Reference to the file header.
+ */
+SCardTraceHeader *
+SCardTrace_header(
+  _In_ const SCardTrace *trace)
+{
+  return (SCardTraceHeader *) trace->file.data;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardTrace` object.
+ * Reference to the record header at given offset (within the ring).
+ */
+SCardTraceRecord *
+SCardTrace_recordAt(
+  _In_ const SCardTrace *trace,
+  _In_ const size_t offset)
+{
+  return (SCardTraceRecord *)
+    &(trace->file.data[WEBCARD_TRACE_FILE__HEADER_SIZE + offset]);
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `SCardTrace` object.
+ * Drops the oldest records until `length` bytes are free.
+ */
+VOID
+SCardTrace_makeRoom(
+  _Inout_ SCardTraceHeader *header,
+  _In_ const SCardTrace *trace,
+  _In_ const size_t length)
+{
+  const SCardTraceRecord *oldest;
+
+  while ((header->ringSize - header->usedBytes) < length)
+  {
+    oldest = SCardTrace_recordAt(trace, header->tail);
+
+    if (WEBCARD_TRACE_RECORD__PADDING != oldest->type)
+    {
+      header->dropped += 1;
+    }
+
+    header->usedBytes -= oldest->length;
+    header->tail += oldest->length;
+
+    if (header->tail >= header->ringSize)
+    {
+      header->tail = 0;
+    }
+  }
+}
+
+/**************************************************************/
+
+VOID
+SCardTrace_init(
+  _Out_ SCardTrace *trace)
+{
+  OSSpecific_initMappedFile(&(trace->file));
+  trace->startTime = 0;
+}
+
+/**************************************************************/
+
+VOID
+SCardTrace_destroy(
+  _Inout_ SCardTrace *trace)
+{
+  if (SCardTrace_isOpen(trace))
+  {
+    OSSpecific_flushMappedFile(&(trace->file));
+  }
+
+  OSSpecific_closeMappedFile(&(trace->file));
+}
+
+/**************************************************************/
+
+BOOL
+SCardTrace_isOpen(
+  _In_ const SCardTrace *trace)
+{
+  return (NULL != trace->file.data);
+}
+
+/**************************************************************/
+
+BOOL
+SCardTrace_configure(
+  _Inout_ SCardTrace *trace,
+  _In_ const size_t fileSize)
+{
+  BOOL test_bool;
+  SCardTraceHeader *header;
+
+  /* The previous trace (or the stopped one) is kept on disk */
+
+  SCardTrace_destroy(trace);
+
+  if (0 == fileSize)
+  {
+    return TRUE;
+  }
+
+  if ((fileSize < WEBCARD_TRACE_FILE__MIN_SIZE) || (fileSize > UINT32_MAX))
+  {
+    return FALSE;
+  }
+
+  test_bool = OSSpecific_openMappedFile(
+    &(trace->file),
+    WEBCARD_TRACE_FILE_NAME,
+    fileSize);
+
+  if (!test_bool)
+  {
+    OSSpecific_closeMappedFile(&(trace->file));
+    return FALSE;
+  }
+
+  /* Every trace starts with an empty ring */
+
+  header = SCardTrace_header(trace);
+  memset(header, 0x00, WEBCARD_TRACE_FILE__HEADER_SIZE);
+
+  memcpy(header->magic, WEBCARD_TRACE_FILE__MAGIC, 4);
+  header->version = WEBCARD_TRACE_FILE__VERSION;
+  header->ringSize = (uint32_t) ((trace->file.size -
+    WEBCARD_TRACE_FILE__HEADER_SIZE) & (~((size_t) 7)));
+  header->startedAt = (uint64_t) time(NULL);
+
+  trace->startTime = OSSpecific_getPreciseTime();
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+VOID
+SCardTrace_record(
+  _Inout_ SCardTrace *trace,
+  _In_ const uint16_t type,
+  _In_ uint16_t flags,
+  _In_ const uint32_t reader,
+  _In_ const uint32_t status,
+  _In_ const uint64_t startTime,
+  _In_ const uint64_t endTime,
+  _In_opt_ const BYTE *first,
+  _In_ size_t firstLength,
+  _In_opt_ const BYTE *second,
+  _In_ size_t secondLength)
+{
+  SCardTraceHeader *header;
+  SCardTraceRecord *record;
+  size_t record_length;
+  size_t max_data_length;
+  LPBYTE data;
+
+  if (!SCardTrace_isOpen(trace))
+  {
+    return;
+  }
+
+  header = SCardTrace_header(trace);
+
+  /* A single record never takes more than a quarter of the ring */
+
+  max_data_length = (header->ringSize / 4) - sizeof(SCardTraceRecord);
+
+  if (firstLength > max_data_length)
+  {
+    firstLength = max_data_length;
+    flags |= WEBCARD_TRACE_FLAG__TRUNCATED;
+  }
+
+  if (secondLength > (max_data_length - firstLength))
+  {
+    secondLength = max_data_length - firstLength;
+    flags |= WEBCARD_TRACE_FLAG__TRUNCATED;
+  }
+
+  record_length = WEBCARD_TRACE_FILE__ALIGN(
+    sizeof(SCardTraceRecord) + firstLength + secondLength);
+
+  /* Records never wrap: the end of the ring is skipped instead */
+
+  if ((header->ringSize - header->head) < record_length)
+  {
+    SCardTrace_makeRoom(header, trace, header->ringSize - header->head);
+
+    record = SCardTrace_recordAt(trace, header->head);
+    record->length = header->ringSize - header->head;
+    record->type = WEBCARD_TRACE_RECORD__PADDING;
+
+    header->usedBytes += record->length;
+    header->head = 0;
+  }
+
+  SCardTrace_makeRoom(header, trace, record_length);
+
+  /* Fill in the record, then publish it in the header */
+
+  record = SCardTrace_recordAt(trace, header->head);
+
+  record->length = (uint32_t) record_length;
+  record->type = type;
+  record->flags = flags;
+  record->time = (startTime > trace->startTime) ?
+    (startTime - trace->startTime) :
+    0;
+  record->duration = endTime - startTime;
+  record->reader = reader;
+  record->status = status;
+  record->dataLength = (uint32_t) (firstLength + secondLength);
+  record->split = (uint32_t) firstLength;
+
+  data = (LPBYTE) &(record[1]);
+
+  if (firstLength > 0)
+  {
+    memcpy(data, first, firstLength);
+  }
+
+  if (secondLength > 0)
+  {
+    memcpy(&(data[firstLength]), second, secondLength);
+  }
+
+  header->usedBytes += (uint32_t) record_length;
+  header->head += (uint32_t) record_length;
+
+  if (header->head >= header->ringSize)
+  {
+    header->head = 0;
+  }
+
+  header->written += 1;
+}
+
+/**************************************************************/
+
+size_t
+SCardTrace_usage(
+  _In_ const SCardTrace *trace,
+  _Out_ uint64_t *writtenRef,
+  _Out_ uint64_t *droppedRef)
+{
+  const SCardTraceHeader *header;
+
+  if (!SCardTrace_isOpen(trace))
+  {
+    writtenRef[0] = 0;
+    droppedRef[0] = 0;
+    return 0;
+  }
+
+  header = SCardTrace_header(trace);
+
+  writtenRef[0] = header->written;
+  droppedRef[0] = header->dropped;
+
+  return header->usedBytes;
+}
+
+/**************************************************************/
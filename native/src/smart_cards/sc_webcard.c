@@ -7,158 +7,154 @@
 
 /**************************************************************/
 
-#if defined(_DEBUG)
-
-  LPCSTR
-  WebCard_errorLookup(
-    _In_ const PCSC_LONG errorCode)
-  {
-    switch (errorCode)
-    {
-      #if defined(_WIN32)
-        case ERROR_BROKEN_PIPE:
-          return "ERROR_BROKEN_PIPE";
-        case SCARD_E_NO_PIN_CACHE:
-          return "SCARD_E_NO_PIN_CACHE";
-        case SCARD_E_PIN_CACHE_EXPIRED:
-          return "SCARD_E_PIN_CACHE_EXPIRED";
-        case SCARD_E_READ_ONLY_CARD:
-          return "SCARD_E_READ_ONLY_CARD";
-        case SCARD_E_UNEXPECTED:
-          return "SCARD_E_UNEXPECTED";
-        case SCARD_W_CACHE_ITEM_NOT_FOUND:
-          return "SCARD_W_CACHE_ITEM_NOT_FOUND";
-        case SCARD_W_CACHE_ITEM_STALE:
-          return "SCARD_W_CACHE_ITEM_STALE";
-        case SCARD_W_CACHE_ITEM_TOO_BIG:
-          return "SCARD_W_CACHE_ITEM_TOO_BIG";
-      #endif
-      case SCARD_E_BAD_SEEK:
-        return "SCARD_E_BAD_SEEK";
-      case SCARD_E_CANCELLED:
-        return "SCARD_E_CANCELLED";
-      case SCARD_E_CANT_DISPOSE:
-        return "SCARD_E_CANT_DISPOSE";
-      case SCARD_E_CARD_UNSUPPORTED:
-        return "SCARD_E_CARD_UNSUPPORTED";
-      case SCARD_E_CERTIFICATE_UNAVAILABLE:
-        return "SCARD_E_CERTIFICATE_UNAVAILABLE";
-      case SCARD_E_COMM_DATA_LOST:
-        return "SCARD_E_COMM_DATA_LOST";
-      case SCARD_E_DIR_NOT_FOUND:
-        return "SCARD_E_DIR_NOT_FOUND";
-      case SCARD_E_DUPLICATE_READER:
-        return "SCARD_E_DUPLICATE_READER";
-      case SCARD_E_FILE_NOT_FOUND:
-        return "SCARD_E_FILE_NOT_FOUND";
-      case SCARD_E_ICC_CREATEORDER:
-        return "SCARD_E_ICC_CREATEORDER";
-      case SCARD_E_ICC_INSTALLATION:
-        return "SCARD_E_ICC_INSTALLATION";
-      case SCARD_E_INSUFFICIENT_BUFFER:
-        return "SCARD_E_INSUFFICIENT_BUFFER";
-      case SCARD_E_INVALID_ATR:
-        return "SCARD_E_INVALID_ATR";
-      case SCARD_E_INVALID_CHV:
-        return "SCARD_E_INVALID_CHV";
-      case SCARD_E_INVALID_HANDLE:
-        return "SCARD_E_INVALID_HANDLE";
-      case SCARD_E_INVALID_PARAMETER:
-        return "SCARD_E_INVALID_PARAMETER";
-      case SCARD_E_INVALID_TARGET:
-        return "SCARD_E_INVALID_TARGET";
-      case SCARD_E_INVALID_VALUE:
-        return "SCARD_E_INVALID_VALUE";
-      case SCARD_E_NO_ACCESS:
-        return "SCARD_E_NO_ACCESS";
-      case SCARD_E_NO_DIR:
-        return "SCARD_E_NO_DIR";
-      case SCARD_E_NO_FILE:
-        return "SCARD_E_NO_FILE";
-      case SCARD_E_NO_KEY_CONTAINER:
-        return "SCARD_E_NO_KEY_CONTAINER";
-      case SCARD_E_NO_MEMORY:
-        return "SCARD_E_NO_MEMORY";
-      case SCARD_E_NO_READERS_AVAILABLE:
-        return "SCARD_E_NO_READERS_AVAILABLE";
-      case SCARD_E_NO_SERVICE:
-        return "SCARD_E_NO_SERVICE";
-      case SCARD_E_NO_SMARTCARD:
-        return "SCARD_E_NO_SMARTCARD";
-      case SCARD_E_NO_SUCH_CERTIFICATE:
-        return "SCARD_E_NO_SUCH_CERTIFICATE";
-      case SCARD_E_NOT_READY:
-        return "SCARD_E_NOT_READY";
-      case SCARD_E_NOT_TRANSACTED:
-        return "SCARD_E_NOT_TRANSACTED";
-      case SCARD_E_PCI_TOO_SMALL:
-        return "SCARD_E_PCI_TOO_SMALL";
-      case SCARD_E_PROTO_MISMATCH:
-        return "SCARD_E_PROTO_MISMATCH";
-      case SCARD_E_READER_UNAVAILABLE:
-        return "SCARD_E_READER_UNAVAILABLE";
-      case SCARD_E_READER_UNSUPPORTED:
-        return "SCARD_E_READER_UNSUPPORTED";
-      case SCARD_E_SERVER_TOO_BUSY:
-        return "SCARD_E_SERVER_TOO_BUSY";
-      case SCARD_E_SERVICE_STOPPED:
-        return "SCARD_E_SERVICE_STOPPED";
-      case SCARD_E_SHARING_VIOLATION:
-        return "SCARD_E_SHARING_VIOLATION";
-      case SCARD_E_SYSTEM_CANCELLED:
-        return "SCARD_E_SYSTEM_CANCELLED";
-      case SCARD_E_TIMEOUT:
-        return "SCARD_E_TIMEOUT";
-      case SCARD_E_UNKNOWN_CARD:
-        return "SCARD_E_UNKNOWN_CARD";
-      case SCARD_E_UNKNOWN_READER:
-        return "SCARD_E_UNKNOWN_READER";
-      case SCARD_E_UNKNOWN_RES_MNG:
-        return "SCARD_E_UNKNOWN_RES_MNG";
-      case SCARD_E_UNSUPPORTED_FEATURE:
-        return "SCARD_E_UNSUPPORTED_FEATURE";
-      case SCARD_E_WRITE_TOO_MANY:
-        return "SCARD_E_WRITE_TOO_MANY";
-      case SCARD_F_COMM_ERROR:
-        return "SCARD_F_COMM_ERROR";
-      case SCARD_F_INTERNAL_ERROR:
-        return "SCARD_F_INTERNAL_ERROR";
-      case SCARD_F_UNKNOWN_ERROR:
-        return "SCARD_F_UNKNOWN_ERROR";
-      case SCARD_F_WAITED_TOO_LONG:
-        return "SCARD_F_WAITED_TOO_LONG";
-      case SCARD_P_SHUTDOWN:
-        return "SCARD_P_SHUTDOWN";
-      case SCARD_S_SUCCESS:
-        return "SCARD_S_SUCCESS";
-      case SCARD_W_CANCELLED_BY_USER:
-        return "SCARD_W_CANCELLED_BY_USER";
-      case SCARD_W_CARD_NOT_AUTHENTICATED:
-        return "SCARD_W_CARD_NOT_AUTHENTICATED";
-      case SCARD_W_CHV_BLOCKED:
-        return "SCARD_W_CHV_BLOCKED";
-      case SCARD_W_EOF:
-        return "SCARD_W_EOF";
-      case SCARD_W_REMOVED_CARD:
-        return "SCARD_W_REMOVED_CARD";
-      case SCARD_W_RESET_CARD:
-        return "SCARD_W_RESET_CARD";
-      case SCARD_W_SECURITY_VIOLATION:
-        return "SCARD_W_SECURITY_VIOLATION";
-      case SCARD_W_UNPOWERED_CARD:
-        return "SCARD_W_UNPOWERED_CARD";
-      case SCARD_W_UNRESPONSIVE_CARD:
-        return "SCARD_W_UNRESPONSIVE_CARD";
-      case SCARD_W_UNSUPPORTED_CARD:
-        return "SCARD_W_UNSUPPORTED_CARD";
-      case SCARD_W_WRONG_CHV:
-        return "SCARD_W_WRONG_CHV";
-      default:
-        return "";
-    }
-  }
-
-#endif
+LPCSTR
+WebCard_errorLookup(
+  _In_ const PCSC_LONG errorCode)
+{
+  switch (errorCode)
+  {
+    #if defined(_WIN32)
+      case ERROR_BROKEN_PIPE:
+        return "ERROR_BROKEN_PIPE";
+      case SCARD_E_NO_PIN_CACHE:
+        return "SCARD_E_NO_PIN_CACHE";
+      case SCARD_E_PIN_CACHE_EXPIRED:
+        return "SCARD_E_PIN_CACHE_EXPIRED";
+      case SCARD_E_READ_ONLY_CARD:
+        return "SCARD_E_READ_ONLY_CARD";
+      case SCARD_E_UNEXPECTED:
+        return "SCARD_E_UNEXPECTED";
+      case SCARD_W_CACHE_ITEM_NOT_FOUND:
+        return "SCARD_W_CACHE_ITEM_NOT_FOUND";
+      case SCARD_W_CACHE_ITEM_STALE:
+        return "SCARD_W_CACHE_ITEM_STALE";
+      case SCARD_W_CACHE_ITEM_TOO_BIG:
+        return "SCARD_W_CACHE_ITEM_TOO_BIG";
+    #endif
+    case SCARD_E_BAD_SEEK:
+      return "SCARD_E_BAD_SEEK";
+    case SCARD_E_CANCELLED:
+      return "SCARD_E_CANCELLED";
+    case SCARD_E_CANT_DISPOSE:
+      return "SCARD_E_CANT_DISPOSE";
+    case SCARD_E_CARD_UNSUPPORTED:
+      return "SCARD_E_CARD_UNSUPPORTED";
+    case SCARD_E_CERTIFICATE_UNAVAILABLE:
+      return "SCARD_E_CERTIFICATE_UNAVAILABLE";
+    case SCARD_E_COMM_DATA_LOST:
+      return "SCARD_E_COMM_DATA_LOST";
+    case SCARD_E_DIR_NOT_FOUND:
+      return "SCARD_E_DIR_NOT_FOUND";
+    case SCARD_E_DUPLICATE_READER:
+      return "SCARD_E_DUPLICATE_READER";
+    case SCARD_E_FILE_NOT_FOUND:
+      return "SCARD_E_FILE_NOT_FOUND";
+    case SCARD_E_ICC_CREATEORDER:
+      return "SCARD_E_ICC_CREATEORDER";
+    case SCARD_E_ICC_INSTALLATION:
+      return "SCARD_E_ICC_INSTALLATION";
+    case SCARD_E_INSUFFICIENT_BUFFER:
+      return "SCARD_E_INSUFFICIENT_BUFFER";
+    case SCARD_E_INVALID_ATR:
+      return "SCARD_E_INVALID_ATR";
+    case SCARD_E_INVALID_CHV:
+      return "SCARD_E_INVALID_CHV";
+    case SCARD_E_INVALID_HANDLE:
+      return "SCARD_E_INVALID_HANDLE";
+    case SCARD_E_INVALID_PARAMETER:
+      return "SCARD_E_INVALID_PARAMETER";
+    case SCARD_E_INVALID_TARGET:
+      return "SCARD_E_INVALID_TARGET";
+    case SCARD_E_INVALID_VALUE:
+      return "SCARD_E_INVALID_VALUE";
+    case SCARD_E_NO_ACCESS:
+      return "SCARD_E_NO_ACCESS";
+    case SCARD_E_NO_DIR:
+      return "SCARD_E_NO_DIR";
+    case SCARD_E_NO_FILE:
+      return "SCARD_E_NO_FILE";
+    case SCARD_E_NO_KEY_CONTAINER:
+      return "SCARD_E_NO_KEY_CONTAINER";
+    case SCARD_E_NO_MEMORY:
+      return "SCARD_E_NO_MEMORY";
+    case SCARD_E_NO_READERS_AVAILABLE:
+      return "SCARD_E_NO_READERS_AVAILABLE";
+    case SCARD_E_NO_SERVICE:
+      return "SCARD_E_NO_SERVICE";
+    case SCARD_E_NO_SMARTCARD:
+      return "SCARD_E_NO_SMARTCARD";
+    case SCARD_E_NO_SUCH_CERTIFICATE:
+      return "SCARD_E_NO_SUCH_CERTIFICATE";
+    case SCARD_E_NOT_READY:
+      return "SCARD_E_NOT_READY";
+    case SCARD_E_NOT_TRANSACTED:
+      return "SCARD_E_NOT_TRANSACTED";
+    case SCARD_E_PCI_TOO_SMALL:
+      return "SCARD_E_PCI_TOO_SMALL";
+    case SCARD_E_PROTO_MISMATCH:
+      return "SCARD_E_PROTO_MISMATCH";
+    case SCARD_E_READER_UNAVAILABLE:
+      return "SCARD_E_READER_UNAVAILABLE";
+    case SCARD_E_READER_UNSUPPORTED:
+      return "SCARD_E_READER_UNSUPPORTED";
+    case SCARD_E_SERVER_TOO_BUSY:
+      return "SCARD_E_SERVER_TOO_BUSY";
+    case SCARD_E_SERVICE_STOPPED:
+      return "SCARD_E_SERVICE_STOPPED";
+    case SCARD_E_SHARING_VIOLATION:
+      return "SCARD_E_SHARING_VIOLATION";
+    case SCARD_E_SYSTEM_CANCELLED:
+      return "SCARD_E_SYSTEM_CANCELLED";
+    case SCARD_E_TIMEOUT:
+      return "SCARD_E_TIMEOUT";
+    case SCARD_E_UNKNOWN_CARD:
+      return "SCARD_E_UNKNOWN_CARD";
+    case SCARD_E_UNKNOWN_READER:
+      return "SCARD_E_UNKNOWN_READER";
+    case SCARD_E_UNKNOWN_RES_MNG:
+      return "SCARD_E_UNKNOWN_RES_MNG";
+    case SCARD_E_UNSUPPORTED_FEATURE:
+      return "SCARD_E_UNSUPPORTED_FEATURE";
+    case SCARD_E_WRITE_TOO_MANY:
+      return "SCARD_E_WRITE_TOO_MANY";
+    case SCARD_F_COMM_ERROR:
+      return "SCARD_F_COMM_ERROR";
+    case SCARD_F_INTERNAL_ERROR:
+      return "SCARD_F_INTERNAL_ERROR";
+    case SCARD_F_UNKNOWN_ERROR:
+      return "SCARD_F_UNKNOWN_ERROR";
+    case SCARD_F_WAITED_TOO_LONG:
+      return "SCARD_F_WAITED_TOO_LONG";
+    case SCARD_P_SHUTDOWN:
+      return "SCARD_P_SHUTDOWN";
+    case SCARD_S_SUCCESS:
+      return "SCARD_S_SUCCESS";
+    case SCARD_W_CANCELLED_BY_USER:
+      return "SCARD_W_CANCELLED_BY_USER";
+    case SCARD_W_CARD_NOT_AUTHENTICATED:
+      return "SCARD_W_CARD_NOT_AUTHENTICATED";
+    case SCARD_W_CHV_BLOCKED:
+      return "SCARD_W_CHV_BLOCKED";
+    case SCARD_W_EOF:
+      return "SCARD_W_EOF";
+    case SCARD_W_REMOVED_CARD:
+      return "SCARD_W_REMOVED_CARD";
+    case SCARD_W_RESET_CARD:
+      return "SCARD_W_RESET_CARD";
+    case SCARD_W_SECURITY_VIOLATION:
+      return "SCARD_W_SECURITY_VIOLATION";
+    case SCARD_W_UNPOWERED_CARD:
+      return "SCARD_W_UNPOWERED_CARD";
+    case SCARD_W_UNRESPONSIVE_CARD:
+      return "SCARD_W_UNRESPONSIVE_CARD";
+    case SCARD_W_UNSUPPORTED_CARD:
+      return "SCARD_W_UNSUPPORTED_CARD";
+    case SCARD_W_WRONG_CHV:
+      return "SCARD_W_WRONG_CHV";
+    default:
+      return "";
+  }
+}
 
 /**************************************************************/
 
@@ -168,42 +164,26 @@ WebCard_establishContext(
 {
   resultContext[0] = 0;
 
-  PCSC_LONG pcscResult = SCardEstablishContext(
-    SCARD_SCOPE_USER,
-    NULL,
-    NULL,
+  PCSC_LONG pcscResult = SCardBackend_current->establishContext(
     resultContext);
 
   if (SCARD_S_SUCCESS != pcscResult)
   {
-    #if defined(_DEBUG)
-    {
-      OSSpecific_writeDebugMessage(
-        "{SCardEstablishContext} failed: 0x%08X (%s)",
-        (uint32_t) pcscResult,
-        WebCard_errorLookup(pcscResult));
-    }
-    #endif
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{SCardEstablishContext} failed: 0x%08X (%s)",
+      (uint32_t) pcscResult,
+      WebCard_errorLookup(pcscResult));
 
+    resultContext[0] = 0;
     return FALSE;
   }
 
-  #if defined(_DEBUG)
-  {
-    UTF8String hexdump;
-    UTF8String_init(&(hexdump));
-    UTF8String_pushBytesAsHex(
-      &(hexdump),
-      sizeof(SCARDCONTEXT),
-      (const BYTE *) &(resultContext[0]));
-
-    OSSpecific_writeDebugMessage(
-      "{SCardEstablishContext} success: %s",
-      (LPCSTR) hexdump.text);
-
-    UTF8String_destroy(&(hexdump));
-  }
-  #endif
+  OSSpecific_writeLogBytes(
+    OS_SPECIFIC_LOG__INFO,
+    "{SCardEstablishContext} success",
+    (const BYTE *) &(resultContext[0]),
+    sizeof(SCARDCONTEXT));
 
   return TRUE;
 }
@@ -216,172 +196,466 @@ WebCard_init(
   _Out_ SCARDCONTEXT *resultContext)
 {
   int fetch_result;
-  BOOL should_fetch;
 
   SCardReaderDB_init(resultDatabase);
+  resultContext[0] = 0;
 
-  if (!WebCard_establishContext(resultContext))
+  /* Real PC/SC or simulated reader farm */
+
+  if (!SCardBackend_select())
   {
     return FALSE;
   }
 
-  should_fetch = TRUE;
-  while (should_fetch)
+  /* Without the service, the main loop keeps trying (`SCardRecovery`) */
+
+  if (!WebCard_establishContext(resultContext))
   {
-    should_fetch = FALSE;
+    return TRUE;
+  }
 
-    fetch_result = SCardReaderDB_fetch(
-      resultDatabase,
-      NULL,
-      resultContext[0],
-      TRUE);
+  fetch_result = SCardReaderDB_fetch(
+    resultDatabase,
+    NULL,
+    resultContext[0],
+    TRUE);
 
-    if (WEBCARD_FETCH_READERS__FAIL == fetch_result)
-    {
-      #if defined(_DEBUG)
-      {
-        OSSpecific_writeDebugMessage(
-          "{SCardReaderDB::fetch} failed");
-      }
-      #endif
+  if (WEBCARD_FETCH_READERS__FAIL == fetch_result)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__ERROR,
+      "{SCardReaderDB::fetch} failed");
 
-      return FALSE;
+    return FALSE;
+  }
+  else if (WEBCARD_FETCH_READERS__SERVICE_STOPPED == fetch_result)
+  {
+    SCardBackend_current->releaseContext(resultContext[0]);
+    resultContext[0] = 0;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Body of the startup thread: runs `WebCard_init`.
+ */
+OS_SPECIFIC_THREAD_ROUTINE(WebCard_runStartup)
+{
+  WebCardStartup *startup = (WebCardStartup *) parameter;
+  BOOL succeeded = WebCard_init(&(startup->database), &(startup->context));
+
+  OSSpecific_lockMutex(&(startup->mutex));
+  startup->succeeded = succeeded;
+  startup->finished = TRUE;
+  OSSpecific_unlockMutex(&(startup->mutex));
+
+  return 0;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_beginStartup(
+  _Out_ WebCardStartup *startup)
+{
+  OSSpecific_initMutex(&(startup->mutex));
+
+  startup->finished = FALSE;
+  startup->succeeded = FALSE;
+  startup->context = 0;
+  startup->startTime = OSSpecific_getMonotonicTime();
+
+  SCardReaderDB_init(&(startup->database));
+
+  startup->started = OSSpecific_startThread(
+    &(startup->thread),
+    WebCard_runStartup,
+    startup);
+
+  return startup->started;
+}
+
+/**************************************************************/
+
+int
+WebCard_finishStartup(
+  _Inout_ WebCardStartup *startup,
+  _Inout_ SCardReaderDB *database,
+  _Out_ SCARDCONTEXT *context,
+  _In_ const BOOL wait)
+{
+  BOOL finished;
+
+  if (startup->started)
+  {
+    if (wait)
+    {
+      OSSpecific_joinThread(startup->thread);
+      finished = TRUE;
     }
-    else if (WEBCARD_FETCH_READERS__SERVICE_STOPPED == fetch_result)
+    else
     {
-      SCardReleaseContext(resultContext[0]);
+      OSSpecific_lockMutex(&(startup->mutex));
+      finished = startup->finished;
+      OSSpecific_unlockMutex(&(startup->mutex));
 
-      if (!WebCard_establishContext(resultContext))
+      if (!finished)
       {
-        return FALSE;
+        return WEBCARD_STARTUP__PENDING;
       }
 
-      should_fetch = TRUE;
+      OSSpecific_joinThread(startup->thread);
     }
   }
 
-  return TRUE;
+  OSSpecific_destroyMutex(&(startup->mutex));
+
+  /* Requests handled so far have only updated the settings */
+  /* and statistics, which are kept (as on every re-load) */
+
+  SCardReaderDB_moveSettings(&(startup->database), database);
+  SCardReaderDB_destroy(database);
+
+  database[0] = startup->database;
+  context[0] = startup->context;
+
+  if (!startup->succeeded)
+  {
+    return WEBCARD_STARTUP__FAILED;
+  }
+
+  /* Persistent card data cache enabled in a previous session */
+
+  SCardCacheFile_resume(&(database->apduCache.persistent));
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{WebCard::startup} %u readers ready after %u ms",
+    (uint32_t) database->count,
+    (uint32_t) (OSSpecific_getMonotonicTime() - startup->startTime));
+
+  return WEBCARD_STARTUP__READY;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Releases a lost Smart Card Context, so that the main loop
+ * re-establishes it (`SCardRecovery`).
+ */
+VOID
+WebCard_loseContext(
+  _Inout_ SCardReaderDB *database,
+  _Inout_ SCARDCONTEXT *context)
+{
+  SCardFanOut *fan_out;
+
+  /* Worker threads go first (their contexts were lost as well) */
+
+  for (fan_out = database->fanOuts; NULL != fan_out; fan_out = fan_out->next)
+  {
+    SCardFanOut_stop(fan_out);
+    SCardFanOut_wait(fan_out);
+  }
+
+  if (NULL != database->jobs)
+  {
+    SCardJobQueue_wait(database->jobs);
+  }
+
+  SCardBackend_current->releaseContext(context[0]);
+  context[0] = 0;
+
+  SCardRecovery_lose(
+    &(database->recovery),
+    OSSpecific_getMonotonicTime());
 }
 
 /**************************************************************/
 
 VOID
-WebCard_run(void)
+WebCard_run(
+  _In_ const BOOL daemonMode)
 {
   SCARDCONTEXT context;
   SCardReaderDB database;
   int byte_stream_status;
   int fetch_result;
+  uint32_t ended_session;
 
-  JsonByteStream json_stream;
-  JsonObject json_request;
+  WebCardStartup startup;
+  SCardDaemon daemon;
+  SCardOutputQueue output;
+  SCardRequestQueue requests;
+  SCardQueuedRequest request;
   JsonObject json_response;
   JsonArray json_reader_names;
 
-  clock_t cpu_time_start = clock();
+  clock_t cpu_time_start;
   clock_t cpu_time_end;
   double cpu_time_elapsed;
 
-  BOOL should_fetch;
-  BOOL active = WebCard_init(&(database), &(context));
+  BOOL fetch_now = FALSE;
+  BOOL recovering;
+  BOOL congested;
+  BOOL active;
+  int startup_status = WEBCARD_STARTUP__PENDING;
+
+  /* PC/SC is brought up in the background: */
+  /* the first requests are read meanwhile */
+
+  SCardReaderDB_init(&(database));
+  context = 0;
+
+  WebCard_beginStartup(&(startup));
+
+  /* Requests are read ahead by a background thread */
+  /* (one per client in daemon mode) */
+
+  SCardRequestQueue_init(&(requests));
+  SCardDaemon_init(&(daemon));
+
+  /* Standard Output is written by a background thread */
+  /* (without it, messages are written right away) */
+
+  SCardOutputQueue_init(&(output));
+
+  if (!daemonMode)
+  {
+    SCardOutputQueue_start(&(output));
+  }
+
+  database.requests = &(requests);
+  active = SCardRequestQueue_start(&(requests), !daemonMode);
+
+  if (active && daemonMode)
+  {
+    active = SCardDaemon_start(&(daemon), &(requests));
+  }
+
+  while (active && (WEBCARD_STARTUP__READY != startup_status))
+  {
+    startup_status = WebCard_finishStartup(
+      &(startup),
+      &(database),
+      &(context),
+      FALSE);
+
+    if (WEBCARD_STARTUP__FAILED == startup_status)
+    {
+      active = FALSE;
+    }
+    else if (WEBCARD_STARTUP__PENDING == startup_status)
+    {
+      /* Only the requests that need no reader */
+
+      byte_stream_status = SCardRequestQueue_pop(
+        &(requests),
+        WebCard_isRequestRunnableEarly,
+        NULL,
+        &(request));
+
+      if (JSON_STREAM_STATUS__VALID == byte_stream_status)
+      {
+        WebCard_handleRequest(
+          &(request),
+          &(json_response),
+          &(database),
+          context);
+
+        SCardQueuedRequest_destroy(&(request));
+        JsonObject_destroy(&(json_response));
+      }
+      else if (JSON_STREAM_STATUS__NO_MORE == byte_stream_status)
+      {
+        active = FALSE;
+      }
+      else
+      {
+        OSSpecific_sleep(WEBCARD_STARTUP_POLL_INTERVAL);
+      }
+    }
+  }
+
+  cpu_time_start = clock();
+
+  /* Service not available at startup: same as a lost context */
+
+  if (active && (0 == context))
+  {
+    SCardRecovery_lose(&(database.recovery), OSSpecific_getMonotonicTime());
+  }
 
   while (active)
   {
+    /* 0) Re-establish a lost Smart Card Context */
+    /* (service restarted, or last reader unplugged on Windows) */
+
+    recovering = (WEBCARD_RECOVERY__READY != database.recovery.state);
+
+    if (recovering &&
+      SCardRecovery_isAttemptDue(&(database.recovery), OSSpecific_getMonotonicTime()))
+    {
+      if (WebCard_establishContext(&(context)))
+      {
+        SCardRecovery_succeed(&(database.recovery), OSSpecific_getMonotonicTime());
+
+        /* The readers might have changed meanwhile */
+
+        recovering = FALSE;
+        fetch_now = TRUE;
+      }
+      else
+      {
+        SCardRecovery_fail(&(database.recovery), OSSpecific_getMonotonicTime());
+      }
+    }
+
     cpu_time_end = clock();
     cpu_time_elapsed =
       ((double)(cpu_time_end - cpu_time_start)) / FIXED_CLOCKS_PER_SEC;
 
     /* Do the fetching every 1.0 second(s) */
 
-    if (cpu_time_elapsed >= 1.0)
+    if ((!recovering) && (fetch_now || (cpu_time_elapsed >= 1.0)))
     {
       cpu_time_start = cpu_time_end;
+      fetch_now = FALSE;
 
       /* 1) Fetch list of Smart Card Readers */
       /* (detecting plugging and unplugging) */
 
-      should_fetch = TRUE;
-      while (should_fetch)
+      fetch_result = SCardReaderDB_fetch(
+        &(database),
+        &(json_reader_names),
+        context,
+        FALSE);
+
+      if (WEBCARD_FETCH_READERS__SERVICE_STOPPED == fetch_result)
       {
-        should_fetch = FALSE;
+        WebCard_loseContext(&(database), &(context));
+        recovering = TRUE;
+      }
+      else if ((WEBCARD_FETCH_READERS__FAIL != fetch_result) &&
+        (WEBCARD_FETCH_READERS__IGNORE != fetch_result))
+      {
+        /* Waiting Card Events keep the reader indices of the old list: */
+        /* new events must not replace them */
 
-        fetch_result = SCardReaderDB_fetch(
+        SCardOutputQueue_forgetReaders(&(output));
+
+        WebCard_publishReaderEvent(
           &(database),
+          0,
+          (WEBCARD_FETCH_READERS__MORE_READERS == fetch_result) ?
+            WEBCARD_READER_EVENT__READERS_MORE :
+            WEBCARD_READER_EVENT__READERS_LESS,
           &(json_reader_names),
-          context,
-          FALSE);
+          0);
+      }
 
-        if ((WEBCARD_FETCH_READERS__FAIL != fetch_result) &&
-          (WEBCARD_FETCH_READERS__IGNORE != fetch_result))
-        {
-          if (WEBCARD_FETCH_READERS__SERVICE_STOPPED == fetch_result)
-          {
-            SCardReleaseContext(context);
-
-            if (WebCard_establishContext(&(context)))
-            {
-              /* Context re-established (Smart Card Service re-launched), */
-              /* now try fetching the list of readers again! */
-              should_fetch = TRUE;
-            }
-            else
-            {
-              active = FALSE;
-            }
-          }
-          else
-          {
-            WebCard_sendReaderEvent(
-              NULL,
-              0,
-              (WEBCARD_FETCH_READERS__MORE_READERS == fetch_result) ?
-                WEBCARD_READER_EVENT__READERS_MORE :
-                WEBCARD_READER_EVENT__READERS_LESS,
-              &(json_response),
-              &(json_reader_names));
-
-            JsonObject_destroy(&(json_response));
-          }
-        }
+      JsonArray_destroy(&(json_reader_names));
+    }
+
+    /* Clients of the daemon come and go */
 
-        JsonArray_destroy(&(json_reader_names));
+    if (active && daemonMode)
+    {
+      while (SCardDaemon_popEndedSession(&(daemon), &(ended_session)))
+      {
+        WebCard_endSession(&(database), ended_session);
       }
-    }
 
-    /* Smart Card Service Context might be lost */
-    /* when the last reader is unplugged */
+      if (SCardDaemon_isIdle(&(daemon)))
+      {
+        OSSpecific_writeLogMessage(
+          OS_SPECIFIC_LOG__INFO,
+          "{WebCard::run} no clients left, stopping the daemon");
+
+        active = FALSE;
+      }
+    }
 
     if (active)
     {
       /* 2) Update Smart Card Reader Status list */
       /* (detecting existence of smart cards) */
 
-      WebCard_handleStatusChange(&(database), context);
+      if ((!recovering) && !WebCard_handleStatusChange(&(database), context))
+      {
+        WebCard_loseContext(&(database), &(context));
+        recovering = TRUE;
+      }
+
+      /* Production-line jobs and fan-out readers that are done get reported */
+
+      WebCard_collectJobs(&(database));
+      WebCard_collectFanOuts(&(database));
 
-      /* 3) Parse commands from Standard Input */
+      /* 3) Handle commands read from Standard Input */
 
-      byte_stream_status = JsonByteStream_loadFromStandardInput(&(json_stream));
+      /* (Requests for readers owned by other clients keep waiting, */
+      /* and all requests for readers wait for a lost context) */
+
+      /* (No requests are taken while the browser is not reading */
+      /* the responses: reader events are still merged and queued) */
+
+      congested = SCardOutputQueue_isCongested(&(output));
+
+      byte_stream_status = congested ?
+        JSON_STREAM_STATUS__EMPTY :
+        SCardRequestQueue_pop(
+          &(requests),
+          recovering ? WebCard_isRequestRunnableEarly : WebCard_isRequestRunnable,
+          &(database),
+          &(request));
 
       if (JSON_STREAM_STATUS__VALID == byte_stream_status)
       {
         WebCard_handleRequest(
-          &(json_stream),
-          &(json_request),
+          &(request),
           &(json_response),
           &(database),
           context);
 
-        JsonObject_destroy(&(json_request));
+        SCardQueuedRequest_destroy(&(request));
         JsonObject_destroy(&(json_response));
       }
       else if (JSON_STREAM_STATUS__NO_MORE == byte_stream_status)
       {
         active = FALSE;
       }
+      else if (recovering)
+      {
+        OSSpecific_sleep(WEBCARD_STARTUP_POLL_INTERVAL);
+      }
+      else if (congested)
+      {
+        OSSpecific_sleep(WEBCARD_OUTPUT_CONGESTED_INTERVAL);
+      }
     }
   }
 
+  /* Session threads push to the queue until they are stopped */
+
+  SCardDaemon_destroy(&(daemon));
+  SCardRequestQueue_destroy(&(requests));
+
+  if (WEBCARD_STARTUP__PENDING == startup_status)
+  {
+    WebCard_finishStartup(&(startup), &(database), &(context), TRUE);
+  }
+
   WebCard_close(&(database), context);
+
+  /* Last messages are written before exiting */
+
+  SCardOutputQueue_destroy(&(output));
 }
 
 /**************************************************************/
@@ -395,99 +669,458 @@ WebCard_close(
 
   if (0 != context)
   {
-    SCardReleaseContext(context);
+    SCardBackend_current->releaseContext(context);
   }
+
+  SCardBackend_release();
 }
 
 /**************************************************************/
 
-VOID
-WebCard_handleRequest(
-  _Inout_ JsonByteStream *jsonStream,
-  _Out_ JsonObject *jsonRequest,
-  _Out_ JsonObject *jsonResponse,
-  _In_ const SCardReaderDB *database,
-  _In_ const SCARDCONTEXT context)
+/**
+ * @brief A private method for `WebCard` object.
+ * Finds where the fragment of a long message that starts at `offset`
+ * ends: after `WEBCARD_MESSAGE_FRAGMENT_SIZE` bytes, moved back
+ * to the start of a UTF-8 character.
+ */
+size_t
+WebCard_findFragmentEnd(
+  _In_ const UTF8String *message,
+  _In_ const size_t offset)
 {
-  BOOL test_bool;
-  JsonValue json_value;
-  UTF8String utf8_string;
-  size_t command;
-
-  /* Initialize JSON response object */
-  /* (it will be destroyed by caller) */
-
-  JsonObject_init(jsonResponse);
+  size_t end = offset + WEBCARD_MESSAGE_FRAGMENT_SIZE;
 
-  /* Initialize and load JSON request object */
-  /* Destroy `jsonStream` after parsing the JSON object */
-
-  test_bool = JsonObject_parse(
-    &(jsonRequest),
-    FALSE,
-    jsonStream);
+  if (end >= message->length)
+  {
+    return message->length;
+  }
 
-  JsonByteStream_destroy(jsonStream);
+  /* Continuation bytes are 10xxxxxx */
 
-  if (!test_bool)
+  while ((end > offset + 1) && (0x80 == (message->text[end] & 0xC0)))
   {
-    #if defined(_DEBUG)
-      OSSpecific_writeDebugMessage(
-        "{JSON Request} parsing error!");
-    #endif
-
-    return;
+    end -= 1;
   }
 
-  /* Try to find the "i" key (unique message identifier) */
+  return end;
+}
 
-  test_bool = JsonObject_getValue(
-    jsonRequest,
-    &(json_value),
-    "i");
+/**************************************************************/
 
-  if (!test_bool || (JSON_VALUE_TYPE__STRING != json_value.type))
+/**
+ * @brief A private method for `WebCard` object.
+ * Sends a message longer than `WEBCARD_MESSAGE_MAX_SIZE` in order as
+ * `{<routing keys>, f: [fragment number, fragments], t: part of the message}`,
+ * which the JavaScript library joins and parses again.
+ *
+ * @param[in] jsonRouting Keys copied into every fragment: "i" for
+ * a response, "e" and "k" for a Reader Event.
+ */
+BOOL
+WebCard_sendFragments(
+  _In_ const JsonObject *jsonRouting,
+  _In_ const UTF8String *message,
+  _In_ const uint32_t session)
+{
+  BOOL test_bool = TRUE;
+  FLOAT test_float;
+  JsonValue json_value;
+  JsonArray json_array;
+  JsonObject json_fragment;
+  UTF8String utf8_part;
+  UTF8String utf8_string;
+  size_t offset;
+  size_t end;
+  size_t count = 0;
+  size_t index = 0;
+
+  /* Fragments end on whole UTF-8 characters */
+  /* (counted first: every fragment carries the total) */
+
+  for (offset = 0; offset < message->length; offset = end)
   {
-    return;
+    end = WebCard_findFragmentEnd(message, offset);
+    count += 1;
   }
 
-  /* Try to append the "i" key to JSON response */
+  for (offset = 0; test_bool && (offset < message->length); offset = end)
+  {
+    end = WebCard_findFragmentEnd(message, offset);
 
-  test_bool = JsonObject_appendKeyValue(
-    jsonResponse,
-    "i",
-    &(json_value));
+    JsonArray_init(&(json_array));
 
-  if (!test_bool) { return; }
+    test_bool = JsonObject_copy(&(json_fragment), jsonRouting);
 
-  /* Try to find the "c" key (request command) */
+    /* Key "f" (fragment number and number of fragments) */
 
-  test_bool = JsonObject_getValue(
-    jsonRequest,
-    &(json_value),
-    "c");
+    json_value.type = JSON_VALUE_TYPE__NUMBER;
+    json_value.value = &(test_float);
 
-  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
-  {
-    return;
-  }
+    test_float = (FLOAT) index;
+    test_bool = test_bool && JsonArray_append(&(json_array), &(json_value));
 
-  /* Handle requested command */
+    test_float = (FLOAT) count;
+    test_bool = test_bool && JsonArray_append(&(json_array), &(json_value));
 
-  command = (size_t) (((FLOAT *) json_value.value)[0]);
+    json_value.type = JSON_VALUE_TYPE__ARRAY;
+    json_value.value = &(json_array);
 
-  switch (command)
-  {
-    case WEBCARD_COMMAND__LIST_READERS:
-    {
-      test_bool = WebCard_pushReadersListToJsonResponse(
-        jsonResponse,
-        database);
+    test_bool = test_bool &&
+      JsonObject_appendKeyValue(&(json_fragment), "f", &(json_value));
 
-      break;
-    }
+    /* Key "t" (part of the stringified message) */
 
-    case WEBCARD_COMMAND__CONNECT:
+    utf8_part.text = &(message->text[offset]);
+    utf8_part.length = end - offset;
+    utf8_part.capacity = utf8_part.length;
+
+    json_value.type = JSON_VALUE_TYPE__STRING;
+    json_value.value = &(utf8_part);
+
+    test_bool = test_bool &&
+      JsonObject_appendKeyValue(&(json_fragment), "t", &(json_value));
+
+    UTF8String_init(&(utf8_string));
+
+    test_bool = test_bool &&
+      JsonObject_toString(&(json_fragment), &(utf8_string)) &&
+      SCardDaemon_send(session, &(utf8_string));
+
+    UTF8String_destroy(&(utf8_string));
+    JsonArray_destroy(&(json_array));
+    JsonObject_destroy(&(json_fragment));
+
+    index += 1;
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Sends a message that carries the "i" key of a request, in fragments
+ * when it is longer than `WEBCARD_MESSAGE_MAX_SIZE`.
+ */
+BOOL
+WebCard_sendToRequester(
+  _In_ const JsonValue *jsonId,
+  _In_ const UTF8String *message,
+  _In_ const uint32_t session)
+{
+  BOOL test_bool;
+  JsonObject json_routing;
+
+  if (message->length <= WEBCARD_MESSAGE_MAX_SIZE)
+  {
+    return SCardDaemon_send(session, message);
+  }
+
+  JsonObject_init(&(json_routing));
+
+  test_bool =
+    JsonObject_appendKeyValue(&(json_routing), "i", jsonId) &&
+    WebCard_sendFragments(&(json_routing), message, session);
+
+  JsonObject_destroy(&(json_routing));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Sends a Reader Event (stringified from `jsonEvent`), in fragments
+ * that keep its "e" and "k" keys when it is longer than
+ * `WEBCARD_MESSAGE_MAX_SIZE` (e.g. prefetch responses or job reports).
+ */
+BOOL
+WebCard_sendEvent(
+  _In_ const JsonObject *jsonEvent,
+  _In_ const UTF8String *message,
+  _In_ const uint32_t session)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  JsonObject json_routing;
+
+  if (message->length <= WEBCARD_MESSAGE_MAX_SIZE)
+  {
+    return SCardDaemon_send(session, message);
+  }
+
+  JsonObject_init(&(json_routing));
+
+  test_bool =
+    JsonObject_getValue(jsonEvent, &(json_value), "e") &&
+    JsonObject_appendKeyValue(&(json_routing), "e", &(json_value));
+
+  if (test_bool && JsonObject_getValue(jsonEvent, &(json_value), "k"))
+  {
+    test_bool = JsonObject_appendKeyValue(&(json_routing), "k", &(json_value));
+  }
+
+  test_bool = test_bool &&
+    WebCard_sendFragments(&(json_routing), message, session);
+
+  JsonObject_destroy(&(json_routing));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+VOID
+WebCard_handleRequest(
+  _Inout_ SCardQueuedRequest *request,
+  _Out_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context)
+{
+  BOOL test_bool;
+  BOOL command_failed;
+  BOOL fan_out_started;
+  JsonValue json_value;
+  JsonValue json_id;
+  UTF8String utf8_string;
+  size_t command;
+  FLOAT test_float;
+  const JsonObject *jsonRequest = &(request->object);
+  uint64_t timestamps[WEBCARD_STAGE_COUNT];
+  SCardReaderStats *reader_stats;
+
+  /* Stages are timed until the response is written */
+  /* (message was read and parsed by the reader thread) */
+
+  timestamps[0] = request->arrivalTime;
+  timestamps[1] = request->readTime;
+
+  /* Initialize JSON response object */
+  /* (it will be destroyed by caller) */
+
+  JsonObject_init(jsonResponse);
+
+  /* Try to find the "i" key (unique message identifier) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "i");
+
+  if (!test_bool || (JSON_VALUE_TYPE__STRING != json_value.type))
+  {
+    return;
+  }
+
+  /* Try to append the "i" key to JSON response */
+
+  test_bool = JsonObject_appendKeyValue(
+    jsonResponse,
+    "i",
+    &(json_value));
+
+  if (!test_bool) { return; }
+
+  /* Try to find the "c" key (request command) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "c");
+
+  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
+  {
+    return;
+  }
+
+  /* Handle requested command (unless it has already expired) */
+
+  command = (size_t) (((FLOAT *) json_value.value)[0]);
+
+  OSSpecific_probe3(
+    request__start,
+    request->id,
+    command,
+    request->stream.head_length);
+
+  timestamps[2] = OSSpecific_getPreciseTime();
+
+  /* New connections and subscriptions belong to this session */
+
+  database->session = request->session;
+
+  /* Time spent waiting for another client to release the reader */
+
+  if ((0 != request->blockedTime) && (request->reader < database->count))
+  {
+    reader_stats = SCardStats_findReader(
+      &(database->stats),
+      database->states[request->reader].szReader);
+
+    if (NULL != reader_stats)
+    {
+      SCardLatencyHistogram_record(
+        &(reader_stats->wait),
+        timestamps[2] - request->arrivalTime);
+    }
+  }
+
+  test_bool = SCardRequestQueue_begin(
+    database->requests,
+    request,
+    context);
+
+  if (test_bool)
+  {
+    test_bool = WebCard_executeCommand(
+      command,
+      jsonRequest,
+      jsonResponse,
+      database,
+      context);
+  }
+
+  /* A fan-out that has started is answered once its readers are done */
+  /* (see `WebCard_collectFanOuts`), at the head of the running ones */
+
+  fan_out_started = test_bool && (WEBCARD_COMMAND__FAN_OUT == command);
+
+  /* Nothing more to send if the request timed out or was cancelled */
+  /* meanwhile: the queue has already answered it */
+
+  if (SCardRequestQueue_finish(database->requests, request))
+  {
+    /* Try to always send a JSON Response (so that a JavaScript Promise */
+    /* won't hang), even if a WebCard's command-handling function has failed */
+
+    command_failed = !test_bool;
+
+    if (command_failed)
+    {
+      /* Append an optional key-value "incomplete=true" */
+
+      json_value.type = JSON_VALUE_TYPE__TRUE;
+      json_value.value = NULL;
+
+      JsonObject_appendKeyValue(jsonResponse, "incomplete", &(json_value));
+    }
+
+    if (WEBCARD_REQUEST_STATE__PENDING != request->state)
+    {
+      /* Expired before it could run: "x" tells why */
+
+      test_float = (FLOAT) request->state;
+
+      json_value.type = JSON_VALUE_TYPE__NUMBER;
+      json_value.value = &(test_float);
+
+      JsonObject_appendKeyValue(jsonResponse, "x", &(json_value));
+    }
+
+    timestamps[3] = OSSpecific_getPreciseTime();
+
+    /* Stringify JSON response and send it through the STDOUT stream */
+    /* (or to the client of the daemon that sent the request) */
+
+    UTF8String_init(&(utf8_string));
+
+    test_bool = JsonObject_toString(jsonResponse, &(utf8_string));
+
+    timestamps[4] = OSSpecific_getPreciseTime();
+
+    if (fan_out_started)
+    {
+      database->fanOuts->deadline = request->deadline;
+    }
+    else if (test_bool)
+    {
+      /* "i" was the first key of the response */
+
+      JsonObject_getValue(jsonResponse, &(json_id), "i");
+
+      WebCard_sendToRequester(&(json_id), &(utf8_string), request->session);
+    }
+
+    OSSpecific_probe4(
+      request__done,
+      request->id,
+      command,
+      command_failed,
+      test_bool ? utf8_string.length : 0);
+
+    UTF8String_destroy(&(utf8_string));
+  }
+  else
+  {
+    command_failed = TRUE;
+
+    if (fan_out_started)
+    {
+      SCardFanOut_stop(database->fanOuts);
+      database->fanOuts->answered = TRUE;
+    }
+
+    timestamps[3] = OSSpecific_getPreciseTime();
+    timestamps[4] = timestamps[3];
+
+    OSSpecific_probe4(
+      request__done,
+      request->id,
+      command,
+      command_failed,
+      0);
+  }
+
+  timestamps[5] = OSSpecific_getPreciseTime();
+
+  SCardStats_recordRequest(
+    &(database->stats),
+    command,
+    command_failed,
+    timestamps);
+
+  SCardTrace_record(
+    &(database->trace),
+    WEBCARD_TRACE_RECORD__REQUEST,
+    command_failed ? WEBCARD_TRACE_FLAG__FAILED : 0,
+    WEBCARD_TRACE_NO_READER,
+    (uint32_t) command,
+    timestamps[0],
+    timestamps[5],
+    request->stream.head,
+    request->stream.head_length,
+    NULL,
+    0);
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_executeCommand(
+  _In_ const size_t command,
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  UTF8String utf8_string;
+
+  switch (command)
+  {
+    case WEBCARD_COMMAND__LIST_READERS:
+    {
+      test_bool = WebCard_pushReadersListToJsonResponse(
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__CONNECT:
     {
       test_bool = WebCard_tryConnectingToReader(
         jsonRequest,
@@ -495,152 +1128,3553 @@ WebCard_handleRequest(
         database,
         context);
 
-      break;
+      break;
+    }
+
+    case WEBCARD_COMMAND__DISCONNECT:
+    {
+      test_bool = WebCard_tryDisconnectingFromReader(
+        jsonRequest,
+        database);
+
+      /* "Empty" response (JSON object containing the "i" key only) */
+      /* will be required to resolve a "JavaScript Promise" */
+      break;
+    }
+
+    case WEBCARD_COMMAND__TRANSCEIVE:
+    {
+      test_bool = WebCard_transmitAndReceive(
+        jsonRequest,
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__GET_VERSION:
+    {
+      UTF8String_makeTemporary(&(utf8_string), WEBCARD_VERSION);
+
+      json_value.type = JSON_VALUE_TYPE__STRING;
+      json_value.value = &(utf8_string);
+
+      test_bool = JsonObject_appendKeyValue(
+        jsonResponse,
+        "verNat",
+        &(json_value));
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__DEBOUNCE:
+    {
+      test_bool = WebCard_configureDebounce(
+        jsonRequest,
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__SUBSCRIBE:
+    {
+      test_bool = WebCard_subscribeToEvents(
+        jsonRequest,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__UNSUBSCRIBE:
+    {
+      test_bool = WebCard_unsubscribeFromEvents(
+        jsonRequest,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__APDU_CACHE:
+    {
+      test_bool = WebCard_configureApduCache(
+        jsonRequest,
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__CARD_CACHE:
+    {
+      test_bool = WebCard_configureCardCache(
+        jsonRequest,
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__PREFETCH:
+    {
+      test_bool = WebCard_registerPrefetchScript(
+        jsonRequest,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__STATS:
+    {
+      test_bool = WebCard_reportStatistics(
+        jsonRequest,
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__TRACE:
+    {
+      test_bool = WebCard_configureTrace(
+        jsonRequest,
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__LOG:
+    {
+      test_bool = WebCard_configureLogging(
+        jsonRequest,
+        jsonResponse);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__LINGER:
+    {
+      test_bool = WebCard_configureLinger(
+        jsonRequest,
+        jsonResponse,
+        database);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__FAN_OUT:
+    {
+      test_bool = WebCard_fanOut(
+        jsonRequest,
+        jsonResponse,
+        database,
+        context);
+
+      break;
+    }
+
+    case WEBCARD_COMMAND__JOBS:
+    {
+      test_bool = WebCard_configureJobs(
+        jsonRequest,
+        jsonResponse,
+        database,
+        context);
+
+      break;
+    }
+
+    default:
+    {
+      test_bool = TRUE;
+    }
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_pushReaderNameToJsonString(
+  _In_ const SCARD_READERSTATE *readerState,
+  _Out_ UTF8String *resultReaderName)
+{
+  BOOL test_bool;
+
+  #ifdef _UNICODE
+    UTF16String utf16_reader_name;
+  #endif
+
+  UTF8String_init(resultReaderName);
+
+  #ifdef _UNICODE
+  {
+    UTF16String_init(&(utf16_reader_name));
+
+    test_bool = UTF16String_pushText(
+      &(utf16_reader_name),
+      readerState->szReader,
+      0);
+
+    if (test_bool)
+    {
+      test_bool = UTF16String_toUTF8(
+        &(utf16_reader_name),
+        resultReaderName);
+    }
+
+    UTF16String_destroy(&(utf16_reader_name));
+  }
+  #else
+  {
+    test_bool = UTF8String_pushText(
+      resultReaderName,
+      readerState->szReader,
+      0);
+  }
+  #endif
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_pushReaderNameToJsonArray(
+  _In_ const SCARD_READERSTATE *readerState,
+  _Inout_ JsonArray *jsonArray)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  UTF8String utf8_reader_name;
+
+  test_bool = WebCard_pushReaderNameToJsonString(
+    readerState,
+    &(utf8_reader_name));
+
+  if (!test_bool)
+  {
+    UTF8String_destroy(&(utf8_reader_name));
+    return FALSE;
+  }
+
+  /* Put "Reader Name" at the end of given array */
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+  json_value.value = &(utf8_reader_name);
+
+  test_bool = JsonArray_append(jsonArray, &(json_value));
+
+  UTF8String_destroy(&(utf8_reader_name));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_pushReaderNameToJsonObject(
+  _In_ const SCARD_READERSTATE *readerState,
+  _Inout_ JsonObject *jsonObject,
+  _In_ LPCSTR key)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  UTF8String utf8_reader_name;
+
+  test_bool = WebCard_pushReaderNameToJsonString(
+    readerState,
+    &(utf8_reader_name));
+
+  if (!test_bool)
+  {
+    UTF8String_destroy(&(utf8_reader_name));
+    return FALSE;
+  }
+
+  /* Add "Reader Name" under a specified key */
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+  json_value.value = &(utf8_reader_name);
+
+  test_bool = JsonObject_appendKeyValue(
+    jsonObject,
+    key,
+    &(json_value));
+
+  UTF8String_destroy(&(utf8_reader_name));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_convertReaderStateToJsonObject(
+  _In_ const SCARD_READERSTATE *readerState,
+  _Out_ JsonObject *jsonReaderObject)
+{
+  BOOL test_bool;
+
+  /* Initialize JSON reader object */
+  /* (it will be destroyed by caller) */
+
+  JsonObject_init(jsonReaderObject);
+
+  /* Add key "n" (Reader Name) */
+
+  test_bool = WebCard_pushReaderNameToJsonObject(
+    readerState,
+    jsonReaderObject,
+    "n");
+
+  if (!test_bool) { return FALSE; }
+
+  /* Add key "a" (card Answer To Reset) */
+
+  return WebCard_pushReaderAtrToJsonObject(
+    readerState,
+    jsonReaderObject,
+    "a");
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_pushReaderAtrToJsonObject(
+  _In_ const SCARD_READERSTATE *readerState,
+  _Inout_ JsonObject *jsonObject,
+  _In_ LPCSTR key)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  UTF8String utf8_string;
+
+  /* Copy Smart Card "ATR" identifier (bytearray to text) */
+
+  UTF8String_init(&(utf8_string));
+
+  test_bool = UTF8String_pushBytesAsHex(
+    &(utf8_string),
+    readerState->cbAtr,
+    readerState->rgbAtr);
+
+  if (!test_bool)
+  {
+    UTF8String_destroy(&(utf8_string));
+    return FALSE;
+  }
+
+  /* Add "card Answer To Reset" under a specified key */
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+  json_value.value = &(utf8_string);
+
+  test_bool = JsonObject_appendKeyValue(
+    jsonObject,
+    key,
+    &(json_value));
+
+  UTF8String_destroy(&(utf8_string));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_convertReaderStatesToJsonArray(
+  _In_ const SCardReaderDB *database,
+  _Out_ JsonArray *jsonReadersArray)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  JsonObject json_reader_object;
+
+  json_value.type = JSON_VALUE_TYPE__OBJECT;
+  json_value.value = &(json_reader_object);
+
+  /* Initialize JSON reader object */
+  /* (it will be destroyed by caller) */
+
+  JsonArray_init(jsonReadersArray);
+
+  /* Enumerate Smart Card Readers */
+
+  for (size_t i = 0; i < database->count; i++)
+  {
+    test_bool = WebCard_convertReaderStateToJsonObject(
+      &(database->states[i]),
+      &(json_reader_object));
+
+    if (test_bool)
+    {
+      test_bool = JsonArray_append(
+        jsonReadersArray,
+        &(json_value));
+    }
+
+    JsonObject_destroy(&(json_reader_object));
+
+    if (!test_bool)
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_pushReadersListToJsonResponse(
+  _Inout_ JsonObject *jsonResponse,
+  _In_ const SCardReaderDB *database)
+{
+  BOOL test_bool;
+  JsonArray json_readers_array;
+  JsonValue json_value;
+
+  test_bool = WebCard_convertReaderStatesToJsonArray(
+    database,
+    &(json_readers_array));
+
+  if (!test_bool)
+  {
+    JsonArray_destroy(&(json_readers_array));
+    return FALSE;
+  }
+
+  json_value.type = JSON_VALUE_TYPE__ARRAY;
+  json_value.value = &(json_readers_array);
+
+  test_bool = JsonObject_appendKeyValue(
+    jsonResponse,
+    "d",
+    &(json_value));
+
+  JsonArray_destroy(&(json_readers_array));
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Checks if a reader is busy with a running fan-out.
+ */
+BOOL
+WebCard_isReaderInFanOut(
+  _In_ const SCardReaderDB *database,
+  _In_ LPCTSTR readerName)
+{
+  const SCardFanOut *fan_out;
+
+  for (fan_out = database->fanOuts; NULL != fan_out; fan_out = fan_out->next)
+  {
+    if (SCardFanOut_usesReader(fan_out, readerName))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_isRequestRunnable(
+  _In_ const SCardQueuedRequest *request,
+  _In_opt_ const void *parameter)
+{
+  const SCardReaderDB *database = (const SCardReaderDB *) parameter;
+  JsonValue json_value;
+  const JsonArray *json_array;
+  size_t reader_index;
+
+  /* Fan-out waits for every listed reader (without a list, readers */
+  /* used by other clients or by other fan-outs are simply skipped) */
+
+  if (WEBCARD_COMMAND__FAN_OUT == request->command)
+  {
+    if (!JsonObject_getValue(&(request->object), &(json_value), "r") ||
+      (JSON_VALUE_TYPE__ARRAY != json_value.type))
+    {
+      return TRUE;
+    }
+
+    json_array = json_value.value;
+
+    for (size_t i = 0; i < json_array->count; i++)
+    {
+      if (JSON_VALUE_TYPE__NUMBER != json_array->values[i].type)
+      {
+        continue;
+      }
+
+      reader_index = (size_t) (((FLOAT *) json_array->values[i].value)[0]);
+
+      if ((reader_index < database->count) &&
+        (!SCardConnection_isAvailableTo(
+          &(database->connections[reader_index]),
+          request->session,
+          request->client) ||
+        WebCard_isReaderInFanOut(database, database->states[reader_index].szReader)))
+      {
+        return FALSE;
+      }
+    }
+
+    return TRUE;
+  }
+
+  /* Only connections and transmissions wait for the reader */
+
+  if ((WEBCARD_COMMAND__CONNECT != request->command) &&
+    (WEBCARD_COMMAND__TRANSCEIVE != request->command))
+  {
+    return TRUE;
+  }
+
+  /* Invalid reader index is reported by the command itself */
+
+  if (request->reader >= database->count)
+  {
+    return TRUE;
+  }
+
+  /* The card is not shared with a running fan-out */
+
+  if (WebCard_isReaderInFanOut(database, database->states[request->reader].szReader))
+  {
+    return FALSE;
+  }
+
+  return SCardConnection_isAvailableTo(
+    &(database->connections[request->reader]),
+    request->session,
+    request->client);
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_isRequestRunnableEarly(
+  _In_ const SCardQueuedRequest *request,
+  _In_opt_ const void *parameter)
+{
+  switch (request->command)
+  {
+    case WEBCARD_COMMAND__GET_VERSION:
+    case WEBCARD_COMMAND__LOG:
+    {
+      return TRUE;
+    }
+
+    /* Settings wait as well, so that they apply to the readers */
+
+    case WEBCARD_COMMAND__LIST_READERS:
+    case WEBCARD_COMMAND__CONNECT:
+    case WEBCARD_COMMAND__DISCONNECT:
+    case WEBCARD_COMMAND__TRANSCEIVE:
+    case WEBCARD_COMMAND__DEBOUNCE:
+    case WEBCARD_COMMAND__SUBSCRIBE:
+    case WEBCARD_COMMAND__UNSUBSCRIBE:
+    case WEBCARD_COMMAND__APDU_CACHE:
+    case WEBCARD_COMMAND__CARD_CACHE:
+    case WEBCARD_COMMAND__PREFETCH:
+    case WEBCARD_COMMAND__STATS:
+    case WEBCARD_COMMAND__TRACE:
+    case WEBCARD_COMMAND__LINGER:
+    case WEBCARD_COMMAND__FAN_OUT:
+    case WEBCARD_COMMAND__JOBS:
+    {
+      return FALSE;
+    }
+
+    /* Unknown commands (pings) only get an empty response */
+
+    default:
+    {
+      return TRUE;
+    }
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Finds the client key ("k") of a Connect or Disconnect request.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object.
+ * @return Client key (valid as long as `jsonRequest`), `NULL` if missing.
+ */
+LPCSTR
+WebCard_findClientKey(
+  _In_ const JsonObject *jsonRequest)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "k");
+
+  if (!test_bool || (JSON_VALUE_TYPE__STRING != json_value.type))
+  {
+    return NULL;
+  }
+
+  return (LPCSTR) ((UTF8String *) json_value.value)->text;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Ends the use of a connection: closes it, or lets it linger
+ * when a linger time is set (shared connections only).
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in,out] connection One of the connections of `database`.
+ * @return `TRUE` on success, `FALSE` if any Smart Card error has occurred.
+ */
+BOOL
+WebCard_releaseConnection(
+  _Inout_ SCardReaderDB *database,
+  _Inout_ SCardConnection *connection)
+{
+  /* An exclusive handle would lock other applications out of the */
+  /* card, and PC/SC does not report their failed attempts: it is */
+  /* never kept */
+
+  if ((0 != database->lingerTime) &&
+    (0 != connection->handle) &&
+    (SCARD_SHARE_EXCLUSIVE != connection->shareMode))
+  {
+    SCardConnection_linger(
+      connection,
+      OSSpecific_getMonotonicTime() + database->lingerTime);
+
+    return TRUE;
+  }
+
+  return SCardConnection_close(connection);
+}
+
+/**************************************************************/
+
+VOID
+WebCard_endSession(
+  _Inout_ SCardReaderDB *database,
+  _In_ const uint32_t session)
+{
+  SCardConnection *connection;
+  SCardFanOut *fan_out;
+  size_t released = 0;
+
+  if (NULL != database->requests)
+  {
+    SCardRequestQueue_cancelClient(database->requests, session, NULL);
+  }
+
+  for (size_t i = 0; i < database->count; i++)
+  {
+    connection = &(database->connections[i]);
+
+    if ((NULL != connection->owner) && (session == connection->ownerSession))
+    {
+      WebCard_releaseConnection(database, connection);
+      released += 1;
+    }
+  }
+
+  SCardReaderDB_unsubscribe(database, session, NULL);
+
+  /* Nobody left to report the waiting jobs to */
+
+  if ((NULL != database->jobs) && (session == database->jobs->session))
+  {
+    SCardJobQueue_clear(database->jobs);
+  }
+
+  /* Nor to answer the running fan-outs (they are still finished) */
+
+  for (fan_out = database->fanOuts; NULL != fan_out; fan_out = fan_out->next)
+  {
+    if (session == fan_out->session)
+    {
+      fan_out->answered = TRUE;
+    }
+  }
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{WebCard::endSession} session %u: %u readers released",
+    session,
+    (uint32_t) released);
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_tryConnectingToReader(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context)
+{
+  BOOL test_bool;
+  size_t reader_index;
+  SCardConnection *connection;
+  const SCARD_READERSTATE *readerState;
+  PCSC_DWORD share_mode = SCARD_SHARE_SHARED;
+  JsonValue json_value;
+  LPCSTR client;
+
+  /* Try to find the "r" key (reader index) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "r");
+
+  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::tryConnectingToReader} failed: " \
+      "missing \"r\" key!"
+    );
+
+    return FALSE;
+  }
+
+  reader_index = (size_t) (((FLOAT *) json_value.value)[0]);
+
+  if (reader_index >= database->count)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::tryConnectingToReader} failed: " \
+      "invalid reader index!"
+    );
+
+    return FALSE;
+  }
+
+  /* Try to find the "p" key (optional share mode param) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "p");
+
+  if (test_bool && (JSON_VALUE_TYPE__NUMBER == json_value.type))
+  {
+    share_mode = (PCSC_DWORD) (((FLOAT *) json_value.value)[0]);
+  }
+
+  readerState = &(database->states[reader_index]);
+  connection = &(database->connections[reader_index]);
+
+  /* Try to find the "d" key (optional cAPDUs replayed after a card reset) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "d");
+
+  test_bool = SCardConnection_setRestoreScript(
+    connection,
+    (test_bool && (JSON_VALUE_TYPE__ARRAY == json_value.type)) ?
+      json_value.value :
+      NULL);
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::tryConnectingToReader} failed: " \
+      "invalid \"d\" key!"
+    );
+
+    return FALSE;
+  }
+
+  if (SCardConnection_reuse(connection, share_mode))
+  {
+    /* Lingering connection taken over (no "SCardConnect" needed) */
+
+    database->lingerHits += 1;
+  }
+  else
+  {
+    if ((0 != database->lingerTime) && (0 == connection->handle))
+    {
+      database->lingerMisses += 1;
+    }
+
+    /* Try to open a connection to active Smart Card */
+
+    test_bool = SCardConnection_open(
+      connection,
+      context,
+      readerState->szReader,
+      share_mode);
+
+    if (!test_bool) { return FALSE; }
+  }
+
+  /* Try to find the "e" key (optional, repeated "SELECT" answered */
+  /* without the card). Ignored in shared mode: "SELECT" commands */
+  /* of other applications are not reported by PC/SC. */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "e");
+
+  connection->elideSelect = test_bool &&
+    (SCARD_SHARE_EXCLUSIVE == share_mode) &&
+    (JSON_VALUE_TYPE__NUMBER == json_value.type) &&
+    (0 != ((FLOAT *) json_value.value)[0]);
+
+  /* Other clients wait until this one disconnects */
+
+  client = WebCard_findClientKey(jsonRequest);
+
+  test_bool = SCardConnection_setOwner(
+    connection,
+    database->session,
+    (NULL != client) ? client : "");
+
+  if (!test_bool) { return FALSE; }
+
+  /* Add key "d" (card Answer To Reset) */
+
+  return WebCard_pushReaderAtrToJsonObject(
+    readerState,
+    jsonResponse,
+    "d");
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_tryDisconnectingFromReader(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  size_t reader_index;
+  JsonValue json_value;
+  SCardConnection *connection;
+  LPCSTR client = WebCard_findClientKey(jsonRequest);
+
+  /* Try to find the "r" key (reader index) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "r");
+
+  if ((!test_bool) && (NULL != client))
+  {
+    /* Without "r": the client went away, releasing all its readers */
+    /* (its requests that still wait for a reader are dropped first) */
+
+    if (NULL != database->requests)
+    {
+      SCardRequestQueue_cancelClient(database->requests, database->session, client);
+    }
+
+    for (size_t i = 0; i < database->count; i++)
+    {
+      connection = &(database->connections[i]);
+
+      if ((NULL != connection->owner) &&
+        (database->session == connection->ownerSession) &&
+        (0 == strcmp(connection->owner, client)))
+      {
+        WebCard_releaseConnection(database, connection);
+      }
+    }
+
+    if ((NULL != database->jobs) &&
+      (database->session == database->jobs->session) &&
+      UTF8String_matches(&(database->jobs->filter.clientKey), client))
+    {
+      SCardJobQueue_clear(database->jobs);
+    }
+
+    return TRUE;
+  }
+
+  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::tryDisconnectingFromReader} failed: " \
+      "missing \"r\" key!"
+    );
+
+    return FALSE;
+  }
+
+  reader_index = (size_t) (((FLOAT *) json_value.value)[0]);
+
+  if (reader_index >= database->count)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::tryDisconnectingFromReader} failed: " \
+      "invalid reader index!"
+    );
+
+    return FALSE;
+  }
+
+  /* A client can only close its own connection */
+
+  connection = &(database->connections[reader_index]);
+
+  if (!SCardConnection_isAvailableTo(
+    connection,
+    database->session,
+    (NULL != client) ? client : ""))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__INFO,
+      "{WebCard::tryDisconnectingFromReader} " \
+      "reader %u is owned by another client",
+      (uint32_t) reader_index);
+
+    return TRUE;
+  }
+
+  /* Try to close a connection to active Smart Card */
+  /* (or keep it open for a while, to be reused) */
+
+  return WebCard_releaseConnection(database, connection);
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_transceiveThroughCache(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _Out_ BYTE *outputBuffer,
+  _Inout_ UTF8String *hexStringResult)
+{
+  BOOL test_bool;
+  BOOL cache_hit = FALSE;
+  LPBYTE cache_key = NULL;
+  size_t cache_key_length = 0;
+  const size_t result_length = hexStringResult->length;
+  SCardConnection *connection = &(database->connections[readerIndex]);
+
+  /* Time every physical exchange with this reader */
+
+  if (NULL == connection->transmitLatency)
+  {
+    connection->transmitLatency = SCardStats_findReaderHistogram(
+      &(database->stats),
+      database->states[readerIndex].szReader);
+  }
+
+  connection->trace = SCardTrace_isOpen(&(database->trace)) ?
+    &(database->trace) :
+    NULL;
+
+  connection->traceReader = (uint32_t) readerIndex;
+
+  /* "SELECT" of what is already selected (opt-in) */
+
+  if (SCardConnection_repeatSelection(connection, apdu, apduLength, hexStringResult))
+  {
+    database->apduCache.elidedSelects += 1;
+    return TRUE;
+  }
+
+  /* Idempotent commands might be answered from the APDU cache */
+
+  test_bool = SCardApduCache_isCacheable(
+    &(database->apduCache),
+    apdu,
+    apduLength);
+
+  if (test_bool)
+  {
+    /* Serial number is needed for the persistent cache (sent once per card) */
+
+    SCardApduCache_identifyCard(
+      &(database->apduCache),
+      readerIndex,
+      connection,
+      outputBuffer,
+      MAX_APDU_SIZE);
+
+    test_bool = SCardApduCache_makeKey(
+      connection,
+      apdu,
+      apduLength,
+      &(cache_key),
+      &(cache_key_length));
+  }
+
+  if (test_bool)
+  {
+    cache_hit = SCardApduCache_lookup(
+      &(database->apduCache),
+      readerIndex,
+      cache_key,
+      cache_key_length,
+      hexStringResult);
+  }
+
+  if (cache_hit)
+  {
+    test_bool = TRUE;
+  }
+  else
+  {
+    /* A failed look-up might have appended some text */
+
+    hexStringResult->length = result_length;
+
+    if (NULL != hexStringResult->text)
+    {
+      hexStringResult->text[result_length] = '\0';
+    }
+
+    test_bool = SCardConnection_transceiveMultiple(
+      connection,
+      hexStringResult,
+      apdu,
+      apduLength,
+      outputBuffer,
+      MAX_APDU_SIZE);
+
+    SCardApduCache_observeCommand(
+      &(database->apduCache),
+      readerIndex,
+      connection,
+      apdu,
+      apduLength,
+      test_bool ? hexStringResult : NULL);
+
+    if (test_bool && (NULL != cache_key))
+    {
+      SCardApduCache_store(
+        &(database->apduCache),
+        readerIndex,
+        cache_key,
+        cache_key_length,
+        hexStringResult);
+    }
+  }
+
+  if (NULL != cache_key)
+  {
+    free(cache_key);
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_transmitAndReceive(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  size_t reader_index;
+  LPBYTE input_bytes;
+  size_t input_bytes_length;
+  LPBYTE output_bytes;
+  JsonValue json_value;
+  UTF8String utf8_hex_apdu_response;
+  SCardConnection *connection;
+
+  /* Try to find the "r" key (reader index) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "r");
+
+  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::transmitAndReceive} failed: " \
+      "missing \"r\" key!"
+    );
+
+    return FALSE;
+  }
+
+  reader_index = (size_t) (((FLOAT *) json_value.value)[0]);
+
+  if (reader_index >= database->count)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::transmitAndReceive} failed: " \
+      "invalid reader index!"
+    );
+
+    return FALSE;
+  }
+
+  /* Make sure that a connection to the Smart Card is still active */
+
+  connection = &(database->connections[reader_index]);
+
+  if ((0 == connection->handle) || (0 != connection->lingerDeadline))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::transmitAndReceive} failed: " \
+      "no connection!"
+    );
+
+    return FALSE;
+  }
+
+  /* Try to find the "a" key (Application Protocol Data Unit) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "a");
+
+  if (!test_bool || (JSON_VALUE_TYPE__STRING != json_value.type))
+  {
+    return FALSE;
+  }
+
+  /* Prepare input and output byte buffers */
+
+  test_bool = UTF8String_hexToByteArray(
+    json_value.value,
+    &(input_bytes_length),
+    &(input_bytes));
+
+  if (!test_bool)
+  {
+    if (NULL != input_bytes)
+    {
+      free(input_bytes);
+    }
+    return FALSE;
+  }
+
+  output_bytes = malloc(sizeof(BYTE) * MAX_APDU_SIZE);
+  if (NULL == output_bytes)
+  {
+    free(input_bytes);
+    return FALSE;
+  }
+
+  /* Transmit and receive (or read from the APDU cache) */
+
+  UTF8String_init(&(utf8_hex_apdu_response));
+
+  test_bool = WebCard_transceiveThroughCache(
+    database,
+    reader_index,
+    input_bytes,
+    input_bytes_length,
+    output_bytes,
+    &(utf8_hex_apdu_response));
+
+  free(output_bytes);
+  free(input_bytes);
+
+  if (test_bool)
+  {
+    /* Add key "d" (Smart Card APDU response) */
+
+    json_value.type = JSON_VALUE_TYPE__STRING;
+    json_value.value = &(utf8_hex_apdu_response);
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
+
+  UTF8String_destroy(&(utf8_hex_apdu_response));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Builds the result of one reader of a fan-out:
+ * `{r: reader index, d: [response APDUs]}`, marked "incomplete"
+ * when the script was interrupted ("r" is omitted when the reader
+ * is no longer listed).
+ *
+ * @param[in] job Reference to a collected `SCardFanOutJob`.
+ * @param[in] apduCount Number of command APDUs in the script.
+ * @param[out] jsonObject Reference to an UNINITIALIZED `JsonObject` variable.
+ * @return `TRUE` on success, `FALSE` on memory allocation error.
+ *
+ * @note `jsonObject` must be released by the caller.
+ */
+BOOL
+WebCard_convertFanOutJobToJsonObject(
+  _In_ const SCardFanOutJob *job,
+  _In_ const size_t apduCount,
+  _Out_ JsonObject *jsonObject)
+{
+  BOOL test_bool = TRUE;
+  FLOAT test_float;
+  JsonValue json_value;
+  JsonArray json_responses;
+
+  JsonObject_init(jsonObject);
+
+  /* Key "r" (reader index) */
+
+  if (SIZE_MAX != job->readerIndex)
+  {
+    test_float = (FLOAT) job->readerIndex;
+
+    json_value.type = JSON_VALUE_TYPE__NUMBER;
+    json_value.value = &(test_float);
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonObject,
+      "r",
+      &(json_value));
+  }
+
+  /* Key "d" (hex-string response APDUs) */
+
+  JsonArray_init(&(json_responses));
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+
+  for (size_t i = 0; test_bool && (i < job->responseCount); i++)
+  {
+    json_value.value = (UTF8String *) &(job->responses[i]);
+
+    test_bool = JsonArray_append(&(json_responses), &(json_value));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__ARRAY;
+    json_value.value = &(json_responses);
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonObject,
+      "d",
+      &(json_value));
+  }
+
+  JsonArray_destroy(&(json_responses));
+
+  if (test_bool && (job->responseCount < apduCount))
+  {
+    json_value.type = JSON_VALUE_TYPE__TRUE;
+    json_value.value = NULL;
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonObject,
+      "incomplete",
+      &(json_value));
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Sends the result of one reader of a streamed fan-out,
+ * under the "u" key of a message with the "i" key of the request.
+ */
+VOID
+WebCard_sendFanOutResult(
+  _In_ const SCardFanOut *fanOut,
+  _In_ const SCardFanOutJob *job)
+{
+  BOOL test_bool;
+  JsonValue json_id;
+  JsonValue json_value;
+  JsonObject json_message;
+  JsonObject json_result;
+  UTF8String utf8_id;
+  UTF8String utf8_string;
+
+  UTF8String_makeTemporary(&(utf8_id), fanOut->id);
+
+  json_id.type = JSON_VALUE_TYPE__STRING;
+  json_id.value = &(utf8_id);
+
+  JsonObject_init(&(json_message));
+
+  test_bool = JsonObject_appendKeyValue(
+    &(json_message),
+    "i",
+    &(json_id));
+
+  if (test_bool)
+  {
+    test_bool = WebCard_convertFanOutJobToJsonObject(
+      job,
+      fanOut->script.apduCount,
+      &(json_result));
+
+    if (test_bool)
+    {
+      json_value.type = JSON_VALUE_TYPE__OBJECT;
+      json_value.value = &(json_result);
+
+      test_bool = JsonObject_appendKeyValue(
+        &(json_message),
+        "u",
+        &(json_value));
+    }
+
+    JsonObject_destroy(&(json_result));
+  }
+
+  UTF8String_init(&(utf8_string));
+
+  if (test_bool)
+  {
+    test_bool = JsonObject_toString(&(json_message), &(utf8_string));
+  }
+
+  if (test_bool)
+  {
+    WebCard_sendToRequester(&(json_id), &(utf8_string), fanOut->session);
+  }
+
+  UTF8String_destroy(&(utf8_string));
+  JsonObject_destroy(&(json_message));
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Answers a fan-out request: with every reader's result under "d"
+ * (or only their number under "n", when the results were streamed),
+ * or as an incomplete request with the reason under "x".
+ *
+ * @param[in] fanOut Reference to a VALID and CONSTANT `SCardFanOut` object.
+ * @param[in] state One of `WEBCARD_REQUEST_STATE__*` values
+ * (`WEBCARD_REQUEST_STATE__PENDING` when every reader is done).
+ */
+VOID
+WebCard_sendFanOutResponse(
+  _In_ const SCardFanOut *fanOut,
+  _In_ const int state)
+{
+  BOOL test_bool;
+  FLOAT test_float;
+  JsonValue json_id;
+  JsonValue json_value;
+  JsonArray json_results;
+  JsonObject json_result;
+  JsonObject json_response;
+  UTF8String utf8_id;
+  UTF8String utf8_string;
+
+  UTF8String_makeTemporary(&(utf8_id), fanOut->id);
+
+  json_id.type = JSON_VALUE_TYPE__STRING;
+  json_id.value = &(utf8_id);
+
+  JsonObject_init(&(json_response));
+  JsonArray_init(&(json_results));
+
+  test_bool = JsonObject_appendKeyValue(
+    &(json_response),
+    "i",
+    &(json_id));
+
+  if (!test_bool)
+  {
+    JsonObject_destroy(&(json_response));
+    return;
+  }
+
+  if (WEBCARD_REQUEST_STATE__PENDING == state)
+  {
+    if (fanOut->streamed)
+    {
+      /* Key "n" (number of readers, results were already sent) */
+
+      test_float = (FLOAT) fanOut->jobCount;
+
+      json_value.type = JSON_VALUE_TYPE__NUMBER;
+      json_value.value = &(test_float);
+
+      test_bool = JsonObject_appendKeyValue(
+        &(json_response),
+        "n",
+        &(json_value));
+    }
+    else
+    {
+      /* Key "d" (results in the order of the readers) */
+
+      for (size_t i = 0; test_bool && (i < fanOut->jobCount); i++)
+      {
+        test_bool = WebCard_convertFanOutJobToJsonObject(
+          &(fanOut->jobs[i]),
+          fanOut->script.apduCount,
+          &(json_result));
+
+        if (test_bool)
+        {
+          json_value.type = JSON_VALUE_TYPE__OBJECT;
+          json_value.value = &(json_result);
+
+          test_bool = JsonArray_append(&(json_results), &(json_value));
+        }
+
+        JsonObject_destroy(&(json_result));
+      }
+
+      if (test_bool)
+      {
+        json_value.type = JSON_VALUE_TYPE__ARRAY;
+        json_value.value = &(json_results);
+
+        test_bool = JsonObject_appendKeyValue(
+          &(json_response),
+          "d",
+          &(json_value));
+      }
+    }
+  }
+
+  if (!test_bool || (WEBCARD_REQUEST_STATE__PENDING != state))
+  {
+    /* Append an optional key-value "incomplete=true" */
+
+    json_value.type = JSON_VALUE_TYPE__TRUE;
+    json_value.value = NULL;
+
+    JsonObject_appendKeyValue(&(json_response), "incomplete", &(json_value));
+  }
+
+  if (WEBCARD_REQUEST_STATE__PENDING != state)
+  {
+    test_float = (FLOAT) state;
+
+    json_value.type = JSON_VALUE_TYPE__NUMBER;
+    json_value.value = &(test_float);
+
+    JsonObject_appendKeyValue(&(json_response), "x", &(json_value));
+  }
+
+  UTF8String_init(&(utf8_string));
+
+  if (JsonObject_toString(&(json_response), &(utf8_string)))
+  {
+    WebCard_sendToRequester(&(json_id), &(utf8_string), fanOut->session);
+  }
+
+  UTF8String_destroy(&(utf8_string));
+  JsonArray_destroy(&(json_results));
+  JsonObject_destroy(&(json_response));
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_fanOut(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  UTF8String *utf8_id;
+  LPCSTR client;
+  SCardConnection *connection;
+  SCardFanOut *fan_out;
+
+  fan_out = malloc(sizeof(SCardFanOut));
+  if (NULL == fan_out) { return FALSE; }
+
+  SCardFanOut_init(fan_out);
+
+  /* Keys "r", "a", "m" and "d" (same meaning as for prefetch scripts) */
+
+  test_bool = SCardPrefetchScript_load(&(fan_out->script), jsonRequest);
+
+  if (!test_bool || (0 == fan_out->script.apduCount))
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::fanOut} failed: " \
+      "invalid \"d\" key!"
+    );
+
+    SCardFanOut_destroy(fan_out);
+    free(fan_out);
+    return FALSE;
+  }
+
+  /* Key "s" (send every result as soon as it is known) */
+
+  if (JsonObject_getValue(jsonRequest, &(json_value), "s") &&
+    (JSON_VALUE_TYPE__NUMBER == json_value.type))
+  {
+    fan_out->streamed = (0 != ((FLOAT *) json_value.value)[0]);
+  }
+
+  /* Key "i" (the request is answered later) */
+
+  JsonObject_getValue(jsonRequest, &(json_value), "i");
+
+  utf8_id = json_value.value;
+
+  fan_out->id = malloc(sizeof(char) * (utf8_id->length + 1));
+
+  if (NULL == fan_out->id)
+  {
+    SCardFanOut_destroy(fan_out);
+    free(fan_out);
+    return FALSE;
+  }
+
+  memcpy(fan_out->id, utf8_id->text, utf8_id->length);
+  fan_out->id[utf8_id->length] = '\0';
+
+  fan_out->session = database->session;
+
+  client = WebCard_findClientKey(jsonRequest);
+
+  if (NULL == client)
+  {
+    client = "";
+  }
+
+  /* Readers are chosen by the main thread */
+
+  for (size_t i = 0; i < database->count; i++)
+  {
+    connection = &(database->connections[i]);
+
+    if (!(database->states[i].dwCurrentState & SCARD_STATE_PRESENT))
+    {
+      continue;
+    }
+
+    test_bool = SCardSubscription_matches(
+      &(fan_out->script.filter),
+      i,
+      WEBCARD_READER_EVENT__CARD_INSERTION,
+      connection->cardAtr,
+      connection->cardAtrLength);
+
+    if (!test_bool ||
+      !SCardConnection_isAvailableTo(connection, database->session, client) ||
+      WebCard_isReaderInFanOut(database, database->states[i].szReader))
+    {
+      continue;
+    }
+
+    if (fan_out->jobCount >= WEBCARD_FANOUT_MAX_READERS)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{WebCard::fanOut} more than %u readers, the rest is skipped",
+        (uint32_t) WEBCARD_FANOUT_MAX_READERS);
+
+      break;
+    }
+
+    SCardFanOut_addReader(
+      fan_out,
+      database->states[i].szReader,
+      i,
+      connection);
+  }
+
+  /* Every reader at once: it takes as long as the slowest one, */
+  /* and the main thread does not wait for any of them */
+
+  SCardFanOut_start(fan_out);
+
+  fan_out->next = database->fanOuts;
+  database->fanOuts = fan_out;
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__DEBUG,
+    "{WebCard::fanOut} %u command APDUs sent to %u readers",
+    (uint32_t) fan_out->script.apduCount,
+    (uint32_t) fan_out->jobCount);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Gives the next waiting job to the card in given reader,
+ * if the reader takes part in the production line.
+ *
+ * @return `TRUE` if a job was dispatched.
+ */
+BOOL
+WebCard_dispatchJob(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex)
+{
+  BOOL test_bool;
+  SCardJobQueue *queue = database->jobs;
+  SCardConnection *connection = &(database->connections[readerIndex]);
+  const UTF8String *client_key;
+
+  connection->awaitingJob = FALSE;
+
+  if (NULL == queue)
+  {
+    return FALSE;
+  }
+
+  test_bool = SCardJobQueue_matches(
+    queue,
+    readerIndex,
+    connection->cardAtr,
+    connection->cardAtrLength);
+
+  if (!test_bool)
+  {
+    return FALSE;
+  }
+
+  /* Reader used by another client (or by a fan-out): */
+  /* the card waits, like a busy reader */
+
+  client_key = &(queue->filter.clientKey);
+
+  test_bool = SCardConnection_isAvailableTo(
+    connection,
+    queue->session,
+    (NULL != client_key->text) ? (LPCSTR) client_key->text : "") &&
+    !WebCard_isReaderInFanOut(database, database->states[readerIndex].szReader);
+
+  if (test_bool)
+  {
+    test_bool = SCardJobQueue_dispatch(
+      queue,
+      database->states[readerIndex].szReader);
+  }
+
+  connection->awaitingJob = !test_bool;
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Gives the waiting jobs to the cards that were inserted
+ * while there was no job (or no free worker) for them.
+ */
+VOID
+WebCard_dispatchAwaitingJobs(
+  _Inout_ SCardReaderDB *database)
+{
+  for (size_t i = 0; i < database->count; i++)
+  {
+    if (database->connections[i].awaitingJob &&
+      (database->states[i].dwCurrentState & SCARD_STATE_PRESENT))
+    {
+      WebCard_dispatchJob(database, i);
+    }
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Sends the result of one job to the client of the production line,
+ * as the "Job Done" Reader Event.
+ */
+VOID
+WebCard_sendJobReport(
+  _In_ const SCardJobQueue *queue,
+  _In_ const SCardJobWorker *worker,
+  _In_ const size_t readerIndex)
+{
+  BOOL test_bool;
+  FLOAT test_float;
+  JsonValue json_value;
+  JsonObject json_message;
+  JsonObject json_report;
+  JsonArray json_array;
+  UTF8String utf8_string;
+
+  JsonObject_init(&(json_message));
+  JsonObject_init(&(json_report));
+
+  json_value.type = JSON_VALUE_TYPE__NUMBER;
+  json_value.value = &(test_float);
+
+  /* Key "e" (reader event) and key "r" (reader index, if still listed) */
+
+  test_float = (FLOAT) WEBCARD_READER_EVENT__JOB_DONE;
+
+  test_bool = JsonObject_appendKeyValue(
+    &(json_message),
+    "e",
+    &(json_value));
+
+  if (test_bool && (SIZE_MAX != readerIndex))
+  {
+    test_float = (FLOAT) readerIndex;
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_message),
+      "r",
+      &(json_value));
+  }
+
+  /* Report: "j" (job number), "t" (time on the card, in milliseconds) */
+
+  if (test_bool)
+  {
+    test_float = (FLOAT) worker->job.id;
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_report),
+      "j",
+      &(json_value));
+  }
+
+  if (test_bool)
+  {
+    test_float = (FLOAT) (worker->endTime - worker->startTime);
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_report),
+      "t",
+      &(json_value));
+  }
+
+  /* Report: "d" (hex-string response APDUs) */
+
+  JsonArray_init(&(json_array));
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+
+  for (size_t i = 0; test_bool && (i < worker->responseCount); i++)
+  {
+    json_value.value = (UTF8String *) &(worker->responses[i]);
+
+    test_bool = JsonArray_append(&(json_array), &(json_value));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__ARRAY;
+    json_value.value = &(json_array);
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_report),
+      "d",
+      &(json_value));
+  }
+
+  JsonArray_destroy(&(json_array));
+
+  if (test_bool && worker->failed)
+  {
+    json_value.type = JSON_VALUE_TYPE__TRUE;
+    json_value.value = NULL;
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_report),
+      "incomplete",
+      &(json_value));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_report);
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_message),
+      "d",
+      &(json_value));
+  }
+
+  /* Key "k" (client that queued the jobs, used for routing) */
+
+  if (test_bool && (queue->filter.clientKey.length > 0))
+  {
+    JsonArray_init(&(json_array));
+
+    json_value.type = JSON_VALUE_TYPE__STRING;
+    json_value.value = (UTF8String *) &(queue->filter.clientKey);
+
+    test_bool = JsonArray_append(&(json_array), &(json_value));
+
+    if (test_bool)
+    {
+      json_value.type = JSON_VALUE_TYPE__ARRAY;
+      json_value.value = &(json_array);
+
+      test_bool = JsonObject_appendKeyValue(
+        &(json_message),
+        "k",
+        &(json_value));
+    }
+
+    JsonArray_destroy(&(json_array));
+  }
+
+  UTF8String_init(&(utf8_string));
+
+  if (test_bool)
+  {
+    test_bool = JsonObject_toString(&(json_message), &(utf8_string));
+  }
+
+  if (test_bool)
+  {
+    WebCard_sendEvent(&(json_message), &(utf8_string), queue->session);
+  }
+
+  UTF8String_destroy(&(utf8_string));
+  JsonObject_destroy(&(json_report));
+  JsonObject_destroy(&(json_message));
+}
+
+/**************************************************************/
+
+VOID
+WebCard_collectJobs(
+  _Inout_ SCardReaderDB *database)
+{
+  size_t reader_index;
+  BOOL collected = FALSE;
+  SCardJobWorker *worker;
+  SCardJobQueue *queue = database->jobs;
+
+  if (NULL == queue)
+  {
+    return;
+  }
+
+  while (NULL != (worker = SCardJobQueue_collect(queue)))
+  {
+    collected = TRUE;
+
+    /* Readers might have been re-listed since the job was dispatched */
+
+    reader_index = SIZE_MAX;
+
+    for (size_t i = 0; (SIZE_MAX == reader_index) && (i < database->count); i++)
+    {
+      if (0 == _tcscmp(database->states[i].szReader, worker->readerName))
+      {
+        reader_index = i;
+      }
+    }
+
+    /* The APDU cache and the selections learn about the exchanges */
+
+    for (size_t j = 0; (SIZE_MAX != reader_index) && (j < worker->apduCount) && (j <= worker->responseCount); j++)
+    {
+      SCardApduCache_observeCommand(
+        &(database->apduCache),
+        reader_index,
+        &(database->connections[reader_index]),
+        worker->apdus[j],
+        worker->apduLengths[j],
+        (j < worker->responseCount) ? &(worker->responses[j]) : NULL);
+    }
+
+    OSSpecific_writeLogMessage(
+      worker->failed ? OS_SPECIFIC_LOG__WARNING : OS_SPECIFIC_LOG__DEBUG,
+      "{WebCard::collectJobs} job %u %s after %u ms",
+      worker->job.id,
+      worker->failed ? "failed" : "done",
+      (uint32_t) (worker->endTime - worker->startTime));
+
+    WebCard_sendJobReport(queue, worker, reader_index);
+
+    SCardJobQueue_release(queue, worker);
+  }
+
+  /* A card inserted while its reader was still busy gets a job now */
+
+  if (collected)
+  {
+    WebCard_dispatchAwaitingJobs(database);
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Sends a Reader Event to every session with a matching subscription
+ * (see `WebCard_sendReaderEvent` for the parameters).
+ */
+VOID
+WebCard_sendToSubscribers(
+  _In_ const SCardReaderDB *database,
+  _In_opt_ const SCARD_READERSTATE *readerState,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _In_opt_ const JsonArray *jsonEventDetails,
+  _In_ const BOOL detailsIncomplete,
+  _In_ const uint32_t suppressedCount)
+{
+  JsonObject json_response;
+  JsonArray json_client_keys;
+  uint32_t sessions[WEBCARD_DAEMON__MAX_SESSIONS];
+  size_t session_count;
+
+  /* Every client of the daemon has its own subscriptions */
+
+  session_count = SCardDaemon_listSessions(sessions);
+
+  for (size_t i = 0; i < session_count; i++)
+  {
+    if (SCardReaderDB_findSubscribers(
+      database,
+      sessions[i],
+      readerIndex,
+      readerEvent,
+      &(json_client_keys)))
+    {
+      WebCard_sendReaderEvent(
+        readerState,
+        readerIndex,
+        readerEvent,
+        &(json_response),
+        jsonEventDetails,
+        detailsIncomplete,
+        suppressedCount,
+        &(json_client_keys),
+        sessions[i]);
+
+      JsonObject_destroy(&(json_response));
+    }
+
+    JsonArray_destroy(&(json_client_keys));
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Checks if any session would receive given Reader Event.
+ */
+BOOL
+WebCard_hasSubscribers(
+  _In_ const SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent)
+{
+  BOOL test_bool = FALSE;
+  JsonArray json_client_keys;
+  uint32_t sessions[WEBCARD_DAEMON__MAX_SESSIONS];
+  size_t session_count;
+
+  session_count = SCardDaemon_listSessions(sessions);
+
+  for (size_t i = 0; (!test_bool) && (i < session_count); i++)
+  {
+    test_bool = SCardReaderDB_findSubscribers(
+      database,
+      sessions[i],
+      readerIndex,
+      readerEvent,
+      &(json_client_keys));
+
+    JsonArray_destroy(&(json_client_keys));
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Publishes the "Card Insertion" event that waited for a prefetch
+ * script, with its responses under "p" (and "x" if the script was
+ * cut short: failed transmission, card removed or context lost).
+ */
+VOID
+WebCard_publishPrefetchedEvent(
+  _In_ const SCardReaderDB *database,
+  _In_ const SCardFanOut *fanOut,
+  _In_ const SCardFanOutJob *job)
+{
+  BOOL test_bool = TRUE;
+  JsonValue json_value;
+  JsonArray json_prefetched;
+  SCARD_READERSTATE reader_state;
+
+  /* The card might be gone already: the event tells which card */
+  /* was read (the ATR is taken from the job) */
+
+  reader_state = database->states[job->readerIndex];
+
+  reader_state.cbAtr = (PCSC_DWORD)
+    ((job->connection.cardAtrLength < sizeof(reader_state.rgbAtr)) ?
+      job->connection.cardAtrLength :
+      sizeof(reader_state.rgbAtr));
+
+  memcpy(
+    reader_state.rgbAtr,
+    job->connection.cardAtr,
+    reader_state.cbAtr);
+
+  JsonArray_init(&(json_prefetched));
+
+  json_value.type = JSON_VALUE_TYPE__STRING;
+
+  for (size_t i = 0; test_bool && (i < job->responseCount); i++)
+  {
+    json_value.value = (UTF8String *) &(job->responses[i]);
+
+    test_bool = JsonArray_append(&(json_prefetched), &(json_value));
+  }
+
+  /* Without its responses, the event is still sent (incomplete) */
+
+  WebCard_sendToSubscribers(
+    database,
+    &(reader_state),
+    job->readerIndex,
+    WEBCARD_READER_EVENT__CARD_INSERTION,
+    &(json_prefetched),
+    !test_bool || (job->responseCount < fanOut->script.apduCount),
+    fanOut->suppressedCount);
+
+  JsonArray_destroy(&(json_prefetched));
+}
+
+/**************************************************************/
+
+VOID
+WebCard_collectFanOuts(
+  _Inout_ SCardReaderDB *database)
+{
+  size_t reader_index;
+  BOOL collected = FALSE;
+  LPBYTE cache_key;
+  size_t cache_key_length;
+  SCardConnection *connection;
+  SCardFanOutJob *job;
+  SCardFanOut *fan_out;
+  SCardFanOut **link = &(database->fanOuts);
+  const SCardPrefetchScript *script;
+
+  while (NULL != (fan_out = link[0]))
+  {
+    script = &(fan_out->script);
+
+    while (NULL != (job = SCardFanOut_collect(fan_out)))
+    {
+      /* Readers might have been re-listed since the fan-out started */
+
+      reader_index = SCardReaderDB_findReaderNamed(database, job->readerName);
+
+      job->readerIndex = reader_index;
+
+      /* The APDU cache and the selections learn about the exchanges */
+      /* (the card only, when its reader is gone) */
+
+      connection = (SIZE_MAX != reader_index) ?
+        &(database->connections[reader_index]) :
+        &(job->connection);
+
+      for (size_t j = 0; (j < script->apduCount) && (j <= job->responseCount); j++)
+      {
+        /* Prefetched responses are cached too, so that the page */
+        /* can read the same data again for free */
+
+        cache_key = NULL;
+
+        if (fan_out->prefetch &&
+          (SIZE_MAX != reader_index) &&
+          (j < job->responseCount) &&
+          SCardApduCache_isCacheable(
+            &(database->apduCache),
+            script->apdus[j],
+            script->apduLengths[j]))
+        {
+          SCardApduCache_makeKey(
+            connection,
+            script->apdus[j],
+            script->apduLengths[j],
+            &(cache_key),
+            &(cache_key_length));
+        }
+
+        SCardApduCache_observeCommand(
+          &(database->apduCache),
+          reader_index,
+          connection,
+          script->apdus[j],
+          script->apduLengths[j],
+          (j < job->responseCount) ? &(job->responses[j]) : NULL);
+
+        if (NULL != cache_key)
+        {
+          SCardApduCache_store(
+            &(database->apduCache),
+            reader_index,
+            cache_key,
+            cache_key_length,
+            &(job->responses[j]));
+
+          free(cache_key);
+        }
+      }
+
+      if (fan_out->prefetch && (SIZE_MAX != reader_index))
+      {
+        WebCard_publishPrefetchedEvent(database, fan_out, job);
+      }
+      else if (fan_out->streamed && !(fan_out->answered))
+      {
+        WebCard_sendFanOutResult(fan_out, job);
+      }
+    }
+
+    if (SCardFanOut_isDone(fan_out))
+    {
+      if (!(fan_out->answered))
+      {
+        WebCard_sendFanOutResponse(fan_out, WEBCARD_REQUEST_STATE__PENDING);
+      }
+
+      link[0] = fan_out->next;
+
+      SCardFanOut_destroy(fan_out);
+      free(fan_out);
+
+      collected = TRUE;
+      continue;
+    }
+
+    /* Deadline ("t" key of the request) passed: answered at once, */
+    /* the readers stop before their next command APDU */
+
+    if (!(fan_out->answered) && (0 != fan_out->deadline) &&
+      (OSSpecific_getPreciseTime() >= fan_out->deadline))
+    {
+      SCardFanOut_stop(fan_out);
+
+      WebCard_sendFanOutResponse(fan_out, WEBCARD_REQUEST_STATE__TIMED_OUT);
+
+      fan_out->answered = TRUE;
+    }
+
+    link = &(fan_out->next);
+  }
+
+  /* Cards that were busy with a fan-out can get their jobs now */
+
+  if (collected)
+  {
+    WebCard_dispatchAwaitingJobs(database);
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Builds the state of the production line: `{p: waiting jobs,
+ * b: busy readers, n: jobs done, f: failed jobs, h: cards per hour,
+ * r: [{n: reader name, j: jobs, f: failures, t: busy time, u: utilization}]}`.
+ */
+BOOL
+WebCard_convertJobQueueToJsonObject(
+  _In_ const SCardJobQueue *queue,
+  _Out_ JsonObject *jsonObject)
+{
+  BOOL test_bool = TRUE;
+  FLOAT test_float;
+  JsonValue json_value;
+  JsonValue json_number;
+  JsonArray json_readers;
+  JsonObject json_reader;
+  SCARD_READERSTATE reader_state;
+  size_t busy = 0;
+  const uint64_t now = OSSpecific_getMonotonicTime();
+  const uint64_t elapsed = (0 != queue->firstDispatch) ? (now - queue->firstDispatch) : 0;
+
+  JsonObject_init(jsonObject);
+
+  for (size_t i = 0; i < WEBCARD_JOBS_MAX_WORKERS; i++)
+  {
+    if (queue->workers[i].busy)
+    {
+      busy += 1;
+    }
+  }
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  const struct
+  {
+    LPCSTR key;
+    FLOAT value;
+  }
+  summary[] =
+  {
+    {"p", (FLOAT) queue->pendingCount},
+    {"b", (FLOAT) busy},
+    {"n", (FLOAT) queue->doneCount},
+    {"f", (FLOAT) queue->failedCount},
+    {"h", (elapsed > 0) ?
+      (FLOAT) ((queue->doneCount + queue->failedCount) * 3600000.0 / elapsed) :
+      0}
+  };
+
+  for (size_t i = 0; test_bool && (i < (sizeof(summary) / sizeof(summary[0]))); i++)
+  {
+    test_float = summary[i].value;
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonObject,
+      summary[i].key,
+      &(json_number));
+  }
+
+  /* Key "r" (throughput of every reader, busy time in percents */
+  /* of the time since the first job) */
+
+  JsonArray_init(&(json_readers));
+
+  for (size_t i = 0; test_bool && (i < queue->readerCount); i++)
+  {
+    JsonObject_init(&(json_reader));
+
+    /* Only the name is needed to convert it to UTF-8 */
+
+    reader_state.szReader = queue->readers[i].readerName;
+
+    test_bool = WebCard_pushReaderNameToJsonObject(
+      &(reader_state),
+      &(json_reader),
+      "n");
+
+    const struct
+    {
+      LPCSTR key;
+      FLOAT value;
+    }
+    reader_summary[] =
+    {
+      {"j", (FLOAT) queue->readers[i].jobs},
+      {"f", (FLOAT) queue->readers[i].failures},
+      {"t", (FLOAT) queue->readers[i].busyTime},
+      {"u", (elapsed > 0) ?
+        (FLOAT) (100.0 * queue->readers[i].busyTime / elapsed) :
+        0}
+    };
+
+    for (size_t j = 0; test_bool && (j < (sizeof(reader_summary) / sizeof(reader_summary[0]))); j++)
+    {
+      test_float = reader_summary[j].value;
+
+      test_bool = JsonObject_appendKeyValue(
+        &(json_reader),
+        reader_summary[j].key,
+        &(json_number));
+    }
+
+    if (test_bool)
+    {
+      json_value.type = JSON_VALUE_TYPE__OBJECT;
+      json_value.value = &(json_reader);
+
+      test_bool = JsonArray_append(&(json_readers), &(json_value));
+    }
+
+    JsonObject_destroy(&(json_reader));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__ARRAY;
+    json_value.value = &(json_readers);
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonObject,
+      "r",
+      &(json_value));
+  }
+
+  JsonArray_destroy(&(json_readers));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_configureJobs(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context)
+{
+  BOOL test_bool;
+  FLOAT test_float;
+  JsonValue json_value;
+  JsonObject json_state_object;
+  uint32_t first_id;
+
+  /* Production line is created by its first command */
+
+  if (NULL == database->jobs)
+  {
+    database->jobs = malloc(sizeof(SCardJobQueue));
+
+    if (NULL == database->jobs)
+    {
+      return FALSE;
+    }
+
+    SCardJobQueue_init(database->jobs);
+  }
+
+  test_bool = SCardJobQueue_configure(
+    database->jobs,
+    jsonRequest,
+    database->session,
+    &(first_id));
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::configureJobs} failed: " \
+      "invalid job script or jobs!"
+    );
+
+    return FALSE;
+  }
+
+  /* Cards that are already waiting get the new jobs at once */
+
+  WebCard_dispatchAwaitingJobs(database);
+
+  /* Report the state of the production line */
+
+  test_bool = WebCard_convertJobQueueToJsonObject(
+    database->jobs,
+    &(json_state_object));
+
+  if (test_bool && (0 != first_id))
+  {
+    /* Key "k" (number of the first queued job) */
+
+    test_float = (FLOAT) first_id;
+
+    json_value.type = JSON_VALUE_TYPE__NUMBER;
+    json_value.value = &(test_float);
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_state_object),
+      "k",
+      &(json_value));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_state_object);
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
+
+  JsonObject_destroy(&(json_state_object));
+
+  /* Key "z" (reset the counters after reporting) */
+
+  if (test_bool &&
+    JsonObject_getValue(jsonRequest, &(json_value), "z") &&
+    (JSON_VALUE_TYPE__NUMBER == json_value.type) &&
+    (0 != ((FLOAT *) json_value.value)[0]))
+  {
+    SCardJobQueue_resetCounters(database->jobs);
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+VOID
+WebCard_sendReaderEvent(
+  _In_opt_ const SCARD_READERSTATE *readerState,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _Out_ JsonObject *jsonResponse,
+  _In_opt_ const JsonArray *jsonEventDetails,
+  _In_ const BOOL detailsIncomplete,
+  _In_ const uint32_t suppressedCount,
+  _In_opt_ const JsonArray *jsonClientKeys,
+  _In_ const uint32_t session)
+{
+  BOOL test_bool;
+  FLOAT test_float;
+  JsonValue json_value;
+  UTF8String utf8_string;
+  UTF8String utf8_keys;
+
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__DEBUG,
+    "Sending ReaderEvent '%d' (ReaderIndex '%d')",
+    readerEvent,
+    readerIndex);
+
+  /* Initialize JSON response object */
+  /* (it will be destroyed by caller) */
+
+  JsonObject_init(jsonResponse);
+
+  json_value.type = JSON_VALUE_TYPE__NUMBER;
+  json_value.value = &(test_float);
+
+  /* Add key "e" (reader event) */
+
+  test_float = (FLOAT) readerEvent;
+
+  test_bool = JsonObject_appendKeyValue(
+    jsonResponse,
+    "e",
+    &(json_value));
+
+  if (!test_bool) { return; }
+
+  if (NULL != readerState)
+  {
+    /* Add key "r" (reader index for reader events) */
+
+    test_float = (FLOAT) readerIndex;
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "r",
+      &(json_value));
+
+    if (!test_bool) { return; }
+
+    /* Add key "d" (card Answer To Reset) on CARD INSERT event */
+
+    if (WEBCARD_READER_EVENT__CARD_INSERTION == readerEvent)
+    {
+      test_bool = WebCard_pushReaderAtrToJsonObject(
+        readerState,
+        jsonResponse,
+        "d");
+
+      if (!test_bool) { return; }
+    }
+
+    /* Add key "s" (transitions suppressed by the debounce logic) */
+
+    if (suppressedCount > 0)
+    {
+      json_value.type = JSON_VALUE_TYPE__NUMBER;
+      json_value.value = &(test_float);
+
+      test_float = (FLOAT) suppressedCount;
+
+      test_bool = JsonObject_appendKeyValue(
+        jsonResponse,
+        "s",
+        &(json_value));
+
+      if (!test_bool) { return; }
+    }
+
+    if (NULL != jsonEventDetails)
+    {
+      /* Add key "p" (responses of the prefetch script) */
+
+      json_value.type = JSON_VALUE_TYPE__ARRAY;
+      json_value.value = (void *) jsonEventDetails;
+
+      test_bool = JsonObject_appendKeyValue(
+        jsonResponse,
+        "p",
+        &(json_value));
+
+      if (!test_bool) { return; }
+
+      /* Add key "x" (the prefetch script was cut short) */
+
+      if (detailsIncomplete)
+      {
+        json_value.type = JSON_VALUE_TYPE__NUMBER;
+        json_value.value = &(test_float);
+
+        test_float = 1;
+
+        test_bool = JsonObject_appendKeyValue(
+          jsonResponse,
+          "x",
+          &(json_value));
+
+        if (!test_bool) { return; }
+      }
+    }
+  }
+  else
+  {
+    if (NULL != jsonEventDetails)
+    {
+      /* Add key "n" (optional reader names) */
+
+      json_value.type = JSON_VALUE_TYPE__ARRAY;
+      json_value.value = (void *) jsonEventDetails;
+
+      test_bool = JsonObject_appendKeyValue(
+        jsonResponse,
+        "n",
+        &(json_value));
+
+      if (!test_bool) { return; }
+    }
+  }
+
+  if ((NULL != jsonClientKeys) && (jsonClientKeys->count > 0))
+  {
+    /* Add key "k" (subscribed clients, used for routing) */
+
+    json_value.type = JSON_VALUE_TYPE__ARRAY;
+    json_value.value = (void *) jsonClientKeys;
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "k",
+      &(json_value));
+
+    if (!test_bool) { return; }
+  }
+
+  /* Stringify JSON response and send it through the STDOUT stream */
+
+  UTF8String_init(&(utf8_string));
+
+  test_bool = JsonObject_toString(jsonResponse, &(utf8_string));
+
+  if (test_bool)
+  {
+    /* A later state of the same card, for the same clients, */
+    /* supersedes this one (fragments are never merged) */
+
+    if ((NULL != readerState) &&
+      (utf8_string.length <= WEBCARD_MESSAGE_MAX_SIZE))
+    {
+      UTF8String_init(&(utf8_keys));
+
+      test_bool = (NULL == jsonClientKeys) ||
+        JsonArray_toString(jsonClientKeys, &(utf8_keys));
+
+      if (test_bool)
+      {
+        SCardDaemon_sendCardEvent(session, &(utf8_string), readerIndex, &(utf8_keys));
+      }
+
+      UTF8String_destroy(&(utf8_keys));
+    }
+    else
+    {
+      WebCard_sendEvent(jsonResponse, &(utf8_string), session);
+    }
+  }
+
+  UTF8String_destroy(&(utf8_string));
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_subscribeToEvents(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  SCardSubscription subscription;
+
+  test_bool = SCardSubscription_load(
+    &(subscription),
+    jsonRequest);
+
+  subscription.session = database->session;
+
+  if (test_bool)
+  {
+    test_bool = SCardReaderDB_subscribe(
+      database,
+      &(subscription));
+  }
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::subscribeToEvents} failed: " \
+      "invalid filters!"
+    );
+
+    SCardSubscription_destroy(&(subscription));
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_unsubscribeFromEvents(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  JsonValue json_value;
+  UTF8String empty_key;
+
+  /* Try to find the "k" key (optional client key) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "k");
+
+  if (!test_bool)
+  {
+    UTF8String_init(&(empty_key));
+
+    json_value.type = JSON_VALUE_TYPE__STRING;
+    json_value.value = &(empty_key);
+  }
+  else if (JSON_VALUE_TYPE__STRING != json_value.type)
+  {
+    return FALSE;
+  }
+
+  /* Unknown clients are not an error (nothing to remove) */
+
+  SCardReaderDB_unsubscribe(
+    database,
+    database->session,
+    json_value.value);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Traces the names of all readers (and, optionally, the cards
+ * that are already present, as if they were just inserted).
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] withCards Should the present cards be traced too?
+ */
+VOID
+WebCard_traceReaders(
+  _Inout_ SCardReaderDB *database,
+  _In_ const BOOL withCards)
+{
+  UTF8String utf8_reader_name;
+  uint64_t now;
+  const SCARD_READERSTATE *reader_state;
+
+  if (!SCardTrace_isOpen(&(database->trace)))
+  {
+    return;
+  }
+
+  now = OSSpecific_getPreciseTime();
+
+  for (size_t i = 0; i < database->count; i++)
+  {
+    if (WebCard_pushReaderNameToJsonString(
+      &(database->states[i]),
+      &(utf8_reader_name)))
+    {
+      SCardTrace_record(
+        &(database->trace),
+        WEBCARD_TRACE_RECORD__READER,
+        0,
+        (uint32_t) i,
+        0,
+        now,
+        now,
+        utf8_reader_name.text,
+        utf8_reader_name.length,
+        NULL,
+        0);
+    }
+
+    UTF8String_destroy(&(utf8_reader_name));
+  }
+
+  for (size_t i = 0; withCards && (i < database->count); i++)
+  {
+    reader_state = &(database->states[i]);
+
+    if (reader_state->dwCurrentState & SCARD_STATE_PRESENT)
+    {
+      SCardTrace_record(
+        &(database->trace),
+        WEBCARD_TRACE_RECORD__EVENT,
+        0,
+        (uint32_t) i,
+        WEBCARD_READER_EVENT__CARD_INSERTION,
+        now,
+        now,
+        reader_state->rgbAtr,
+        (reader_state->cbAtr < WEBCARD_ATR_MAX_SIZE) ?
+          reader_state->cbAtr :
+          WEBCARD_ATR_MAX_SIZE,
+        NULL,
+        0);
+    }
+  }
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Traces a card insertion (with the ATR of the card) or removal.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] readerIndex Index of the reader.
+ * @param[in] readerEvent One of `WEBCARD_READER_EVENT__*` values.
+ */
+VOID
+WebCard_traceCardEvent(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent)
+{
+  const uint64_t now = OSSpecific_getPreciseTime();
+  const SCardConnection *connection = &(database->connections[readerIndex]);
+  const BOOL inserted = (WEBCARD_READER_EVENT__CARD_INSERTION == readerEvent);
+
+  SCardTrace_record(
+    &(database->trace),
+    WEBCARD_TRACE_RECORD__EVENT,
+    0,
+    (uint32_t) readerIndex,
+    (uint32_t) readerEvent,
+    now,
+    now,
+    connection->cardAtr,
+    inserted ? connection->cardAtrLength : 0,
+    NULL,
+    0);
+}
+
+/**************************************************************/
+
+VOID
+WebCard_publishReaderEvent(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _In_opt_ const JsonArray *jsonEventDetails,
+  _In_ const uint32_t suppressedCount)
+{
+  BOOL card_event;
+  BOOL prefetching = FALSE;
+
+  /* Reader indices of later trace records refer to the new list */
+
+  if ((WEBCARD_READER_EVENT__READERS_MORE == readerEvent) ||
+    (WEBCARD_READER_EVENT__READERS_LESS == readerEvent))
+  {
+    WebCard_traceReaders(database, FALSE);
+  }
+
+  /* Newly inserted card might be read before the event is sent */
+  /* (once, for all the sessions): by a worker thread, the event */
+  /* is published when it is collected */
+
+  if ((WEBCARD_READER_EVENT__CARD_INSERTION == readerEvent) &&
+    WebCard_hasSubscribers(database, readerIndex, readerEvent))
+  {
+    prefetching = WebCard_startPrefetch(
+      database,
+      readerIndex,
+      suppressedCount);
+  }
+
+  card_event =
+    (WEBCARD_READER_EVENT__CARD_INSERTION == readerEvent) ||
+    (WEBCARD_READER_EVENT__CARD_REMOVAL == readerEvent);
+
+  if (!prefetching)
+  {
+    WebCard_sendToSubscribers(
+      database,
+      card_event ? &(database->states[readerIndex]) : NULL,
+      readerIndex,
+      readerEvent,
+      jsonEventDetails,
+      FALSE,
+      suppressedCount);
+  }
+
+  /* Production line: the card gets the next job at once */
+  /* (or after the prefetch script, so that their commands don't mix) */
+
+  if (WEBCARD_READER_EVENT__CARD_INSERTION == readerEvent)
+  {
+    WebCard_dispatchJob(database, readerIndex);
+  }
+  else if (WEBCARD_READER_EVENT__CARD_REMOVAL == readerEvent)
+  {
+    database->connections[readerIndex].awaitingJob = FALSE;
+  }
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_configureDebounce(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  BOOL has_reader_index;
+  size_t reader_index = 0;
+  FLOAT test_float;
+  uint32_t window;
+  JsonValue json_value;
+  JsonValue json_number;
+  JsonObject json_reader_object;
+  JsonArray json_readers_array;
+  SCardConnection *connection;
+
+  /* Try to find the "r" key (optional reader index) */
+
+  has_reader_index = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "r");
+
+  if (has_reader_index)
+  {
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
+    {
+      return FALSE;
+    }
+
+    reader_index = (size_t) (((FLOAT *) json_value.value)[0]);
+
+    if (reader_index >= database->count)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{WebCard::configureDebounce} failed: " \
+        "invalid reader index!"
+      );
+
+      return FALSE;
+    }
+  }
+
+  /* Try to find the "p" key (optional window, in milliseconds) */
+  /* Negative value restores the Database-wide window for a reader */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "p");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
+    {
+      return FALSE;
+    }
+
+    test_float = ((FLOAT *) json_value.value)[0];
+
+    if (test_float < 0)
+    {
+      window = WEBCARD_DEBOUNCE__INHERIT;
+    }
+    else if (test_float >= (FLOAT) (WEBCARD_DEBOUNCE__INHERIT / 2))
+    {
+      return FALSE;
+    }
+    else
+    {
+      window = (uint32_t) test_float;
+    }
+
+    if (has_reader_index)
+    {
+      database->connections[reader_index].debounceWindow = window;
+    }
+    else if (WEBCARD_DEBOUNCE__INHERIT != window)
+    {
+      database->debounceWindow = window;
+    }
+    else
+    {
+      return FALSE;
+    }
+  }
+
+  /* Report effective windows and suppressed transitions of every reader */
+
+  JsonArray_init(&(json_readers_array));
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  json_value.type = JSON_VALUE_TYPE__OBJECT;
+  json_value.value = &(json_reader_object);
+
+  test_bool = TRUE;
+
+  for (size_t i = 0; test_bool && (i < database->count); i++)
+  {
+    connection = &(database->connections[i]);
+
+    JsonObject_init(&(json_reader_object));
+
+    test_float = (FLOAT) (
+      (WEBCARD_DEBOUNCE__INHERIT == connection->debounceWindow) ?
+        database->debounceWindow :
+        connection->debounceWindow);
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_reader_object),
+      "w",
+      &(json_number));
+
+    if (test_bool)
+    {
+      test_float = (FLOAT) connection->suppressedTotal;
+
+      test_bool = JsonObject_appendKeyValue(
+        &(json_reader_object),
+        "s",
+        &(json_number));
+    }
+
+    if (test_bool)
+    {
+      test_bool = JsonArray_append(
+        &(json_readers_array),
+        &(json_value));
+    }
+
+    JsonObject_destroy(&(json_reader_object));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__ARRAY;
+    json_value.value = &(json_readers_array);
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
+
+  JsonArray_destroy(&(json_readers_array));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_configureApduCache(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  FLOAT test_float;
+  LPBYTE instructions;
+  size_t instructions_length;
+  JsonValue json_value;
+  JsonValue json_number;
+  JsonObject json_stats_object;
+  SCardApduCache *cache = &(database->apduCache);
+
+  /* Try to find the "a" key (optional hex-string of "INS" bytes) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "a");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__STRING != json_value.type)
+    {
+      return FALSE;
+    }
+
+    if (0 == ((const UTF8String *) json_value.value)->length)
+    {
+      SCardApduCache_setAllowedInstructions(cache, NULL, 0);
+    }
+    else
+    {
+      test_bool = UTF8String_hexToByteArray(
+        json_value.value,
+        &(instructions_length),
+        &(instructions));
+
+      if (test_bool)
+      {
+        SCardApduCache_setAllowedInstructions(
+          cache,
+          instructions,
+          instructions_length);
+      }
+
+      if (NULL != instructions)
+      {
+        free(instructions);
+      }
+
+      if (!test_bool) { return FALSE; }
+    }
+  }
+
+  /* Try to find the "p" key (optional byte budget, `0` disables the cache) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "p");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
+    {
+      return FALSE;
+    }
+
+    test_float = ((FLOAT *) json_value.value)[0];
+
+    if (test_float < 0)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{WebCard::configureApduCache} failed: " \
+        "invalid byte budget!"
+      );
+
+      return FALSE;
+    }
+
+    SCardApduCache_setBudget(cache, (size_t) test_float);
+  }
+
+  /* Report the cache statistics */
+
+  const struct
+  {
+    LPCSTR key;
+    size_t value;
+  }
+  stats[] =
+  {
+    {"p", cache->byteBudget},
+    {"b", cache->byteCount},
+    {"n", cache->entryCount},
+    {"h", cache->hits},
+    {"m", cache->misses},
+    {"e", cache->evictions},
+    {"s", cache->elidedSelects}
+  };
+
+  JsonObject_init(&(json_stats_object));
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  test_bool = TRUE;
+
+  for (size_t i = 0; test_bool && (i < (sizeof(stats) / sizeof(stats[0]))); i++)
+  {
+    test_float = (FLOAT) stats[i].value;
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_stats_object),
+      stats[i].key,
+      &(json_number));
+  }
+
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_stats_object);
+
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
+
+  JsonObject_destroy(&(json_stats_object));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_configureCardCache(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  FLOAT test_float;
+  LPBYTE serial_apdu;
+  size_t serial_apdu_length;
+  JsonValue json_value;
+  JsonValue json_number;
+  JsonObject json_stats_object;
+  SCardCacheFile *persistent = &(database->apduCache.persistent);
+
+  /* Try to find the "a" key (optional serial-number command APDU) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "a");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__STRING != json_value.type)
+    {
+      return FALSE;
     }
 
-    case WEBCARD_COMMAND__DISCONNECT:
+    if (0 == ((const UTF8String *) json_value.value)->length)
     {
-      test_bool = WebCard_tryDisconnectingFromReader(
-        jsonRequest,
-        database);
+      persistent->serialApduLength = 0;
+    }
+    else
+    {
+      test_bool = UTF8String_hexToByteArray(
+        json_value.value,
+        &(serial_apdu_length),
+        &(serial_apdu));
+
+      if (test_bool &&
+        (serial_apdu_length >= 4) &&
+        (serial_apdu_length <= WEBCARD_SERIAL_APDU_MAX_SIZE))
+      {
+        memcpy(persistent->serialApdu, serial_apdu, serial_apdu_length);
+        persistent->serialApduLength = serial_apdu_length;
+      }
+      else
+      {
+        test_bool = FALSE;
+      }
 
-      /* "Empty" response (JSON object containing the "i" key only) */
-      /* will be required to resolve a "JavaScript Promise" */
-      break;
+      if (NULL != serial_apdu)
+      {
+        free(serial_apdu);
+      }
+
+      if (!test_bool) { return FALSE; }
     }
 
-    case WEBCARD_COMMAND__TRANSCEIVE:
+    /* Cards already identified with another command */
+    /* would get keys that can never match again */
+
+    for (size_t i = 0; i < database->count; i++)
     {
-      test_bool = WebCard_transmitAndReceive(
-        jsonRequest,
-        jsonResponse,
-        database);
+      database->connections[i].cardSerialKnown = FALSE;
+      database->connections[i].cardSerialLength = 0;
+    }
+  }
 
-      break;
+  /* Try to find the "l" key (optional record lifetime, in seconds) */
+
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "l");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
+    {
+      return FALSE;
     }
 
-    case WEBCARD_COMMAND__GET_VERSION:
+    test_float = ((FLOAT *) json_value.value)[0];
+
+    if ((test_float < 1) || (test_float > UINT32_MAX))
     {
-      UTF8String_makeTemporary(&(utf8_string), WEBCARD_VERSION);
+      return FALSE;
+    }
 
-      json_value.type = JSON_VALUE_TYPE__STRING;
-      json_value.value = &(utf8_string);
+    persistent->timeToLive = (uint32_t) test_float;
+  }
 
-      test_bool = JsonObject_appendKeyValue(
-        jsonResponse,
-        "verNat",
-        &(json_value));
+  /* Try to find the "p" key (optional file size, `0` disables the cache) */
 
-      break;
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "p");
+
+  if (test_bool)
+  {
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
+    {
+      return FALSE;
     }
 
-    default:
+    test_float = ((FLOAT *) json_value.value)[0];
+
+    if (test_float < 0)
     {
-      test_bool = TRUE;
+      return FALSE;
+    }
+
+    test_bool = SCardCacheFile_configure(persistent, (size_t) test_float);
+
+    if (!test_bool)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{WebCard::configureCardCache} failed: " \
+        "cache file unavailable!"
+      );
+
+      return FALSE;
     }
   }
 
-  /* Try to always send a JSON Response (so that a JavaScript Promise */
-  /* won't hang), even if a WebCard's command-handling function has failed */
+  /* Settings survive the restart of the Native App */
 
-  if (!test_bool)
+  SCardCacheFile_saveSettings(persistent);
+
+  /* Report the cache statistics */
+
+  const struct
   {
-    /* Append an optional key-value "incomplete=true" */
+    LPCSTR key;
+    size_t value;
+  }
+  stats[] =
+  {
+    {"p", persistent->file.size},
+    {"b", SCardCacheFile_usedBytes(persistent)},
+    {"n", persistent->slotCount},
+    {"h", persistent->hits},
+    {"m", persistent->misses},
+    {"e", persistent->evictions},
+    {"x", persistent->corrupted}
+  };
 
-    json_value.type = JSON_VALUE_TYPE__TRUE;
-    json_value.value = NULL;
+  JsonObject_init(&(json_stats_object));
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  test_bool = TRUE;
+
+  for (size_t i = 0; test_bool && (i < (sizeof(stats) / sizeof(stats[0]))); i++)
+  {
+    test_float = (FLOAT) stats[i].value;
 
-    JsonObject_appendKeyValue(jsonResponse, "incomplete", &(json_value));
+    test_bool = JsonObject_appendKeyValue(
+      &(json_stats_object),
+      stats[i].key,
+      &(json_number));
   }
 
-  /* Stringify JSON response and send it through the STDOUT stream */
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_stats_object);
 
-  UTF8String_init(&(utf8_string));
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
 
-  test_bool = JsonObject_toString(jsonResponse, &(utf8_string));
+  JsonObject_destroy(&(json_stats_object));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+WebCard_registerPrefetchScript(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ SCardReaderDB *database)
+{
+  BOOL test_bool;
+  SCardPrefetchScript script;
+
+  test_bool = SCardPrefetchScript_load(&(script), jsonRequest);
 
   if (test_bool)
   {
-    UTF8String_writeToStandardOutput(&(utf8_string));
+    /* On success, the script is moved into the database */
+
+    test_bool = SCardReaderDB_installPrefetchScript(database, &(script));
   }
 
-  UTF8String_destroy(&(utf8_string));
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard::registerPrefetchScript} failed: " \
+      "invalid script!"
+    );
+
+    SCardPrefetchScript_destroy(&(script));
+  }
+
+  return test_bool;
 }
 
 /**************************************************************/
 
+/**
+ * @brief A private method for `WebCard` object.
+ * Adds a histogram summary to a JSON Object under given key.
+ *
+ * @param[in] histogram Reference to a VALID and CONSTANT
+ * `SCardLatencyHistogram` object.
+ * @param[in,out] jsonObject Reference to a VALID `JsonObject` object.
+ * @param[in] key Key of the histogram summary.
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ */
 BOOL
-WebCard_pushReaderNameToJsonString(
-  _In_ const SCARD_READERSTATE *readerState,
-  _Out_ UTF8String *resultReaderName)
+WebCard_pushHistogramToJsonObject(
+  _In_ const SCardLatencyHistogram *histogram,
+  _Inout_ JsonObject *jsonObject,
+  _In_ LPCSTR key)
 {
   BOOL test_bool;
+  JsonValue json_value;
+  JsonObject json_summary;
 
-  #ifdef _UNICODE
-    UTF16String utf16_reader_name;
-  #endif
+  test_bool = SCardLatencyHistogram_toJsonObject(
+    histogram,
+    &(json_summary));
 
-  UTF8String_init(resultReaderName);
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_summary);
 
-  #ifdef _UNICODE
+    test_bool = JsonObject_appendKeyValue(
+      jsonObject,
+      key,
+      &(json_value));
+  }
+
+  JsonObject_destroy(&(json_summary));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Describes the statistics of every command that was handled so far:
+ * `[{c, f, read, parse, run, serialize, write, total}, ...]`.
+ *
+ * @param[in] stats Reference to a VALID and CONSTANT `SCardStats` object.
+ * @param[out] jsonArray Reference to an UNINITIALIZED `JsonArray` object.
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ *
+ * @note `jsonArray` must be released by the caller.
+ */
+BOOL
+WebCard_convertCommandStatsToJsonArray(
+  _In_ const SCardStats *stats,
+  _Out_ JsonArray *jsonArray)
+{
+  BOOL test_bool = TRUE;
+  FLOAT test_float;
+  JsonValue json_value;
+  JsonValue json_number;
+  JsonObject json_command;
+  const SCardCommandStats *command_stats;
+
+  static const LPCSTR stage_names[WEBCARD_STAGE_COUNT] =
   {
-    UTF16String_init(&(utf16_reader_name));
+    "read", "parse", "run", "serialize", "write", "total"
+  };
 
-    test_bool = UTF16String_pushText(
-      &(utf16_reader_name),
-      readerState->szReader,
-      0);
+  JsonArray_init(jsonArray);
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  for (size_t i = 0; test_bool && (i < WEBCARD_STATS_COMMANDS); i++)
+  {
+    command_stats = stats->commands[i];
+    if (NULL == command_stats) { continue; }
+
+    JsonObject_init(&(json_command));
+
+    /* Command number ("c") and number of failed responses ("f") */
+
+    test_float = (FLOAT) i;
+    test_bool = JsonObject_appendKeyValue(&(json_command), "c", &(json_number));
 
     if (test_bool)
     {
-      test_bool = UTF16String_toUTF8(
-        &(utf16_reader_name),
-        resultReaderName);
+      test_float = (FLOAT) command_stats->failures;
+      test_bool = JsonObject_appendKeyValue(&(json_command), "f", &(json_number));
     }
 
-    UTF16String_destroy(&(utf16_reader_name));
-  }
-  #else
-  {
-    test_bool = UTF8String_pushText(
-      resultReaderName,
-      readerState->szReader,
-      0);
+    for (size_t j = 0; test_bool && (j < WEBCARD_STAGE_COUNT); j++)
+    {
+      test_bool = WebCard_pushHistogramToJsonObject(
+        &(command_stats->stages[j]),
+        &(json_command),
+        stage_names[j]);
+    }
+
+    if (test_bool)
+    {
+      json_value.type = JSON_VALUE_TYPE__OBJECT;
+      json_value.value = &(json_command);
+
+      test_bool = JsonArray_append(jsonArray, &(json_value));
+    }
+
+    JsonObject_destroy(&(json_command));
   }
-  #endif
 
   return test_bool;
 }
 
 /**************************************************************/
 
+/**
+ * @brief A private method for `WebCard` object.
+ * Describes the `SCardTransmit` and waiting statistics
+ * of every reader: `[{n, x, w}, ...]`.
+ *
+ * @param[in] stats Reference to a VALID and CONSTANT `SCardStats` object.
+ * @param[out] jsonArray Reference to an UNINITIALIZED `JsonArray` object.
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ *
+ * @note `jsonArray` must be released by the caller.
+ */
 BOOL
-WebCard_pushReaderNameToJsonArray(
-  _In_ const SCARD_READERSTATE *readerState,
-  _Inout_ JsonArray *jsonArray)
+WebCard_convertReaderStatsToJsonArray(
+  _In_ const SCardStats *stats,
+  _Out_ JsonArray *jsonArray)
 {
-  BOOL test_bool;
+  BOOL test_bool = TRUE;
   JsonValue json_value;
-  UTF8String utf8_reader_name;
+  JsonObject json_reader;
+  SCARD_READERSTATE reader_state;
 
-  test_bool = WebCard_pushReaderNameToJsonString(
-    readerState,
-    &(utf8_reader_name));
+  JsonArray_init(jsonArray);
 
-  if (!test_bool)
+  for (size_t i = 0; test_bool && (i < stats->readerCount); i++)
   {
-    UTF8String_destroy(&(utf8_reader_name));
-    return FALSE;
-  }
+    JsonObject_init(&(json_reader));
 
-  /* Put "Reader Name" at the end of given array */
+    /* Only the name is needed to convert it to UTF-8 */
 
-  json_value.type = JSON_VALUE_TYPE__STRING;
-  json_value.value = &(utf8_reader_name);
+    reader_state.szReader = stats->readers[i]->readerName;
 
-  test_bool = JsonArray_append(jsonArray, &(json_value));
+    test_bool = WebCard_pushReaderNameToJsonObject(
+      &(reader_state),
+      &(json_reader),
+      "n");
 
-  UTF8String_destroy(&(utf8_reader_name));
+    if (test_bool)
+    {
+      test_bool = WebCard_pushHistogramToJsonObject(
+        &(stats->readers[i]->transmit),
+        &(json_reader),
+        "x");
+    }
+
+    if (test_bool)
+    {
+      test_bool = WebCard_pushHistogramToJsonObject(
+        &(stats->readers[i]->wait),
+        &(json_reader),
+        "w");
+    }
+
+    if (test_bool)
+    {
+      json_value.type = JSON_VALUE_TYPE__OBJECT;
+      json_value.value = &(json_reader);
+
+      test_bool = JsonArray_append(jsonArray, &(json_value));
+    }
+
+    JsonObject_destroy(&(json_reader));
+  }
 
   return test_bool;
 }
@@ -648,109 +4682,181 @@ WebCard_pushReaderNameToJsonArray(
 /**************************************************************/
 
 BOOL
-WebCard_pushReaderNameToJsonObject(
-  _In_ const SCARD_READERSTATE *readerState,
-  _Inout_ JsonObject *jsonObject,
-  _In_ LPCSTR key)
+WebCard_reportStatistics(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database)
 {
   BOOL test_bool;
+  FLOAT test_float;
   JsonValue json_value;
-  UTF8String utf8_reader_name;
+  JsonValue json_number;
+  JsonArray json_array;
+  JsonObject json_stats_object;
+  JsonObject json_recovery_object;
+  JsonObject json_output_object;
+  SCardOutputStats output_stats;
+  SCardStats *stats = &(database->stats);
+
+  SCardRecovery *recovery = &(database->recovery);
+  const uint64_t now = OSSpecific_getMonotonicTime();
+
+  const struct
+  {
+    LPCSTR key;
+    uint64_t value;
+  }
+  recovery_stats[] =
+  {
+    {"n", recovery->outages},
+    {"a", recovery->failedAttempts},
+    {"f", recovery->fastAttempts},
+    {"l", recovery->lastRecoveryTime},
+    {"m", recovery->longestRecoveryTime},
+    {"d", (WEBCARD_RECOVERY__READY == recovery->state) ? 0 : (now - recovery->lostSince)}
+  };
 
-  test_bool = WebCard_pushReaderNameToJsonString(
-    readerState,
-    &(utf8_reader_name));
+  JsonObject_init(&(json_stats_object));
 
-  if (!test_bool)
+  /* Time since the last reset ("t", in milliseconds) */
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  test_float = (FLOAT) (now - stats->resetTime);
+
+  test_bool = JsonObject_appendKeyValue(
+    &(json_stats_object),
+    "t",
+    &(json_number));
+
+  /* Per-command ("c") and per-reader ("r") histograms */
+
+  json_value.type = JSON_VALUE_TYPE__ARRAY;
+  json_value.value = &(json_array);
+
+  if (test_bool)
   {
-    UTF8String_destroy(&(utf8_reader_name));
-    return FALSE;
+    test_bool =
+      WebCard_convertCommandStatsToJsonArray(stats, &(json_array)) &&
+      JsonObject_appendKeyValue(&(json_stats_object), "c", &(json_value));
+
+    JsonArray_destroy(&(json_array));
   }
 
-  /* Add "Reader Name" under a specified key */
+  if (test_bool)
+  {
+    test_bool =
+      WebCard_convertReaderStatsToJsonArray(stats, &(json_array)) &&
+      JsonObject_appendKeyValue(&(json_stats_object), "r", &(json_value));
 
-  json_value.type = JSON_VALUE_TYPE__STRING;
-  json_value.value = &(utf8_reader_name);
+    JsonArray_destroy(&(json_array));
+  }
 
-  test_bool = JsonObject_appendKeyValue(
-    jsonObject,
-    key,
-    &(json_value));
+  /* Smart Card Context outages ("s") */
 
-  UTF8String_destroy(&(utf8_reader_name));
+  if (test_bool)
+  {
+    JsonObject_init(&(json_recovery_object));
+
+    for (size_t i = 0; test_bool && (i < (sizeof(recovery_stats) / sizeof(recovery_stats[0]))); i++)
+    {
+      test_float = (FLOAT) recovery_stats[i].value;
 
-  return test_bool;
-}
+      test_bool = JsonObject_appendKeyValue(
+        &(json_recovery_object),
+        recovery_stats[i].key,
+        &(json_number));
+    }
 
-/**************************************************************/
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_recovery_object);
 
-BOOL
-WebCard_convertReaderStateToJsonObject(
-  _In_ const SCARD_READERSTATE *readerState,
-  _Out_ JsonObject *jsonReaderObject)
-{
-  BOOL test_bool;
+    test_bool = test_bool &&
+      JsonObject_appendKeyValue(&(json_stats_object), "s", &(json_value));
 
-  /* Initialize JSON reader object */
-  /* (it will be destroyed by caller) */
+    JsonObject_destroy(&(json_recovery_object));
+  }
 
-  JsonObject_init(jsonReaderObject);
+  /* Backpressure of Standard Output ("o") */
 
-  /* Add key "n" (Reader Name) */
+  if (test_bool && (NULL != SCardOutputQueue_current))
+  {
+    SCardOutputQueue_getStats(SCardOutputQueue_current, &(output_stats));
 
-  test_bool = WebCard_pushReaderNameToJsonObject(
-    readerState,
-    jsonReaderObject,
-    "n");
+    const struct
+    {
+      LPCSTR key;
+      uint64_t value;
+    }
+    output_counters[] =
+    {
+      {"n", output_stats.queuedMessages},
+      {"b", output_stats.queuedBytes},
+      {"p", output_stats.peakBytes},
+      {"m", output_stats.mergedEvents},
+      {"c", output_stats.congestions},
+      {"w", output_stats.congestedTime},
+      {"l", output_stats.longestWait}
+    };
+
+    JsonObject_init(&(json_output_object));
+
+    for (size_t i = 0; test_bool && (i < (sizeof(output_counters) / sizeof(output_counters[0]))); i++)
+    {
+      test_float = (FLOAT) output_counters[i].value;
 
-  if (!test_bool) { return FALSE; }
+      test_bool = JsonObject_appendKeyValue(
+        &(json_output_object),
+        output_counters[i].key,
+        &(json_number));
+    }
 
-  /* Add key "a" (card Answer To Reset) */
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_output_object);
 
-  return WebCard_pushReaderAtrToJsonObject(
-    readerState,
-    jsonReaderObject,
-    "a");
-}
+    test_bool = test_bool &&
+      JsonObject_appendKeyValue(&(json_stats_object), "o", &(json_value));
 
-/**************************************************************/
+    JsonObject_destroy(&(json_output_object));
+  }
 
-BOOL
-WebCard_pushReaderAtrToJsonObject(
-  _In_ const SCARD_READERSTATE *readerState,
-  _Inout_ JsonObject *jsonObject,
-  _In_ LPCSTR key)
-{
-  BOOL test_bool;
-  JsonValue json_value;
-  UTF8String utf8_string;
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_stats_object);
 
-  /* Copy Smart Card "ATR" identifier (bytearray to text) */
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
 
-  UTF8String_init(&(utf8_string));
+  JsonObject_destroy(&(json_stats_object));
 
-  test_bool = UTF8String_pushBytesAsHex(
-    &(utf8_string),
-    readerState->cbAtr,
-    readerState->rgbAtr);
+  /* Try to find the "z" key (optional reset, after reporting) */
 
-  if (!test_bool)
+  if (JsonObject_getValue(jsonRequest, &(json_value), "z") &&
+    (JSON_VALUE_TYPE__NUMBER == json_value.type) &&
+    (0 != ((FLOAT *) json_value.value)[0]))
   {
-    UTF8String_destroy(&(utf8_string));
-    return FALSE;
-  }
+    /* Connections must not keep pointers to the released histograms */
 
-  /* Add "card Answer To Reset" under a specified key */
+    for (int i = 0; i < database->count; i++)
+    {
+      database->connections[i].transmitLatency = NULL;
+    }
 
-  json_value.type = JSON_VALUE_TYPE__STRING;
-  json_value.value = &(utf8_string);
+    SCardStats_destroy(stats);
+    SCardStats_init(stats);
 
-  test_bool = JsonObject_appendKeyValue(
-    jsonObject,
-    key,
-    &(json_value));
+    SCardRecovery_resetCounters(recovery);
 
-  UTF8String_destroy(&(utf8_string));
+    if (NULL != SCardOutputQueue_current)
+    {
+      SCardOutputQueue_resetStats(SCardOutputQueue_current);
+    }
+  }
 
   return test_bool;
 }
@@ -758,520 +4864,687 @@ WebCard_pushReaderAtrToJsonObject(
 /**************************************************************/
 
 BOOL
-WebCard_convertReaderStatesToJsonArray(
-  _In_ const SCardReaderDB *database,
-  _Out_ JsonArray *jsonReadersArray)
+WebCard_configureTrace(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database)
 {
   BOOL test_bool;
+  FLOAT test_float;
+  uint64_t written;
+  uint64_t dropped;
+  size_t used_bytes;
   JsonValue json_value;
-  JsonObject json_reader_object;
-
-  json_value.type = JSON_VALUE_TYPE__OBJECT;
-  json_value.value = &(json_reader_object);
-
-  /* Initialize JSON reader object */
-  /* (it will be destroyed by caller) */
+  JsonValue json_number;
+  JsonObject json_stats_object;
+  SCardTrace *trace = &(database->trace);
 
-  JsonArray_init(jsonReadersArray);
+  /* Try to find the "p" key (optional file size, `0` stops tracing) */
 
-  /* Enumerate Smart Card Readers */
+  test_bool = JsonObject_getValue(
+    jsonRequest,
+    &(json_value),
+    "p");
 
-  for (size_t i = 0; i < database->count; i++)
+  if (test_bool)
   {
-    test_bool = WebCard_convertReaderStateToJsonObject(
-      &(database->states[i]),
-      &(json_reader_object));
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
+    {
+      return FALSE;
+    }
 
-    if (test_bool)
+    test_float = ((FLOAT *) json_value.value)[0];
+
+    if (test_float < 0)
     {
-      test_bool = JsonArray_append(
-        jsonReadersArray,
-        &(json_value));
+      return FALSE;
     }
 
-    JsonObject_destroy(&(json_reader_object));
+    test_bool = SCardTrace_configure(trace, (size_t) test_float);
 
     if (!test_bool)
     {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__WARNING,
+        "{WebCard::configureTrace} failed: " \
+        "trace file unavailable!"
+      );
+
       return FALSE;
     }
+
+    /* Every trace begins with the current readers and cards */
+
+    WebCard_traceReaders(database, TRUE);
   }
 
-  return TRUE;
-}
+  /* Report the trace usage */
 
-/**************************************************************/
+  used_bytes = SCardTrace_usage(trace, &(written), &(dropped));
 
-BOOL
-WebCard_pushReadersListToJsonResponse(
-  _Inout_ JsonObject *jsonResponse,
-  _In_ const SCardReaderDB *database)
-{
-  BOOL test_bool;
-  JsonArray json_readers_array;
-  JsonValue json_value;
+  const struct
+  {
+    LPCSTR key;
+    uint64_t value;
+  }
+  stats[] =
+  {
+    {"p", trace->file.size},
+    {"b", used_bytes},
+    {"n", written},
+    {"x", dropped}
+  };
 
-  test_bool = WebCard_convertReaderStatesToJsonArray(
-    database,
-    &(json_readers_array));
+  JsonObject_init(&(json_stats_object));
 
-  if (!test_bool)
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  test_bool = TRUE;
+
+  for (size_t i = 0; test_bool && (i < (sizeof(stats) / sizeof(stats[0]))); i++)
   {
-    JsonArray_destroy(&(json_readers_array));
-    return FALSE;
+    test_float = (FLOAT) stats[i].value;
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_stats_object),
+      stats[i].key,
+      &(json_number));
   }
 
-  json_value.type = JSON_VALUE_TYPE__ARRAY;
-  json_value.value = &(json_readers_array);
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_stats_object);
 
-  test_bool = JsonObject_appendKeyValue(
-    jsonResponse,
-    "d",
-    &(json_value));
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
+
+  JsonObject_destroy(&(json_stats_object));
 
-  JsonArray_destroy(&(json_readers_array));
   return test_bool;
 }
 
 /**************************************************************/
 
 BOOL
-WebCard_tryConnectingToReader(
+WebCard_configureLogging(
   _In_ const JsonObject *jsonRequest,
-  _Inout_ JsonObject *jsonResponse,
-  _In_ const SCardReaderDB *database,
-  _In_ const SCARDCONTEXT context)
+  _Inout_ JsonObject *jsonResponse)
 {
   BOOL test_bool;
-  size_t reader_index;
-  const SCARD_READERSTATE *readerState;
-  PCSC_DWORD share_mode = SCARD_SHARE_SHARED;
+  FLOAT test_float;
+  uint64_t dropped;
   JsonValue json_value;
+  JsonValue json_number;
+  JsonObject json_state_object;
 
-  /* Try to find the "r" key (reader index) */
+  /* Try to find the "p" key (optional log level) */
 
   test_bool = JsonObject_getValue(
     jsonRequest,
     &(json_value),
-    "r");
+    "p");
 
-  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
+  if (test_bool)
   {
-    #if defined(_DEBUG)
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
     {
-      OSSpecific_writeDebugMessage(
-        "{WebCard::tryConnectingToReader} failed: " \
-        "missing \"r\" key!"
-      );
+      return FALSE;
     }
-    #endif
 
-    return FALSE;
-  }
-
-  reader_index = (size_t) (((FLOAT *) json_value.value)[0]);
+    test_float = ((FLOAT *) json_value.value)[0];
 
-  if (reader_index >= database->count)
-  {
-    #if defined(_DEBUG)
+    if ((test_float < OS_SPECIFIC_LOG__OFF) || (test_float > OS_SPECIFIC_LOG__TRACE))
     {
-      OSSpecific_writeDebugMessage(
-        "{WebCard::tryConnectingToReader} failed: " \
-        "invalid reader index!"
-      );
+      return FALSE;
     }
-    #endif
 
-    return FALSE;
+    if (!OSSpecific_setLogLevel((int) test_float))
+    {
+      return FALSE;
+    }
   }
 
-  /* Try to find the "p" key (optional share mode param) */
+  /* Report the logger state */
 
-  test_bool = JsonObject_getValue(
-    jsonRequest,
-    &(json_value),
-    "p");
+  JsonObject_init(&(json_state_object));
 
-  if (test_bool && (JSON_VALUE_TYPE__NUMBER == json_value.type))
-  {
-    share_mode = (PCSC_DWORD) (((FLOAT *) json_value.value)[0]);
-  }
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
 
-  /* Try to open a connection to active Smart Card */
+  test_float = (FLOAT) OSSpecific_getLogLevel(&(dropped));
 
-  readerState = &(database->states[reader_index]);
+  test_bool = JsonObject_appendKeyValue(
+    &(json_state_object),
+    "p",
+    &(json_number));
 
-  test_bool = SCardConnection_open(
-    &(database->connections[reader_index]),
-    context,
-    readerState->szReader,
-    share_mode);
+  if (test_bool)
+  {
+    test_float = (FLOAT) dropped;
 
-  if (!test_bool) { return FALSE; }
+    test_bool = JsonObject_appendKeyValue(
+      &(json_state_object),
+      "x",
+      &(json_number));
+  }
 
-  /* Add key "d" (card Answer To Reset) */
+  if (test_bool)
+  {
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_state_object);
 
-  return WebCard_pushReaderAtrToJsonObject(
-    readerState,
-    jsonResponse,
-    "d");
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
+  }
+
+  JsonObject_destroy(&(json_state_object));
+
+  return test_bool;
 }
 
 /**************************************************************/
 
 BOOL
-WebCard_tryDisconnectingFromReader(
+WebCard_configureLinger(
   _In_ const JsonObject *jsonRequest,
-  _In_ const SCardReaderDB *database)
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database)
 {
   BOOL test_bool;
-  size_t reader_index;
+  FLOAT test_float;
+  size_t lingering = 0;
   JsonValue json_value;
+  JsonValue json_number;
+  JsonObject json_state_object;
 
-  /* Try to find the "r" key (reader index) */
+  /* Try to find the "p" key (optional linger time, in milliseconds) */
 
   test_bool = JsonObject_getValue(
     jsonRequest,
     &(json_value),
-    "r");
+    "p");
 
-  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
+  if (test_bool)
   {
-    #if defined(_DEBUG)
+    if (JSON_VALUE_TYPE__NUMBER != json_value.type)
     {
-      OSSpecific_writeDebugMessage(
-        "{WebCard::tryDisconnectingFromReader} failed: " \
-        "missing \"r\" key!"
-      );
+      return FALSE;
     }
-    #endif
 
-    return FALSE;
+    test_float = ((FLOAT *) json_value.value)[0];
+
+    if ((test_float < 0) || (test_float > WEBCARD_LINGER__MAX_TIME))
+    {
+      return FALSE;
+    }
+
+    database->lingerTime = (uint32_t) test_float;
+
+    /* Lingering stops right away when disabled */
+
+    for (size_t i = 0; (0 == database->lingerTime) && (i < database->count); i++)
+    {
+      if (0 != database->connections[i].lingerDeadline)
+      {
+        SCardConnection_close(&(database->connections[i]));
+      }
+    }
   }
 
-  reader_index = (size_t) (((FLOAT *) json_value.value)[0]);
+  for (size_t i = 0; i < database->count; i++)
+  {
+    if (0 != database->connections[i].lingerDeadline)
+    {
+      lingering += 1;
+    }
+  }
+
+  /* Report the linger state */
+
+  JsonObject_init(&(json_state_object));
+
+  json_number.type = JSON_VALUE_TYPE__NUMBER;
+  json_number.value = &(test_float);
+
+  const struct
+  {
+    LPCSTR key;
+    uint64_t value;
+  }
+  summary[] =
+  {
+    {"p", database->lingerTime},
+    {"n", lingering},
+    {"h", database->lingerHits},
+    {"m", database->lingerMisses},
+    {"x", database->lingerReleases}
+  };
+
+  test_bool = TRUE;
+
+  for (size_t i = 0; test_bool && (i < (sizeof(summary) / sizeof(summary[0]))); i++)
+  {
+    test_float = (FLOAT) summary[i].value;
+
+    test_bool = JsonObject_appendKeyValue(
+      &(json_state_object),
+      summary[i].key,
+      &(json_number));
+  }
 
-  if (reader_index >= database->count)
+  if (test_bool)
   {
-    #if defined(_DEBUG)
-    {
-      OSSpecific_writeDebugMessage(
-        "{WebCard::tryDisconnectingFromReader} failed: " \
-        "invalid reader index!"
-      );
-    }
-    #endif
+    json_value.type = JSON_VALUE_TYPE__OBJECT;
+    json_value.value = &(json_state_object);
 
-    return FALSE;
+    test_bool = JsonObject_appendKeyValue(
+      jsonResponse,
+      "d",
+      &(json_value));
   }
 
-  /* Try to close a connection to active Smart Card */
+  JsonObject_destroy(&(json_state_object));
 
-  return SCardConnection_close(
-    &(database->connections[reader_index]));
+  return test_bool;
 }
 
 /**************************************************************/
 
 BOOL
-WebCard_transmitAndReceive(
-  _In_ const JsonObject *jsonRequest,
-  _Inout_ JsonObject *jsonResponse,
-  _In_ const SCardReaderDB *database)
+WebCard_startPrefetch(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const uint32_t suppressedCount)
 {
   BOOL test_bool;
-  size_t reader_index;
-  LPBYTE input_bytes;
-  size_t input_bytes_length;
-  LPBYTE output_bytes;
-  JsonValue json_value;
-  UTF8String utf8_hex_apdu_response;
-  SCardConnection *connection;
+  SCardFanOut *fan_out;
+  const SCardPrefetchScript *script;
 
-  /* Try to find the "r" key (reader index) */
-
-  test_bool = JsonObject_getValue(
-    jsonRequest,
-    &(json_value),
-    "r");
+  script = SCardReaderDB_findPrefetchScript(database, readerIndex);
 
-  if (!test_bool || (JSON_VALUE_TYPE__NUMBER != json_value.type))
+  if (NULL == script)
   {
-    #if defined(_DEBUG)
-    {
-      OSSpecific_writeDebugMessage(
-        "{WebCard::transmitAndReceive} failed: " \
-        "missing \"r\" key!"
-      );
-    }
-    #endif
-
     return FALSE;
   }
 
-  reader_index = (size_t) (((FLOAT *) json_value.value)[0]);
+  fan_out = malloc(sizeof(SCardFanOut));
+  if (NULL == fan_out) { return FALSE; }
 
-  if (reader_index >= database->count)
-  {
-    #if defined(_DEBUG)
-    {
-      OSSpecific_writeDebugMessage(
-        "{WebCard::transmitAndReceive} failed: " \
-        "invalid reader index!"
-      );
-    }
-    #endif
+  SCardFanOut_init(fan_out);
 
-    return FALSE;
-  }
+  /* Nobody waits for an answer: the event is published instead */
 
-  /* Make sure that a connection to the Smart Card is still active */
+  fan_out->prefetch = TRUE;
+  fan_out->answered = TRUE;
+  fan_out->suppressedCount = suppressedCount;
 
-  connection = &(database->connections[reader_index]);
+  /* The script might be replaced while the worker reads it */
 
-  if (0 == connection->handle)
+  test_bool = SCardPrefetchScript_copy(&(fan_out->script), script);
+
+  if (test_bool)
   {
-    #if defined(_DEBUG)
-    {
-      OSSpecific_writeDebugMessage(
-        "{WebCard::transmitAndReceive} failed: " \
-        "no connection!"
-      );
-    }
-    #endif
+    test_bool = SCardFanOut_addReader(
+      fan_out,
+      database->states[readerIndex].szReader,
+      readerIndex,
+      &(database->connections[readerIndex]));
+  }
 
+  if (!test_bool)
+  {
+    SCardFanOut_destroy(fan_out);
+    free(fan_out);
     return FALSE;
   }
 
-  /* Try to find the "a" key (Application Protocol Data Unit) */
+  /* The page doesn't know about this card yet: the main loop does */
+  /* not wait for it (requests for this reader do, like for a fan-out) */
 
-  test_bool = JsonObject_getValue(
-    jsonRequest,
-    &(json_value),
-    "a");
+  SCardFanOut_start(fan_out);
 
-  if (!test_bool || (JSON_VALUE_TYPE__STRING != json_value.type))
-  {
-    return FALSE;
-  }
+  fan_out->next = database->fanOuts;
+  database->fanOuts = fan_out;
 
-  /* Prepare input and output byte buffers */
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__DEBUG,
+    "{WebCard::startPrefetch} %u command APDUs sent to reader %u",
+    (uint32_t) fan_out->script.apduCount,
+    (uint32_t) readerIndex);
 
-  test_bool = UTF8String_hexToByteArray(
-    json_value.value,
-    &(input_bytes_length),
-    &(input_bytes));
+  return TRUE;
+}
 
-  if (!test_bool)
+/**************************************************************/
+
+/**
+ * @brief A private method for `WebCard` object.
+ * Publishes the "Card Insertion" event of given reader at once, if it
+ * still waits for its prefetch script (stopped before its next command).
+ */
+VOID
+WebCard_finishPrefetch(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex)
+{
+  SCardFanOut *fan_out;
+  BOOL stopped = FALSE;
+
+  for (fan_out = database->fanOuts; NULL != fan_out; fan_out = fan_out->next)
   {
-    if (NULL != input_bytes)
+    if (fan_out->prefetch &&
+      SCardFanOut_usesReader(fan_out, database->states[readerIndex].szReader))
     {
-      free(input_bytes);
+      SCardFanOut_stop(fan_out);
+      SCardFanOut_wait(fan_out);
+      stopped = TRUE;
     }
-    return FALSE;
   }
 
-  output_bytes = malloc(sizeof(BYTE) * MAX_APDU_SIZE);
-  if (NULL == output_bytes)
+  if (stopped)
   {
-    free(input_bytes);
-    return FALSE;
+    WebCard_collectFanOuts(database);
   }
+}
 
-  /* Transmit and receive */
+/**************************************************************/
 
-  UTF8String_init(&(utf8_hex_apdu_response));
+VOID
+WebCard_debounceCardEvent(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _In_ const uint64_t now)
+{
+  SCardConnection *connection = &(database->connections[readerIndex]);
 
-  test_bool = SCardConnection_transceiveMultiple(
-    connection,
-    &(utf8_hex_apdu_response),
-    input_bytes,
-    input_bytes_length,
-    output_bytes,
-    MAX_APDU_SIZE);
+  uint32_t window = (WEBCARD_DEBOUNCE__INHERIT == connection->debounceWindow) ?
+    database->debounceWindow :
+    connection->debounceWindow;
 
-  if (test_bool)
+  if ((0 == window) &&
+    (WEBCARD_READER_EVENT__NONE == connection->pendingEvent))
   {
-    /* Add key "d" (Smart Card APDU response) */
+    /* Debouncing disabled: send every transition immediately */
 
-    json_value.type = JSON_VALUE_TYPE__STRING;
-    json_value.value = &(utf8_hex_apdu_response);
+    WebCard_publishReaderEvent(
+      database,
+      readerIndex,
+      readerEvent,
+      NULL,
+      0);
 
-    test_bool = JsonObject_appendKeyValue(
-      jsonResponse,
-      "d",
-      &(json_value));
+    connection->settledEvent = readerEvent;
+    return;
   }
 
-  UTF8String_destroy(&(utf8_hex_apdu_response));
+  /* Coalesce with the previous (still unsettled) transition */
 
-  return test_bool;
+  if (WEBCARD_READER_EVENT__NONE != connection->pendingEvent)
+  {
+    connection->pendingSuppressed += 1;
+  }
+
+  if (WEBCARD_READER_EVENT__CARD_REMOVAL == readerEvent)
+  {
+    connection->pendingRemoval = TRUE;
+  }
+
+  /* The state must stay unchanged for the whole window */
+
+  connection->pendingEvent = readerEvent;
+  connection->pendingDeadline = now + window;
 }
 
 /**************************************************************/
 
 VOID
-WebCard_sendReaderEvent(
-  _In_opt_ const SCARD_READERSTATE *readerState,
-  _In_ const size_t readerIndex,
-  _In_ const int readerEvent,
-  _Out_ JsonObject *jsonResponse,
-  _In_opt_ const JsonArray *jsonEventDetails)
+WebCard_flushSettledCardEvents(
+  _Inout_ SCardReaderDB *database,
+  _In_ const uint64_t now)
 {
-  BOOL test_bool;
-  FLOAT test_float;
-  JsonValue json_value;
-  UTF8String utf8_string;
+  SCardConnection *connection;
+  BOOL should_send;
 
-  #if defined(_DEBUG)
+  for (size_t i = 0; i < database->count; i++)
   {
-    OSSpecific_writeDebugMessage(
-      "Sending ReaderEvent '%d' (ReaderIndex '%d')",
-      readerEvent,
-      readerIndex);
-  }
-  #endif
+    connection = &(database->connections[i]);
 
-  /* Initialize JSON response object */
-  /* (it will be destroyed by caller) */
+    if ((WEBCARD_READER_EVENT__NONE == connection->pendingEvent) ||
+      (now < connection->pendingDeadline))
+    {
+      continue;
+    }
 
-  JsonObject_init(jsonResponse);
+    /* Send the settled state if the page doesn't know it yet. */
+    /* A card that was removed and put back is a new card session, */
+    /* even though the settled state equals the last sent one. */
 
-  json_value.type = JSON_VALUE_TYPE__NUMBER;
-  json_value.value = &(test_float);
+    should_send =
+      (connection->pendingEvent != connection->settledEvent) ||
+      ((WEBCARD_READER_EVENT__CARD_INSERTION == connection->pendingEvent) &&
+        connection->pendingRemoval);
 
-  /* Add key "e" (reader event) */
+    if (should_send)
+    {
+      WebCard_publishReaderEvent(
+        database,
+        i,
+        connection->pendingEvent,
+        NULL,
+        connection->pendingSuppressed);
 
-  test_float = (FLOAT) readerEvent;
+      connection->settledEvent = connection->pendingEvent;
+    }
+    else
+    {
+      connection->pendingSuppressed += 1;
+    }
 
-  test_bool = JsonObject_appendKeyValue(
-    jsonResponse,
-    "e",
-    &(json_value));
+    connection->suppressedTotal += connection->pendingSuppressed;
 
-  if (!test_bool) { return; }
+    connection->pendingEvent = WEBCARD_READER_EVENT__NONE;
+    connection->pendingRemoval = FALSE;
+    connection->pendingSuppressed = 0;
+  }
+}
 
-  if (NULL != readerState)
-  {
-    /* Add key "r" (reader index for reader events) */
+/**************************************************************/
 
-    test_float = (FLOAT) readerIndex;
+/**
+ * @brief A private method for `WebCard` object.
+ * Handles the new state of one Smart Card Reader
+ * (reported by `SCardGetStatusChange` as changed).
+ */
+VOID
+WebCard_handleReaderChange(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const uint64_t now)
+{
+  SCARD_READERSTATE *reader_state = &(database->states[readerIndex]);
+  SCardConnection *connection = &(database->connections[readerIndex]);
+
+  OSSpecific_probe3(
+    status__change,
+    readerIndex,
+    reader_state->dwCurrentState,
+    reader_state->dwEventState);
+
+  /* A lingering connection must not keep the reader busy */
+  /* once the card is gone, or when it was reset or used */
+  /* by another application (changes of the "in use" flags */
+  /* alone might come from our own connection) */
+
+  if ((0 != connection->lingerDeadline) &&
+    (0 != ((reader_state->dwCurrentState ^ reader_state->dwEventState) &
+      ~(SCARD_STATE_CHANGED | SCARD_STATE_INUSE | SCARD_STATE_EXCLUSIVE))))
+  {
+    SCardConnection_close(connection);
+    database->lingerReleases += 1;
+  }
 
-    test_bool = JsonObject_appendKeyValue(
-      jsonResponse,
-      "r",
-      &(json_value));
+  /* Other applications sharing the card might have selected */
+  /* something else: any sign of them is enough to forget */
 
-    if (!test_bool) { return; }
+  if (SCARD_SHARE_EXCLUSIVE != connection->shareMode)
+  {
+    SCardConnection_forgetSelections(connection);
+  }
 
-    /* Add key "d" (card Answer To Reset) on CARD INSERT event */
+  /* Remember the ATR whenever a card is present: also for a card */
+  /* that was already inserted when the reader was listed (no */
+  /* "Card Insertion" then), and after a reset changed the ATR. */
+  /* It is kept after the removal, to filter the "Card Removal". */
 
-    if (WEBCARD_READER_EVENT__CARD_INSERTION == readerEvent)
-    {
-      test_bool = WebCard_pushReaderAtrToJsonObject(
-        readerState,
-        jsonResponse,
-        "d");
+  if (reader_state->dwEventState & SCARD_STATE_PRESENT)
+  {
+    connection->cardAtrLength =
+      (reader_state->cbAtr < WEBCARD_ATR_MAX_SIZE) ?
+        reader_state->cbAtr :
+        WEBCARD_ATR_MAX_SIZE;
+
+    memcpy(
+      connection->cardAtr,
+      reader_state->rgbAtr,
+      connection->cardAtrLength);
+  }
 
-      if (!test_bool) { return; }
-    }
+  if (connection->ignoreCounter > 0)
+  {
+    connection->ignoreCounter -= 1;
   }
   else
   {
-    if (NULL != jsonEventDetails)
-    {
-      /* Add key "n" (optional reader names) */
-
-      json_value.type = JSON_VALUE_TYPE__ARRAY;
-      json_value.value = (void *) jsonEventDetails;
+    int reader_event = WEBCARD_READER_EVENT__NONE;
 
-      test_bool = JsonObject_appendKeyValue(
-        jsonResponse,
-        "n",
-        &(json_value));
-
-      if (!test_bool) { return; }
+    if ((reader_state->dwCurrentState & SCARD_STATE_EMPTY) &&
+      (reader_state->dwEventState & SCARD_STATE_PRESENT))
+    {
+      reader_event = WEBCARD_READER_EVENT__CARD_INSERTION;
     }
-  }
-
-  /* Stringify JSON response and send it through the STDOUT stream */
+    else if ((reader_state->dwCurrentState & SCARD_STATE_PRESENT) &&
+      (reader_state->dwEventState & SCARD_STATE_EMPTY))
+    {
+      reader_event = WEBCARD_READER_EVENT__CARD_REMOVAL;
 
-  UTF8String_init(&(utf8_string));
+      /* The connection is useless without the card: it is closed */
+      /* (and its handle disconnected), so that the next waiting */
+      /* client is granted the reader right away */
+      SCardConnection_close(connection);
+    }
 
-  test_bool = JsonObject_toString(jsonResponse, &(utf8_string));
+    if (WEBCARD_READER_EVENT__NONE != reader_event)
+    {
+      /* Physical transitions are traced (before debouncing) */
+      WebCard_traceCardEvent(database, readerIndex, reader_event);
+
+      /* A prefetch script of the previous card is cut short: its */
+      /* "Card Insertion" event goes first, and its responses are */
+      /* cached before the entries of this reader are dropped */
+      WebCard_finishPrefetch(database, readerIndex);
+
+      /* A new card session begins (regardless of debouncing) */
+      SCardConnection_forgetSelections(connection);
+      connection->cardSerialKnown = FALSE;
+      connection->cardSerialLength = 0;
+
+      SCardApduCache_invalidateReader(
+        &(database->apduCache),
+        readerIndex);
+    }
 
-  if (test_bool)
-  {
-    UTF8String_writeToStandardOutput(&(utf8_string));
+    if (WEBCARD_READER_EVENT__NONE != reader_event)
+    {
+      WebCard_debounceCardEvent(
+        database,
+        readerIndex,
+        reader_event,
+        now);
+    }
   }
 
-  UTF8String_destroy(&(utf8_string));
+  reader_state->dwCurrentState = (reader_state->dwEventState & (~SCARD_STATE_CHANGED));
 }
 
 /**************************************************************/
 
-VOID
+BOOL
 WebCard_handleStatusChange(
   _Inout_ SCardReaderDB *database,
   _In_ const SCARDCONTEXT context)
 {
-  JsonObject json_response;
-
-  PCSC_LONG pcscResult = SCardGetStatusChange(
-    context,
-    0,
-    database->states,
-    database->count);
-
-  if (SCARD_S_SUCCESS != pcscResult) { return; }
+  uint64_t now = OSSpecific_getMonotonicTime();
+  size_t first = 0;
+  size_t group_size;
+  PCSC_LONG pcscResult;
 
-  /* Enumerate Smart Card Readers */
+  /* Readers are watched in groups: PCSC Lite refuses more than */
+  /* 16 readers per call (and racks of readers have many more) */
 
-  for (size_t i = 0; i < database->count; i++)
+  do
   {
-    SCARD_READERSTATE *readerState = &(database->states[i]);
-    SCardConnection *connection = &(database->connections[i]);
+    group_size = database->count - first;
 
-    if (readerState->dwEventState & SCARD_STATE_CHANGED)
+    if (group_size > WEBCARD_STATUS_GROUP_SIZE)
     {
-      if (connection->ignoreCounter > 0)
-      {
-        connection->ignoreCounter -= 1;
-      }
-      else
-      {
-        int reader_event = WEBCARD_READER_EVENT__NONE;
+      group_size = WEBCARD_STATUS_GROUP_SIZE;
+    }
 
-        if ((readerState->dwCurrentState & SCARD_STATE_EMPTY) &&
-          (readerState->dwEventState & SCARD_STATE_PRESENT))
-        {
-          reader_event = WEBCARD_READER_EVENT__CARD_INSERTION;
-        }
-        else if ((readerState->dwCurrentState & SCARD_STATE_PRESENT) &&
-          (readerState->dwEventState & SCARD_STATE_EMPTY))
-        {
-          reader_event = WEBCARD_READER_EVENT__CARD_REMOVAL;
+    pcscResult = SCardBackend_current->getStatusChange(
+      context,
+      0,
+      &(database->states[first]),
+      (PCSC_DWORD) group_size);
 
-          /* Invalidate connection */
-          connection->handle = 0;
-        }
+    OSSpecific_probe2(
+      status__poll,
+      pcscResult,
+      group_size);
+
+    if (SCardRecovery_isContextLost(pcscResult))
+    {
+      return FALSE;
+    }
 
-        if (WEBCARD_READER_EVENT__NONE != reader_event)
+    if (SCARD_S_SUCCESS == pcscResult)
+    {
+      for (size_t i = first; i < (first + group_size); i++)
+      {
+        if (database->states[i].dwEventState & SCARD_STATE_CHANGED)
         {
-          WebCard_sendReaderEvent(
-            readerState,
-            i,
-            reader_event,
-            &(json_response),
-            NULL);
-
-          JsonObject_destroy(&(json_response));
+          WebCard_handleReaderChange(database, i, now);
         }
       }
+    }
+
+    first += group_size;
+  }
+  while (first < database->count);
 
-      readerState->dwCurrentState = (readerState->dwEventState & (~SCARD_STATE_CHANGED));
+  /* Close the connections that lingered long enough */
+
+  for (size_t i = 0; i < database->count; i++)
+  {
+    if ((0 != database->connections[i].lingerDeadline) &&
+      (now >= database->connections[i].lingerDeadline))
+    {
+      SCardConnection_close(&(database->connections[i]));
     }
   }
+
+  /* Send Card Events that are no longer flapping */
+
+  WebCard_flushSettledCardEvents(database, now);
+
+  return TRUE;
 }
 
 /**************************************************************/
@@ -39,6 +39,33 @@
 
 #define MAX_APDU_SIZE  0x7FFF
 
+/** Largest "Answer To Reset" kept by WebCard (Windows limit). */
+#define WEBCARD_ATR_MAX_SIZE  36
+
+/** Largest "SELECT" command remembered as the APDU cache context. */
+#define WEBCARD_SELECT_CONTEXT_SIZE  64
+
+/** Largest "SELECT" response (FCI) kept for repeated "SELECT" commands. */
+#define WEBCARD_SELECT_RESPONSE_SIZE  258
+
+/** Logical channels with a tracked selection (basic channel included). */
+#define WEBCARD_LOGICAL_CHANNELS  4
+
+/** Largest card serial number (card fingerprint for the persistent cache). */
+#define WEBCARD_CARD_SERIAL_MAX_SIZE  32
+
+/** Largest command APDU that reads the card serial number. */
+#define WEBCARD_SERIAL_APDU_MAX_SIZE  64
+
+/** Maximal number of command APDUs in one prefetch script. */
+#define WEBCARD_PREFETCH_MAX_APDUS  16
+
+/** Maximal number of command APDUs replayed after a card reset. */
+#define WEBCARD_RESTORE_MAX_APDUS  8
+
+/** Most readers in one `SCardGetStatusChange` call (PCSC Lite limit). */
+#define WEBCARD_STATUS_GROUP_SIZE  16
+
 /**
  * Possible "Reader Event" values.
  */
@@ -48,6 +75,7 @@
   #define WEBCARD_READER_EVENT__CARD_REMOVAL    2
   #define WEBCARD_READER_EVENT__READERS_MORE    3
   #define WEBCARD_READER_EVENT__READERS_LESS    4
+  #define WEBCARD_READER_EVENT__JOB_DONE        5
 
 /**
  * Possible "Webcard Command" values.
@@ -59,6 +87,34 @@
   #define WEBCARD_COMMAND__DISCONNECT     3
   #define WEBCARD_COMMAND__TRANSCEIVE     4
   #define WEBCARD_COMMAND__GET_VERSION   10
+  #define WEBCARD_COMMAND__DEBOUNCE      11
+  #define WEBCARD_COMMAND__SUBSCRIBE     12
+  #define WEBCARD_COMMAND__UNSUBSCRIBE   13
+  #define WEBCARD_COMMAND__APDU_CACHE    14
+  #define WEBCARD_COMMAND__CARD_CACHE    15
+  #define WEBCARD_COMMAND__PREFETCH      16
+  #define WEBCARD_COMMAND__STATS         17
+  #define WEBCARD_COMMAND__TRACE         18
+  #define WEBCARD_COMMAND__LOG           19
+  #define WEBCARD_COMMAND__CANCEL        20
+  #define WEBCARD_COMMAND__LINGER        21
+  #define WEBCARD_COMMAND__FAN_OUT       22
+  #define WEBCARD_COMMAND__JOBS          23
+
+/**
+ * Special value for `SCardConnection::debounceWindow`:
+ * use the Database-wide window (`SCardReaderDB::debounceWindow`).
+ */
+
+  #define WEBCARD_DEBOUNCE__INHERIT  UINT32_MAX
+
+/**
+ * Longest accepted `SCardReaderDB::lingerTime` (in milliseconds):
+ * a lingering connection keeps other applications from connecting
+ * exclusively to the card.
+ */
+
+  #define WEBCARD_LINGER__MAX_TIME  60000
 
 /**
  * Possible return values for `SCardReaderDB_fetch` function.
@@ -70,116 +126,3084 @@
   #define WEBCARD_FETCH_READERS__MORE_READERS     3
   #define WEBCARD_FETCH_READERS__LESS_READERS     4
 
+/**
+ * Possible return values for `WebCard_finishStartup` function.
+ */
+
+  #define WEBCARD_STARTUP__PENDING  0
+  #define WEBCARD_STARTUP__READY    1
+  #define WEBCARD_STARTUP__FAILED   2
+
 
 /**************************************************************/
-/* SMART CARD CONNECTION                                      */
+/* PC/SC BACKEND                                              */
 /**************************************************************/
 
 /**
- * `SCardConnection` type definition.
+ * `SCardBackend` type definition.
  */
-typedef struct SCardConnection SCardConnection;
+typedef struct SCardBackend SCardBackend;
 
 /**
- * Connection parameters for disgnated Smart Card reader.
+ * Table of the PC/SC functions used by WebCard. The real backend forwards
+ * every call to "WinSCard" / "PCSC Lite", the simulated backend answers
+ * from an in-process reader farm (no hardware needed).
+ * All functions return PC/SC result codes (`SCARD_S_SUCCESS` on success).
  */
-struct SCardConnection
+struct SCardBackend
 {
-  /** A handle that identifies the connection to the Smart Card in the designated reader. */
-  SCARDHANDLE handle;
+  /** Short name of the backend (for diagnostics) */
+  LPCSTR name;
 
-  /** A flag that indicates the established active protocol. */
-  PCSC_DWORD activeProtocol;
+  /** Same as `SCardEstablishContext(SCARD_SCOPE_USER, ...)` */
+  PCSC_LONG (*establishContext)(
+    _Out_ LPSCARDCONTEXT context);
 
-  /** How many incoming Reader State Changes should be ignored. */
-  DWORD ignoreCounter;
+  /** Same as `SCardReleaseContext()` */
+  PCSC_LONG (*releaseContext)(
+    _In_ SCARDCONTEXT context);
+
+  /** Same as `SCardListReaders()` without reader groups */
+  PCSC_LONG (*listReaders)(
+    _In_ SCARDCONTEXT context,
+    _Out_opt_ LPTSTR readerNames,
+    _Inout_ PCSC_DWORD *readerNamesLength);
+
+  /** Same as `SCardGetStatusChange()` */
+  PCSC_LONG (*getStatusChange)(
+    _In_ SCARDCONTEXT context,
+    _In_ PCSC_DWORD timeout,
+    _Inout_ SCARD_READERSTATE *readerStates,
+    _In_ PCSC_DWORD readerCount);
+
+  /** Same as `SCardConnect()` */
+  PCSC_LONG (*connect)(
+    _In_ SCARDCONTEXT context,
+    _In_ LPCTSTR readerName,
+    _In_ PCSC_DWORD shareMode,
+    _In_ PCSC_DWORD preferredProtocols,
+    _Out_ LPSCARDHANDLE card,
+    _Out_ PCSC_DWORD *activeProtocol);
+
+  /** Same as `SCardDisconnect()` */
+  PCSC_LONG (*disconnect)(
+    _In_ SCARDHANDLE card,
+    _In_ PCSC_DWORD disposition);
+
+  /** Same as `SCardReconnect()` */
+  PCSC_LONG (*reconnect)(
+    _In_ SCARDHANDLE card,
+    _In_ PCSC_DWORD shareMode,
+    _In_ PCSC_DWORD preferredProtocols,
+    _In_ PCSC_DWORD initialization,
+    _Out_ PCSC_DWORD *activeProtocol);
+
+  /** Same as `SCardTransmit()`, with PCI selected by the active protocol */
+  PCSC_LONG (*transmit)(
+    _In_ SCARDHANDLE card,
+    _In_ PCSC_DWORD activeProtocol,
+    _In_ const BYTE *input,
+    _In_ PCSC_DWORD inputLength,
+    _Out_ BYTE *output,
+    _Inout_ PCSC_DWORD *outputLength);
+
+  /**
+   * Same as `SCardCancel()`: called from another thread to interrupt
+   * blocking calls of the context (where the PC/SC service supports it).
+   */
+  PCSC_LONG (*cancel)(
+    _In_ SCARDCONTEXT context);
+
+  /**
+   * Cheap check (without any context) if the PC/SC service is running,
+   * so that a lost context is re-established as soon as the service is
+   * back. `TRUE` when it can't be told.
+   */
+  BOOL (*isServiceAvailable)(void);
 };
 
 /**
- * @brief `SCardConnection` constructor.
+ * Socket of "pcscd" (PCSC Lite), unless overridden
+ * by the "PCSCLITE_CSOCK_NAME" environment variable.
+ */
+#define WEBCARD_PCSCLITE_SOCKET  "/run/pcscd/pcscd.comm"
+
+/**
+ * The backend that WebCard is talking to
+ * (by default `SCardBackend_pcsc`).
+ */
+extern const SCardBackend *SCardBackend_current;
+
+/**
+ * The real PC/SC backend.
+ */
+extern const SCardBackend SCardBackend_pcsc;
+
+/**
+ * The simulated backend (see "SIMULATED READER FARM").
+ */
+extern const SCardBackend SCardBackend_simulated;
+
+/**
+ * @brief Selects the PC/SC backend for this process.
  *
- * @param[out] connection Reference to an UNINITIALIZED
- * `SCardConnection` object.
+ * When the "WEBCARD_SIMULATOR" environment variable names a reader farm
+ * description (JSON file), the simulated backend is loaded and selected.
+ * Otherwise the real PC/SC backend is used.
+ * @return `FALSE` if the reader farm description is invalid, otherwise `TRUE`.
+ */
+extern BOOL
+SCardBackend_select(void);
+
+/**
+ * @brief Releases the selected backend (and its reader farm, if any)
+ * and goes back to the real PC/SC backend.
  */
 extern VOID
-SCardConnection_init(
-  _Out_ SCardConnection *connection);
+SCardBackend_release(void);
+
+
+/**************************************************************/
+/* SIMULATED READER FARM                                      */
+/**************************************************************/
+
+/**
+ * Environment variable with the path of a reader farm description.
+ */
+#define WEBCARD_SIMULATOR_VARIABLE  "WEBCARD_SIMULATOR"
+
+/**
+ * Behaviour of a simulated card, beyond its table of fixed responses.
+ */
+
+  /** Fixed responses only ("6D00" for anything else) */
+  #define WEBCARD_SIM_MODEL__STATIC   0
+
+  /** ISO 7816-4 transparent files: SELECT, READ BINARY, UPDATE BINARY */
+  #define WEBCARD_SIM_MODEL__ISO7816  1
+
+  /** PC/SC storage card (e.g. MIFARE Ultralight): "FF B0", "FF D6" blocks */
+  #define WEBCARD_SIM_MODEL__MEMORY   2
+
+/**
+ * `SCardSimResponse` type definition.
+ */
+typedef struct SCardSimResponse SCardSimResponse;
+
+/**
+ * Fixed response of a simulated card to one exact command APDU.
+ */
+struct SCardSimResponse
+{
+  /** Length of the command APDU */
+  size_t commandLength;
+
+  /** Command APDU (dynamic allocation) */
+  LPBYTE command;
+
+  /** Length of the response APDU */
+  size_t responseLength;
+
+  /** Response APDU, including the status word (dynamic allocation) */
+  LPBYTE response;
+
+  /** Processing time in microseconds (replaces the card latency) */
+  uint32_t latency;
+};
+
+/**
+ * `SCardSimFile` type definition.
+ */
+typedef struct SCardSimFile SCardSimFile;
+
+/**
+ * Transparent elementary file (or application) of an ISO 7816-4 card.
+ */
+struct SCardSimFile
+{
+  /** Length of the identifier: 2 for File ID, up to 16 for AID */
+  size_t idLength;
+
+  /** File ID ("SELECT" by P1 = 00) or AID ("SELECT" by P1 = 04) */
+  BYTE id[16];
+
+  /** Length of the file contents */
+  size_t length;
+
+  /** File contents (dynamic allocation) */
+  LPBYTE data;
+};
+
+/**
+ * `SCardSimCard` type definition.
+ */
+typedef struct SCardSimCard SCardSimCard;
+
+/**
+ * Simulated card: ATR, timing and behaviour.
+ */
+struct SCardSimCard
+{
+  /** Name used by reader timelines */
+  UTF8String name;
+
+  /** One of `WEBCARD_SIM_MODEL__*` values */
+  int model;
+
+  /** Answer To Reset */
+  BYTE atr[WEBCARD_ATR_MAX_SIZE];
+
+  /** Length of the ATR */
+  size_t atrLength;
+
+  /** `SCARD_PROTOCOL_T0` or `SCARD_PROTOCOL_T1` */
+  PCSC_DWORD protocol;
+
+  /** Processing time of every command, in microseconds */
+  uint32_t latency;
+
+  /** Number of fixed responses */
+  size_t responseCount;
+
+  /** Fixed responses (checked before the card model) */
+  SCardSimResponse *responses;
+
+  /** Number of files (ISO 7816-4 model) */
+  size_t fileCount;
+
+  /** Files (ISO 7816-4 model) */
+  SCardSimFile *files;
+
+  /** Block size (memory model) */
+  size_t blockSize;
+
+  /** Memory contents (memory model) */
+  SCardSimFile memory;
+
+  /** Length of the unique identifier */
+  size_t uidLength;
+
+  /** Unique identifier, returned by "FF CA 00 00" */
+  BYTE uid[WEBCARD_CARD_SERIAL_MAX_SIZE];
+};
+
+/**
+ * `SCardSimEvent` type definition.
+ */
+typedef struct SCardSimEvent SCardSimEvent;
+
+/**
+ * One step of a reader timeline.
+ */
+struct SCardSimEvent
+{
+  /** Milliseconds since the simulation start (or since the period start) */
+  uint64_t at;
+
+  /** Index of the inserted card, `SIZE_MAX` when the card is removed */
+  size_t cardIndex;
+};
+
+/**
+ * `SCardSimReader` type definition.
+ */
+typedef struct SCardSimReader SCardSimReader;
+
+/**
+ * Simulated reader with a scripted timeline of card insertions and removals.
+ */
+struct SCardSimReader
+{
+  /** Reader name (dynamic allocation) */
+  LPTSTR name;
+
+  /** Number of timeline steps */
+  size_t eventCount;
+
+  /** Timeline steps, sorted by time */
+  SCardSimEvent *events;
+
+  /** Card inserted before the first timeline step, `SIZE_MAX` if none */
+  size_t initialCard;
+
+  /** Delay of the whole timeline in milliseconds (staggered readers) */
+  uint64_t offset;
+
+  /** Timeline period in milliseconds (`0` = the timeline is played once) */
+  uint64_t period;
+
+  /** Index of the card in the reader, `SIZE_MAX` for an empty reader */
+  size_t cardIndex;
+
+  /** Number of insertions and removals so far */
+  uint32_t eventCounter;
+
+  /** Index of the selected file (ISO 7816-4 model), `SIZE_MAX` if none */
+  size_t selectedFile;
+
+  /** Card reset by another application this often (ms, `0` = never) */
+  uint64_t resetPeriod;
+
+  /** Number of such resets so far */
+  uint64_t resetCounter;
+
+  /** Value of `resetCounter` when the card was last (re)connected */
+  uint64_t resetSeen;
+};
+
+/** Most Smart Card Contexts established at the same time (simulated backend). */
+#define WEBCARD_SIM_MAX_CONTEXTS  128
+
+/** Most simulated readers (card handles carry the reader index in 12 bits). */
+#define WEBCARD_SIM_MAX_READERS  0xFFF
+
+/**
+ * `SCardSimulator` type definition.
+ */
+typedef struct SCardSimulator SCardSimulator;
+
+/**
+ * In-process reader farm.
+ */
+struct SCardSimulator
+{
+  /** Start of the simulation (monotonic time in milliseconds) */
+  uint64_t startTime;
+
+  /** Time taken by `SCardEstablishContext` (microseconds) */
+  uint64_t startupLatency;
+
+  /** First simulated service outage (milliseconds from the start) */
+  uint64_t outageStart;
+
+  /** Length of every outage (milliseconds, 0 = no outages) */
+  uint64_t outageLength;
+
+  /** Outages are repeated this often (milliseconds, 0 = only once) */
+  uint64_t outagePeriod;
+
+  /** Number of card definitions */
+  size_t cardCount;
+
+  /** Card definitions */
+  SCardSimCard *cards;
+
+  /** Number of readers */
+  size_t readerCount;
+
+  /** Readers */
+  SCardSimReader *readers;
+
+  /** Are `contextLocks` initialized (the farm was loaded)? */
+  BOOL locksReady;
+
+  /**
+   * One lock per context: like PCSC Lite, the service runs the calls
+   * made through one context (and its card handles) one at a time.
+   */
+  os_specific_mutex_t contextLocks[WEBCARD_SIM_MAX_CONTEXTS];
+
+  /** Is the context of the same index established? */
+  BOOL contextUsed[WEBCARD_SIM_MAX_CONTEXTS];
+};
+
+/**
+ * @brief Loads a reader farm description into the simulated backend.
+ *
+ * @param[in] fileName Path to a JSON file with "cards" and "readers" arrays
+ * (see "README.md" for the format).
+ * @return `TRUE` on success, `FALSE` on file-system error OR on invalid
+ * description OR on memory allocation error.
+ */
+extern BOOL
+SCardSimulator_load(
+  _In_ LPCSTR fileName);
+
+/**
+ * @brief Releases the reader farm of the simulated backend.
+ */
+extern VOID
+SCardSimulator_destroy(void);
+
+
+/**************************************************************/
+/* CONTEXT RECOVERY                                           */
+/**************************************************************/
+
+/**
+ * Possible values of `SCardRecovery::state`.
+ */
+
+  #define WEBCARD_RECOVERY__READY  0
+  #define WEBCARD_RECOVERY__LOST   1
+
+/** Wait after the first failed attempt to re-establish the context (ms). */
+#define WEBCARD_RECOVERY_FIRST_DELAY  100
+
+/** Longest wait between two attempts (ms). */
+#define WEBCARD_RECOVERY_MAX_DELAY  5000
+
+/** How often the PC/SC service is probed while the context is lost (ms). */
+#define WEBCARD_RECOVERY_PROBE_INTERVAL  50
+
+/**
+ * `SCardRecovery` type definition.
+ */
+typedef struct SCardRecovery SCardRecovery;
+
+/**
+ * Supervises the Smart Card Context: after the PC/SC service has stopped
+ * (restarted, or the last reader was unplugged on Windows), the context
+ * is re-established immediately once, then with exponential backoff and
+ * jitter, or as soon as the service is seen starting again.
+ */
+struct SCardRecovery
+{
+  /** `WEBCARD_RECOVERY__READY` or `WEBCARD_RECOVERY__LOST`. */
+  int state;
+
+  /** When the context was lost (monotonic time in milliseconds). */
+  uint64_t lostSince;
+
+  /** When the next attempt is due (monotonic time in milliseconds). */
+  uint64_t nextAttempt;
+
+  /** When the service was last probed (monotonic time in milliseconds). */
+  uint64_t lastProbe;
+
+  /** Failed attempts since the context was lost. */
+  uint32_t attempts;
+
+  /** Result of the last `SCardBackend::isServiceAvailable` probe. */
+  BOOL serviceAvailable;
+
+  /** State of the jitter generator (xorshift). */
+  uint32_t jitter;
+
+  /** Times the context was lost. */
+  uint64_t outages;
+
+  /** Failed attempts to re-establish the context. */
+  uint64_t failedAttempts;
+
+  /** Attempts made early, because the service was seen starting. */
+  uint64_t fastAttempts;
+
+  /** Duration of the last recovery (ms). */
+  uint64_t lastRecoveryTime;
+
+  /** Duration of the longest recovery (ms). */
+  uint64_t longestRecoveryTime;
+};
+
+/**
+ * @brief `SCardRecovery` constructor (context considered established).
+ *
+ * @param[out] recovery Reference to an UNINITIALIZED `SCardRecovery` object.
+ */
+extern VOID
+SCardRecovery_init(
+  _Out_ SCardRecovery *recovery);
+
+/**
+ * @brief Checks if a PC/SC result means that the Smart Card Context
+ * is no longer usable (service stopped, restarted or unreachable).
+ *
+ * @param[in] pcscResult Result of a `WinSCard` function using the context.
+ * @return `TRUE` if the context should be re-established.
+ */
+extern BOOL
+SCardRecovery_isContextLost(
+  _In_ const PCSC_LONG pcscResult);
+
+/**
+ * @brief Records that the context was lost (and released by the caller).
+ * The first attempt to re-establish it is due at once.
+ *
+ * @param[in,out] recovery Reference to a VALID `SCardRecovery` object.
+ * @param[in] now Current monotonic time (in milliseconds).
+ */
+extern VOID
+SCardRecovery_lose(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now);
+
+/**
+ * @brief Checks if the context should be re-established now:
+ * the backoff has passed, or the service has just been seen starting.
+ *
+ * @param[in,out] recovery Reference to a VALID `SCardRecovery` object.
+ * @param[in] now Current monotonic time (in milliseconds).
+ * @return `TRUE` if an attempt is due.
+ */
+extern BOOL
+SCardRecovery_isAttemptDue(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now);
+
+/**
+ * @brief Records a failed attempt and schedules the next one
+ * (the wait doubles up to `WEBCARD_RECOVERY_MAX_DELAY`,
+ * a random half of it is skipped).
+ *
+ * @param[in,out] recovery Reference to a VALID `SCardRecovery` object.
+ * @param[in] now Current monotonic time (in milliseconds).
+ */
+extern VOID
+SCardRecovery_fail(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now);
+
+/**
+ * @brief Records that the context has been re-established.
+ *
+ * @param[in,out] recovery Reference to a VALID `SCardRecovery` object.
+ * @param[in] now Current monotonic time (in milliseconds).
+ */
+extern VOID
+SCardRecovery_succeed(
+  _Inout_ SCardRecovery *recovery,
+  _In_ const uint64_t now);
+
+/**
+ * @brief Clears the counters (not the state).
+ *
+ * @param[in,out] recovery Reference to a VALID `SCardRecovery` object.
+ */
+extern VOID
+SCardRecovery_resetCounters(
+  _Inout_ SCardRecovery *recovery);
+
+
+/**************************************************************/
+/* LATENCY STATISTICS                                         */
+/**************************************************************/
+
+/**
+ * Log-linear histogram layout: every power of two is split into
+ * `WEBCARD_STATS_SUB_BUCKETS` linear buckets (about 6% resolution).
+ * Durations (in nanoseconds) up to 2^36 ns (about 68 seconds)
+ * are tracked, longer ones are counted in the last bucket.
+ */
+
+  #define WEBCARD_STATS_SUB_BUCKETS_LOG2  4
+  #define WEBCARD_STATS_SUB_BUCKETS       (1 << WEBCARD_STATS_SUB_BUCKETS_LOG2)
+  #define WEBCARD_STATS_MAX_EXPONENT      36
+
+  #define WEBCARD_STATS_BUCKETS  (WEBCARD_STATS_SUB_BUCKETS * \
+    (1 + WEBCARD_STATS_MAX_EXPONENT - WEBCARD_STATS_SUB_BUCKETS_LOG2))
+
+/**
+ * Timed stages of handling one request.
+ */
+
+  /** Reading the length-prefixed message from Standard Input. */
+  #define WEBCARD_STAGE__READ       0
+
+  /** Parsing the JSON Request. */
+  #define WEBCARD_STAGE__PARSE      1
+
+  /** Running the command (including every `SCardTransmit` call). */
+  #define WEBCARD_STAGE__EXECUTE    2
+
+  /** Stringifying the JSON Response. */
+  #define WEBCARD_STAGE__SERIALIZE  3
+
+  /** Writing the JSON Response to Standard Output. */
+  #define WEBCARD_STAGE__WRITE      4
+
+  /** From the first byte read to the last byte written. */
+  #define WEBCARD_STAGE__TOTAL      5
+
+  #define WEBCARD_STAGE_COUNT       6
+
+/** Commands with larger numbers are counted as `WEBCARD_COMMAND__NONE`. */
+#define WEBCARD_STATS_COMMANDS  32
+
+/**
+ * `SCardLatencyHistogram` type definition.
+ */
+typedef struct SCardLatencyHistogram SCardLatencyHistogram;
+
+/**
+ * Distribution of durations, with constant-time recording.
+ */
+struct SCardLatencyHistogram
+{
+  /** Number of recorded durations. */
+  uint64_t count;
+
+  /** Sum of recorded durations, in nanoseconds. */
+  uint64_t sum;
+
+  /** Shortest recorded duration, in nanoseconds. */
+  uint64_t min;
+
+  /** Longest recorded duration, in nanoseconds. */
+  uint64_t max;
+
+  /** Number of durations in every log-linear bucket. */
+  uint32_t buckets[WEBCARD_STATS_BUCKETS];
+};
+
+/**
+ * @brief `SCardLatencyHistogram` constructor.
+ *
+ * @param[out] histogram Reference to an UNINITIALIZED
+ * `SCardLatencyHistogram` object.
+ */
+extern VOID
+SCardLatencyHistogram_init(
+  _Out_ SCardLatencyHistogram *histogram);
+
+/**
+ * @brief Adds one duration to the histogram.
+ *
+ * @param[in,out] histogram Reference to a VALID `SCardLatencyHistogram` object.
+ * @param[in] duration Measured duration, in nanoseconds.
+ */
+extern VOID
+SCardLatencyHistogram_record(
+  _Inout_ SCardLatencyHistogram *histogram,
+  _In_ const uint64_t duration);
+
+/**
+ * @brief Estimates a percentile of the recorded durations.
+ *
+ * @param[in] histogram Reference to a VALID and CONSTANT
+ * `SCardLatencyHistogram` object.
+ * @param[in] fraction Requested percentile, from `0.0` to `1.0`.
+ * @return Duration in nanoseconds (middle of the matching bucket),
+ * `0` if the histogram is empty.
+ */
+extern uint64_t
+SCardLatencyHistogram_percentile(
+  _In_ const SCardLatencyHistogram *histogram,
+  _In_ const double fraction);
+
+/**
+ * @brief Summarizes the histogram as a JSON Object with keys:
+ * "n" (count), "min", "mean", "p50", "p90", "p99", "p999", "max"
+ * (durations in nanoseconds).
+ *
+ * @param[in] histogram Reference to a VALID and CONSTANT
+ * `SCardLatencyHistogram` object.
+ * @param[out] jsonObject Reference to an UNINITIALIZED `JsonObject` object.
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ *
+ * @note After this call, `jsonObject` will hold a VALID (at least
+ * initialized) `JsonObject` object, which must be destroyed by the caller.
+ */
+extern BOOL
+SCardLatencyHistogram_toJsonObject(
+  _In_ const SCardLatencyHistogram *histogram,
+  _Out_ JsonObject *jsonObject);
+
+/**
+ * `SCardCommandStats` type definition.
+ */
+typedef struct SCardCommandStats SCardCommandStats;
+
+/**
+ * Latency statistics of one WebCard command.
+ */
+struct SCardCommandStats
+{
+  /** Number of responses flagged as "incomplete". */
+  uint64_t failures;
+
+  /** Durations of every `WEBCARD_STAGE__*` stage. */
+  SCardLatencyHistogram stages[WEBCARD_STAGE_COUNT];
+};
+
+/**
+ * `SCardReaderStats` type definition.
+ */
+typedef struct SCardReaderStats SCardReaderStats;
+
+/**
+ * Latency statistics of one Smart Card Reader.
+ */
+struct SCardReaderStats
+{
+  /** Dynamically-allocated copy of the reader name. */
+  LPTSTR readerName;
+
+  /** Durations of physical APDU exchanges (`SCardTransmit` calls). */
+  SCardLatencyHistogram transmit;
+
+  /**
+   * Time (from arrival until the reader was granted) spent by requests
+   * that had to wait for another client to release this reader.
+   */
+  SCardLatencyHistogram wait;
+};
+
+/**
+ * `SCardStats` type definition.
+ */
+typedef struct SCardStats SCardStats;
+
+/**
+ * Latency statistics of the Native App, since the last reset.
+ */
+struct SCardStats
+{
+  /** Monotonic time (in milliseconds) of the last reset. */
+  uint64_t resetTime;
+
+  /** Statistics of every command (allocated on first use). */
+  SCardCommandStats *commands[WEBCARD_STATS_COMMANDS];
+
+  /** Number of elements in `readers`. */
+  size_t readerCount;
+
+  /**
+   * Dynamically-allocated list of reader statistics, keyed by reader name
+   * (so that they survive the re-loading of the Reader list).
+   */
+  SCardReaderStats **readers;
+};
+
+/**
+ * @brief `SCardStats` constructor.
+ *
+ * @param[out] stats Reference to an UNINITIALIZED `SCardStats` object.
+ */
+extern VOID
+SCardStats_init(
+  _Out_ SCardStats *stats);
+
+/**
+ * @brief `SCardStats` destructor.
+ *
+ * @param[in,out] stats Reference to a VALID `SCardStats` object.
+ *
+ * @note After this call, `stats` should not be used (unless re-initialized).
+ */
+extern VOID
+SCardStats_destroy(
+  _Inout_ SCardStats *stats);
+
+/**
+ * @brief Records the stages of one handled request.
+ *
+ * @param[in,out] stats Reference to a VALID `SCardStats` object.
+ * @param[in] command Handled WebCard command.
+ * @param[in] failed Was the response flagged as "incomplete"?
+ * @param[in] timestamps `WEBCARD_STAGE_COUNT` precise times (nanoseconds):
+ * the start of the request, followed by the end of every stage
+ * (except `WEBCARD_STAGE__TOTAL`).
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ */
+extern BOOL
+SCardStats_recordRequest(
+  _Inout_ SCardStats *stats,
+  _In_ size_t command,
+  _In_ const BOOL failed,
+  _In_ const uint64_t *timestamps);
+
+/**
+ * @brief Finds (or creates) the `SCardTransmit` histogram of given reader.
+ *
+ * @param[in,out] stats Reference to a VALID `SCardStats` object.
+ * @param[in] readerName Name of the Smart Card Reader.
+ * @return Reference to the histogram (valid until `SCardStats_destroy`),
+ * `NULL` on memory allocation failure.
+ */
+extern SCardLatencyHistogram *
+SCardStats_findReaderHistogram(
+  _Inout_ SCardStats *stats,
+  _In_ LPCTSTR readerName);
+
+/**
+ * @brief Finds (or creates) the statistics of given reader.
+ *
+ * @param[in,out] stats Reference to a VALID `SCardStats` object.
+ * @param[in] readerName Name of the Smart Card Reader.
+ * @return Reference to the statistics (valid until `SCardStats_destroy`),
+ * `NULL` on memory allocation failure.
+ */
+extern SCardReaderStats *
+SCardStats_findReader(
+  _Inout_ SCardStats *stats,
+  _In_ LPCTSTR readerName);
+
+
+/**************************************************************/
+/* APDU TRACE                                                 */
+/**************************************************************/
+
+/** Name of the trace file (in the per-user cache directory). */
+#define WEBCARD_TRACE_FILE_NAME  "apdu_trace.bin"
+
+/** Identification of the trace file format. */
+#define WEBCARD_TRACE_FILE__MAGIC    "WCtr"
+#define WEBCARD_TRACE_FILE__VERSION  1
+
+/** Space reserved for the file header (the ring of records follows it). */
+#define WEBCARD_TRACE_FILE__HEADER_SIZE  128
+
+/** Smallest accepted trace file. */
+#define WEBCARD_TRACE_FILE__MIN_SIZE  (64 * 1024)
+
+/** Records are aligned to 8 bytes. */
+#define WEBCARD_TRACE_FILE__ALIGN(x)  (((x) + 7) & (~((size_t) 7)))
+
+/**
+ * Possible "Trace Record" types.
+ */
+
+  /** Unused space at the end of the ring (next record is at its beginning). */
+  #define WEBCARD_TRACE_RECORD__PADDING  0
+
+  /** UTF-8 name of a reader (when tracing starts and when readers change). */
+  #define WEBCARD_TRACE_RECORD__READER   1
+
+  /** Stringified JSON Request, `status` is the command number. */
+  #define WEBCARD_TRACE_RECORD__REQUEST  2
+
+  /**
+   * One `SCardTransmit` call: command APDU (`split` bytes) followed by
+   * the response APDU, `status` is the Status Word or the PC/SC error.
+   */
+  #define WEBCARD_TRACE_RECORD__APDU     3
+
+  /** Card Event (`status`), with the ATR of the card. */
+  #define WEBCARD_TRACE_RECORD__EVENT    4
+
+/**
+ * Possible "Trace Record" flags.
+ */
+
+  /** Request answered with "incomplete", or transmission failure. */
+  #define WEBCARD_TRACE_FLAG__FAILED     0x0001
+
+  /** Data did not fit in the record and was cut. */
+  #define WEBCARD_TRACE_FLAG__TRUNCATED  0x0002
+
+/** Reader index of records that are not related to any reader. */
+#define WEBCARD_TRACE_NO_READER  UINT32_MAX
+
+/**
+ * Header of the trace file (host byte order: the file is meant to be
+ * replayed on the same kind of computer on which it was written).
+ */
+typedef struct SCardTraceHeader
+{
+  BYTE magic[4];
+  uint32_t version;
+
+  /** Size of the ring of records (bytes after the file header). */
+  uint32_t ringSize;
+
+  /** Offset (within the ring) of the oldest record. */
+  uint32_t tail;
+
+  /** Offset (within the ring) where the next record will be written. */
+  uint32_t head;
+
+  /** Bytes used by records, from `tail` to `head` (wrapping around). */
+  uint32_t usedBytes;
+
+  /** Number of records ever written. */
+  uint64_t written;
+
+  /** Number of records overwritten by newer ones. */
+  uint64_t dropped;
+
+  /** Wall-clock time when tracing started (seconds since the Epoch). */
+  uint64_t startedAt;
+}
+SCardTraceHeader;
+
+/**
+ * Header of a trace record, followed by `dataLength` bytes of data
+ * (and by padding up to the next multiple of 8 bytes).
+ */
+typedef struct SCardTraceRecord
+{
+  /** Total (aligned) length of the record, including this header. */
+  uint32_t length;
+
+  /** One of `WEBCARD_TRACE_RECORD__*` values. */
+  uint16_t type;
+
+  /** Combination of `WEBCARD_TRACE_FLAG__*` values. */
+  uint16_t flags;
+
+  /** Beginning of the traced operation, in nanoseconds since tracing started. */
+  uint64_t time;
+
+  /** Duration of the traced operation, in nanoseconds. */
+  uint64_t duration;
+
+  /** Reader index, or `WEBCARD_TRACE_NO_READER`. */
+  uint32_t reader;
+
+  /** Type-specific value (command number, Status Word, Reader Event). */
+  uint32_t status;
+
+  /** Number of data bytes. */
+  uint32_t dataLength;
+
+  /** APDU records: length of the command APDU (response follows it). */
+  uint32_t split;
+}
+SCardTraceRecord;
+
+/**
+ * `SCardTrace` type definition.
+ */
+typedef struct SCardTrace SCardTrace;
+
+/**
+ * Memory-mapped, fixed-size ring of binary trace records: requests,
+ * physical APDU exchanges and card events, with nanosecond timestamps.
+ * The oldest records are overwritten when the ring is full.
+ */
+struct SCardTrace
+{
+  /** Mapped file (`file.data` is `NULL` when tracing is off). */
+  OSSpecificMappedFile file;
+
+  /** Precise time (in nanoseconds) when tracing started. */
+  uint64_t startTime;
+};
+
+/**
+ * @brief `SCardTrace` constructor (tracing is off).
+ *
+ * @param[out] trace Reference to an UNINITIALIZED `SCardTrace` object.
+ */
+extern VOID
+SCardTrace_init(
+  _Out_ SCardTrace *trace);
+
+/**
+ * @brief `SCardTrace` destructor (stops tracing, keeping the file).
+ *
+ * @param[in,out] trace Reference to a VALID `SCardTrace` object.
+ *
+ * @note After this call, `trace` should not be used (unless re-initialized).
+ */
+extern VOID
+SCardTrace_destroy(
+  _Inout_ SCardTrace *trace);
+
+/**
+ * @brief Is tracing on (and the file mapped)?
+ *
+ * @param[in] trace Reference to a VALID and CONSTANT `SCardTrace` object.
+ * @return `TRUE` if the trace file is open.
+ */
+extern BOOL
+SCardTrace_isOpen(
+  _In_ const SCardTrace *trace);
+
+/**
+ * @brief Starts a new trace (discarding the previous one) or stops tracing.
+ *
+ * @param[in,out] trace Reference to a VALID `SCardTrace` object.
+ * @param[in] fileSize Size of the trace file, in bytes (`0` stops tracing
+ * and keeps the file for the replay tool).
+ * @return `TRUE` on success, `FALSE` on invalid size or on any
+ * file-system error (tracing is then off).
+ */
+extern BOOL
+SCardTrace_configure(
+  _Inout_ SCardTrace *trace,
+  _In_ const size_t fileSize);
+
+/**
+ * @brief Appends one record to the ring (overwriting the oldest records
+ * if needed). Does nothing when tracing is off.
+ *
+ * Data is given in two parts, which are stored one after another.
+ * @param[in,out] trace Reference to a VALID `SCardTrace` object.
+ * @param[in] type One of `WEBCARD_TRACE_RECORD__*` values.
+ * @param[in] flags Combination of `WEBCARD_TRACE_FLAG__*` values.
+ * @param[in] reader Reader index, or `WEBCARD_TRACE_NO_READER`.
+ * @param[in] status Type-specific value.
+ * @param[in] startTime Precise time when the operation began
+ * (as returned by `OSSpecific_getPreciseTime`).
+ * @param[in] endTime Precise time when the operation ended.
+ * @param[in] first First part of the data (can be `NULL` when empty).
+ * @param[in] firstLength Length of `first`, in bytes (`split` of the record).
+ * @param[in] second Second part of the data (can be `NULL` when empty).
+ * @param[in] secondLength Length of `second`, in bytes.
+ */
+extern VOID
+SCardTrace_record(
+  _Inout_ SCardTrace *trace,
+  _In_ const uint16_t type,
+  _In_ uint16_t flags,
+  _In_ const uint32_t reader,
+  _In_ const uint32_t status,
+  _In_ const uint64_t startTime,
+  _In_ const uint64_t endTime,
+  _In_opt_ const BYTE *first,
+  _In_ size_t firstLength,
+  _In_opt_ const BYTE *second,
+  _In_ size_t secondLength);
+
+/**
+ * @brief Reports how much of the trace file is used.
+ *
+ * @param[in] trace Reference to a VALID and CONSTANT `SCardTrace` object.
+ * @param[out] writtenRef Receives the number of records ever written.
+ * @param[out] droppedRef Receives the number of overwritten records.
+ * @return Bytes used by records (`0` when tracing is off).
+ */
+extern size_t
+SCardTrace_usage(
+  _In_ const SCardTrace *trace,
+  _Out_ uint64_t *writtenRef,
+  _Out_ uint64_t *droppedRef);
+
+
+/**************************************************************/
+/* REQUEST QUEUE                                              */
+/**************************************************************/
+
+/** Initial number of queued requests (the queue grows as needed). */
+#define WEBCARD_QUEUE_INITIAL_CAPACITY  16
+
+/** Pause of the reader thread after an unusable message, in microseconds. */
+#define WEBCARD_QUEUE_IDLE_INTERVAL  1000
+
+/** Reader index of requests that do not use a reader ("r" key). */
+#define WEBCARD_QUEUE_NO_READER  SIZE_MAX
+
+/** Session of the requests read from Standard Input (daemon clients count from 1). */
+#define WEBCARD_SESSION__STANDARD_IO  0
+
+/**
+ * Possible states of a request. A request that could not complete is
+ * answered with "incomplete" and with its state under the `x` key.
+ */
+
+  #define WEBCARD_REQUEST_STATE__PENDING    0
+  #define WEBCARD_REQUEST_STATE__TIMED_OUT  1
+  #define WEBCARD_REQUEST_STATE__CANCELLED  2
+
+/**
+ * Possible results of the Cancel command.
+ */
+
+  /** No pending request with given identifier (already answered?). */
+  #define WEBCARD_CANCEL__NOT_FOUND  0
+
+  /** The request was waiting in the queue, it will not be run. */
+  #define WEBCARD_CANCEL__QUEUED     1
+
+  /** The request was running, its blocking PC/SC call was cancelled. */
+  #define WEBCARD_CANCEL__RUNNING    2
+
+/**
+ * Request read from Standard Input (or from a client of the daemon),
+ * waiting to be handled.
+ */
+typedef struct SCardQueuedRequest
+{
+  /** Where the request came from, and where its response goes. */
+  uint32_t session;
+
+  /** Stringified JSON Request (kept for the APDU trace). */
+  JsonByteStream stream;
+
+  /** Parsed JSON Request. */
+  JsonObject object;
+
+  /** Value of the "i" key (points into `object`, `NULL` if missing). */
+  LPCSTR id;
+
+  /** Value of the "c" key (`WEBCARD_COMMAND__NONE` if missing). */
+  size_t command;
+
+  /** Value of the "r" key (`WEBCARD_QUEUE_NO_READER` if missing). */
+  size_t reader;
+
+  /** Value of the "k" key (points into `object`, empty string if missing). */
+  LPCSTR client;
+
+  /** Value of the "q" key: requests with higher priority are taken first. */
+  int priority;
+
+  /** Precise time (nanoseconds) when the message started arriving. */
+  uint64_t arrivalTime;
+
+  /** Precise time when the message was fully read (parsing started). */
+  uint64_t readTime;
+
+  /** Precise time when the request expires (`0`: no deadline, "t" key). */
+  uint64_t deadline;
+
+  /** One of `WEBCARD_REQUEST_STATE__*` values. */
+  int state;
+
+  /** `TRUE` when the queue has already answered an expired or cancelled request. */
+  BOOL answered;
+
+  /** Precise time when the request was first held back (`0`: never). */
+  uint64_t blockedTime;
+}
+SCardQueuedRequest;
+
+/**
+ * Decides if a queued request can be handled now (`TRUE`),
+ * or if it must stay in the queue (`FALSE`).
+ */
+typedef BOOL (*SCardRequestFilter)(
+  _In_ const SCardQueuedRequest *request,
+  _In_opt_ const void *parameter);
+
+/**
+ * `SCardRequestQueue` type definition.
+ */
+typedef struct SCardRequestQueue SCardRequestQueue;
+
+/**
+ * Requests read ahead from Standard Input by a background thread,
+ * so that deadlines and the Cancel command work while the main thread
+ * is blocked in a PC/SC call. A second (watchdog) thread answers the
+ * expired requests and interrupts the running one with `SCardCancel`.
+ * Every member is protected by `mutex`.
+ */
+struct SCardRequestQueue
+{
+  os_specific_mutex_t mutex;
+
+  /** Wakes the watchdog thread (new request, deadline changed, stopping). */
+  os_specific_condition_t changed;
+
+  /** Ring of queued requests. */
+  SCardQueuedRequest *entries;
+  size_t capacity;
+  size_t first;
+  size_t count;
+
+  /** The main thread is handling a request. */
+  BOOL busy;
+
+  /** Identifier, deadline and state of the request being handled. */
+  uint32_t activeSession;
+  LPCSTR activeId;
+  uint64_t activeDeadline;
+  int activeState;
+  BOOL activeAnswered;
+
+  /** Context of the blocking calls to cancel. */
+  SCARDCONTEXT activeContext;
+
+  /**
+   * When the running request was answered early, in nanoseconds
+   * (`0` if it was not). An `SCardTransmit` already sent to the
+   * card cannot be interrupted: the main thread stays blocked.
+   */
+  uint64_t activeAbortTime;
+
+  /** Standard Input was closed (or broken): no more requests. */
+  /** (never set in daemon mode, where clients come and go) */
+  BOOL closed;
+
+  /** Set by the destructor. */
+  BOOL stopping;
+
+  BOOL readerStarted;
+  os_specific_thread_t readerThread;
+
+  BOOL watchdogStarted;
+  os_specific_thread_t watchdogThread;
+};
+
+/**
+ * @brief `SCardRequestQueue` constructor.
+ *
+ * @param[out] queue Reference to an UNINITIALIZED `SCardRequestQueue` object.
+ */
+extern VOID
+SCardRequestQueue_init(
+  _Out_ SCardRequestQueue *queue);
+
+/**
+ * @brief Starts watching the deadlines and, optionally, reading
+ * Standard Input.
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardRequestQueue` object.
+ * @param[in] readStandardInput `FALSE` when the requests are received
+ * by other threads (`SCardRequestQueue_receive`).
+ * @return `TRUE` on success, `FALSE` if a thread could not be started.
+ */
+extern BOOL
+SCardRequestQueue_start(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const BOOL readStandardInput);
+
+/**
+ * @brief Waits for one message on a stream and queues its request
+ * (the Cancel command is handled right away, not queued).
+ *
+ * @param[in,out] queue Reference to a started `SCardRequestQueue` object.
+ * @param[in] session Session of the request (where its response goes).
+ * @param[in] input OS-specific stream descriptor, open for reading.
+ * @return One of `JSON_STREAM_STATUS__*` values
+ * (`JSON_STREAM_STATUS__NO_MORE` when the stream has ended).
+ */
+extern int
+SCardRequestQueue_receive(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const uint32_t session,
+  _In_ const os_specific_stream_t input);
+
+/**
+ * @brief `SCardRequestQueue` destructor.
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardRequestQueue` object.
+ *
+ * @note When Standard Input is still open, the reader thread stays blocked
+ * (the process is exiting anyway) and the queue memory is not released.
+ */
+extern VOID
+SCardRequestQueue_destroy(
+  _Inout_ SCardRequestQueue *queue);
+
+/**
+ * @brief Takes the next request out of the queue (without waiting):
+ * the oldest one with the highest priority, among the requests accepted
+ * by `filter`. Requests held back by `filter` keep waiting (their
+ * deadlines still run), and so do the younger requests of the same client
+ * ("k") for the same reader ("r"). Requests already answered by the queue
+ * are dropped.
+ *
+ * @param[in,out] queue Reference to a started `SCardRequestQueue` object.
+ * @param[in] filter Optional function that holds back some requests.
+ * @param[in] filterParameter Passed to `filter`.
+ * @param[out] request Receives the request, to be destroyed by the caller
+ * (`SCardQueuedRequest_destroy`) when `JSON_STREAM_STATUS__VALID` is returned.
+ * @return One of `JSON_STREAM_STATUS__*` values.
+ */
+extern int
+SCardRequestQueue_pop(
+  _Inout_ SCardRequestQueue *queue,
+  _In_opt_ SCardRequestFilter filter,
+  _In_opt_ const void *filterParameter,
+  _Out_ SCardQueuedRequest *request);
+
+/**
+ * @brief Cancels every waiting request of a client that uses a reader
+ * ("r" key), e.g. when the client has gone away.
+ *
+ * @param[in,out] queue Reference to a started `SCardRequestQueue` object.
+ * @param[in] session Session of the client.
+ * @param[in] client Client key ("k"), or `NULL` to cancel every waiting
+ * request of the session (readers used or not).
+ * @return Number of cancelled requests.
+ */
+extern size_t
+SCardRequestQueue_cancelClient(
+  _Inout_ SCardRequestQueue *queue,
+  _In_ const uint32_t session,
+  _In_opt_ LPCSTR client);
+
+/**
+ * @brief Marks a request as running (deadline watched, cancellable).
+ *
+ * @param[in,out] queue Reference to a started `SCardRequestQueue` object.
+ * @param[in,out] request Request taken out of the queue.
+ * @param[in] context Context of the PC/SC calls made for this request.
+ * @return `TRUE` when the request should be run, `FALSE` when it
+ * has already expired (`request->state` is updated).
+ */
+extern BOOL
+SCardRequestQueue_begin(
+  _Inout_ SCardRequestQueue *queue,
+  _Inout_ SCardQueuedRequest *request,
+  _In_ const SCARDCONTEXT context);
+
+/**
+ * @brief Checks if the running request expired or was cancelled
+ * (further PC/SC calls should not be made).
+ *
+ * @param[in,out] queue Reference to a started `SCardRequestQueue` object.
+ * @return `TRUE` when the request should stop, otherwise `FALSE`.
+ */
+extern BOOL
+SCardRequestQueue_isAborted(
+  _Inout_ SCardRequestQueue *queue);
+
+/**
+ * @brief Marks the running request as completed.
+ *
+ * @param[in,out] queue Reference to a started `SCardRequestQueue` object.
+ * @param[in,out] request Request passed to `SCardRequestQueue_begin`
+ * (`state` and `answered` are updated).
+ * @return `TRUE` when the caller should write the response,
+ * `FALSE` when the request has already been answered by the queue.
+ */
+extern BOOL
+SCardRequestQueue_finish(
+  _Inout_ SCardRequestQueue *queue,
+  _Inout_ SCardQueuedRequest *request);
+
+/**
+ * @brief `SCardQueuedRequest` destructor.
+ *
+ * @param[in,out] request Request returned by `SCardRequestQueue_pop`.
+ */
+extern VOID
+SCardQueuedRequest_destroy(
+  _Inout_ SCardQueuedRequest *request);
+
+
+/**************************************************************/
+/* SHARED NATIVE APP (DAEMON MODE)                            */
+/**************************************************************/
+
+/** Most clients (browser instances) connected at the same time. */
+#define WEBCARD_DAEMON__MAX_SESSIONS  64
+
+/** The daemon exits after being left without clients for this long (ms). */
+#define WEBCARD_DAEMON__IDLE_TIME  60000
+
+/** How often the listening thread checks if it should stop (ms). */
+#define WEBCARD_DAEMON__ACCEPT_INTERVAL  200
+
+/** A client that does not read its messages for this long is dropped (ms). */
+#define WEBCARD_DAEMON__SEND_TIMEOUT  5000
+
+/**
+ * `SCardDaemon` type definition.
+ */
+typedef struct SCardDaemon SCardDaemon;
+
+/**
+ * One client of the daemon: a socket with the framing of the Native
+ * Messaging pipes, read by its own thread.
+ */
+typedef struct SCardDaemonSession
+{
+  /** Session number (`0`: free slot). */
+  uint32_t id;
+
+  /** Connected local socket. */
+  os_specific_stream_t stream;
+
+  /** The client has gone away (the main thread still has to clean up). */
+  BOOL ended;
+
+  /** Held while a message is written to `stream`. */
+  os_specific_mutex_t outputMutex;
+
+  /** Thread that queues the requests of this client. */
+  os_specific_thread_t thread;
+
+  /** Back-reference for the thread. */
+  SCardDaemon *daemon;
+}
+SCardDaemonSession;
+
+/**
+ * Long-lived Native App shared by all the browser instances of a user:
+ * one PC/SC context, one reader database and one status watcher serve
+ * every client of a local socket ("webcard_shim" relays the Native
+ * Messaging pipes of a browser to this socket). Requests of all clients
+ * go through one `SCardRequestQueue`. Every member is protected by `mutex`.
+ */
+struct SCardDaemon
+{
+  os_specific_mutex_t mutex;
+
+  /** Listening socket. */
+  os_specific_stream_t listener;
+
+  /** Where the clients' requests are queued. */
+  SCardRequestQueue *queue;
+
+  /** Client slots (`id == 0`: free). */
+  SCardDaemonSession sessions[WEBCARD_DAEMON__MAX_SESSIONS];
+
+  /** Number of used slots. */
+  size_t sessionCount;
+
+  /** Number of the next session. */
+  uint32_t nextSession;
+
+  /** Monotonic time (ms) since when there are no clients. */
+  uint64_t idleSince;
+
+  /** Set by the destructor. */
+  BOOL stopping;
+
+  BOOL acceptStarted;
+  os_specific_thread_t acceptThread;
+};
+
+/**
+ * Daemon that writes the messages of `SCardDaemon_send`
+ * (`NULL` when the Native App only talks through Standard Input/Output).
+ */
+extern SCardDaemon *SCardDaemon_current;
+
+/**
+ * @brief `SCardDaemon` constructor.
+ *
+ * @param[out] daemon Reference to an UNINITIALIZED `SCardDaemon` object.
+ */
+extern VOID
+SCardDaemon_init(
+  _Out_ SCardDaemon *daemon);
+
+/**
+ * @brief Starts listening on the local socket and accepting clients,
+ * whose requests are pushed to `queue`. The daemon becomes
+ * `SCardDaemon_current`.
+ *
+ * @param[in,out] daemon Reference to an INITIALIZED `SCardDaemon` object.
+ * @param[in,out] queue Started queue (without reading Standard Input).
+ * @return `TRUE` on success, `FALSE` if the socket is already used
+ * by another daemon OR on any socket or thread error.
+ */
+extern BOOL
+SCardDaemon_start(
+  _Inout_ SCardDaemon *daemon,
+  _Inout_ SCardRequestQueue *queue);
+
+/**
+ * @brief `SCardDaemon` destructor: disconnects every client.
+ *
+ * @param[in,out] daemon Reference to an INITIALIZED `SCardDaemon` object.
+ */
+extern VOID
+SCardDaemon_destroy(
+  _Inout_ SCardDaemon *daemon);
+
+/**
+ * @brief Writes a message to a session: Standard Output for
+ * `WEBCARD_SESSION__STANDARD_IO`, otherwise a client of
+ * `SCardDaemon_current` (a client that cannot be written to is
+ * disconnected). Thread-safe.
+ *
+ * @param[in] session Session of the request, or of the event subscriber.
+ * @param[in] message Reference to a VALID and CONSTANT `UTF8String` object.
+ * @return `TRUE` on success, `FALSE` if the message was not written
+ * (e.g. the client has gone away).
+ */
+extern BOOL
+SCardDaemon_send(
+  _In_ const uint32_t session,
+  _In_ const UTF8String *message);
+
+/**
+ * @brief Same as `SCardDaemon_send`, for a Card Event (insertion or
+ * removal): on Standard Output, the event replaces a Card Event of the
+ * same reader, for the same clients, that is still waiting in
+ * `SCardOutputQueue_current`.
+ *
+ * @param[in] session Session of the event subscriber.
+ * @param[in] message Reference to a VALID and CONSTANT `UTF8String` object.
+ * @param[in] readerIndex Index of the reader in `SCardReaderDB`.
+ * @param[in] clientKeys Reference to a VALID and CONSTANT `UTF8String`
+ * object: stringified "k" key of the event (empty when missing).
+ * @return `TRUE` on success, `FALSE` if the message was not written.
+ */
+extern BOOL
+SCardDaemon_sendCardEvent(
+  _In_ const uint32_t session,
+  _In_ const UTF8String *message,
+  _In_ const size_t readerIndex,
+  _In_ const UTF8String *clientKeys);
+
+/**
+ * @brief Lists the sessions that receive Reader Events.
+ *
+ * @param[out] sessions Array of `WEBCARD_DAEMON__MAX_SESSIONS` elements.
+ * @return Number of sessions: the connected clients of `SCardDaemon_current`,
+ * otherwise `1` (`WEBCARD_SESSION__STANDARD_IO`).
+ */
+extern size_t
+SCardDaemon_listSessions(
+  _Out_ uint32_t *sessions);
+
+/**
+ * @brief Frees the slot of a client that has gone away (main thread).
+ *
+ * @param[in,out] daemon Reference to a started `SCardDaemon` object.
+ * @param[out] sessionRef Receives the number of the ended session, whose
+ * connections, subscriptions and waiting requests should be released.
+ * @return `TRUE` if a session has ended, otherwise `FALSE`.
+ */
+extern BOOL
+SCardDaemon_popEndedSession(
+  _Inout_ SCardDaemon *daemon,
+  _Out_ uint32_t *sessionRef);
+
+/**
+ * @brief Checks if the daemon has been left without clients
+ * for `WEBCARD_DAEMON__IDLE_TIME`.
+ *
+ * @param[in,out] daemon Reference to a started `SCardDaemon` object.
+ * @return `TRUE` when the daemon should exit, otherwise `FALSE`.
+ */
+extern BOOL
+SCardDaemon_isIdle(
+  _Inout_ SCardDaemon *daemon);
+
+
+/**************************************************************/
+/* OUTGOING MESSAGES (STANDARD OUTPUT)                        */
+/**************************************************************/
+
+/** Bytes of unwritten messages above which no more requests are handled. */
+#define WEBCARD_OUTPUT_BUDGET  (2 * 1024 * 1024)
+
+/** Pause of the main loop while Standard Output is over its budget, in microseconds. */
+#define WEBCARD_OUTPUT_CONGESTED_INTERVAL  1000
+
+/**
+ * `SCardOutgoingMessage` type definition.
+ */
+typedef struct SCardOutgoingMessage SCardOutgoingMessage;
+
+/**
+ * One message waiting to be written to Standard Output.
+ */
+struct SCardOutgoingMessage
+{
+  SCardOutgoingMessage *next;
+
+  /** Reader of a Card Event (`WEBCARD_QUEUE_NO_READER`: never merged). */
+  size_t readerIndex;
+
+  /** Session and stringified "k" key of a Card Event (merged only if equal). */
+  uint32_t session;
+  UTF8String clientKeys;
+
+  /** Monotonic time (ms) when the message was queued. */
+  uint64_t queuedTime;
+
+  UTF8String text;
+};
+
+/**
+ * Backpressure counters of an `SCardOutputQueue` (since the last reset).
+ */
+typedef struct SCardOutputStats
+{
+  /** Messages not written yet (at the time of the report). */
+  size_t queuedMessages;
+
+  /** Bytes not written yet (at the time of the report). */
+  size_t queuedBytes;
+
+  /** Most bytes waiting at the same time. */
+  size_t peakBytes;
+
+  /** Card Events replaced by a later event of the same reader. */
+  uint64_t mergedEvents;
+
+  /** Times the queue went over `WEBCARD_OUTPUT_BUDGET`. */
+  uint64_t congestions;
+
+  /** Time spent over `WEBCARD_OUTPUT_BUDGET` (ms). */
+  uint64_t congestedTime;
+
+  /** Longest time a message waited before it was written (ms). */
+  uint64_t longestWait;
+}
+SCardOutputStats;
+
+/**
+ * `SCardOutputQueue` type definition.
+ */
+typedef struct SCardOutputQueue SCardOutputQueue;
+
+/**
+ * Messages for Standard Output, written by a background thread:
+ * a browser that stops reading (busy service worker, suspended tab)
+ * blocks that thread, not the main loop. Responses are never dropped;
+ * the main loop stops taking requests while the queue is over
+ * `WEBCARD_OUTPUT_BUDGET`, and a Card Event replaces the waiting
+ * Card Event of the same reader. Every member is protected by `mutex`.
+ */
+struct SCardOutputQueue
+{
+  os_specific_mutex_t mutex;
+
+  /** Signalled when a message is queued or the queue is stopped. */
+  os_specific_condition_t condition;
+
+  /** Messages in their order (the one being written is detached). */
+  SCardOutgoingMessage *first;
+  SCardOutgoingMessage *last;
+
+  /** Messages and bytes not written yet (including the one being written). */
+  size_t count;
+  size_t bytes;
+
+  /** Over `WEBCARD_OUTPUT_BUDGET`, since `congestedSince` (monotonic ms). */
+  BOOL congested;
+  uint64_t congestedSince;
+
+  /** Standard Output can't be written any more: messages are discarded. */
+  BOOL broken;
+
+  /** Set by the destructor. */
+  BOOL stopping;
+
+  BOOL writerStarted;
+  os_specific_thread_t writerThread;
+
+  SCardOutputStats stats;
+};
+
+/**
+ * Queue used by `SCardDaemon_send` for Standard Output
+ * (`NULL`: messages are written by the calling thread).
+ */
+extern SCardOutputQueue *SCardOutputQueue_current;
+
+/**
+ * @brief `SCardOutputQueue` constructor.
+ *
+ * @param[out] queue Reference to an UNINITIALIZED `SCardOutputQueue` object.
+ */
+extern VOID
+SCardOutputQueue_init(
+  _Out_ SCardOutputQueue *queue);
+
+/**
+ * @brief Starts the writer thread. The queue becomes
+ * `SCardOutputQueue_current`.
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardOutputQueue` object.
+ * @return `TRUE` on success, `FALSE` if the thread could not be started.
+ */
+extern BOOL
+SCardOutputQueue_start(
+  _Inout_ SCardOutputQueue *queue);
+
+/**
+ * @brief `SCardOutputQueue` destructor: writes the waiting messages,
+ * then stops the writer thread.
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardOutputQueue` object.
+ */
+extern VOID
+SCardOutputQueue_destroy(
+  _Inout_ SCardOutputQueue *queue);
+
+/**
+ * @brief Queues a copy of a message without waiting for it to be written.
+ * Thread-safe.
+ *
+ * @param[in,out] queue Reference to a started `SCardOutputQueue` object.
+ * @param[in] message Reference to a VALID and CONSTANT `UTF8String` object.
+ * @param[in] session Session of the message.
+ * @param[in] readerIndex Reader of a Card Event, which replaces a waiting
+ * Card Event of the same reader, session and clients
+ * (`WEBCARD_QUEUE_NO_READER` for any other message).
+ * @param[in] clientKeys Optional stringified "k" key of a Card Event
+ * (`NULL` for any other message).
+ * @return `TRUE` on success, `FALSE` on memory error or when
+ * Standard Output has been closed.
+ */
+extern BOOL
+SCardOutputQueue_push(
+  _Inout_ SCardOutputQueue *queue,
+  _In_ const UTF8String *message,
+  _In_ const uint32_t session,
+  _In_ const size_t readerIndex,
+  _In_opt_ const UTF8String *clientKeys);
+
+/**
+ * @brief Makes the waiting Card Events final: they are no longer
+ * replaced by later events (reader indices change when the Reader
+ * list is re-loaded). Thread-safe.
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardOutputQueue` object.
+ */
+extern VOID
+SCardOutputQueue_forgetReaders(
+  _Inout_ SCardOutputQueue *queue);
+
+/**
+ * @brief Checks if the waiting messages are over `WEBCARD_OUTPUT_BUDGET`
+ * (new requests should wait).
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardOutputQueue` object.
+ * @return `TRUE` when the browser is not keeping up, otherwise `FALSE`.
+ */
+extern BOOL
+SCardOutputQueue_isCongested(
+  _Inout_ SCardOutputQueue *queue);
+
+/**
+ * @brief Takes a snapshot of the backpressure counters.
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardOutputQueue` object.
+ * @param[out] stats Receives the counters.
+ */
+extern VOID
+SCardOutputQueue_getStats(
+  _Inout_ SCardOutputQueue *queue,
+  _Out_ SCardOutputStats *stats);
+
+/**
+ * @brief Clears the backpressure counters (an ongoing congestion
+ * is counted again from now).
+ *
+ * @param[in,out] queue Reference to an INITIALIZED `SCardOutputQueue` object.
+ */
+extern VOID
+SCardOutputQueue_resetStats(
+  _Inout_ SCardOutputQueue *queue);
+
+
+/**************************************************************/
+/* SMART CARD CONNECTION                                      */
+/**************************************************************/
+
+/**
+ * `SCardSelection` type definition.
+ */
+typedef struct SCardSelection SCardSelection;
+
+/**
+ * File or application selected on one logical channel,
+ * learnt from the last successful "SELECT" command.
+ */
+struct SCardSelection
+{
+  /** Length of `command`, or `0` when the selected file is unknown. */
+  size_t commandLength;
+
+  /** Last successful "SELECT" command (part of APDU cache keys). */
+  BYTE command[WEBCARD_SELECT_CONTEXT_SIZE];
+
+  /**
+   * Length of `response` (in hex characters), or `0` when the command
+   * must reach the card when repeated (relative selection, response
+   * too long, or more response bytes were available).
+   */
+  size_t responseLength;
+
+  /** Response of the card (FCI and Status Word) as a hex-string. */
+  char response[2 * WEBCARD_SELECT_RESPONSE_SIZE];
+};
+
+/**
+ * `SCardConnection` type definition.
+ */
+typedef struct SCardConnection SCardConnection;
+
+/**
+ * Connection parameters for disgnated Smart Card reader.
+ */
+struct SCardConnection
+{
+  /** A handle that identifies the connection to the Smart Card in the designated reader. */
+  SCARDHANDLE handle;
+
+  /** A flag that indicates the established active protocol. */
+  PCSC_DWORD activeProtocol;
+
+  /** Share mode of the open `handle`. */
+  PCSC_DWORD shareMode;
+
+  /**
+   * Dynamically-allocated command APDUs that restore the card session
+   * after the card was reset by another application (every APDU
+   * preceded by its length, 2 bytes big-endian), or `NULL`.
+   */
+  LPBYTE restoreScript;
+
+  /** Length of `restoreScript`, in bytes. */
+  size_t restoreScriptLength;
+
+  /** Times the card was reconnected after a reset (or power-down). */
+  uint32_t reconnectCount;
+
+  /**
+   * Monotonic time (in milliseconds) when a disconnected but still open
+   * `handle` is finally closed, or `0` when the handle is not lingering.
+   */
+  uint64_t lingerDeadline;
+
+  /** How many incoming Reader State Changes should be ignored. */
+  DWORD ignoreCounter;
+
+  /**
+   * Debounce window (in milliseconds) for Card Events on this reader,
+   * or `WEBCARD_DEBOUNCE__INHERIT` to use the Database-wide setting.
+   */
+  uint32_t debounceWindow;
+
+  /** Last Card Event that was actually sent (the settled state). */
+  int settledEvent;
+
+  /** Card Event waiting for the debounce window to expire. */
+  int pendingEvent;
+
+  /** Monotonic time (in milliseconds) when `pendingEvent` settles. */
+  uint64_t pendingDeadline;
+
+  /** Was the card removed at any point during the debounce window? */
+  BOOL pendingRemoval;
+
+  /** Transitions coalesced into `pendingEvent` so far. */
+  uint32_t pendingSuppressed;
+
+  /** Total number of transitions that were never sent as Card Events. */
+  uint32_t suppressedTotal;
+
+  /** Length of `cardAtr` (`0` if no card was seen yet). */
+  size_t cardAtrLength;
+
+  /**
+   * "Answer To Reset" of the most recently inserted card, which
+   * is still needed to filter the "Card Removal" event of that card.
+   */
+  BYTE cardAtr[WEBCARD_ATR_MAX_SIZE];
+
+  /** Selection on every logical channel (basic channel first). */
+  SCardSelection selections[WEBCARD_LOGICAL_CHANNELS];
+
+  /**
+   * Should a repeated "SELECT" be answered without the card?
+   * (opt-in, exclusive connections only)
+   */
+  BOOL elideSelect;
+
+  /** Was the current card inserted while no job could be dispatched? */
+  BOOL awaitingJob;
+
+  /**
+   * Was the serial-number command already sent to the current card?
+   * (`cardSerialLength` is `0` if the card could not be identified)
+   */
+  BOOL cardSerialKnown;
+
+  /** Length of the card serial number, in bytes. */
+  size_t cardSerialLength;
+
+  /** Card serial number (part of APDU cache keys). */
+  BYTE cardSerial[WEBCARD_CARD_SERIAL_MAX_SIZE];
+
+  /**
+   * Histogram of `SCardTransmit` durations (owned by `SCardStats`),
+   * or `NULL` if the exchanges should not be timed.
+   */
+  SCardLatencyHistogram *transmitLatency;
+
+  /** Trace of `SCardTransmit` calls (`NULL`: not traced). */
+  SCardTrace *trace;
+
+  /** Index of this reader in the trace records. */
+  uint32_t traceReader;
+
+  /** Queue of the request being handled (`NULL`: never aborted). */
+  SCardRequestQueue *requests;
+
+  /**
+   * Dynamically-allocated key ("k") of the client that connected to this
+   * reader, or `NULL` when the reader is free. Other clients wait until
+   * the owner disconnects.
+   */
+  LPSTR owner;
+
+  /** Session of the owner (client keys are unique within a session). */
+  uint32_t ownerSession;
+};
+
+/**
+ * @brief `SCardConnection` constructor.
+ *
+ * @param[out] connection Reference to an UNINITIALIZED
+ * `SCardConnection` object.
+ */
+extern VOID
+SCardConnection_init(
+  _Out_ SCardConnection *connection);
+
+/**
+ * @brief Opens connection to a Smart Card Reader.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] context A handle that identifies the resource manager context.
+ * @param[in] readerName The name of the reader that contains the target card.
+ * @param[in] shareMode A flag that indicates whether other applications
+ * may form connections to the card.
+ * @return `TRUE` on success (or if the connection is already open),
+ * `FALSE` if the connection was NOT established.
+ */
+extern BOOL
+SCardConnection_open(
+  _Inout_ SCardConnection *connection,
+  _In_ const SCARDCONTEXT context,
+  _In_ LPCTSTR readerName,
+  _In_ const PCSC_DWORD shareMode);
+
+/**
+ * @brief Registers the command APDUs that restore the card session
+ * (e.g. "SELECT" of the application) after the card was reset
+ * by another application. Replaces the previous script.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] jsonApdus Reference to a CONSTANT `JsonArray` of hex-string
+ * command APDUs, or `NULL` to remove the script.
+ * @return `TRUE` on success, `FALSE` on invalid command APDUs
+ * OR on memory allocation failure (the script is removed).
+ */
+extern BOOL
+SCardConnection_setRestoreScript(
+  _Inout_ SCardConnection *connection,
+  _In_opt_ const JsonArray *jsonApdus);
+
+/**
+ * @brief Forgets what is selected on every logical channel
+ * (card reset or removed, or used by another application).
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ */
+extern VOID
+SCardConnection_forgetSelections(
+  _Inout_ SCardConnection *connection);
+
+/**
+ * @brief Updates the selection of the logical channel of a command
+ * that was sent to the card: a successful "SELECT" is remembered,
+ * instructions that might change the selection make it unknown.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] apdu Command APDU that was sent to the card.
+ * @param[in] apduLength The length of `apdu` buffer, in bytes.
+ * @param[in] hexStringResponse Response APDU as a hex-string
+ * (`NULL` if the transmission has failed).
+ */
+extern VOID
+SCardConnection_observeSelection(
+  _Inout_ SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _In_opt_ const UTF8String *hexStringResponse);
+
+/**
+ * @brief Answers a "SELECT" command of what is already selected
+ * on its logical channel, without the card (if `elideSelect` is set
+ * and the connection is exclusive).
+ *
+ * @param[in] connection Reference to a VALID and CONSTANT
+ * `SCardConnection` object.
+ * @param[in] apdu Command APDU to be sent to the card.
+ * @param[in] apduLength The length of `apdu` buffer, in bytes.
+ * @param[in,out] hexStringResult Refernce to a VALID `UTF8String` object.
+ * The remembered response is appended at the end of this param.
+ * @return `TRUE` if the command was answered, `FALSE` if it has
+ * to be sent to the card (OR on memory allocation failure).
+ */
+extern BOOL
+SCardConnection_repeatSelection(
+  _In_ const SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _Inout_ UTF8String *hexStringResult);
+
+/**
+ * @brief Closes connection to a Smart Card Reader
+ * (the reader is no longer owned by any client).
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @return `TRUE` on success (or if the connection is already closed),
+ * `FALSE` if any Smart Card error has occurred.
+ */
+extern BOOL
+SCardConnection_close(
+  _Inout_ SCardConnection *connection);
+
+/**
+ * @brief Keeps the connection open after a disconnect, so that it can be
+ * reused by `SCardConnection_reuse` until it is closed (the reader
+ * is no longer owned by any client).
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object
+ * with an open handle.
+ * @param[in] deadline Monotonic time (in milliseconds) when the caller
+ * should close the lingering connection.
+ */
+extern VOID
+SCardConnection_linger(
+  _Inout_ SCardConnection *connection,
+  _In_ const uint64_t deadline);
+
+/**
+ * @brief Tries to take over a lingering connection. A connection
+ * with a different share mode is closed instead.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] shareMode Requested share mode.
+ * @return `TRUE` if the open handle can be used right away,
+ * `FALSE` if `SCardConnection_open` has to connect again.
+ */
+extern BOOL
+SCardConnection_reuse(
+  _Inout_ SCardConnection *connection,
+  _In_ const PCSC_DWORD shareMode);
+
+/**
+ * @brief Makes given client the owner of the reader.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] session Session of the client.
+ * @param[in] client Client key ("k"), an empty string for anonymous clients.
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ */
+extern BOOL
+SCardConnection_setOwner(
+  _Inout_ SCardConnection *connection,
+  _In_ const uint32_t session,
+  _In_z_ LPCSTR client);
+
+/**
+ * @brief Checks if given client may use the reader right now
+ * (the reader is free, or owned by that client).
+ *
+ * @param[in] connection Reference to a VALID and CONSTANT
+ * `SCardConnection` object.
+ * @param[in] session Session of the client.
+ * @param[in] client Client key ("k"), an empty string for anonymous clients.
+ * @return `TRUE` if the client may use the reader, otherwise `FALSE`.
+ */
+extern BOOL
+SCardConnection_isAvailableTo(
+  _In_ const SCardConnection *connection,
+  _In_ const uint32_t session,
+  _In_z_ LPCSTR client);
+
+/**
+ * @brief Sends a service request to the smart card
+ * and expects to receive data back from the card.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] input Data to be written to the card.
+ * @param[in] inputLength The length of `input` buffer, in bytes.
+ * @param[out] output Data returned from the card.
+ * @param[in,out] outputLengthRef Supplies the length, in bytes,
+ * of the `output` buffer, and receives the actual number of bytes
+ * received from the smart card.
+ * @return `TRUE` on success (one APDU sent and one APDU received),
+ * `FALSE` if any Smart Card error has occurred.
+ *
+ * @note A card that was reset (or powered down) by another application
+ * is reconnected, the restore script is replayed and the APDU is sent
+ * once more, without failing the request.
+ */
+extern BOOL
+SCardConnection_transceiveSingle(
+  _Inout_ SCardConnection *connection,
+  _In_ const BYTE *input,
+  _In_ const PCSC_DWORD inputLength,
+  _Out_ BYTE *output,
+  _Inout_ PCSC_DWORD *outputLengthRef);
+
+/**
+ * @brief Sends a large APDU to the smart card
+ * and concatenates response to a one large string of data.
+ *
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in,out] hexStringResult Refernce to a VALID `UTF8String` object.
+ * Reponse in form of hex-string will be appended at the end of this param.
+ * @param[in] input Data to be written to the card.
+ * @param[in] inputLength The length of `input` buffer, in bytes.
+ * @param[out] output Buffer that can be used to collect reponse data.
+ * @param[in] outputLength The length of `output` buffer, in bytes.
+ * @return `TRUE` on success (one APDU sent and multiple APDUs received),
+ * `FALSE` if any Smart Card error has occurred.
+ */
+extern BOOL
+SCardConnection_transceiveMultiple(
+  _Inout_ SCardConnection *connection,
+  _Inout_ UTF8String *hexStringResult,
+  _In_ const BYTE *input,
+  _In_ const PCSC_DWORD inputLength,
+  _Out_ LPBYTE output,
+  _In_ const PCSC_DWORD outputLength);
+
+
+/**************************************************************/
+/* PERSISTENT CARD DATA CACHE                                 */
+/**************************************************************/
+
+/** Name of the cache file (in the per-user cache directory). */
+#define WEBCARD_CACHE_FILE_NAME  "card_cache.bin"
+
+/** Default lifetime of a persistent entry: one week (in seconds). */
+#define WEBCARD_CACHE_FILE_DEFAULT_TTL  (7 * 24 * 60 * 60)
+
+/**
+ * `SCardCacheFileSlot` type definition.
+ */
+typedef struct SCardCacheFileSlot SCardCacheFileSlot;
+
+/**
+ * In-memory index of one live record of the cache file.
+ */
+struct SCardCacheFileSlot
+{
+  /** Hash of the record key. */
+  uint32_t hash;
+
+  /** Offset of the record, from the beginning of the file. */
+  uint32_t offset;
+};
+
+/**
+ * `SCardCacheFile` type definition.
+ */
+typedef struct SCardCacheFile SCardCacheFile;
+
+/**
+ * Memory-mapped file with responses to idempotent commands,
+ * that survives the restarts of the Native App.
+ * Records are appended in insertion order (oldest first),
+ * each of them protected with a CRC-32 and an expiration time.
+ */
+struct SCardCacheFile
+{
+  /** Mapped file (`file.data` is `NULL` when the cache is disabled). */
+  OSSpecificMappedFile file;
+
+  /** Lifetime of newly stored records, in seconds. */
+  uint32_t timeToLive;
+
+  /** Length of `serialApdu` (`0`: cards can not be identified). */
+  size_t serialApduLength;
+
+  /** Command APDU that reads the serial number of a card. */
+  BYTE serialApdu[WEBCARD_SERIAL_APDU_MAX_SIZE];
+
+  /** Number of live records. */
+  size_t slotCount;
+
+  /** Number of allocated elements in the `slots` array. */
+  size_t slotCapacity;
+
+  /** Dynamically-allocated index of live records. */
+  SCardCacheFileSlot *slots;
+
+  /** Statistics. */
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+  uint32_t corrupted;
+};
+
+/**
+ * @brief `SCardCacheFile` constructor (the cache is disabled).
+ *
+ * @param[out] cacheFile Reference to an UNINITIALIZED `SCardCacheFile` object.
+ */
+extern VOID
+SCardCacheFile_init(
+  _Out_ SCardCacheFile *cacheFile);
+
+/**
+ * @brief `SCardCacheFile` destructor (closes the file, keeping its contents).
+ *
+ * @param[in,out] cacheFile Reference to a VALID `SCardCacheFile` object.
+ *
+ * @note After this call, `cacheFile` should not be used
+ * (unless re-initialized).
+ */
+extern VOID
+SCardCacheFile_destroy(
+  _Inout_ SCardCacheFile *cacheFile);
+
+/**
+ * @brief Is the persistent cache enabled (and the file mapped)?
+ *
+ * @param[in] cacheFile Reference to a VALID and CONSTANT `SCardCacheFile`.
+ * @return `TRUE` if the cache file is open.
+ */
+extern BOOL
+SCardCacheFile_isOpen(
+  _In_ const SCardCacheFile *cacheFile);
+
+/**
+ * @brief Opens the cache file left by a previous session (if any),
+ * together with its settings (lifetime, serial-number command).
+ *
+ * @param[in,out] cacheFile Reference to a VALID `SCardCacheFile` object.
+ * @return `TRUE` if the persistent cache is now enabled.
+ */
+extern BOOL
+SCardCacheFile_resume(
+  _Inout_ SCardCacheFile *cacheFile);
+
+/**
+ * @brief Enables, resizes or disables the persistent cache.
+ *
+ * When shrinking, the oldest records are dropped to fit in the new size.
+ * @param[in,out] cacheFile Reference to a VALID `SCardCacheFile` object.
+ * @param[in] fileSize New size of the file, in bytes
+ * (`0` disables the cache and deletes the file).
+ * @return `TRUE` on success, `FALSE` on any file-system error
+ * (the cache is then disabled).
+ */
+extern BOOL
+SCardCacheFile_configure(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const size_t fileSize);
+
+/**
+ * @brief Stores the current settings in the header of the cache file.
+ *
+ * @param[in,out] cacheFile Reference to a VALID `SCardCacheFile` object.
+ */
+extern VOID
+SCardCacheFile_saveSettings(
+  _Inout_ SCardCacheFile *cacheFile);
+
+/**
+ * @brief Number of bytes currently used by records.
+ *
+ * @param[in] cacheFile Reference to a VALID and CONSTANT `SCardCacheFile`.
+ * @return Used bytes (`0` if the cache is disabled).
+ */
+extern size_t
+SCardCacheFile_usedBytes(
+  _In_ const SCardCacheFile *cacheFile);
+
+/**
+ * @brief Looks up a live (not expired) record.
+ *
+ * @param[in,out] cacheFile Reference to a VALID `SCardCacheFile` object.
+ * @param[in] key Record key.
+ * @param[in] keyLength The length of `key` buffer, in bytes.
+ * @param[in,out] hexStringResult Reference to a VALID `UTF8String` object,
+ * to which the stored response will be appended.
+ * @return `TRUE` on cache hit, `FALSE` on cache miss
+ * (or on memory allocation failure).
+ */
+extern BOOL
+SCardCacheFile_lookup(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _Inout_ UTF8String *hexStringResult);
+
+/**
+ * @brief Appends a record (replacing a previous record with the same key),
+ * dropping expired and then the oldest records when the file is full.
+ *
+ * @param[in,out] cacheFile Reference to a VALID `SCardCacheFile` object.
+ * @param[in] key Record key.
+ * @param[in] keyLength The length of `key` buffer, in bytes.
+ * @param[in] hexStringResponse Reference to a VALID and CONSTANT
+ * `UTF8String` object (response APDU as a hex-string).
+ * @return `TRUE` if the record was stored, otherwise `FALSE`.
+ */
+extern BOOL
+SCardCacheFile_store(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _In_ const UTF8String *hexStringResponse);
+
+/**
+ * @brief Drops all records whose keys start with given bytes
+ * (e.g. every record of one card).
+ *
+ * @param[in,out] cacheFile Reference to a VALID `SCardCacheFile` object.
+ * @param[in] prefix Key prefix.
+ * @param[in] prefixLength The length of `prefix` buffer, in bytes.
+ */
+extern VOID
+SCardCacheFile_invalidatePrefix(
+  _Inout_ SCardCacheFile *cacheFile,
+  _In_ const BYTE *prefix,
+  _In_ const size_t prefixLength);
+
+
+/**************************************************************/
+/* APDU RESPONSE CACHE                                        */
+/**************************************************************/
+
+/**
+ * `SCardCacheEntry` type definition.
+ */
+typedef struct SCardCacheEntry SCardCacheEntry;
+
+/**
+ * One cached APDU response.
+ */
+struct SCardCacheEntry
+{
+  /** Zero-based index of the Smart Card Reader. */
+  size_t readerIndex;
+
+  /** Hash of (`readerIndex`, `key`). */
+  uint32_t hash;
+
+  /** Length of the `key` buffer, in bytes. */
+  size_t keyLength;
+
+  /** Card identity ("ATR"), "SELECT" context and the exact command APDU. */
+  LPBYTE key;
+
+  /** Cached response APDU (hex-string). */
+  UTF8String response;
+
+  /** Next entry in the same hash bucket. */
+  SCardCacheEntry *bucketNext;
+
+  /** Neighbours in the "Least Recently Used" list. */
+  SCardCacheEntry *newer;
+  SCardCacheEntry *older;
+};
+
+/**
+ * `SCardApduCache` type definition.
+ */
+typedef struct SCardApduCache SCardApduCache;
+
+/**
+ * Cache of responses to idempotent commands (like "READ BINARY"),
+ * valid while the same card stays in the reader.
+ */
+struct SCardApduCache
+{
+  /** Maximal number of bytes used by all entries (`0` disables the cache). */
+  size_t byteBudget;
+
+  /** Number of bytes currently used by all entries. */
+  size_t byteCount;
+
+  /** Number of cached entries. */
+  size_t entryCount;
+
+  /** Number of hash buckets (power of 2). */
+  size_t bucketCount;
+
+  /** Dynamically-allocated array of hash buckets. */
+  SCardCacheEntry **buckets;
+
+  /** Most recently used entry. */
+  SCardCacheEntry *newest;
+
+  /** Least recently used entry (first to be evicted). */
+  SCardCacheEntry *oldest;
+
+  /** Bit `n` is set when instruction byte `n` may be cached. */
+  BYTE allowedInstructions[256 / 8];
+
+  /** Statistics. */
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+
+  /** Repeated "SELECT" commands answered without the card. */
+  uint32_t elidedSelects;
+
+  /** Second tier: responses kept across sessions (for identified cards). */
+  SCardCacheFile persistent;
+};
+
+/**
+ * @brief `SCardApduCache` constructor.
+ *
+ * The cache is disabled (zero byte budget), with "READ BINARY"
+ * and "GET DATA" on the instruction allowlist.
+ * @param[out] cache Reference to an UNINITIALIZED `SCardApduCache` object.
+ */
+extern VOID
+SCardApduCache_init(
+  _Out_ SCardApduCache *cache);
+
+/**
+ * @brief `SCardApduCache` destructor.
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ *
+ * @note After this call, `cache` should not be used (unless re-initialized).
+ */
+extern VOID
+SCardApduCache_destroy(
+  _Inout_ SCardApduCache *cache);
+
+/**
+ * @brief Removes all in-memory entries (settings, statistics
+ * and the persistent cache are kept).
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ */
+extern VOID
+SCardApduCache_clear(
+  _Inout_ SCardApduCache *cache);
+
+/**
+ * @brief Removes all entries of given reader
+ * (card removed, card reset, or card contents modified).
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ */
+extern VOID
+SCardApduCache_invalidateReader(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex);
+
+/**
+ * @brief Changes the byte budget, evicting entries if necessary.
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ * @param[in] byteBudget New budget (`0` disables and clears the cache).
+ */
+extern VOID
+SCardApduCache_setBudget(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t byteBudget);
+
+/**
+ * @brief Replaces the allowlist of cacheable instruction bytes.
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ * @param[in] instructions Array of "INS" bytes.
+ * @param[in] count Number of elements in `instructions`.
+ */
+extern VOID
+SCardApduCache_setAllowedInstructions(
+  _Inout_ SCardApduCache *cache,
+  _In_ const BYTE *instructions,
+  _In_ const size_t count);
+
+/**
+ * @brief Checks if a command APDU may be served from (or stored in) the cache.
+ *
+ * Only enabled caches (in-memory or persistent), allowlisted instructions
+ * and the basic logical channel are accepted.
+ * @param[in] cache Reference to a VALID and CONSTANT `SCardApduCache` object.
+ * @param[in] apdu Command APDU.
+ * @param[in] apduLength The length of `apdu` buffer, in bytes.
+ * @return `TRUE` if the command is cacheable.
+ */
+extern BOOL
+SCardApduCache_isCacheable(
+  _In_ const SCardApduCache *cache,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength);
+
+/**
+ * @brief Prepares a cache key, that binds a command APDU
+ * to the card identity (ATR and serial number, if known)
+ * and to the currently selected file.
+ *
+ * @param[in] connection Reference to a VALID and CONSTANT
+ * `SCardConnection` object.
+ * @param[in] apdu Command APDU.
+ * @param[in] apduLength The length of `apdu` buffer, in bytes.
+ * @param[out] keyRef Receives a dynamically-allocated key
+ * (`NULL` on memory allocation failure).
+ * @param[out] keyLengthRef Receives the length of the key.
+ * @return `TRUE` on success, `FALSE` when the selected file is unknown
+ * (or was selected relative to the current DF) OR on memory allocation failure.
+ *
+ * @note `keyRef[0]` must be released by the caller (if not `NULL`).
+ */
+extern BOOL
+SCardApduCache_makeKey(
+  _In_ const SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _Outptr_result_maybenull_ LPBYTE *keyRef,
+  _Out_ size_t *keyLengthRef);
+
+/**
+ * @brief Looks up a cached response (in memory first, then in the
+ * persistent cache if the key contains a card serial number).
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @param[in] key Key prepared with `SCardApduCache_makeKey`.
+ * @param[in] keyLength The length of `key` buffer, in bytes.
+ * @param[in,out] hexStringResult Reference to a VALID `UTF8String` object,
+ * to which the cached response will be appended.
+ * @return `TRUE` on cache hit, `FALSE` on cache miss
+ * (or on memory allocation failure).
+ */
+extern BOOL
+SCardApduCache_lookup(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _Inout_ UTF8String *hexStringResult);
+
+/**
+ * @brief Stores a successful response ("9000" status word) in the cache,
+ * evicting the least recently used entries to fit in the byte budget.
+ * Responses of identified cards are also stored in the persistent cache.
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @param[in] key Key prepared with `SCardApduCache_makeKey`.
+ * @param[in] keyLength The length of `key` buffer, in bytes.
+ * @param[in] hexStringResponse Reference to a VALID and CONSTANT
+ * `UTF8String` object (response APDU as a hex-string).
+ * @return `TRUE` if the response was stored, otherwise `FALSE`.
+ */
+extern BOOL
+SCardApduCache_store(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *key,
+  _In_ const size_t keyLength,
+  _In_ const UTF8String *hexStringResponse);
+
+/**
+ * @brief Reads the serial number of the current card (once per card),
+ * so that its responses can be kept in the persistent cache.
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[out] outputBuffer Work buffer for the response APDU.
+ * @param[in] outputBufferLength The length of `outputBuffer`, in bytes.
+ * @return `TRUE` if the card is identified (`cardSerial` is valid).
+ */
+extern BOOL
+SCardApduCache_identifyCard(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _Inout_ SCardConnection *connection,
+  _Out_ BYTE *outputBuffer,
+  _In_ const size_t outputBufferLength);
+
+/**
+ * @brief Updates the "SELECT" context of a connection and decides
+ * whether the cached responses of that reader are still valid,
+ * after a command was sent to the card.
+ *
+ * @param[in,out] cache Reference to a VALID `SCardApduCache` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @param[in,out] connection Reference to a VALID `SCardConnection` object.
+ * @param[in] apdu Command APDU that was sent to the card.
+ * @param[in] apduLength The length of `apdu` buffer, in bytes.
+ * @param[in] hexStringResponse Response APDU as a hex-string
+ * (`NULL` if the transmission has failed).
+ */
+extern VOID
+SCardApduCache_observeCommand(
+  _Inout_ SCardApduCache *cache,
+  _In_ const size_t readerIndex,
+  _Inout_ SCardConnection *connection,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _In_opt_ const UTF8String *hexStringResponse);
+
+
+/**************************************************************/
+/* SMART CARD EVENT SUBSCRIPTIONS                             */
+/**************************************************************/
+
+/**
+ * `SCardSubscription` type definition.
+ */
+typedef struct SCardSubscription SCardSubscription;
+
+/**
+ * Reader Events that one client (browser tab) wants to receive.
+ */
+struct SCardSubscription
+{
+  /** Identifies the client that owns this subscription. */
+  UTF8String clientKey;
+
+  /** Session of the client (client keys are unique within a session). */
+  uint32_t session;
+
+  /** Bit `(1 << n)` is set for every subscribed Reader Event `n`. */
+  uint32_t eventMask;
+
+  /** Number of elements in `readerIndices` (`0` means any reader). */
+  size_t readerCount;
+
+  /**
+   * Dynamically-allocated list of subscribed reader indices
+   * (follow the readers when the Reader list is re-loaded,
+   * `SIZE_MAX` for an unplugged reader).
+   */
+  size_t *readerIndices;
+
+  /** Length of `atrPattern` and `atrMask` (`0` means any card). */
+  size_t atrLength;
+
+  /** Expected "Answer To Reset" bytes (after masking). */
+  BYTE atrPattern[WEBCARD_ATR_MAX_SIZE];
+
+  /** Which bits of the "Answer To Reset" are compared. */
+  BYTE atrMask[WEBCARD_ATR_MAX_SIZE];
+};
+
+/**
+ * @brief `SCardSubscription` constructor.
+ *
+ * The initialized object matches every Reader Event.
+ * @param[out] subscription Reference to an UNINITIALIZED
+ * `SCardSubscription` object.
+ */
+extern VOID
+SCardSubscription_init(
+  _Out_ SCardSubscription *subscription);
+
+/**
+ * @brief `SCardSubscription` destructor.
+ *
+ * @param[in,out] subscription Reference to a VALID `SCardSubscription` object.
+ *
+ * @note After this call, `subscription` should not be used
+ * (unless re-initialized).
+ */
+extern VOID
+SCardSubscription_destroy(
+  _Inout_ SCardSubscription *subscription);
+
+/**
+ * @brief Loads subscription filters from a JSON Request.
+ *
+ * Recognized keys: "k" (client key), "e" (array of Reader Event numbers),
+ * "r" (array of reader indices), "a" (hex ATR pattern) and "m" (hex ATR mask,
+ * defaults to all bits set). Every missing key means "no filtering".
+ * @param[out] subscription Reference to an UNINITIALIZED
+ * `SCardSubscription` object.
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object.
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on memory allocation failure.
+ *
+ * @note After this call, `subscription` will hold a VALID (at least
+ * initialized) object. If the function returned `FALSE`,
+ * `subscription` shall be destroyed.
+ */
+extern BOOL
+SCardSubscription_load(
+  _Out_ SCardSubscription *subscription,
+  _In_ const JsonObject *jsonRequest);
+
+/**
+ * @brief Checks if given Reader Event passes the subscription filters.
+ *
+ * @param[in] subscription Reference to a VALID and CONSTANT
+ * `SCardSubscription` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * Ignored for events other than "Card Insertion" and "Card Removal".
+ * @param[in] readerEvent Type of the Reader Event.
+ * @param[in] atr "Answer To Reset" of the card involved in the event.
+ * @param[in] atrLength The length of `atr` buffer, in bytes.
+ * @return `TRUE` if the subscriber wants this Reader Event.
+ */
+extern BOOL
+SCardSubscription_matches(
+  _In_ const SCardSubscription *subscription,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _In_ const BYTE *atr,
+  _In_ const size_t atrLength);
+
+
+/**************************************************************/
+/* PREFETCH SCRIPTS                                           */
+/**************************************************************/
+
+/**
+ * `SCardPrefetchScript` type definition.
+ */
+typedef struct SCardPrefetchScript SCardPrefetchScript;
+
+/**
+ * Command APDUs sent to a newly inserted card before the
+ * "Card Insertion" event is sent, so that their responses
+ * reach the page together with the event.
+ */
+struct SCardPrefetchScript
+{
+  /**
+   * Script name (`filter.clientKey`), reader indices and ATR pattern
+   * that select the cards for this script. Event mask is not used.
+   */
+  SCardSubscription filter;
+
+  /** Number of command APDUs. */
+  size_t apduCount;
+
+  /** Dynamically-allocated command APDUs. */
+  LPBYTE apdus[WEBCARD_PREFETCH_MAX_APDUS];
+
+  /** Lengths of `apdus`, in bytes. */
+  size_t apduLengths[WEBCARD_PREFETCH_MAX_APDUS];
+};
+
+/**
+ * @brief `SCardPrefetchScript` constructor.
+ *
+ * @param[out] script Reference to an UNINITIALIZED `SCardPrefetchScript`.
+ */
+extern VOID
+SCardPrefetchScript_init(
+  _Out_ SCardPrefetchScript *script);
+
+/**
+ * @brief `SCardPrefetchScript` destructor.
+ *
+ * @param[in,out] script Reference to a VALID `SCardPrefetchScript` object.
+ *
+ * @note After this call, `script` should not be used (unless re-initialized).
+ */
+extern VOID
+SCardPrefetchScript_destroy(
+  _Inout_ SCardPrefetchScript *script);
+
+/**
+ * @brief Reads a prefetch script from a JSON request.
+ *
+ * @param[out] script Reference to an UNINITIALIZED `SCardPrefetchScript`.
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional keys: "k" (script name), "r" (array of reader
+ * indices), "a" and "m" (ATR pattern and ATR mask, hex-strings)
+ * and "d" (array of hex-string command APDUs, empty to remove the script).
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on memory allocation failure.
+ *
+ * @note After this call, `script` will hold a VALID (at least
+ * initialized) object. If the function returned `FALSE`,
+ * `script` shall be destroyed.
+ */
+extern BOOL
+SCardPrefetchScript_load(
+  _Out_ SCardPrefetchScript *script,
+  _In_ const JsonObject *jsonRequest);
+
+/**
+ * @brief Copies the command APDUs of a prefetch script
+ * (the copy has no filter).
+ *
+ * @param[out] destination Reference to an UNINITIALIZED `SCardPrefetchScript`.
+ * @param[in] source Reference to a VALID and CONSTANT `SCardPrefetchScript`.
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ *
+ * @note After this call, `destination` will hold a VALID (at least
+ * initialized) object. If the function returned `FALSE`,
+ * `destination` shall be destroyed.
+ */
+extern BOOL
+SCardPrefetchScript_copy(
+  _Out_ SCardPrefetchScript *destination,
+  _In_ const SCardPrefetchScript *source);
+
+
+/**************************************************************/
+/* PRODUCTION-LINE JOBS                                       */
+/**************************************************************/
+
+/** Most jobs waiting in the production-line queue. */
+#define WEBCARD_JOBS_MAX_PENDING  65536
+
+/** Most parameters of one job (`{0}` to `{7}` in the script). */
+#define WEBCARD_JOBS_MAX_PARAMETERS  8
+
+/** Most readers working on jobs at the same time (one thread each). */
+#define WEBCARD_JOBS_MAX_WORKERS  32
+
+/**
+ * `SCardJobQueue` type definition.
+ */
+typedef struct SCardJobQueue SCardJobQueue;
+
+/**
+ * One job: parameters of the job script for one card.
+ */
+typedef struct SCardJob
+{
+  /** Job number (counted from `1`, in the order of queueing). */
+  uint32_t id;
+
+  /** Number of `parameters`. */
+  size_t parameterCount;
+
+  /** Dynamically-allocated hex-strings that replace `{0}`, `{1}`, ... */
+  LPSTR parameters[WEBCARD_JOBS_MAX_PARAMETERS];
+}
+SCardJob;
+
+/**
+ * A reader working on one job: its own connection and worker thread.
+ */
+typedef struct SCardJobWorker
+{
+  /** Is a job dispatched (and not collected yet)? Main thread only. */
+  BOOL busy;
+
+  /** Has the worker thread finished? (protected by the queue mutex) */
+  BOOL finished;
+
+  /** Has the worker thread been started (and must be joined)? */
+  BOOL started;
+
+  /** Worker thread. */
+  os_specific_thread_t thread;
+
+  /**
+   * Connection of the worker (shared mode), apart from the clients' one:
+   * opened and closed by the worker thread, through a Smart Card Context
+   * of its own.
+   */
+  SCardConnection connection;
+
+  /** Dynamically-allocated copy of the reader name. */
+  LPTSTR readerName;
+
+  /** The job being done. */
+  SCardJob job;
+
+  /** Number of command APDUs (the job script with the parameters). */
+  size_t apduCount;
+
+  /** Dynamically-allocated command APDUs. */
+  LPBYTE apdus[WEBCARD_PREFETCH_MAX_APDUS];
+
+  /** Lengths of `apdus`, in bytes. */
+  size_t apduLengths[WEBCARD_PREFETCH_MAX_APDUS];
+
+  /** Number of successful exchanges (the job stops at the first failure). */
+  size_t responseCount;
+
+  /** Hex-string response APDUs. */
+  UTF8String responses[WEBCARD_PREFETCH_MAX_APDUS];
+
+  /** Has the job failed? (the job script could not be built, or an exchange failed) */
+  BOOL failed;
+
+  /** Monotonic time (in milliseconds) when the job was dispatched. */
+  uint64_t startTime;
+
+  /** Monotonic time (in milliseconds) when the job was done. */
+  uint64_t endTime;
+
+  /** Back-reference for the worker thread. */
+  SCardJobQueue *queue;
+}
+SCardJobWorker;
+
+/**
+ * `SCardJobReaderStats` type definition.
+ */
+typedef struct SCardJobReaderStats SCardJobReaderStats;
+
+/**
+ * Throughput of one reader on the production line.
+ */
+struct SCardJobReaderStats
+{
+  /** Dynamically-allocated copy of the reader name. */
+  LPTSTR readerName;
+
+  /** Jobs done on this reader. */
+  uint32_t jobs;
+
+  /** Jobs that failed on this reader. */
+  uint32_t failures;
+
+  /** Time spent on jobs (in milliseconds). */
+  uint64_t busyTime;
+};
+
+/**
+ * Production line (mass personalization): a queue of jobs for one job
+ * script. Whenever a card is inserted into one of the selected readers,
+ * the next job is dispatched to that reader at once (no round trip to
+ * the page), and done by a worker thread. The main thread collects the
+ * results and reports every job to the client that queued the jobs.
+ */
+struct SCardJobQueue
+{
+  /** Protects `finished` flags of the workers. */
+  os_specific_mutex_t mutex;
+
+  /** Session of the client that receives the job reports. */
+  uint32_t session;
+
+  /**
+   * Reader indices and ATR pattern that select the readers and cards,
+   * and the key ("k") of the client that receives the job reports.
+   */
+  SCardSubscription filter;
+
+  /** Number of `templates` (`0`: no job script yet). */
+  size_t templateCount;
+
+  /** Dynamically-allocated hex-string command APDUs with `{n}` parameters. */
+  LPSTR templates[WEBCARD_PREFETCH_MAX_APDUS];
+
+  /** Dynamically-allocated list of waiting jobs (from `pendingFirst`). */
+  SCardJob *pending;
+
+  /** Size of `pending`, in jobs. */
+  size_t pendingCapacity;
+
+  /** Position of the oldest waiting job in `pending`. */
+  size_t pendingFirst;
+
+  /** Number of waiting jobs. */
+  size_t pendingCount;
+
+  /** Number of the next queued job. */
+  uint32_t nextId;
+
+  /** Readers working on jobs. */
+  SCardJobWorker workers[WEBCARD_JOBS_MAX_WORKERS];
+
+  /** Monotonic time (in milliseconds) of the first job since the last reset (`0`: none). */
+  uint64_t firstDispatch;
+
+  /** Jobs done (since the last reset). */
+  uint32_t doneCount;
+
+  /** Jobs that failed (since the last reset). */
+  uint32_t failedCount;
+
+  /** Number of elements in `readers`. */
+  size_t readerCount;
+
+  /** Dynamically-allocated throughput of every reader, keyed by reader name. */
+  SCardJobReaderStats *readers;
+};
+
+/**
+ * @brief `SCardJobQueue` constructor.
+ *
+ * @param[out] queue Reference to an UNINITIALIZED `SCardJobQueue` object.
+ */
+extern VOID
+SCardJobQueue_init(
+  _Out_ SCardJobQueue *queue);
+
+/**
+ * @brief `SCardJobQueue` destructor: waits for the workers to finish
+ * (which close their connections). Waiting jobs are dropped.
+ *
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
+ *
+ * @note After this call, `queue` should not be used (unless re-initialized).
+ */
+extern VOID
+SCardJobQueue_destroy(
+  _Inout_ SCardJobQueue *queue);
+
+/**
+ * @brief Configures the production line from a JSON Request.
+ *
+ * Recognized keys: "d" (array of hex-string command APDUs, where `{n}`
+ * stands for the n-th parameter of a job) together with "r", "a" and "m"
+ * (reader and card filters, see `SCardSubscription_load`), "j" (array of
+ * jobs to queue, every job an array of hex-string parameters) and
+ * "x" (non-zero: drop the waiting jobs). A new job script makes the client
+ * who sent it ("k", `session`) receive the job reports.
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[in] session Session of the client.
+ * @param[out] firstIdRef Receives the number of the first queued job
+ * (`0` when no job was queued).
+ * @return `TRUE` on success, `FALSE` on invalid parameters (nothing
+ * is changed) OR on memory allocation failure.
+ */
+extern BOOL
+SCardJobQueue_configure(
+  _Inout_ SCardJobQueue *queue,
+  _In_ const JsonObject *jsonRequest,
+  _In_ const uint32_t session,
+  _Out_ uint32_t *firstIdRef);
+
+/**
+ * @brief Drops every waiting job (jobs in progress are finished).
+ *
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
+ */
+extern VOID
+SCardJobQueue_clear(
+  _Inout_ SCardJobQueue *queue);
+
+/**
+ * @brief Does given reader take part in the production line?
+ *
+ * @param[in] queue Reference to a VALID and CONSTANT `SCardJobQueue` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @param[in] atr "Answer To Reset" of the card in the reader.
+ * @param[in] atrLength The length of `atr` buffer, in bytes.
+ * @return `TRUE` if the card in the reader should get a job.
+ */
+extern BOOL
+SCardJobQueue_matches(
+  _In_ const SCardJobQueue *queue,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *atr,
+  _In_ const size_t atrLength);
 
 /**
- * @brief Opens connection to a Smart Card Reader.
+ * @brief Dispatches the next waiting job to given reader: starts
+ * a worker thread, which establishes a Smart Card Context of its own
+ * and connects to the card in shared mode (a card that cannot be
+ * connected makes the job fail).
  *
- * @param[in,out] connection Reference to a VALID `SCardConnection` object.
- * @param[in] context A handle that identifies the resource manager context.
- * @param[in] readerName The name of the reader that contains the target card.
- * @param[in] shareMode A flag that indicates whether other applications
- * may form connections to the card.
- * @return `TRUE` on success (or if the connection is already open),
- * `FALSE` if the connection was NOT established.
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
+ * @param[in] readerName Name of the Smart Card Reader.
+ * @return `TRUE` if a job was dispatched, `FALSE` if there is no waiting
+ * job, no free worker, the reader is still busy with another job,
+ * OR on memory allocation failure.
  */
 extern BOOL
-SCardConnection_open(
-  _Inout_ SCardConnection *connection,
-  _In_ const SCARDCONTEXT context,
-  _In_ LPCTSTR readerName,
-  _In_ const PCSC_DWORD shareMode);
+SCardJobQueue_dispatch(
+  _Inout_ SCardJobQueue *queue,
+  _In_ LPCTSTR readerName);
 
 /**
- * @brief Closes connection to a Smart Card Reader.
+ * @brief Finds a worker that has finished its job (without waiting).
  *
- * @param[in,out] connection Reference to a VALID `SCardConnection` object.
- * @return `TRUE` on success (or if the connection is already closed),
- * `FALSE` if any Smart Card error has occurred.
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
+ * @return Finished worker (to be passed to `SCardJobQueue_release`
+ * once its results are reported), or `NULL`.
  */
-extern BOOL
-SCardConnection_close(
-  _Inout_ SCardConnection *connection);
+extern SCardJobWorker *
+SCardJobQueue_collect(
+  _Inout_ SCardJobQueue *queue);
 
 /**
- * @brief Sends a service request to the smart card
- * and expects to receive data back from the card.
+ * @brief Counts a collected job and makes the worker available again.
  *
- * @param[in] connection Reference to a VALID and CONSTANT
- * `SCardConnection` object.
- * @param[in] input Data to be written to the card.
- * @param[in] inputLength The length of `input` buffer, in bytes.
- * @param[out] output Data returned from the card.
- * @param[in,out] outputLengthRef Supplies the length, in bytes,
- * of the `output` buffer, and receives the actual number of bytes
- * received from the smart card.
- * @return `TRUE` on success (one APDU sent and one APDU received),
- * `FALSE` if any Smart Card error has occurred.
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
+ * @param[in,out] worker Worker returned by `SCardJobQueue_collect`.
  */
-extern BOOL
-SCardConnection_transceiveSingle(
-  _In_ const SCardConnection *connection,
-  _In_ const BYTE *input,
-  _In_ const PCSC_DWORD inputLength,
-  _Out_ BYTE *output,
-  _Inout_ PCSC_DWORD *outputLengthRef);
+extern VOID
+SCardJobQueue_release(
+  _Inout_ SCardJobQueue *queue,
+  _Inout_ SCardJobWorker *worker);
 
 /**
- * @brief Sends a large APDU to the smart card
- * and concatenates response to a one large string of data.
+ * @brief Waits for the workers to finish their jobs
+ * (the jobs are still collected and reported).
  *
- * @param[in] connection Reference to a VALID and CONSTANT
- * `SCardConnection` object.
- * @param[in,out] hexStringResult Refernce to a VALID `UTF8String` object.
- * Reponse in form of hex-string will be appended at the end of this param.
- * @param[in] input Data to be written to the card.
- * @param[in] inputLength The length of `input` buffer, in bytes.
- * @param[out] output Buffer that can be used to collect reponse data.
- * @param[in] outputLength The length of `output` buffer, in bytes.
- * @return `TRUE` on success (one APDU sent and multiple APDUs received),
- * `FALSE` if any Smart Card error has occurred.
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
  */
-extern BOOL
-SCardConnection_transceiveMultiple(
-  _In_ const SCardConnection *connection,
-  _Inout_ UTF8String *hexStringResult,
-  _In_ const BYTE *input,
-  _In_ const PCSC_DWORD inputLength,
-  _Out_ LPBYTE output,
-  _In_ const PCSC_DWORD outputLength);
+extern VOID
+SCardJobQueue_wait(
+  _Inout_ SCardJobQueue *queue);
+
+/**
+ * @brief Clears the throughput counters.
+ *
+ * @param[in,out] queue Reference to a VALID `SCardJobQueue` object.
+ */
+extern VOID
+SCardJobQueue_resetCounters(
+  _Inout_ SCardJobQueue *queue);
 
 
 /**************************************************************/
@@ -210,6 +3234,74 @@ struct SCardReaderDB
    * establishing connections and for data transmission.
    */
   SCardConnection *connections;
+
+  /**
+   * Default debounce window (in milliseconds) for Card Events.
+   * `0` means that every transition is sent immediately.
+   * This setting survives the re-loading of the Reader list.
+   */
+  uint32_t debounceWindow;
+
+  /**
+   * Number of Reader Event subscriptions. When `0`, every Reader Event
+   * is sent (clients that never subscribed receive everything).
+   */
+  size_t subscriptionCount;
+
+  /** Dynamically-allocated list of Reader Event subscriptions. */
+  SCardSubscription *subscriptions;
+
+  /** Responses to idempotent commands, for every reader. */
+  SCardApduCache apduCache;
+
+  /** Number of installed prefetch scripts. */
+  size_t prefetchCount;
+
+  /** Dynamically-allocated list of prefetch scripts. */
+  SCardPrefetchScript *prefetchScripts;
+
+  /** Latency statistics (survive the re-loading of the Reader list). */
+  SCardStats stats;
+
+  /** APDU trace (survives the re-loading of the Reader list). */
+  SCardTrace trace;
+
+  /** Incoming requests (owned by `WebCard_run`, `NULL` when not reading). */
+  SCardRequestQueue *requests;
+
+  /** Session of the request being handled (owns new connections and subscriptions). */
+  uint32_t session;
+
+  /**
+   * How long (in milliseconds) a connection stays open after a disconnect,
+   * to be reused by the next connect. `0` closes connections immediately.
+   * This setting survives the re-loading of the Reader list.
+   */
+  uint32_t lingerTime;
+
+  /** Connects served by a lingering connection. */
+  uint64_t lingerHits;
+
+  /** Connects that had to call `SCardConnect` (while lingering is enabled). */
+  uint64_t lingerMisses;
+
+  /** Lingering connections closed early (card removed, reader state changed). */
+  uint64_t lingerReleases;
+
+  /** Supervision of the Smart Card Context (kept on every re-load). */
+  SCardRecovery recovery;
+
+  /**
+   * Dynamically-allocated production-line job queue, or `NULL` until
+   * the first jobs command (survives the re-loading of the Reader list).
+   */
+  SCardJobQueue *jobs;
+
+  /**
+   * Dynamically-allocated list of running fan-outs, newest first
+   * (survives the re-loading of the Reader list).
+   */
+  struct SCardFanOut *fanOuts;
 };
 
 /**
@@ -232,6 +3324,22 @@ extern VOID
 SCardReaderDB_destroy(
   _Inout_ SCardReaderDB *database);
 
+/**
+ * @brief Moves settings that should survive the re-loading
+ * of the Reader list. Readers listed in both keep their debounce
+ * state (matched by name).
+ *
+ * @param[in,out] destination Reference to a VALID `SCardReaderDB` object
+ * (freshly loaded list of readers, with default settings).
+ * @param[in,out] source Reference to a VALID `SCardReaderDB` object
+ * (previous list of readers). Its settings are reset to defaults,
+ * so that the destructor won't release the moved resources.
+ */
+extern VOID
+SCardReaderDB_moveSettings(
+  _Inout_ SCardReaderDB *destination,
+  _Inout_ SCardReaderDB *source);
+
 /**
  * @brief Prepares a Smart Card Reader Database (list od states
  * and list of connections) from given reader names.
@@ -262,6 +3370,18 @@ SCardReaderDB_hasReaderNamed(
   _In_ const SCardReaderDB *database,
   _In_ LPCTSTR readerName);
 
+/**
+ * @brief Finds given Smart Card Reader in a given Database.
+ *
+ * @param[in] database Reference to a VALID and CONSTANT `SCardReaderDB` object.
+ * @param[in] readerName Name of the queried Smart Card Reader.
+ * @return Zero-based index of the reader, or `SIZE_MAX` if it is not listed.
+ */
+extern size_t
+SCardReaderDB_findReaderNamed(
+  _In_ const SCardReaderDB *database,
+  _In_ LPCTSTR readerName);
+
 /**
  * @brief Fetches the list of currently connected Smart Card Readers
  * and replaces given Database if the number is different.
@@ -276,8 +3396,9 @@ SCardReaderDB_hasReaderNamed(
  * (and `jsonReaderNames` will hold the names of now-missing readers);
  * `WEBCARD_FETCH_READERS__MORE_READERS` if some readers were connected
  * (and `jsonReaderNames` will hold the names of just-added readers);
- * `WEBCARD_FETCH_READERS__SERVICE_STOPPED` if last reader was disconnected,
- * the Smart Card Service has stopped and must be re-established;
+ * `WEBCARD_FETCH_READERS__SERVICE_STOPPED` if the Smart Card Context
+ * was lost (last reader disconnected on Windows, service stopped
+ * or restarted) and must be re-established;
  * `WEBCARD_FETCH_READERS__FAIL` on any error (and the Database doesn't change).
  *
  * @note After this call, `jsonReaderNames` will hold a VALID
@@ -292,23 +3413,362 @@ SCardReaderDB_fetch(
   _In_ const BOOL firstFetch);
 
 
-/**************************************************************/
-/* WEBCARD OPERATIONS                                         */
-/**************************************************************/
+/**
+ * @brief Adds a Reader Event subscription to the Database,
+ * replacing any previous subscription with the same client key.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in,out] subscription Reference to a VALID `SCardSubscription`
+ * object. On success, its contents are MOVED into the Database
+ * and the object is left UNINITIALIZED.
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ */
+extern BOOL
+SCardReaderDB_subscribe(
+  _Inout_ SCardReaderDB *database,
+  _Inout_ SCardSubscription *subscription);
+
+/**
+ * @brief Removes the Reader Event subscription of given client.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] session Session of the client.
+ * @param[in] clientKey Reference to a VALID and CONSTANT `UTF8String` object,
+ * or `NULL` to remove every subscription of the session.
+ * @return `TRUE` if a subscription was removed, otherwise `FALSE`.
+ */
+extern BOOL
+SCardReaderDB_unsubscribe(
+  _Inout_ SCardReaderDB *database,
+  _In_ const uint32_t session,
+  _In_opt_ const UTF8String *clientKey);
+
+/**
+ * @brief Finds the clients of a session that want to receive
+ * given Reader Event.
+ *
+ * @param[in] database Reference to a VALID and CONSTANT `SCardReaderDB` object.
+ * @param[in] session Session that would receive the Reader Event.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader
+ * (only for "Card Insertion" and "Card Removal" events).
+ * @param[in] readerEvent Type of the Reader Event.
+ * @param[out] jsonClientKeys Reference to an UNINITIALIZED `JsonArray`
+ * variable, that will hold the keys of matching clients.
+ * It stays empty when the session has no subscriptions at all.
+ * @return `TRUE` if the Reader Event should be sent to the session,
+ * `FALSE` if none of its clients subscribed to it.
+ *
+ * @note `jsonClientKeys` must be released by the caller.
+ */
+extern BOOL
+SCardReaderDB_findSubscribers(
+  _In_ const SCardReaderDB *database,
+  _In_ const uint32_t session,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _Out_ JsonArray *jsonClientKeys);
+
+/**
+ * @brief Installs a prefetch script, replacing the script with the same name.
+ * A script without any command APDUs removes the script with the same name.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in,out] script Reference to a VALID `SCardPrefetchScript` object.
+ * On success, its contents are moved into the database
+ * (so the caller must NOT destroy it).
+ * @return `TRUE` on success, `FALSE` on memory allocation failure.
+ */
+extern BOOL
+SCardReaderDB_installPrefetchScript(
+  _Inout_ SCardReaderDB *database,
+  _Inout_ SCardPrefetchScript *script);
+
+/**
+ * @brief Finds the first prefetch script for a card in given reader.
+ *
+ * @param[in] database Reference to a VALID and CONSTANT `SCardReaderDB` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @return Reference to the matching script, or `NULL`.
+ */
+extern const SCardPrefetchScript *
+SCardReaderDB_findPrefetchScript(
+  _In_ const SCardReaderDB *database,
+  _In_ const size_t readerIndex);
+
+
+/**************************************************************/
+/* FAN-OUT (ONE SCRIPT, MANY READERS)                         */
+/**************************************************************/
+
+/** Most readers served by one fan-out request (one thread each). */
+#define WEBCARD_FANOUT_MAX_READERS  32
+
+/**
+ * `SCardFanOut` type definition.
+ */
+typedef struct SCardFanOut SCardFanOut;
+
+/**
+ * One reader of a fan-out: its worker thread and its responses.
+ */
+typedef struct SCardFanOutJob
+{
+  /** Dynamically-allocated name of the Smart Card Reader. */
+  LPTSTR readerName;
+
+  /**
+   * Zero-based index of the Smart Card Reader when the fan-out started
+   * (re-resolved by name when the job is reported, `SIZE_MAX` if gone).
+   */
+  size_t readerIndex;
+
+  /**
+   * Shared connection of this job, opened and closed by the worker thread
+   * through a Smart Card Context of its own (the ATR and serial number
+   * of the card are set by the main thread).
+   */
+  SCardConnection connection;
+
+  /** Number of successful exchanges (the script stops at the first failure). */
+  size_t responseCount;
+
+  /** Hex-string response APDUs (`responseCount` of them are valid). */
+  UTF8String responses[WEBCARD_PREFETCH_MAX_APDUS];
+
+  /** Has the worker thread been started (and must be joined)? */
+  BOOL started;
+
+  /** Has the worker thread finished? (protected by the fan-out mutex) */
+  BOOL finished;
+
+  /** Was this job already returned by `SCardFanOut_collect`? */
+  BOOL reported;
+
+  /** Worker thread. */
+  os_specific_thread_t thread;
+
+  /** Back-reference for the worker thread. */
+  SCardFanOut *fanOut;
+}
+SCardFanOutJob;
+
+/**
+ * Runs the command APDUs of one script on several readers at once,
+ * one worker thread per reader, so that the whole request takes as
+ * long as the slowest reader. The main thread keeps serving other
+ * requests meanwhile: it collects the finished readers on every turn
+ * of its loop. Workers only exchange APDUs through connections (and
+ * Smart Card Contexts) of their own: the APDU cache and the selections are updated by the
+ * main thread when the readers are collected.
+ */
+struct SCardFanOut
+{
+  /** Protects `finished` flags and `stopping`. */
+  os_specific_mutex_t mutex;
+
+  /** Command APDUs (read by every worker). */
+  SCardPrefetchScript script;
+
+  /** Dynamically-allocated value of the "i" key of the request. */
+  LPSTR id;
+
+  /** Session of the request (where the results go). */
+  uint32_t session;
+
+  /** Is every reader's result sent as soon as it is known? */
+  BOOL streamed;
+
+  /** Precise time when the request expires (`0`: no deadline). */
+  uint64_t deadline;
+
+  /** Workers send no more command APDUs (deadline passed). */
+  BOOL stopping;
+
+  /** Was the request already answered (or has its client gone away)? */
+  BOOL answered;
+
+  /**
+   * Is this the prefetch script of a newly inserted card? There is no
+   * request to answer: the "Card Insertion" event waits for the reader.
+   */
+  BOOL prefetch;
+
+  /** Transitions coalesced into that "Card Insertion" event. */
+  uint32_t suppressedCount;
+
+  /** Number of used `jobs`. */
+  size_t jobCount;
+
+  /** One job for every reader. */
+  SCardFanOutJob jobs[WEBCARD_FANOUT_MAX_READERS];
+
+  /** Next running fan-out (`NULL`: last one). */
+  SCardFanOut *next;
+};
+
+/**
+ * @brief `SCardFanOut` constructor.
+ *
+ * @param[out] fanOut Reference to an UNINITIALIZED `SCardFanOut` object.
+ */
+extern VOID
+SCardFanOut_init(
+  _Out_ SCardFanOut *fanOut);
+
+/**
+ * @brief `SCardFanOut` destructor: waits for the worker threads
+ * (which close their connections).
+ *
+ * @param[in,out] fanOut Reference to a VALID `SCardFanOut` object.
+ *
+ * @note After this call, `fanOut` should not be used (unless re-initialized).
+ */
+extern VOID
+SCardFanOut_destroy(
+  _Inout_ SCardFanOut *fanOut);
+
+/**
+ * @brief Adds a reader (before `SCardFanOut_start`). Its worker thread
+ * establishes a Smart Card Context of its own and connects to the card
+ * in shared mode (a card that cannot be connected gets no responses).
+ *
+ * @param[in,out] fanOut Reference to a VALID `SCardFanOut` object.
+ * @param[in] readerName Name of the Smart Card Reader.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @param[in] card Connection of the reader in the database
+ * (the ATR and serial number of its card are copied).
+ * @return `TRUE` on success, `FALSE` if there are too many readers
+ * OR on memory allocation failure.
+ */
+extern BOOL
+SCardFanOut_addReader(
+  _Inout_ SCardFanOut *fanOut,
+  _In_ LPCTSTR readerName,
+  _In_ const size_t readerIndex,
+  _In_ const SCardConnection *card);
+
+/**
+ * @brief Starts a worker thread for every reader. A reader whose
+ * thread could not be started is served by the calling thread.
+ *
+ * @param[in,out] fanOut Reference to a VALID `SCardFanOut` object.
+ */
+extern VOID
+SCardFanOut_start(
+  _Inout_ SCardFanOut *fanOut);
+
+/**
+ * @brief Makes the workers stop before their next command APDU.
+ *
+ * @param[in,out] fanOut Reference to a VALID `SCardFanOut` object.
+ */
+extern VOID
+SCardFanOut_stop(
+  _Inout_ SCardFanOut *fanOut);
+
+/**
+ * @brief Waits for every worker thread (after `SCardFanOut_stop`, they
+ * finish their current command APDU). The jobs are still collected.
+ *
+ * @param[in,out] fanOut Reference to a VALID `SCardFanOut` object.
+ */
+extern VOID
+SCardFanOut_wait(
+  _Inout_ SCardFanOut *fanOut);
+
+/**
+ * @brief Takes another finished reader (without waiting).
+ *
+ * @param[in,out] fanOut Reference to a VALID `SCardFanOut` object.
+ * @return Finished job (in the order of completion), or `NULL`
+ * when no other reader is done yet.
+ */
+extern SCardFanOutJob *
+SCardFanOut_collect(
+  _Inout_ SCardFanOut *fanOut);
+
+/**
+ * @brief Checks if every reader was returned by `SCardFanOut_collect`.
+ *
+ * @param[in] fanOut Reference to a VALID and CONSTANT `SCardFanOut` object.
+ * @return `TRUE` when the fan-out is over.
+ */
+extern BOOL
+SCardFanOut_isDone(
+  _In_ const SCardFanOut *fanOut);
+
+/**
+ * @brief Checks if a reader still belongs to the fan-out
+ * (not yet returned by `SCardFanOut_collect`).
+ *
+ * @param[in] fanOut Reference to a VALID and CONSTANT `SCardFanOut` object.
+ * @param[in] readerName Name of the Smart Card Reader.
+ * @return `TRUE` if the reader is busy with this fan-out.
+ */
+extern BOOL
+SCardFanOut_usesReader(
+  _In_ const SCardFanOut *fanOut,
+  _In_ LPCTSTR readerName);
+
+
+/**************************************************************/
+/* WEBCARD OPERATIONS                                         */
+/**************************************************************/
+
+/** Pause of the main loop while PC/SC is being initialized (or re-established), in microseconds. */
+#define WEBCARD_STARTUP_POLL_INTERVAL  1000
+
+/** Longest message that browsers accept from a Native App (bytes): longer responses are split. */
+#define WEBCARD_MESSAGE_MAX_SIZE  (1024 * 1024)
+
+/** Bytes of a split response carried by one fragment (at most twice as many once escaped). */
+#define WEBCARD_MESSAGE_FRAGMENT_SIZE  (256 * 1024)
+
+/**
+ * `WebCardStartup` type definition.
+ */
+typedef struct WebCardStartup WebCardStartup;
+
+/**
+ * Background initialization of PC/SC (`WebCard_init`), so that requests
+ * which do not need any reader are answered while it is in progress.
+ */
+struct WebCardStartup
+{
+  /** Guards `finished`. */
+  os_specific_mutex_t mutex;
+
+  /** Thread running `WebCard_init`. */
+  os_specific_thread_t thread;
+
+  /** `FALSE` when the thread could not be started. */
+  BOOL started;
+
+  /** Set by the thread when it is done. */
+  BOOL finished;
 
-#if defined(_DEBUG)
+  /** Result of `WebCard_init` (valid once `finished`). */
+  BOOL succeeded;
 
-  /**
-   * @brief Returns a string representation of a `WinSCard` Error Code.
-   *
-   * @param[in] errorCode Error Code returned by any of the `WinSCard` functions.
-   * @return Contant string (mapping number to a name).
-   */
-  extern LPCSTR
-  WebCard_errorLookup(
-    _In_ const PCSC_LONG errorCode);
+  /** Readers Database loaded by the thread (adopted by `WebCard_run`). */
+  SCardReaderDB database;
 
-#endif
+  /** Smart Card Context established by the thread. */
+  SCARDCONTEXT context;
+
+  /** When the thread was started (`OSSpecific_getMonotonicTime`). */
+  uint64_t startTime;
+};
+
+/**
+ * @brief Returns a string representation of a `WinSCard` Error Code.
+ *
+ * @param[in] errorCode Error Code returned by any of the `WinSCard` functions.
+ * @return Contant string (mapping number to a name).
+ */
+extern LPCSTR
+WebCard_errorLookup(
+  _In_ const PCSC_LONG errorCode);
 
 /**
  * @brief (Re)establishes the Smart Card Context.
@@ -331,21 +3791,76 @@ WebCard_establishContext(
  * @param[out] resultContext Pointer to an UNITIALIZED variable
  * of `SCARDCONTEXT` type (pointer to a handle that identifies
  * the resource manager context).
- * @return `TRUE` on successful initialization,
- * `FALSE` if any Smart Card error has occurred.
+ * @return `TRUE` on successful initialization (`resultContext` is `0`
+ * when the PC/SC service is not available: `WebCard_run` keeps trying
+ * to establish it), `FALSE` if the backend could not be selected
+ * or the list of readers could not be read.
  */
 extern BOOL
 WebCard_init(
   _Out_ SCardReaderDB *resultDatabase,
   _Out_ SCARDCONTEXT *resultContext);
 
+/**
+ * @brief Starts `WebCard_init` on a background thread.
+ *
+ * @param[out] startup Reference to an UNINITIALIZED `WebCardStartup` object.
+ * @return `TRUE` if the thread was started, `FALSE` otherwise.
+ * @note `WebCard_finishStartup` must be called until it stops returning
+ * `WEBCARD_STARTUP__PENDING`, even if this function has failed.
+ */
+extern BOOL
+WebCard_beginStartup(
+  _Out_ WebCardStartup *startup);
+
+/**
+ * @brief Checks if the background initialization is done, and if so,
+ * hands its Readers Database and Smart Card Context over to the main loop.
+ *
+ * @param[in,out] startup Reference to a `WebCardStartup` object
+ * passed to `WebCard_beginStartup`.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object
+ * used so far (empty list of readers). Its settings, statistics
+ * and request queue are kept.
+ * @param[out] context Pointer to a `SCARDCONTEXT` variable.
+ * @param[in] wait `TRUE` to wait for the thread to finish.
+ * @return `WEBCARD_STARTUP__PENDING` if the thread is still running,
+ * `WEBCARD_STARTUP__READY` on successful initialization,
+ * `WEBCARD_STARTUP__FAILED` if any Smart Card error has occurred.
+ * @note On failure, `database` and `context` are adopted as well,
+ * so that `WebCard_close` releases whatever was initialized.
+ */
+extern int
+WebCard_finishStartup(
+  _Inout_ WebCardStartup *startup,
+  _Inout_ SCardReaderDB *database,
+  _Out_ SCARDCONTEXT *context,
+  _In_ const BOOL wait);
+
 /**
  * @brief Enters the `WebCard` main loop.
  *
  * This function takes care of `WebCard_init` and `WebCard_close`.
+ * @param[in] daemonMode `TRUE` to serve the clients of a local socket
+ * (`SCardDaemon`) until none is left for `WEBCARD_DAEMON__IDLE_TIME`,
+ * `FALSE` to serve Standard Input until it is closed.
  */
 extern VOID
-WebCard_run(void);
+WebCard_run(
+  _In_ const BOOL daemonMode);
+
+/**
+ * @brief Cleans up after a client of the daemon that has gone away:
+ * its waiting requests are dropped, its readers released and its
+ * Reader Event subscriptions removed.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] session Session of the client.
+ */
+extern VOID
+WebCard_endSession(
+  _Inout_ SCardReaderDB *database,
+  _In_ const uint32_t session);
 
 /**
  * @brief Shuts down the `WebCard` NativeApp.
@@ -360,27 +3875,44 @@ WebCard_close(
   _In_ const SCARDCONTEXT context);
 
 /**
- * @brief Takes a stream of bytes, tries to create a JSON Object from it,
- * and then chooses appropriate path based on the JSON Request.
+ * @brief Takes a JSON Request read by the `SCardRequestQueue`, chooses
+ * appropriate path based on it and sends the JSON Response (unless the
+ * request has already been answered as timed out or cancelled).
  *
- * @param[in,out] jsonStream Reference to a valid (preloaded) stream of bytes,
- * from which the `jsonRequest` is constructed.
- * @param[out] jsonRequest Reference to an UNITIALIZED `JsonObject` variable
- * that will hold the JSON Request (input command).
+ * @param[in,out] request Request taken out of `database->requests`.
  * @param[out] jsonResponse Reference to an UNITIALIZED `JsonObject` variable
  * that will hold the JSON Response (output).
- * @param[in] database Reference to a VALID and CONSTANT `SCardReaderDB` object
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object
  * that holds the states of plugged-in Smart Card Readers.
  * @param[in] context A handle that identifies the resource manager context.
- * @note After this call, `jsonRequest` and `jsonResponse` will be initialized
- * and they must be released by the caller.
+ * @note After this call, `jsonResponse` will be initialized
+ * and it must be released by the caller (together with `request`).
  */
 extern VOID
 WebCard_handleRequest(
-  _Inout_ JsonByteStream *jsonStream,
-  _Out_ JsonObject *jsonRequest,
+  _Inout_ SCardQueuedRequest *request,
   _Out_ JsonObject *jsonResponse,
-  _In_ const SCardReaderDB *database,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context);
+
+/**
+ * @brief Executes a single WebCard command.
+ *
+ * @param[in] command Numeric command read from the `c` key.
+ * @param[in] jsonRequest Reference to the JSON Request (input command).
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject`
+ * that receives command-specific response keys.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object
+ * that holds the states of plugged-in Smart Card Readers.
+ * @param[in] context A handle that identifies the resource manager context.
+ * @return `TRUE` if the command succeeded, `FALSE` otherwise.
+ */
+extern BOOL
+WebCard_executeCommand(
+  _In_ const size_t command,
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
   _In_ const SCARDCONTEXT context);
 
 /**
@@ -508,17 +4040,48 @@ WebCard_pushReadersListToJsonResponse(
   _Inout_ JsonObject *jsonResponse,
   _In_ const SCardReaderDB *database);
 
+/**
+ * @brief Decides if a queued request can be handled now
+ * (`SCardRequestFilter` of `SCardRequestQueue_pop`): the Connect and
+ * Transceive commands wait while another client owns their reader.
+ *
+ * @param[in] request Request waiting in the queue.
+ * @param[in] parameter Reference to a VALID and CONSTANT `SCardReaderDB` object.
+ * @return `TRUE` if the request can be handled now, otherwise `FALSE`.
+ */
+extern BOOL
+WebCard_isRequestRunnable(
+  _In_ const SCardQueuedRequest *request,
+  _In_opt_ const void *parameter);
+
+/**
+ * @brief Decides which requests can run while PC/SC is being initialized
+ * (`SCardRequestFilter` used by `WebCard_run`): those that do not need
+ * any reader, such as Get Version or an unknown command (ping).
+ *
+ * @param[in] request Waiting request.
+ * @param[in] parameter Not used.
+ * @return `TRUE` if the request can be handled now.
+ */
+extern BOOL
+WebCard_isRequestRunnableEarly(
+  _In_ const SCardQueuedRequest *request,
+  _In_opt_ const void *parameter);
+
 /**
  * @brief Executes one of the main WebCard commands, which attempts
  * to establish a connection from OS to the selected Smart Card Reader.
  *
+ * The connecting client (optional "k" key) owns the reader until it
+ * disconnects.
+ *
  * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
  * that contains the Smart Card Reader Index ("r") key
  * and the optional Share Mode parameter ("p") key.
  * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
  * that will hold the reader's ATR attribute (if any card is inserted,
  * otherwise empty text) under the predefined "d" (data) key.
- * @param[in] database Reference to a VALID and CONSTANT `SCardReaderDB` object
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object
  * that holds the states of plugged-in Smart Card Readers.
  * @param[in] context A handle that identifies the resource manager context.
  * @return `TRUE` when a connection was successfully established,
@@ -528,24 +4091,27 @@ extern BOOL
 WebCard_tryConnectingToReader(
   _In_ const JsonObject *jsonRequest,
   _Inout_ JsonObject *jsonResponse,
-  _In_ const SCardReaderDB *database,
+  _Inout_ SCardReaderDB *database,
   _In_ const SCARDCONTEXT context);
 
 /**
  * @brief Executes one of the main WebCard commands, which attempts
  * to close the connection from OS to the selected Smart Card Reader.
+ * Connections owned by other clients are left open. With a linger time
+ * set, the connection stays open (unowned) for a while, to be reused.
  *
  * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
- * that contains the Smart Card Reader Index ("r") key.
- * @param[in] database Reference to a VALID and CONSTANT `SCardReaderDB` object
+ * that contains the Smart Card Reader Index ("r") key and the optional
+ * client key ("k"). Without "r", all readers owned by "k" are released.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object
  * that holds the states of plugged-in Smart Card Readers.
- * @return `TRUE` when the connection was closed,
- * `FALSE` on invalid parameters.
+ * @return `TRUE` when the connection was closed (or is not owned
+ * by this client), `FALSE` on invalid parameters.
  */
 extern BOOL
 WebCard_tryDisconnectingFromReader(
   _In_ const JsonObject *jsonRequest,
-  _In_ const SCardReaderDB *database);
+  _Inout_ SCardReaderDB *database);
 
 /**
  * @brief Executes one of the main WebCard commands, which attempts to transmit
@@ -556,8 +4122,9 @@ WebCard_tryDisconnectingFromReader(
  * Application Prodotol Data Unit ("APDU") hex-string under the "a" key.
  * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
  * that will hold the Smart Card's APDU response under the "d" (data) key.
- * @param[in] database Reference to a VALID and CONSTANT `SCardReaderDB` object
- * that holds the states of plugged-in Smart Card Readers.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object
+ * that holds the states of plugged-in Smart Card Readers
+ * (and the APDU response cache).
  * @return `TRUE` on success, `FALSE` on invalid parameters
  * OR on memory allocation error OR on any internal Smart Card error.
  */
@@ -565,7 +4132,7 @@ extern BOOL
 WebCard_transmitAndReceive(
   _In_ const JsonObject *jsonRequest,
   _Inout_ JsonObject *jsonResponse,
-  _In_ const SCardReaderDB *database);
+  _Inout_ SCardReaderDB *database);
 
 /**
  * @brief Sends selected Reader Event to the Standard Output.
@@ -589,9 +4156,18 @@ WebCard_transmitAndReceive(
  * @param[out] jsonResponse Reference to an UNITIALIZED `JsonObject` variable
  * that will hold the JSON Response (output).
  * @param[in] jsonEventDetails Reference to a VALID and CONSTANT `JsonArray`
- * object, that holds the names of affected Smard Card Readers. It has
- * no meaning for events other than "More Readers" and "Less Readers".
+ * object, that holds the names of affected Smard Card Readers
+ * ("More Readers" and "Less Readers" events, key "n"), or the responses
+ * of a prefetch script ("Card Insertion" event, key "p").
  * This parameter is optional (can be `NULL`).
+ * @param[in] detailsIncomplete Was the prefetch script cut short?
+ * (key "x", "Card Insertion" event with prefetch responses only)
+ * @param[in] suppressedCount Number of transitions that were coalesced
+ * into this Card Event by the debounce logic. Sent only when non-zero.
+ * @param[in] jsonClientKeys Reference to a VALID and CONSTANT `JsonArray`
+ * object, that holds the keys of subscribed clients ("k").
+ * This parameter is optional (can be `NULL` or empty).
+ * @param[in] session Session that receives the event.
  *
  * @note `jsonResponse` must be released by the caller.
  */
@@ -601,7 +4177,374 @@ WebCard_sendReaderEvent(
   _In_ const size_t readerIndex,
   _In_ const int readerEvent,
   _Out_ JsonObject *jsonResponse,
-  _In_opt_ const JsonArray *jsonEventDetails);
+  _In_opt_ const JsonArray *jsonEventDetails,
+  _In_ const BOOL detailsIncomplete,
+  _In_ const uint32_t suppressedCount,
+  _In_opt_ const JsonArray *jsonClientKeys,
+  _In_ const uint32_t session);
+
+/**
+ * @brief Executes one of the WebCard commands, which changes and/or reads
+ * the debounce settings of Card Events.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional Smart Card Reader Index ("r") key
+ * (if missing, the Database-wide default is selected) and the optional
+ * debounce window in milliseconds ("p") key (if missing, nothing changes).
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold, under the "d" (data) key, an array with the effective
+ * window ("w") and the number of suppressed transitions ("s") of each reader.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on memory allocation error.
+ */
+extern BOOL
+WebCard_configureDebounce(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which registers
+ * (or replaces) the Reader Event subscription of one client.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * with the subscription filters (see `SCardSubscription_load`).
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on memory allocation error.
+ */
+extern BOOL
+WebCard_subscribeToEvents(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which removes
+ * the Reader Event subscription of one client ("k" key).
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid parameters.
+ */
+extern BOOL
+WebCard_unsubscribeFromEvents(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Sends a command APDU to a connected card, unless its response
+ * can be served from the APDU cache (which is updated accordingly).
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] readerIndex Zero-based index of a CONNECTED Smart Card Reader.
+ * @param[in] apdu Command APDU.
+ * @param[in] apduLength The length of `apdu` buffer, in bytes.
+ * @param[out] outputBuffer Work buffer of `MAX_APDU_SIZE` bytes.
+ * @param[in,out] hexStringResult Reference to a VALID `UTF8String` object,
+ * to which the response APDU will be appended (as a hex-string).
+ * @return `TRUE` on success, `FALSE` on memory allocation error
+ * OR on any internal Smart Card error.
+ */
+extern BOOL
+WebCard_transceiveThroughCache(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const BYTE *apdu,
+  _In_ const size_t apduLength,
+  _Out_ BYTE *outputBuffer,
+  _Inout_ UTF8String *hexStringResult);
+
+/**
+ * @brief Executes one of the WebCard commands, which configures
+ * the APDU response cache and reads its statistics.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional byte budget ("p") key (`0` disables the cache)
+ * and the optional hex-string of cacheable instruction bytes ("a") key.
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold the cache statistics under the "d" (data) key.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on memory allocation error.
+ */
+extern BOOL
+WebCard_configureApduCache(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which configures
+ * the persistent card data cache (kept across sessions) and reads its statistics.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional file size ("p") key (`0` disables the cache
+ * and deletes the file), the optional serial-number command ("a") key
+ * and the optional record lifetime in seconds ("l") key.
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold the cache statistics under the "d" (data) key.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on file-system error OR on memory allocation error.
+ */
+extern BOOL
+WebCard_configureCardCache(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which installs
+ * (or removes) a prefetch script for newly inserted cards.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * (see `SCardPrefetchScript_load` for the expected keys).
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on memory allocation error.
+ */
+extern BOOL
+WebCard_registerPrefetchScript(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which reports the latency
+ * statistics of every command stage and of every reader.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional reset ("z") key (non-zero number clears
+ * the statistics after reporting them).
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold the statistics under the "d" (data) key: "t" (milliseconds
+ * since the last reset), "c" (per-command histograms of every stage)
+ * and "r" (per-reader histograms of `SCardTransmit` calls).
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on memory allocation error.
+ */
+extern BOOL
+WebCard_reportStatistics(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which starts or stops
+ * the APDU trace.
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional "p" key (size of the trace file in bytes,
+ * `0` stops tracing). Without "p", only the trace usage is reported.
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold the trace usage under the "d" (data) key:
+ * `{p: file size, b: used bytes, n: records written, x: records overwritten}`.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid request OR on file-system
+ * error OR on memory allocation error.
+ */
+extern BOOL
+WebCard_configureTrace(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which sets how long
+ * the connections stay open after a disconnect (to be reused).
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional "p" key (linger time in milliseconds,
+ * `0` disables lingering). Without "p", only the current state is reported.
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold the linger state under the "d" (data) key:
+ * `{p: linger time, n: lingering connections, h: reused, m: connected,
+ * x: closed early}`.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @return `TRUE` on success, `FALSE` on invalid request OR on memory
+ * allocation error.
+ */
+extern BOOL
+WebCard_configureLinger(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Executes one of the WebCard commands, which changes
+ * the log level of the Native App (messages written to `STDERR`).
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional "p" key (log level, from `0` (off) to `5` (trace)).
+ * Without "p", only the current level is reported.
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold the logger state under the "d" (data) key:
+ * `{p: log level, x: messages dropped}`.
+ * @return `TRUE` on success, `FALSE` on invalid request OR on memory
+ * allocation error.
+ */
+extern BOOL
+WebCard_configureLogging(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse);
+
+/**
+ * @brief Executes one of the WebCard commands, which starts sending
+ * the same command APDUs to many readers at once (one thread per reader,
+ * each with a PC/SC context and a shared connection of its own).
+ * The request is answered
+ * by `WebCard_collectFanOuts`, once every reader is done.
+ *
+ * Readers without a card, readers whose card does not match the ATR
+ * pattern, readers used by other clients (or by another fan-out), and
+ * readers that cannot be connected in shared mode are skipped.
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the "d" key (array of hex-string command APDUs), and the
+ * optional keys "r" (array of reader indices), "a" and "m" (ATR pattern
+ * and ATR mask, hex-strings) and "s" (non-zero: streamed results).
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * (left as it is: the response is sent later).
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * The new fan-out is placed at the head of its running fan-outs.
+ * @param[in] context A handle that identifies the resource manager context.
+ * @return `TRUE` when the fan-out has started, `FALSE` on invalid
+ * parameters OR on memory allocation error.
+ */
+extern BOOL
+WebCard_fanOut(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context);
+
+/**
+ * @brief Executes one of the WebCard commands, which configures
+ * the production line: a job script, the readers that take part
+ * and a queue of jobs. Every card inserted into one of these readers
+ * gets the next job at once (see `SCardJobQueue_configure`).
+ *
+ * @param[in] jsonRequest Reference to a VALID and CONSTANT `JsonObject` object
+ * that contains the optional keys "d" (job script), "r", "a" and "m"
+ * (reader and card filters), "j" (jobs to queue), "x" (non-zero: drop
+ * the waiting jobs) and "z" (non-zero: reset the counters after reporting).
+ * @param[in,out] jsonResponse Reference to a VALID `JsonObject` object
+ * that will hold the state of the production line under the "d" (data)
+ * key: `{p: waiting jobs, b: busy readers, n: jobs done, f: failed jobs,
+ * h: cards per hour, k: number of the first queued job, r: [{n: reader
+ * name, j: jobs, f: failures, t: busy time in milliseconds, u: busy time
+ * in percents of the time since the first job}]}`.
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] context A handle that identifies the resource manager context.
+ * @return `TRUE` on success, `FALSE` on invalid parameters
+ * OR on memory allocation error.
+ */
+extern BOOL
+WebCard_configureJobs(
+  _In_ const JsonObject *jsonRequest,
+  _Inout_ JsonObject *jsonResponse,
+  _Inout_ SCardReaderDB *database,
+  _In_ const SCARDCONTEXT context);
+
+/**
+ * @brief Reports the readers of running fan-outs that are done, and
+ * answers every fan-out request that is over: with the per-reader results
+ * (`{r: reader index, d: [response APDUs]}`, marked "incomplete" when
+ * a transmission has failed, "r" omitted when the reader is gone) under
+ * the "d" (data) key, in the order of the readers. Streamed results are
+ * sent one by one, as soon as each reader is done, under the "u" key of
+ * extra messages with the same "i" key, and the response only holds the
+ * number of readers under "n". A fan-out still running at its deadline
+ * is answered as timed out, and its readers stop before the next APDU.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ */
+extern VOID
+WebCard_collectFanOuts(
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Reports the production-line jobs that are done (the "Job Done"
+ * Reader Event, with `{j: job number, d: [response APDUs], t: time
+ * in milliseconds}`, marked "incomplete" when the job has failed),
+ * then gives the waiting jobs to the cards that are still waiting.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ */
+extern VOID
+WebCard_collectJobs(
+  _Inout_ SCardReaderDB *database);
+
+/**
+ * @brief Starts the prefetch script that matches a newly inserted card,
+ * as a fan-out to that reader alone: a worker thread connects to the card
+ * (in shared mode, through a Smart Card Context of its own) and sends every
+ * command APDU. The "Card Insertion" event is published when the worker
+ * is collected (see `WebCard_collectFanOuts`), with the responses.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] readerIndex Zero-based index of the Smart Card Reader.
+ * @param[in] suppressedCount Transitions coalesced into the event.
+ * @return `TRUE` if the script was started (the event waits for it),
+ * `FALSE` if there is no script for this card (OR on memory allocation
+ * failure).
+ */
+extern BOOL
+WebCard_startPrefetch(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const uint32_t suppressedCount);
+
+/**
+ * @brief Sends a Reader Event, but only if any client has subscribed to it
+ * (otherwise the JSON message is not even built).
+ * The "Card Insertion" event carries the results of a matching prefetch
+ * script: it is sent later, once the script is done (the other Card Events
+ * of that reader wait for it).
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] readerIndex Zero-based index that identifies Smart Card Reader
+ * (only for "Card Insertion" and "Card Removal" events).
+ * @param[in] readerEvent Type of the Reader Event.
+ * @param[in] jsonEventDetails Names of affected Smart Card Readers
+ * (only for "More Readers" and "Less Readers" events, otherwise `NULL`).
+ * @param[in] suppressedCount Number of transitions coalesced into this event.
+ */
+extern VOID
+WebCard_publishReaderEvent(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _In_opt_ const JsonArray *jsonEventDetails,
+  _In_ const uint32_t suppressedCount);
+
+/**
+ * @brief Passes a detected Card Event through the debounce logic
+ * of given reader: the event is either sent immediately,
+ * or it becomes the pending (not yet settled) state of that reader.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] readerIndex Zero-based index that identifies Smart Card Reader.
+ * @param[in] readerEvent Either "Card Insertion" or "Card Removal".
+ * @param[in] now Current monotonic time (in milliseconds).
+ */
+extern VOID
+WebCard_debounceCardEvent(
+  _Inout_ SCardReaderDB *database,
+  _In_ const size_t readerIndex,
+  _In_ const int readerEvent,
+  _In_ const uint64_t now);
+
+/**
+ * @brief Sends the settled Card Events of readers,
+ * whose debounce windows have already expired.
+ *
+ * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
+ * @param[in] now Current monotonic time (in milliseconds).
+ */
+extern VOID
+WebCard_flushSettledCardEvents(
+  _Inout_ SCardReaderDB *database,
+  _In_ const uint64_t now);
 
 /**
  * @brief Checks if any Reader changed status (ICC connected/disconnected),
@@ -609,8 +4552,10 @@ WebCard_sendReaderEvent(
  *
  * @param[in,out] database Reference to a VALID `SCardReaderDB` object.
  * @param[in] context A handle that identifies the resource manager context.
+ * @return `FALSE` if the context has been lost (see `SCardRecovery`),
+ * otherwise `TRUE`.
  */
-extern VOID
+extern BOOL
 WebCard_handleStatusChange(
   _Inout_ SCardReaderDB *database,
   _In_ const SCARDCONTEXT context);
@@ -268,6 +268,14 @@ UTF8String_matches(
 
 /**************************************************************/
 
+/**
+ * Messages are written by more than one thread: the length prefix
+ * and the text must not be interleaved with another message.
+ */
+static os_specific_mutex_t UTF8String_outputMutex = OS_SPECIFIC_MUTEX_INITIALIZER;
+
+/**************************************************************/
+
 BOOL
 UTF8String_writeToStandardOutput(
   _In_ const UTF8String *string)
@@ -289,19 +297,49 @@ UTF8String_writeToStandardOutput(
   }
   #endif
 
+  OSSpecific_lockMutex(&(UTF8String_outputMutex));
+
+  BOOL test_bool = UTF8String_writeToStream(
+    string,
+    stdout_stream);
+
+  OSSpecific_unlockMutex(&(UTF8String_outputMutex));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+UTF8String_writeToStream(
+  _In_ const UTF8String *string,
+  _In_ const os_specific_stream_t output)
+{
   uint32_t outgoing_length = string->length;
 
+  OSSpecific_probe1(
+    stdout__start,
+    outgoing_length);
+
   BOOL test_bool = OSSpecific_writeBytesToStream(
-    stdout_stream,
+    output,
     &(outgoing_length),
     sizeof(uint32_t));
 
-  if (!test_bool) { return FALSE; }
+  if (test_bool)
+  {
+    test_bool = OSSpecific_writeBytesToStream(
+      output,
+      string->text,
+      string->length);
+  }
+
+  OSSpecific_probe2(
+    stdout__done,
+    outgoing_length,
+    test_bool);
 
-  return OSSpecific_writeBytesToStream(
-    stdout_stream,
-    string->text,
-    string->length);
+  return test_bool;
 }
 
 /**************************************************************/
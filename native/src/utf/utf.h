@@ -180,6 +180,7 @@ UTF8String_matches(
  *
  * This method first stores the string length (32-bit integer),
  * then stores the text buffer contents (without the NULL-terminator).
+ * Messages written from different threads are never interleaved.
  * @param[in] string Reference to a VALID and CONSTANT `UTF8String` object.
  * @return `TRUE` on success, `FALSE` if the stream-writing functions failed.
  */
@@ -187,6 +188,22 @@ extern BOOL
 UTF8String_writeToStandardOutput(
   _In_ const UTF8String *string);
 
+/**
+ * @brief Sends the string to any stream, with the framing of
+ * Standard Output (e.g. to a local socket).
+ *
+ * @param[in] string Reference to a VALID and CONSTANT `UTF8String` object.
+ * @param[in] output OS-specific stream descriptor, open for writing.
+ * @return `TRUE` on success, `FALSE` if the stream-writing functions failed.
+ *
+ * @note Not synchronized: threads writing to the same stream
+ * must hold a common lock.
+ */
+extern BOOL
+UTF8String_writeToStream(
+  _In_ const UTF8String *string,
+  _In_ const os_specific_stream_t output);
+
 
 /**************************************************************/
 /* UTF-16 STRING                                              */
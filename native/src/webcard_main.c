@@ -41,19 +41,51 @@ validateInputOutputPipes(void)
 
 /**************************************************************/
 
+BOOL
+isDaemonRequested(
+  _In_ int argc,
+  _In_ char *argv[])
+{
+  /* Browsers pass the extension's origin (and more) as arguments */
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (0 == strcmp(argv[i], "--daemon"))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**************************************************************/
+
 int
-main(void)
+main(int argc, char *argv[])
 {
-  if (!validateInputOutputPipes())
+  BOOL daemonMode;
+
+  OSSpecific_initLogger();
+
+  /* Shared Native App (Linux and macOS): clients connect */
+  /* through a local socket, no pipes to validate */
+
+  daemonMode = isDaemonRequested(argc, argv);
+
+  if ((!daemonMode) && (!validateInputOutputPipes()))
   {
+    OSSpecific_destroyLogger();
     return EXIT_FAILURE;
   }
 
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "Starting {WebCard Native App}%s",
+    daemonMode ? " (daemon)" : "");
+
   #if defined(_DEBUG)
   {
-    OSSpecific_writeDebugMessage(
-      "Starting {WebCard Native App}");
-
     volatile BOOL debuggerAttached = FALSE;
 
     #if defined(_WIN32)
@@ -90,14 +122,13 @@ main(void)
   }
   #endif
 
-  WebCard_run();
+  WebCard_run(daemonMode);
 
-  #if defined(_DEBUG)
-  {
-    OSSpecific_writeDebugMessage(
-      "{ WebCard Native App } shutting down");
-  }
-  #endif
+  OSSpecific_writeLogMessage(
+    OS_SPECIFIC_LOG__INFO,
+    "{ WebCard Native App } shutting down");
+
+  OSSpecific_destroyLogger();
 
   return EXIT_SUCCESS;
 }
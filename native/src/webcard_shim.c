@@ -0,0 +1,251 @@
+/**
+ * @file "native/src/webcard_shim.c"
+ * WebCard Native App :: Shim for the shared (daemon) mode
+ *
+ * Registered as the Native Messaging host instead of "webcard":
+ * relays the framed messages of the browser (STDIN/STDOUT) to the
+ * local socket of a long-lived "webcard --daemon", starting the
+ * daemon when nobody listens yet. Messages are copied byte-for-byte
+ * (both ends use the same framing), so the shim knows nothing
+ * about their contents.
+ */
+
+#include "os_specific/os_specific.h"
+
+#if defined(_WIN32)
+  #error("WIN32 not supported yet!")
+  #pragma GCC error "WIN32 not supported yet!"
+#endif
+
+/** Name of the Native App, next to the shim (set by the makefile). */
+#ifndef WEBCARD_SHIM_TARGET
+  #define WEBCARD_SHIM_TARGET  "webcard"
+#endif
+
+/** How long a newly started daemon may take to listen (milliseconds). */
+#define WEBCARD_SHIM_START_TIME  2000
+
+/** Pause between the attempts to connect (microseconds). */
+#define WEBCARD_SHIM_RETRY_INTERVAL  10000
+
+/** Most bytes copied at once. */
+#define WEBCARD_SHIM_BUFFER_SIZE  65536
+
+/**************************************************************/
+
+/**
+ * @brief Builds the path of the Native App from the path of the shim.
+ *
+ * @param[out] output Buffer of `size` characters.
+ * @param[in] size Size of the `output` buffer.
+ * @param[in] shimPath `argv[0]` (browsers use the absolute path
+ * from the host manifest).
+ * @return `TRUE` on success, `FALSE` if the path is too long.
+ */
+BOOL
+getTargetPath(
+  _Out_ char *output,
+  _In_ const size_t size,
+  _In_z_ LPCSTR shimPath)
+{
+  int length;
+  const char *slash = strrchr(shimPath, '/');
+
+  if (NULL == slash)
+  {
+    length = snprintf(output, size, "./%s", WEBCARD_SHIM_TARGET);
+  }
+  else
+  {
+    length = snprintf(
+      output,
+      size,
+      "%.*s/%s",
+      (int) (slash - shimPath),
+      shimPath,
+      WEBCARD_SHIM_TARGET);
+  }
+
+  return ((length > 0) && ((size_t) length < size));
+}
+
+/**************************************************************/
+
+/**
+ * @brief Starts the Native App in daemon mode, detached from
+ * the browser (new session, no inherited pipes).
+ *
+ * @param[in] targetPath Path of the Native App.
+ */
+VOID
+startDaemon(
+  _In_z_ LPCSTR targetPath)
+{
+  int null_device;
+  pid_t pid = fork();
+
+  if (0 != pid)
+  {
+    if ((-1) == pid)
+    {
+      OSSpecific_writeLogMessage(
+        OS_SPECIFIC_LOG__ERROR,
+        "{fork} failed: errno=0x%08X",
+        errno);
+    }
+
+    /* Not waited for: it outlives the shim */
+    return;
+  }
+
+  setsid();
+
+  /* Browser must see the end of its pipes when the shim exits */
+
+  null_device = open("/dev/null", O_RDWR);
+
+  if ((-1) != null_device)
+  {
+    dup2(null_device, STDIN_FILENO);
+    dup2(null_device, STDOUT_FILENO);
+    dup2(null_device, STDERR_FILENO);
+
+    if (null_device > STDERR_FILENO)
+    {
+      close(null_device);
+    }
+  }
+
+  execl(targetPath, targetPath, "--daemon", (char *) NULL);
+  _exit(EXIT_FAILURE);
+}
+
+/**************************************************************/
+
+/**
+ * @brief Copies the bytes available on one stream to another.
+ *
+ * @return `FALSE` when either stream has ended or failed.
+ */
+BOOL
+relayBytes(
+  _In_ const os_specific_stream_t input,
+  _In_ const os_specific_stream_t output,
+  _Out_ BYTE *buffer)
+{
+  uint32_t available;
+
+  if (!OSSpecific_peekStream(input, &(available)))
+  {
+    return FALSE;
+  }
+
+  if (0 == available)
+  {
+    return TRUE;
+  }
+
+  if (available > WEBCARD_SHIM_BUFFER_SIZE)
+  {
+    available = WEBCARD_SHIM_BUFFER_SIZE;
+  }
+
+  return OSSpecific_readBytesFromStream(input, buffer, available) &&
+    OSSpecific_writeBytesToStream(output, buffer, available);
+}
+
+/**************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+  BOOL test_bool;
+  uint64_t give_up_time;
+  os_specific_stream_t daemon_stream;
+  char target_path[1024];
+  static BYTE buffer[WEBCARD_SHIM_BUFFER_SIZE];
+
+  struct pollfd fds[2];
+
+  OSSpecific_initLogger();
+
+  if ((argc < 1) || !getTargetPath(target_path, sizeof(target_path), argv[0]))
+  {
+    OSSpecific_destroyLogger();
+    return EXIT_FAILURE;
+  }
+
+  /* Usually the daemon is already running */
+
+  test_bool = OSSpecific_connectLocalSocket(&(daemon_stream));
+
+  if (!test_bool)
+  {
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__INFO,
+      "{WebCard Shim} starting \"%s --daemon\"",
+      target_path);
+
+    startDaemon(target_path);
+
+    give_up_time = OSSpecific_getMonotonicTime() + WEBCARD_SHIM_START_TIME;
+
+    while ((!test_bool) && (OSSpecific_getMonotonicTime() < give_up_time))
+    {
+      OSSpecific_sleep(WEBCARD_SHIM_RETRY_INTERVAL);
+      test_bool = OSSpecific_connectLocalSocket(&(daemon_stream));
+    }
+  }
+
+  if (!test_bool)
+  {
+    /* Without a daemon, this browser gets a Native App of its own */
+
+    OSSpecific_writeLogMessage(
+      OS_SPECIFIC_LOG__WARNING,
+      "{WebCard Shim} daemon not available, running \"%s\"",
+      target_path);
+
+    OSSpecific_destroyLogger();
+
+    argv[0] = target_path;
+    execv(target_path, argv);
+
+    return EXIT_FAILURE;
+  }
+
+  /* Relay until either side goes away */
+
+  fds[0].fd = STDIN_FILENO;
+  fds[0].events = POLLIN;
+  fds[1].fd = daemon_stream;
+  fds[1].events = POLLIN;
+
+  test_bool = TRUE;
+
+  while (test_bool)
+  {
+    if ((-1) == poll(fds, 2, (-1)))
+    {
+      test_bool = (EINTR == errno);
+      continue;
+    }
+
+    if (0 != fds[0].revents)
+    {
+      test_bool = relayBytes(STDIN_FILENO, daemon_stream, buffer);
+    }
+
+    if (test_bool && (0 != fds[1].revents))
+    {
+      test_bool = relayBytes(daemon_stream, STDOUT_FILENO, buffer);
+    }
+  }
+
+  OSSpecific_closeStream(daemon_stream);
+  OSSpecific_destroyLogger();
+
+  return EXIT_SUCCESS;
+}
+
+/**************************************************************/
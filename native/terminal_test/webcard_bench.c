@@ -0,0 +1,822 @@
+/**
+ * @file "native/terminal_test/webcard_bench.c"
+ * Microbenchmarks for the "json" and "utf" libraries.
+ *
+ * Every benchmark runs on a realistic Native Messaging payload
+ * (transceive requests and responses with 5 B to 64 KB APDUs,
+ * reader lists with 1 to 256 readers, reader events) and reports
+ * ns/op, bytes/s and allocations/op. Results can be saved as JSON
+ * ("-o" option) and compared against a stored baseline ("-b" option).
+ */
+
+#include "json/json.h"
+
+#if defined(_WIN32)
+
+  #include <windows.h>
+
+#elif defined(__linux__) || defined(__APPLE__)
+
+  #include <time.h>  /* clock_gettime */
+
+#else
+  #error("Unsupported Operating System, sorry!")
+  #pragma GCC error "Unsupported Operating System, sorry!"
+#endif
+
+/**************************************************************/
+
+/** Default minimal measurement time of one benchmark. */
+#define BENCH_MIN_TIME_MS  200
+
+#define BENCH_MAX_COUNT  64
+
+#define BENCH_NAME_LENGTH  64
+
+/**************************************************************/
+
+/**
+ * Allocation counting: every `malloc`, `calloc` and `realloc`
+ * call is redirected by the linker ("--wrap" option, GNU ld).
+ */
+
+#if defined(BENCH_COUNT_ALLOCATIONS)
+
+  extern void *__real_malloc(size_t size);
+  extern void *__real_calloc(size_t count, size_t size);
+  extern void *__real_realloc(void *pointer, size_t size);
+
+  static uint64_t bench_allocations = 0;
+
+  void *
+  __wrap_malloc(size_t size)
+  {
+    bench_allocations += 1;
+    return __real_malloc(size);
+  }
+
+  void *
+  __wrap_calloc(size_t count, size_t size)
+  {
+    bench_allocations += 1;
+    return __real_calloc(count, size);
+  }
+
+  void *
+  __wrap_realloc(void *pointer, size_t size)
+  {
+    bench_allocations += 1;
+    return __real_realloc(pointer, size);
+  }
+
+#endif
+
+/**************************************************************/
+
+typedef struct bench_t bench_t;
+
+struct bench_t
+{
+  char name[BENCH_NAME_LENGTH];
+
+  /** Runs one operation, returns `FALSE` on failure. */
+  BOOL (*run)(bench_t *bench);
+
+  /** Bytes processed by one operation (input or output). */
+  size_t bytes;
+
+  /** Input: stringified JSON, text, or byte array. */
+  UTF8String text;
+  BYTE *data;
+  size_t data_length;
+  UTF16String wide_text;
+
+  /** Input of the serialization benchmarks. */
+  JsonObject object;
+
+  /** Results */
+  uint64_t iterations;
+  double ns_per_op;
+  double bytes_per_s;
+  double allocs_per_op;
+};
+
+static bench_t benches[BENCH_MAX_COUNT];
+static size_t bench_count = 0;
+
+/** Example reader name and ATR, as reported by "PCSC Lite". */
+#define BENCH_READER_NAME  "ACS ACR1252 Dual Reader [ACR1252 Dual Reader PICC] 00 00"
+#define BENCH_READER_ATR   "3B8F8001804F0CA000000306030001000000006A"
+
+/**************************************************************/
+
+uint64_t
+now_ns(void)
+{
+  #if defined(_WIN32)
+  {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&(frequency));
+    QueryPerformanceCounter(&(counter));
+
+    return (uint64_t) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+  }
+  #else
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &(now));
+    return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+  }
+  #endif
+}
+
+/**************************************************************/
+
+/**
+ * Points a `JsonByteStream` at a read-only text (nothing to destroy).
+ */
+void
+stream_from_text(JsonByteStream *stream, const UTF8String *text)
+{
+  stream->head = text->text;
+  stream->head_length = text->length;
+  stream->tail = text->text;
+  stream->tail_length = text->length;
+}
+
+/**************************************************************/
+
+/**
+ * Fills `length` pseudo-random bytes (repeatable between runs).
+ */
+void
+fill_bytes(BYTE *bytes, size_t length)
+{
+  uint32_t state = 0x12345678;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    state = (state * 1103515245) + 12345;
+    bytes[i] = (BYTE) (state >> 16);
+  }
+}
+
+/**************************************************************/
+
+bench_t *
+add_bench(BOOL (*run)(bench_t *), const char *format, size_t parameter)
+{
+  bench_t *bench;
+
+  if (bench_count >= BENCH_MAX_COUNT) { return NULL; }
+
+  bench = &(benches[bench_count]);
+  bench_count += 1;
+
+  memset(bench, 0x00, sizeof(bench_t));
+  snprintf(bench->name, BENCH_NAME_LENGTH, format, parameter);
+
+  bench->run = run;
+  UTF8String_init(&(bench->text));
+  UTF16String_init(&(bench->wide_text));
+  JsonObject_init(&(bench->object));
+
+  return bench;
+}
+
+/**************************************************************/
+
+BOOL
+run_object_parse(bench_t *bench)
+{
+  JsonByteStream stream;
+  JsonObject object;
+  JsonObject *object_ptr = &(object);
+  BOOL test_bool;
+
+  stream_from_text(&(stream), &(bench->text));
+
+  test_bool = JsonObject_parse(&(object_ptr), FALSE, &(stream));
+
+  JsonObject_destroy(&(object));
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+run_object_to_string(bench_t *bench)
+{
+  UTF8String output;
+  BOOL test_bool;
+
+  UTF8String_init(&(output));
+
+  test_bool = JsonObject_toString(&(bench->object), &(output));
+
+  UTF8String_destroy(&(output));
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+run_string_parse(bench_t *bench)
+{
+  JsonByteStream stream;
+  UTF8String string;
+  UTF8String *string_ptr = &(string);
+  BOOL test_bool;
+
+  stream_from_text(&(stream), &(bench->text));
+
+  test_bool = JsonString_parse(&(string_ptr), FALSE, &(stream));
+
+  UTF8String_destroy(&(string));
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+run_push_bytes_as_hex(bench_t *bench)
+{
+  UTF8String output;
+  BOOL test_bool;
+
+  UTF8String_init(&(output));
+
+  test_bool = UTF8String_pushBytesAsHex(&(output), bench->data_length, bench->data);
+
+  UTF8String_destroy(&(output));
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+run_hex_to_byte_array(bench_t *bench)
+{
+  BYTE *bytes = NULL;
+  size_t bytes_length;
+  BOOL test_bool;
+
+  test_bool = UTF8String_hexToByteArray(&(bench->text), &(bytes_length), &(bytes));
+
+  free(bytes);
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+run_utf16_to_utf8(bench_t *bench)
+{
+  UTF8String output;
+  BOOL test_bool;
+
+  UTF8String_init(&(output));
+
+  test_bool = UTF16String_toUTF8(&(bench->wide_text), &(output));
+
+  UTF8String_destroy(&(output));
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * Builds the stringified transceive request or response
+ * for an APDU of `apdu_length` bytes.
+ */
+BOOL
+make_apdu_message(UTF8String *text, const char *prefix, size_t apdu_length)
+{
+  BYTE *apdu = malloc(apdu_length);
+  BOOL test_bool;
+
+  if (NULL == apdu) { return FALSE; }
+
+  fill_bytes(apdu, apdu_length);
+
+  test_bool =
+    UTF8String_pushText(text, prefix, 0) &&
+    UTF8String_pushBytesAsHex(text, apdu_length, apdu) &&
+    UTF8String_pushText(text, "\"}", 0);
+
+  free(apdu);
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * Builds the stringified response to the "list readers" command.
+ */
+BOOL
+make_list_message(UTF8String *text, size_t reader_count)
+{
+  BOOL test_bool = UTF8String_pushText(text, "{\"i\":\"17\",\"d\":[", 0);
+
+  for (size_t i = 0; test_bool && (i < reader_count); i++)
+  {
+    test_bool =
+      ((0 == i) || UTF8String_pushByte(text, ',')) &&
+      UTF8String_pushText(text, "{\"n\":\"" BENCH_READER_NAME "\",\"a\":\"", 0) &&
+      UTF8String_pushText(text, (0 == (i % 2)) ? BENCH_READER_ATR : "", 0) &&
+      UTF8String_pushText(text, "\"}", 0);
+  }
+
+  return test_bool && UTF8String_pushText(text, "]}", 0);
+}
+
+/**************************************************************/
+
+/**
+ * Registers a parsing and a serialization benchmark of one message.
+ */
+BOOL
+add_message_benches(const char *name, UTF8String *text)
+{
+  char format[BENCH_NAME_LENGTH];
+  JsonByteStream stream;
+  JsonObject *object_ptr;
+  bench_t *bench;
+  BOOL test_bool;
+
+  snprintf(format, BENCH_NAME_LENGTH, "JsonObject_parse/%s", name);
+
+  bench = add_bench(run_object_parse, format, 0);
+  if (NULL == bench) { return FALSE; }
+
+  bench->text = text[0];
+  bench->bytes = text->length;
+
+  snprintf(format, BENCH_NAME_LENGTH, "JsonObject_toString/%s", name);
+
+  bench = add_bench(run_object_to_string, format, 0);
+  if (NULL == bench) { return FALSE; }
+
+  stream_from_text(&(stream), text);
+  object_ptr = &(bench->object);
+
+  test_bool = JsonObject_parse(&(object_ptr), FALSE, &(stream));
+
+  bench->bytes = text->length;
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+setup_benches(void)
+{
+  static const size_t apdu_lengths[] = {5, 256, 4096, 65536};
+  static const size_t reader_counts[] = {1, 16, 256};
+  char name[BENCH_NAME_LENGTH];
+  UTF8String text;
+  bench_t *bench;
+  size_t count;
+  BOOL test_bool = TRUE;
+
+  /* Transceive requests and responses */
+
+  for (size_t i = 0; test_bool && (i < 4); i++)
+  {
+    UTF8String_init(&(text));
+    snprintf(name, BENCH_NAME_LENGTH, "transceive_request/%zu", apdu_lengths[i]);
+
+    test_bool =
+      make_apdu_message(&(text), "{\"i\":\"1024\",\"c\":4,\"r\":3,\"a\":\"", apdu_lengths[i]) &&
+      add_message_benches(name, &(text));
+
+    UTF8String_init(&(text));
+    snprintf(name, BENCH_NAME_LENGTH, "transceive_response/%zu", apdu_lengths[i]);
+
+    test_bool = test_bool &&
+      make_apdu_message(&(text), "{\"i\":\"1024\",\"d\":\"", apdu_lengths[i] + 2) &&
+      add_message_benches(name, &(text));
+  }
+
+  /* Reader lists */
+
+  for (size_t i = 0; test_bool && (i < 3); i++)
+  {
+    UTF8String_init(&(text));
+    snprintf(name, BENCH_NAME_LENGTH, "list_response/%zu", reader_counts[i]);
+
+    test_bool =
+      make_list_message(&(text), reader_counts[i]) &&
+      add_message_benches(name, &(text));
+  }
+
+  /* Reader Event (card inserted) */
+
+  if (test_bool)
+  {
+    UTF8String_init(&(text));
+
+    test_bool =
+      UTF8String_pushText(&(text),
+        "{\"e\":1,\"r\":3,\"d\":\"" BENCH_READER_ATR "\",\"k\":[1,2]}", 0) &&
+      add_message_benches("event", &(text));
+  }
+
+  /* JSON Strings: hex-strings, escaped texts */
+
+  for (size_t i = 0; test_bool && (i < 4); i++)
+  {
+    bench = add_bench(run_string_parse, "JsonString_parse/hex/%zu", apdu_lengths[i]);
+    test_bool = (NULL != bench) && make_apdu_message(&(bench->text), "\"", apdu_lengths[i]);
+
+    if (test_bool)
+    {
+      /* Only the opening quote is needed */
+      bench->text.length -= 1;
+      bench->bytes = bench->text.length;
+    }
+  }
+
+  if (test_bool)
+  {
+    bench = add_bench(run_string_parse, "JsonString_parse/escaped/%zu", 4096);
+    test_bool = (NULL != bench) && UTF8String_pushByte(&(bench->text), '"');
+
+    for (count = 0; test_bool && (count < 4096); count += 16)
+    {
+      test_bool = UTF8String_pushText(&(bench->text), "Reader \\\"A\\\"\\\\\\n\\t", 0);
+    }
+
+    test_bool = test_bool && UTF8String_pushByte(&(bench->text), '"');
+
+    if (test_bool) { bench->bytes = bench->text.length; }
+  }
+
+  /* Hex-strings of APDUs */
+
+  for (size_t i = 0; test_bool && (i < 4); i++)
+  {
+    bench = add_bench(run_push_bytes_as_hex, "UTF8String_pushBytesAsHex/%zu", apdu_lengths[i]);
+    test_bool = (NULL != bench);
+
+    if (test_bool)
+    {
+      bench->data = malloc(apdu_lengths[i]);
+      test_bool = (NULL != bench->data);
+    }
+
+    if (test_bool)
+    {
+      fill_bytes(bench->data, apdu_lengths[i]);
+      bench->data_length = apdu_lengths[i];
+      bench->bytes = apdu_lengths[i];
+    }
+
+    bench = add_bench(run_hex_to_byte_array, "UTF8String_hexToByteArray/%zu", apdu_lengths[i]);
+
+    test_bool = test_bool && (NULL != bench) &&
+      make_apdu_message(&(bench->text), "", apdu_lengths[i]);
+
+    if (test_bool)
+    {
+      /* No closing quote and curly bracket */
+      bench->text.length -= 2;
+      bench->text.text[bench->text.length] = '\0';
+      bench->bytes = bench->text.length;
+    }
+  }
+
+  /* UTF-16 reader names (Windows) */
+
+  if (test_bool)
+  {
+    bench = add_bench(run_utf16_to_utf8, "UTF16String_toUTF8/reader_name", 0);
+    test_bool = (NULL != bench);
+
+    for (const char *c = BENCH_READER_NAME; test_bool && ('\0' != c[0]); c++)
+    {
+      test_bool = UTF16String_pushWideChar(&(bench->wide_text), (WCHAR) c[0]);
+    }
+
+    if (test_bool) { bench->bytes = bench->wide_text.length * sizeof(WCHAR); }
+  }
+
+  if (test_bool)
+  {
+    bench = add_bench(run_utf16_to_utf8, "UTF16String_toUTF8/text/%zu", 4096);
+    test_bool = (NULL != bench);
+
+    for (count = 0; test_bool && (count < 4096); count++)
+    {
+      test_bool = UTF16String_pushWideChar(&(bench->wide_text), (WCHAR) (' ' + (count % 95)));
+    }
+
+    if (test_bool) { bench->bytes = bench->wide_text.length * sizeof(WCHAR); }
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * Runs one benchmark until at least `min_time_ns` elapsed.
+ */
+BOOL
+measure_bench(bench_t *bench, uint64_t min_time_ns)
+{
+  uint64_t iterations = 1;
+  uint64_t start_ns;
+  uint64_t elapsed_ns;
+  uint64_t allocations = 0;
+
+  /* Warm-up (and correctness check) */
+
+  if (!bench->run(bench)) { return FALSE; }
+
+  while (TRUE)
+  {
+    #if defined(BENCH_COUNT_ALLOCATIONS)
+      allocations = bench_allocations;
+    #endif
+
+    start_ns = now_ns();
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+      if (!bench->run(bench)) { return FALSE; }
+    }
+
+    elapsed_ns = now_ns() - start_ns;
+
+    #if defined(BENCH_COUNT_ALLOCATIONS)
+      allocations = bench_allocations - allocations;
+    #endif
+
+    if (elapsed_ns >= min_time_ns) { break; }
+
+    /* Aim slightly above the minimal time */
+
+    if (elapsed_ns < (min_time_ns / 100))
+    {
+      iterations *= 100;
+    }
+    else
+    {
+      iterations = 1 + (uint64_t) ((double) iterations * 1.2 * (double) min_time_ns / (double) elapsed_ns);
+    }
+  }
+
+  bench->iterations = iterations;
+  bench->ns_per_op = (double) elapsed_ns / (double) iterations;
+  bench->bytes_per_s = (double) bench->bytes * 1e9 / bench->ns_per_op;
+
+  #if defined(BENCH_COUNT_ALLOCATIONS)
+    bench->allocs_per_op = (double) allocations / (double) iterations;
+  #else
+    bench->allocs_per_op = -1;
+  #endif
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Finds the "ns_per_op" result of a named benchmark in the baseline,
+ * returns a negative number if not found.
+ */
+double
+baseline_ns_per_op(const JsonObject *baseline, const char *name)
+{
+  JsonValue json_value;
+  JsonArray *json_array;
+  JsonObject *json_object;
+
+  if (!JsonObject_getValue(baseline, &(json_value), "benchmarks") ||
+    (JSON_VALUE_TYPE__ARRAY != json_value.type))
+  {
+    return -1;
+  }
+
+  json_array = (JsonArray *) json_value.value;
+
+  for (size_t i = 0; i < json_array->count; i++)
+  {
+    if (JSON_VALUE_TYPE__OBJECT != json_array->values[i].type) { continue; }
+
+    json_object = (JsonObject *) json_array->values[i].value;
+
+    if (!JsonObject_getValue(json_object, &(json_value), "name") ||
+      (JSON_VALUE_TYPE__STRING != json_value.type) ||
+      !UTF8String_matches((UTF8String *) json_value.value, name))
+    {
+      continue;
+    }
+
+    if (!JsonObject_getValue(json_object, &(json_value), "ns_per_op") ||
+      (JSON_VALUE_TYPE__NUMBER != json_value.type))
+    {
+      return -1;
+    }
+
+    return (double) ((FLOAT *) json_value.value)[0];
+  }
+
+  return -1;
+}
+
+/**************************************************************/
+
+BOOL
+load_baseline(const char *file_name, JsonObject *baseline)
+{
+  JsonByteStream stream;
+  JsonObject *object_ptr = baseline;
+  BOOL test_bool;
+
+  if (!JsonByteStream_loadFromFile(&(stream), file_name))
+  {
+    fprintf(stderr, "Cannot read baseline \"%s\"\n", file_name);
+    return FALSE;
+  }
+
+  test_bool = JsonByteStream_skipWhitespace(&(stream)) &&
+    JsonObject_parse(&(object_ptr), FALSE, &(stream));
+
+  JsonByteStream_destroy(&(stream));
+
+  if (!test_bool)
+  {
+    fprintf(stderr, "Invalid baseline \"%s\"\n", file_name);
+  }
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+BOOL
+save_results(const char *file_name)
+{
+  FILE *file = fopen(file_name, "w");
+
+  if (NULL == file)
+  {
+    perror("fopen()");
+    return FALSE;
+  }
+
+  fprintf(file, "{\"benchmarks\":[\n");
+
+  for (size_t i = 0; i < bench_count; i++)
+  {
+    fprintf(file,
+      "  {\"name\":\"%s\",\"iterations\":%llu,\"bytes\":%zu," \
+      "\"ns_per_op\":%.1f,\"bytes_per_s\":%.0f,\"allocs_per_op\":%.2f}%s\n",
+      benches[i].name,
+      (unsigned long long) benches[i].iterations,
+      benches[i].bytes,
+      benches[i].ns_per_op,
+      benches[i].bytes_per_s,
+      benches[i].allocs_per_op,
+      (i < (bench_count - 1)) ? "," : "");
+  }
+
+  fprintf(file, "]}\n");
+
+  return (0 == fclose(file));
+}
+
+/**************************************************************/
+
+void
+print_usage(const char *name)
+{
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -f TEXT   run only the benchmarks whose name contains TEXT\n"
+    "  -T MS     minimal measurement time of each benchmark (default %d)\n"
+    "  -o FILE   save the results as JSON\n"
+    "  -b FILE   compare against a baseline (JSON saved with \"-o\")\n"
+    "  -x PCT    fail if any benchmark is more than PCT %% slower than the baseline\n",
+    name,
+    BENCH_MIN_TIME_MS);
+}
+
+/**************************************************************/
+
+int
+main(int argc, char **argv)
+{
+  const char *filter = NULL;
+  const char *output_name = NULL;
+  const char *baseline_name = NULL;
+  double min_time_ms = BENCH_MIN_TIME_MS;
+  double threshold = -1;
+  JsonObject baseline;
+  double baseline_ns;
+  double change;
+  size_t selected = 0;
+  size_t regressions = 0;
+  BOOL test_bool = TRUE;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if ((i + 1) >= argc) { test_bool = FALSE; break; }
+
+    if (0 == strcmp("-f", argv[i])) { filter = argv[++i]; }
+    else if (0 == strcmp("-T", argv[i])) { min_time_ms = strtod(argv[++i], NULL); }
+    else if (0 == strcmp("-o", argv[i])) { output_name = argv[++i]; }
+    else if (0 == strcmp("-b", argv[i])) { baseline_name = argv[++i]; }
+    else if (0 == strcmp("-x", argv[i])) { threshold = strtod(argv[++i], NULL); }
+    else { test_bool = FALSE; break; }
+  }
+
+  if (!test_bool)
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  JsonObject_init(&(baseline));
+
+  if ((NULL != baseline_name) && !load_baseline(baseline_name, &(baseline)))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if (!setup_benches())
+  {
+    fprintf(stderr, "Benchmark setup failed\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%-44s %12s %12s %10s %10s%s\n",
+    "benchmark", "ns/op", "MB/s", "allocs/op", "bytes/op",
+    (NULL != baseline_name) ? "   vs. baseline" : "");
+
+  for (size_t i = 0; i < bench_count; i++)
+  {
+    if ((NULL != filter) && (NULL == strstr(benches[i].name, filter)))
+    {
+      continue;
+    }
+
+    if (!measure_bench(&(benches[i]), (uint64_t) (min_time_ms * 1e6)))
+    {
+      fprintf(stderr, "Benchmark \"%s\" failed\n", benches[i].name);
+      return EXIT_FAILURE;
+    }
+
+    printf("%-44s %12.1f %12.1f %10.2f %10zu",
+      benches[i].name,
+      benches[i].ns_per_op,
+      benches[i].bytes_per_s / 1e6,
+      benches[i].allocs_per_op,
+      benches[i].bytes);
+
+    if (NULL != baseline_name)
+    {
+      baseline_ns = baseline_ns_per_op(&(baseline), benches[i].name);
+
+      if (baseline_ns > 0)
+      {
+        change = 100.0 * (benches[i].ns_per_op - baseline_ns) / baseline_ns;
+        printf("   %+7.1f %%", change);
+
+        if ((threshold >= 0) && (change > threshold))
+        {
+          printf(" (regression)");
+          regressions += 1;
+        }
+      }
+      else
+      {
+        printf("   (new)");
+      }
+    }
+
+    printf("\n");
+
+    /* Only the measured benchmarks are saved */
+
+    benches[selected] = benches[i];
+    selected += 1;
+  }
+
+  bench_count = selected;
+
+  if ((NULL != output_name) && !save_results(output_name))
+  {
+    return EXIT_FAILURE;
+  }
+
+  JsonObject_destroy(&(baseline));
+
+  return (0 == regressions) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**************************************************************/
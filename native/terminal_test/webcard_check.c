@@ -0,0 +1,1165 @@
+/**
+ * @file "native/terminal_test/webcard_check.c"
+ * Scenario checks for the WebCard Native App.
+ *
+ * Every check spawns the Native App with the simulated PC/SC backend
+ * ("-s" option, reader farm "check_farm.json"), sends a short sequence
+ * of requests and looks at the responses, so that regressions in the
+ * caches and in the reader bookkeeping show up without any hardware.
+ * The cache directory of the Native App is a temporary one (for every
+ * check), removed when the checks are done.
+ */
+
+#if defined(_WIN32)
+  #error("WIN32 not supported yet!")
+  #pragma GCC error "WIN32 not supported yet!"
+
+#elif defined(__linux__) || defined(__APPLE__)
+
+  #define _XOPEN_SOURCE 700  /* mkdtemp, nftw */
+
+  #include <stdint.h>  /* uint32_t, uint64_t */
+  #include <stdlib.h>  /* EXIT_SUCCESS, EXIT_FAILURE, malloc, setenv, strtod */
+  #include <stdio.h>  /* printf, snprintf, perror */
+  #include <string.h>  /* strlen, strstr, strncmp, memcmp, memmove */
+  #include <unistd.h>  /* execl, fork, pipe, write, read, close */
+  #include <fcntl.h>  /* O_NONBLOCK */
+  #include <poll.h>  /* poll */
+  #include <signal.h>  /* signal, SIGPIPE */
+  #include <ftw.h>  /* nftw */
+  #include <sys/stat.h>  /* mkdir */
+  #include <sys/wait.h>  /* waitpid */
+  #include <time.h>  /* clock_gettime */
+  #include <errno.h>
+
+  typedef int BOOL;
+  #define FALSE  0
+  #define TRUE   1
+
+  #define WEBCARD_EXEC  "webcard"
+
+  #define READ_END   0
+  #define WRITE_END  1
+
+#else
+  #error("Unsupported Operating System, sorry!")
+  #pragma GCC error "Unsupported Operating System, sorry!"
+#endif
+
+/**************************************************************/
+
+/** Longest wait for one response, in milliseconds. */
+#define RESPONSE_TIMEOUT_MS  5000
+
+/** Readers of "check_farm.json": desk readers, a line, then a rack. */
+#define SLOW_READER  2
+#define SWAP_READER  3
+#define LINE_FIRST_READER  4
+#define LINE_READERS  4
+#define RACK_FIRST_READER  8
+#define RACK_READERS  64
+
+/** Cards of the line are inserted after this many milliseconds. */
+#define LINE_INSERTION_MS  500
+
+/** Latency of every cAPDU sent to the "slow" card, in milliseconds. */
+#define SLOW_CARD_LATENCY_MS  300
+
+#define RESPONSE_LENGTH  65536
+
+#define PATH_LENGTH  512
+
+/**************************************************************/
+
+typedef struct
+{
+  const char *exec_path;
+  const char *farm_path;
+  char cache_path[PATH_LENGTH];
+}
+options_t;
+
+typedef struct
+{
+  int fd_read;
+  int fd_write;
+  pid_t child_pid;
+
+  /* Receive buffer (one or more frames) */
+  uint8_t *buf;
+  size_t buf_length;
+  size_t buf_capacity;
+}
+host_t;
+
+typedef BOOL (*check_t)(const options_t *options);
+
+/**************************************************************/
+
+uint64_t
+now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &(now));
+  return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+}
+
+/**************************************************************/
+
+void
+print_usage(const char *name)
+{
+  fprintf(stderr,
+    "Usage: %s -s FILE [path/to/webcard]\n"
+    "  -s FILE   simulated reader farm (\"terminal_test/check_farm.json\")\n",
+    name);
+}
+
+/**************************************************************/
+
+BOOL
+parse_options(int argc, char **argv, options_t *options)
+{
+  int opt;
+
+  options->exec_path = WEBCARD_EXEC;
+  options->farm_path = NULL;
+  options->cache_path[0] = '\0';
+
+  while ((-1) != (opt = getopt(argc, argv, "s:h")))
+  {
+    switch (opt)
+    {
+      case 's':
+        options->farm_path = optarg;
+        break;
+      default:
+        return FALSE;
+    }
+  }
+
+  if (optind < argc)
+  {
+    options->exec_path = argv[optind];
+  }
+
+  return (NULL != options->farm_path);
+}
+
+/**************************************************************/
+
+BOOL
+spawn_host(const options_t *options, host_t *host)
+{
+  int pipe_child_to_parent[2];
+  int pipe_parent_to_child[2];
+
+  host->buf_length = 0;
+
+  if ((-1) == pipe(pipe_child_to_parent))
+  {
+    perror("pipe(pipe_child_to_parent)");
+    return FALSE;
+  }
+
+  if ((-1) == pipe(pipe_parent_to_child))
+  {
+    perror("pipe(pipe_parent_to_child)");
+    close(pipe_child_to_parent[READ_END]);
+    close(pipe_child_to_parent[WRITE_END]);
+    return FALSE;
+  }
+
+  host->child_pid = fork();
+
+  if ((-1) == host->child_pid)
+  {
+    perror("fork()");
+    return FALSE;
+  }
+
+  if (0 == host->child_pid)
+  {
+    /* Child process: becomes the "Webcard Native App" */
+
+    dup2(pipe_parent_to_child[READ_END], STDIN_FILENO);
+    dup2(pipe_child_to_parent[WRITE_END], STDOUT_FILENO);
+
+    close(pipe_parent_to_child[READ_END]);
+    close(pipe_parent_to_child[WRITE_END]);
+    close(pipe_child_to_parent[READ_END]);
+    close(pipe_child_to_parent[WRITE_END]);
+
+    /* Persistent files go to the temporary directory */
+
+    setenv("WEBCARD_SIMULATOR", options->farm_path, 1);
+    setenv("XDG_CACHE_HOME", options->cache_path, 1);
+    setenv("HOME", options->cache_path, 1);
+
+    execl(options->exec_path, options->exec_path, NULL);
+    perror(" @ execl()");
+    _exit(EXIT_FAILURE);
+  }
+
+  /* Parent process */
+
+  close(pipe_child_to_parent[WRITE_END]);
+  close(pipe_parent_to_child[READ_END]);
+
+  host->fd_read = pipe_child_to_parent[READ_END];
+  host->fd_write = pipe_parent_to_child[WRITE_END];
+
+  if (0 != fcntl(host->fd_read, F_SETFL, O_NONBLOCK))
+  {
+    perror("fcntl(fd_read, F_SETFL, O_NONBLOCK)");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Closes the Standard Input of the Native App (it exits then)
+ * and waits for the process.
+ */
+BOOL
+stop_host(host_t *host)
+{
+  int status;
+
+  close(host->fd_write);
+  close(host->fd_read);
+
+  if (host->child_pid != waitpid(host->child_pid, &(status), 0))
+  {
+    return FALSE;
+  }
+
+  return WIFEXITED(status) && (EXIT_SUCCESS == WEXITSTATUS(status));
+}
+
+/**************************************************************/
+
+BOOL
+write_all(int fd, const uint8_t *bytes, size_t length)
+{
+  ssize_t written;
+
+  while (length > 0)
+  {
+    written = write(fd, bytes, length);
+
+    if (written < 0)
+    {
+      if (EINTR == errno) { continue; }
+      perror("write()");
+      return FALSE;
+    }
+
+    bytes += written;
+    length -= (size_t) written;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Reads whatever arrives within `timeout_ms` milliseconds.
+ */
+BOOL
+receive_bytes(host_t *host, int timeout_ms)
+{
+  struct pollfd poll_fd;
+  ssize_t received;
+  uint8_t *new_buf;
+
+  poll_fd.fd = host->fd_read;
+  poll_fd.events = POLLIN;
+  poll_fd.revents = 0;
+
+  if (poll(&(poll_fd), 1, timeout_ms) <= 0)
+  {
+    return TRUE;
+  }
+
+  while (TRUE)
+  {
+    if (host->buf_capacity - host->buf_length < 65536)
+    {
+      new_buf = realloc(host->buf, host->buf_capacity * 2);
+      if (NULL == new_buf) { return FALSE; }
+
+      host->buf = new_buf;
+      host->buf_capacity *= 2;
+    }
+
+    received = read(
+      host->fd_read,
+      &(host->buf[host->buf_length]),
+      host->buf_capacity - host->buf_length);
+
+    if (received > 0)
+    {
+      host->buf_length += (size_t) received;
+      continue;
+    }
+
+    if ((0 == received) ||
+      ((EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno)))
+    {
+      fprintf(stderr, "The Native App closed its output\n");
+      return FALSE;
+    }
+
+    return TRUE;
+  }
+}
+
+/**************************************************************/
+
+/**
+ * Sends one request, without waiting for its response.
+ */
+BOOL
+send_request(host_t *host, const char *json)
+{
+  uint8_t frame[sizeof(uint32_t) + RESPONSE_LENGTH];
+  uint32_t length = (uint32_t) strlen(json);
+
+  if (length > RESPONSE_LENGTH)
+  {
+    return FALSE;
+  }
+
+  memcpy(frame, &(length), sizeof(uint32_t));
+  memcpy(&(frame[sizeof(uint32_t)]), json, length);
+
+  return write_all(host->fd_write, frame, sizeof(uint32_t) + length);
+}
+
+/**************************************************************/
+
+/**
+ * Does the frame `text` (`length` bytes, not NULL-terminated)
+ * contain `needle`?
+ */
+BOOL
+frame_contains(const char *text, size_t length, const char *needle)
+{
+  const size_t needle_length = strlen(needle);
+
+  for (size_t i = 0; (i + needle_length) <= length; i++)
+  {
+    if (0 == memcmp(&(text[i]), needle, needle_length))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**************************************************************/
+
+/**
+ * Waits for the response with the "i" key `id`. Reader Events
+ * and other responses are skipped. The response is copied
+ * (NULL-terminated) into `response`.
+ */
+BOOL
+wait_response(
+  host_t *host,
+  const char *id,
+  char *response,
+  size_t capacity)
+{
+  char prefix[64];
+  uint32_t frame_length;
+  size_t prefix_length;
+  size_t offset;
+  const char *text;
+  uint64_t give_up_ns = now_ns() +
+    ((uint64_t) RESPONSE_TIMEOUT_MS * 1000000);
+
+  prefix_length = (size_t) snprintf(prefix, sizeof(prefix), "{\"i\":\"%s\"", id);
+
+  while (now_ns() < give_up_ns)
+  {
+    offset = 0;
+
+    while ((host->buf_length - offset) >= sizeof(uint32_t))
+    {
+      memcpy(&(frame_length), &(host->buf[offset]), sizeof(uint32_t));
+
+      if ((host->buf_length - offset - sizeof(uint32_t)) < frame_length)
+      {
+        break;
+      }
+
+      text = (const char *) &(host->buf[offset + sizeof(uint32_t)]);
+      offset += sizeof(uint32_t) + frame_length;
+
+      if ((frame_length >= prefix_length) &&
+        (0 == strncmp(text, prefix, prefix_length)) &&
+        (frame_length < capacity))
+      {
+        memcpy(response, text, frame_length);
+        response[frame_length] = '\0';
+
+        memmove(host->buf, &(host->buf[offset]), host->buf_length - offset);
+        host->buf_length -= offset;
+        return TRUE;
+      }
+    }
+
+    memmove(host->buf, &(host->buf[offset]), host->buf_length - offset);
+    host->buf_length -= offset;
+
+    if (!receive_bytes(host, 100)) { return FALSE; }
+  }
+
+  fprintf(stderr, "No response to \"%s\"\n", id);
+  return FALSE;
+}
+
+/**************************************************************/
+
+/**
+ * Waits for the Reader Event `event` (e.g. 1 for "Card Insertion")
+ * of every reader from `first` to `first + count - 1`. Responses and
+ * other events are skipped, an "incomplete" event fails the wait.
+ */
+BOOL
+wait_events(
+  host_t *host,
+  int event,
+  size_t first,
+  size_t count)
+{
+  BOOL seen[RACK_READERS];
+  size_t seen_count = 0;
+  uint32_t frame_length;
+  size_t offset;
+  size_t reader;
+  const char *text;
+  char prefix[64];
+  size_t prefix_length;
+  uint64_t give_up_ns = now_ns() +
+    ((uint64_t) RESPONSE_TIMEOUT_MS * 1000000);
+
+  if (count > RACK_READERS)
+  {
+    return FALSE;
+  }
+
+  prefix_length = (size_t) snprintf(prefix, sizeof(prefix), "{\"e\":%d,\"r\":", event);
+
+  memset(seen, 0x00, sizeof(seen));
+
+  while (now_ns() < give_up_ns)
+  {
+    offset = 0;
+
+    while ((host->buf_length - offset) >= sizeof(uint32_t))
+    {
+      memcpy(&(frame_length), &(host->buf[offset]), sizeof(uint32_t));
+
+      if ((host->buf_length - offset - sizeof(uint32_t)) < frame_length)
+      {
+        break;
+      }
+
+      text = (const char *) &(host->buf[offset + sizeof(uint32_t)]);
+      offset += sizeof(uint32_t) + frame_length;
+
+      if ((frame_length <= prefix_length) ||
+        (0 != strncmp(text, prefix, prefix_length)))
+      {
+        continue;
+      }
+
+      reader = (size_t) strtod(&(text[prefix_length]), NULL);
+
+      if ((reader < first) || (reader >= (first + count)))
+      {
+        continue;
+      }
+
+      if (frame_contains(text, frame_length, "\"incomplete\""))
+      {
+        fprintf(stderr, "Event %d of reader %zu is incomplete\n", event, reader);
+        return FALSE;
+      }
+
+      if (!seen[reader - first])
+      {
+        seen[reader - first] = TRUE;
+        seen_count += 1;
+      }
+    }
+
+    memmove(host->buf, &(host->buf[offset]), host->buf_length - offset);
+    host->buf_length -= offset;
+
+    if (seen_count == count)
+    {
+      return TRUE;
+    }
+
+    if (!receive_bytes(host, 100)) { return FALSE; }
+  }
+
+  fprintf(stderr, "%zu of %zu events %d seen\n", seen_count, count, event);
+  return FALSE;
+}
+
+/**************************************************************/
+
+/**
+ * Sends one request (`json` must have the "i" key `id`)
+ * and waits for its response (see `wait_response`).
+ */
+BOOL
+exchange(
+  host_t *host,
+  const char *id,
+  const char *json,
+  char *response,
+  size_t capacity)
+{
+  return send_request(host, json) &&
+    wait_response(host, id, response, capacity);
+}
+
+/**************************************************************/
+
+/**
+ * Finds the first number under `key` in a response.
+ */
+BOOL
+find_number(const char *json, const char *key, double *value)
+{
+  char pattern[64];
+  const char *found;
+
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+
+  found = strstr(json, pattern);
+  if (NULL == found) { return FALSE; }
+
+  value[0] = strtod(&(found[strlen(pattern)]), NULL);
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Sends a list of requests (the "i" key of every one is its
+ * position in the list) and checks that none of them failed.
+ */
+BOOL
+exchange_all(
+  host_t *host,
+  const char **requests,
+  size_t count,
+  char *response,
+  size_t capacity)
+{
+  char id[24];
+
+  for (size_t i = 0; i < count; i++)
+  {
+    snprintf(id, sizeof(id), "%zu", i);
+
+    if (!exchange(host, id, requests[i], response, capacity))
+    {
+      return FALSE;
+    }
+
+    if (NULL != strstr(response, "\"incomplete\""))
+    {
+      fprintf(stderr, "Request failed: %s\n", requests[i]);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Starts the Native App, sends the requests (see `exchange_all`)
+ * and stops it. `response` receives the last response.
+ */
+BOOL
+run_session(
+  const options_t *options,
+  const char **requests,
+  size_t count,
+  char *response,
+  size_t capacity)
+{
+  host_t host;
+  BOOL result;
+
+  memset(&(host), 0x00, sizeof(host_t));
+
+  host.buf_capacity = 1 << 16;
+  host.buf = malloc(host.buf_capacity);
+
+  result = (NULL != host.buf) && spawn_host(options, &(host));
+
+  if (result)
+  {
+    result = exchange_all(&(host), requests, count, response, capacity);
+    result = stop_host(&(host)) && result;
+  }
+
+  free(host.buf);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * The card is in the reader before the Native App starts (no
+ * "Card Insertion" event): READ BINARY of a file selected by AID
+ * is served from the APDU cache the second time.
+ */
+BOOL
+check_cache_card_at_startup(const options_t *options)
+{
+  static const char *requests[] =
+  {
+    "{\"i\":\"0\",\"c\":14,\"p\":65536}",
+    "{\"i\":\"1\",\"c\":2,\"r\":0}",
+    "{\"i\":\"2\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"3\",\"c\":4,\"r\":0,\"a\":\"00B0000010\"}",
+    "{\"i\":\"4\",\"c\":4,\"r\":0,\"a\":\"00B0000010\"}",
+    "{\"i\":\"5\",\"c\":14}"
+  };
+
+  char response[RESPONSE_LENGTH];
+  double hits = 0;
+
+  return run_session(
+      options,
+      requests,
+      sizeof(requests) / sizeof(requests[0]),
+      response,
+      RESPONSE_LENGTH) &&
+    find_number(response, "h", &(hits)) &&
+    (1 == hits);
+}
+
+/**************************************************************/
+
+/**
+ * A SELECT by File ID depends on the current DF: what is read
+ * afterwards is never cached (the same SELECT may name another
+ * file next time).
+ */
+BOOL
+check_cache_relative_select(const options_t *options)
+{
+  static const char *requests[] =
+  {
+    "{\"i\":\"0\",\"c\":14,\"p\":65536}",
+    "{\"i\":\"1\",\"c\":2,\"r\":0}",
+    "{\"i\":\"2\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"3\",\"c\":4,\"r\":0,\"a\":\"00A40000025032\"}",
+    "{\"i\":\"4\",\"c\":4,\"r\":0,\"a\":\"00B000000B\"}",
+    "{\"i\":\"5\",\"c\":4,\"r\":0,\"a\":\"00B000000B\"}",
+    "{\"i\":\"6\",\"c\":14}"
+  };
+
+  char response[RESPONSE_LENGTH];
+  double entries = 1;
+
+  return run_session(
+      options,
+      requests,
+      sizeof(requests) / sizeof(requests[0]),
+      response,
+      RESPONSE_LENGTH) &&
+    find_number(response, "n", &(entries)) &&
+    (0 == entries);
+}
+
+/**************************************************************/
+
+/**
+ * The persistent card cache is filled by the first session and
+ * used by the next one (a restart of the browser), while the card
+ * stays in the reader: no "Card Insertion" event in either session.
+ */
+BOOL
+check_card_cache_restart(const options_t *options)
+{
+  static const char *first_session[] =
+  {
+    "{\"i\":\"0\",\"c\":15,\"p\":65536,\"a\":\"FFCA000000\"}",
+    "{\"i\":\"1\",\"c\":2,\"r\":0}",
+    "{\"i\":\"2\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"3\",\"c\":4,\"r\":0,\"a\":\"00B0000010\"}",
+    "{\"i\":\"4\",\"c\":15}"
+  };
+
+  /* Settings come from the file */
+
+  static const char *next_session[] =
+  {
+    "{\"i\":\"0\",\"c\":2,\"r\":0}",
+    "{\"i\":\"1\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"2\",\"c\":4,\"r\":0,\"a\":\"00B0000010\"}",
+    "{\"i\":\"3\",\"c\":15}"
+  };
+
+  char response[RESPONSE_LENGTH];
+  double entries = 0;
+  double hits = 0;
+
+  return run_session(
+      options,
+      first_session,
+      sizeof(first_session) / sizeof(first_session[0]),
+      response,
+      RESPONSE_LENGTH) &&
+    find_number(response, "n", &(entries)) &&
+    (1 == entries) &&
+    run_session(
+      options,
+      next_session,
+      sizeof(next_session) / sizeof(next_session[0]),
+      response,
+      RESPONSE_LENGTH) &&
+    find_number(response, "h", &(hits)) &&
+    (1 == hits);
+}
+
+/**************************************************************/
+
+/**
+ * The simulated storage card refuses UPDATE BINARY without data
+ * ("Lc = 00"): wrong length, nothing is written.
+ */
+BOOL
+check_simulator_empty_update(const options_t *options)
+{
+  static const char *requests[] =
+  {
+    "{\"i\":\"0\",\"c\":2,\"r\":1}",
+    "{\"i\":\"1\",\"c\":4,\"r\":1,\"a\":\"FFD6000000\"}"
+  };
+
+  char response[RESPONSE_LENGTH];
+
+  return run_session(
+      options,
+      requests,
+      sizeof(requests) / sizeof(requests[0]),
+      response,
+      RESPONSE_LENGTH) &&
+    (NULL != strstr(response, "\"d\":\"6700\""));
+}
+
+/**************************************************************/
+
+/**
+ * A fan-out to a slow card does not hold up the other requests:
+ * a request sent after it is answered first, and the fan-out
+ * is answered once its reader is done.
+ */
+BOOL
+check_fanout_requests_meanwhile(const options_t *options)
+{
+  host_t host;
+  BOOL result;
+  char response[RESPONSE_LENGTH];
+
+  memset(&(host), 0x00, sizeof(host_t));
+
+  host.buf_capacity = 1 << 16;
+  host.buf = malloc(host.buf_capacity);
+
+  result = (NULL != host.buf) && spawn_host(options, &(host));
+
+  if (result)
+  {
+    /* Responses that arrive out of turn are skipped (and fail the check) */
+
+    result = send_request(&(host),
+        "{\"i\":\"0\",\"c\":22,\"r\":[2],"
+        "\"d\":[\"00A4040007A0000000041010\",\"00B0000010\"]}") &&
+      exchange(&(host), "1", "{\"i\":\"1\",\"c\":10}", response, RESPONSE_LENGTH) &&
+      wait_response(&(host), "0", response, RESPONSE_LENGTH) &&
+      (NULL != strstr(response, "\"r\":2")) &&
+      (NULL == strstr(response, "\"incomplete\""));
+
+    result = stop_host(&(host)) && result;
+  }
+
+  free(host.buf);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * The connect of another client waits while the reader is owned,
+ * and is answered when the card is removed (the reader is released
+ * then): that client connects once the card is back.
+ */
+BOOL
+check_arbitration_card_removal(const options_t *options)
+{
+  host_t host;
+  BOOL result;
+  char response[RESPONSE_LENGTH];
+
+  memset(&(host), 0x00, sizeof(host_t));
+
+  host.buf_capacity = 1 << 16;
+  host.buf = malloc(host.buf_capacity);
+
+  result = (NULL != host.buf) && spawn_host(options, &(host));
+
+  if (result)
+  {
+    result = exchange(&(host), "0", "{\"i\":\"0\",\"c\":2,\"r\":3,\"k\":\"A\"}", response, RESPONSE_LENGTH) &&
+      (NULL == strstr(response, "\"incomplete\"")) &&
+      send_request(&(host), "{\"i\":\"1\",\"c\":2,\"r\":3,\"k\":\"B\"}") &&
+      wait_response(&(host), "1", response, RESPONSE_LENGTH) &&
+      wait_events(&(host), 1, SWAP_READER, 1) &&
+      exchange(&(host), "2", "{\"i\":\"2\",\"c\":2,\"r\":3,\"k\":\"B\"}", response, RESPONSE_LENGTH) &&
+      (NULL == strstr(response, "\"incomplete\""));
+
+    result = stop_host(&(host)) && result;
+  }
+
+  free(host.buf);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * A transmission to the slow card past its deadline is answered
+ * at once ("x": 1), so is a cancelled request ("x": 2), and the
+ * reader serves the next request as usual.
+ */
+BOOL
+check_deadline_and_cancel(const options_t *options)
+{
+  host_t host;
+  BOOL result;
+  uint64_t started_ns;
+  char response[RESPONSE_LENGTH];
+
+  memset(&(host), 0x00, sizeof(host_t));
+
+  host.buf_capacity = 1 << 16;
+  host.buf = malloc(host.buf_capacity);
+
+  result = (NULL != host.buf) && spawn_host(options, &(host));
+
+  if (result)
+  {
+    result = exchange(&(host), "0", "{\"i\":\"0\",\"c\":2,\"r\":2}", response, RESPONSE_LENGTH) &&
+      (NULL == strstr(response, "\"incomplete\""));
+
+    started_ns = now_ns();
+
+    result = result &&
+      exchange(&(host), "1",
+        "{\"i\":\"1\",\"c\":4,\"r\":2,\"a\":\"00A4040007A0000000041010\",\"t\":100}",
+        response, RESPONSE_LENGTH) &&
+      (NULL != strstr(response, "\"x\":1")) &&
+      ((now_ns() - started_ns) < ((uint64_t) SLOW_CARD_LATENCY_MS * 1000000));
+
+    /* The main loop still waits for the card: "2" is cancelled while waiting */
+
+    result = result &&
+      send_request(&(host), "{\"i\":\"2\",\"c\":4,\"r\":2,\"a\":\"00B0000010\"}") &&
+      send_request(&(host), "{\"i\":\"3\",\"c\":20,\"k\":\"2\"}") &&
+      wait_response(&(host), "2", response, RESPONSE_LENGTH) &&
+      (NULL != strstr(response, "\"x\":2")) &&
+      exchange(&(host), "4", "{\"i\":\"4\",\"c\":4,\"r\":2,\"a\":\"00B0000010\"}", response, RESPONSE_LENGTH) &&
+      (NULL == strstr(response, "\"incomplete\""));
+
+    result = stop_host(&(host)) && result;
+  }
+
+  free(host.buf);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * A repeated SELECT is elided on an exclusive connection, but not
+ * after MANAGE CHANNEL (the selection is forgotten) nor on a shared
+ * connection: one elided SELECT in all.
+ */
+BOOL
+check_select_elision(const options_t *options)
+{
+  static const char *requests[] =
+  {
+    "{\"i\":\"0\",\"c\":2,\"r\":0,\"p\":1,\"e\":1}",
+    "{\"i\":\"1\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"2\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"3\",\"c\":4,\"r\":0,\"a\":\"0070000001\"}",
+    "{\"i\":\"4\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"5\",\"c\":3,\"r\":0}",
+    "{\"i\":\"6\",\"c\":2,\"r\":0,\"p\":2,\"e\":1}",
+    "{\"i\":\"7\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"8\",\"c\":4,\"r\":0,\"a\":\"00A4040007A0000000041010\"}",
+    "{\"i\":\"9\",\"c\":14}"
+  };
+
+  char response[RESPONSE_LENGTH];
+  double elided = 0;
+
+  return run_session(
+      options,
+      requests,
+      sizeof(requests) / sizeof(requests[0]),
+      response,
+      RESPONSE_LENGTH) &&
+    find_number(response, "s", &(elided)) &&
+    (1 == elided);
+}
+
+/**************************************************************/
+
+/**
+ * A fan-out to the slow cards of the line: every reader has its
+ * result, and the readers work in parallel (two cAPDUs each, the
+ * whole fan-out takes less than twice that).
+ */
+BOOL
+check_fanout_line_readers(const options_t *options)
+{
+  host_t host;
+  BOOL result;
+  uint64_t started_ns;
+  char pattern[32];
+  char response[RESPONSE_LENGTH];
+
+  memset(&(host), 0x00, sizeof(host_t));
+
+  host.buf_capacity = 1 << 16;
+  host.buf = malloc(host.buf_capacity);
+
+  result = (NULL != host.buf) && spawn_host(options, &(host));
+
+  if (result)
+  {
+    result = wait_events(&(host), 1, LINE_FIRST_READER, LINE_READERS);
+
+    started_ns = now_ns();
+
+    result = result &&
+      exchange(&(host), "0",
+        "{\"i\":\"0\",\"c\":22,\"r\":[4,5,6,7],"
+        "\"d\":[\"00A4040007A0000000041010\",\"00B0000010\"]}",
+        response, RESPONSE_LENGTH) &&
+      (NULL == strstr(response, "\"incomplete\"")) &&
+      ((now_ns() - started_ns) < ((uint64_t) 4 * SLOW_CARD_LATENCY_MS * 1000000));
+
+    for (size_t i = 0; result && (i < LINE_READERS); i++)
+    {
+      snprintf(pattern, sizeof(pattern), "{\"r\":%zu,", LINE_FIRST_READER + i);
+      result = (NULL != strstr(response, pattern));
+    }
+
+    result = stop_host(&(host)) && result;
+  }
+
+  free(host.buf);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * Jobs queued before the cards of the line are inserted: every
+ * card gets one, every job is reported (Reader Event 5) with its
+ * responses, and the readers work in parallel.
+ */
+BOOL
+check_jobs_line_readers(const options_t *options)
+{
+  host_t host;
+  BOOL result;
+  uint64_t started_ns;
+  char response[RESPONSE_LENGTH];
+
+  memset(&(host), 0x00, sizeof(host_t));
+
+  host.buf_capacity = 1 << 16;
+  host.buf = malloc(host.buf_capacity);
+
+  result = (NULL != host.buf) && spawn_host(options, &(host));
+
+  if (result)
+  {
+    started_ns = now_ns();
+
+    result = exchange(&(host), "0",
+        "{\"i\":\"0\",\"c\":23,\"k\":\"J\",\"r\":[4,5,6,7],"
+        "\"d\":[\"00A4040007A0000000041010\",\"00B0000010\"],"
+        "\"j\":[[\"01\"],[\"02\"],[\"03\"],[\"04\"]]}",
+        response, RESPONSE_LENGTH) &&
+      (NULL == strstr(response, "\"incomplete\"")) &&
+      wait_events(&(host), 5, LINE_FIRST_READER, LINE_READERS) &&
+      ((now_ns() - started_ns) <
+        ((uint64_t) (LINE_INSERTION_MS + 4 * SLOW_CARD_LATENCY_MS) * 1000000));
+
+    result = stop_host(&(host)) && result;
+  }
+
+  free(host.buf);
+
+  return result;
+}
+
+/**************************************************************/
+
+/**
+ * PCSC Lite watches at most 16 readers per "SCardGetStatusChange":
+ * a card is inserted into every reader of a 64-reader rack, one
+ * after another, and every insertion is reported.
+ */
+BOOL
+check_rack_insertions(const options_t *options)
+{
+  host_t host;
+  BOOL result;
+
+  memset(&(host), 0x00, sizeof(host_t));
+
+  host.buf_capacity = 1 << 16;
+  host.buf = malloc(host.buf_capacity);
+
+  result = (NULL != host.buf) && spawn_host(options, &(host));
+
+  if (result)
+  {
+    /* No request needed: card events are sent to everybody */
+
+    result = wait_events(&(host), 1, RACK_FIRST_READER, RACK_READERS);
+
+    result = stop_host(&(host)) && result;
+  }
+
+  free(host.buf);
+
+  return result;
+}
+
+/**************************************************************/
+
+static const struct
+{
+  const char *name;
+  check_t run;
+}
+checks[] =
+{
+  {"APDU cache, card present at startup", check_cache_card_at_startup},
+  {"APDU cache, relative SELECT", check_cache_relative_select},
+  {"Card cache, restart with the card inserted", check_card_cache_restart},
+  {"Simulator, UPDATE BINARY without data", check_simulator_empty_update},
+  {"Fan-out, other requests served meanwhile", check_fanout_requests_meanwhile},
+  {"Reader arbitration, release on card removal", check_arbitration_card_removal},
+  {"Deadlines and cancellation, slow card", check_deadline_and_cancel},
+  {"SELECT elision, forgotten selection and shared mode", check_select_elision},
+  {"Fan-out, four readers in parallel", check_fanout_line_readers},
+  {"Production line, four readers in parallel", check_jobs_line_readers},
+  {"Reader groups, 64 insertions in a rack", check_rack_insertions}
+};
+
+/**************************************************************/
+
+int
+remove_entry(
+  const char *path,
+  const struct stat *status,
+  int type,
+  struct FTW *ftw)
+{
+  return remove(path);
+}
+
+/**************************************************************/
+
+int
+main(int argc, char **argv)
+{
+  options_t options;
+  char base_path[64];
+  char library_path[PATH_LENGTH + 16];
+  size_t failures = 0;
+  BOOL result;
+
+  if (!parse_options(argc, argv, &(options)))
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  snprintf(base_path, sizeof(base_path), "/tmp/webcard_check_XXXXXX");
+
+  if (NULL == mkdtemp(base_path))
+  {
+    perror("mkdtemp()");
+    return EXIT_FAILURE;
+  }
+
+  /* The Native App may exit before reading everything */
+
+  signal(SIGPIPE, SIG_IGN);
+
+  for (size_t i = 0; i < (sizeof(checks) / sizeof(checks[0])); i++)
+  {
+    /* Every check starts without cache files */
+    /* ("$HOME/Library/Caches" on macOS, created by the Native App) */
+
+    snprintf(options.cache_path, PATH_LENGTH, "%s/%zu", base_path, i);
+    mkdir(options.cache_path, 0700);
+
+    snprintf(library_path, sizeof(library_path), "%s/Library", options.cache_path);
+    mkdir(library_path, 0700);
+
+    result = checks[i].run(&(options));
+
+    printf("%s %s\n", result ? "[ ok ]" : "[FAIL]", checks[i].name);
+
+    if (!result)
+    {
+      failures += 1;
+    }
+  }
+
+  nftw(base_path, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+
+  printf("\n%zu of %zu checks failed\n",
+    failures,
+    sizeof(checks) / sizeof(checks[0]));
+
+  return (0 == failures) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**************************************************************/
@@ -0,0 +1,1045 @@
+/**
+ * @file "native/terminal_test/webcard_loadgen.c"
+ * Load generator and latency benchmark for the WebCard Native App.
+ *
+ * Spawns the Native App, speaks the Native Messaging framing
+ * (32-bit length + stringified JSON) and drives a configurable mix
+ * of requests at a target rate, with a fixed number of requests in flight.
+ * Run it against the simulated PC/SC backend ("-s" option) to get
+ * deterministic results without any hardware.
+ * With "-S", it measures the cold start of the Native App instead.
+ */
+
+#if defined(_WIN32)
+  #error("WIN32 not supported yet!")
+  #pragma GCC error "WIN32 not supported yet!"
+
+#elif defined(__linux__) || defined(__APPLE__)
+
+  #define _GNU_SOURCE  /* memmem */
+
+  #include <stdint.h>  /* uint32_t, uint64_t */
+  #include <stdlib.h>  /* EXIT_SUCCESS, EXIT_FAILURE, malloc, qsort, strtod */
+  #include <stdio.h>  /* printf, snprintf, perror */
+  #include <string.h>  /* strlen, strncmp, memmove, memmem */
+  #include <unistd.h>  /* execl, fork, pipe, write, read, close */
+  #include <fcntl.h>  /* O_NONBLOCK */
+  #include <poll.h>  /* poll */
+  #include <signal.h>  /* signal, SIGPIPE */
+  #include <sys/wait.h>  /* waitpid */
+  #include <time.h>  /* clock_gettime */
+  #include <errno.h>
+
+  typedef int BOOL;
+  #define FALSE  0
+  #define TRUE   1
+
+  #define WEBCARD_EXEC  "webcard"
+
+  #define READ_END   0
+  #define WRITE_END  1
+
+#else
+  #error("Unsupported Operating System, sorry!")
+  #pragma GCC error "Unsupported Operating System, sorry!"
+#endif
+
+/**************************************************************/
+
+/** Request kinds (order of the "-m" mix keys). */
+#define KIND_LIST        0
+#define KIND_CONNECT     1
+#define KIND_TRANSCEIVE  2
+#define KIND_BATCH       3
+#define KIND_VERSION     4
+#define KIND_COUNT       5
+
+static const char *kind_names[KIND_COUNT] =
+{
+  "list", "connect", "transceive", "batch", "version"
+};
+
+/** Outstanding requests are tracked in a ring indexed by request id. */
+#define SLOT_COUNT  65536
+
+#define MAX_BATCH  64
+
+#define REQUEST_LENGTH  512
+
+/** Cold start: longest wait for the responses of one launch. */
+#define STARTUP_TIMEOUT_MS  10000
+
+/**************************************************************/
+
+typedef struct
+{
+  const char *exec_path;
+  const char *farm_path;
+  const char *apdu;
+  unsigned int mix[KIND_COUNT];
+  double rate;
+  size_t in_flight;
+  size_t total;
+  size_t warmup;
+  size_t batch;
+  unsigned int reader;
+  double duration;
+  size_t launches;
+}
+options_t;
+
+typedef struct
+{
+  BOOL pending;
+  int kind;
+  uint64_t start_ns;
+}
+slot_t;
+
+typedef struct
+{
+  int fd_read;
+  int fd_write;
+  pid_t child_pid;
+
+  /* Receive buffer (one or more frames) */
+  uint8_t *buf;
+  size_t buf_length;
+  size_t buf_capacity;
+
+  slot_t *slots;
+  size_t in_flight;
+  size_t next_id;
+
+  /* Latencies of completed (measured) requests */
+  uint64_t *latencies[KIND_COUNT];
+  size_t latency_count[KIND_COUNT];
+  size_t errors[KIND_COUNT];
+  size_t completed;
+  size_t events;
+}
+session_t;
+
+/**************************************************************/
+
+uint64_t
+now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &(now));
+  return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+}
+
+/**************************************************************/
+
+void
+print_usage(const char *name)
+{
+  fprintf(stderr,
+    "Usage: %s [options] [path/to/webcard]\n"
+    "  -m MIX    request mix, e.g. \"list=1,connect=1,transceive=8,batch=1\"\n"
+    "            (default \"transceive=1\")\n"
+    "  -r RATE   target rate in requests per second (default 0 = unlimited)\n"
+    "  -k K      requests in flight (default 1, or the batch size)\n"
+    "  -n N      number of measured requests (default 10000)\n"
+    "  -w N      warm-up requests, not measured (default 100)\n"
+    "  -t SEC    stop after SEC seconds (default: no limit)\n"
+    "  -b B      transceive requests per batch (default 8)\n"
+    "  -R INDEX  reader index (default 0)\n"
+    "  -a APDU   hex command APDU to transceive (default \"FFCA000000\")\n"
+    "  -s FILE   simulated reader farm (sets WEBCARD_SIMULATOR)\n"
+    "  -S N      cold start: launch the Native App N times and measure\n"
+    "            the first response byte and the first list of readers\n",
+    name);
+}
+
+/**************************************************************/
+
+BOOL
+parse_mix(const char *text, unsigned int mix[KIND_COUNT])
+{
+  size_t name_length;
+  char *end;
+  BOOL found;
+
+  for (int i = 0; i < KIND_COUNT; i++)
+  {
+    mix[i] = 0;
+  }
+
+  while ('\0' != text[0])
+  {
+    found = FALSE;
+
+    for (int i = 0; (!found) && (i < KIND_COUNT); i++)
+    {
+      name_length = strlen(kind_names[i]);
+
+      if ((0 == strncmp(text, kind_names[i], name_length)) &&
+        ('=' == text[name_length]))
+      {
+        mix[i] = (unsigned int) strtoul(&(text[name_length + 1]), &(end), 10);
+        text = end;
+        found = TRUE;
+      }
+    }
+
+    if (!found) { return FALSE; }
+
+    if (',' == text[0]) { text++; }
+  }
+
+  for (int i = 0; i < KIND_COUNT; i++)
+  {
+    if (mix[i] > 0) { return TRUE; }
+  }
+
+  return FALSE;
+}
+
+/**************************************************************/
+
+BOOL
+parse_options(int argc, char **argv, options_t *options)
+{
+  int opt;
+  BOOL in_flight_given = FALSE;
+
+  options->exec_path = WEBCARD_EXEC;
+  options->farm_path = NULL;
+  options->apdu = "FFCA000000";
+  options->rate = 0;
+  options->in_flight = 1;
+  options->total = 10000;
+  options->warmup = 100;
+  options->batch = 8;
+  options->reader = 0;
+  options->duration = 0;
+  options->launches = 0;
+
+  parse_mix("transceive=1", options->mix);
+
+  while ((-1) != (opt = getopt(argc, argv, "m:r:k:n:w:t:b:R:a:s:S:h")))
+  {
+    switch (opt)
+    {
+      case 'm':
+        if (!parse_mix(optarg, options->mix)) { return FALSE; }
+        break;
+      case 'r':
+        options->rate = strtod(optarg, NULL);
+        break;
+      case 'k':
+        options->in_flight = strtoul(optarg, NULL, 10);
+        in_flight_given = TRUE;
+        break;
+      case 'n':
+        options->total = strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        options->warmup = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        options->duration = strtod(optarg, NULL);
+        break;
+      case 'b':
+        options->batch = strtoul(optarg, NULL, 10);
+        break;
+      case 'R':
+        options->reader = (unsigned int) strtoul(optarg, NULL, 10);
+        break;
+      case 'a':
+        options->apdu = optarg;
+        break;
+      case 's':
+        options->farm_path = optarg;
+        break;
+      case 'S':
+        options->launches = strtoul(optarg, NULL, 10);
+        if (0 == options->launches) { return FALSE; }
+        break;
+      default:
+        return FALSE;
+    }
+  }
+
+  if (optind < argc)
+  {
+    options->exec_path = argv[optind];
+  }
+
+  if ((0 == options->in_flight) || (options->in_flight >= SLOT_COUNT / 2) ||
+    (0 == options->batch) || (options->batch > MAX_BATCH) ||
+    (0 == options->total) || (options->rate < 0))
+  {
+    return FALSE;
+  }
+
+  /* Every launch is measured (one request of each kind) */
+
+  if (options->launches > 0)
+  {
+    options->warmup = 0;
+    options->total = options->launches;
+  }
+
+  /* A batch must fit in the in-flight window: the default window */
+  /* is widened, a window given with "-k" is never changed */
+
+  if ((options->mix[KIND_BATCH] > 0) && (options->batch > options->in_flight))
+  {
+    if (in_flight_given)
+    {
+      fprintf(stderr,
+        "-k %zu is smaller than the batch size (-b %zu)\n",
+        options->in_flight,
+        options->batch);
+
+      return FALSE;
+    }
+
+    options->in_flight = options->batch;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+spawn_host(const options_t *options, session_t *session)
+{
+  int pipe_child_to_parent[2];
+  int pipe_parent_to_child[2];
+
+  if ((-1) == pipe(pipe_child_to_parent))
+  {
+    perror("pipe(pipe_child_to_parent)");
+    return FALSE;
+  }
+
+  if ((-1) == pipe(pipe_parent_to_child))
+  {
+    perror("pipe(pipe_parent_to_child)");
+    close(pipe_child_to_parent[READ_END]);
+    close(pipe_child_to_parent[WRITE_END]);
+    return FALSE;
+  }
+
+  session->child_pid = fork();
+
+  if ((-1) == session->child_pid)
+  {
+    perror("fork()");
+    return FALSE;
+  }
+
+  if (0 == session->child_pid)
+  {
+    /* Child process: becomes the "Webcard Native App" */
+
+    dup2(pipe_parent_to_child[READ_END], STDIN_FILENO);
+    dup2(pipe_child_to_parent[WRITE_END], STDOUT_FILENO);
+
+    close(pipe_parent_to_child[READ_END]);
+    close(pipe_parent_to_child[WRITE_END]);
+    close(pipe_child_to_parent[READ_END]);
+    close(pipe_child_to_parent[WRITE_END]);
+
+    if (NULL != options->farm_path)
+    {
+      setenv("WEBCARD_SIMULATOR", options->farm_path, 1);
+    }
+
+    execl(options->exec_path, options->exec_path, NULL);
+    perror(" @ execl()");
+    _exit(EXIT_FAILURE);
+  }
+
+  /* Parent process */
+
+  close(pipe_child_to_parent[WRITE_END]);
+  close(pipe_parent_to_child[READ_END]);
+
+  session->fd_read = pipe_child_to_parent[READ_END];
+  session->fd_write = pipe_parent_to_child[WRITE_END];
+
+  if (0 != fcntl(session->fd_read, F_SETFL, O_NONBLOCK))
+  {
+    perror("fcntl(fd_read, F_SETFL, O_NONBLOCK)");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+write_all(int fd, const uint8_t *bytes, size_t length)
+{
+  ssize_t written;
+
+  while (length > 0)
+  {
+    written = write(fd, bytes, length);
+
+    if (written < 0)
+    {
+      if (EINTR == errno) { continue; }
+      perror("write()");
+      return FALSE;
+    }
+
+    bytes += written;
+    length -= (size_t) written;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Writes one framed request into `frame`, returns the frame length.
+ */
+size_t
+build_request(
+  const options_t *options,
+  int kind,
+  size_t id,
+  uint8_t *frame)
+{
+  uint32_t length;
+  char *json = (char *) &(frame[sizeof(uint32_t)]);
+  const size_t capacity = REQUEST_LENGTH - sizeof(uint32_t);
+
+  switch (kind)
+  {
+    case KIND_LIST:
+      length = snprintf(json, capacity, "{\"i\":\"%zu\",\"c\":1}", id);
+      break;
+
+    case KIND_CONNECT:
+      length = snprintf(json, capacity,
+        "{\"i\":\"%zu\",\"c\":2,\"r\":%u,\"p\":2}", id, options->reader);
+      break;
+
+    case KIND_VERSION:
+      length = snprintf(json, capacity, "{\"i\":\"%zu\",\"c\":10}", id);
+      break;
+
+    default:
+      length = snprintf(json, capacity,
+        "{\"i\":\"%zu\",\"c\":4,\"r\":%u,\"a\":\"%s\"}",
+        id, options->reader, options->apdu);
+      break;
+  }
+
+  memcpy(frame, &(length), sizeof(uint32_t));
+
+  return sizeof(uint32_t) + length;
+}
+
+/**************************************************************/
+
+/**
+ * Sends `count` requests of the same kind in a single write
+ * (a batch is a pipelined burst of transceive requests).
+ */
+BOOL
+send_requests(
+  const options_t *options,
+  session_t *session,
+  int kind,
+  size_t count,
+  uint64_t start_ns)
+{
+  uint8_t frames[REQUEST_LENGTH * MAX_BATCH];
+  size_t frames_length = 0;
+  slot_t *slot;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    slot = &(session->slots[session->next_id % SLOT_COUNT]);
+
+    if (slot->pending)
+    {
+      fprintf(stderr, "Request %zu never answered\n", session->next_id);
+      return FALSE;
+    }
+
+    slot->pending = TRUE;
+    slot->kind = kind;
+    slot->start_ns = start_ns;
+
+    frames_length += build_request(
+      options,
+      (KIND_BATCH == kind) ? KIND_TRANSCEIVE : kind,
+      session->next_id,
+      &(frames[frames_length]));
+
+    session->next_id += 1;
+    session->in_flight += 1;
+  }
+
+  return write_all(session->fd_write, frames, frames_length);
+}
+
+/**************************************************************/
+
+/**
+ * Handles one response (or Reader Event) frame.
+ */
+void
+handle_response(
+  const options_t *options,
+  session_t *session,
+  const char *json,
+  size_t length,
+  uint64_t end_ns)
+{
+  const char *id_text;
+  size_t id;
+  slot_t *slot;
+  int kind;
+  BOOL failed;
+
+  /* Responses start with the "i" key, Reader Events don't */
+
+  if ((length < 8) || (0 != strncmp(json, "{\"i\":\"", 6)) || ('"' == json[6]))
+  {
+    session->events += 1;
+    return;
+  }
+
+  id_text = &(json[6]);
+  id = 0;
+
+  while (((size_t) (id_text - json) < length) &&
+    (id_text[0] >= '0') && (id_text[0] <= '9'))
+  {
+    id = (id * 10) + (size_t) (id_text[0] - '0');
+    id_text++;
+  }
+
+  slot = &(session->slots[id % SLOT_COUNT]);
+
+  if (!slot->pending) { return; }
+
+  slot->pending = FALSE;
+  session->in_flight -= 1;
+  session->completed += 1;
+
+  kind = slot->kind;
+
+  /* Failed commands are flagged with "incomplete", */
+  /* failed transmissions have no "d" key */
+
+  failed = (NULL != memmem(json, length, "\"incomplete\"", 12));
+
+  if ((!failed) && ((KIND_TRANSCEIVE == kind) || (KIND_BATCH == kind)))
+  {
+    failed = (NULL == memmem(json, length, "\"d\":", 4));
+  }
+
+  if (id < options->warmup) { return; }
+
+  if (failed)
+  {
+    session->errors[kind] += 1;
+  }
+  else
+  {
+    session->latencies[kind][session->latency_count[kind]] =
+      end_ns - slot->start_ns;
+    session->latency_count[kind] += 1;
+  }
+}
+
+/**************************************************************/
+
+/**
+ * Reads whatever is available, then handles every complete frame.
+ */
+BOOL
+receive_responses(
+  const options_t *options,
+  session_t *session,
+  int timeout_ms)
+{
+  struct pollfd poll_fd;
+  ssize_t received;
+  uint32_t frame_length;
+  size_t offset;
+  uint64_t end_ns;
+  uint8_t *new_buf;
+
+  poll_fd.fd = session->fd_read;
+  poll_fd.events = POLLIN;
+  poll_fd.revents = 0;
+
+  if (poll(&(poll_fd), 1, timeout_ms) <= 0)
+  {
+    return TRUE;
+  }
+
+  while (TRUE)
+  {
+    if (session->buf_capacity - session->buf_length < 65536)
+    {
+      new_buf = realloc(session->buf, session->buf_capacity * 2);
+      if (NULL == new_buf) { return FALSE; }
+
+      session->buf = new_buf;
+      session->buf_capacity *= 2;
+    }
+
+    received = read(
+      session->fd_read,
+      &(session->buf[session->buf_length]),
+      session->buf_capacity - session->buf_length);
+
+    if (received > 0)
+    {
+      session->buf_length += (size_t) received;
+      continue;
+    }
+
+    if ((0 == received) ||
+      ((EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno)))
+    {
+      fprintf(stderr, "The Native App closed its output\n");
+      return FALSE;
+    }
+
+    break;
+  }
+
+  end_ns = now_ns();
+  offset = 0;
+
+  while ((session->buf_length - offset) >= sizeof(uint32_t))
+  {
+    memcpy(&(frame_length), &(session->buf[offset]), sizeof(uint32_t));
+
+    if ((session->buf_length - offset - sizeof(uint32_t)) < frame_length)
+    {
+      break;
+    }
+
+    handle_response(
+      options,
+      session,
+      (const char *) &(session->buf[offset + sizeof(uint32_t)]),
+      frame_length,
+      end_ns);
+
+    offset += sizeof(uint32_t) + frame_length;
+  }
+
+  memmove(session->buf, &(session->buf[offset]), session->buf_length - offset);
+  session->buf_length -= offset;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+int
+compare_latencies(const void *left, const void *right)
+{
+  const uint64_t a = ((const uint64_t *) left)[0];
+  const uint64_t b = ((const uint64_t *) right)[0];
+
+  return (a > b) - (a < b);
+}
+
+/**************************************************************/
+
+double
+percentile_us(const uint64_t *sorted, size_t count, double fraction)
+{
+  size_t index;
+
+  if (0 == count) { return 0; }
+
+  index = (size_t) (fraction * (double) count);
+  if (index >= count) { index = count - 1; }
+
+  return (double) sorted[index] / 1000.0;
+}
+
+/**************************************************************/
+
+void
+print_latencies(const char *name, uint64_t *latencies, size_t count, size_t errors)
+{
+  double sum = 0;
+
+  qsort(latencies, count, sizeof(uint64_t), compare_latencies);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    sum += (double) latencies[i];
+  }
+
+  printf("%-10s %9zu %7zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+    name,
+    count,
+    errors,
+    (count > 0) ? (double) latencies[0] / 1000.0 : 0,
+    (count > 0) ? (sum / (double) count) / 1000.0 : 0,
+    percentile_us(latencies, count, 0.50),
+    percentile_us(latencies, count, 0.99),
+    percentile_us(latencies, count, 0.999),
+    (count > 0) ? (double) latencies[count - 1] / 1000.0 : 0);
+}
+
+/**************************************************************/
+
+/**
+ * Picks the next request kind, spreading the mix evenly (no randomness,
+ * so that runs are repeatable).
+ */
+int
+next_kind(const options_t *options, long *credits)
+{
+  int best = (-1);
+  long best_credit = 0;
+  long weight_sum = 0;
+
+  for (int i = 0; i < KIND_COUNT; i++)
+  {
+    credits[i] += (long) options->mix[i];
+    weight_sum += (long) options->mix[i];
+
+    if ((options->mix[i] > 0) && ((best < 0) || (credits[i] > best_credit)))
+    {
+      best = i;
+      best_credit = credits[i];
+    }
+  }
+
+  credits[best] -= weight_sum;
+
+  return best;
+}
+
+/**************************************************************/
+
+BOOL
+run_benchmark(const options_t *options, session_t *session)
+{
+  long credits[KIND_COUNT] = {0};
+  size_t planned = options->warmup + options->total;
+  uint64_t start_ns;
+  uint64_t measure_start_ns = 0;
+  uint64_t measure_end_ns;
+  uint64_t due_ns;
+  uint64_t now;
+  uint64_t deadline_ns = 0;
+  size_t measured;
+  size_t count;
+  size_t sent = 0;
+  int kind = next_kind(options, credits);
+  int timeout_ms;
+  double elapsed;
+
+  /* Open the connection before measuring anything */
+
+  if (!send_requests(options, session, KIND_CONNECT, 1, now_ns()))
+  {
+    return FALSE;
+  }
+
+  while (session->in_flight > 0)
+  {
+    if (!receive_responses(options, session, 1000)) { return FALSE; }
+  }
+
+  if (session->errors[KIND_CONNECT] > 0)
+  {
+    fprintf(stderr, "Could not connect to reader %u\n", options->reader);
+    return FALSE;
+  }
+
+  session->completed = 0;
+  session->next_id = 0;
+  session->errors[KIND_CONNECT] = 0;
+  session->latency_count[KIND_CONNECT] = 0;
+
+  start_ns = now_ns();
+
+  if (options->duration > 0)
+  {
+    deadline_ns = start_ns + (uint64_t) (options->duration * 1e9);
+  }
+
+  while (session->completed < sent || sent < planned)
+  {
+    now = now_ns();
+
+    if ((0 == measure_start_ns) && (session->completed >= options->warmup))
+    {
+      measure_start_ns = now;
+    }
+
+    if ((0 != deadline_ns) && (now >= deadline_ns) && (sent < planned))
+    {
+      /* Out of time: only wait for the requests already sent */
+      planned = sent;
+    }
+
+    timeout_ms = 100;
+
+    if (sent < planned)
+    {
+      count = (KIND_BATCH == kind) ? options->batch : 1;
+
+      /* Open loop: requests are due at a fixed rate, and latency */
+      /* counts from the due time (queueing delay included) */
+
+      due_ns = (options->rate > 0) ?
+        start_ns + (uint64_t) ((double) sent * 1e9 / options->rate) :
+        now;
+
+      if ((session->in_flight + count <= options->in_flight) && (due_ns <= now))
+      {
+        if (!send_requests(options, session, kind, count, due_ns))
+        {
+          return FALSE;
+        }
+
+        sent += count;
+        kind = next_kind(options, credits);
+        continue;
+      }
+
+      if (due_ns > now)
+      {
+        timeout_ms = (int) ((due_ns - now) / 1000000);
+      }
+      else
+      {
+        timeout_ms = 0;
+      }
+    }
+
+    if (!receive_responses(options, session, timeout_ms)) { return FALSE; }
+  }
+
+  measure_end_ns = now_ns();
+
+  if (0 == measure_start_ns)
+  {
+    measure_start_ns = start_ns;
+  }
+
+  /* Report */
+
+  measured = 0;
+
+  for (int i = 0; i < KIND_COUNT; i++)
+  {
+    measured += session->latency_count[i] + session->errors[i];
+  }
+
+  elapsed = (double) (measure_end_ns - measure_start_ns) / 1e9;
+
+  printf("Native App: %s%s%s\n",
+    options->exec_path,
+    (NULL != options->farm_path) ? ", simulated farm: " : "",
+    (NULL != options->farm_path) ? options->farm_path : "");
+
+  printf("Requests in flight: %zu, target rate: %.0f req/s%s\n",
+    options->in_flight,
+    options->rate,
+    (0 == options->rate) ? " (unlimited)" : "");
+
+  printf("Measured requests: %zu in %.3f s, throughput: %.1f req/s, " \
+    "reader events: %zu\n\n",
+    measured,
+    elapsed,
+    (elapsed > 0) ? (double) measured / elapsed : 0,
+    session->events);
+
+  printf("%-10s %9s %7s %10s %10s %10s %10s %10s %10s\n",
+    "kind", "ok", "errors",
+    "min(us)", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+
+  for (int i = 0; i < KIND_COUNT; i++)
+  {
+    if (options->mix[i] > 0)
+    {
+      print_latencies(
+        kind_names[i],
+        session->latencies[i],
+        session->latency_count[i],
+        session->errors[i]);
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Launches the Native App `-S` times. Get Version and List Readers
+ * requests are written right after `fork`: the first response byte shows
+ * how soon the Native App answers, the List Readers response how soon
+ * PC/SC is initialized. Everything counts from just before `fork`.
+ */
+BOOL
+run_startup(const options_t *options, session_t *session)
+{
+  uint64_t *first_bytes = malloc(sizeof(uint64_t) * options->launches);
+  uint64_t start_ns;
+  uint64_t give_up_ns;
+  struct pollfd poll_fd;
+  int status;
+  BOOL result = (NULL != first_bytes);
+
+  for (size_t run = 0; result && (run < options->launches); run++)
+  {
+    session->buf_length = 0;
+    session->next_id = 0;
+    session->in_flight = 0;
+
+    start_ns = now_ns();
+    give_up_ns = start_ns + ((uint64_t) STARTUP_TIMEOUT_MS * 1000000);
+
+    if (!spawn_host(options, session))
+    {
+      result = FALSE;
+      break;
+    }
+
+    result = send_requests(options, session, KIND_VERSION, 1, start_ns) &&
+      send_requests(options, session, KIND_LIST, 1, start_ns);
+
+    if (result)
+    {
+      poll_fd.fd = session->fd_read;
+      poll_fd.events = POLLIN;
+      poll_fd.revents = 0;
+
+      result = (poll(&(poll_fd), 1, STARTUP_TIMEOUT_MS) > 0);
+      first_bytes[run] = now_ns() - start_ns;
+    }
+
+    while (result && (session->in_flight > 0))
+    {
+      result = (now_ns() < give_up_ns) &&
+        receive_responses(options, session, 100);
+    }
+
+    if (!result)
+    {
+      fprintf(stderr, "No response from the Native App (launch %zu)\n", run);
+    }
+
+    close(session->fd_write);
+    close(session->fd_read);
+    waitpid(session->child_pid, &(status), 0);
+  }
+
+  if (result)
+  {
+    printf("Native App: %s%s%s\n",
+      options->exec_path,
+      (NULL != options->farm_path) ? ", simulated farm: " : "",
+      (NULL != options->farm_path) ? options->farm_path : "");
+
+    printf("Cold starts: %zu (latency counts from fork)\n\n",
+      options->launches);
+
+    printf("%-10s %9s %7s %10s %10s %10s %10s %10s %10s\n",
+      "stage", "ok", "errors",
+      "min(us)", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+
+    print_latencies("first byte", first_bytes, options->launches, 0);
+
+    print_latencies(
+      kind_names[KIND_VERSION],
+      session->latencies[KIND_VERSION],
+      session->latency_count[KIND_VERSION],
+      session->errors[KIND_VERSION]);
+
+    print_latencies(
+      kind_names[KIND_LIST],
+      session->latencies[KIND_LIST],
+      session->latency_count[KIND_LIST],
+      session->errors[KIND_LIST]);
+  }
+
+  free(first_bytes);
+
+  return result;
+}
+
+/**************************************************************/
+
+int
+main(int argc, char **argv)
+{
+  options_t options;
+  session_t session;
+  BOOL result;
+  int status;
+
+  if (!parse_options(argc, argv, &(options)))
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  memset(&(session), 0x00, sizeof(session_t));
+
+  session.buf_capacity = 1 << 20;
+  session.buf = malloc(session.buf_capacity);
+  session.slots = calloc(SLOT_COUNT, sizeof(slot_t));
+
+  result = (NULL != session.buf) && (NULL != session.slots);
+
+  for (int i = 0; result && (i < KIND_COUNT); i++)
+  {
+    session.latencies[i] = malloc(sizeof(uint64_t) * (options.total + MAX_BATCH));
+    result = (NULL != session.latencies[i]);
+  }
+
+  /* The Native App may exit before reading everything */
+
+  signal(SIGPIPE, SIG_IGN);
+
+  if (result && (options.launches > 0))
+  {
+    result = run_startup(&(options), &(session));
+  }
+  else if (result)
+  {
+    result = spawn_host(&(options), &(session));
+
+    if (result)
+    {
+      result = run_benchmark(&(options), &(session));
+
+      close(session.fd_write);
+      close(session.fd_read);
+      waitpid(session.child_pid, &(status), 0);
+    }
+  }
+
+  for (int i = 0; i < KIND_COUNT; i++)
+  {
+    free(session.latencies[i]);
+  }
+
+  free(session.slots);
+  free(session.buf);
+
+  return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**************************************************************/
@@ -0,0 +1,1322 @@
+/**
+ * @file "native/terminal_test/webcard_replay.c"
+ * Offline replay of an APDU trace recorded by the WebCard Native App.
+ *
+ * Rebuilds a simulated reader farm from the trace (readers, cards
+ * identified by their ATR, recorded responses with their timing,
+ * card insertions and removals), then runs the Native App against
+ * that farm, sends the recorded requests at their recorded times
+ * and compares the recorded and the replayed latency of every command.
+ */
+
+#if defined(__linux__) || defined(__APPLE__)
+  #define _GNU_SOURCE  /* memmem, nftw */
+#endif
+
+#include "smart_cards/smart_cards.h"
+
+#if defined(_WIN32)
+  #error("WIN32 not supported yet!")
+  #pragma GCC error "WIN32 not supported yet!"
+
+#elif defined(__linux__) || defined(__APPLE__)
+
+  #include <stdio.h>  /* printf, fprintf, fopen, perror */
+  #include <signal.h>  /* signal, SIGPIPE */
+  #include <sys/wait.h>  /* waitpid */
+  #include <ftw.h>  /* nftw */
+  #include <errno.h>
+
+  #define WEBCARD_EXEC  "webcard"
+
+  #define READ_END   0
+  #define WRITE_END  1
+
+#else
+  #error("Unsupported Operating System, sorry!")
+  #pragma GCC error "Unsupported Operating System, sorry!"
+#endif
+
+/**************************************************************/
+
+#define NAME_LENGTH  128
+
+#define ID_LENGTH  128
+
+/** Largest command number with its own row in the report. */
+#define MAX_COMMAND  31
+
+/**************************************************************/
+
+typedef struct
+{
+  const char *trace_path;
+  const char *exec_path;
+  char farm_path[1024];
+  BOOL farm_only;
+  double speed;
+  double wait;
+}
+options_t;
+
+typedef struct
+{
+  UTF8String command;
+  UTF8String response;
+  uint64_t latency_us;
+}
+sim_response_t;
+
+typedef struct
+{
+  BYTE atr[WEBCARD_ATR_MAX_SIZE];
+  size_t atr_length;
+  sim_response_t *responses;
+  size_t response_count;
+}
+sim_card_t;
+
+typedef struct
+{
+  uint64_t at_ms;
+  size_t card;
+}
+sim_step_t;
+
+typedef struct
+{
+  char name[NAME_LENGTH];
+  BOOL seen;
+  size_t initial_card;
+  size_t current_card;
+  sim_step_t *steps;
+  size_t step_count;
+}
+sim_reader_t;
+
+typedef struct
+{
+  uint64_t time;
+  uint32_t command;
+  BOOL recorded_failed;
+  uint64_t recorded_ns;
+  const BYTE *json;
+  size_t json_length;
+  char id[ID_LENGTH];
+
+  BOOL sent;
+  BOOL done;
+  BOOL replayed_failed;
+  uint64_t sent_ns;
+  uint64_t replayed_ns;
+}
+request_t;
+
+typedef struct
+{
+  LPBYTE file;
+  size_t file_length;
+
+  sim_card_t *cards;
+  size_t card_count;
+
+  sim_reader_t *readers;
+  size_t reader_count;
+
+  request_t *requests;
+  size_t request_count;
+  size_t skipped;
+}
+replay_t;
+
+typedef struct
+{
+  int fd_read;
+  int fd_write;
+  pid_t child_pid;
+  char cache_dir[256];
+
+  uint8_t *buf;
+  size_t buf_length;
+  size_t buf_capacity;
+
+  size_t answered;
+  size_t events;
+}
+session_t;
+
+/**************************************************************/
+
+uint64_t
+now_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &(now));
+  return ((uint64_t) now.tv_sec * 1000000000) + (uint64_t) now.tv_nsec;
+}
+
+/**************************************************************/
+
+void
+print_usage(const char *name)
+{
+  printf(
+    "Usage: %s [options] <trace file> [webcard executable]\n"
+    "  -f <file>   where to save the simulated reader farm\n"
+    "              (default: \"<trace file>.farm.json\")\n"
+    "  -n          only save the reader farm, do not run the Native App\n"
+    "  -s <speed>  replay speed factor (default 1, \"2\" is twice as fast)\n"
+    "  -w <sec>    how long to wait for the last responses (default 5)\n"
+    "The trace file is \"" WEBCARD_TRACE_FILE_NAME "\" from the per-user cache\n"
+    "directory of WebCard (e.g. \"~/.cache/webcard\").\n",
+    name);
+}
+
+/**************************************************************/
+
+BOOL
+parse_options(int argc, char **argv, options_t *options)
+{
+  int i;
+  const char *farm_path = NULL;
+
+  options->trace_path = NULL;
+  options->exec_path = WEBCARD_EXEC;
+  options->farm_only = FALSE;
+  options->speed = 1;
+  options->wait = 5;
+
+  for (i = 1; i < argc; i++)
+  {
+    if ('-' != argv[i][0]) { break; }
+
+    if (0 == strcmp(argv[i], "-n"))
+    {
+      options->farm_only = TRUE;
+      continue;
+    }
+
+    if ((i + 1) >= argc) { return FALSE; }
+
+    if (0 == strcmp(argv[i], "-f"))
+    {
+      farm_path = argv[++i];
+    }
+    else if (0 == strcmp(argv[i], "-s"))
+    {
+      options->speed = strtod(argv[++i], NULL);
+    }
+    else if (0 == strcmp(argv[i], "-w"))
+    {
+      options->wait = strtod(argv[++i], NULL);
+    }
+    else
+    {
+      return FALSE;
+    }
+  }
+
+  if (i >= argc) { return FALSE; }
+
+  options->trace_path = argv[i++];
+
+  if (i < argc)
+  {
+    options->exec_path = argv[i++];
+  }
+
+  if ((i < argc) || (options->speed <= 0) || (options->wait < 0))
+  {
+    return FALSE;
+  }
+
+  if (NULL != farm_path)
+  {
+    snprintf(options->farm_path, sizeof(options->farm_path), "%s", farm_path);
+  }
+  else
+  {
+    snprintf(options->farm_path, sizeof(options->farm_path),
+      "%s.farm.json", options->trace_path);
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+load_file(const char *path, replay_t *replay)
+{
+  FILE *file = fopen(path, "rb");
+  long length;
+
+  if (NULL == file)
+  {
+    perror(path);
+    return FALSE;
+  }
+
+  fseek(file, 0, SEEK_END);
+  length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if (length <= WEBCARD_TRACE_FILE__HEADER_SIZE)
+  {
+    fprintf(stderr, "%s: not a trace file\n", path);
+    fclose(file);
+    return FALSE;
+  }
+
+  replay->file = malloc((size_t) length);
+  replay->file_length = (size_t) length;
+
+  if ((NULL == replay->file) ||
+    (1 != fread(replay->file, (size_t) length, 1, file)))
+  {
+    fprintf(stderr, "%s: read error\n", path);
+    fclose(file);
+    return FALSE;
+  }
+
+  fclose(file);
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Finds (or adds) the simulated card with given ATR.
+ */
+size_t
+find_card(replay_t *replay, const BYTE *atr, size_t atr_length)
+{
+  sim_card_t *card;
+  sim_card_t *new_cards;
+
+  if (atr_length > WEBCARD_ATR_MAX_SIZE)
+  {
+    atr_length = WEBCARD_ATR_MAX_SIZE;
+  }
+
+  for (size_t i = 0; i < replay->card_count; i++)
+  {
+    card = &(replay->cards[i]);
+
+    if ((card->atr_length == atr_length) &&
+      (0 == memcmp(card->atr, atr, atr_length)))
+    {
+      return i;
+    }
+  }
+
+  new_cards = realloc(replay->cards, sizeof(sim_card_t) * (replay->card_count + 1));
+  if (NULL == new_cards) { return SIZE_MAX; }
+
+  replay->cards = new_cards;
+  card = &(replay->cards[replay->card_count]);
+
+  memcpy(card->atr, atr, atr_length);
+  card->atr_length = atr_length;
+  card->responses = NULL;
+  card->response_count = 0;
+
+  return replay->card_count++;
+}
+
+/**************************************************************/
+
+/**
+ * Remembers the first successful response of a card to given command.
+ */
+BOOL
+add_response(sim_card_t *card, const SCardTraceRecord *record)
+{
+  const BYTE *data = (const BYTE *) &(record[1]);
+  UTF8String command;
+  sim_response_t *new_responses;
+  sim_response_t *response;
+
+  UTF8String_init(&(command));
+
+  if (!UTF8String_pushBytesAsHex(&(command), record->split, data))
+  {
+    UTF8String_destroy(&(command));
+    return FALSE;
+  }
+
+  for (size_t i = 0; i < card->response_count; i++)
+  {
+    if (UTF8String_matches(&(card->responses[i].command), (LPCSTR) command.text))
+    {
+      UTF8String_destroy(&(command));
+      return TRUE;
+    }
+  }
+
+  new_responses = realloc(
+    card->responses,
+    sizeof(sim_response_t) * (card->response_count + 1));
+
+  if (NULL == new_responses)
+  {
+    UTF8String_destroy(&(command));
+    return FALSE;
+  }
+
+  card->responses = new_responses;
+  response = &(card->responses[card->response_count]);
+
+  response->command = command;
+  response->latency_us = record->duration / 1000;
+
+  UTF8String_init(&(response->response));
+
+  card->response_count += 1;
+
+  return UTF8String_pushBytesAsHex(
+    &(response->response),
+    record->dataLength - record->split,
+    &(data[record->split]));
+}
+
+/**************************************************************/
+
+BOOL
+add_step(sim_reader_t *reader, uint64_t at_ms, size_t card)
+{
+  sim_step_t *new_steps = realloc(
+    reader->steps,
+    sizeof(sim_step_t) * (reader->step_count + 1));
+
+  if (NULL == new_steps) { return FALSE; }
+
+  reader->steps = new_steps;
+  reader->steps[reader->step_count].at_ms = at_ms;
+  reader->steps[reader->step_count].card = card;
+  reader->step_count += 1;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Copies the "i" (unique message identifier) of a recorded request.
+ */
+BOOL
+extract_request_id(request_t *request)
+{
+  BOOL test_bool;
+  JsonByteStream stream;
+  JsonObject json_request;
+  JsonObject *json_request_ref = &(json_request);
+  JsonValue json_value;
+  const UTF8String *id;
+
+  /* The stream only points at the trace data (nothing to destroy) */
+
+  stream.head = (LPBYTE) request->json;
+  stream.head_length = request->json_length;
+  stream.tail = stream.head;
+  stream.tail_length = stream.head_length;
+
+  JsonObject_init(&(json_request));
+
+  test_bool =
+    JsonObject_parse(&(json_request_ref), FALSE, &(stream)) &&
+    JsonObject_getValue(&(json_request), &(json_value), "i") &&
+    (JSON_VALUE_TYPE__STRING == json_value.type);
+
+  if (test_bool)
+  {
+    id = json_value.value;
+    test_bool = (id->length > 0) && (id->length < ID_LENGTH);
+
+    if (test_bool)
+    {
+      memcpy(request->id, id->text, id->length);
+      request->id[id->length] = '\0';
+    }
+  }
+
+  JsonObject_destroy(&(json_request));
+
+  return test_bool;
+}
+
+/**************************************************************/
+
+/**
+ * Walks the ring (oldest record first) and builds the reader farm
+ * and the list of requests.
+ */
+BOOL
+analyze_trace(const options_t *options, replay_t *replay)
+{
+  const SCardTraceHeader *header = (const SCardTraceHeader *) replay->file;
+  const SCardTraceRecord *record;
+  const BYTE *data;
+  const BYTE *ring = &(replay->file[WEBCARD_TRACE_FILE__HEADER_SIZE]);
+  sim_reader_t *reader;
+  request_t *request;
+  size_t offset;
+  size_t remaining;
+  size_t card;
+  uint64_t snapshot_time = UINT64_MAX;
+
+  if ((0 != memcmp(header->magic, WEBCARD_TRACE_FILE__MAGIC, 4)) ||
+    (WEBCARD_TRACE_FILE__VERSION != header->version) ||
+    (header->ringSize > (replay->file_length - WEBCARD_TRACE_FILE__HEADER_SIZE)) ||
+    (header->usedBytes > header->ringSize) ||
+    (header->tail >= header->ringSize))
+  {
+    fprintf(stderr, "%s: not a valid trace file\n", options->trace_path);
+    return FALSE;
+  }
+
+  printf("Trace: %llu records written, %llu overwritten, %u bytes used\n",
+    (unsigned long long) header->written,
+    (unsigned long long) header->dropped,
+    header->usedBytes);
+
+  if (header->dropped > 0)
+  {
+    printf("Warning: the oldest records were overwritten, the replay starts in the"
+      " middle of a session (readers, cards or connections may be missing)\n");
+  }
+
+  replay->requests = malloc(sizeof(request_t) * (1 + header->written));
+  if (NULL == replay->requests) { return FALSE; }
+
+  /* Every reader index seen in the trace becomes a simulated reader */
+
+  offset = header->tail;
+  remaining = header->usedBytes;
+
+  while (remaining > 0)
+  {
+    record = (const SCardTraceRecord *) &(ring[offset]);
+    data = (const BYTE *) &(record[1]);
+
+    if ((record->length < sizeof(uint32_t)) ||
+      (record->length > remaining) ||
+      ((offset + record->length) > header->ringSize) ||
+      ((WEBCARD_TRACE_RECORD__PADDING != record->type) &&
+        ((record->length < sizeof(SCardTraceRecord)) ||
+        (record->dataLength > (record->length - sizeof(SCardTraceRecord))) ||
+        (record->split > record->dataLength))))
+    {
+      fprintf(stderr, "Damaged record at offset %zu\n", offset);
+      return FALSE;
+    }
+
+    remaining -= record->length;
+    offset += record->length;
+    if (offset >= header->ringSize) { offset = 0; }
+
+    /* Padding (the skipped end of the ring) can be shorter than a record */
+
+    if (WEBCARD_TRACE_RECORD__PADDING == record->type)
+    {
+      continue;
+    }
+
+    if ((WEBCARD_TRACE_NO_READER != record->reader) &&
+      (record->reader >= replay->reader_count))
+    {
+      reader = realloc(replay->readers, sizeof(sim_reader_t) * (record->reader + 1));
+      if (NULL == reader) { return FALSE; }
+
+      replay->readers = reader;
+
+      for (size_t i = replay->reader_count; i <= record->reader; i++)
+      {
+        reader = &(replay->readers[i]);
+
+        snprintf(reader->name, NAME_LENGTH, "Traced Reader %zu", i);
+        reader->seen = FALSE;
+        reader->initial_card = SIZE_MAX;
+        reader->current_card = SIZE_MAX;
+        reader->steps = NULL;
+        reader->step_count = 0;
+      }
+
+      replay->reader_count = record->reader + 1;
+    }
+
+    reader = (WEBCARD_TRACE_NO_READER != record->reader) ?
+      &(replay->readers[record->reader]) :
+      NULL;
+
+    if ((NULL == reader) && (WEBCARD_TRACE_RECORD__REQUEST != record->type))
+    {
+      continue;
+    }
+
+    switch (record->type)
+    {
+      case WEBCARD_TRACE_RECORD__READER:
+      {
+        /* Simulated readers have ASCII names, the first name wins */
+
+        size_t i;
+
+        if (reader->seen) { break; }
+
+        for (i = 0; (i < record->dataLength) && (i < (NAME_LENGTH - 1)); i++)
+        {
+          reader->name[i] =
+            ((data[i] < 0x20) || (data[i] >= 0x7F) ||
+              ('"' == data[i]) || ('\\' == data[i])) ?
+            '?' :
+            (char) data[i];
+        }
+
+        reader->name[i] = '\0';
+        reader->seen = TRUE;
+
+        if (UINT64_MAX == snapshot_time)
+        {
+          snapshot_time = record->time;
+        }
+
+        break;
+      }
+      case WEBCARD_TRACE_RECORD__EVENT:
+      {
+        if (WEBCARD_READER_EVENT__CARD_INSERTION == record->status)
+        {
+          card = find_card(replay, data, record->dataLength);
+          if (SIZE_MAX == card) { return FALSE; }
+        }
+        else
+        {
+          card = SIZE_MAX;
+        }
+
+        reader->current_card = card;
+
+        /* Cards present when tracing started are in the readers from the start */
+
+        if ((record->time == snapshot_time) && (0 == reader->step_count))
+        {
+          reader->initial_card = card;
+        }
+        else if (!add_step(
+          reader,
+          (uint64_t) ((double) record->time / 1000000.0 / options->speed),
+          card))
+        {
+          return FALSE;
+        }
+
+        break;
+      }
+      case WEBCARD_TRACE_RECORD__APDU:
+      {
+        if ((WEBCARD_TRACE_FLAG__FAILED & record->flags) ||
+          (WEBCARD_TRACE_FLAG__TRUNCATED & record->flags))
+        {
+          break;
+        }
+
+        /* The insertion of this card was overwritten: unknown ATR */
+
+        if ((SIZE_MAX == reader->current_card) && (0 == reader->step_count))
+        {
+          card = find_card(replay, (const BYTE *) "\x3B\x00", 2);
+          if (SIZE_MAX == card) { return FALSE; }
+
+          reader->initial_card = card;
+          reader->current_card = card;
+        }
+
+        if ((SIZE_MAX != reader->current_card) &&
+          !add_response(&(replay->cards[reader->current_card]), record))
+        {
+          return FALSE;
+        }
+
+        break;
+      }
+      case WEBCARD_TRACE_RECORD__REQUEST:
+      {
+        request = &(replay->requests[replay->request_count]);
+        memset(request, 0x00, sizeof(request_t));
+
+        request->time = record->time;
+        request->command = record->status;
+        request->recorded_failed = (0 != (WEBCARD_TRACE_FLAG__FAILED & record->flags));
+        request->recorded_ns = record->duration;
+        request->json = data;
+        request->json_length = record->dataLength;
+
+        /* Replaying the trace command would overwrite the trace */
+
+        if ((WEBCARD_TRACE_FLAG__TRUNCATED & record->flags) ||
+          (WEBCARD_COMMAND__TRACE == record->status) ||
+          (!extract_request_id(request)))
+        {
+          replay->skipped += 1;
+          break;
+        }
+
+        replay->request_count += 1;
+        break;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+int
+compare_requests(const void *left, const void *right)
+{
+  const request_t *a = left;
+  const request_t *b = right;
+
+  /* Requests are recorded when answered, replayed when received */
+
+  if (a->time != b->time)
+  {
+    return (a->time > b->time) - (a->time < b->time);
+  }
+
+  return (a->json > b->json) - (a->json < b->json);
+}
+
+/**************************************************************/
+
+void
+print_hex(FILE *file, const BYTE *bytes, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    fprintf(file, "%02X", bytes[i]);
+  }
+}
+
+/**************************************************************/
+
+BOOL
+save_farm(const options_t *options, const replay_t *replay)
+{
+  FILE *file = fopen(options->farm_path, "w");
+  const sim_card_t *card;
+  const sim_reader_t *reader;
+
+  if (NULL == file)
+  {
+    perror(options->farm_path);
+    return FALSE;
+  }
+
+  fprintf(file, "{\n  \"cards\": [");
+
+  for (size_t i = 0; i < replay->card_count; i++)
+  {
+    card = &(replay->cards[i]);
+
+    fprintf(file, "%s\n    {\"name\": \"card%zu\", \"atr\": \"", (i > 0) ? "," : "", i);
+    print_hex(file, card->atr, card->atr_length);
+    fprintf(file, "\", \"latency\": 0, \"responses\": [");
+
+    for (size_t j = 0; j < card->response_count; j++)
+    {
+      fprintf(file,
+        "%s\n      {\"command\": \"%s\", \"response\": \"%s\", \"latency\": %llu}",
+        (j > 0) ? "," : "",
+        (const char *) card->responses[j].command.text,
+        (const char *) card->responses[j].response.text,
+        (unsigned long long) card->responses[j].latency_us);
+    }
+
+    fprintf(file, "]}");
+  }
+
+  fprintf(file, "\n  ],\n  \"readers\": [");
+
+  for (size_t i = 0; i < replay->reader_count; i++)
+  {
+    reader = &(replay->readers[i]);
+
+    fprintf(file, "%s\n    {\"name\": \"%s\"", (i > 0) ? "," : "", reader->name);
+
+    if (SIZE_MAX != reader->initial_card)
+    {
+      fprintf(file, ", \"card\": \"card%zu\"", reader->initial_card);
+    }
+
+    fprintf(file, ", \"timeline\": [");
+
+    for (size_t j = 0; j < reader->step_count; j++)
+    {
+      fprintf(file, "%s{\"at\": %llu, \"card\": \"",
+        (j > 0) ? ", " : "",
+        (unsigned long long) reader->steps[j].at_ms);
+
+      if (SIZE_MAX != reader->steps[j].card)
+      {
+        fprintf(file, "card%zu", reader->steps[j].card);
+      }
+
+      fprintf(file, "\"}");
+    }
+
+    fprintf(file, "]}");
+  }
+
+  fprintf(file, "\n  ]\n}\n");
+
+  if (0 != fclose(file))
+  {
+    perror(options->farm_path);
+    return FALSE;
+  }
+
+  printf("Reader farm: %zu readers, %zu cards, saved to \"%s\"\n",
+    replay->reader_count,
+    replay->card_count,
+    options->farm_path);
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+spawn_host(const options_t *options, session_t *session)
+{
+  int pipe_child_to_parent[2];
+  int pipe_parent_to_child[2];
+
+  /* The replayed Native App gets its own (empty) cache directory */
+
+  snprintf(session->cache_dir, sizeof(session->cache_dir),
+    "/tmp/webcard_replay.XXXXXX");
+
+  if (NULL == mkdtemp(session->cache_dir))
+  {
+    perror("mkdtemp()");
+    session->cache_dir[0] = '\0';
+    return FALSE;
+  }
+
+  if (((-1) == pipe(pipe_child_to_parent)) ||
+    ((-1) == pipe(pipe_parent_to_child)))
+  {
+    perror("pipe()");
+    return FALSE;
+  }
+
+  session->child_pid = fork();
+
+  if ((-1) == session->child_pid)
+  {
+    perror("fork()");
+    return FALSE;
+  }
+
+  if (0 == session->child_pid)
+  {
+    /* Child process: becomes the "Webcard Native App" */
+
+    dup2(pipe_parent_to_child[READ_END], STDIN_FILENO);
+    dup2(pipe_child_to_parent[WRITE_END], STDOUT_FILENO);
+
+    close(pipe_parent_to_child[READ_END]);
+    close(pipe_parent_to_child[WRITE_END]);
+    close(pipe_child_to_parent[READ_END]);
+    close(pipe_child_to_parent[WRITE_END]);
+
+    setenv(WEBCARD_SIMULATOR_VARIABLE, options->farm_path, 1);
+    setenv("XDG_CACHE_HOME", session->cache_dir, 1);
+    setenv("HOME", session->cache_dir, 1);
+
+    execl(options->exec_path, options->exec_path, NULL);
+    perror(" @ execl()");
+    _exit(EXIT_FAILURE);
+  }
+
+  /* Parent process */
+
+  close(pipe_child_to_parent[WRITE_END]);
+  close(pipe_parent_to_child[READ_END]);
+
+  session->fd_read = pipe_child_to_parent[READ_END];
+  session->fd_write = pipe_parent_to_child[WRITE_END];
+
+  if (0 != fcntl(session->fd_read, F_SETFL, O_NONBLOCK))
+  {
+    perror("fcntl(fd_read, F_SETFL, O_NONBLOCK)");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+int
+remove_entry(const char *path, const struct stat *status, int flag, struct FTW *ftw)
+{
+  return remove(path);
+}
+
+/**************************************************************/
+
+BOOL
+write_all(int fd, const uint8_t *bytes, size_t length)
+{
+  ssize_t written;
+
+  while (length > 0)
+  {
+    written = write(fd, bytes, length);
+
+    if (written < 0)
+    {
+      if (EINTR == errno) { continue; }
+      perror("write()");
+      return FALSE;
+    }
+
+    bytes += written;
+    length -= (size_t) written;
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+BOOL
+send_request(session_t *session, request_t *request)
+{
+  const uint32_t length = (uint32_t) request->json_length;
+
+  request->sent = TRUE;
+  request->sent_ns = now_ns();
+
+  return
+    write_all(session->fd_write, (const uint8_t *) &(length), sizeof(uint32_t)) &&
+    write_all(session->fd_write, request->json, request->json_length);
+}
+
+/**************************************************************/
+
+/**
+ * Matches a response with the oldest unanswered request with the same "i".
+ */
+void
+handle_response(
+  replay_t *replay,
+  session_t *session,
+  const char *json,
+  size_t length,
+  uint64_t end_ns)
+{
+  size_t id_length = 0;
+  request_t *request;
+
+  /* Responses start with the "i" key, Reader Events don't */
+
+  if ((length < 8) || (0 != strncmp(json, "{\"i\":\"", 6)) || ('"' == json[6]))
+  {
+    session->events += 1;
+    return;
+  }
+
+  json = &(json[6]);
+  length -= 6;
+
+  while ((id_length < length) && ('"' != json[id_length]))
+  {
+    id_length++;
+  }
+
+  for (size_t i = 0; i < replay->request_count; i++)
+  {
+    request = &(replay->requests[i]);
+
+    if (request->sent && !request->done &&
+      (0 == strncmp(request->id, json, id_length)) &&
+      ('\0' == request->id[id_length]))
+    {
+      request->done = TRUE;
+      request->replayed_ns = end_ns - request->sent_ns;
+      request->replayed_failed =
+        (NULL != memmem(json, length, "\"incomplete\"", 12));
+
+      session->answered += 1;
+      return;
+    }
+  }
+}
+
+/**************************************************************/
+
+/**
+ * Reads whatever is available, then handles every complete frame.
+ */
+BOOL
+receive_responses(replay_t *replay, session_t *session, int timeout_ms)
+{
+  struct pollfd poll_fd;
+  ssize_t received;
+  uint32_t frame_length;
+  size_t offset;
+  uint64_t end_ns;
+  uint8_t *new_buf;
+
+  poll_fd.fd = session->fd_read;
+  poll_fd.events = POLLIN;
+  poll_fd.revents = 0;
+
+  if (poll(&(poll_fd), 1, timeout_ms) <= 0)
+  {
+    return TRUE;
+  }
+
+  while (TRUE)
+  {
+    if (session->buf_capacity - session->buf_length < 65536)
+    {
+      new_buf = realloc(session->buf, session->buf_capacity * 2);
+      if (NULL == new_buf) { return FALSE; }
+
+      session->buf = new_buf;
+      session->buf_capacity *= 2;
+    }
+
+    received = read(
+      session->fd_read,
+      &(session->buf[session->buf_length]),
+      session->buf_capacity - session->buf_length);
+
+    if (received > 0)
+    {
+      session->buf_length += (size_t) received;
+      continue;
+    }
+
+    if ((0 == received) ||
+      ((EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno)))
+    {
+      fprintf(stderr, "The Native App closed its output\n");
+      return FALSE;
+    }
+
+    break;
+  }
+
+  end_ns = now_ns();
+  offset = 0;
+
+  while ((session->buf_length - offset) >= sizeof(uint32_t))
+  {
+    memcpy(&(frame_length), &(session->buf[offset]), sizeof(uint32_t));
+
+    if ((session->buf_length - offset - sizeof(uint32_t)) < frame_length)
+    {
+      break;
+    }
+
+    handle_response(
+      replay,
+      session,
+      (const char *) &(session->buf[offset + sizeof(uint32_t)]),
+      frame_length,
+      end_ns);
+
+    offset += sizeof(uint32_t) + frame_length;
+  }
+
+  memmove(session->buf, &(session->buf[offset]), session->buf_length - offset);
+  session->buf_length -= offset;
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+/**
+ * Sends every request at its recorded time (scaled by the speed factor).
+ */
+BOOL
+run_replay(const options_t *options, replay_t *replay, session_t *session)
+{
+  size_t next = 0;
+  uint64_t now;
+  uint64_t due;
+  uint64_t deadline = 0;
+  int timeout_ms;
+  const uint64_t start = now_ns();
+
+  while (session->answered < replay->request_count)
+  {
+    now = now_ns();
+
+    while (next < replay->request_count)
+    {
+      due = start + (uint64_t) ((double) replay->requests[next].time / options->speed);
+      if (due > now) { break; }
+
+      if (!send_request(session, &(replay->requests[next]))) { return FALSE; }
+      next++;
+    }
+
+    if (next < replay->request_count)
+    {
+      timeout_ms = (int) ((due - now) / 1000000);
+      if (timeout_ms > 100) { timeout_ms = 100; }
+    }
+    else
+    {
+      if (0 == deadline)
+      {
+        deadline = now + (uint64_t) (options->wait * 1e9);
+      }
+
+      if (now >= deadline) { break; }
+
+      timeout_ms = 100;
+    }
+
+    if (!receive_responses(replay, session, timeout_ms)) { return FALSE; }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************/
+
+int
+compare_latencies(const void *left, const void *right)
+{
+  const uint64_t a = ((const uint64_t *) left)[0];
+  const uint64_t b = ((const uint64_t *) right)[0];
+
+  return (a > b) - (a < b);
+}
+
+/**************************************************************/
+
+double
+percentile_us(const uint64_t *sorted, size_t count, double fraction)
+{
+  size_t index;
+
+  if (0 == count) { return 0; }
+
+  index = (size_t) (fraction * (double) count);
+  if (index >= count) { index = count - 1; }
+
+  return (double) sorted[index] / 1000.0;
+}
+
+/**************************************************************/
+
+/**
+ * Prints recorded and replayed latencies of every command.
+ * Returns the number of requests that were never answered.
+ */
+size_t
+print_report(const replay_t *replay)
+{
+  uint64_t *recorded;
+  uint64_t *replayed;
+  size_t count;
+  size_t answered;
+  size_t recorded_failed;
+  size_t replayed_failed;
+  size_t missing = 0;
+  const request_t *request;
+
+  recorded = malloc(sizeof(uint64_t) * (1 + replay->request_count));
+  replayed = malloc(sizeof(uint64_t) * (1 + replay->request_count));
+
+  if ((NULL == recorded) || (NULL == replayed))
+  {
+    free(recorded);
+    free(replayed);
+    return replay->request_count;
+  }
+
+  printf("\nLatency in microseconds (recorded: inside the Native App,"
+    " replayed: round trip through the pipes)\n");
+  printf("%-7s %6s | %6s %10s %10s %10s | %6s %10s %10s %10s | %7s\n",
+    "command", "count",
+    "failed", "p50", "p99", "max",
+    "failed", "p50", "p99", "max",
+    "p50 +/-");
+
+  for (uint32_t command = 0; command <= MAX_COMMAND; command++)
+  {
+    count = 0;
+    answered = 0;
+    recorded_failed = 0;
+    replayed_failed = 0;
+
+    for (size_t i = 0; i < replay->request_count; i++)
+    {
+      request = &(replay->requests[i]);
+
+      if ((request->command != command) &&
+        !((MAX_COMMAND == command) && (request->command > MAX_COMMAND)))
+      {
+        continue;
+      }
+
+      recorded[count++] = request->recorded_ns;
+      if (request->recorded_failed) { recorded_failed += 1; }
+
+      if (request->done)
+      {
+        replayed[answered++] = request->replayed_ns;
+        if (request->replayed_failed) { replayed_failed += 1; }
+      }
+      else
+      {
+        missing += 1;
+      }
+    }
+
+    if (0 == count) { continue; }
+
+    qsort(recorded, count, sizeof(uint64_t), compare_latencies);
+    qsort(replayed, answered, sizeof(uint64_t), compare_latencies);
+
+    printf("%-7u %6zu | %6zu %10.1f %10.1f %10.1f | %6zu %10.1f %10.1f %10.1f | %+6.0f%%\n",
+      command,
+      count,
+      recorded_failed,
+      percentile_us(recorded, count, 0.50),
+      percentile_us(recorded, count, 0.99),
+      (double) recorded[count - 1] / 1000.0,
+      replayed_failed + (count - answered),
+      percentile_us(replayed, answered, 0.50),
+      percentile_us(replayed, answered, 0.99),
+      (answered > 0) ? (double) replayed[answered - 1] / 1000.0 : 0,
+      (answered > 0) ?
+        (100.0 * (percentile_us(replayed, answered, 0.50) /
+          percentile_us(recorded, count, 0.50) - 1.0)) :
+        0);
+  }
+
+  free(recorded);
+  free(replayed);
+
+  return missing;
+}
+
+/**************************************************************/
+
+void
+free_replay(replay_t *replay)
+{
+  for (size_t i = 0; i < replay->card_count; i++)
+  {
+    for (size_t j = 0; j < replay->cards[i].response_count; j++)
+    {
+      UTF8String_destroy(&(replay->cards[i].responses[j].command));
+      UTF8String_destroy(&(replay->cards[i].responses[j].response));
+    }
+
+    free(replay->cards[i].responses);
+  }
+
+  for (size_t i = 0; i < replay->reader_count; i++)
+  {
+    free(replay->readers[i].steps);
+  }
+
+  free(replay->cards);
+  free(replay->readers);
+  free(replay->requests);
+  free(replay->file);
+}
+
+/**************************************************************/
+
+int
+main(int argc, char **argv)
+{
+  options_t options;
+  replay_t replay;
+  session_t session;
+  BOOL test_bool;
+  size_t missing;
+
+  if (!parse_options(argc, argv, &(options)))
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  memset(&(replay), 0x00, sizeof(replay_t));
+  memset(&(session), 0x00, sizeof(session_t));
+
+  test_bool =
+    load_file(options.trace_path, &(replay)) &&
+    analyze_trace(&(options), &(replay)) &&
+    save_farm(&(options), &(replay));
+
+  if (!test_bool)
+  {
+    free_replay(&(replay));
+    return EXIT_FAILURE;
+  }
+
+  qsort(replay.requests, replay.request_count, sizeof(request_t), compare_requests);
+
+  printf("Requests: %zu to replay, %zu skipped (truncated, unparsable or trace commands)\n",
+    replay.request_count,
+    replay.skipped);
+
+  if (options.farm_only)
+  {
+    free_replay(&(replay));
+    return EXIT_SUCCESS;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  session.buf_capacity = 131072;
+  session.buf = malloc(session.buf_capacity);
+
+  test_bool =
+    (NULL != session.buf) &&
+    spawn_host(&(options), &(session)) &&
+    run_replay(&(options), &(replay), &(session));
+
+  if (session.child_pid > 0)
+  {
+    close(session.fd_write);
+    close(session.fd_read);
+    waitpid(session.child_pid, NULL, 0);
+  }
+
+  if ('\0' != session.cache_dir[0])
+  {
+    nftw(session.cache_dir, remove_entry, 16, (FTW_DEPTH | FTW_PHYS));
+  }
+
+  missing = print_report(&(replay));
+
+  printf("\n%zu answered, %zu unanswered, %zu reader events\n",
+    session.answered,
+    missing,
+    session.events);
+
+  free(session.buf);
+  free_replay(&(replay));
+
+  return (test_bool && (0 == missing)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**************************************************************/
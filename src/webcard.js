@@ -15,12 +15,22 @@ function Reader(index, name, atr) {
     self.index = index;
     self.name = name;
     self.atr = atr;
+    self.prefetched = undefined;
+    self.prefetchIncomplete = undefined;
     self.connected = undefined;
     self.connectStartTime = null;
 
-    self.connect = (shared) => {
+    // While another tab is connected to this reader, the promise waits
+    // for it to disconnect. Waiting requests with higher `priority` go first.
+    // `restore` (hex cAPDUs, e.g. a SELECT) is replayed by the Native App
+    // when another application resets the card, before retrying the APDU.
+    // With `elideSelect`, a SELECT of what is already selected is answered
+    // without a card exchange (exclusive connections only, ignored when shared).
+    self.connect = (shared, priority, restore, elideSelect) => {
         self.connectStartTime = Date.now();
-        return navigator.webcard.send(2, { r: self.index, p: shared ? 2 : 1 });
+        return navigator.webcard.send(2, {
+            r: self.index, p: shared ? 2 : 1, q: priority, d: restore, e: elideSelect ? 1 : undefined
+        });
     };
 
     self.disconnect = () => {
@@ -40,8 +50,17 @@ function Reader(index, name, atr) {
         return p;
     };
 
-    self.transceive = (apdu) =>
-        navigator.webcard.send(4, { r: self.index, a: apdu });
+    // With `timeout` (ms), the promise is rejected with 'timeout'
+    // once the Native App gives up on the command. Only the promise is
+    // released: an APDU already sent to the card still blocks the reader
+    // (and the Native App) until the card answers.
+    self.transceive = (apdu, timeout) =>
+        navigator.webcard.send(4, { r: self.index, a: apdu, t: timeout });
+
+    // Debounce window (ms) for card events of this reader.
+    // A negative value restores the default window.
+    self.setDebounce = (window) =>
+        navigator.webcard.send(11, { r: self.index, p: window });
 }
 
 /******************************************************************************/
@@ -49,6 +68,7 @@ function Reader(index, name, atr) {
 function WebCard(options = {}) {
     let self = this;
     let _readerList;
+    let _eventFragments = [];
 
     console.info('Starting WebCard...');
 
@@ -153,8 +173,9 @@ function WebCard(options = {}) {
     // Remember all pending JavaScript Promises.
     self.pendingRequests = new Map();
 
-    // Command-sending wrapper method.
-    self.send = (cmdIdx, otherParams) => {
+    // Command-sending wrapper method
+    // (`onUpdate` receives the partial results of streamed commands).
+    self.send = (cmdIdx, otherParams, onUpdate) => {
         if (!self.isReady) {
             return new Promise((_, reject) => reject());
         }
@@ -164,7 +185,8 @@ function WebCard(options = {}) {
 
             self.pendingRequests.set(
                 uid,
-                { c: cmdIdx, resolve: resolve, reject: reject });
+                { c: cmdIdx, resolve: resolve, reject: reject,
+                  onUpdate: onUpdate, updates: [] });
 
             try {
                 window.postMessage(
@@ -255,6 +277,95 @@ function WebCard(options = {}) {
     self.getReaders = () => self.send(1);
     self.readers = self.getReaders;
 
+    // Receive only selected Reader Events, e.g.:
+    // `{ e: [1, 2], r: [0], a: '3B8F80', m: 'FFFFF0' }` (all keys optional)
+    // e: event numbers, r: reader indices, a: ATR pattern (hex), m: ATR mask (hex)
+    self.subscribe = (filters = {}) => self.send(12, filters);
+
+    // Stop receiving Reader Events in this tab.
+    self.unsubscribe = () => self.send(13);
+
+    // Default debounce window (ms) for card events of all readers.
+    // Resolves with `[{w: window, s: suppressedTransitions}, ...]`.
+    self.setDebounce = (window) => self.send(11, { p: window });
+
+    // Native cache of responses to idempotent commands (opt-in), e.g.:
+    // `{ budget: 65536, instructions: 'B0CA' }` (all keys optional, budget 0 disables)
+    // Resolves with cache statistics `{p, b, n, h, m, e}`.
+    self.configureCache = ({ budget, instructions } = {}) =>
+        self.send(14, { p: budget, a: instructions });
+
+    // Cache kept on disk across browser sessions, for cards identified
+    // by ATR + response to `serialApdu`, e.g.:
+    // `{ size: 1048576, serialApdu: 'FFCA000000', lifetime: 86400 }` (size 0 deletes the file)
+    // Resolves with cache statistics `{p, b, n, h, m, e, x}`.
+    self.configureCardCache = ({ size, serialApdu, lifetime } = {}) =>
+        self.send(15, { p: size, a: serialApdu, l: lifetime });
+
+    // Commands sent to every newly inserted card (matching the optional
+    // reader and ATR filters) before `cardInserted` is called, e.g.:
+    // `{ k: 'emv', a: '3B', m: 'FF', d: ['00A404000E325041592E5359532E444446303100'] }`
+    // Responses end up in `reader.prefetched`. Empty `d` removes the script named `k`.
+    // `reader.prefetchIncomplete` is true when the script was cut short
+    // (failed command or card removed): `prefetched` then holds fewer responses.
+    self.setPrefetch = (script) => self.send(16, script);
+
+    // Latency histograms (nanoseconds) of every command stage and of every reader,
+    // `{t, c: [{c, f, read, parse, run, serialize, write, total}], r: [{n, x}]}`.
+    // `reset` clears them after reporting.
+    self.getStats = (reset = false) => self.send(17, { z: reset ? 1 : 0 });
+
+    // Binary trace of requests, APDUs and card events, written to
+    // "apdu_trace.bin" (ring of `size` bytes, at least 65536; 0 stops tracing).
+    // Without `size` only reports `{p, b, n, x}`.
+    self.trace = (size) => self.send(18, { p: size });
+
+    // Log level of the Native App (0-off, 1-error, 2-warning, 3-info, 4-debug,
+    // 5-trace), written to its stderr. Without `level` only reports `{p, x}`.
+    self.setLogLevel = (level) => self.send(19, { p: level });
+
+    // Cancels a pending request (`uid` returned by `sendEx`), which is then
+    // rejected with 'cancelled'. Resolves with 0-not found (already answered),
+    // 1-removed from the queue, 2-interrupted while running (an APDU already
+    // sent to the card still completes, as with `transceive` timeouts).
+    self.cancel = (uid) => self.send(20, { k: uid });
+
+    // Shared connections stay open for `time` ms after a disconnect (0 disables
+    // it), so that the next shared connect to the same reader is instant.
+    // Exclusive connections are always closed.
+    // Without `time` only reports `{p, n, h, m, x}`.
+    self.setLinger = (time) => self.send(21, { p: time });
+
+    // Sends the same command APDUs to many readers at once (one thread
+    // per reader), e.g. `fanOut(['00A4040007A0000000041010'], { readers: [0, 2] })`.
+    // Without `readers`, every reader with a (matching) card that is not used
+    // by another tab; `atr` and `mask` filter the cards like `subscribe`.
+    // Other requests are served meanwhile (the native app does not wait).
+    // Resolves with `[{r: reader index, d: [responses], incomplete?}, ...]`
+    // (`r` is missing when the reader was unplugged meanwhile);
+    // with `onResult`, every reader is also reported as soon as it is done.
+    self.fanOut = (apdus, { readers, atr, mask, onResult } = {}) =>
+        self.send(
+            22,
+            { d: apdus, r: readers, a: atr, m: mask, s: onResult ? 1 : 0 },
+            onResult);
+
+    // Production line: every card inserted into the selected readers gets
+    // the next job at once, without waiting for the page, e.g.
+    // `jobs({ script: ['00A4040007A0000000041010', '00DA0101{0}'], readers: [0, 1],
+    // queue: [['03AABBCC'], ['03DDEEFF']] })`, where `{n}` stands for the n-th
+    // hex parameter of a job. `readers`, `atr` and `mask` select the readers
+    // like `fanOut`; `clear` drops the waiting jobs, `reset` clears the
+    // counters after reporting. Every job ends up in `jobDone(result, reader)`,
+    // `result` being `{j: job number, d: [responses], t: ms, incomplete?}`.
+    // Resolves with `{p: waiting, b: busy readers, n: done, f: failed,
+    // h: cards per hour, k: first queued job, r: [{n, j, f, t, u: busy %}]}`.
+    self.jobs = ({ script, readers, atr, mask, queue, clear, reset } = {}) =>
+        self.send(23, {
+            d: script, r: readers, a: atr, m: mask, j: queue,
+            x: clear ? 1 : 0, z: reset ? 1 : 0
+        });
+
     // Handling content script (Native App) responses.
     self.responseCallback = (msg) => {
         if (typeof msg !== 'object') {
@@ -262,6 +373,22 @@ function WebCard(options = {}) {
         }
 
         if (msg.e) {
+            // [Join the fragments of a reader event over 1 MB, sent in order]
+            if (msg.f) {
+                if (msg.f[0] === 0) {
+                    _eventFragments = [];
+                }
+
+                _eventFragments.push(msg.t);
+
+                if (_eventFragments.length < msg.f[1]) {
+                    return;
+                }
+
+                msg = JSON.parse(_eventFragments.join(''));
+                _eventFragments = [];
+            }
+
             switch (msg.e) {
                 // [Reject any pending promises]
                 case (-1): {
@@ -276,6 +403,8 @@ function WebCard(options = {}) {
                 // [Card inserted]
                 case 1: {
                     _readerList[msg.r].atr = msg.d;
+                    _readerList[msg.r].prefetched = msg.p;
+                    _readerList[msg.r].prefetchIncomplete = (undefined !== msg.p) ? (1 === msg.x) : undefined;
                     self.cardInserted?.(_readerList[msg.r]);
                     break;
                 }
@@ -283,6 +412,8 @@ function WebCard(options = {}) {
                 // [Card removed]
                 case 2: {
                     _readerList[msg.r].atr = "";
+                    _readerList[msg.r].prefetched = undefined;
+                    _readerList[msg.r].prefetchIncomplete = undefined;
                     self.cardRemoved?.(_readerList[msg.r]);
                     break;
                 }
@@ -298,6 +429,12 @@ function WebCard(options = {}) {
                     self.readersDisconnected?.(msg.n);
                     break;
                 }
+
+                // [Production-line job done]
+                case 5: {
+                    self.jobDone?.(msg.d, _readerList?.[msg.r]);
+                    break;
+                }
             }
 
             return;
@@ -314,10 +451,35 @@ function WebCard(options = {}) {
             return;
         }
 
+        if (msg.f) {
+            // Fragment of a message over the 1 MB limit of Native Messaging
+            // (fragments arrive in order, the last one completes the message).
+            request.fragments ??= [];
+            request.fragments.push(msg.t);
+
+            if (request.fragments.length < msg.f[1]) {
+                return;
+            }
+
+            msg = { ...JSON.parse(request.fragments.join('')), i: msg.i };
+            request.fragments = undefined;
+        }
+
+        if (msg.u) {
+            // Partial result of a streamed command (more to come).
+            request.updates.push(msg.u);
+            request.onUpdate?.(msg.u);
+            return;
+        }
+
         if (msg.incomplete) {
             // Response marked as incomplete
-            // (error on the Native App's side).
-            request.reject();
+            // (error on the Native App's side,
+            // or the deadline has passed / request was cancelled).
+            request.reject(
+                (1 === msg.x) ? 'timeout' :
+                (2 === msg.x) ? 'cancelled' :
+                undefined);
         } else switch (request.c) {
             // [List readers]
             case 1: {
@@ -337,8 +499,8 @@ function WebCard(options = {}) {
                 break;
             }
 
-            // [Connect] and [Transceive]
-            case 2: case 4: {
+            // [Connect], [Transceive] and [Debounce]
+            case 2: case 4: case 11: case 14: case 15: {
                 if (msg.d) {
                     request.resolve(msg.d);
                 } else {
@@ -348,6 +510,18 @@ function WebCard(options = {}) {
                 break;
             }
 
+            // [Statistics], [Trace], [Log level], [Cancel], [Linger] and [Jobs]
+            case 17: case 18: case 19: case 20: case 21: case 23: {
+                request.resolve(msg.d);
+                break;
+            }
+
+            // [Fan-out] (streamed results were collected meanwhile)
+            case 22: {
+                request.resolve(msg.d ?? request.updates);
+                break;
+            }
+
             // [Get Version]
             case 10: {
                 request.resolve(msg);